@@ -115,7 +115,7 @@ int ReverseLookup(SOCKADDR * sa, int salen, char * buf, int buflen)
     int hostlen = NI_MAXHOST, rc;
     HRESULT hRet;
 
-    rc = getnameinfo(sa, salen, host, hostlen, NULL, 0, 0);
+    rc = DnsCacheGetNameInfo(sa, salen, host, hostlen, 0);
     if (rc != 0) {
         fprintf(stderr, "getnameinfo failed: %d\n", rc);
         return rc;
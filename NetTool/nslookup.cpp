@@ -359,137 +359,54 @@ BOOL IsValidIP(PCHAR pInput)
 }
 
 
-int ExtractName(PCHAR pBuffer, PCHAR pOutput, USHORT Offset, UCHAR Limit)
+BOOL ExtractName(PCHAR pBuffer, DWORD BufferLength, USHORT Offset, PCHAR pOutput, SIZE_T OutputLength)
 {
-    int c = 0, d = 0, i = 0, j = 0, k = 0, l = 0, m = 0;
-
-    i = Offset;
-
-    /* If Limit == 0, then we assume "no" limit. */
-    d = Limit;
-    if (0 == Limit)
-        d = 255;
-
-    while (d > 0) {
-        l = pBuffer[i] & 0xFF;
-        i += 1;
-        if (!m)
-            c += 1;
-
-        if (0xC0 == l) {
-            if (!m)
-                c += 1;
-            m = 1;
-            d += (255 - Limit);
-            i = pBuffer[i];
-        } else {
-            for (j = 0; j < l; j += 1) {
-                pOutput[k] = pBuffer[i];
-
-                i += 1;
-                if (!m)
-                    c += 1;
-                k += 1;
-                d -= 1;
-            }
-
-            d -= 1;
-
-            if (!pBuffer[i] || (d < 1))
-                break;
-
-            pOutput[k] = '.';
-            k += 1;
-        }
-    };
-
-    if (!m) {
-        if (!Limit)
-            c += 1;
-    }
-
-    pOutput[k] = '\0';
-
-    return c;
+    /* Bounds checked, follows 14-bit compression pointers and rejects pointer loops. */
+    return ERROR_SUCCESS == DnsWireReadName((PBYTE)pBuffer, BufferLength, Offset, pOutput, OutputLength, NULL);
 }
 
 
-int ExtractIP(PCHAR pBuffer, PCHAR pOutput, USHORT Offset)
+BOOL ExtractIP(PCHAR pBuffer, const DNS_WIRE_RECORD * Record, PCHAR pOutput, SIZE_T OutputLength)
 {
-    int c = 0, l = 0, i = 0, v = 0;
-
-    i = Offset;
-
-    v = (UCHAR)pBuffer[i];
-    l += 1;
-    i += 1;
-
-    sprintf(&pOutput[c], "%d.", v);
-    c += strlen(&pOutput[c]);
-
-    v = (UCHAR)pBuffer[i];
-    l += 1;
-    i += 1;
+    PBYTE p = (PBYTE)&pBuffer[Record->Data];
 
-    sprintf(&pOutput[c], "%d.", v);
-    c += strlen(&pOutput[c]);
-
-    v = (UCHAR)pBuffer[i];
-    l += 1;
-    i += 1;
-
-    sprintf(&pOutput[c], "%d.", v);
-    c += strlen(&pOutput[c]);
-
-    v = (UCHAR)pBuffer[i];
-    l += 1;
-    i += 1;
+    /* DnsWireParse already checked that the RDATA lies within the packet. */
+    if (4 == Record->DataLength) {
+        StringCchPrintfA(pOutput, OutputLength, "%d.%d.%d.%d", p[0], p[1], p[2], p[3]);
+        return TRUE;
+    }
 
-    sprintf(&pOutput[c], "%d", v);
-    c += strlen(&pOutput[c]);
+    if (16 == Record->DataLength)
+        return NULL != InetNtopA(AF_INET6, p, pOutput, OutputLength);
 
-    pOutput[c] = '\0';
+    if (OutputLength)
+        pOutput[0] = '\0';
 
-    return l;
+    return FALSE;
 }
 
 
 void PrintD2(PCHAR pBuffer, DWORD BufferLength)
 {
-    USHORT RequestID;
+    DNS_WIRE_MESSAGE Message;
+    DNS_WIRE_RECORD Records[MAX_RECORDS];
     UCHAR Header1, Header2;
-    USHORT NumQuestions, NumAnswers, NumAuthority, NumAdditional;
-    USHORT Type, Class;
-    CHAR pName[255];
-    int i = 0, k = 0;
+    CHAR pName[DNS_WIRE_MAX_NAME_TEXT];
+    ULONG ret, Count, k;
 
-    RequestID = ntohs(((PUSHORT)&pBuffer[i])[0]);
-    i += 2;
-
-    Header1 = pBuffer[i];
-    i += 1;
+    /* Parse the packet once, the records are in section order. */
+    ret = DnsWireParse((PBYTE)pBuffer, BufferLength, &Message, Records, _ARRAYSIZE(Records));
+    Count = min(Message.Records, (ULONG)_ARRAYSIZE(Records));
 
-    Header2 = pBuffer[i];
-    i += 1;
-
-    NumQuestions = ntohs(((PSHORT)&pBuffer[i])[0]);
-    i += 2;
-
-    NumAnswers = ntohs(((PSHORT)&pBuffer[i])[0]);
-    i += 2;
-
-    NumAuthority = ntohs(((PUSHORT)&pBuffer[i])[0]);
-    i += 2;
-
-    NumAdditional = ntohs(((PUSHORT)&pBuffer[i])[0]);
-    i += 2;
+    Header1 = (UCHAR)(Message.Flags >> 8);
+    Header2 = (UCHAR)Message.Flags;
 
     printf(("------------\n"));
     printf(("SendRequest(), len %d\n"), (int)BufferLength);
     printf(("    HEADER:\n"));
     printf("        opcode = %s, id = %d, rcode = %s\n",
            OpcodeIDtoOpcodeName((Header1 & 0x78) >> 3),
-           (int)RequestID,
+           (int)Message.Id,
            RCodeIDtoRCodeName(Header2 & 0x0F));
 
     printf(("        header flags:  query"));
@@ -499,70 +416,53 @@ void PrintD2(PCHAR pBuffer, DWORD BufferLength)
 
     printf(("        questions = %d,  answers = %d,"
             "  authority records = %d,  additional = %d\n\n"),
-           (int)NumQuestions,
-           (int)NumAnswers,
-           (int)NumAuthority,
-           (int)NumAdditional);
+           (int)Message.Count[DNS_SECTION_QUESTION],
+           (int)Message.Count[DNS_SECTION_ANSWER],
+           (int)Message.Count[DNS_SECTION_AUTHORITY],
+           (int)Message.Count[DNS_SECTION_ADDITIONAL]);
 
-    if (NumQuestions) {
+    if (Message.Count[DNS_SECTION_QUESTION]) {
         printf(("    QUESTIONS:\n"));
 
-        for (k = 0; k < NumQuestions; k += 1) {
-            i += ExtractName(pBuffer, pName, i, 0);
+        for (k = 0; k < Message.Count[DNS_SECTION_QUESTION] && k < Count; k += 1) {
+            ExtractName(pBuffer, BufferLength, Records[k].Name, pName, sizeof(pName));
 
             printf("        %s", pName);
-
-            Type = ntohs(((PUSHORT)&pBuffer[i])[0]);
-            i += 2;
-
-            Class = ntohs(((PUSHORT)&pBuffer[i])[0]);
-            i += 2;
-
-            printf((", type = %s, class = %s\n"), TypeIDtoTypeName(Type), ClassIDtoClassName(Class));
+            printf((", type = %s, class = %s\n"),
+                   TypeIDtoTypeName(Records[k].Type),
+                   ClassIDtoClassName(Records[k].Class));
         }
     }
 
+    if (ERROR_INVALID_DATA == ret)
+        printf(("    *** malformed packet\n"));
+
     printf(("\n------------\n"));
 }
 
 
 void PrintDebug(PCHAR pBuffer, DWORD BufferLength)
 {
-    USHORT ResponseID;
+    DNS_WIRE_MESSAGE Message;
+    DNS_WIRE_RECORD Records[MAX_RECORDS];
+    PDNS_WIRE_RECORD Record;
     UCHAR Header1, Header2;
-    USHORT NumQuestions, NumAnswers, NumAuthority, NumAdditional;
-    USHORT Type, Class;
-    ULONG TTL;
-    CHAR pName[255];
-    int d = 0, i = 0, k = 0;
+    CHAR pName[DNS_WIRE_MAX_NAME_TEXT];
+    ULONG ret, Count, Consumed, i = 0, j = 0, k = 0;
 
-    ResponseID = ntohs(((PUSHORT)&pBuffer[i])[0]);
-    i += 2;
+    /* Parse the packet once, the records are in section order. */
+    ret = DnsWireParse((PBYTE)pBuffer, BufferLength, &Message, Records, _ARRAYSIZE(Records));
+    Count = min(Message.Records, (ULONG)_ARRAYSIZE(Records));
 
-    Header1 = pBuffer[i];
-    i += 1;
-
-    Header2 = pBuffer[i];
-    i += 1;
-
-    NumQuestions = ntohs(((PSHORT)&pBuffer[i])[0]);
-    i += 2;
-
-    NumAnswers = ntohs(((PSHORT)&pBuffer[i])[0]);
-    i += 2;
-
-    NumAuthority = ntohs(((PUSHORT)&pBuffer[i])[0]);
-    i += 2;
-
-    NumAdditional = ntohs(((PUSHORT)&pBuffer[i])[0]);
-    i += 2;
+    Header1 = (UCHAR)(Message.Flags >> 8);
+    Header2 = (UCHAR)Message.Flags;
 
     printf(("------------\n"));
     printf(("Got answer (%d bytes):\n"), (int)BufferLength);
     printf(("    HEADER:\n"));
     printf(("        opcode = %s, id = %d, rcode = %s\n"),
            OpcodeIDtoOpcodeName((Header1 & 0x78) >> 3),
-           (int)ResponseID,
+           (int)Message.Id,
            RCodeIDtoRCodeName(Header2 & 0x0F));
 
     printf(("        header flags:  response"));
@@ -574,170 +474,141 @@ void PrintDebug(PCHAR pBuffer, DWORD BufferLength)
 
     printf(("        questions = %d,  answers = %d,  "
             "authority records = %d,  additional = %d\n\n"),
-           (int)NumQuestions,
-           (int)NumAnswers,
-           (int)NumAuthority,
-           (int)NumAdditional);
+           (int)Message.Count[DNS_SECTION_QUESTION],
+           (int)Message.Count[DNS_SECTION_ANSWER],
+           (int)Message.Count[DNS_SECTION_AUTHORITY],
+           (int)Message.Count[DNS_SECTION_ADDITIONAL]);
 
-    if (NumQuestions) {
+    if (Message.Count[DNS_SECTION_QUESTION]) {
         printf(("    QUESTIONS:\n"));
 
-        for (k = 0; k < NumQuestions; k += 1) {
-            i += ExtractName(pBuffer, pName, i, 0);
+        for (k = 0; k < Message.Count[DNS_SECTION_QUESTION] && i < Count; k += 1, i += 1) {
+            ExtractName(pBuffer, BufferLength, Records[i].Name, pName, sizeof(pName));
 
             printf(("        %s"), pName);
-
-            Type = ntohs(((PUSHORT)&pBuffer[i])[0]);
-            i += 2;
-
-            Class = ntohs(((PUSHORT)&pBuffer[i])[0]);
-            i += 2;
-
-            printf((", type = %s, class = %s\n"), TypeIDtoTypeName(Type), ClassIDtoClassName(Class));
+            printf((", type = %s, class = %s\n"),
+                   TypeIDtoTypeName(Records[i].Type),
+                   ClassIDtoClassName(Records[i].Class));
         }
     }
 
-    if (NumAnswers) {
+    if (Message.Count[DNS_SECTION_ANSWER]) {
         printf(("    ANSWERS:\n"));
 
-        for (k = 0; k < NumAnswers; k += 1) {
+        for (k = 0; k < Message.Count[DNS_SECTION_ANSWER] && i < Count; k += 1, i += 1) {
+            Record = &Records[i];
             printf(("    ->  "));
 
             /* Print out the name. */
-            i += ExtractName(pBuffer, pName, i, 0);
+            ExtractName(pBuffer, BufferLength, Record->Name, pName, sizeof(pName));
 
             printf(("%s\n"), pName);
 
             /* Print out the type, class and data length. */
-            Type = ntohs(((PUSHORT)&pBuffer[i])[0]);
-            i += 2;
-
-            Class = ntohs(((PUSHORT)&pBuffer[i])[0]);
-            i += 2;
-
-            TTL = ntohl(((PULONG)&pBuffer[i])[0]);
-            i += 4;
-
-            d = ntohs(((PUSHORT)&pBuffer[i])[0]);
-            i += 2;
-
             printf(("        type = %s, class = %s, dlen = %d\n"),
-                   TypeIDtoTypeName(Type),
-                   ClassIDtoClassName(Class),
-                   d);
+                   TypeIDtoTypeName(Record->Type),
+                   ClassIDtoClassName(Record->Class),
+                   (int)Record->DataLength);
 
             /* Print out the answer. */
-            if (TYPE_A == Type) {
-                i += ExtractIP(pBuffer, pName, i);
+            if (TYPE_A == Record->Type) {
+                ExtractIP(pBuffer, Record, pName, sizeof(pName));
 
                 printf(("        internet address = %s\n"), pName);
             } else {
-                i += ExtractName(pBuffer, pName, i, d);
+                ExtractName(pBuffer, BufferLength, Record->Data, pName, sizeof(pName));
 
                 printf(("        name = %s\n"), pName);
             }
 
-            printf(("        ttl = %d ()\n"), (int)TTL);
+            printf(("        ttl = %d ()\n"), (int)Record->Ttl);
         }
     }
 
-    if (NumAuthority) {
+    if (Message.Count[DNS_SECTION_AUTHORITY]) {
         printf(("    AUTHORITY RECORDS:\n"));
 
-        for (k = 0; k < NumAuthority; k += 1) {
+        for (k = 0; k < Message.Count[DNS_SECTION_AUTHORITY] && i < Count; k += 1, i += 1) {
+            Record = &Records[i];
+
             /* Print out the zone name. */
-            i += ExtractName(pBuffer, pName, i, 0);
+            ExtractName(pBuffer, BufferLength, Record->Name, pName, sizeof(pName));
 
             printf(("    ->  %s\n"), pName);
 
             /* Print out the type, class, data length and TTL. */
-            Type = ntohs(((PUSHORT)&pBuffer[i])[0]);
-            i += 2;
-
-            Class = ntohs(((PUSHORT)&pBuffer[i])[0]);
-            i += 2;
-
-            TTL = ntohl(((PULONG)&pBuffer[i])[0]);
-            i += 4;
-
-            d = ntohs(((PUSHORT)&pBuffer[i])[0]);
-            i += 2;
-
             printf(("        type = %s, class = %s, dlen = %d\n"),
-                   TypeIDtoTypeName(Type),
-                   ClassIDtoClassName(Class),
-                   d);
+                   TypeIDtoTypeName(Record->Type),
+                   ClassIDtoClassName(Record->Class),
+                   (int)Record->DataLength);
 
             /* TODO: There might be more types? */
-            if (TYPE_NS == Type) {
+            if (TYPE_NS == Record->Type) {
                 /* Print out the NS. */
-                i += ExtractName(pBuffer, pName, i, d);
+                ExtractName(pBuffer, BufferLength, Record->Data, pName, sizeof(pName));
 
                 printf(("        nameserver = %s\n"), pName);
 
-                printf(("        ttl = %d ()\n"), (int)TTL);
-            } else if (TYPE_SOA == Type) {
-                printf(("        ttl = %d ()\n"), (int)TTL);
+                printf(("        ttl = %d ()\n"), (int)Record->Ttl);
+            } else if (TYPE_SOA == Record->Type) {
+                printf(("        ttl = %d ()\n"), (int)Record->Ttl);
 
                 /* Print out the primary NS. */
-                i += ExtractName(pBuffer, pName, i, 0);
+                j = Record->Data;
+                DnsWireReadName((PBYTE)pBuffer, BufferLength, j, pName, sizeof(pName), &Consumed);
+                j += Consumed;
 
                 printf(("        primary name server = %s\n"), pName);
 
                 /* Print out the responsible mailbox. */
-                i += ExtractName(pBuffer, pName, i, 0);
+                DnsWireReadName((PBYTE)pBuffer, BufferLength, j, pName, sizeof(pName), &Consumed);
+                j += Consumed;
 
                 printf(("        responsible mail addr = %s\n"), pName);
 
                 /* Print out the serial, refresh, retry, expire and default TTL. */
-                printf(("        serial = ()\n"));
-                printf(("        refresh = ()\n"));
-                printf(("        retry = ()\n"));
-                printf(("        expire = ()\n"));
-                printf(("        default TTL = ()\n"));
-                i += 20;
+                if (Consumed && j + 20 <= (ULONG)Record->Data + Record->DataLength) {
+                    printf(("        serial = %lu\n"), ntohl(((PULONG)&pBuffer[j])[0]));
+                    printf(("        refresh = %lu\n"), ntohl(((PULONG)&pBuffer[j + 4])[0]));
+                    printf(("        retry = %lu\n"), ntohl(((PULONG)&pBuffer[j + 8])[0]));
+                    printf(("        expire = %lu\n"), ntohl(((PULONG)&pBuffer[j + 12])[0]));
+                    printf(("        default TTL = %lu\n"), ntohl(((PULONG)&pBuffer[j + 16])[0]));
+                }
             }
         }
     }
 
-    if (NumAdditional) {
+    if (Message.Count[DNS_SECTION_ADDITIONAL]) {
         printf(("    ADDITIONAL:\n"));
 
-        for (k = 0; k < NumAdditional; k += 1) {
+        for (k = 0; k < Message.Count[DNS_SECTION_ADDITIONAL] && i < Count; k += 1, i += 1) {
+            Record = &Records[i];
+
             /* Print the name. */
-            i += ExtractName(pBuffer, pName, i, 0);
+            ExtractName(pBuffer, BufferLength, Record->Name, pName, sizeof(pName));
 
             printf(("    ->  %s\n"), pName);
 
             /* Print out the type, class, data length and TTL. */
-            Type = ntohs(((PUSHORT)&pBuffer[i])[0]);
-            i += 2;
-
-            Class = ntohs(((PUSHORT)&pBuffer[i])[0]);
-            i += 2;
-
-            TTL = ntohl(((PULONG)&pBuffer[i])[0]);
-            i += 4;
-
-            d = ntohs(((PUSHORT)&pBuffer[i])[0]);
-            i += 2;
-
             printf(("        type = %s, class = %s, dlen = %d\n"),
-                   TypeIDtoTypeName(Type),
-                   ClassIDtoClassName(Class),
-                   d);
+                   TypeIDtoTypeName(Record->Type),
+                   ClassIDtoClassName(Record->Class),
+                   (int)Record->DataLength);
 
             /* TODO: There might be more types? */
-            if (TYPE_A == Type) {
+            if (TYPE_A == Record->Type) {
                 /* Print out the NS. */
-                i += ExtractIP(pBuffer, pName, i);
+                ExtractIP(pBuffer, Record, pName, sizeof(pName));
 
                 printf(("        internet address = %s\n"), pName);
-                printf(("        ttl = %d ()\n"), (int)TTL);
+                printf(("        ttl = %d ()\n"), (int)Record->Ttl);
             }
         }
     }
 
+    if (ERROR_INVALID_DATA == ret)
+        printf(("    *** malformed packet\n"));
+
     printf(("\n------------\n"));
 }
 
@@ -922,17 +793,19 @@ void PrintUsage()
             " using 'server'\n"));
 }
 
-BOOL PerformInternalLookup(PCHAR pAddr, PCHAR pResult)
+BOOL PerformInternalLookup(PCHAR pAddr, PCHAR pResult, SIZE_T ResultLength)
 {
     /* Needed to issue DNS packets and parse them. */
     PCHAR Buffer = NULL, RecBuffer = NULL;
     CHAR pResolve[256];
     ULONG BufferLength = 0, RecBufferLength = 512;
-    int i = 0, j = 0, k = 0, d = 0;
+    int i = 0, j = 0, k = 0;
     BOOL bOk = FALSE;
 
     /* Makes things easier when parsing the response packet. */
-    USHORT NumQuestions;
+    DNS_WIRE_MESSAGE Message;
+    DNS_WIRE_RECORD Records[MAX_RECORDS];
+    ULONG ret;
     USHORT Type;
 
     if ((strlen(pAddr) + 1) > 255)
@@ -1026,33 +899,22 @@ BOOL PerformInternalLookup(PCHAR pAddr, PCHAR pResult)
     if (!bOk)
         goto cleanup;
 
-    /* Start parsing the received packet. */
-    NumQuestions = ntohs(((PSHORT)&RecBuffer[4])[0]);
-
-    k = 12;
-
-    /* We don't care about the questions section, blow through it. */
-    if (NumQuestions) {
-        for (i = 0; i < NumQuestions; i += 1) {
-            /* Quick way to skip the domain name section. */
-            k += ExtractName(RecBuffer, pResult, k, 0);
-            k += 4;
-        }
+    /* Parse the received packet once, the answers follow the questions. */
+    ret = DnsWireParse((PBYTE)RecBuffer, RecBufferLength, &Message, Records, _ARRAYSIZE(Records));
+    if (ERROR_SUCCESS != ret && ERROR_INSUFFICIENT_BUFFER != ret) {
+        bOk = FALSE;
+        goto cleanup;
     }
 
-    /* Skip the answer name. */
-    k += ExtractName(RecBuffer, pResult, k, 0);
-
-    Type = ntohs(((PUSHORT)&RecBuffer[k])[0]);
-    k += 8;
-
-    d = ntohs(((PUSHORT)&RecBuffer[k])[0]);
-    k += 2;
+    k = Message.Count[DNS_SECTION_QUESTION];
+    if (Message.Count[DNS_SECTION_ANSWER] && k < _ARRAYSIZE(Records)) {
+        Type = Records[k].Type;
 
-    if (TYPE_PTR == Type) {
-        k += ExtractName(RecBuffer, pResult, k, d);
-    } else if (TYPE_A == Type) {
-        k += ExtractIP(RecBuffer, pResult, k);
+        if (TYPE_PTR == Type) {
+            ExtractName(RecBuffer, RecBufferLength, Records[k].Data, pResult, ResultLength);
+        } else if (TYPE_A == Type) {
+            ExtractIP(RecBuffer, &Records[k], pResult, ResultLength);
+        }
     }
 
 cleanup:
@@ -1073,15 +935,16 @@ void PerformLookup(PCHAR pAddr)
     /* Needed to issue DNS packets and parse them. */
     PCHAR Buffer = NULL, RecBuffer = NULL;
     CHAR pResolve[256];
-    CHAR pResult[256];
+    CHAR pResult[DNS_WIRE_MAX_NAME_TEXT] = {0};
     ULONG BufferLength = 0, RecBufferLength = 512;
     int i = 0, j = 0, k = 0, d = 0;
     BOOL bOk = FALSE;
 
     /* Makes things easier when parsing the response packet. */
+    DNS_WIRE_MESSAGE Message;
+    DNS_WIRE_RECORD Records[MAX_RECORDS];
+    ULONG ret;
     UCHAR Header2;
-    USHORT NumQuestions;
-    USHORT NumAnswers;
     USHORT NumAuthority;
     USHORT Type;
 
@@ -1182,11 +1045,10 @@ void PerformLookup(PCHAR pAddr)
     if (!bOk)
         goto cleanup;
 
-    /* Start parsing the received packet. */
-    Header2 = RecBuffer[3];
-    NumQuestions = ntohs(((PSHORT)&RecBuffer[4])[0]);
-    NumAnswers = ntohs(((PSHORT)&RecBuffer[6])[0]);
-    NumAuthority = ntohs(((PUSHORT)&RecBuffer[8])[0]);
+    /* Parse the received packet once, the answers follow the questions. */
+    ret = DnsWireParse((PBYTE)RecBuffer, RecBufferLength, &Message, Records, _ARRAYSIZE(Records));
+    Header2 = (UCHAR)Message.Flags;
+    NumAuthority = Message.Count[DNS_SECTION_AUTHORITY];
     Type = 0;
 
     /* Check the RCODE for failure. */
@@ -1206,30 +1068,19 @@ void PerformLookup(PCHAR pAddr)
         goto cleanup;
     }
 
-    k = 12;
-
-    if (NumQuestions) {
-        /* Blow through the questions section since we don't care about it. */
-        for (i = 0; i < NumQuestions; i += 1) {
-            k += ExtractName(RecBuffer, pResult, k, 0);
-            k += 4;
-        }
+    if (ERROR_SUCCESS != ret && ERROR_INSUFFICIENT_BUFFER != ret) {
+        printf(("*** %s can't find %s: Malformed response\n"), State.DefaultServer, pAddr);
+        goto cleanup;
     }
 
-    if (NumAnswers) {
-        /* Skip the name. */
-        k += ExtractName(RecBuffer, pResult, k, 0);
-
-        Type = ntohs(((PUSHORT)&RecBuffer[k])[0]);
-        k += 8;
-
-        d = ntohs(((PUSHORT)&RecBuffer[k])[0]);
-        k += 2;
+    k = Message.Count[DNS_SECTION_QUESTION];
+    if (Message.Count[DNS_SECTION_ANSWER] && k < _ARRAYSIZE(Records)) {
+        Type = Records[k].Type;
 
         if (TYPE_PTR == Type) {
-            k += ExtractName(RecBuffer, pResult, k, d);
+            ExtractName(RecBuffer, RecBufferLength, Records[k].Data, pResult, sizeof(pResult));
         } else if (TYPE_A == Type) {
-            k += ExtractIP(RecBuffer, pResult, k);
+            ExtractIP(RecBuffer, &Records[k], pResult, sizeof(pResult));
         }
     }
 
@@ -1293,11 +1144,15 @@ BOOL ParseCommandLine(int argc, char * argv[])
                 if (IsValidIP(Server)) {
                     strncpy(State.DefaultServerAddress, Server, 16);
 
-                    PerformInternalLookup(State.DefaultServerAddress, State.DefaultServer);
+                    PerformInternalLookup(State.DefaultServerAddress,
+                                          State.DefaultServer,
+                                          sizeof(State.DefaultServer));
                 } else {
                     strncpy(State.DefaultServer, Server, 255);
 
-                    PerformInternalLookup(State.DefaultServer, State.DefaultServerAddress);
+                    PerformInternalLookup(State.DefaultServer,
+                                          State.DefaultServerAddress,
+                                          sizeof(State.DefaultServerAddress));
                 }
 
                 if (Interactive)
@@ -1421,14 +1276,14 @@ BOOL ParseCommandLine(int argc, char * argv[])
 
         if (NoMoreOptions && !Interactive) {
             /* Get the FQDN of the DNS server. */
-            PerformInternalLookup(State.DefaultServerAddress, State.DefaultServer);
+            PerformInternalLookup(State.DefaultServerAddress, State.DefaultServer, sizeof(State.DefaultServer));
             PerformLookup(AddrToResolve);
             return 0;
         }
     }
 
     /* Get the FQDN of the DNS server. */
-    PerformInternalLookup(State.DefaultServerAddress, State.DefaultServer);
+    PerformInternalLookup(State.DefaultServerAddress, State.DefaultServer, sizeof(State.DefaultServer));
 
     return 1;
 }
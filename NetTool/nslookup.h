@@ -1,5 +1,6 @@
 #pragma once
 
+#include "..\inc\libnet.h"
 #include "pch.h"
 
 
@@ -56,6 +57,8 @@
 #define DEFAULT_ROOT    "A.ROOT-SERVERS.NET."
 #define ARPA_SIG        ".in-addr.arpa"
 
+#define MAX_RECORDS     128     /* More than a 512 byte response can hold. */
+
 typedef struct _STATE {
     BOOL debug;
     BOOL defname;
@@ -87,11 +90,11 @@ extern HANDLE   ProcessHeap;
 
 BOOL SendRequest(PCHAR pInBuffer, ULONG InBufferLength, PCHAR pOutBuffer, PULONG pOutBufferLength);
 
-int     ExtractName(PCHAR pBuffer, PCHAR pOutput, USHORT Offset, UCHAR Limit);
+BOOL    ExtractName(PCHAR pBuffer, DWORD BufferLength, USHORT Offset, PCHAR pOutput, SIZE_T OutputLength);
 
 void    ReverseIP(PCHAR pIP, PCHAR pReturn);
 BOOL    IsValidIP(PCHAR pInput);
-int     ExtractIP(PCHAR pBuffer, PCHAR pOutput, USHORT Offset);
+BOOL    ExtractIP(PCHAR pBuffer, const DNS_WIRE_RECORD * Record, PCHAR pOutput, SIZE_T OutputLength);
 void    PrintD2(PCHAR pBuffer, DWORD BufferLength);
 void    PrintDebug(PCHAR pBuffer, DWORD BufferLength);
 PCHAR   OpcodeIDtoOpcodeName(UCHAR Opcode);
@@ -38,6 +38,7 @@
 
 #pragma once
  
+#include "..\inc\libnet.h"
 #include "pch.h"
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
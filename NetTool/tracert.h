@@ -1,5 +1,6 @@
 #pragma once
 
+#include "..\inc\libnet.h"
 #include "pch.h"
 #include <netiodef.h>
 #include <tdiinfo.h>
@@ -128,6 +128,260 @@ typedef struct raw6_tcp {
 #include <poppack.h>
 
 
+//ʽУ͵ģChecksumInit/ChecksumUpdate/ChecksumFinal
+typedef struct _CHECKSUM_CONTEXT {
+    UINT64 Sum;    //δ۵δȡĶƷ͡
+    UINT64 Length; //Ѿۼӵֽжһεż
+} CHECKSUM_CONTEXT, * PCHECKSUM_CONTEXT;
+
+
+//ʱÿ֡ڻλãPacketizeSyn4Batchȡ
+typedef struct _PACKET_SPAN {
+    SIZE_T Offset; //ڻʼƫơ
+    ULONG Length;  //֡ĳȡ
+} PACKET_SPAN, * PPACKET_SPAN;
+
+
+//ɢһݣWSABUFĲһֱӴWSASendMsgȡIpFragment
+typedef struct _PACKET_SEGMENT {
+    ULONG Length;
+    const BYTE * Buffer;
+} PACKET_SEGMENT, * PPACKET_SEGMENT;
+
+
+//ɢ/ۼʱͷĴС̫ͷ + IPv6ͷ + 8ֽڵL4ͷٶ룩PacketizeUdp4Gatherȡ
+#define PACKET_GATHER_HEADER_SIZE 64
+
+
+//pcap/pcapngļĶдPcapOpenWriter/PcapOpenReader
+#define PCAP_FORMAT_PCAP        1
+#define PCAP_FORMAT_PCAPNG      2
+#define PCAP_LINKTYPE_ETHERNET  1
+
+typedef struct _PCAP_WRITER PCAP_WRITER, * PPCAP_WRITER;
+typedef struct _PCAP_READER PCAP_READER, * PPCAP_READER;
+
+typedef struct _PCAP_PACKET {
+    const BYTE * Data;     //ָӳĴڣǸƵģһPcapNextPacket֮ǰЧ
+    UINT32 Length;         //ļĳȡ
+    UINT32 OriginalLength; //·ϵĳȡ
+    UINT64 Timestamp;      //룬1970-01-01 UTC
+    UINT32 LinkType;
+} PCAP_PACKET, * PPCAP_PACKET;
+
+
+//PACKET_INFO.Layersȡֵλ򣩡
+#define PACKET_LAYER_ETHERNET 0x0001
+#define PACKET_LAYER_VLAN     0x0002
+#define PACKET_LAYER_IPV4     0x0004
+#define PACKET_LAYER_IPV6     0x0008
+#define PACKET_LAYER_TCP      0x0010
+#define PACKET_LAYER_UDP      0x0020
+#define PACKET_LAYER_ICMP     0x0040 //ICMPICMPv6
+#define PACKET_LAYER_FRAGMENT 0x0080 //IPƬһǵһƬûL4
+#define PACKET_LAYER_PAYLOAD  0x0100
+
+//PACKET_INFO.TcpOptionsȡֵλ򣩡
+#define PACKET_TCP_OPT_MSS            0x01
+#define PACKET_TCP_OPT_WS             0x02
+#define PACKET_TCP_OPT_SACK_PERMITTED 0x04
+#define PACKET_TCP_OPT_TIMESTAMP      0x08
+
+#define PACKET_MAX_VLAN 2
+
+
+/*
+DissectPacketĽ
+
+еƫƶ̫֡ͷĿʼеֵ
+ֻLayersĲֶβ塣
+*/
+typedef struct _PACKET_INFO {
+    UINT16 Layers;    // PACKET_LAYER_*
+    UINT16 EtherType; //ȥVLANǩ֮͡
+
+    UINT8 VlanCount;
+    UINT8 IpVersion;  // 46
+    UINT8 Protocol;   // L4Э飨IPv6չͷһ磺IPPROTO_TCP
+    UINT8 HopLimit;   // IPv4TTLIPv6Hop Limit
+    UINT16 VlanId[PACKET_MAX_VLAN];
+
+    UINT32 L3Offset;
+    UINT32 L3Length;  // IPͷĳȣIPv4ѡIPv6չͷ
+    UINT32 L4Offset;
+    UINT32 L4Length;  // L4ͷĳȣTCPѡ
+    UINT32 PayloadOffset;
+    UINT32 PayloadLength; //IPͷĳΪ׼ȥ̫䣩֡ĳȡ
+
+    UINT16 FragmentOffset; //ֽΪλ
+    UINT16 Reserved;
+    UINT32 FragmentId;
+
+    UINT16 SourcePort;      // TCP/UDPĶ˿ڣICMP͡
+    UINT16 DestinationPort; // TCP/UDPĶ˿ڣICMPĴ롣
+
+    UINT32 Seq;
+    UINT32 Ack;
+    UINT16 Window;
+    UINT8 TcpFlags;
+    UINT8 TcpOptions;     // PACKET_TCP_OPT_*
+    UINT16 Mss;
+    UINT8 WindowScale;
+    UINT8 Reserved2;
+    UINT32 TsVal;
+    UINT32 TsEcr;
+} PACKET_INFO, * PPACKET_INFO;
+
+
+/*
+״̬̽⣨SYN cookieʽģProbeInitialize
+
+Դ˿ںͳʼţISNԿ(ĿĵַĿĶ˿ڣԪ)
+յĻӦSYN+ACKRST+ACKֻ¼һξ֤͹ҪΪÿ̽Ᵽ״̬
+*/
+typedef struct _PROBE_CONTEXT {
+    UINT64 Key[2];    // SipHashԿ
+    UINT32 Epoch;     //Ԫɵߵ磺ÿɨ裩ƥʱҲһԪĻӦ
+    UINT16 PortBase;  //Դ˿ڵķΧ[PortBase, PortBase + PortCount)
+    UINT16 PortCount;
+} PROBE_CONTEXT, * PPROBE_CONTEXT;
+
+
+//ProbeMatchReplyĽеֵ
+typedef struct _PROBE_REPLY {
+    UINT8 IpVersion;  // 46
+    UINT8 TcpFlags;   //ӦTCP־磺TH_SYN | TH_ACK˿ڿţTH_RST | TH_ACK˿ڹرգ
+    UINT16 Port;      //̽ĿĶ˿ڡ
+    UINT32 Epoch;     //̽ڵļԪ
+    BYTE Address[16]; //̽ĿĵַIPv4ֻǰ4ֽڡ
+} PROBE_REPLY, * PPROBE_REPLY;
+
+
+//IpFragmentĽһƬɣͷڵṩĻָԭİƣ
+//ԱPACKET_SEGMENTWSABUFĲ֣ԿԵWSABUFֱӷ͡
+typedef struct _IP_FRAGMENT {
+    PACKET_SEGMENT Header;  //̫ͷVLAN+ IPͷIPv6İɷƬչͷͷƬͷ
+    PACKET_SEGMENT Payload; //Ƭݡ
+} IP_FRAGMENT, * PIP_FRAGMENT;
+
+//IpFragmentͷÿƬռĴС
+#define IP_FRAGMENT_HEADER_SIZE 256
+
+
+//IpReassemblerCreateصԡ
+#define IP_REASSEMBLY_OVERLAP_DROP  0 //ݱRFC 5722ȫظķƬ⡣
+#define IP_REASSEMBLY_OVERLAP_FIRST 1 //ȵݡ
+#define IP_REASSEMBLY_OVERLAP_LAST  2 //ú󵽵ݸǡ
+
+#define IP_REASSEMBLY_MAX_DATAGRAMS 4096 //ͬʱݱĸޣÿռ64KBࡣ
+
+typedef struct _IP_REASSEMBLER IP_REASSEMBLER, * PIP_REASSEMBLER;
+
+typedef struct _IP_REASSEMBLY_STATISTICS {
+    UINT64 Fragments;  //յķƬ
+    UINT64 Datagrams;  //ɵݱ
+    UINT64 Timeouts;   //ʱݱ
+    UINT64 Evictions;  //ʱ̭ģϵģݱ
+    UINT64 Overlaps;   //صķƬ
+    UINT64 Duplicates; //ȫظķƬ
+    UINT64 Malformed;  //εķƬȲ8ı64KB֪Ľβìܵȣ
+    UINT32 InUse;      //ݱ
+    UINT32 Reserved;
+} IP_REASSEMBLY_STATISTICS, * PIP_REASSEMBLY_STATISTICS;
+
+
+#define LPM_NO_MATCH  MAXUINT32  // LpmLookup*ûƥǰ׺ʱصֵ
+#define LPM_MAX_VALUE 0x7ffffffe //ǰ׺ֵޡ
+
+
+//һǰ׺LpmBuild
+typedef struct _LPM_PREFIX {
+    ADDRESS_FAMILY Family; // AF_INETAF_INET6
+    UINT8 PrefixLength;
+    UINT8 Reserved;
+    UINT32 Value;          //ƥʱصֵ磺·ɵ±꣬ǩLPM_MAX_VALUE
+    BYTE Address[16];      //IPv4ֻǰ4ֽڡֻᱻԡ
+} LPM_PREFIX, * PLPM_PREFIX;
+
+
+typedef struct _LPM_TABLE_INFORMATION {
+    ULONG Prefixes[2]; //±0IPv4ģ1IPv6ģͬ
+    ULONG Nodes[2];
+    ULONG Leaves[2];
+    ULONG Routes;      // LpmBuildFromRouteTable·ɵĸ
+    SIZE_T Bytes;      //ܹռõڴ档
+} LPM_TABLE_INFORMATION, * PLPM_TABLE_INFORMATION;
+
+
+typedef struct _LPM_TABLE LPM_TABLE, * PLPM_TABLE; //úֻ߳̿ͬʱҡü
+typedef struct _LPM_INDEX LPM_INDEX, * PLPM_INDEX; //ǰLPM_TABLEڱ߳ؽԭӵ滻
+
+
+typedef struct _IP_SET IP_SET, * PIP_SET; //IPv4IPv6ĵַļϣ洢̰߳ȫġ
+
+
+typedef struct _IP_SET_INFORMATION {
+    ULONG Ranges[2];     //±0IPv4ģ1IPv6ģཻڵĸ
+    UINT64 Addresses4;   // IPv4ĵַĸ
+    double Addresses6;   // IPv6ĵַĸƣ
+    SIZE_T Bytes;        //ռõڴ档
+} IP_SET_INFORMATION, * PIP_SET_INFORMATION;
+
+
+typedef struct _IP_SET_LOAD_STATISTICS {
+    UINT64 Lines;        //ܵ
+    UINT64 Entries;      //ЧĿ
+    UINT64 BadLines;     //޷УкעͲ㣩
+    UINT64 FirstBadLine; //һ޷екţ1ʼûе0
+} IP_SET_LOAD_STATISTICS, * PIP_SET_LOAD_STATISTICS;
+
+
+#define IP_SET_FIREWALL_ENTRIES 1000 //ÿǽĵַĸޣAddRemoteAddressRules
+
+
+//ַIANAIPv4/IPv6 Special-Purpose Address RegistryԼ鲥ķΧIpClassify4
+#define IP_CLASS_GLOBAL                 0  //ͨĹַκһ
+#define IP_CLASS_UNSPECIFIED            1  // 0.0.0.0/8This network::/128
+#define IP_CLASS_LOOPBACK               2  // 127.0.0.0/8::1/128
+#define IP_CLASS_PRIVATE                3  // 10.0.0.0/8172.16.0.0/12192.168.0.0/16
+#define IP_CLASS_SHARED                 4  // 100.64.0.0/10Ӫ̼NATCGNAT
+#define IP_CLASS_LINK_LOCAL             5  // 169.254.0.0/16fe80::/10
+#define IP_CLASS_UNIQUE_LOCAL           6  // fc00::/7
+#define IP_CLASS_SITE_LOCAL             7  // fec0::/10ѷ
+#define IP_CLASS_DOCUMENTATION          8  // 192.0.2.0/24ȣ2001:db8::/323fff::/20
+#define IP_CLASS_BENCHMARKING           9  // 198.18.0.0/152001:2::/48
+#define IP_CLASS_PROTOCOL               10 // IETFЭķ䣺192.0.0.0/242001::/23
+#define IP_CLASS_AS112                  11 // 192.31.196.0/24192.175.48.0/242001:4:112::/482620:4f:8000::/48
+#define IP_CLASS_AMT                    12 // 192.52.193.0/242001:3::/32
+#define IP_CLASS_6TO4_RELAY             13 // 192.88.99.0/24ѷ
+#define IP_CLASS_RESERVED               14 // 240.0.0.0/4IPv6δĿռ䣨2000::/3֮ģ
+#define IP_CLASS_BROADCAST              15 // 255.255.255.255/32
+#define IP_CLASS_TEREDO                 16 // 2001::/32
+#define IP_CLASS_6TO4                   17 // 2002::/16
+#define IP_CLASS_IPV4_MAPPED            18 // ::ffff:0:0/96
+#define IP_CLASS_NAT64                  19 // 64:ff9b::/9664:ff9b:1::/48
+#define IP_CLASS_DISCARD                20 // 100::/64
+#define IP_CLASS_ORCHID                 21 // 2001:10::/28ѷ2001:20::/28
+#define IP_CLASS_SRV6                   22 // 5f00::/16SRv6SID
+#define IP_CLASS_MULTICAST_INTERFACE    23 // ff01::/16ȣΧ1
+#define IP_CLASS_MULTICAST_LINK         24 // 224.0.0.0/24ff02::/16ȣΧ2
+#define IP_CLASS_MULTICAST_ADMIN        25 // 239.0.0.0/8ಿ֣ff04::/16ȣΧ4
+#define IP_CLASS_MULTICAST_SITE         26 // 239.255.0.0/16ff05::/16ȣΧ5
+#define IP_CLASS_MULTICAST_ORGANIZATION 27 // 239.192.0.0/14ff08::/16ȣΧ8
+#define IP_CLASS_MULTICAST_GLOBAL       28 // 224.0.0.0/4ಿ֣ff0e::/16ȣΧe
+#define IP_CLASS_MULTICAST_OTHER        29 // IPv6ģģδģΧ
+#define IP_CLASS_COUNT                  30
+
+
+//IpClassFlagsı־
+#define IP_CLASS_FLAG_GLOBAL        0x1  //ȫֿɴIANAGlobally ReachableN/AҲ㣩
+#define IP_CLASS_FLAG_MULTICAST     0x2
+#define IP_CLASS_FLAG_LOCAL         0x4  //߱·ػ·أطΧ鲥
+#define IP_CLASS_FLAG_PRIVATE       0x8  //˽еģڲģ˽CGNATULAվ㱾أ
+#define IP_CLASS_FLAG_EMBEDDED_IPV4 0x10 //ַﺬIPv4ַ6to4TeredoIPv4ӳ䣬NAT64
+#define IP_CLASS_FLAG_DEPRECATED    0x20
+
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
 
@@ -187,15 +441,457 @@ __declspec(dllimport)
 VOID WINAPI PrintDnsRecordList(PDNS_RECORD DnsRecord);
 
 
+#define DNS_WIRE_HEADER_SIZE    12
+#define DNS_WIRE_MAX_NAME       255  //ϸʽֵ󳤶ȣֽںͽβ0
+#define DNS_WIRE_MAX_NAME_TEXT  1024 //ıʽֵĻޣÿֽתΪ\DDDDnsWireReadName
+#define DNS_WIRE_HASH_SIZE      64   //ʱס֣׺ĸޣѹ
+
+//DNS_WIRE_MESSAGE.Count±꣬ҲDnsWriteRecordSection
+#define DNS_SECTION_QUESTION    0
+#define DNS_SECTION_ANSWER      1
+#define DNS_SECTION_AUTHORITY   2
+#define DNS_SECTION_ADDITIONAL  3
+
+
+//һԴ¼ֻƫƺͳȣݡDnsWireReadNameȡ
+typedef struct _DNS_WIRE_RECORD {
+    USHORT Name;       //ڱƫơ
+    USHORT NameLength; //ԭռõֽβ0ߵһѹָΪֹ
+    USHORT Type;       //ͬ
+    USHORT Class;
+    ULONG Ttl;         //0
+    USHORT Data;       // RDATAڱƫƣ0
+    USHORT DataLength;
+} DNS_WIRE_RECORD, * PDNS_WIRE_RECORD;
+
+
+//ĵͷ͸ڵļ¼ĸDnsWireParse
+typedef struct _DNS_WIRE_MESSAGE {
+    USHORT Id;
+    USHORT Flags;      // QROpcodeAATCRDRAZRCODE
+    USHORT Count[4];   //ڵļ¼ĸ±DNS_SECTION_*¼ڵ˳С
+    ULONG Records;     //ܵļ¼ĸҲ㣩
+    ULONG Length;      //ĳȣСڱĵĳ˵滹жݡ
+} DNS_WIRE_MESSAGE, * PDNS_WIRE_MESSAGE;
+
+
+//DnsWriterInitڴ棬Էջϡ
+typedef struct _DNS_WRITER {
+    PBYTE Buffer;
+    ULONG Capacity;
+    ULONG Length;      //Ѿдĳȡ
+    ULONG Section;     //ǰĽڣֻܰ˳д
+    ULONG Names;       //ϣֵĸ
+    USHORT Hash[DNS_WIRE_HASH_SIZE]; //Ѿд֣׺ƫƣ0ǿյģƫƲ0
+} DNS_WRITER, * PDNS_WRITER;
+
+
+__declspec(dllimport)
+ULONG WINAPI DnsWireParse(_In_reads_bytes_(Length) const BYTE * Message,
+                          _In_ ULONG Length,
+                          _Out_ PDNS_WIRE_MESSAGE Header,
+                          _Out_writes_opt_(Capacity) PDNS_WIRE_RECORD Records,
+                          _In_ ULONG Capacity);
+
+__declspec(dllimport)
+ULONG WINAPI DnsWireReadName(_In_reads_bytes_(Length) const BYTE * Message,
+                             _In_ ULONG Length,
+                             _In_ ULONG Offset,
+                             _Out_writes_z_(Characters) PSTR Name,
+                             _In_ SIZE_T Characters,
+                             _Out_opt_ PULONG Consumed);
+
+__declspec(dllimport)
+BOOLEAN WINAPI DnsWireNameEqual(_In_reads_bytes_(Length) const BYTE * Message,
+                                _In_ ULONG Length,
+                                _In_ ULONG Offset1,
+                                _In_ ULONG Offset2);
+
+__declspec(dllimport)
+ULONG WINAPI DnsWriterInit(_Out_ PDNS_WRITER Writer,
+                           _Out_writes_bytes_(Capacity) PBYTE Buffer,
+                           _In_ ULONG Capacity,
+                           _In_ USHORT Id,
+                           _In_ USHORT Flags);
+
+__declspec(dllimport)
+ULONG WINAPI DnsWriteQuestion(_Inout_ PDNS_WRITER Writer, _In_z_ PCSTR Name, _In_ USHORT Type, _In_ USHORT Class);
+
+__declspec(dllimport)
+ULONG WINAPI DnsWriteRecord(_Inout_ PDNS_WRITER Writer,
+                            _In_ ULONG Section,
+                            _In_z_ PCSTR Name,
+                            _In_ USHORT Type,
+                            _In_ USHORT Class,
+                            _In_ ULONG Ttl,
+                            _In_reads_bytes_opt_(DataLength) const void * Data,
+                            _In_ USHORT DataLength);
+
+__declspec(dllimport)
+ULONG WINAPI DnsWriteNameRecord(_Inout_ PDNS_WRITER Writer,
+                                _In_ ULONG Section,
+                                _In_z_ PCSTR Name,
+                                _In_ USHORT Type,
+                                _In_ USHORT Class,
+                                _In_ ULONG Ttl,
+                                _In_z_ PCSTR Target);
+
+
+typedef struct _DNS_CACHE DNS_CACHE, * PDNS_CACHE; // DNSĻ棬DnsCacheCreatḛ߳ȫ
+
+
+#define DNS_CACHE_DEFAULT_BYTES  (16 * 1024 * 1024)
+#define DNS_CACHE_MAX_TTL        86400 //ӦTTLޣ룩
+#define DNS_CACHE_MAX_NEGATIVE   10800 //񶨵ӦTTLޣRFC 2308ֵ3Сʱ
+
+//DnsCacheGetNameInfoõRFC 6895˽õķΧDnsCacheInsertResponseģINֿ
+// NI_NOFQDNĽҲֿ
+#define DNS_CACHE_CLASS_NAMEINFO 0xFF00
+#define DNS_CACHE_CLASS_NOFQDN   0xFF01
+#define DNS_CACHE_NAMEINFO_TTL   300 // getnameinfoTTLĽô롣
+#define DNS_CACHE_NAMEINFO_NEGATIVE_TTL 60
+
+
+typedef struct _DNS_CACHE_INFORMATION {
+    UINT64 Hits;          //С
+    UINT64 NegativeHits;  //񶨵УNXDOMAINNODATA
+    UINT64 Misses;        //ûеģڵġ
+    UINT64 Expired;       //Ϊڶûеġ
+    UINT64 Inserts;
+    UINT64 Evictions;     //Ϊڳռ̭ģڵĺ滻ģ
+    ULONG Entries;
+    ULONG Shards;
+    SIZE_T Bytes;         //Ŀռõڴ档
+    SIZE_T MaxBytes;
+} DNS_CACHE_INFORMATION, * PDNS_CACHE_INFORMATION;
+
+
+__declspec(dllimport)
+ULONG WINAPI DnsCacheCreate(_In_ SIZE_T MaxBytes, _In_ ULONG Shards, _Out_ PDNS_CACHE * Cache);
+
+__declspec(dllimport)
+void WINAPI DnsCacheDestroy(_In_opt_ PDNS_CACHE Cache);
+
+__declspec(dllimport)
+PDNS_CACHE WINAPI DnsCacheDefault();
+
+__declspec(dllimport)
+ULONG WINAPI DnsCacheInsert(_In_ PDNS_CACHE Cache,
+                            _In_z_ PCSTR Name,
+                            _In_ USHORT Type,
+                            _In_ USHORT Class,
+                            _In_ ULONG Status,
+                            _In_reads_bytes_opt_(Length) const void * Data,
+                            _In_ ULONG Length,
+                            _In_ ULONG Ttl);
+
+__declspec(dllimport)
+ULONG WINAPI DnsCacheInsertResponse(_In_ PDNS_CACHE Cache,
+                                    _In_reads_bytes_(Length) const BYTE * Message,
+                                    _In_ ULONG Length);
+
+__declspec(dllimport)
+ULONG WINAPI DnsCacheLookup(_In_ PDNS_CACHE Cache,
+                            _In_z_ PCSTR Name,
+                            _In_ USHORT Type,
+                            _In_ USHORT Class,
+                            _Out_writes_bytes_opt_(*Length) PVOID Data,
+                            _Inout_opt_ PULONG Length,
+                            _Out_opt_ PULONG Ttl);
+
+__declspec(dllimport)
+void WINAPI DnsCacheFlush(_In_ PDNS_CACHE Cache);
+
+__declspec(dllimport)
+void WINAPI DnsCacheQuery(_In_ PDNS_CACHE Cache, _Out_ PDNS_CACHE_INFORMATION Information);
+
+__declspec(dllimport)
+int WINAPI DnsCacheGetNameInfo(_In_reads_bytes_(AddressLength) const SOCKADDR * Address,
+                               _In_ int AddressLength,
+                               _Out_writes_(HostLength) PCHAR Host,
+                               _In_ DWORD HostLength,
+                               _In_ int Flags);
+
+
+typedef struct _DNS_RESOLVER DNS_RESOLVER, * PDNS_RESOLVER; //첽DNSDnsResolverCreatḛ߳ȫġ
+
+
+#define DNS_RESOLVER_FLAG_NO_TCP       0x1 //ضϵӦTCP²ѯֱӷأӦͷTC
+#define DNS_RESOLVER_FLAG_NO_RECURSION 0x2 //RDȨѯ
+#define DNS_RESOLVER_FLAG_NO_EDNS      0x4 //OPT¼ĬϴUDPӦDNS_RESOLVER_EDNS_SIZE
+
+#define DNS_RESOLVER_EDNS_SIZE 1232 // DNS Flag Day 2020ƼĴСƬ
+
+
+typedef struct _DNS_RESOLVER_CONFIG {
+    SOCKADDR_INET Server; //εķIPv4IPv6˿053
+    ULONG Sockets;        // UDP׽ֵĸÿһԴ˿ڡ0Ĭϵģ864
+    ULONG MaxQueries;     //ͬʱ;Ĳѯޣ0Ĭϵģ409665534
+    ULONG Timeout;        //һεĳʱ룩֮ÿشӱTCP0Ĭϵģ1000
+    ULONG Attempts;       // UDPķʹһΣ0Ĭϵģ3
+    ULONG Flags;          // DNS_RESOLVER_FLAG_*
+    PDNS_CACHE Cache;     //ѡĻ棨ԺͱĽյӦȥеĲٷ͡
+} DNS_RESOLVER_CONFIG, * PDNS_RESOLVER_CONFIG;
+
+
+//һѯĽDNS_RESOLVER_CALLBACK
+typedef struct _DNS_RESOLVER_RESULT {
+    PVOID Context;          // DnsResolverSubmitContext
+    ULONG Status;           // ERROR_SUCCESSյӦ𣬲RCODEERROR_TIMEOUTERROR_CANCELLEDTCPĴȡ
+    PCSTR Name;             //ѯ֣淶ģ
+    USHORT Type;            //ѯ͡
+    UCHAR Rcode;            //ӦRCODE磺DNS_RCODE_NXDOMAIN
+    BOOLEAN Tcp;            //ӦTCPģUDPıضˣ
+    ULONG Attempts;         // UDPķʹл0
+    ULONG Elapsed;          //ύɵĺ
+    const BYTE * Response;  //Ӧ𣨿DnsWireParseʧܵnullptr
+    ULONG ResponseLength;
+} DNS_RESOLVER_RESULT, * PDNS_RESOLVER_RESULT;
+
+
+//ѯɵĻصDnsResolverPollDnsResolverDestroyãлDnsResolverSubmitá
+// ResultָֻڻصЧ
+//صԵDnsResolverSubmitǲܵDnsResolverPollDnsResolverDestroy
+typedef VOID(WINAPI * DNS_RESOLVER_CALLBACK)(_In_ const DNS_RESOLVER_RESULT * Result);
+
+
+typedef struct _DNS_RESOLVER_INFORMATION {
+    ULONG Pending;        //;Ĳѯ
+    ULONG Sockets;
+    UINT64 Submitted;
+    UINT64 Answered;      //յӦģTCPģ
+    UINT64 Sent;          // UDP͵ıģش
+    UINT64 Retransmits;
+    UINT64 Timeouts;
+    UINT64 TcpFallbacks;  //ضϺTCPġ
+    UINT64 Mismatched;    //ıģԴIDⲻƥģεģαģ
+    UINT64 Cached;        //лģSubmitted
+    SIZE_T Bytes;         //ռõڴ档
+} DNS_RESOLVER_INFORMATION, * PDNS_RESOLVER_INFORMATION;
+
+
+__declspec(dllimport)
+ULONG WINAPI DnsResolverCreate(_In_ const DNS_RESOLVER_CONFIG * Config, _Out_ PDNS_RESOLVER * Resolver);
+
+__declspec(dllimport)
+void WINAPI DnsResolverDestroy(_In_opt_ PDNS_RESOLVER Resolver);
+
+__declspec(dllimport)
+ULONG WINAPI DnsResolverSubmit(_In_ PDNS_RESOLVER Resolver,
+                               _In_z_ PCSTR Name,
+                               _In_ USHORT Type,
+                               _In_ DNS_RESOLVER_CALLBACK Callback,
+                               _In_opt_ PVOID Context);
+
+__declspec(dllimport)
+ULONG WINAPI DnsResolverPoll(_In_ PDNS_RESOLVER Resolver, _In_ ULONG Timeout, _Out_opt_ PULONG Completed);
+
+__declspec(dllimport)
+void WINAPI DnsResolverQuery(_In_ PDNS_RESOLVER Resolver, _Out_ PDNS_RESOLVER_INFORMATION Information);
+
+
+#define DNS_REVERSE_NAME_SIZE 74 // ip6.arpa֣32ֽڣÿһ㣬"ip6.arpa"ͽβ0
+
+
+//һַķĽ
+typedef struct _DNS_REVERSE_ENTRY {
+    ULONG Status; // ERROR_SUCCESSDNS_ERROR_RCODE_NAME_ERRORDNS_INFO_NO_RECORDSERROR_TIMEOUTȡ
+    PCSTR Name;   // PTR¼֣һʧܵnullptrͬĵַָͬһַ
+} DNS_REVERSE_ENTRY, * PDNS_REVERSE_ENTRY;
+
+
+//ķĽDnsReverseLookupһڴ棬DnsReverseFreeͷš
+typedef struct _DNS_REVERSE_RESULT {
+    ULONG Count;                         //ַĸ
+    ULONG Unique;                        //ȥغģʵʲѯģ
+    ULONG Resolved;                      //ȥغֵĸ
+    ULONG Elapsed;                       //롣
+    DNS_RESOLVER_INFORMATION Statistics; //ͳƣͣشеȣ
+    DNS_REVERSE_ENTRY Entries[1];        //ĵַһһӦ˳ͬCount
+} DNS_REVERSE_RESULT, * PDNS_REVERSE_RESULT;
+
+
+__declspec(dllimport)
+ULONG WINAPI DnsReverseName(_In_ const SOCKADDR_INET * Address,
+                            _Out_writes_(Size) PSTR Name,
+                            _In_ ULONG Size);
+
+__declspec(dllimport)
+ULONG WINAPI DnsReverseLookup(_In_ const DNS_RESOLVER_CONFIG * Config,
+                              _In_reads_(Count) const SOCKADDR_INET * Addresses,
+                              _In_ ULONG Count,
+                              _Out_ PDNS_REVERSE_RESULT * Result);
+
+__declspec(dllimport)
+void WINAPI DnsReverseFree(_In_opt_ PDNS_REVERSE_RESULT Result);
+
+
+//DnsFormatRecordȵFormat
+#define DNS_FORMAT_TEXT   0 //ԭPrintDnsRecordListĸʽÿֶһУ˿
+#define DNS_FORMAT_ZONE   1 //ļRFC 1035 5.1ĸʽһ¼һУname. TTL IN TYPE RDATA
+#define DNS_FORMAT_JSON   2 //һ¼һJSONбDNS_FORMAT_WRITERһ顣
+#define DNS_FORMAT_BINARY 3 //Դ¼ĸʽRFC 1035 4.1.3ѹIN
+
+#define DNS_FORMAT_BUFFER_SIZE 4096 //һļ¼ıĸʽòô࣬ʺϷջϡ
+
+
+//DNS_FORMAT_WRITERĻˣDnsFormatWriterFinishʱãERROR_SUCCESSֵֹд롣
+typedef ULONG(WINAPI * DNS_FORMAT_FLUSH)(_In_opt_ PVOID Context,
+                                         _In_reads_bytes_(Length) const char * Data,
+                                         _In_ ULONG Length);
+
+
+//ʽظʽļ¼DnsFormatWriterInitڴ棬Էջϡ
+typedef struct _DNS_FORMAT_WRITER {
+    ULONG Format;
+    PCHAR Buffer;
+    ULONG Capacity;
+    ULONG Length;          //ﻹûнFlushĳȡ
+    DNS_FORMAT_FLUSH Flush;
+    PVOID Context;
+    ULONG Records;         //Ѿдļ¼ĸ
+    ULONG Skipped;         //ʽֵ֧Ͷļ¼ĸ
+    UINT64 Written;        //Flushܵĳȡ
+} DNS_FORMAT_WRITER, * PDNS_FORMAT_WRITER;
+
+
+__declspec(dllimport)
+ULONG WINAPI DnsFormatRecord(_In_ const DNS_RECORD * Record,
+                             _In_ ULONG Format,
+                             _Out_writes_bytes_to_opt_(Capacity, *Length) PCHAR Buffer,
+                             _In_ ULONG Capacity,
+                             _Out_ PULONG Length);
+
+__declspec(dllimport)
+ULONG WINAPI DnsFormatWriterInit(_Out_ PDNS_FORMAT_WRITER Writer,
+                                 _In_ ULONG Format,
+                                 _Out_writes_bytes_(Capacity) PCHAR Buffer,
+                                 _In_ ULONG Capacity,
+                                 _In_ DNS_FORMAT_FLUSH Flush,
+                                 _In_opt_ PVOID Context);
+
+__declspec(dllimport)
+ULONG WINAPI DnsFormatWriterAppend(_Inout_ PDNS_FORMAT_WRITER Writer, _In_opt_ const DNS_RECORD * Records);
+
+__declspec(dllimport)
+ULONG WINAPI DnsFormatWriterFinish(_Inout_ PDNS_FORMAT_WRITER Writer);
+
+__declspec(dllimport)
+ULONG WINAPI DnsFormatPrint(_In_opt_ PVOID Context, _In_reads_bytes_(Length) const char * Data, _In_ ULONG Length);
+
+
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
 
+//CidrIteratorInit˳
+#define CIDR_ORDER_SEQUENTIAL 0 //μһ
+#define CIDR_ORDER_STRIDED    1 //ģԾƣÿַǡһΡ
+#define CIDR_ORDER_SHUFFLED   2 //ӾαУÿַǡһΡ
+
+//CidrIteratorInitı־
+#define CIDR_FLAG_HOST_ORDER 0x1 // IPv4ĽUINT32ĬIN_ADDR
+
+
+//CIDRöCidrIteratorInitڴ棬ֱӸƺͱ档
+typedef struct _CIDR_ITERATOR {
+    ADDRESS_FAMILY Family; // AF_INETAF_INET6
+    UINT8 PrefixLength;
+    UINT8 HostBits;        //ֵλַĸ2^HostBitsIPv432IPv664
+    ULONG Order;           // CIDR_ORDER_*
+    ULONG Flags;           // CIDR_FLAG_*
+    BOOLEAN Exhausted;     //Ѿöˡ
+    UINT64 Offset;         //һַţ0ʼԱ֮CidrIteratorSeek
+    UINT64 Mask;           // 2^HostBits - 1
+    UINT64 Base[2];        //ַ򣩣Base[0]IPv6ĸ64λIPv4ֻBase[1]ĵ32λ
+    UINT64 Key[5];         //еĲ
+} CIDR_ITERATOR, * PCIDR_ITERATOR;
+
+
 __declspec(dllimport)
 void WINAPI EnumIPv4ByMask(const char * ipv4, const char * mask);
 
 __declspec(dllimport)
 void WINAPI EnumIPv4ByMasks(const char * ipv4, BYTE mask);
 
+__declspec(dllimport)
+ULONG WINAPI CidrIteratorInit(_Out_ PCIDR_ITERATOR Iterator,
+                              _In_ ADDRESS_FAMILY Family,
+                              _In_ const void * Address,
+                              _In_ UINT8 PrefixLength,
+                              _In_ ULONG Order,
+                              _In_ UINT64 Parameter,
+                              _In_ ULONG Flags);
+
+__declspec(dllimport)
+ULONG WINAPI CidrIteratorInitFromString(_Out_ PCIDR_ITERATOR Iterator,
+                                        _In_z_ PCSTR Cidr,
+                                        _In_ ULONG Order,
+                                        _In_ UINT64 Parameter,
+                                        _In_ ULONG Flags);
+
+__declspec(dllimport)
+ULONG WINAPI CidrIteratorNext(_Inout_ PCIDR_ITERATOR Iterator,
+                              _Out_ PVOID Addresses,
+                              _In_ ULONG Capacity,
+                              _Out_ PULONG Count);
+
+__declspec(dllimport)
+ULONG WINAPI CidrIteratorSeek(_Inout_ PCIDR_ITERATOR Iterator, _In_ UINT64 Offset);
+
+__declspec(dllimport)
+ULONG WINAPI ParseIPv4Batch(_In_reads_(Count) const PCSTR * Strings,
+                            _In_ ULONG Count,
+                            _Out_writes_(Count) PIN_ADDR Addresses,
+                            _Out_writes_opt_(Count) PBOOLEAN Valid);
+
+__declspec(dllimport)
+ULONG WINAPI ParseIPv6Batch(_In_reads_(Count) const PCSTR * Strings,
+                            _In_ ULONG Count,
+                            _Out_writes_(Count) PIN6_ADDR Addresses,
+                            _Out_writes_opt_(Count) PBOOLEAN Valid);
+
+__declspec(dllimport)
+ULONG WINAPI FormatIPv4Batch(_In_reads_(Count) const IN_ADDR * Addresses,
+                             _In_ ULONG Count,
+                             _Out_writes_bytes_(Count * Stride) PSTR Buffer,
+                             _In_ SIZE_T Stride,
+                             _Out_writes_opt_(Count) PULONG Lengths);
+
+__declspec(dllimport)
+ULONG WINAPI FormatIPv6Batch(_In_reads_(Count) const IN6_ADDR * Addresses,
+                             _In_ ULONG Count,
+                             _Out_writes_bytes_(Count * Stride) PSTR Buffer,
+                             _In_ SIZE_T Stride,
+                             _Out_writes_opt_(Count) PULONG Lengths);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//ַصġ
+
+
+__declspec(dllimport)
+UINT8 WINAPI IpClassify4(_In_ const IN_ADDR * Address);
+
+__declspec(dllimport)
+UINT8 WINAPI IpClassify6(_In_ const IN6_ADDR * Address);
+
+__declspec(dllimport)
+void WINAPI IpClassify4Batch(_In_reads_(Count) const IN_ADDR * Addresses,
+                             _In_ ULONG Count,
+                             _Out_writes_(Count) PUINT8 Classes);
+
+__declspec(dllimport)
+void WINAPI IpClassify6Batch(_In_reads_(Count) const IN6_ADDR * Addresses,
+                             _In_ ULONG Count,
+                             _Out_writes_(Count) PUINT8 Classes);
+
+__declspec(dllimport)
+PCSTR WINAPI IpClassName(_In_ UINT8 Class);
+
+__declspec(dllimport)
+ULONG WINAPI IpClassFlags(_In_ UINT8 Class);
+
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -280,6 +976,460 @@ __declspec(dllimport)
 int WINAPI EnumExtendedUdpTable6();
 
 
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//ӱĿա
+
+
+// TABLE_SNAPSHOTKindĸAPI
+#define TABLE_SNAPSHOT_TCP          1 // GetTcpTableMIB_TCPROW
+#define TABLE_SNAPSHOT_TCP2         2 // GetTcpTable2MIB_TCPROW2
+#define TABLE_SNAPSHOT_TCP6         3 // GetTcp6TableMIB_TCP6ROW
+#define TABLE_SNAPSHOT_TCP6_2       4 // GetTcp6Table2MIB_TCP6ROW2
+#define TABLE_SNAPSHOT_TCP_EXTENDED 5 // GetExtendedTcpTableеFamilyClassTCP_TABLE_CLASS
+#define TABLE_SNAPSHOT_UDP          6 // GetUdpTableMIB_UDPROW
+#define TABLE_SNAPSHOT_UDP6         7 // GetUdp6TableMIB_UDP6ROW
+#define TABLE_SNAPSHOT_UDP_EXTENDED 8 // GetExtendedUdpTableеFamilyClassUDP_TABLE_CLASS
+
+#define TABLE_SNAPSHOT_MAX_TRIES 8    //ε֮һֱʱõĴ
+
+
+//һӱĿգTableSnapshotRefresh
+//ֻˢʱã̰߳ȫġԷջϻȫֱTABLE_SNAPSHOT_INITIALIZER
+//ˢ֮޸FamilyClassOrder
+typedef struct _TABLE_SNAPSHOT {
+    ULONG Kind;
+    ULONG Family;    //չıAF_INETAF_INET6ĺԡ
+    ULONG Class;     //չıTCP_TABLE_CLASSUDP_TABLE_CLASSĺԡ
+    BOOL Order;      //ϵͳַͶ˿жĿѯһ㲻Ҫ
+    PVOID Buffer;    //MIB_XXXTABLE
+    ULONG Capacity;  // BufferĴС
+    PVOID Rows;      //ָBufferĵһУˢʧܵnullptr
+    ULONG RowSize;
+    ULONG Count;     //
+    ULONG Refreshes; //ɹˢµĴ
+    ULONG Grows;     //ڴĴ
+    ULONG Retries;   //ERROR_INSUFFICIENT_BUFFERĴε֮ģ
+} TABLE_SNAPSHOT, * PTABLE_SNAPSHOT;
+
+#define TABLE_SNAPSHOT_INITIALIZER(Kind, Family, Class, Order) {(Kind), (Family), (Class), (Order)}
+
+
+__declspec(dllimport)
+ULONG WINAPI TableSnapshotInit(_Out_ PTABLE_SNAPSHOT Snapshot,
+                               _In_ ULONG Kind,
+                               _In_ ULONG Family,
+                               _In_ ULONG Class,
+                               _In_ BOOL Order);
+
+__declspec(dllimport)
+ULONG WINAPI TableSnapshotReserve(_Inout_ PTABLE_SNAPSHOT Snapshot, _In_ ULONG Rows);
+
+__declspec(dllimport)
+ULONG WINAPI TableSnapshotRefresh(_Inout_ PTABLE_SNAPSHOT Snapshot);
+
+__declspec(dllimport)
+void WINAPI TableSnapshotFree(_Inout_ PTABLE_SNAPSHOT Snapshot);
+
+
+EXTERN_C_END
+
+
+#ifdef __cplusplus
+
+
+//еͷʿգ磺
+//for (auto & Row : TableSnapshotRows<MIB_TCPROW_OWNER_PID>(&Snapshot)) {...}
+//еҪKindFamilyClassӦֻСԵķؿյġ
+template <typename Row>
+struct TABLE_SNAPSHOT_SPAN {
+    Row * Rows;
+    ULONG Count;
+
+    Row * begin() const { return Rows; }
+    Row * end() const { return Rows + Count; }
+    Row & operator[](ULONG Index) const { return Rows[Index]; }
+};
+
+
+template <typename Row>
+TABLE_SNAPSHOT_SPAN<Row> TableSnapshotRows(_In_ const TABLE_SNAPSHOT * Snapshot)
+{
+    if (nullptr == Snapshot->Rows || sizeof(Row) != Snapshot->RowSize) {
+        return {nullptr, 0}; //ûˢ³ɹͲԡ
+    }
+
+    return {reinterpret_cast<Row *>(Snapshot->Rows), Snapshot->Count};
+}
+
+
+#endif
+
+
+EXTERN_C_START
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//ӱ
+
+
+typedef struct _TABLE_DIFF TABLE_DIFF, * PTABLE_DIFF; //ӱTableDiffUpdatḛ߳ȫġ
+
+
+// TableDiffCreateFlags
+#define TABLE_DIFF_COMPACT 0x1 //ÿֻ16ֽڣĹϣPID״̬رյ¼ûеַͶ˿ڡ
+
+// TABLE_DIFF_EVENTType
+#define TABLE_DIFF_OPENED  1
+#define TABLE_DIFF_CLOSED  2
+#define TABLE_DIFF_CHANGED 3
+
+// TABLE_DIFF_EVENTChanges
+#define TABLE_DIFF_STATE_CHANGED 0x1 // TCP״̬MIB_TCP_STATEˡ
+#define TABLE_DIFF_PID_CHANGED   0x2 //ͬһԪ̱ˡ
+
+#define TABLE_DIFF_BATCH 256 //صһ¼
+
+
+//ֱͳһĸʽ˿ֽIPv4ĵַǰ4ֽڣ0
+typedef struct _TABLE_DIFF_ROW {
+    ADDRESS_FAMILY Family; // AF_INETAF_INET6TABLE_DIFF_COMPACTĹرյ¼AF_UNSPEC
+    UINT8 Protocol;        // IPPROTO_TCPIPPROTO_UDP
+    UINT8 Reserved;
+    USHORT LocalPort;
+    USHORT RemotePort;     // UDP0
+    ULONG State;           // TCPMIB_TCP_STATEUDP0
+    ULONG OwningPid;       //ûнϢıGetTcpTableȣ0
+    UINT8 LocalAddress[16];
+    UINT8 RemoteAddress[16];
+} TABLE_DIFF_ROW, * PTABLE_DIFF_ROW;
+
+
+typedef struct _TABLE_DIFF_EVENT {
+    ULONG Type;
+    ULONG Changes;     // TABLE_DIFF_CHANGEDTABLE_DIFF_STATE_CHANGEDȡ
+    ULONG OldState;    // TABLE_DIFF_CHANGEDTABLE_DIFF_CLOSEDԭ״̬PID
+    ULONG OldPid;
+    UINT64 Key;        //Ԫ飨Э飩Ĺϣͬһӵĸ¼ͬ
+    TABLE_DIFF_ROW Row; //򿪺ͱ仯ڵУرյԭС
+} TABLE_DIFF_EVENT, * PTABLE_DIFF_EVENT;
+
+
+//ERROR_SUCCESSֵֹαȽϣTableDiffUpdateֵѾµı
+typedef ULONG(WINAPI * TABLE_DIFF_CALLBACK)(_In_opt_ PVOID Context,
+                                            _In_reads_(Count) const TABLE_DIFF_EVENT * Events,
+                                            _In_ ULONG Count);
+
+
+typedef struct _TABLE_DIFF_INFORMATION {
+    ULONG Rows;      //µģһεģ
+    ULONG Updates;
+    UINT64 Opened;   //ۼƵĸ¼ĸ
+    UINT64 Closed;
+    UINT64 Changed;
+    SIZE_T Bytes;    //ռõڴ档
+} TABLE_DIFF_INFORMATION, * PTABLE_DIFF_INFORMATION;
+
+
+__declspec(dllimport)
+ULONG WINAPI TableDiffCreate(_In_ ULONG Flags, _Out_ PTABLE_DIFF * Diff);
+
+__declspec(dllimport)
+void WINAPI TableDiffDestroy(_In_opt_ PTABLE_DIFF Diff);
+
+__declspec(dllimport)
+ULONG WINAPI TableDiffUpdate(_In_ PTABLE_DIFF Diff,
+                             _In_ const TABLE_SNAPSHOT * Snapshot,
+                             _In_opt_ TABLE_DIFF_CALLBACK Callback,
+                             _In_opt_ PVOID Context);
+
+__declspec(dllimport)
+ULONG WINAPI TableDiffCompare(_In_ const TABLE_SNAPSHOT * Old,
+                              _In_ const TABLE_SNAPSHOT * New,
+                              _In_ TABLE_DIFF_CALLBACK Callback,
+                              _In_opt_ PVOID Context);
+
+__declspec(dllimport)
+ULONG WINAPI TableDiffGetRow(_In_ const TABLE_SNAPSHOT * Snapshot, _In_ ULONG Index, _Out_ PTABLE_DIFF_ROW Row);
+
+__declspec(dllimport)
+void WINAPI TableDiffGetInformation(_In_ PTABLE_DIFF Diff, _Out_ PTABLE_DIFF_INFORMATION Information);
+
+__declspec(dllimport)
+ULONG WINAPI TableDiffPrint(_In_opt_ PVOID Context,
+                            _In_reads_(Count) const TABLE_DIFF_EVENT * Events,
+                            _In_ ULONG Count);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//ʽӱ
+
+
+#define TABLE_COLUMNS_BLOCK  64 //룬һѡλͼ֣UINT64Ӧһ顣
+#define TABLE_COLUMNS_STATES 13 // Stateеȡֵ0UDPδ֪ģMIB_TCP_STATE_CLOSEDMIB_TCP_STATE_DELETE_TCB
+
+#define TABLE_COLUMNS_SELECTION_WORDS(Count) (((Count) + TABLE_COLUMNS_BLOCK - 1) / TABLE_COLUMNS_BLOCK)
+
+
+//ӱʽstruct of arraysıʾTableColumnsAppend
+//ÿһһ飬͹ֻõСIPv4IPv6ĵַͳһΪ16ֽڣIPv4ӳĵַ
+//ֻʱã̰߳ȫġTableColumnsInitʼTableColumnsFreeͷš
+typedef struct _TABLE_COLUMNS {
+    ULONG Count;
+    ULONG Capacity;          //TABLE_COLUMNS_BLOCKı
+    PUINT8 Family;           // AF_INETAF_INET6
+    PUINT8 Protocol;         // IPPROTO_TCPIPPROTO_UDP
+    PUINT8 State;            // TCPMIB_TCP_STATEUDPĺͲʶ0
+    PUSHORT LocalPort;       //ֽ
+    PUSHORT RemotePort;      // UDP0
+    PULONG Pid;
+    PIN6_ADDR LocalAddress;  // IPv4::ffff:a.b.c.d
+    PIN6_ADDR RemoteAddress;
+    PVOID Buffer;            //еһڴ
+    ULONG Grows;
+    PVOID Groups;            //õĹϣڲá
+    ULONG GroupCapacity;
+} TABLE_COLUMNS, * PTABLE_COLUMNS;
+
+
+// TABLE_COLUMNS_FILTERFlagsȽЩУȣStateǼϣ
+#define TABLE_COLUMNS_MATCH_FAMILY      0x01
+#define TABLE_COLUMNS_MATCH_PROTOCOL    0x02
+#define TABLE_COLUMNS_MATCH_STATES      0x04
+#define TABLE_COLUMNS_MATCH_PID         0x08
+#define TABLE_COLUMNS_MATCH_LOCAL_PORT  0x10
+#define TABLE_COLUMNS_MATCH_REMOTE_PORT 0x20
+
+
+typedef struct _TABLE_COLUMNS_FILTER {
+    ULONG Flags;
+    UINT8 Family;
+    UINT8 Protocol;
+    USHORT LocalPort;  //ֽ
+    USHORT RemotePort;
+    USHORT Reserved;
+    ULONG States;      //״̬ļϣnλStateΪnģ磺1 << MIB_TCP_STATE_ESTAB
+    ULONG Pid;
+} TABLE_COLUMNS_FILTER, * PTABLE_COLUMNS_FILTER;
+
+
+//ĽCountӴСͬİС
+typedef struct _TABLE_COLUMNS_PID_COUNT {
+    ULONG Pid;
+    ULONG Count;
+} TABLE_COLUMNS_PID_COUNT, * PTABLE_COLUMNS_PID_COUNT;
+
+typedef struct _TABLE_COLUMNS_ADDRESS_COUNT {
+    IN6_ADDR Address;
+    ULONG Count;
+} TABLE_COLUMNS_ADDRESS_COUNT, * PTABLE_COLUMNS_ADDRESS_COUNT;
+
+
+__declspec(dllimport)
+void WINAPI TableColumnsInit(_Out_ PTABLE_COLUMNS Columns);
+
+__declspec(dllimport)
+void WINAPI TableColumnsReset(_Inout_ PTABLE_COLUMNS Columns);
+
+__declspec(dllimport)
+ULONG WINAPI TableColumnsAppend(_Inout_ PTABLE_COLUMNS Columns, _In_ const TABLE_SNAPSHOT * Snapshot);
+
+__declspec(dllimport)
+ULONG WINAPI TableColumnsAppendTcp4(_Inout_ PTABLE_COLUMNS Columns, _In_ const MIB_TCPTABLE_OWNER_PID * Table);
+
+__declspec(dllimport)
+ULONG WINAPI TableColumnsAppendTcp6(_Inout_ PTABLE_COLUMNS Columns, _In_ const MIB_TCP6TABLE_OWNER_MODULE * Table);
+
+__declspec(dllimport)
+ULONG WINAPI TableColumnsFilter(_In_ const TABLE_COLUMNS * Columns,
+                                _In_ const TABLE_COLUMNS_FILTER * Filter,
+                                _Out_writes_(TABLE_COLUMNS_SELECTION_WORDS(Columns->Count)) PUINT64 Selection);
+
+__declspec(dllimport)
+void WINAPI TableColumnsCountByState(_In_ const TABLE_COLUMNS * Columns,
+                                     _In_opt_ const UINT64 * Selection,
+                                     _Out_writes_(TABLE_COLUMNS_STATES) PULONG Counts);
+
+__declspec(dllimport)
+ULONG WINAPI TableColumnsTopPids(_Inout_ PTABLE_COLUMNS Columns,
+                                 _In_opt_ const UINT64 * Selection,
+                                 _In_ ULONG Count,
+                                 _Out_writes_to_(Count, *Returned) PTABLE_COLUMNS_PID_COUNT Top,
+                                 _Out_ PULONG Returned,
+                                 _Out_opt_ PULONG Groups);
+
+__declspec(dllimport)
+ULONG WINAPI TableColumnsTopRemoteAddresses(_Inout_ PTABLE_COLUMNS Columns,
+                                            _In_opt_ const UINT64 * Selection,
+                                            _In_ ULONG Count,
+                                            _Out_writes_to_(Count, *Returned) PTABLE_COLUMNS_ADDRESS_COUNT Top,
+                                            _Out_ PULONG Returned,
+                                            _Out_opt_ PULONG Groups);
+
+__declspec(dllimport)
+void WINAPI TableColumnsFree(_Inout_ PTABLE_COLUMNS Columns);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//ȡӱĺˡ
+
+
+typedef struct _TABLE_BACKEND TABLE_BACKEND, * PTABLE_BACKEND; //ȡӱĺˣTableBackendEnumeratḛ߳ȫġ
+
+
+// TableBackendCreateType
+#define TABLE_BACKEND_DEFAULT  0 // WindowsTABLE_BACKEND_IPHELPERLinuxTABLE_BACKEND_NETLINK
+#define TABLE_BACKEND_IPHELPER 1 // GetExtendedTcpTableGetExtendedUdpTableOWNER_PIDֻWindowsġ
+#define TABLE_BACKEND_NETLINK  2 // NETLINK_SOCK_DIAGinet_diagں˲ֵ֧ıĶ/proc/netֻLinuxġ
+#define TABLE_BACKEND_PROCFS   3 ///proc/net/tcptcp6udpudp6ֻLinuxġ
+
+// TableBackendCreateFlags
+#define TABLE_BACKEND_NO_PIDS 0x1 //Ḷ̌OwningPid0LinuxҽҪ/proc/*/fdȡöࡣ
+
+// TableBackendEnumerateTables
+#define TABLE_BACKEND_TCP4 0x1
+#define TABLE_BACKEND_TCP6 0x2
+#define TABLE_BACKEND_UDP4 0x4
+#define TABLE_BACKEND_UDP6 0x8
+#define TABLE_BACKEND_ALL  (TABLE_BACKEND_TCP4 | TABLE_BACKEND_TCP6 | TABLE_BACKEND_UDP4 | TABLE_BACKEND_UDP6)
+
+#define TABLE_BACKEND_BATCH 256 //صһ
+
+
+//˵ͳһĸʽͬTABLE_DIFF_ROWWindowsĿֱӵTABLE_DIFF_ROWã
+//˿ֽIPv4ĵַǰ4ֽڣ0FamilyǱƽ̨AF_INETAF_INET6
+typedef struct _TABLE_BACKEND_ROW {
+    ADDRESS_FAMILY Family;
+    UINT8 Protocol;        // IPPROTO_TCPIPPROTO_UDP
+    UINT8 Reserved;
+    USHORT LocalPort;
+    USHORT RemotePort;     // WindowsUDP0LinuxӹconnectUDPС
+    ULONG State;           // TCPMIB_TCP_STATELinuxҲUDP0
+    ULONG OwningPid;       //ҲģûȨޣѾ˳ȣTABLE_BACKEND_NO_PIDS0
+    UINT8 LocalAddress[16];
+    UINT8 RemoteAddress[16];
+} TABLE_BACKEND_ROW, * PTABLE_BACKEND_ROW;
+
+
+//ERROR_SUCCESSֵֹö٣TableBackendEnumerateֵ
+typedef ULONG(WINAPI * TABLE_BACKEND_CALLBACK)(_In_opt_ PVOID Context,
+                                               _In_reads_(Count) const TABLE_BACKEND_ROW * Rows,
+                                               _In_ ULONG Count);
+
+
+typedef struct _TABLE_BACKEND_INFORMATION {
+    ULONG Type;          //ʵõĺˣTABLE_BACKEND_DEFAULTġ
+    ULONG Enumerations;
+    UINT64 Rows;         //ۼƵ
+    ULONG Fallbacks;     // TABLE_BACKEND_NETLINKں˲֧֣Ķ/proc/netıĸ
+    ULONG IndexBuilds;   // LinuxinodePIDؽ
+    ULONG Inodes;        //socketĸ
+    UINT64 Unmapped;     //inodeҲ̵С
+    SIZE_T Bytes;        //ռõڴ档
+} TABLE_BACKEND_INFORMATION, * PTABLE_BACKEND_INFORMATION;
+
+
+__declspec(dllimport)
+ULONG WINAPI TableBackendCreate(_In_ ULONG Type, _In_ ULONG Flags, _Out_ PTABLE_BACKEND * Backend);
+
+__declspec(dllimport)
+void WINAPI TableBackendDestroy(_In_opt_ PTABLE_BACKEND Backend);
+
+__declspec(dllimport)
+ULONG WINAPI TableBackendEnumerate(_In_ PTABLE_BACKEND Backend,
+                                   _In_ ULONG Tables,
+                                   _In_ TABLE_BACKEND_CALLBACK Callback,
+                                   _In_opt_ PVOID Context);
+
+__declspec(dllimport)
+void WINAPI TableBackendGetInformation(_In_ PTABLE_BACKEND Backend, _Out_ PTABLE_BACKEND_INFORMATION Information);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//ӵ̣ģ飩Ļ档
+
+
+typedef struct _OWNER_CACHE OWNER_CACHE, * POWNER_CACHE; //̵ģĻ棬OwnerCacheResolvḛ߳ȫġ
+
+
+#ifdef _WIN32
+typedef WCHAR OWNER_CHAR; // WindowsַUTF-16
+#define OWNER_MODULE_INFO_SIZE TCPIP_OWNING_MODULE_SIZE
+#else
+typedef char OWNER_CHAR;  // LinuxļԭֽڣһUTF-8
+#define OWNER_MODULE_INFO_SIZE 16
+#endif
+
+#define OWNER_CACHE_DEFAULT_ENTRIES 4096
+#define OWNER_CACHE_MAX_AGE         2000 //ܵȴ˳Ŀ򲻿̵ģ񶨵ģЧڣ룩
+
+
+//һ̣߷񣩵ģ顣
+typedef struct _OWNER_MODULE {
+    ULONG Pid;
+    ULONG Reserved;
+    UINT64 CreateTime;        // Windowsǽ̵Ĵʱ䣨FILETIMELinux/proc/[pid]/statstarttime
+    const OWNER_CHAR * Name;  // WindowspModuleNameǷLinuxcomm
+    const OWNER_CHAR * Path;  // WindowspModulePathLinux/proc/[pid]/exeûȨ޵ǿմ
+} OWNER_MODULE, * POWNER_MODULE;
+
+
+//ҵһ
+typedef struct _OWNER_CACHE_REQUEST {
+    ULONG Pid;
+    const UINT64 * ModuleInfo; // OWNER_MODULEеOwningModuleInfoOWNER_MODULE_INFO_SIZEnullptr
+} OWNER_CACHE_REQUEST, * POWNER_CACHE_REQUEST;
+
+
+typedef struct _OWNER_CACHE_INFORMATION {
+    UINT64 Lookups;        //ҵÿһж㣩
+    UINT64 Hits;           //еģ񶨵ģ
+    UINT64 Misses;         //ʵȥϵͳĴ
+    UINT64 NegativeHits;   //еǲ鲻ģûȨޣѾ˳ȣ
+    UINT64 Invalidations;  //˳߹ڣɾġ
+    UINT64 Evictions;      //̭ġ
+    ULONG Entries;
+    ULONG MaxEntries;
+    SIZE_T Bytes;
+} OWNER_CACHE_INFORMATION, * POWNER_CACHE_INFORMATION;
+
+
+__declspec(dllimport)
+ULONG WINAPI OwnerCacheCreate(_In_ ULONG MaxEntries, _Out_ POWNER_CACHE * Cache);
+
+__declspec(dllimport)
+void WINAPI OwnerCacheDestroy(_In_opt_ POWNER_CACHE Cache);
+
+__declspec(dllimport)
+POWNER_CACHE WINAPI OwnerCacheAcquireDefault();
+
+__declspec(dllimport)
+void WINAPI OwnerCacheReleaseDefault();
+
+__declspec(dllimport)
+ULONG WINAPI OwnerCacheLookup(_In_ POWNER_CACHE Cache,
+                              _In_ ULONG Pid,
+                              _In_opt_ const UINT64 * ModuleInfo,
+                              _Out_ const OWNER_MODULE ** Module);
+
+__declspec(dllimport)
+ULONG WINAPI OwnerCacheResolve(_In_ POWNER_CACHE Cache,
+                               _In_reads_(Count) const OWNER_CACHE_REQUEST * Requests,
+                               _In_ ULONG Count,
+                               _Out_writes_(Count) const OWNER_MODULE ** Modules);
+
+__declspec(dllimport)
+ULONG WINAPI OwnerCacheResolveRows(_In_ POWNER_CACHE Cache,
+                                   _In_reads_(Count) const TABLE_BACKEND_ROW * Rows,
+                                   _In_ ULONG Count,
+                                   _Out_writes_(Count) const OWNER_MODULE ** Modules);
+
+__declspec(dllimport)
+void WINAPI OwnerCacheSweep(_In_ POWNER_CACHE Cache);
+
+__declspec(dllimport)
+void WINAPI OwnerCacheQuery(_In_ POWNER_CACHE Cache, _Out_ POWNER_CACHE_INFORMATION Information);
+
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
 
@@ -390,6 +1540,407 @@ USHORT WINAPI calc_icmp4_sum(PICMP_HEADER icmp, int size);
 __declspec(dllimport)
 USHORT WINAPI checksum(USHORT * buffer, int size);
 
+__declspec(dllimport)
+void WINAPI ChecksumInit(_Out_ PCHECKSUM_CONTEXT Context);
+
+__declspec(dllimport)
+void WINAPI ChecksumUpdate(_Inout_ PCHECKSUM_CONTEXT Context, _In_reads_bytes_(Size) const void * Buffer, _In_ SIZE_T Size);
+
+__declspec(dllimport)
+void WINAPI ChecksumUpdatePseudoHeader4(_Inout_ PCHECKSUM_CONTEXT Context,
+                                        _In_ const IN_ADDR * SourceAddress,
+                                        _In_ const IN_ADDR * DestinationAddress,
+                                        _In_ UINT8 Protocol,
+                                        _In_ UINT16 Length);
+
+__declspec(dllimport)
+void WINAPI ChecksumUpdatePseudoHeader6(_Inout_ PCHECKSUM_CONTEXT Context,
+                                        _In_ const IN6_ADDR * SourceAddress,
+                                        _In_ const IN6_ADDR * DestinationAddress,
+                                        _In_ UINT8 NextHeader,
+                                        _In_ UINT32 Length);
+
+__declspec(dllimport)
+USHORT WINAPI ChecksumFinal(_In_ PCHECKSUM_CONTEXT Context);
+
+__declspec(dllimport)
+USHORT WINAPI ChecksumAdjust16(_In_ USHORT Checksum, _In_ USHORT OldValue, _In_ USHORT NewValue);
+
+__declspec(dllimport)
+USHORT WINAPI ChecksumAdjust32(_In_ USHORT Checksum, _In_ UINT32 OldValue, _In_ UINT32 NewValue);
+
+__declspec(dllimport)
+USHORT WINAPI ChecksumAdjust(_In_ USHORT Checksum,
+                             _In_reads_bytes_(Size) const void * OldData,
+                             _In_reads_bytes_(Size) const void * NewData,
+                             _In_ SIZE_T Size);
+
+__declspec(dllimport)
+USHORT WINAPI UdpChecksumAdjust(_In_ USHORT Checksum,
+                                _In_reads_bytes_(Size) const void * OldData,
+                                _In_reads_bytes_(Size) const void * NewData,
+                                _In_ SIZE_T Size);
+
+__declspec(dllimport)
+ULONG WINAPI PacketizeSyn4Batch(_In_reads_bytes_(6) PBYTE SrcMac,
+                                _In_reads_bytes_(6) PBYTE DesMac,
+                                _In_ PIN_ADDR SourceAddress,
+                                _In_ UINT16 th_sport,
+                                _In_ ULONG Count,
+                                _In_reads_(Count) const IN_ADDR * DestinationAddresses,
+                                _In_reads_(Count) const UINT16 * DestinationPorts,
+                                _Out_writes_bytes_(SlabSize) PBYTE Slab,
+                                _In_ SIZE_T SlabSize,
+                                _In_ ULONG Stride,
+                                _Out_writes_opt_(Count) PPACKET_SPAN Spans);
+
+__declspec(dllimport)
+ULONG WINAPI PacketizeSyn6Batch(_In_reads_bytes_(6) PBYTE SrcMac,
+                                _In_reads_bytes_(6) PBYTE DesMac,
+                                _In_ PIN6_ADDR SourceAddress,
+                                _In_ UINT16 th_sport,
+                                _In_ ULONG Count,
+                                _In_reads_(Count) const IN6_ADDR * DestinationAddresses,
+                                _In_reads_(Count) const UINT16 * DestinationPorts,
+                                _Out_writes_bytes_(SlabSize) PBYTE Slab,
+                                _In_ SIZE_T SlabSize,
+                                _In_ ULONG Stride,
+                                _Out_writes_opt_(Count) PPACKET_SPAN Spans);
+
+__declspec(dllimport)
+ULONG WINAPI packetize_icmpv4_echo_request_batch(_In_reads_bytes_(6) PBYTE SrcMac,
+                                                 _In_reads_bytes_(6) PBYTE DesMac,
+                                                 _In_ PIN_ADDR SourceAddress,
+                                                 _In_ UINT16 Sequence,
+                                                 _In_ ULONG Count,
+                                                 _In_reads_(Count) const IN_ADDR * DestinationAddresses,
+                                                 _Out_writes_bytes_(SlabSize) PBYTE Slab,
+                                                 _In_ SIZE_T SlabSize,
+                                                 _In_ ULONG Stride,
+                                                 _Out_writes_opt_(Count) PPACKET_SPAN Spans);
+
+__declspec(dllimport)
+ULONG WINAPI packetize_icmpv6_echo_request_batch(_In_reads_bytes_(6) PBYTE SrcMac,
+                                                 _In_reads_bytes_(6) PBYTE DesMac,
+                                                 _In_ PIN6_ADDR SourceAddress,
+                                                 _In_ UINT16 Sequence,
+                                                 _In_ ULONG Count,
+                                                 _In_reads_(Count) const IN6_ADDR * DestinationAddresses,
+                                                 _Out_writes_bytes_(SlabSize) PBYTE Slab,
+                                                 _In_ SIZE_T SlabSize,
+                                                 _In_ ULONG Stride,
+                                                 _Out_writes_opt_(Count) PPACKET_SPAN Spans);
+
+__declspec(dllimport)
+ULONG WINAPI packetize_icmpv4_echo_request_gather(_In_reads_bytes_(6) PBYTE SrcMac,
+                                                  _In_reads_bytes_(6) PBYTE DesMac,
+                                                  _In_ PIN_ADDR SourceAddress,
+                                                  _In_ PIN_ADDR DestinationAddress,
+                                                  _In_ UINT16 Sequence,
+                                                  _In_reads_(PayloadCount) const PACKET_SEGMENT * Payload,
+                                                  _In_ ULONG PayloadCount,
+                                                  _Out_writes_bytes_(PACKET_GATHER_HEADER_SIZE) PBYTE Header,
+                                                  _Out_writes_(*SegmentCount) PPACKET_SEGMENT Segments,
+                                                  _Inout_ PULONG SegmentCount);
+
+__declspec(dllimport)
+ULONG WINAPI packetize_icmpv6_echo_request_gather(_In_reads_bytes_(6) PBYTE SrcMac,
+                                                  _In_reads_bytes_(6) PBYTE DesMac,
+                                                  _In_ PIN6_ADDR SourceAddress,
+                                                  _In_ PIN6_ADDR DestinationAddress,
+                                                  _In_ UINT16 Sequence,
+                                                  _In_reads_(PayloadCount) const PACKET_SEGMENT * Payload,
+                                                  _In_ ULONG PayloadCount,
+                                                  _Out_writes_bytes_(PACKET_GATHER_HEADER_SIZE) PBYTE Header,
+                                                  _Out_writes_(*SegmentCount) PPACKET_SEGMENT Segments,
+                                                  _Inout_ PULONG SegmentCount);
+
+__declspec(dllimport)
+ULONG WINAPI PacketizeUdp4Gather(_In_reads_bytes_(6) PBYTE SrcMac,
+                                 _In_reads_bytes_(6) PBYTE DesMac,
+                                 _In_ PIN_ADDR SourceAddress,
+                                 _In_ PIN_ADDR DestinationAddress,
+                                 _In_ UINT16 SourcePort,
+                                 _In_ UINT16 DestinationPort,
+                                 _In_reads_(PayloadCount) const PACKET_SEGMENT * Payload,
+                                 _In_ ULONG PayloadCount,
+                                 _Out_writes_bytes_(PACKET_GATHER_HEADER_SIZE) PBYTE Header,
+                                 _Out_writes_(*SegmentCount) PPACKET_SEGMENT Segments,
+                                 _Inout_ PULONG SegmentCount);
+
+__declspec(dllimport)
+ULONG WINAPI PacketizeUdp6Gather(_In_reads_bytes_(6) PBYTE SrcMac,
+                                 _In_reads_bytes_(6) PBYTE DesMac,
+                                 _In_ PIN6_ADDR SourceAddress,
+                                 _In_ PIN6_ADDR DestinationAddress,
+                                 _In_ UINT16 SourcePort,
+                                 _In_ UINT16 DestinationPort,
+                                 _In_reads_(PayloadCount) const PACKET_SEGMENT * Payload,
+                                 _In_ ULONG PayloadCount,
+                                 _Out_writes_bytes_(PACKET_GATHER_HEADER_SIZE) PBYTE Header,
+                                 _Out_writes_(*SegmentCount) PPACKET_SEGMENT Segments,
+                                 _Inout_ PULONG SegmentCount);
+
+__declspec(dllimport)
+ULONG WINAPI PacketGatherCopy(_In_reads_(Count) const PACKET_SEGMENT * Segments,
+                              _In_ ULONG Count,
+                              _Out_writes_bytes_opt_(Size) PBYTE Buffer,
+                              _In_ SIZE_T Size,
+                              _Out_ PSIZE_T Length);
+
+__declspec(dllimport)
+ULONG WINAPI PcapOpenWriter(_In_z_ LPCWSTR FileName,
+                            _In_ ULONG Format,
+                            _In_ ULONG LinkType,
+                            _Out_ PPCAP_WRITER * Writer);
+
+__declspec(dllimport)
+ULONG WINAPI PcapWritePacket(_In_ PPCAP_WRITER Writer,
+                             _In_ UINT64 Timestamp,
+                             _In_reads_bytes_(Length) const BYTE * Frame,
+                             _In_ ULONG Length,
+                             _In_ ULONG OriginalLength);
+
+__declspec(dllimport)
+ULONG WINAPI PcapWriteBatch(_In_ PPCAP_WRITER Writer,
+                            _In_ UINT64 Timestamp,
+                            _In_ const BYTE * Slab,
+                            _In_reads_(Count) const PACKET_SPAN * Spans,
+                            _In_ ULONG Count);
+
+__declspec(dllimport)
+ULONG WINAPI PcapCloseWriter(_In_ PPCAP_WRITER Writer);
+
+__declspec(dllimport)
+ULONG WINAPI PcapOpenReader(_In_z_ LPCWSTR FileName, _Out_ PPCAP_READER * Reader);
+
+__declspec(dllimport)
+ULONG WINAPI PcapNextPacket(_Inout_ PPCAP_READER Reader, _Out_ PPCAP_PACKET Packet);
+
+__declspec(dllimport)
+void WINAPI PcapCloseReader(_In_ PPCAP_READER Reader);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//Ľصġ
+
+
+__declspec(dllimport)
+ULONG WINAPI DissectPacket(_In_reads_bytes_(Size) const BYTE * Frame, _In_ SIZE_T Size, _Out_ PPACKET_INFO Info);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//״̬̽صġ
+
+
+__declspec(dllimport)
+ULONG WINAPI ProbeInitialize(_Out_ PPROBE_CONTEXT Context,
+                             _In_reads_bytes_opt_(16) const BYTE * Key,
+                             _In_ UINT16 PortBase,
+                             _In_ UINT16 PortCount);
+
+__declspec(dllimport)
+void WINAPI ProbeSequence4(_In_ const PROBE_CONTEXT * Context,
+                           _In_ const IN_ADDR * DestinationAddress,
+                           _In_ UINT16 th_dport,
+                           _Out_ PUINT16 th_sport,
+                           _Out_ SEQ_NUM * th_seq);
+
+__declspec(dllimport)
+void WINAPI ProbeSequence6(_In_ const PROBE_CONTEXT * Context,
+                           _In_ const IN6_ADDR * DestinationAddress,
+                           _In_ UINT16 th_dport,
+                           _Out_ PUINT16 th_sport,
+                           _Out_ SEQ_NUM * th_seq);
+
+__declspec(dllimport)
+void WINAPI PacketizeProbe4(_In_ const PROBE_CONTEXT * Context,
+                            _In_reads_bytes_(6) const BYTE * SrcMac,
+                            _In_reads_bytes_(6) const BYTE * DesMac,
+                            _In_ const IN_ADDR * SourceAddress,
+                            _In_ const IN_ADDR * DestinationAddress,
+                            _In_ UINT16 th_dport,
+                            _Out_ PBYTE buffer);
+
+__declspec(dllimport)
+void WINAPI PacketizeProbe6(_In_ const PROBE_CONTEXT * Context,
+                            _In_reads_bytes_(6) const BYTE * SrcMac,
+                            _In_reads_bytes_(6) const BYTE * DesMac,
+                            _In_ const IN6_ADDR * SourceAddress,
+                            _In_ const IN6_ADDR * DestinationAddress,
+                            _In_ UINT16 th_dport,
+                            _Out_ PBYTE buffer);
+
+__declspec(dllimport)
+ULONG WINAPI ProbeMatchReply(_In_ const PROBE_CONTEXT * Context,
+                             _In_reads_bytes_(Size) const BYTE * Frame,
+                             _In_ SIZE_T Size,
+                             _Out_ PPROBE_REPLY Reply);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//Ƭصġ
+
+
+__declspec(dllimport)
+ULONG WINAPI IpFragment(_In_reads_bytes_(Size) const BYTE * Frame,
+                        _In_ SIZE_T Size,
+                        _In_ ULONG Mtu,
+                        _In_ UINT32 Identification,
+                        _Out_writes_bytes_(HeaderSlabSize) PBYTE HeaderSlab,
+                        _In_ SIZE_T HeaderSlabSize,
+                        _Out_writes_(*Count) PIP_FRAGMENT Fragments,
+                        _Inout_ PULONG Count);
+
+__declspec(dllimport)
+ULONG WINAPI IpReassemblerCreate(_In_ ULONG MaxDatagrams,
+                                 _In_ ULONG Timeout,
+                                 _In_ ULONG OverlapPolicy,
+                                 _Out_ PIP_REASSEMBLER * Reassembler);
+
+__declspec(dllimport)
+ULONG WINAPI IpReassemblerAdd(_In_ PIP_REASSEMBLER Reassembler,
+                              _In_reads_bytes_(Size) const BYTE * Frame,
+                              _In_ SIZE_T Size,
+                              _In_ UINT64 Now,
+                              _Out_ const BYTE ** Datagram,
+                              _Out_ PSIZE_T DatagramSize);
+
+__declspec(dllimport)
+void WINAPI IpReassemblerGetStatistics(_In_ PIP_REASSEMBLER Reassembler,
+                                       _Out_ PIP_REASSEMBLY_STATISTICS Statistics);
+
+__declspec(dllimport)
+void WINAPI IpReassemblerDestroy(_In_ PIP_REASSEMBLER Reassembler);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//ǰ׺ƥصġ
+
+
+__declspec(dllimport)
+ULONG WINAPI LpmBuild(_In_reads_(Count) const LPM_PREFIX * Prefixes, _In_ ULONG Count, _Out_ PLPM_TABLE * Table);
+
+__declspec(dllimport)
+ULONG WINAPI LpmBuildFromRouteTable(_In_ ADDRESS_FAMILY Family, _Out_ PLPM_TABLE * Table);
+
+__declspec(dllimport)
+ULONG WINAPI LpmGetRoute(_In_ const LPM_TABLE * Table, _In_ UINT32 Value, _Out_ PMIB_IPFORWARD_ROW2 Route);
+
+__declspec(dllimport)
+void WINAPI LpmQueryTable(_In_ const LPM_TABLE * Table, _Out_ PLPM_TABLE_INFORMATION Information);
+
+__declspec(dllimport)
+void WINAPI LpmAddRef(_In_ PLPM_TABLE Table);
+
+__declspec(dllimport)
+void WINAPI LpmRelease(_In_opt_ PLPM_TABLE Table);
+
+__declspec(dllimport)
+UINT32 WINAPI LpmLookup4(_In_ const LPM_TABLE * Table, _In_ const IN_ADDR * Address);
+
+__declspec(dllimport)
+UINT32 WINAPI LpmLookup6(_In_ const LPM_TABLE * Table, _In_ const IN6_ADDR * Address);
+
+__declspec(dllimport)
+void WINAPI LpmLookup4Batch(_In_ const LPM_TABLE * Table,
+                            _In_reads_(Count) const IN_ADDR * Addresses,
+                            _In_ ULONG Count,
+                            _Out_writes_(Count) PUINT32 Values);
+
+__declspec(dllimport)
+void WINAPI LpmLookup6Batch(_In_ const LPM_TABLE * Table,
+                            _In_reads_(Count) const IN6_ADDR * Addresses,
+                            _In_ ULONG Count,
+                            _Out_writes_(Count) PUINT32 Values);
+
+__declspec(dllimport)
+ULONG WINAPI LpmIndexCreate(_Out_ PLPM_INDEX * Index);
+
+__declspec(dllimport)
+void WINAPI LpmIndexPublish(_In_ PLPM_INDEX Index, _In_opt_ PLPM_TABLE Table);
+
+__declspec(dllimport)
+PLPM_TABLE WINAPI LpmIndexAcquire(_In_ PLPM_INDEX Index);
+
+__declspec(dllimport)
+ULONG WINAPI LpmIndexRebuildFromRouteTable(_In_ PLPM_INDEX Index, _In_ ADDRESS_FAMILY Family, _In_ BOOLEAN Watch);
+
+__declspec(dllimport)
+ULONG WINAPI LpmIndexWait(_In_ PLPM_INDEX Index);
+
+__declspec(dllimport)
+void WINAPI LpmIndexDestroy(_In_ PLPM_INDEX Index);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//IPصġ
+
+
+__declspec(dllimport)
+ULONG WINAPI IpSetCreate(_Out_ PIP_SET * Set);
+
+__declspec(dllimport)
+void WINAPI IpSetDestroy(_In_opt_ PIP_SET Set);
+
+__declspec(dllimport)
+ULONG WINAPI IpSetAddRange(_In_ PIP_SET Set,
+                           _In_ ADDRESS_FAMILY Family,
+                           _In_ const void * First,
+                           _In_ const void * Last);
+
+__declspec(dllimport)
+ULONG WINAPI IpSetAddPrefix(_In_ PIP_SET Set,
+                            _In_ ADDRESS_FAMILY Family,
+                            _In_ const void * Address,
+                            _In_ UINT8 PrefixLength);
+
+__declspec(dllimport)
+ULONG WINAPI IpSetAddString(_In_ PIP_SET Set, _In_z_ PCSTR Entry);
+
+__declspec(dllimport)
+ULONG WINAPI IpSetLoadText(_In_ PIP_SET Set,
+                           _In_reads_bytes_(Size) const char * Text,
+                           _In_ SIZE_T Size,
+                           _Out_opt_ PIP_SET_LOAD_STATISTICS Statistics);
+
+__declspec(dllimport)
+ULONG WINAPI IpSetLoadFile(_In_ PIP_SET Set,
+                           _In_z_ PCWSTR FileName,
+                           _Out_opt_ PIP_SET_LOAD_STATISTICS Statistics);
+
+__declspec(dllimport)
+BOOLEAN WINAPI IpSetContains(_In_ PIP_SET Set, _In_ ADDRESS_FAMILY Family, _In_ const void * Address);
+
+__declspec(dllimport)
+ULONG WINAPI IpSetUnion(_In_ PIP_SET A, _In_ PIP_SET B, _Out_ PIP_SET * Result);
+
+__declspec(dllimport)
+ULONG WINAPI IpSetIntersect(_In_ PIP_SET A, _In_ PIP_SET B, _Out_ PIP_SET * Result);
+
+__declspec(dllimport)
+ULONG WINAPI IpSetDifference(_In_ PIP_SET A, _In_ PIP_SET B, _Out_ PIP_SET * Result);
+
+__declspec(dllimport)
+void WINAPI IpSetQuery(_In_ PIP_SET Set, _Out_ PIP_SET_INFORMATION Information);
+
+__declspec(dllimport)
+ULONG WINAPI IpSetGetPrefixes(_In_ PIP_SET Set,
+                              _In_ ADDRESS_FAMILY Family,
+                              _Out_writes_opt_(Capacity) PLPM_PREFIX Prefixes,
+                              _In_ ULONG Capacity,
+                              _Out_ PULONG Count);
+
+__declspec(dllimport)
+ULONG WINAPI IpSetFormatFirewallAddresses(_In_ PIP_SET Set,
+                                          _In_ ULONG Start,
+                                          _In_ ULONG MaxEntries,
+                                          _Out_writes_(Characters) PWSTR Buffer,
+                                          _In_ SIZE_T Characters,
+                                          _Out_ PULONG Next);
+
+
+
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
 //ǽصġ
@@ -398,6 +1949,13 @@ USHORT WINAPI checksum(USHORT * buffer, int size);
 __declspec(dllimport)
 int WINAPI GettingFirewallSettings();
 
+__declspec(dllimport)
+HRESULT WINAPI AddRemoteAddressRules(_In_z_ PCWSTR Name,
+                                     _In_ PIP_SET Set,
+                                     _In_ BOOLEAN Outbound,
+                                     _In_ BOOLEAN Allow,
+                                     _Out_opt_ PULONG Rules);
+
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
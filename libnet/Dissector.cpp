@@ -0,0 +1,439 @@
+﻿#include "Dissector.h"
+
+#ifdef _WIN32
+#include "raw.h"
+#else
+#include <netinet/in.h>
+#endif
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/*
+零拷贝的报文解析。
+
+输入是一个完整的以太帧（指针和长度），输出是各层的偏移和关键字段（PACKET_INFO），不分配内存，不修改数据。
+
+每次读取之前都检查边界，所以可以直接处理抓到的（可能被截断的，或者恶意构造的）数据。
+读取时按字节组合（大端），不要求数据对齐。
+
+支持：
+1.以太网，802.1Q/802.1ad的VLAN标签（最多PACKET_MAX_VLAN层）。
+2.IPv4（包括选项），IPv6（包括扩展头链）。
+3.TCP（包括选项：MSS，WS，SACK_PERMITTED，Timestamp），UDP，ICMP，ICMPv6。
+*/
+
+
+#define ETHERNET_TYPE_VLAN       0x8100
+#define ETHERNET_TYPE_QINQ       0x88A8
+#define ETHERNET_TYPE_QINQ_OLD   0x9100
+
+//各个头（不含选项）的长度，不用raw.h等的结构，这样Linux上也能单独编译。
+#define DISSECT_ETHERNET_LENGTH      14 //以太类型是最后的两个字节。
+#define DISSECT_IPV4_LENGTH          20
+#define DISSECT_IPV6_LENGTH          40
+#define DISSECT_IPV6_FRAGMENT_LENGTH 8
+#define DISSECT_TCP_LENGTH           20
+#define DISSECT_UDP_LENGTH           8
+#define DISSECT_ICMP_LENGTH          4
+
+#ifndef _WIN32
+//Windows SDK（netiodef.h，mstcpip.h）里的，值同Windows。
+#define ETHERNET_TYPE_IPV4 0x0800
+#define ETHERNET_TYPE_IPV6 0x86dd
+
+#define TH_OPT_EOL            0
+#define TH_OPT_NOP            1
+#define TH_OPT_MSS            2
+#define TH_OPT_WS             3
+#define TH_OPT_SACK_PERMITTED 4
+#define TH_OPT_TS             8
+
+#define TH_SYN 0x02
+#endif
+
+
+static FORCEINLINE UINT16 ReadUint16(const BYTE * p)
+{
+    return (UINT16)((p[0] << 8) | p[1]);
+}
+
+
+static FORCEINLINE UINT32 ReadUint32(const BYTE * p)
+{
+    return ((UINT32)p[0] << 24) | ((UINT32)p[1] << 16) | ((UINT32)p[2] << 8) | p[3];
+}
+
+
+static ULONG DissectTcpOptions(const BYTE * Option, const BYTE * End, PPACKET_INFO Info)
+/*
+功能：解析TCP的选项。
+
+注意：不认识的选项按长度跳过，长度不合法的当作畸形的报文。
+*/
+{
+    while (Option < End) {
+        BYTE Kind = Option[0];
+
+        if (TH_OPT_EOL == Kind) {
+            break;
+        }
+
+        if (TH_OPT_NOP == Kind) {
+            Option++;
+            continue;
+        }
+
+        if (End - Option < 2) {
+            return ERROR_INVALID_DATA;
+        }
+
+        BYTE Length = Option[1];
+        if (Length < 2 || Length > End - Option) {
+            return ERROR_INVALID_DATA;
+        }
+
+        switch (Kind) {
+        case TH_OPT_MSS:
+            if (4 == Length) {
+                Info->TcpOptions |= PACKET_TCP_OPT_MSS;
+                Info->Mss = ReadUint16(Option + 2);
+            }
+            break;
+        case TH_OPT_WS:
+            if (3 == Length) {
+                Info->TcpOptions |= PACKET_TCP_OPT_WS;
+                Info->WindowScale = Option[2];
+            }
+            break;
+        case TH_OPT_SACK_PERMITTED:
+            if (2 == Length) {
+                Info->TcpOptions |= PACKET_TCP_OPT_SACK_PERMITTED;
+            }
+            break;
+        case TH_OPT_TS:
+            if (10 == Length) {
+                Info->TcpOptions |= PACKET_TCP_OPT_TIMESTAMP;
+                Info->TsVal = ReadUint32(Option + 2);
+                Info->TsEcr = ReadUint32(Option + 6);
+            }
+            break;
+        default:
+            break;
+        }
+
+        Option += Length;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG DissectTransport(const BYTE * Frame, UINT32 Offset, UINT32 End, PPACKET_INFO Info)
+/*
+功能：解析L4（TCP，UDP，ICMP，ICMPv6）。
+
+参数：
+End：IP报文的结束（已经去掉了以太网的填充）。
+
+注意：不认识的协议不算错误，剩下的数据都算作负载。
+*/
+{
+    UINT32 Available = End - Offset;
+    const BYTE * L4 = Frame + Offset;
+
+    Info->L4Offset = Offset;
+
+    switch (Info->Protocol) {
+    case IPPROTO_TCP:
+    {
+        if (Available < DISSECT_TCP_LENGTH) {
+            return ERROR_INSUFFICIENT_BUFFER;
+        }
+
+        UINT32 HeaderLength = (L4[12] >> 4) * 4;
+        if (HeaderLength < DISSECT_TCP_LENGTH) {
+            return ERROR_INVALID_DATA;
+        }
+
+        if (Available < HeaderLength) {
+            return ERROR_INSUFFICIENT_BUFFER;
+        }
+
+        Info->Layers |= PACKET_LAYER_TCP;
+        Info->SourcePort = ReadUint16(L4);
+        Info->DestinationPort = ReadUint16(L4 + 2);
+        Info->Seq = ReadUint32(L4 + 4);
+        Info->Ack = ReadUint32(L4 + 8);
+        Info->TcpFlags = L4[13];
+        Info->Window = ReadUint16(L4 + 14);
+        Info->L4Length = HeaderLength;
+
+        ULONG ret = DissectTcpOptions(L4 + DISSECT_TCP_LENGTH, L4 + HeaderLength, Info);
+        if (ERROR_SUCCESS != ret) {
+            return ret;
+        }
+
+        break;
+    }
+    case IPPROTO_UDP:
+    {
+        if (Available < DISSECT_UDP_LENGTH) {
+            return ERROR_INSUFFICIENT_BUFFER;
+        }
+
+        UINT16 Length = ReadUint16(L4 + 4);
+        if (Length < DISSECT_UDP_LENGTH) {
+            return ERROR_INVALID_DATA;
+        }
+
+        Info->Layers |= PACKET_LAYER_UDP;
+        Info->SourcePort = ReadUint16(L4);
+        Info->DestinationPort = ReadUint16(L4 + 2);
+        Info->L4Length = DISSECT_UDP_LENGTH;
+
+        if (Length < Available) { // UDP的长度比IP的短的，以UDP的为准。
+            End = Offset + Length;
+        }
+
+        break;
+    }
+    case IPPROTO_ICMP:
+    case IPPROTO_ICMPV6:
+        if (Available < DISSECT_ICMP_LENGTH) {
+            return ERROR_INSUFFICIENT_BUFFER;
+        }
+
+        Info->Layers |= PACKET_LAYER_ICMP;
+        Info->SourcePort = L4[0];      //类型。
+        Info->DestinationPort = L4[1]; //代码。
+        Info->L4Length = DISSECT_ICMP_LENGTH;
+        break;
+    default:
+        Info->L4Length = 0;
+        break;
+    }
+
+    Info->Layers |= PACKET_LAYER_PAYLOAD;
+    Info->PayloadOffset = Offset + Info->L4Length;
+    Info->PayloadLength = End - Info->PayloadOffset;
+
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG DissectIpv4(const BYTE * Frame, UINT32 Offset, UINT32 Size, PPACKET_INFO Info)
+{
+    const BYTE * Ip = Frame + Offset;
+    UINT32 Available = Size - Offset;
+
+    if (Available < DISSECT_IPV4_LENGTH) {
+        return ERROR_INSUFFICIENT_BUFFER;
+    }
+
+    UINT32 HeaderLength = (Ip[0] & 0x0f) * 4;
+    UINT32 TotalLength = ReadUint16(Ip + 2);
+
+    if ((Ip[0] >> 4) != 4 || HeaderLength < DISSECT_IPV4_LENGTH || TotalLength < HeaderLength) {
+        return ERROR_INVALID_DATA;
+    }
+
+    if (Available < HeaderLength) {
+        return ERROR_INSUFFICIENT_BUFFER;
+    }
+
+    Info->Layers |= PACKET_LAYER_IPV4;
+    Info->IpVersion = 4;
+    Info->L3Offset = Offset;
+    Info->L3Length = HeaderLength;
+    Info->HopLimit = Ip[8];
+    Info->Protocol = Ip[9];
+
+    UINT16 FlagsAndOffset = ReadUint16(Ip + 6);
+    if (FlagsAndOffset & 0x3fff) { // MF或者片偏移。
+        Info->Layers |= PACKET_LAYER_FRAGMENT;
+        Info->FragmentId = ReadUint16(Ip + 4);
+        Info->FragmentOffset = (UINT16)((FlagsAndOffset & 0x1fff) * 8);
+    }
+
+    //截断的（抓包时的snaplen）以实际的为准，填充的以IP头的为准。
+    UINT32 End = TotalLength < Available ? Offset + TotalLength : Size;
+
+    if (Info->FragmentOffset) { //非第一个分片，没有L4头。
+        Info->Layers |= PACKET_LAYER_PAYLOAD;
+        Info->PayloadOffset = Offset + HeaderLength;
+        Info->PayloadLength = End - Info->PayloadOffset;
+        return ERROR_SUCCESS;
+    }
+
+    return DissectTransport(Frame, Offset + HeaderLength, End, Info);
+}
+
+
+static ULONG DissectIpv6(const BYTE * Frame, UINT32 Offset, UINT32 Size, PPACKET_INFO Info)
+/*
+功能：解析IPv6头及扩展头链。
+
+注意：ESP（50）和No Next Header（59）之后的数据算作负载。
+*/
+{
+    const BYTE * Ip = Frame + Offset;
+    UINT32 Available = Size - Offset;
+
+    if (Available < DISSECT_IPV6_LENGTH) {
+        return ERROR_INSUFFICIENT_BUFFER;
+    }
+
+    if ((Ip[0] >> 4) != 6) {
+        return ERROR_INVALID_DATA;
+    }
+
+    UINT32 TotalLength = DISSECT_IPV6_LENGTH + ReadUint16(Ip + 4);
+    UINT32 End = TotalLength < Available ? Offset + TotalLength : Size;
+
+    Info->Layers |= PACKET_LAYER_IPV6;
+    Info->IpVersion = 6;
+    Info->L3Offset = Offset;
+    Info->HopLimit = Ip[7];
+
+    UINT8 NextHeader = Ip[6];
+    UINT32 Current = Offset + DISSECT_IPV6_LENGTH;
+    bool IsLaterFragment = false;
+
+    for (;;) {
+        const BYTE * Extension = Frame + Current;
+        UINT32 ExtensionLength;
+
+        switch (NextHeader) {
+        case IPPROTO_HOPOPTS:
+        case IPPROTO_ROUTING:
+        case IPPROTO_DSTOPTS:
+        case 135: // Mobility
+        case 139: // HIP
+        case 140: // Shim6
+            if (End - Current < 8) {
+                return ERROR_INSUFFICIENT_BUFFER;
+            }
+            ExtensionLength = (Extension[1] + 1) * 8;
+            break;
+        case IPPROTO_AH:
+            if (End - Current < 8) {
+                return ERROR_INSUFFICIENT_BUFFER;
+            }
+            ExtensionLength = (Extension[1] + 2) * 4;
+            break;
+        case IPPROTO_FRAGMENT:
+        {
+            if (End - Current < DISSECT_IPV6_FRAGMENT_LENGTH) {
+                return ERROR_INSUFFICIENT_BUFFER;
+            }
+
+            UINT16 OffsetAndFlags = ReadUint16(Extension + 2);
+            Info->Layers |= PACKET_LAYER_FRAGMENT;
+            Info->FragmentOffset = OffsetAndFlags & 0xfff8;
+            Info->FragmentId = ReadUint32(Extension + 4);
+            IsLaterFragment = Info->FragmentOffset != 0;
+            ExtensionLength = DISSECT_IPV6_FRAGMENT_LENGTH;
+            break;
+        }
+        default:
+            ExtensionLength = 0;
+            break;
+        }
+
+        if (0 == ExtensionLength) {
+            break;
+        }
+
+        if (End - Current < ExtensionLength) {
+            return ERROR_INSUFFICIENT_BUFFER;
+        }
+
+        NextHeader = Extension[0];
+        Current += ExtensionLength;
+
+        if (IsLaterFragment) {
+            break;
+        }
+    }
+
+    Info->Protocol = NextHeader;
+    Info->L3Length = Current - Offset;
+
+    if (IsLaterFragment) {
+        Info->Layers |= PACKET_LAYER_PAYLOAD;
+        Info->PayloadOffset = Current;
+        Info->PayloadLength = End - Current;
+        return ERROR_SUCCESS;
+    }
+
+    return DissectTransport(Frame, Current, End, Info);
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DissectPacket(_In_reads_bytes_(Size) const BYTE * Frame, _In_ SIZE_T Size, _Out_ PPACKET_INFO Info)
+/*
+功能：解析一个以太帧。
+
+参数：
+Frame：以太帧的开始（目的MAC）。
+Size：帧的长度，最大0xFFFFFFFF。
+Info：解析的结果。出错时，也包含已经解析的那几层。
+
+返回值：
+ERROR_SUCCESS：成功。不认识的以太类型或者L4协议也算成功，剩下的数据算作负载。
+ERROR_INSUFFICIENT_BUFFER：帧被截断了（头不完整）。
+ERROR_INVALID_DATA：畸形的报文（如：版本不对，头的长度不合法，TCP选项的长度不合法）。
+ERROR_NOT_SUPPORTED：VLAN标签的层数超过PACKET_MAX_VLAN。
+*/
+{
+    RtlZeroMemory(Info, sizeof(PACKET_INFO));
+
+    if (Size > MAXUINT32) {
+        return ERROR_NOT_SUPPORTED;
+    }
+
+    UINT32 Length = (UINT32)Size;
+
+    if (Length < DISSECT_ETHERNET_LENGTH) {
+        return ERROR_INSUFFICIENT_BUFFER;
+    }
+
+    Info->Layers = PACKET_LAYER_ETHERNET;
+
+    UINT32 Offset = DISSECT_ETHERNET_LENGTH;
+    UINT16 Type = ReadUint16(Frame + Offset - sizeof(UINT16));
+
+    while (ETHERNET_TYPE_VLAN == Type || ETHERNET_TYPE_QINQ == Type || ETHERNET_TYPE_QINQ_OLD == Type) {
+        if (PACKET_MAX_VLAN == Info->VlanCount) {
+            return ERROR_NOT_SUPPORTED;
+        }
+
+        if (Length - Offset < 4) {
+            return ERROR_INSUFFICIENT_BUFFER;
+        }
+
+        Info->Layers |= PACKET_LAYER_VLAN;
+        Info->VlanId[Info->VlanCount++] = ReadUint16(Frame + Offset) & 0x0fff;
+        Type = ReadUint16(Frame + Offset + 2);
+        Offset += 4;
+    }
+
+    Info->EtherType = Type;
+
+    switch (Type) {
+    case ETHERNET_TYPE_IPV4:
+        return DissectIpv4(Frame, Offset, Length, Info);
+    case ETHERNET_TYPE_IPV6:
+        return DissectIpv6(Frame, Offset, Length, Info);
+    default:
+        Info->Layers |= PACKET_LAYER_PAYLOAD;
+        Info->PayloadOffset = Offset;
+        Info->PayloadLength = Length - Offset;
+        return ERROR_SUCCESS;
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
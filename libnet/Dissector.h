@@ -0,0 +1,88 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "LinuxCompat.h" // Linux上单独编译，见test/DissectorTest.cpp。
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+//PACKET_INFO.Layers的取值（位或）。
+#define PACKET_LAYER_ETHERNET 0x0001
+#define PACKET_LAYER_VLAN     0x0002
+#define PACKET_LAYER_IPV4     0x0004
+#define PACKET_LAYER_IPV6     0x0008
+#define PACKET_LAYER_TCP      0x0010
+#define PACKET_LAYER_UDP      0x0020
+#define PACKET_LAYER_ICMP     0x0040 //ICMP或者ICMPv6。
+#define PACKET_LAYER_FRAGMENT 0x0080 //IP分片（包括第一个），非第一个分片没有L4。
+#define PACKET_LAYER_PAYLOAD  0x0100
+
+//PACKET_INFO.TcpOptions的取值（位或）。
+#define PACKET_TCP_OPT_MSS            0x01
+#define PACKET_TCP_OPT_WS             0x02
+#define PACKET_TCP_OPT_SACK_PERMITTED 0x04
+#define PACKET_TCP_OPT_TIMESTAMP      0x08
+
+#define PACKET_MAX_VLAN 2
+
+
+/*
+DissectPacket的结果。
+
+所有的偏移都是相对于帧（以太头）的开始，所有的数值都是主机序。
+只有Layers里标明的层的字段才有意义。
+*/
+typedef struct _PACKET_INFO {
+    UINT16 Layers;    // PACKET_LAYER_*。
+    UINT16 EtherType; //去掉VLAN标签之后的类型。
+
+    UINT8 VlanCount;
+    UINT8 IpVersion;  // 4或者6。
+    UINT8 Protocol;   // L4的协议（IPv6是扩展头链的最后一个），如：IPPROTO_TCP。
+    UINT8 HopLimit;   // IPv4的TTL或者IPv6的Hop Limit。
+    UINT16 VlanId[PACKET_MAX_VLAN];
+
+    UINT32 L3Offset;
+    UINT32 L3Length;  // IP头的长度（包括IPv4的选项和IPv6的扩展头）。
+    UINT32 L4Offset;
+    UINT32 L4Length;  // L4头的长度（包括TCP的选项）。
+    UINT32 PayloadOffset;
+    UINT32 PayloadLength; //以IP头里的长度为准（去掉以太网的填充），但不超过帧的长度。
+
+    UINT16 FragmentOffset; //以字节为单位。
+    UINT16 Reserved;
+    UINT32 FragmentId;
+
+    UINT16 SourcePort;      // TCP/UDP的端口，ICMP的类型。
+    UINT16 DestinationPort; // TCP/UDP的端口，ICMP的代码。
+
+    UINT32 Seq;
+    UINT32 Ack;
+    UINT16 Window;
+    UINT8 TcpFlags;
+    UINT8 TcpOptions;     // PACKET_TCP_OPT_*。
+    UINT16 Mss;
+    UINT8 WindowScale;
+    UINT8 Reserved2;
+    UINT32 TsVal;
+    UINT32 TsEcr;
+} PACKET_INFO, * PPACKET_INFO;
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C_START
+
+
+DLLEXPORT
+ULONG WINAPI DissectPacket(_In_reads_bytes_(Size) const BYTE * Frame, _In_ SIZE_T Size, _Out_ PPACKET_INFO Info);
+
+
+EXTERN_C_END
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
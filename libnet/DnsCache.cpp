@@ -0,0 +1,938 @@
+﻿#include "pch.h"
+#include "DnsCache.h"
+#include "DnsWire.h"
+#include "DnsReverse.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/*
+进程内的DNS缓存，键是（名字，类型，类别），名字忽略大小写和末尾的点。
+
+1.按照TTL过期；否定的应答（NXDOMAIN，NODATA）也缓存，TTL是SOA的TTL和MINIMUM中小的那个（RFC 2308），
+  没有SOA的否定的应答不缓存。
+2.分片：按键的哈希分到若干个片里，每个片一个SRW锁。查找只拿共享锁（命中的标记和计数用原子操作），
+  插入和淘汰拿独占锁。
+3.内存有上限（每个片平分），超过了用CLOCK（二次机会）淘汰：每个片的条目连成一个环，命中的设置引用位，
+  指针扫过时有引用位的清除后跳过，没有的（或者过期的）淘汰。比LRU少了查找时的链表操作（和独占锁）。
+4.DnsCacheInsertResponse保存整个应答的报文，取出时按经过的时间减小里面的TTL。
+
+参考：
+https://www.rfc-editor.org/rfc/rfc2308
+https://www.rfc-editor.org/rfc/rfc2181#section-8
+*/
+
+
+#define DNS_FLAG_QR 0x8000
+#define DNS_FLAG_TC 0x0200
+
+#define DNS_CACHE_MAX_SHARDS     256
+#define DNS_CACHE_BUCKET_BYTES   256 //平均每个条目的内存的估计，用来决定哈希桶的个数（不再扩容）。
+#define DNS_CACHE_MIN_BYTES      (64 * 1024)
+
+
+typedef struct _DNS_CACHE_ENTRY {
+    struct _DNS_CACHE_ENTRY * Next;      //哈希桶的链表。
+    struct _DNS_CACHE_ENTRY * ClockNext; // CLOCK的环。
+    struct _DNS_CACHE_ENTRY * ClockPrev;
+    ULONGLONG Inserted;                  // GetTickCount64。
+    ULONGLONG Expires;
+    SIZE_T Size;                         //占用的内存，包括这个头。
+    ULONG Hash;
+    ULONG Status;                        // ERROR_SUCCESS，DNS_ERROR_RCODE_NAME_ERROR，DNS_INFO_NO_RECORDS。
+    ULONG DataLength;
+    USHORT Type;
+    USHORT Class;
+    USHORT NameLength;
+    BOOLEAN Message;                     // Data是应答的报文，取出时调整TTL。
+    volatile LONG Referenced;
+    CHAR Name[1];                        //规范化的名字（小写，没有末尾的点），之后是Data。
+} DNS_CACHE_ENTRY, * PDNS_CACHE_ENTRY;
+
+
+typedef struct _DNS_CACHE_SHARD {
+    SRWLOCK Lock;
+    PDNS_CACHE_ENTRY * Buckets;
+    PDNS_CACHE_ENTRY Hand;               // CLOCK的指针，nullptr是空的。
+    SIZE_T Bytes;
+    ULONG Entries;
+    volatile LONG64 Hits;                //下面这4个在共享锁下用原子操作更新。
+    volatile LONG64 NegativeHits;
+    volatile LONG64 Misses;
+    volatile LONG64 Expired;
+    LONG64 Inserts;
+    LONG64 Evictions;
+    BYTE Padding[64];                    //避免相邻的片的计数在同一个缓存行里。
+} DNS_CACHE_SHARD, * PDNS_CACHE_SHARD;
+
+
+struct _DNS_CACHE {
+    ULONG ShardMask;
+    ULONG BucketMask;
+    ULONG Seed;                          //哈希的种子是随机的，以免别人构造冲突的名字。
+    SIZE_T MaxBytes;
+    SIZE_T ShardBytes;
+    PDNS_CACHE_SHARD Shards;
+};
+
+
+static PDNS_CACHE g_DnsCache; // DnsCacheDefault，进程退出前不释放。
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static ULONG NormalizeName(_In_z_ PCSTR Name, _Out_writes_(DNS_WIRE_MAX_NAME_TEXT) PSTR Key, _Out_ PUSHORT Length)
+/*
+功能：小写，去掉末尾的点（根还是"."）。不检查标签的语法，转义的字符原样保留。
+
+末尾的点是不是转义的，要从左往右按转义（\DDD或者\c，同DnsWire.cpp的NameEncode）扫描才知道，
+如：foo\.的点是转义的（保留），foo\\.的是转义的反斜杠加上根的点（去掉）。
+*/
+{
+    ULONG n = 0;
+    ULONG Escape = 0;     //后面还属于当前的转义的字符数。
+    bool Escaped = false; //最后一个字符是转义的。
+
+    for (; Name[n]; n++) {
+        if (n + 1 >= DNS_WIRE_MAX_NAME_TEXT) {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        CHAR c = Name[n];
+        Key[n] = (c >= 'A' && c <= 'Z') ? (CHAR)(c | 0x20) : c;
+
+        Escaped = 0 != Escape;
+        if (Escape) {
+            Escape--;
+        } else if ('\\' == c) {
+            PCSTR p = Name + n + 1;
+            bool Decimal = p[0] >= '0' && p[0] <= '9' && p[1] >= '0' && p[1] <= '9' && p[2] >= '0' && p[2] <= '9';
+            Escape = Decimal ? 3 : 1;
+        }
+    }
+
+    if (n > 1 && '.' == Key[n - 1] && !Escaped) {
+        n--;
+    }
+
+    if (0 == n) {
+        Key[n++] = '.';
+    }
+
+    Key[n] = 0;
+    *Length = (USHORT)n;
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG KeyHash(_In_ PDNS_CACHE Cache,
+                     _In_reads_(Length) PCSTR Key,
+                     _In_ ULONG Length,
+                     _In_ USHORT Type,
+                     _In_ USHORT Class)
+{
+    ULONG Hash = 0x811c9dc5 ^ Cache->Seed; // FNV-1a，最后再混合一下（低位用来选片）。
+
+    for (ULONG i = 0; i < Length; i++) {
+        Hash = (Hash ^ (BYTE)Key[i]) * 0x01000193;
+    }
+
+    Hash = (Hash ^ Type) * 0x01000193;
+    Hash = (Hash ^ Class) * 0x01000193;
+
+    Hash ^= Hash >> 16;
+    Hash *= 0x85EBCA6B;
+    Hash ^= Hash >> 13;
+    Hash *= 0xC2B2AE35;
+    Hash ^= Hash >> 16;
+    return Hash;
+}
+
+
+static PDNS_CACHE_ENTRY ShardFind(_In_ PDNS_CACHE Cache,
+                                  _In_ PDNS_CACHE_SHARD Shard,
+                                  _In_ ULONG Hash,
+                                  _In_reads_(Length) PCSTR Key,
+                                  _In_ USHORT Length,
+                                  _In_ USHORT Type,
+                                  _In_ USHORT Class)
+{
+    PDNS_CACHE_ENTRY Entry = Shard->Buckets[(Hash >> 8) & Cache->BucketMask];
+
+    for (; Entry; Entry = Entry->Next) {
+        if (Entry->Hash == Hash && Entry->Type == Type && Entry->Class == Class && Entry->NameLength == Length &&
+            0 == memcmp(Entry->Name, Key, Length)) {
+            break;
+        }
+    }
+
+    return Entry;
+}
+
+
+static void ShardUnlink(_In_ PDNS_CACHE Cache, _Inout_ PDNS_CACHE_SHARD Shard, _In_ PDNS_CACHE_ENTRY Entry)
+/*
+功能：从哈希桶和CLOCK的环里摘下（不释放），调用者持有独占锁。
+*/
+{
+    PDNS_CACHE_ENTRY * Link = &Shard->Buckets[(Entry->Hash >> 8) & Cache->BucketMask];
+
+    while (*Link != Entry) {
+        Link = &(*Link)->Next;
+    }
+
+    *Link = Entry->Next;
+
+    if (Entry->ClockNext == Entry) {
+        Shard->Hand = nullptr;
+    } else {
+        Entry->ClockPrev->ClockNext = Entry->ClockNext;
+        Entry->ClockNext->ClockPrev = Entry->ClockPrev;
+        if (Shard->Hand == Entry) {
+            Shard->Hand = Entry->ClockNext;
+        }
+    }
+
+    Shard->Bytes -= Entry->Size;
+    Shard->Entries--;
+}
+
+
+static PDNS_CACHE_ENTRY ShardEvict(_In_ PDNS_CACHE Cache,
+                                   _Inout_ PDNS_CACHE_SHARD Shard,
+                                   _In_ SIZE_T Needed,
+                                   _In_ ULONGLONG Now)
+/*
+功能：转动CLOCK的指针，直到放得下Needed字节。淘汰的条目用Next连起来返回，由调用者在锁外释放。
+
+每个条目最多被跳过一次（引用位清除了），所以最多转两圈。
+*/
+{
+    PDNS_CACHE_ENTRY Victims = nullptr;
+
+    while (Shard->Hand && Shard->Bytes + Needed > Cache->ShardBytes) {
+        PDNS_CACHE_ENTRY Entry = Shard->Hand;
+
+        if (Entry->Expires > Now && Entry->Referenced) {
+            Entry->Referenced = 0;
+            Shard->Hand = Entry->ClockNext;
+            continue;
+        }
+
+        if (Entry->Expires > Now) {
+            Shard->Evictions++;
+        }
+
+        ShardUnlink(Cache, Shard, Entry);
+        Entry->Next = Victims;
+        Victims = Entry;
+    }
+
+    return Victims;
+}
+
+
+static void FreeEntries(_In_opt_ PDNS_CACHE_ENTRY Entry)
+{
+    while (Entry) {
+        PDNS_CACHE_ENTRY Next = Entry->Next;
+        FREE(Entry);
+        Entry = Next;
+    }
+}
+
+
+static ULONG ParseRecords(_In_reads_bytes_(Length) const BYTE * Message,
+                          _In_ ULONG Length,
+                          _Out_ PDNS_WIRE_MESSAGE Header,
+                          _Inout_updates_(Capacity) PDNS_WIRE_RECORD Stack,
+                          _In_ ULONG Capacity,
+                          _Out_ PDNS_WIRE_RECORD * Records)
+/*
+功能：解析完整的报文，记录多的申请内存（*Records不等于Stack的要FREE）。
+*/
+{
+    *Records = Stack;
+
+    ULONG ret = DnsWireParse(Message, Length, Header, Stack, Capacity);
+    if (ERROR_INSUFFICIENT_BUFFER == ret) {
+        ULONG Count = Header->Records;
+
+        *Records = reinterpret_cast<PDNS_WIRE_RECORD>(MALLOC(Count * sizeof(DNS_WIRE_RECORD)));
+        if (nullptr == *Records) {
+            *Records = Stack;
+            return ERROR_NOT_ENOUGH_MEMORY;
+        }
+
+        ret = DnsWireParse(Message, Length, Header, *Records, Count);
+    }
+
+    return ret;
+}
+
+
+static void AdjustTtl(_Inout_updates_bytes_(Length) PBYTE Message, _In_ ULONG Length, _In_ ULONG Elapsed)
+/*
+功能：报文里的所有的记录（OPT除外）的TTL减去经过的秒数（不小于0）。
+*/
+{
+    DNS_WIRE_MESSAGE Header;
+    DNS_WIRE_RECORD Stack[64];
+    PDNS_WIRE_RECORD Records;
+
+    if (0 == Elapsed) {
+        return;
+    }
+
+    if (ERROR_SUCCESS == ParseRecords(Message, Length, &Header, Stack, _ARRAYSIZE(Stack), &Records)) {
+        for (ULONG i = Header.Count[DNS_SECTION_QUESTION]; i < Header.Records; i++) {
+            if (DNS_TYPE_OPT != Records[i].Type) {
+                PBYTE p = Message + Records[i].Data - 6; // TTL在RDLENGTH的前面。
+                ULONG Ttl = Records[i].Ttl > Elapsed ? Records[i].Ttl - Elapsed : 0;
+
+                p[0] = (BYTE)(Ttl >> 24);
+                p[1] = (BYTE)(Ttl >> 16);
+                p[2] = (BYTE)(Ttl >> 8);
+                p[3] = (BYTE)Ttl;
+            }
+        }
+    }
+
+    if (Records != Stack) {
+        FREE(Records);
+    }
+}
+
+
+static ULONG CacheInsert(_In_ PDNS_CACHE Cache,
+                         _In_z_ PCSTR Name,
+                         _In_ USHORT Type,
+                         _In_ USHORT Class,
+                         _In_ ULONG Status,
+                         _In_reads_bytes_opt_(Length) const void * Data,
+                         _In_ ULONG Length,
+                         _In_ ULONG Ttl,
+                         _In_ BOOLEAN Message,
+                         _In_ ULONGLONG Now)
+{
+    CHAR Key[DNS_WIRE_MAX_NAME_TEXT];
+    USHORT KeyLength;
+    PDNS_CACHE_ENTRY Entry = nullptr;
+
+    if ((ERROR_SUCCESS != Status && DNS_ERROR_RCODE_NAME_ERROR != Status && DNS_INFO_NO_RECORDS != Status) ||
+        (nullptr == Data && Length)) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    ULONG ret = NormalizeName(Name, Key, &KeyLength);
+    if (ERROR_SUCCESS != ret) {
+        return ret;
+    }
+
+    Ttl = min(Ttl, (ULONG)(ERROR_SUCCESS == Status ? DNS_CACHE_MAX_TTL : DNS_CACHE_MAX_NEGATIVE));
+
+    ULONG Hash = KeyHash(Cache, Key, KeyLength, Type, Class);
+    PDNS_CACHE_SHARD Shard = &Cache->Shards[Hash & Cache->ShardMask];
+    SIZE_T Size = FIELD_OFFSET(DNS_CACHE_ENTRY, Name) + KeyLength + 1 + (SIZE_T)Length;
+
+    if (Size > Cache->ShardBytes) {
+        return ERROR_NOT_ENOUGH_QUOTA;
+    }
+
+    if (Ttl) { // TTL是0的不缓存（RFC 1035），只删除旧的。
+        Entry = reinterpret_cast<PDNS_CACHE_ENTRY>(MALLOC(Size));
+        if (nullptr == Entry) {
+            return ERROR_NOT_ENOUGH_MEMORY;
+        }
+
+        Entry->Inserted = Now;
+        Entry->Expires = Now + Ttl * 1000ULL;
+        Entry->Size = Size;
+        Entry->Hash = Hash;
+        Entry->Status = Status;
+        Entry->DataLength = Length;
+        Entry->Type = Type;
+        Entry->Class = Class;
+        Entry->NameLength = KeyLength;
+        Entry->Message = Message;
+        RtlCopyMemory(Entry->Name, Key, KeyLength + 1);
+        if (Length) {
+            RtlCopyMemory(Entry->Name + KeyLength + 1, Data, Length);
+        }
+    }
+
+    AcquireSRWLockExclusive(&Shard->Lock);
+
+    PDNS_CACHE_ENTRY Victims = nullptr;
+    PDNS_CACHE_ENTRY Old = ShardFind(Cache, Shard, Hash, Key, KeyLength, Type, Class);
+    if (Old) {
+        ShardUnlink(Cache, Shard, Old);
+        Old->Next = nullptr;
+        Victims = Old;
+    }
+
+    if (Entry) {
+        PDNS_CACHE_ENTRY Evicted = ShardEvict(Cache, Shard, Size, Now);
+        while (Evicted) {
+            PDNS_CACHE_ENTRY Next = Evicted->Next;
+            Evicted->Next = Victims;
+            Victims = Evicted;
+            Evicted = Next;
+        }
+
+        PDNS_CACHE_ENTRY * Bucket = &Shard->Buckets[(Hash >> 8) & Cache->BucketMask];
+        Entry->Next = *Bucket;
+        *Bucket = Entry;
+
+        if (Shard->Hand) { //放在指针的后面，要转一圈才会被检查。
+            Entry->ClockNext = Shard->Hand;
+            Entry->ClockPrev = Shard->Hand->ClockPrev;
+            Entry->ClockPrev->ClockNext = Entry;
+            Shard->Hand->ClockPrev = Entry;
+        } else {
+            Entry->ClockNext = Entry;
+            Entry->ClockPrev = Entry;
+            Shard->Hand = Entry;
+        }
+
+        Shard->Bytes += Size;
+        Shard->Entries++;
+        Shard->Inserts++;
+    }
+
+    ReleaseSRWLockExclusive(&Shard->Lock);
+
+    FreeEntries(Victims);
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG CacheLookup(_In_ PDNS_CACHE Cache,
+                         _In_z_ PCSTR Name,
+                         _In_ USHORT Type,
+                         _In_ USHORT Class,
+                         _Out_writes_bytes_opt_(*Length) PVOID Data,
+                         _Inout_opt_ PULONG Length,
+                         _Out_opt_ PULONG Ttl,
+                         _In_ ULONGLONG Now)
+{
+    CHAR Key[DNS_WIRE_MAX_NAME_TEXT];
+    USHORT KeyLength;
+
+    if (Ttl) {
+        *Ttl = 0;
+    }
+
+    ULONG ret = NormalizeName(Name, Key, &KeyLength);
+    if (ERROR_SUCCESS != ret) {
+        return ret;
+    }
+
+    ULONG Hash = KeyHash(Cache, Key, KeyLength, Type, Class);
+    PDNS_CACHE_SHARD Shard = &Cache->Shards[Hash & Cache->ShardMask];
+    ULONG Elapsed = 0;
+    BOOLEAN Message = FALSE;
+
+    AcquireSRWLockShared(&Shard->Lock);
+
+    PDNS_CACHE_ENTRY Entry = ShardFind(Cache, Shard, Hash, Key, KeyLength, Type, Class);
+    if (nullptr == Entry || Entry->Expires <= Now) { //过期的留给插入时的淘汰。
+        if (Entry) {
+            InterlockedIncrement64(&Shard->Expired);
+        }
+
+        InterlockedIncrement64(&Shard->Misses);
+        ret = ERROR_NOT_FOUND;
+    } else {
+        if (0 == Entry->Referenced) { //已经设置了的不再写，减少缓存行的争用。
+            InterlockedExchange(&Entry->Referenced, 1);
+        }
+
+        InterlockedIncrement64(ERROR_SUCCESS == Entry->Status ? &Shard->Hits : &Shard->NegativeHits);
+
+        ret = Entry->Status;
+        Message = Entry->Message;
+        Elapsed = (ULONG)((Now - Entry->Inserted) / 1000);
+        if (Ttl) {
+            *Ttl = (ULONG)((Entry->Expires - Now + 999) / 1000);
+        }
+
+        if (Length) {
+            if (*Length < Entry->DataLength || (nullptr == Data && Entry->DataLength)) {
+                ret = ERROR_MORE_DATA;
+                Message = FALSE;
+            } else if (Entry->DataLength) {
+                RtlCopyMemory(Data, Entry->Name + Entry->NameLength + 1, Entry->DataLength);
+            }
+
+            *Length = Entry->DataLength;
+        } else {
+            Message = FALSE;
+        }
+    }
+
+    ReleaseSRWLockShared(&Shard->Lock);
+
+    if (Message) {
+        AdjustTtl(reinterpret_cast<PBYTE>(Data), *Length, Elapsed);
+    }
+
+    return ret;
+}
+
+
+static ULONG ResponseTtl(_In_ const BYTE * Message,
+                         _In_ const DNS_WIRE_MESSAGE * Header,
+                         _In_reads_(Header->Records) const DNS_WIRE_RECORD * Records,
+                         _Out_ PULONG Status,
+                         _Out_ PULONG Ttl)
+/*
+功能：应答的缓存的状态和TTL。
+
+正的：回答的节里的最小的TTL。
+否定的（NXDOMAIN，或者没有回答的NOERROR）：授权的节里的SOA的TTL和MINIMUM中小的那个（RFC 2308第5节）。
+其余的（SERVFAIL等，没有SOA的否定的）：不缓存。
+*/
+{
+    ULONG Rcode = Header->Flags & 0xF;
+    ULONG Answers = Header->Count[DNS_SECTION_ANSWER];
+    ULONG First = Header->Count[DNS_SECTION_QUESTION];
+
+    if (0 == Rcode && Answers) {
+        *Status = ERROR_SUCCESS;
+        *Ttl = MAXULONG;
+        for (ULONG i = First; i < First + Answers; i++) {
+            *Ttl = min(*Ttl, Records[i].Ttl);
+        }
+
+        return ERROR_SUCCESS;
+    }
+
+    if (DNS_RCODE_NXDOMAIN != Rcode && 0 != Rcode) {
+        return ERROR_NOT_SUPPORTED;
+    }
+
+    *Status = (DNS_RCODE_NXDOMAIN == Rcode) ? DNS_ERROR_RCODE_NAME_ERROR : DNS_INFO_NO_RECORDS;
+
+    for (ULONG i = First + Answers; i < First + Answers + Header->Count[DNS_SECTION_AUTHORITY]; i++) {
+        const DNS_WIRE_RECORD * Record = &Records[i];
+
+        if (DNS_TYPE_SOA == Record->Type && Record->DataLength >= 22) { //两个名字（至少各1字节）和5个32位的数。
+            const BYTE * p = Message + Record->Data + Record->DataLength - 4;
+            ULONG Minimum = ((ULONG)p[0] << 24) | ((ULONG)p[1] << 16) | ((ULONG)p[2] << 8) | p[3];
+
+            *Ttl = min(Record->Ttl, Minimum);
+            return ERROR_SUCCESS;
+        }
+    }
+
+    return ERROR_NOT_SUPPORTED;
+}
+
+
+static ULONG CacheInsertResponse(_In_ PDNS_CACHE Cache,
+                                 _In_reads_bytes_(Length) const BYTE * Message,
+                                 _In_ ULONG Length,
+                                 _In_ ULONGLONG Now)
+{
+    DNS_WIRE_MESSAGE Header;
+    DNS_WIRE_RECORD Stack[64];
+    PDNS_WIRE_RECORD Records;
+    CHAR Name[DNS_WIRE_MAX_NAME_TEXT];
+    ULONG Status = ERROR_SUCCESS;
+    ULONG Ttl = 0;
+
+    ULONG ret = ParseRecords(Message, Length, &Header, Stack, _ARRAYSIZE(Stack), &Records);
+    if (ERROR_SUCCESS != ret) {
+        goto Cleanup;
+    }
+
+    if (0 == (Header.Flags & DNS_FLAG_QR) || (Header.Flags & DNS_FLAG_TC) ||
+        1 != Header.Count[DNS_SECTION_QUESTION]) {
+        ret = ERROR_NOT_SUPPORTED; //不是应答，截断的，或者没有（多个）问题。
+        goto Cleanup;
+    }
+
+    ret = DnsWireReadName(Message, Length, Records[0].Name, Name, sizeof(Name), nullptr);
+    if (ERROR_SUCCESS != ret) {
+        goto Cleanup;
+    }
+
+    ret = ResponseTtl(Message, &Header, Records, &Status, &Ttl);
+    if (ERROR_SUCCESS != ret) {
+        goto Cleanup;
+    }
+
+    ret = CacheInsert(Cache, Name, Records[0].Type, Records[0].Class, Status, Message, Length, Ttl, TRUE, Now);
+
+Cleanup:
+    if (Records != Stack) {
+        FREE(Records);
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DnsCacheCreate(_In_ SIZE_T MaxBytes, _In_ ULONG Shards, _Out_ PDNS_CACHE * Cache)
+/*
+功能：创建DNS缓存。
+
+参数：
+MaxBytes：条目占用的内存的上限（平分给每个片），0是DNS_CACHE_DEFAULT_BYTES。
+Shards：片的个数，向上取为2的幂，0是16。多线程的可以用CPU个数的几倍。
+
+注意：用完要调用DnsCacheDestroy。
+*/
+{
+    *Cache = nullptr;
+
+    if (0 == MaxBytes) {
+        MaxBytes = DNS_CACHE_DEFAULT_BYTES;
+    }
+
+    if (0 == Shards) {
+        Shards = 16;
+    }
+
+    if (Shards > DNS_CACHE_MAX_SHARDS || MaxBytes < DNS_CACHE_MIN_BYTES) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    ULONG ShardCount = 1;
+    while (ShardCount < Shards) {
+        ShardCount *= 2;
+    }
+
+    SIZE_T ShardBytes = MaxBytes / ShardCount;
+    ULONG BucketCount = 16;
+    while (BucketCount < ShardBytes / DNS_CACHE_BUCKET_BYTES && BucketCount < 0x1000000) {
+        BucketCount *= 2;
+    }
+
+    ULONG ret = ERROR_SUCCESS;
+    PDNS_CACHE Temp = reinterpret_cast<PDNS_CACHE>(MALLOC(sizeof(struct _DNS_CACHE)));
+    if (nullptr == Temp) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    Temp->ShardMask = ShardCount - 1;
+    Temp->BucketMask = BucketCount - 1;
+    Temp->MaxBytes = MaxBytes;
+    Temp->ShardBytes = ShardBytes;
+
+    Temp->Shards = reinterpret_cast<PDNS_CACHE_SHARD>(MALLOC(ShardCount * sizeof(DNS_CACHE_SHARD)));
+    if (nullptr == Temp->Shards) {
+        ret = ERROR_NOT_ENOUGH_MEMORY;
+        goto Cleanup;
+    }
+
+    for (ULONG i = 0; i < ShardCount; i++) {
+        PDNS_CACHE_SHARD Shard = &Temp->Shards[i];
+
+        InitializeSRWLock(&Shard->Lock);
+        Shard->Buckets = reinterpret_cast<PDNS_CACHE_ENTRY *>(MALLOC(BucketCount * sizeof(PDNS_CACHE_ENTRY)));
+        if (nullptr == Shard->Buckets) {
+            ret = ERROR_NOT_ENOUGH_MEMORY;
+            goto Cleanup;
+        }
+    }
+
+    if (!BCRYPT_SUCCESS(BCryptGenRandom(nullptr,
+                                        reinterpret_cast<PUCHAR>(&Temp->Seed),
+                                        sizeof(Temp->Seed),
+                                        BCRYPT_USE_SYSTEM_PREFERRED_RNG))) {
+        ret = ERROR_GEN_FAILURE;
+        goto Cleanup;
+    }
+
+    *Cache = Temp;
+    Temp = nullptr;
+
+Cleanup:
+    DnsCacheDestroy(Temp);
+
+    return ret;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI DnsCacheDestroy(_In_opt_ PDNS_CACHE Cache)
+/*
+功能：销毁DNS缓存。不能再有别的线程在用。
+*/
+{
+    if (nullptr == Cache) {
+        return;
+    }
+
+    if (Cache->Shards) {
+        DnsCacheFlush(Cache);
+
+        for (ULONG i = 0; i <= Cache->ShardMask; i++) {
+            if (Cache->Shards[i].Buckets) {
+                FREE(Cache->Shards[i].Buckets);
+            }
+        }
+
+        FREE(Cache->Shards);
+    }
+
+    FREE(Cache);
+}
+
+
+EXTERN_C
+DLLEXPORT
+PDNS_CACHE WINAPI DnsCacheDefault()
+/*
+功能：进程共享的缓存（默认的大小），第一次调用时创建，失败的返回nullptr。
+
+反向解析（DnsCacheGetNameInfo）用这个，tracert，pathping，ping等共享。
+*/
+{
+    PDNS_CACHE Cache = reinterpret_cast<PDNS_CACHE>(ReadPointerAcquire(reinterpret_cast<PVOID *>(&g_DnsCache)));
+    if (Cache) {
+        return Cache;
+    }
+
+    if (ERROR_SUCCESS != DnsCacheCreate(0, 0, &Cache)) {
+        return nullptr;
+    }
+
+    PVOID Old = InterlockedCompareExchangePointer(reinterpret_cast<PVOID *>(&g_DnsCache), Cache, nullptr);
+    if (Old) { //别的线程先创建了。
+        DnsCacheDestroy(Cache);
+        Cache = reinterpret_cast<PDNS_CACHE>(Old);
+    }
+
+    return Cache;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DnsCacheInsert(_In_ PDNS_CACHE Cache,
+                            _In_z_ PCSTR Name,
+                            _In_ USHORT Type,
+                            _In_ USHORT Class,
+                            _In_ ULONG Status,
+                            _In_reads_bytes_opt_(Length) const void * Data,
+                            _In_ ULONG Length,
+                            _In_ ULONG Ttl)
+/*
+功能：加入（或者替换）一个条目。
+
+参数：
+Status：ERROR_SUCCESS，或者否定的DNS_ERROR_RCODE_NAME_ERROR（NXDOMAIN），DNS_INFO_NO_RECORDS（NODATA）。
+Data：任意的数据（如：文本的名字，地址），复制保存。否定的可以没有。
+Ttl：秒，会被限制在DNS_CACHE_MAX_TTL（否定的DNS_CACHE_MAX_NEGATIVE）以内。0的不缓存（删除已有的）。
+
+返回值：
+ERROR_SUCCESS。
+ERROR_INVALID_PARAMETER：Status不对，名字太长。
+ERROR_NOT_ENOUGH_QUOTA：条目比一个片的内存上限还大。
+ERROR_NOT_ENOUGH_MEMORY。
+*/
+{
+    return CacheInsert(Cache, Name, Type, Class, Status, Data, Length, Ttl, FALSE, GetTickCount64());
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DnsCacheInsertResponse(_In_ PDNS_CACHE Cache,
+                                    _In_reads_bytes_(Length) const BYTE * Message,
+                                    _In_ ULONG Length)
+/*
+功能：按问题（名字，类型，类别）缓存一个完整的应答（线上格式）。TTL的规则见ResponseTtl。
+
+返回值：
+ERROR_SUCCESS。
+ERROR_NOT_SUPPORTED：不可缓存的应答（截断的，SERVFAIL，没有SOA的否定的等）。
+ERROR_INVALID_DATA：畸形的报文。
+其他：见DnsCacheInsert。
+*/
+{
+    return CacheInsertResponse(Cache, Message, Length, GetTickCount64());
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DnsCacheLookup(_In_ PDNS_CACHE Cache,
+                            _In_z_ PCSTR Name,
+                            _In_ USHORT Type,
+                            _In_ USHORT Class,
+                            _Out_writes_bytes_opt_(*Length) PVOID Data,
+                            _Inout_opt_ PULONG Length,
+                            _Out_opt_ PULONG Ttl)
+/*
+功能：查找（没有过期的）条目。
+
+参数：
+Length：输入是Data的大小，输出是数据的长度。nullptr的只要状态。
+Ttl：剩下的秒数。
+
+返回值：
+ERROR_SUCCESS：正的命中。
+DNS_ERROR_RCODE_NAME_ERROR，DNS_INFO_NO_RECORDS：否定的命中（名字不存在，没有这个类型的记录）。
+ERROR_MORE_DATA：命中了，但是Data放不下，需要的大小在*Length里。
+ERROR_NOT_FOUND：没有，或者过期了。
+
+注意：DnsCacheInsertResponse保存的报文，取出时里面的TTL已经减去了保存后经过的时间。
+*/
+{
+    return CacheLookup(Cache, Name, Type, Class, Data, Length, Ttl, GetTickCount64());
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI DnsCacheFlush(_In_ PDNS_CACHE Cache)
+/*
+功能：清空所有的条目（计数不变）。
+*/
+{
+    for (ULONG i = 0; i <= Cache->ShardMask; i++) {
+        PDNS_CACHE_SHARD Shard = &Cache->Shards[i];
+        PDNS_CACHE_ENTRY Victims = nullptr;
+
+        if (nullptr == Shard->Buckets) {
+            continue;
+        }
+
+        AcquireSRWLockExclusive(&Shard->Lock);
+        while (Shard->Hand) {
+            PDNS_CACHE_ENTRY Entry = Shard->Hand;
+
+            ShardUnlink(Cache, Shard, Entry);
+            Entry->Next = Victims;
+            Victims = Entry;
+        }
+        ReleaseSRWLockExclusive(&Shard->Lock);
+
+        FreeEntries(Victims);
+    }
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI DnsCacheQuery(_In_ PDNS_CACHE Cache, _Out_ PDNS_CACHE_INFORMATION Information)
+/*
+功能：获取命中，没有命中等的计数（各个片的和）。
+*/
+{
+    RtlZeroMemory(Information, sizeof(DNS_CACHE_INFORMATION));
+    Information->Shards = Cache->ShardMask + 1;
+    Information->MaxBytes = Cache->MaxBytes;
+
+    for (ULONG i = 0; i <= Cache->ShardMask; i++) {
+        PDNS_CACHE_SHARD Shard = &Cache->Shards[i];
+
+        AcquireSRWLockShared(&Shard->Lock);
+        Information->Hits += Shard->Hits;
+        Information->NegativeHits += Shard->NegativeHits;
+        Information->Misses += Shard->Misses;
+        Information->Expired += Shard->Expired;
+        Information->Inserts += Shard->Inserts;
+        Information->Evictions += Shard->Evictions;
+        Information->Entries += Shard->Entries;
+        Information->Bytes += Shard->Bytes;
+        ReleaseSRWLockShared(&Shard->Lock);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//反向解析。
+
+
+static BOOLEAN ReverseName(_In_reads_bytes_(AddressLength) const SOCKADDR * Address,
+                           _In_ int AddressLength,
+                           _Out_writes_(DNS_REVERSE_NAME_SIZE) PSTR Name)
+/*
+功能：地址对应的PTR的名字，如：4.3.2.1.in-addr.arpa，b.a.9.8...ip6.arpa。
+*/
+{
+    SOCKADDR_INET Inet;
+
+    RtlZeroMemory(&Inet, sizeof(Inet));
+    if (AF_INET == Address->sa_family && AddressLength >= (int)sizeof(SOCKADDR_IN)) {
+        RtlCopyMemory(&Inet.Ipv4, Address, sizeof(SOCKADDR_IN));
+    } else if (AF_INET6 == Address->sa_family && AddressLength >= (int)sizeof(SOCKADDR_IN6)) {
+        RtlCopyMemory(&Inet.Ipv6, Address, sizeof(SOCKADDR_IN6));
+    }
+
+    return 0 != DnsReverseName(&Inet, Name, DNS_REVERSE_NAME_SIZE);
+}
+
+
+EXTERN_C
+DLLEXPORT
+int WINAPI DnsCacheGetNameInfo(_In_reads_bytes_(AddressLength) const SOCKADDR * Address,
+                               _In_ int AddressLength,
+                               _Out_writes_(HostLength) PCHAR Host,
+                               _In_ DWORD HostLength,
+                               _In_ int Flags)
+/*
+功能：带缓存的getnameinfo（只取主机名），结果存在DnsCacheDefault里。
+
+找到的名字缓存DNS_CACHE_NAMEINFO_TTL秒，找不到的（EAI_NONAME）缓存DNS_CACHE_NAMEINFO_NEGATIVE_TTL秒，
+其余的错误（如：EAI_AGAIN）不缓存。getnameinfo不返回TTL，所以用固定的值。
+
+参数和返回值同getnameinfo：
+NI_NUMERICHOST：直接调用getnameinfo，不用缓存。
+NI_NAMEREQD：找不到名字的返回EAI_NONAME，否则返回数字的地址。
+NI_NOFQDN：和完整的名字分开缓存（类别是DNS_CACHE_CLASS_NOFQDN）。
+*/
+{
+    CHAR Ptr[DNS_REVERSE_NAME_SIZE];
+    CHAR Name[NI_MAXHOST];
+    USHORT Class = (Flags & NI_NOFQDN) ? DNS_CACHE_CLASS_NOFQDN : DNS_CACHE_CLASS_NAMEINFO;
+    PDNS_CACHE Cache = DnsCacheDefault();
+
+    if ((Flags & NI_NUMERICHOST) || nullptr == Cache || !ReverseName(Address, AddressLength, Ptr)) {
+        return getnameinfo(Address, AddressLength, Host, HostLength, nullptr, 0, Flags);
+    }
+
+    ULONG Length = HostLength;
+    ULONG ret = DnsCacheLookup(Cache, Ptr, DNS_TYPE_PTR, Class, Host, &Length, nullptr);
+    if (ERROR_NOT_FOUND == ret) {
+        int rc = getnameinfo(Address, AddressLength, Name, sizeof(Name), nullptr, 0, Flags | NI_NAMEREQD);
+        if (0 == rc) {
+            DnsCacheInsert(Cache, Ptr, DNS_TYPE_PTR, Class, ERROR_SUCCESS, Name, (ULONG)strlen(Name) + 1,
+                           DNS_CACHE_NAMEINFO_TTL);
+            ret = SUCCEEDED(StringCchCopyA(Host, HostLength, Name)) ? ERROR_SUCCESS : ERROR_MORE_DATA;
+        } else if (EAI_NONAME == rc) {
+            DnsCacheInsert(Cache, Ptr, DNS_TYPE_PTR, Class, DNS_ERROR_RCODE_NAME_ERROR, nullptr, 0,
+                           DNS_CACHE_NAMEINFO_NEGATIVE_TTL);
+            ret = DNS_ERROR_RCODE_NAME_ERROR;
+        } else {
+            return rc;
+        }
+    }
+
+    switch (ret) {
+    case ERROR_SUCCESS:
+        return 0;
+    case ERROR_MORE_DATA:
+        return WSAEFAULT; //同getnameinfo的缓冲区太小。
+    default: //找不到名字。
+        if (Flags & NI_NAMEREQD) {
+            return EAI_NONAME;
+        }
+
+        return getnameinfo(Address, AddressLength, Host, HostLength, nullptr, 0, Flags | NI_NUMERICHOST);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
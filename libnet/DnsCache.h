@@ -0,0 +1,94 @@
+﻿#pragma once
+
+#include "pch.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+typedef struct _DNS_CACHE DNS_CACHE, * PDNS_CACHE; // DNS的缓存，见DnsCacheCreate。线程安全。
+
+
+#define DNS_CACHE_DEFAULT_BYTES  (16 * 1024 * 1024)
+#define DNS_CACHE_MAX_TTL        86400 //正的应答的TTL的上限（秒）。
+#define DNS_CACHE_MAX_NEGATIVE   10800 //否定的应答的TTL的上限（RFC 2308建议的最大值，3小时）。
+
+//DnsCacheGetNameInfo用的类别（RFC 6895的私用的范围），和DnsCacheInsertResponse的（IN）分开，
+// NI_NOFQDN的结果和完整的也分开。
+#define DNS_CACHE_CLASS_NAMEINFO 0xFF00
+#define DNS_CACHE_CLASS_NOFQDN   0xFF01
+#define DNS_CACHE_NAMEINFO_TTL   300 // getnameinfo不返回TTL，反向解析的结果缓存这么多秒。
+#define DNS_CACHE_NAMEINFO_NEGATIVE_TTL 60
+
+
+typedef struct _DNS_CACHE_INFORMATION {
+    UINT64 Hits;          //正的命中。
+    UINT64 NegativeHits;  //否定的命中（NXDOMAIN，NODATA）。
+    UINT64 Misses;        //没有的，包括过期的。
+    UINT64 Expired;       //因为过期而没有命中的。
+    UINT64 Inserts;
+    UINT64 Evictions;     //为了腾出空间而淘汰的（不包括过期的和替换的）。
+    ULONG Entries;
+    ULONG Shards;
+    SIZE_T Bytes;         //条目占用的内存。
+    SIZE_T MaxBytes;
+} DNS_CACHE_INFORMATION, * PDNS_CACHE_INFORMATION;
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C_START
+
+
+DLLEXPORT
+ULONG WINAPI DnsCacheCreate(_In_ SIZE_T MaxBytes, _In_ ULONG Shards, _Out_ PDNS_CACHE * Cache);
+
+DLLEXPORT
+void WINAPI DnsCacheDestroy(_In_opt_ PDNS_CACHE Cache);
+
+DLLEXPORT
+PDNS_CACHE WINAPI DnsCacheDefault();
+
+DLLEXPORT
+ULONG WINAPI DnsCacheInsert(_In_ PDNS_CACHE Cache,
+                            _In_z_ PCSTR Name,
+                            _In_ USHORT Type,
+                            _In_ USHORT Class,
+                            _In_ ULONG Status,
+                            _In_reads_bytes_opt_(Length) const void * Data,
+                            _In_ ULONG Length,
+                            _In_ ULONG Ttl);
+
+DLLEXPORT
+ULONG WINAPI DnsCacheInsertResponse(_In_ PDNS_CACHE Cache,
+                                    _In_reads_bytes_(Length) const BYTE * Message,
+                                    _In_ ULONG Length);
+
+DLLEXPORT
+ULONG WINAPI DnsCacheLookup(_In_ PDNS_CACHE Cache,
+                            _In_z_ PCSTR Name,
+                            _In_ USHORT Type,
+                            _In_ USHORT Class,
+                            _Out_writes_bytes_opt_(*Length) PVOID Data,
+                            _Inout_opt_ PULONG Length,
+                            _Out_opt_ PULONG Ttl);
+
+DLLEXPORT
+void WINAPI DnsCacheFlush(_In_ PDNS_CACHE Cache);
+
+DLLEXPORT
+void WINAPI DnsCacheQuery(_In_ PDNS_CACHE Cache, _Out_ PDNS_CACHE_INFORMATION Information);
+
+DLLEXPORT
+int WINAPI DnsCacheGetNameInfo(_In_reads_bytes_(AddressLength) const SOCKADDR * Address,
+                               _In_ int AddressLength,
+                               _Out_writes_(HostLength) PCHAR Host,
+                               _In_ DWORD HostLength,
+                               _In_ int Flags);
+
+
+EXTERN_C_END
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
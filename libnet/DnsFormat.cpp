@@ -0,0 +1,1372 @@
+﻿#include "pch.h"
+#include "DnsFormat.h"
+#include "DnsWire.h"
+#include "IpAddr.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/*
+把DNS_RECORD（DnsQuery的结果）格式化到调用者的缓冲区里，代替逐个字段的printf。
+
+1.格式：缩进的文本（原来的PrintDnsRecordList的样子），区域文件，JSON和报文里的资源记录（二进制）。
+2.不申请内存：数字用std::to_chars，地址用FormatIPv4Batch/FormatIPv6Batch，都写到栈上的小缓冲区再复制。
+3.缓冲区不够时只计数不写，所以一次就能得到需要的长度（DnsFormatRecord返回ERROR_INSUFFICIENT_BUFFER）。
+4.DNS_FORMAT_WRITER：缓冲区满了就交给回调（写文件，发送等）；比整个缓冲区还大的记录分段重新格式化，
+  每次只写其中的一段，所以缓冲区的大小只影响效率，不影响能否写出。
+5.名字和字符串是UTF-16（DnsQuery_W）的就转换为UTF-8；区域文件里不可打印的字节写成\DDD，JSON按RFC 8259转义。
+
+文本的格式摘自：Windows-classic-samples\Samples\DNSAsyncQuery\cpp\PrintDnsRecord.cpp
+
+参考：
+https://www.rfc-editor.org/rfc/rfc1035#section-5.1
+https://www.rfc-editor.org/rfc/rfc3597#section-5 （未知的类型的\#）
+https://www.rfc-editor.org/rfc/rfc4034 （DNSKEY，RRSIG，NSEC，DS）
+https://www.rfc-editor.org/rfc/rfc5155#section-3.3 （NSEC3）
+*/
+
+
+#define ESCAPE_NONE        0 //原样（UTF-8）。
+#define ESCAPE_JSON        1
+#define ESCAPE_ZONE_NAME   2 //区域文件里的名字：除了不可打印的，空格和();"\@$也要转义。
+#define ESCAPE_ZONE_STRING 3 //区域文件里引号内的字符串。
+
+#define BYTES_HEX       0 // DS的摘要，NSEC3的盐。
+#define BYTES_BASE64    1 //密钥和签名。
+#define BYTES_BASE32HEX 2 // NSEC3的下一个哈希。
+
+
+//格式化的输出：超出Capacity的只计数不写，Length总是需要的长度。
+//Skip之前的也只计数，用于分段地写出比缓冲区还大的记录。
+typedef struct _FORMAT_OUTPUT {
+    PCHAR Buffer;
+    ULONG Capacity;
+    ULONG Skip;
+    ULONG Length;
+    ULONG Format;
+    ULONG Fields; //已经写的数据字段的个数，区域文件的分隔符用。
+    ULONG Status;
+} FORMAT_OUTPUT, * PFORMAT_OUTPUT;
+
+
+static const char HexDigits[] = "0123456789ABCDEF";
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//输出的基本操作。
+
+
+static void OutputInit(_Out_ PFORMAT_OUTPUT Out,
+                       _In_ ULONG Format,
+                       _Out_writes_bytes_opt_(Capacity) PCHAR Buffer,
+                       _In_ ULONG Capacity,
+                       _In_ ULONG Skip)
+{
+    Out->Buffer = Buffer;
+    Out->Capacity = Capacity;
+    Out->Skip = Skip;
+    Out->Length = 0;
+    Out->Format = Format;
+    Out->Fields = 0;
+    Out->Status = ERROR_SUCCESS;
+}
+
+
+static FORCEINLINE void PutChar(_Inout_ PFORMAT_OUTPUT Out, _In_ char c)
+{
+    const ULONG Position = Out->Length - Out->Skip; // Length < Skip时回绕为很大的数，不写。
+
+    if (Position < Out->Capacity) {
+        Out->Buffer[Position] = c;
+    }
+
+    Out->Length++;
+}
+
+
+static void PutBytes(_Inout_ PFORMAT_OUTPUT Out, _In_reads_bytes_(Size) const void * Data, _In_ ULONG Size)
+{
+    if (Out->Length >= Out->Skip && Out->Length - Out->Skip + Size <= Out->Capacity) {
+        RtlCopyMemory(Out->Buffer + (Out->Length - Out->Skip), Data, Size);
+        Out->Length += Size;
+    } else {
+        for (ULONG i = 0; i < Size; i++) {
+            PutChar(Out, ((const char *)Data)[i]);
+        }
+    }
+}
+
+
+static void PutString(_Inout_ PFORMAT_OUTPUT Out, _In_z_ PCSTR String)
+{
+    PutBytes(Out, String, (ULONG)strlen(String));
+}
+
+
+template<typename T>
+static void PutNumber(_Inout_ PFORMAT_OUTPUT Out, _In_ T Value)
+{
+    char Text[24];
+    const std::to_chars_result Result = std::to_chars(Text, Text + sizeof(Text), Value);
+
+    PutBytes(Out, Text, (ULONG)(Result.ptr - Text));
+}
+
+
+static void PutHex(_Inout_ PFORMAT_OUTPUT Out, _In_ UINT64 Value, _In_ ULONG Digits, _In_ BOOLEAN Upper)
+/*
+功能：固定位数的十六进制（前面补0），相当于%0*x或者%0*X。
+*/
+{
+    char Text[16];
+    const std::to_chars_result Result = std::to_chars(Text, Text + sizeof(Text), Value, 16);
+    ULONG Length = (ULONG)(Result.ptr - Text);
+
+    for (; Digits > Length; Digits--) {
+        PutChar(Out, '0');
+    }
+
+    if (Upper) {
+        for (ULONG i = 0; i < Length; i++) {
+            Text[i] = (char)toupper((BYTE)Text[i]);
+        }
+    }
+
+    PutBytes(Out, Text, Length);
+}
+
+
+static void PutUshort(_Inout_ PFORMAT_OUTPUT Out, _In_ USHORT Value) //网络序，下同。
+{
+    PutChar(Out, (char)(Value >> 8));
+    PutChar(Out, (char)Value);
+}
+
+
+static void PutUlong(_Inout_ PFORMAT_OUTPUT Out, _In_ ULONG Value)
+{
+    PutUshort(Out, (USHORT)(Value >> 16));
+    PutUshort(Out, (USHORT)Value);
+}
+
+
+static void PatchByte(_Inout_ PFORMAT_OUTPUT Out, _In_ ULONG Position, _In_ BYTE Value)
+/*
+功能：回填前面写的长度（在当前的窗口里的话）。
+*/
+{
+    if (Position >= Out->Skip && Position - Out->Skip < Out->Capacity) {
+        Out->Buffer[Position - Out->Skip] = (char)Value;
+    }
+}
+
+
+//转义后的文本先写到栈上的一小块，满了再复制到输出，避免逐个字节地检查边界。
+typedef struct _TEXT_CHUNK {
+    PFORMAT_OUTPUT Out;
+    ULONG Escape;
+    ULONG Length;
+    char Data[256];
+} TEXT_CHUNK, * PTEXT_CHUNK;
+
+
+static FORCEINLINE void ChunkByte(_Inout_ PTEXT_CHUNK Chunk, _In_ BYTE c)
+{
+    PCHAR p = Chunk->Data + Chunk->Length;
+
+    if (Chunk->Length > sizeof(Chunk->Data) - 8) { //一个字节转义后最多6个字节（\u00XX）。
+        PutBytes(Chunk->Out, Chunk->Data, Chunk->Length);
+        p = Chunk->Data;
+    }
+
+    switch (Chunk->Escape) {
+    case ESCAPE_JSON:
+        if (c == '"' || c == '\\') {
+            *p++ = '\\';
+            *p++ = (char)c;
+        } else if (c < 0x20) {
+            *p++ = '\\';
+            *p++ = 'u';
+            *p++ = '0';
+            *p++ = '0';
+            *p++ = HexDigits[c >> 4];
+            *p++ = HexDigits[c & 0xF];
+        } else {
+            *p++ = (char)c; //多字节的UTF-8原样。
+        }
+        break;
+    case ESCAPE_ZONE_NAME:
+    case ESCAPE_ZONE_STRING:
+        if (c < 0x20 || c >= 0x7F) {
+            *p++ = '\\';
+            *p++ = (char)('0' + c / 100);
+            *p++ = (char)('0' + c / 10 % 10);
+            *p++ = (char)('0' + c % 10);
+        } else if (c == '"' || c == '\\' || (Chunk->Escape == ESCAPE_ZONE_NAME && strchr(" ();@$", c))) {
+            *p++ = '\\';
+            *p++ = (char)c;
+        } else {
+            *p++ = (char)c;
+        }
+        break;
+    default:
+        *p++ = (char)c;
+        break;
+    }
+
+    Chunk->Length = (ULONG)(p - Chunk->Data);
+}
+
+
+static void PutText(_Inout_ PFORMAT_OUTPUT Out, _In_opt_ const void * Text, _In_ BOOLEAN Wide, _In_ ULONG Escape)
+/*
+功能：写一个以0结尾的字符串，UTF-16的转换为UTF-8，再按Escape转义。
+
+注意：单独的代理（不成对的）写成U+FFFD。
+*/
+{
+    TEXT_CHUNK Chunk;
+
+    if (nullptr == Text) {
+        return;
+    }
+
+    Chunk.Out = Out;
+    Chunk.Escape = Escape;
+    Chunk.Length = 0;
+
+    if (!Wide) {
+        for (PCSTR p = (PCSTR)Text; *p; p++) {
+            ChunkByte(&Chunk, (BYTE)*p);
+        }
+    } else {
+        for (PCWSTR p = (PCWSTR)Text; *p; p++) {
+            ULONG c = (ULONG)*p;
+
+            if (c >= 0xD800 && c < 0xDC00 && p[1] >= 0xDC00 && p[1] < 0xE000) {
+                c = 0x10000 + ((c - 0xD800) << 10) + ((ULONG)p[1] - 0xDC00);
+                p++;
+            } else if (c >= 0xD800 && c < 0xE000) {
+                c = 0xFFFD;
+            }
+
+            if (c < 0x80) {
+                ChunkByte(&Chunk, (BYTE)c);
+            } else if (c < 0x800) {
+                ChunkByte(&Chunk, (BYTE)(0xC0 | (c >> 6)));
+                ChunkByte(&Chunk, (BYTE)(0x80 | (c & 0x3F)));
+            } else if (c < 0x10000) {
+                ChunkByte(&Chunk, (BYTE)(0xE0 | (c >> 12)));
+                ChunkByte(&Chunk, (BYTE)(0x80 | ((c >> 6) & 0x3F)));
+                ChunkByte(&Chunk, (BYTE)(0x80 | (c & 0x3F)));
+            } else {
+                ChunkByte(&Chunk, (BYTE)(0xF0 | (c >> 18)));
+                ChunkByte(&Chunk, (BYTE)(0x80 | ((c >> 12) & 0x3F)));
+                ChunkByte(&Chunk, (BYTE)(0x80 | ((c >> 6) & 0x3F)));
+                ChunkByte(&Chunk, (BYTE)(0x80 | (c & 0x3F)));
+            }
+        }
+    }
+
+    PutBytes(Out, Chunk.Data, Chunk.Length);
+}
+
+
+static BOOLEAN TextEndsWithDot(_In_opt_ const void * Text, _In_ BOOLEAN Wide)
+{
+    SIZE_T Length = 0;
+
+    if (nullptr == Text) {
+        return FALSE;
+    }
+
+    if (Wide) {
+        PCWSTR p = (PCWSTR)Text;
+
+        Length = wcslen(p);
+        return Length && p[Length - 1] == L'.';
+    }
+
+    Length = strlen((PCSTR)Text);
+    return Length && ((PCSTR)Text)[Length - 1] == '.';
+}
+
+
+static void PutZoneName(_Inout_ PFORMAT_OUTPUT Out, _In_opt_ const void * Name, _In_ BOOLEAN Wide)
+/*
+功能：区域文件里的名字总是完整的（以'.'结尾），空的是根。
+*/
+{
+    PutText(Out, Name, Wide, ESCAPE_ZONE_NAME);
+
+    if (!TextEndsWithDot(Name, Wide)) {
+        PutChar(Out, '.');
+    }
+}
+
+
+static void PutEncodedBytes(_Inout_ PFORMAT_OUTPUT Out,
+                            _In_reads_bytes_(Size) const BYTE * Data,
+                            _In_ ULONG Size,
+                            _In_ ULONG Encoding)
+{
+    static const char Base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    static const char Base32Hex[] = "0123456789ABCDEFGHIJKLMNOPQRSTUV";
+
+    switch (Encoding) {
+    case BYTES_BASE64:
+        for (ULONG i = 0; i < Size; i += 3) {
+            const ULONG Rest = Size - i;
+            const ULONG v = (Data[i] << 16) | (Rest > 1 ? Data[i + 1] << 8 : 0) | (Rest > 2 ? Data[i + 2] : 0);
+
+            PutChar(Out, Base64[(v >> 18) & 0x3F]);
+            PutChar(Out, Base64[(v >> 12) & 0x3F]);
+            PutChar(Out, Rest > 1 ? Base64[(v >> 6) & 0x3F] : '=');
+            PutChar(Out, Rest > 2 ? Base64[v & 0x3F] : '=');
+        }
+        break;
+    case BYTES_BASE32HEX: //不填充（RFC 5155的表示法）。
+    {
+        ULONG Bits = 0;
+        ULONG Value = 0;
+
+        for (ULONG i = 0; i < Size; i++) {
+            Value = (Value << 8) | Data[i];
+            Bits += 8;
+            while (Bits >= 5) {
+                Bits -= 5;
+                PutChar(Out, Base32Hex[(Value >> Bits) & 0x1F]);
+            }
+        }
+
+        if (Bits) {
+            PutChar(Out, Base32Hex[(Value << (5 - Bits)) & 0x1F]);
+        }
+        break;
+    }
+    default:
+        for (ULONG i = 0; i < Size; i++) {
+            PutChar(Out, HexDigits[Data[i] >> 4]);
+            PutChar(Out, HexDigits[Data[i] & 0xF]);
+        }
+        break;
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//类型的助记符。
+
+
+static PCSTR TypeNames[] = {
+    nullptr,      //  0
+    "A",          //  1
+    "NS",         //  2
+    "MD",         //  3
+    "MF",         //  4
+    "CNAME",      //  5
+    "SOA",        //  6
+    "MB",         //  7
+    "MG",         //  8
+    "MR",         //  9
+    "NULL",       // 10
+    "WKS",        // 11
+    "PTR",        // 12
+    "HINFO",      // 13
+    "MINFO",      // 14
+    "MX",         // 15
+    "TXT",        // 16
+    "RP",         // 17
+    "AFSDB",      // 18
+    "X25",        // 19
+    "ISDN",       // 20
+    "RT",         // 21
+    "NSAP",       // 22
+    "NSAP-PTR",   // 23
+    "SIG",        // 24
+    "KEY",        // 25
+    "PX",         // 26
+    "GPOS",       // 27
+    "AAAA",       // 28
+    "LOC",        // 29
+    "NXT",        // 30
+    "EID",        // 31
+    "NIMLOC",     // 32
+    "SRV",        // 33
+    "ATMA",       // 34
+    "NAPTR",      // 35
+    "KX",         // 36
+    "CERT",       // 37
+    "A6",         // 38
+    "DNAME",      // 39
+    "SINK",       // 40
+    "OPT",        // 41
+    "APL",        // 42
+    "DS",         // 43
+    "SSHFP",      // 44
+    "IPSECKEY",   // 45
+    "RRSIG",      // 46
+    "NSEC",       // 47
+    "DNSKEY",     // 48
+    "DHCID",      // 49
+    "NSEC3",      // 50
+    "NSEC3PARAM", // 51
+    "TLSA",       // 52
+};
+
+
+static void PutType(_Inout_ PFORMAT_OUTPUT Out, _In_ USHORT Type)
+/*
+功能：类型的助记符，没有的写成TYPEnnn（RFC 3597）。
+*/
+{
+    if (Type < _ARRAYSIZE(TypeNames) && TypeNames[Type]) {
+        PutString(Out, TypeNames[Type]);
+    } else {
+        PutString(Out, "TYPE");
+        PutNumber(Out, Type);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//字段：TEXT是"\t标签 = 值\n"，区域文件是用空白分开的值，JSON是,"键":值。
+
+
+static BOOLEAN FieldBegin(_Inout_ PFORMAT_OUTPUT Out, _In_opt_z_ PCSTR Label, _In_z_ PCSTR Key)
+/*
+返回值：FALSE表示这个格式不写这个字段（TEXT格式里没有标签的字段，和原来的输出保持一致）。
+*/
+{
+    switch (Out->Format) {
+    case DNS_FORMAT_TEXT:
+        if (nullptr == Label) {
+            return FALSE;
+        }
+
+        PutChar(Out, '\t');
+        PutString(Out, Label);
+        PutString(Out, " = ");
+        break;
+    case DNS_FORMAT_ZONE:
+        PutChar(Out, Out->Fields ? ' ' : '\t');
+        break;
+    default:
+        PutString(Out, ",\"");
+        PutString(Out, Key);
+        PutString(Out, "\":");
+        break;
+    }
+
+    Out->Fields++;
+    return TRUE;
+}
+
+
+static void FieldEnd(_Inout_ PFORMAT_OUTPUT Out)
+{
+    if (Out->Format == DNS_FORMAT_TEXT) {
+        PutChar(Out, '\n');
+    }
+}
+
+
+static void FieldNumber(_Inout_ PFORMAT_OUTPUT Out, _In_opt_z_ PCSTR Label, _In_z_ PCSTR Key, _In_ ULONG Value)
+{
+    if (FieldBegin(Out, Label, Key)) {
+        PutNumber(Out, Value);
+        FieldEnd(Out);
+    }
+}
+
+
+static void FieldFlags(_Inout_ PFORMAT_OUTPUT Out,
+                       _In_opt_z_ PCSTR Label,
+                       _In_z_ PCSTR Key,
+                       _In_ ULONG Value,
+                       _In_ ULONG Digits)
+/*
+功能：标志位，TEXT格式是0x加固定位数的十六进制，其他的是十进制（区域文件的惯例）。
+*/
+{
+    if (FieldBegin(Out, Label, Key)) {
+        if (Out->Format == DNS_FORMAT_TEXT) {
+            PutString(Out, "0x");
+            PutHex(Out, Value, Digits, FALSE);
+        } else {
+            PutNumber(Out, Value);
+        }
+
+        FieldEnd(Out);
+    }
+}
+
+
+static void FieldType(_Inout_ PFORMAT_OUTPUT Out, _In_opt_z_ PCSTR Label, _In_z_ PCSTR Key, _In_ USHORT Type)
+{
+    if (FieldBegin(Out, Label, Key)) {
+        if (Out->Format == DNS_FORMAT_TEXT) {
+            PutNumber(Out, Type);
+        } else if (Out->Format == DNS_FORMAT_ZONE) {
+            PutType(Out, Type);
+        } else {
+            PutChar(Out, '"');
+            PutType(Out, Type);
+            PutChar(Out, '"');
+        }
+
+        FieldEnd(Out);
+    }
+}
+
+
+static void FieldName(_Inout_ PFORMAT_OUTPUT Out,
+                      _In_opt_z_ PCSTR Label,
+                      _In_z_ PCSTR Key,
+                      _In_opt_ const void * Name,
+                      _In_ BOOLEAN Wide)
+{
+    if (FieldBegin(Out, Label, Key)) {
+        if (Out->Format == DNS_FORMAT_TEXT) {
+            PutText(Out, Name, Wide, ESCAPE_NONE);
+        } else if (Out->Format == DNS_FORMAT_ZONE) {
+            PutZoneName(Out, Name, Wide);
+        } else {
+            PutChar(Out, '"');
+            PutText(Out, Name, Wide, ESCAPE_JSON);
+            PutChar(Out, '"');
+        }
+
+        FieldEnd(Out);
+    }
+}
+
+
+static void FieldString(_Inout_ PFORMAT_OUTPUT Out, _In_opt_ const void * Text, _In_ BOOLEAN Wide)
+/*
+功能：TXT等的一个字符串（区域文件和JSON都加引号），JSON的是数组的一个元素（由调用者写键和括号）。
+*/
+{
+    if (Out->Format == DNS_FORMAT_ZONE) {
+        PutChar(Out, Out->Fields++ ? ' ' : '\t');
+        PutChar(Out, '"');
+        PutText(Out, Text, Wide, ESCAPE_ZONE_STRING);
+        PutChar(Out, '"');
+    } else if (Out->Format == DNS_FORMAT_JSON) {
+        if (Out->Fields++) {
+            PutChar(Out, ',');
+        }
+
+        PutChar(Out, '"');
+        PutText(Out, Text, Wide, ESCAPE_JSON);
+        PutChar(Out, '"');
+    } else {
+        PutText(Out, Text, Wide, ESCAPE_NONE);
+    }
+}
+
+
+static void FieldIpv4(_Inout_ PFORMAT_OUTPUT Out, _In_opt_z_ PCSTR Label, _In_z_ PCSTR Key, _In_ ULONG Address)
+{
+    if (FieldBegin(Out, Label, Key)) {
+        IN_ADDR Ipv4{};
+        char Text[MAX_ADDRESS_STRING_LENGTH];
+        ULONG Length = 0;
+
+        Ipv4.S_un.S_addr = Address;
+        FormatIPv4Batch(&Ipv4, 1, Text, sizeof(Text), &Length);
+
+        if (Out->Format == DNS_FORMAT_JSON) {
+            PutChar(Out, '"');
+            PutBytes(Out, Text, Length);
+            PutChar(Out, '"');
+        } else {
+            PutBytes(Out, Text, Length);
+        }
+
+        FieldEnd(Out);
+    }
+}
+
+
+static void FieldIpv6(_Inout_ PFORMAT_OUTPUT Out,
+                      _In_opt_z_ PCSTR Label,
+                      _In_z_ PCSTR Key,
+                      _In_reads_bytes_(16) const BYTE * Address)
+{
+    if (FieldBegin(Out, Label, Key)) {
+        IN6_ADDR Ipv6{};
+        char Text[MAX_ADDRESS_STRING_LENGTH];
+        ULONG Length = 0;
+
+        RtlCopyMemory(&Ipv6, Address, sizeof(Ipv6));
+        FormatIPv6Batch(&Ipv6, 1, Text, sizeof(Text), &Length);
+
+        if (Out->Format == DNS_FORMAT_JSON) {
+            PutChar(Out, '"');
+            PutBytes(Out, Text, Length);
+            PutChar(Out, '"');
+        } else {
+            PutBytes(Out, Text, Length);
+        }
+
+        FieldEnd(Out);
+    }
+}
+
+
+static void FieldBytes(_Inout_ PFORMAT_OUTPUT Out,
+                       _In_z_ PCSTR Key,
+                       _In_reads_bytes_(Size) const BYTE * Data,
+                       _In_ ULONG Size,
+                       _In_ ULONG Encoding)
+/*
+功能：密钥，签名，摘要等（TEXT格式不写）。区域文件里空的盐写成"-"。
+*/
+{
+    if (FieldBegin(Out, nullptr, Key)) {
+        if (Out->Format == DNS_FORMAT_JSON) {
+            PutChar(Out, '"');
+            PutEncodedBytes(Out, Data, Size, Encoding);
+            PutChar(Out, '"');
+        } else if (0 == Size) {
+            PutChar(Out, '-');
+        } else {
+            PutEncodedBytes(Out, Data, Size, Encoding);
+        }
+    }
+}
+
+
+static void FieldTypeBitmap(_Inout_ PFORMAT_OUTPUT Out,
+                            _In_reads_bytes_(Size) const BYTE * Bitmap,
+                            _In_ ULONG Size)
+/*
+功能：NSEC和NSEC3的类型的位图（RFC 4034 4.1.2），区域文件里是各个类型，JSON里是数组（TEXT格式不写）。
+*/
+{
+    ULONG Count = 0;
+
+    if (Out->Format == DNS_FORMAT_TEXT) {
+        return;
+    }
+
+    if (Out->Format == DNS_FORMAT_JSON) {
+        PutString(Out, ",\"types\":[");
+    }
+
+    for (ULONG i = 0; i + 2 <= Size;) {
+        const ULONG Window = Bitmap[i];
+        const ULONG Length = Bitmap[i + 1];
+
+        i += 2;
+        if (0 == Length || Length > 32 || i + Length > Size) {
+            break;
+        }
+
+        for (ULONG j = 0; j < Length; j++) {
+            for (ULONG k = 0; k < 8; k++) {
+                if (Bitmap[i + j] & (0x80 >> k)) {
+                    const USHORT Type = (USHORT)(Window * 256 + j * 8 + k);
+
+                    if (Out->Format == DNS_FORMAT_JSON) {
+                        PutString(Out, Count ? ",\"" : "\"");
+                        PutType(Out, Type);
+                        PutChar(Out, '"');
+                    } else {
+                        PutChar(Out, Out->Fields++ ? ' ' : '\t');
+                        PutType(Out, Type);
+                    }
+
+                    Count++;
+                }
+            }
+        }
+
+        i += Length;
+    }
+
+    if (Out->Format == DNS_FORMAT_JSON) {
+        PutChar(Out, ']');
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//文本的格式（TEXT，ZONE，JSON）。
+
+
+static void RenderTxt(_Inout_ PFORMAT_OUTPUT Out, _In_ const DNS_TXT_DATAW * Txt, _In_ BOOLEAN Wide)
+{
+    if (Out->Format == DNS_FORMAT_TEXT) {
+        for (ULONG i = 0; i < Txt->dwStringCount; i++) {
+            PutString(Out, "\tString[");
+            PutNumber(Out, i + 1);
+            PutString(Out, "]      = ");
+            FieldString(Out, Txt->pStringArray[i], Wide);
+            PutChar(Out, '\n');
+        }
+    } else if (Out->Format == DNS_FORMAT_ZONE) {
+        for (ULONG i = 0; i < Txt->dwStringCount; i++) {
+            FieldString(Out, Txt->pStringArray[i], Wide);
+        }
+    } else {
+        PutString(Out, ",\"strings\":[");
+        for (ULONG i = 0; i < Txt->dwStringCount; i++) {
+            FieldString(Out, Txt->pStringArray[i], Wide);
+        }
+        PutChar(Out, ']');
+    }
+}
+
+
+static ULONG RenderData(_Inout_ PFORMAT_OUTPUT Out, _In_ const DNS_RECORD * Record, _In_ BOOLEAN Wide)
+/*
+功能：记录的数据部分。标签（TEXT格式）和原来的各个XxxRecordPrint的相同。
+
+返回值：ERROR_SUCCESS，或者ERROR_NOT_SUPPORTED（没有格式化的类型，TEXT格式只写头）。
+*/
+{
+    switch (Record->wType) {
+    case DNS_TYPE_A:
+        FieldIpv4(Out, "IP address    ", "address", Record->Data.A.IpAddress);
+        break;
+    case DNS_TYPE_AAAA:
+        FieldIpv6(Out, "IP address    ", "address", Record->Data.AAAA.Ip6Address.IP6Byte);
+        break;
+    case DNS_TYPE_NS:
+    case DNS_TYPE_MD:
+    case DNS_TYPE_MF:
+    case DNS_TYPE_CNAME:
+    case DNS_TYPE_MB:
+    case DNS_TYPE_MG:
+    case DNS_TYPE_MR:
+    case DNS_TYPE_PTR:
+    case DNS_TYPE_DNAME:
+        FieldName(Out, "HostName      ", "host", Record->Data.PTR.pNameHost, Wide);
+        break;
+    case DNS_TYPE_SOA:
+        FieldName(Out, "Primary       ", "primary", Record->Data.SOA.pNamePrimaryServer, Wide);
+        FieldName(Out, "Admin         ", "admin", Record->Data.SOA.pNameAdministrator, Wide);
+        FieldNumber(Out, "Serial        ", "serial", Record->Data.SOA.dwSerialNo);
+        FieldNumber(Out, "Refresh       ", "refresh", Record->Data.SOA.dwRefresh);
+        FieldNumber(Out, "Retry         ", "retry", Record->Data.SOA.dwRetry);
+        FieldNumber(Out, "Expire        ", "expire", Record->Data.SOA.dwExpire);
+        FieldNumber(Out, "Default TTL   ", "minimum", Record->Data.SOA.dwDefaultTtl);
+        break;
+    case DNS_TYPE_MINFO:
+    case DNS_TYPE_RP:
+        FieldName(Out, nullptr, "mailbox", Record->Data.MINFO.pNameMailbox, Wide);
+        FieldName(Out, nullptr, "errors", Record->Data.MINFO.pNameErrorsMailbox, Wide);
+        break;
+    case DNS_TYPE_MX:
+    case DNS_TYPE_AFSDB:
+    case DNS_TYPE_RT:
+        FieldNumber(Out, "Preference    ", "preference", Record->Data.MX.wPreference);
+        FieldName(Out, "Exchange      ", "exchange", Record->Data.MX.pNameExchange, Wide);
+        break;
+    case DNS_TYPE_HINFO:
+    case DNS_TYPE_TEXT:
+    case DNS_TYPE_X25:
+    case DNS_TYPE_ISDN:
+        RenderTxt(Out, &Record->Data.TXT, Wide);
+        break;
+    case DNS_TYPE_SRV:
+        FieldNumber(Out, "Priority      ", "priority", Record->Data.SRV.wPriority);
+        FieldNumber(Out, "Weight        ", "weight", Record->Data.SRV.wWeight);
+        FieldNumber(Out, "Port          ", "port", Record->Data.SRV.wPort);
+        FieldName(Out, "Target Host   ", "target", Record->Data.SRV.pNameTarget, Wide);
+        break;
+    case DNS_TYPE_SIG:
+    case DNS_TYPE_RRSIG:
+        FieldType(Out, "Type Covered        ", "typeCovered", Record->Data.SIG.wTypeCovered);
+        FieldNumber(Out, "Algorithm           ", "algorithm", Record->Data.SIG.chAlgorithm);
+        FieldNumber(Out, "Labels              ", "labels", Record->Data.SIG.chLabelCount);
+        FieldNumber(Out, "Original TTL        ", "originalTtl", Record->Data.SIG.dwOriginalTtl);
+        FieldNumber(Out, "Signature Expiration", "expiration", Record->Data.SIG.dwExpiration);
+        FieldNumber(Out, "Signature Inception ", "inception", Record->Data.SIG.dwTimeSigned);
+        FieldNumber(Out, "Key Tag             ", "keyTag", Record->Data.SIG.wKeyTag);
+        FieldName(Out, "Signer's Name       ", "signer", Record->Data.SIG.pNameSigner, Wide);
+        FieldBytes(Out,
+                   "signature",
+                   Record->Data.SIG.Signature,
+                   Record->Data.SIG.wSignatureLength,
+                   BYTES_BASE64);
+        break;
+    case DNS_TYPE_KEY:
+    case DNS_TYPE_DNSKEY:
+        FieldFlags(Out, "Flags               ", "flags", Record->Data.KEY.wFlags, 4);
+        FieldNumber(Out, "Protocol            ", "protocol", Record->Data.KEY.chProtocol);
+        FieldNumber(Out, "Algorithm           ", "algorithm", Record->Data.KEY.chAlgorithm);
+        FieldBytes(Out, "key", Record->Data.KEY.Key, Record->Data.KEY.wKeyLength, BYTES_BASE64);
+        break;
+    case DNS_TYPE_DS:
+        FieldNumber(Out, "Key Tag             ", "keyTag", Record->Data.DS.wKeyTag);
+        FieldNumber(Out, "Algorithm           ", "algorithm", Record->Data.DS.chAlgorithm);
+        FieldNumber(Out, "Digest Type         ", "digestType", Record->Data.DS.chDigestType);
+        FieldBytes(Out, "digest", Record->Data.DS.Digest, Record->Data.DS.wDigestLength, BYTES_HEX);
+        break;
+    case DNS_TYPE_NSEC:
+        FieldName(Out, "Next Domain Name    ", "next", Record->Data.NSEC.pNextDomainName, Wide);
+        FieldTypeBitmap(Out, Record->Data.NSEC.TypeBitMaps, Record->Data.NSEC.wTypeBitMapsLength);
+        break;
+    case DNS_TYPE_NSEC3:
+    {
+        const DNS_NSEC3_DATA * Nsec3 = &Record->Data.NSEC3;
+
+        FieldNumber(Out, "HashAlgorithm                  ", "algorithm", Nsec3->chAlgorithm);
+        FieldFlags(Out, "Flags                          ", "flags", Nsec3->bFlags, 2);
+        FieldNumber(Out, "Iterations                     ", "iterations", Nsec3->wIterations);
+        FieldBytes(Out, "salt", Nsec3->chData, Nsec3->bSaltLength, BYTES_HEX);
+        FieldBytes(Out, "next", Nsec3->chData + Nsec3->bSaltLength, Nsec3->bHashLength, BYTES_BASE32HEX);
+        FieldTypeBitmap(Out,
+                        Nsec3->chData + Nsec3->bSaltLength + Nsec3->bHashLength,
+                        Nsec3->wTypeBitMapsLength);
+        break;
+    }
+    case DNS_TYPE_NSEC3PARAM:
+        FieldNumber(Out, "HashAlgorithm                  ", "algorithm", Record->Data.NSEC3PARAM.chAlgorithm);
+        FieldFlags(Out, "Flags                          ", "flags", Record->Data.NSEC3PARAM.bFlags, 2);
+        FieldNumber(Out, "Iterations                     ", "iterations", Record->Data.NSEC3PARAM.wIterations);
+        FieldBytes(Out, "salt", Record->Data.NSEC3PARAM.pbSalt, Record->Data.NSEC3PARAM.bSaltLength, BYTES_HEX);
+        break;
+    case DNS_TYPE_NULL: //未知的格式（RFC 3597）：\# 长度 十六进制。
+        if (Out->Format == DNS_FORMAT_ZONE) {
+            PutString(Out, "\t\\# ");
+            PutNumber(Out, Record->Data.Null.dwByteCount);
+            Out->Fields++;
+        }
+
+        if (Out->Format != DNS_FORMAT_ZONE || Record->Data.Null.dwByteCount) {
+            FieldBytes(Out, "rdata", Record->Data.Null.Data, Record->Data.Null.dwByteCount, BYTES_HEX);
+        }
+        break;
+    default:
+        return Out->Format == DNS_FORMAT_TEXT ? ERROR_SUCCESS : ERROR_NOT_SUPPORTED;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+static void RenderTextHeader(_Inout_ PFORMAT_OUTPUT Out, _In_ const DNS_RECORD * Record, _In_ BOOLEAN Wide)
+/*
+功能：原来的PrintRecord的头（%p是固定位数的大写的十六进制，和MSVC的一样）。
+*/
+{
+    PutString(Out, "  Record:\n\tPtr            = ");
+    PutHex(Out, (UINT64)(ULONG_PTR)Record, sizeof(PVOID) * 2, TRUE);
+    PutString(Out, ", pNext = ");
+    PutHex(Out, (UINT64)(ULONG_PTR)Record->pNext, sizeof(PVOID) * 2, TRUE);
+    PutString(Out, "\n\tOwner          = ");
+    PutText(Out, Record->pName, Wide, ESCAPE_NONE);
+    PutString(Out, "\n\tType           = ");
+    PutNumber(Out, Record->wType);
+    PutString(Out, "\n\tFlags          = ");
+    PutHex(Out, Record->Flags.DW, 8, FALSE);
+    PutString(Out, "\n\t\tSection      = ");
+    PutNumber(Out, (ULONG)Record->Flags.S.Section);
+    PutString(Out, "\n\t\tDelete       = ");
+    PutNumber(Out, (ULONG)Record->Flags.S.Delete);
+    PutString(Out, "\n\t\tCharSet      = ");
+    PutNumber(Out, (ULONG)Record->Flags.S.CharSet);
+    PutString(Out, "\n\tTTL            = ");
+    PutNumber(Out, Record->dwTtl);
+    PutString(Out, "\n\tReserved       = ");
+    PutNumber(Out, Record->dwReserved);
+    PutString(Out, "\n\tDataLength     = ");
+    PutNumber(Out, Record->wDataLength);
+    PutChar(Out, '\n');
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//二进制的格式：报文里的资源记录（RFC 1035 4.1.3），名字不压缩。
+
+
+static void PutWireName(_Inout_ PFORMAT_OUTPUT Out, _In_opt_ const void * Name, _In_ BOOLEAN Wide)
+/*
+功能：把文本的名字（UTF-8）按'.'分成标签写出。空的名字和"."是根。
+
+注意：标签不能是空的或者超过63字节，总长不超过255字节，否则设置ERROR_INVALID_NAME。
+*/
+{
+    char Text[DNS_WIRE_MAX_NAME_TEXT];
+    FORMAT_OUTPUT Temp;
+    ULONG Total = 1;
+
+    OutputInit(&Temp, DNS_FORMAT_BINARY, Text, sizeof(Text), 0);
+    PutText(&Temp, Name, Wide, ESCAPE_NONE);
+    if (Temp.Length >= sizeof(Text)) {
+        Out->Status = ERROR_INVALID_NAME;
+        return;
+    }
+
+    if (Temp.Length == 1 && Text[0] == '.') {
+        Temp.Length = 0;
+    }
+
+    for (ULONG Start = 0; Start < Temp.Length;) {
+        ULONG End = Start;
+
+        while (End < Temp.Length && Text[End] != '.') {
+            End++;
+        }
+
+        const ULONG Size = End - Start;
+        if (0 == Size || Size > 63) {
+            Out->Status = ERROR_INVALID_NAME;
+            return;
+        }
+
+        Total += 1 + Size;
+        PutChar(Out, (char)Size);
+        PutBytes(Out, Text + Start, Size);
+        Start = End + 1; //最后的'.'之后结束。
+    }
+
+    if (Total > DNS_WIRE_MAX_NAME) {
+        Out->Status = ERROR_INVALID_NAME;
+    }
+
+    PutChar(Out, 0);
+}
+
+
+static void PutWireString(_Inout_ PFORMAT_OUTPUT Out, _In_opt_ const void * Text, _In_ BOOLEAN Wide)
+/*
+功能：<character-string>：一个字节的长度加上内容（最多255字节）。
+*/
+{
+    const ULONG Position = Out->Length;
+    ULONG Size = 0;
+
+    PutChar(Out, 0);
+    PutText(Out, Text, Wide, ESCAPE_NONE);
+
+    Size = Out->Length - Position - 1;
+    if (Size > 255) {
+        Out->Status = ERROR_INVALID_DATA;
+    }
+
+    PatchByte(Out, Position, (BYTE)Size);
+}
+
+
+static ULONG RenderWire(_Inout_ PFORMAT_OUTPUT Out, _In_ const DNS_RECORD * Record, _In_ BOOLEAN Wide)
+{
+    ULONG Position = 0;
+    ULONG Size = 0;
+
+    PutWireName(Out, Record->pName, Wide);
+    PutUshort(Out, Record->wType);
+    PutUshort(Out, DNS_CLASS_INTERNET);
+    PutUlong(Out, Record->dwTtl);
+
+    Position = Out->Length;
+    PutUshort(Out, 0); // RDLENGTH，最后回填。
+
+    switch (Record->wType) {
+    case DNS_TYPE_A:
+        PutBytes(Out, &Record->Data.A.IpAddress, 4);
+        break;
+    case DNS_TYPE_AAAA:
+        PutBytes(Out, Record->Data.AAAA.Ip6Address.IP6Byte, 16);
+        break;
+    case DNS_TYPE_NS:
+    case DNS_TYPE_MD:
+    case DNS_TYPE_MF:
+    case DNS_TYPE_CNAME:
+    case DNS_TYPE_MB:
+    case DNS_TYPE_MG:
+    case DNS_TYPE_MR:
+    case DNS_TYPE_PTR:
+    case DNS_TYPE_DNAME:
+        PutWireName(Out, Record->Data.PTR.pNameHost, Wide);
+        break;
+    case DNS_TYPE_SOA:
+        PutWireName(Out, Record->Data.SOA.pNamePrimaryServer, Wide);
+        PutWireName(Out, Record->Data.SOA.pNameAdministrator, Wide);
+        PutUlong(Out, Record->Data.SOA.dwSerialNo);
+        PutUlong(Out, Record->Data.SOA.dwRefresh);
+        PutUlong(Out, Record->Data.SOA.dwRetry);
+        PutUlong(Out, Record->Data.SOA.dwExpire);
+        PutUlong(Out, Record->Data.SOA.dwDefaultTtl);
+        break;
+    case DNS_TYPE_MINFO:
+    case DNS_TYPE_RP:
+        PutWireName(Out, Record->Data.MINFO.pNameMailbox, Wide);
+        PutWireName(Out, Record->Data.MINFO.pNameErrorsMailbox, Wide);
+        break;
+    case DNS_TYPE_MX:
+    case DNS_TYPE_AFSDB:
+    case DNS_TYPE_RT:
+        PutUshort(Out, Record->Data.MX.wPreference);
+        PutWireName(Out, Record->Data.MX.pNameExchange, Wide);
+        break;
+    case DNS_TYPE_HINFO:
+    case DNS_TYPE_TEXT:
+    case DNS_TYPE_X25:
+    case DNS_TYPE_ISDN:
+        for (ULONG i = 0; i < Record->Data.TXT.dwStringCount; i++) {
+            PutWireString(Out, Record->Data.TXT.pStringArray[i], Wide);
+        }
+        break;
+    case DNS_TYPE_SRV:
+        PutUshort(Out, Record->Data.SRV.wPriority);
+        PutUshort(Out, Record->Data.SRV.wWeight);
+        PutUshort(Out, Record->Data.SRV.wPort);
+        PutWireName(Out, Record->Data.SRV.pNameTarget, Wide);
+        break;
+    case DNS_TYPE_SIG:
+    case DNS_TYPE_RRSIG:
+        PutUshort(Out, Record->Data.SIG.wTypeCovered);
+        PutChar(Out, (char)Record->Data.SIG.chAlgorithm);
+        PutChar(Out, (char)Record->Data.SIG.chLabelCount);
+        PutUlong(Out, Record->Data.SIG.dwOriginalTtl);
+        PutUlong(Out, Record->Data.SIG.dwExpiration);
+        PutUlong(Out, Record->Data.SIG.dwTimeSigned);
+        PutUshort(Out, Record->Data.SIG.wKeyTag);
+        PutWireName(Out, Record->Data.SIG.pNameSigner, Wide);
+        PutBytes(Out, Record->Data.SIG.Signature, Record->Data.SIG.wSignatureLength);
+        break;
+    case DNS_TYPE_KEY:
+    case DNS_TYPE_DNSKEY:
+        PutUshort(Out, Record->Data.KEY.wFlags);
+        PutChar(Out, (char)Record->Data.KEY.chProtocol);
+        PutChar(Out, (char)Record->Data.KEY.chAlgorithm);
+        PutBytes(Out, Record->Data.KEY.Key, Record->Data.KEY.wKeyLength);
+        break;
+    case DNS_TYPE_DS:
+        PutUshort(Out, Record->Data.DS.wKeyTag);
+        PutChar(Out, (char)Record->Data.DS.chAlgorithm);
+        PutChar(Out, (char)Record->Data.DS.chDigestType);
+        PutBytes(Out, Record->Data.DS.Digest, Record->Data.DS.wDigestLength);
+        break;
+    case DNS_TYPE_NSEC:
+        PutWireName(Out, Record->Data.NSEC.pNextDomainName, Wide);
+        PutBytes(Out, Record->Data.NSEC.TypeBitMaps, Record->Data.NSEC.wTypeBitMapsLength);
+        break;
+    case DNS_TYPE_NSEC3:
+    {
+        const DNS_NSEC3_DATA * Nsec3 = &Record->Data.NSEC3;
+
+        PutChar(Out, (char)Nsec3->chAlgorithm);
+        PutChar(Out, (char)Nsec3->bFlags);
+        PutUshort(Out, Nsec3->wIterations);
+        PutChar(Out, (char)Nsec3->bSaltLength);
+        PutBytes(Out, Nsec3->chData, Nsec3->bSaltLength);
+        PutChar(Out, (char)Nsec3->bHashLength);
+        PutBytes(Out, Nsec3->chData + Nsec3->bSaltLength, Nsec3->bHashLength + Nsec3->wTypeBitMapsLength);
+        break;
+    }
+    case DNS_TYPE_NSEC3PARAM:
+        PutChar(Out, (char)Record->Data.NSEC3PARAM.chAlgorithm);
+        PutChar(Out, (char)Record->Data.NSEC3PARAM.bFlags);
+        PutUshort(Out, Record->Data.NSEC3PARAM.wIterations);
+        PutChar(Out, (char)Record->Data.NSEC3PARAM.bSaltLength);
+        PutBytes(Out, Record->Data.NSEC3PARAM.pbSalt, Record->Data.NSEC3PARAM.bSaltLength);
+        break;
+    case DNS_TYPE_NULL:
+        PutBytes(Out, Record->Data.Null.Data, Record->Data.Null.dwByteCount);
+        break;
+    default:
+        return ERROR_NOT_SUPPORTED;
+    }
+
+    Size = Out->Length - Position - 2;
+    if (Size > 0xFFFF) {
+        return ERROR_INVALID_DATA;
+    }
+
+    PatchByte(Out, Position, (BYTE)(Size >> 8));
+    PatchByte(Out, Position + 1, (BYTE)Size);
+    return Out->Status;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static void RenderRecord(_Inout_ PFORMAT_OUTPUT Out, _In_ const DNS_RECORD * Record)
+/*
+功能：按Out->Format写一个记录，错误记在Out->Status。
+
+注意：CharSet是Unknown的也当作UTF-16（DNS_RECORD就是DNS_RECORDW，自己构造的记录常常不设置）。
+*/
+{
+    const BOOLEAN Wide = Record->Flags.S.CharSet != DnsCharSetUtf8 && Record->Flags.S.CharSet != DnsCharSetAnsi;
+    ULONG Status = ERROR_SUCCESS;
+
+    switch (Out->Format) {
+    case DNS_FORMAT_TEXT:
+        RenderTextHeader(Out, Record, Wide);
+        Status = RenderData(Out, Record, Wide);
+        break;
+    case DNS_FORMAT_ZONE:
+        PutZoneName(Out, Record->pName, Wide);
+        PutChar(Out, '\t');
+        PutNumber(Out, Record->dwTtl);
+        PutString(Out, "\tIN\t");
+        PutType(Out, Record->wType);
+        Status = RenderData(Out, Record, Wide);
+        PutChar(Out, '\n');
+        break;
+    case DNS_FORMAT_JSON:
+        PutString(Out, "{\"name\":\"");
+        PutText(Out, Record->pName, Wide, ESCAPE_JSON);
+        PutString(Out, "\",\"type\":\"");
+        PutType(Out, Record->wType);
+        PutString(Out, "\",\"ttl\":");
+        PutNumber(Out, Record->dwTtl);
+        PutString(Out, ",\"section\":");
+        PutNumber(Out, (ULONG)Record->Flags.S.Section);
+        Status = RenderData(Out, Record, Wide);
+        PutChar(Out, '}');
+        break;
+    default:
+        Status = RenderWire(Out, Record, Wide);
+        break;
+    }
+
+    if (ERROR_SUCCESS == Out->Status) {
+        Out->Status = Status;
+    }
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DnsFormatRecord(_In_ const DNS_RECORD * Record,
+                             _In_ ULONG Format,
+                             _Out_writes_bytes_to_opt_(Capacity, *Length) PCHAR Buffer,
+                             _In_ ULONG Capacity,
+                             _Out_ PULONG Length)
+/*
+功能：把一个记录格式化到Buffer（不跟随pNext）。
+
+参数：
+Format：DNS_FORMAT_*。
+Buffer：可以是nullptr（Capacity是0），用于获取需要的长度。
+Length：写入的（或者需要的）长度。
+
+返回值：
+ERROR_SUCCESS；
+ERROR_INSUFFICIENT_BUFFER：Length是需要的长度；
+ERROR_NOT_SUPPORTED：这个类型只支持DNS_FORMAT_TEXT；
+ERROR_INVALID_NAME，ERROR_INVALID_DATA：名字或者字符串太长，不能写成二进制的格式。
+
+注意：文本的格式如果还有空间，在后面加上0（不计入Length）。
+区域文件的格式以换行结尾，JSON的不以换行结尾。
+*/
+{
+    FORMAT_OUTPUT Out;
+
+    if (nullptr == Record || nullptr == Length || Format > DNS_FORMAT_BINARY || (nullptr == Buffer && Capacity)) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    OutputInit(&Out, Format, Buffer, Capacity, 0);
+    RenderRecord(&Out, Record);
+
+    *Length = Out.Length;
+    if (ERROR_SUCCESS != Out.Status) {
+        return Out.Status;
+    }
+
+    if (Out.Length > Capacity) {
+        return ERROR_INSUFFICIENT_BUFFER;
+    }
+
+    if (Format != DNS_FORMAT_BINARY && Out.Length < Capacity) {
+        Buffer[Out.Length] = 0;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//流式的写入。
+
+
+static ULONG WriterFlush(_Inout_ PDNS_FORMAT_WRITER Writer)
+{
+    ULONG Status = ERROR_SUCCESS;
+
+    if (Writer->Length) {
+        Status = Writer->Flush(Writer->Context, Writer->Buffer, Writer->Length);
+        Writer->Written += Writer->Length;
+        Writer->Length = 0;
+    }
+
+    return Status;
+}
+
+
+static void WriterRender(_In_ PDNS_FORMAT_WRITER Writer,
+                         _Out_ PFORMAT_OUTPUT Out,
+                         _In_opt_ const DNS_RECORD * Record,
+                         _In_ ULONG Skip)
+/*
+功能：在缓冲区的剩余的空间里写一个记录（JSON的还有前面的分隔符），Record是nullptr的写JSON数组的结尾。
+*/
+{
+    OutputInit(Out, Writer->Format, Writer->Buffer + Writer->Length, Writer->Capacity - Writer->Length, Skip);
+
+    if (Writer->Format == DNS_FORMAT_JSON) {
+        if (nullptr == Record) {
+            PutString(Out, Writer->Records ? "\n]\n" : "[]\n");
+            return;
+        }
+
+        PutString(Out, Writer->Records ? ",\n" : "[\n");
+    }
+
+    if (Record) {
+        RenderRecord(Out, Record);
+    }
+}
+
+
+static ULONG WriterWrite(_Inout_ PDNS_FORMAT_WRITER Writer, _In_opt_ const DNS_RECORD * Record)
+/*
+功能：写一个记录，放不下就先Flush；比整个缓冲区还大的就分段：每次重新格式化，只保留其中的一段。
+*/
+{
+    FORMAT_OUTPUT Out;
+    ULONG Status = ERROR_SUCCESS;
+    ULONG Total = 0;
+
+    WriterRender(Writer, &Out, Record, 0);
+    if (ERROR_SUCCESS != Out.Status) {
+        return Out.Status;
+    }
+
+    if (Out.Length <= Writer->Capacity - Writer->Length) {
+        Writer->Length += Out.Length;
+        return ERROR_SUCCESS;
+    }
+
+    Status = WriterFlush(Writer);
+    if (ERROR_SUCCESS != Status) {
+        return Status;
+    }
+
+    Total = Out.Length;
+    for (ULONG Skip = 0; Skip < Total; Skip += Writer->Capacity) {
+        WriterRender(Writer, &Out, Record, Skip);
+        Writer->Length = min(Total - Skip, Writer->Capacity);
+
+        if (Writer->Length == Writer->Capacity) { //最后一段留在缓冲区里，后面的记录可以接着写。
+            Status = WriterFlush(Writer);
+            if (ERROR_SUCCESS != Status) {
+                return Status;
+            }
+        }
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DnsFormatWriterInit(_Out_ PDNS_FORMAT_WRITER Writer,
+                                 _In_ ULONG Format,
+                                 _Out_writes_bytes_(Capacity) PCHAR Buffer,
+                                 _In_ ULONG Capacity,
+                                 _In_ DNS_FORMAT_FLUSH Flush,
+                                 _In_opt_ PVOID Context)
+/*
+功能：初始化流式的写入。
+
+参数：
+Buffer：写入的缓冲区，满了就交给Flush。建议DNS_FORMAT_BUFFER_SIZE或者更大，至少16字节。
+Flush：比如DnsFormatPrint（Context是FILE *或者nullptr）。
+
+用法：
+DnsFormatWriterInit，对每个记录调用DnsFormatWriterAppend，最后DnsFormatWriterFinish。
+*/
+{
+    if (nullptr == Writer || nullptr == Buffer || Capacity < 16 || nullptr == Flush ||
+        Format > DNS_FORMAT_BINARY) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    RtlZeroMemory(Writer, sizeof(DNS_FORMAT_WRITER));
+    Writer->Format = Format;
+    Writer->Buffer = Buffer;
+    Writer->Capacity = Capacity;
+    Writer->Flush = Flush;
+    Writer->Context = Context;
+
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DnsFormatWriterAppend(_Inout_ PDNS_FORMAT_WRITER Writer, _In_opt_ const DNS_RECORD * Records)
+/*
+功能：写一个记录列表（跟随pNext）。
+
+返回值：
+ERROR_SUCCESS：不支持的类型（见DnsFormatRecord）跳过，计入Writer->Skipped；
+其他的：出错的记录的错误（不写这个记录，后面的也不写），或者Flush的返回值。
+*/
+{
+    for (; Records; Records = Records->pNext) {
+        const ULONG Status = WriterWrite(Writer, Records);
+
+        if (ERROR_NOT_SUPPORTED == Status) {
+            Writer->Skipped++;
+            continue;
+        }
+
+        if (ERROR_SUCCESS != Status) {
+            return Status;
+        }
+
+        Writer->Records++;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DnsFormatWriterFinish(_Inout_ PDNS_FORMAT_WRITER Writer)
+/*
+功能：结束写入（JSON的写上数组的结尾），把缓冲区里剩下的交给Flush。
+*/
+{
+    if (Writer->Format == DNS_FORMAT_JSON) {
+        const ULONG Status = WriterWrite(Writer, nullptr);
+
+        if (ERROR_SUCCESS != Status) {
+            return Status;
+        }
+    }
+
+    return WriterFlush(Writer);
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DnsFormatPrint(_In_opt_ PVOID Context, _In_reads_bytes_(Length) const char * Data, _In_ ULONG Length)
+/*
+功能：DNS_FORMAT_WRITER的写到文件的Flush。
+
+参数：
+Context：FILE *，nullptr是stdout。
+*/
+{
+    FILE * File = Context ? (FILE *)Context : stdout;
+
+    return fwrite(Data, 1, Length, File) == Length ? ERROR_SUCCESS : ERROR_WRITE_FAULT;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
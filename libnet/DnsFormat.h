@@ -0,0 +1,72 @@
+﻿#pragma once
+
+#include "pch.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+//DnsFormatRecord等的Format。
+#define DNS_FORMAT_TEXT   0 //原来的PrintDnsRecordList的缩进的格式（每个字段一行），便于人看。
+#define DNS_FORMAT_ZONE   1 //区域文件（RFC 1035 5.1）的格式，一个记录一行：name. TTL IN TYPE RDATA。
+#define DNS_FORMAT_JSON   2 //一个记录一个JSON对象；列表（DNS_FORMAT_WRITER）是一个数组。
+#define DNS_FORMAT_BINARY 3 //报文里的资源记录的格式（RFC 1035 4.1.3），不压缩，类别是IN。
+
+#define DNS_FORMAT_BUFFER_SIZE 4096 //一般的记录的文本的格式都用不了这么多，适合放在栈上。
+
+
+//DNS_FORMAT_WRITER的缓冲区满了（或者DnsFormatWriterFinish）时调用，返回ERROR_SUCCESS以外的值会中止写入。
+typedef ULONG(WINAPI * DNS_FORMAT_FLUSH)(_In_opt_ PVOID Context,
+                                         _In_reads_bytes_(Length) const char * Data,
+                                         _In_ ULONG Length);
+
+
+//流式地格式化大量的记录，见DnsFormatWriterInit。不申请内存，可以放在栈上。
+typedef struct _DNS_FORMAT_WRITER {
+    ULONG Format;
+    PCHAR Buffer;
+    ULONG Capacity;
+    ULONG Length;          //缓冲区里还没有交给Flush的长度。
+    DNS_FORMAT_FLUSH Flush;
+    PVOID Context;
+    ULONG Records;         //已经写入的记录的个数。
+    ULONG Skipped;         //这个格式不支持的类型而跳过的记录的个数。
+    UINT64 Written;        //交给Flush的总的长度。
+} DNS_FORMAT_WRITER, * PDNS_FORMAT_WRITER;
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C_START
+
+
+DLLEXPORT
+ULONG WINAPI DnsFormatRecord(_In_ const DNS_RECORD * Record,
+                             _In_ ULONG Format,
+                             _Out_writes_bytes_to_opt_(Capacity, *Length) PCHAR Buffer,
+                             _In_ ULONG Capacity,
+                             _Out_ PULONG Length);
+
+DLLEXPORT
+ULONG WINAPI DnsFormatWriterInit(_Out_ PDNS_FORMAT_WRITER Writer,
+                                 _In_ ULONG Format,
+                                 _Out_writes_bytes_(Capacity) PCHAR Buffer,
+                                 _In_ ULONG Capacity,
+                                 _In_ DNS_FORMAT_FLUSH Flush,
+                                 _In_opt_ PVOID Context);
+
+DLLEXPORT
+ULONG WINAPI DnsFormatWriterAppend(_Inout_ PDNS_FORMAT_WRITER Writer, _In_opt_ const DNS_RECORD * Records);
+
+DLLEXPORT
+ULONG WINAPI DnsFormatWriterFinish(_Inout_ PDNS_FORMAT_WRITER Writer);
+
+DLLEXPORT
+ULONG WINAPI DnsFormatPrint(_In_opt_ PVOID Context, _In_reads_bytes_(Length) const char * Data, _In_ ULONG Length);
+
+
+EXTERN_C_END
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
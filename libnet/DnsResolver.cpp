@@ -0,0 +1,1070 @@
+﻿#include "pch.h"
+#include "DnsResolver.h"
+#include "DnsWire.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/*
+异步的DNS解析器：在少量的UDP套接字上同时有成千上万个在途的查询。
+
+1.单线程，由调用者驱动：DnsResolverSubmit编码并发送查询，DnsResolverPoll（WSAPoll）接收应答，
+  处理重传和超时，调用回调。不需要锁，也不创建线程；要并行的可以每个线程一个解析器。
+2.防伪造（RFC 5452）：每个套接字绑定一个随机的源端口，每个查询用一个随机的ID（BCryptGenRandom），
+  应答的来源（地址和端口），ID，问题（名字忽略大小写，类型，类别）都匹配了才接受，否则丢弃。
+  （套接字，ID）到查询的映射是一个直接寻址的表，查找是O(1)的。
+3.重传和超时用时间轮（每格10毫秒），重传的间隔指数地增长，发送了Attempts次后超时。
+4.应答被截断（TC）的改用TCP（RFC 7766）重新查询，报文前面有2字节的长度。
+5.默认带EDNS0的OPT记录（RFC 6891），UDP的应答可以到1232字节，减少截断。
+
+查询的内存在创建时一次分配好（每个约300字节，加上每个套接字128KB的ID表），之后不再分配（除了TCP的应答）。
+
+参考：
+https://www.rfc-editor.org/rfc/rfc5452
+https://www.rfc-editor.org/rfc/rfc7766
+https://www.rfc-editor.org/rfc/rfc6891
+*/
+
+
+#define DNS_RESOLVER_TICK        10    //时间轮的一格（毫秒）。
+#define DNS_RESOLVER_SLOTS       512   //时间轮的格数（一圈5.12秒），更远的到期时间会多转几圈。
+#define DNS_RESOLVER_MAX_SOCKETS 64
+#define DNS_RESOLVER_MAX_QUERIES 65534 // ID表里存的是下标加1，0是空的。
+#define DNS_RESOLVER_MAX_TCP     64    //同时的TCP连接的上限，见UdpReceive。
+#define DNS_RESOLVER_NIL         MAXULONG
+
+//查询的报文：头，一个问题（名字最长255字节），OPT记录（11字节）。
+#define DNS_RESOLVER_PACKET  (DNS_WIRE_HEADER_SIZE + DNS_WIRE_MAX_NAME + 4 + 11)
+#define DNS_RESOLVER_RECEIVE 0xFFFF
+
+#define DNS_FLAG_QR 0x8000
+#define DNS_FLAG_TC 0x0200
+#define DNS_FLAG_RD 0x0100
+
+#define DNS_QUERY_FREE 0
+#define DNS_QUERY_UDP  1
+#define DNS_QUERY_TCP  2
+
+#define DNS_TCP_CONNECTING 1
+#define DNS_TCP_SENDING    2
+#define DNS_TCP_RECEIVING  3
+
+
+typedef struct _DNS_QUERY {
+    ULONG Next;         //时间轮的格里的链表，空闲的是空闲链表。
+    ULONG Prev;
+    ULONG Slot;         //所在的格，DNS_RESOLVER_NIL是不在时间轮里。
+    ULONG State;        // DNS_QUERY_*。
+    ULONGLONG Start;    //提交的时间（GetTickCount64）。
+    ULONGLONG Due;      //到期（重传或者超时）的时间。
+    DNS_RESOLVER_CALLBACK Callback;
+    PVOID Context;
+    ULONG Attempts;
+    ULONG Tcp;          // TCP连接的下标，DNS_QUERY_TCP的有效。
+    USHORT Socket;      // UDP套接字的下标。
+    USHORT Id;
+    USHORT Type;
+    USHORT Length;      //报文的长度（不包括前面的2个字节）。
+    USHORT NameLength;  //问题的名字的线上格式的长度。
+    BYTE Packet[2 + DNS_RESOLVER_PACKET]; //前2个字节是TCP的长度，UDP从Packet + 2开始发送。
+} DNS_QUERY, * PDNS_QUERY;
+
+
+typedef struct _DNS_TCP {
+    SOCKET Socket;      // INVALID_SOCKET是空闲的。
+    ULONG Query;
+    ULONG State;        // DNS_TCP_*。
+    ULONG Sent;
+    ULONG Received;     //包括前面的2个字节的长度。
+    ULONG Expected;     //应答的长度。
+    BYTE Prefix[2];
+    PBYTE Response;
+} DNS_TCP, * PDNS_TCP;
+
+
+struct _DNS_RESOLVER {
+    DNS_RESOLVER_CONFIG Config;
+    int AddressLength;
+    BOOL WsaStarted;
+    BOOL Closing;
+    SOCKET Sockets[DNS_RESOLVER_MAX_SOCKETS];
+    PDNS_QUERY Queries;
+    PUSHORT IdMap;      //下标是套接字 * 65536 + ID，值是查询的下标加1。
+    PBYTE Buffer;       // UDP的接收缓冲区。
+    ULONG Free;         //空闲链表的头。
+    ULONG Completed;    //完成的查询的个数（回绕），DnsResolverPoll用来判断有没有完成的。
+    ULONGLONG Tick;     //时间轮处理到的格（GetTickCount64() / DNS_RESOLVER_TICK）。
+    ULONG Slots[DNS_RESOLVER_SLOTS];
+    DNS_TCP Tcp[DNS_RESOLVER_MAX_TCP];
+    ULONG Random[64];   //一次取一批随机数，见ResolverRandom。
+    ULONG RandomUsed;
+    DNS_RESOLVER_INFORMATION Statistics;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static ULONG ResolverRandom(_Inout_ PDNS_RESOLVER Resolver)
+{
+    if (Resolver->RandomUsed >= _ARRAYSIZE(Resolver->Random)) {
+        if (!BCRYPT_SUCCESS(BCryptGenRandom(nullptr,
+                                            reinterpret_cast<PUCHAR>(Resolver->Random),
+                                            sizeof(Resolver->Random),
+                                            BCRYPT_USE_SYSTEM_PREFERRED_RNG))) {
+            for (int i = 0; i < _ARRAYSIZE(Resolver->Random); i++) { //不应该发生，退而求其次。
+                Resolver->Random[i] = (ULONG)(GetTickCount64() * 0x9E3779B97F4A7C15ULL >> 32) ^ (i * 0x85EBCA6B);
+            }
+        }
+
+        Resolver->RandomUsed = 0;
+    }
+
+    return Resolver->Random[Resolver->RandomUsed++];
+}
+
+
+static BOOLEAN AddressEqual(_In_ const SOCKADDR_INET * a, _In_ const SOCKADDR_INET * b)
+{
+    if (a->si_family != b->si_family) {
+        return FALSE;
+    }
+
+    if (AF_INET == a->si_family) {
+        return a->Ipv4.sin_port == b->Ipv4.sin_port && a->Ipv4.sin_addr.s_addr == b->Ipv4.sin_addr.s_addr;
+    }
+
+    return a->Ipv6.sin6_port == b->Ipv6.sin6_port &&
+           0 == memcmp(&a->Ipv6.sin6_addr, &b->Ipv6.sin6_addr, sizeof(IN6_ADDR));
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//时间轮。
+
+
+static void TimerInsert(_Inout_ PDNS_RESOLVER Resolver, _In_ ULONG Index, _In_ ULONGLONG Due)
+/*
+功能：把查询放到到期时间所在的格里（向上取整，处理到这一格时一定已经到期了）。
+*/
+{
+    PDNS_QUERY Query = &Resolver->Queries[Index];
+    ULONGLONG Tick = (Due + DNS_RESOLVER_TICK - 1) / DNS_RESOLVER_TICK;
+
+    if (Tick <= Resolver->Tick) { //已经处理过的格，放到下一格。
+        Tick = Resolver->Tick + 1;
+    }
+
+    ULONG Slot = (ULONG)(Tick % DNS_RESOLVER_SLOTS);
+
+    Query->Due = Due;
+    Query->Slot = Slot;
+    Query->Prev = DNS_RESOLVER_NIL;
+    Query->Next = Resolver->Slots[Slot];
+    if (DNS_RESOLVER_NIL != Query->Next) {
+        Resolver->Queries[Query->Next].Prev = Index;
+    }
+
+    Resolver->Slots[Slot] = Index;
+}
+
+
+static void TimerRemove(_Inout_ PDNS_RESOLVER Resolver, _In_ ULONG Index)
+{
+    PDNS_QUERY Query = &Resolver->Queries[Index];
+
+    if (DNS_RESOLVER_NIL == Query->Slot) {
+        return;
+    }
+
+    if (DNS_RESOLVER_NIL != Query->Prev) {
+        Resolver->Queries[Query->Prev].Next = Query->Next;
+    } else {
+        Resolver->Slots[Query->Slot] = Query->Next;
+    }
+
+    if (DNS_RESOLVER_NIL != Query->Next) {
+        Resolver->Queries[Query->Next].Prev = Query->Prev;
+    }
+
+    Query->Slot = DNS_RESOLVER_NIL;
+    Query->Next = DNS_RESOLVER_NIL;
+    Query->Prev = DNS_RESOLVER_NIL;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static void QueryComplete(_Inout_ PDNS_RESOLVER Resolver,
+                          _In_ ULONG Index,
+                          _In_ ULONG Status,
+                          _In_reads_bytes_opt_(Length) const BYTE * Response,
+                          _In_ ULONG Length,
+                          _In_ BOOLEAN Tcp)
+/*
+功能：结束一个查询：先释放（回调里可以提交新的查询），再调用回调。
+*/
+{
+    PDNS_QUERY Query = &Resolver->Queries[Index];
+    DNS_RESOLVER_CALLBACK Callback = Query->Callback;
+    DNS_RESOLVER_RESULT Result;
+    char Name[DNS_WIRE_MAX_NAME_TEXT];
+
+    DnsWireReadName(Query->Packet + 2, Query->Length, DNS_WIRE_HEADER_SIZE, Name, sizeof(Name), nullptr);
+
+    RtlZeroMemory(&Result, sizeof(Result));
+    Result.Context = Query->Context;
+    Result.Status = Status;
+    Result.Name = Name;
+    Result.Type = Query->Type;
+    Result.Tcp = Tcp;
+    Result.Attempts = Query->Attempts;
+    Result.Elapsed = (ULONG)(GetTickCount64() - Query->Start);
+    if (Response) {
+        Result.Rcode = Response[3] & 0xF;
+        Result.Response = Response;
+        Result.ResponseLength = Length;
+        Resolver->Statistics.Answered++;
+    }
+
+    TimerRemove(Resolver, Index);
+    Resolver->IdMap[(ULONG)Query->Socket * 0x10000 + Query->Id] = 0;
+    Query->State = DNS_QUERY_FREE;
+    Query->Next = Resolver->Free;
+    Resolver->Free = Index;
+    Resolver->Statistics.Pending--;
+    Resolver->Completed++;
+
+    if (Response && Resolver->Config.Cache) { //不可缓存的（如：SERVFAIL）会被拒绝。
+        DnsCacheInsertResponse(Resolver->Config.Cache, Response, Length);
+    }
+
+    Callback(&Result);
+}
+
+
+static BOOLEAN CacheAnswer(_Inout_ PDNS_RESOLVER Resolver,
+                           _In_ const DNS_QUERY * Query,
+                           _In_ USHORT Type,
+                           _In_ DNS_RESOLVER_CALLBACK Callback,
+                           _In_opt_ PVOID Context)
+/*
+功能：缓存里有的，直接调用回调（不占用查询）。Query里已经写好了问题，只用来取规范化的名字。
+
+缓存的应答里的TTL已经减去了经过的时间，ID是原来的查询的。
+*/
+{
+    BYTE Stack[DNS_RESOLVER_EDNS_SIZE]; //不能用Resolver->Buffer，回调里的Response可能就是它。
+    PBYTE Response = Stack;
+    ULONG Length = sizeof(Stack);
+    DNS_RESOLVER_RESULT Result;
+    char Name[DNS_WIRE_MAX_NAME_TEXT];
+
+    DnsWireReadName(Query->Packet + 2, DNS_RESOLVER_PACKET, DNS_WIRE_HEADER_SIZE, Name, sizeof(Name), nullptr);
+
+    ULONG ret = DnsCacheLookup(Resolver->Config.Cache, Name, Type, DNS_CLASS_INTERNET, Response, &Length, nullptr);
+    if (ERROR_MORE_DATA == ret) { // TCP的应答。
+        Response = reinterpret_cast<PBYTE>(MALLOC(Length));
+        if (nullptr == Response) {
+            return FALSE;
+        }
+
+        ret = DnsCacheLookup(Resolver->Config.Cache, Name, Type, DNS_CLASS_INTERNET, Response, &Length, nullptr);
+    }
+
+    BOOLEAN Hit = (ERROR_SUCCESS == ret || DNS_ERROR_RCODE_NAME_ERROR == ret || DNS_INFO_NO_RECORDS == ret) &&
+                  Length >= DNS_WIRE_HEADER_SIZE;
+    if (Hit) {
+        RtlZeroMemory(&Result, sizeof(Result));
+        Result.Context = Context;
+        Result.Status = ERROR_SUCCESS;
+        Result.Name = Name;
+        Result.Type = Type;
+        Result.Rcode = Response[3] & 0xF;
+        Result.Response = Response;
+        Result.ResponseLength = Length;
+
+        Resolver->Statistics.Submitted++;
+        Resolver->Statistics.Cached++;
+
+        Callback(&Result);
+    }
+
+    if (Response != Stack) {
+        FREE(Response);
+    }
+
+    return Hit;
+}
+
+
+static BOOLEAN ResponseMatch(_In_ const DNS_QUERY * Query,
+                             _In_reads_bytes_(Length) const BYTE * Response,
+                             _In_ ULONG Length,
+                             _In_ BOOLEAN Tcp)
+/*
+功能：应答是不是这个查询的：ID，QR，Opcode，问题（名字忽略大小写，类型，类别）。
+
+UDP的截断的应答允许后面是不完整的，其余的必须是完整的报文。
+*/
+{
+    DNS_WIRE_MESSAGE Header;
+    DNS_WIRE_RECORD Question;
+
+    ULONG ret = DnsWireParse(Response, Length, &Header, &Question, 1);
+    if (ERROR_SUCCESS != ret && ERROR_INSUFFICIENT_BUFFER != ret) {
+        if (Tcp || 0 == (Header.Flags & DNS_FLAG_TC) || 0 == Header.Records) {
+            return FALSE;
+        }
+    }
+
+    if (Header.Id != Query->Id || 0 == (Header.Flags & DNS_FLAG_QR) || 0 != ((Header.Flags >> 11) & 0xF) ||
+        1 != Header.Count[DNS_SECTION_QUESTION] || Question.Type != Query->Type ||
+        Question.Class != DNS_CLASS_INTERNET || Question.NameLength != Query->NameLength) {
+        return FALSE;
+    }
+
+    //问题的名字在报文的最前面，不会被压缩，所以直接比较线上格式（长度字节不受大小写转换的影响）。
+    const BYTE * a = Response + Question.Name;
+    const BYTE * b = Query->Packet + 2 + DNS_WIRE_HEADER_SIZE;
+    for (ULONG i = 0; i < Query->NameLength; i++) {
+        BYTE x = a[i], y = b[i];
+
+        if (x != y && ((x | 0x20) != (y | 0x20) || (x | 0x20) < 'a' || (x | 0x20) > 'z')) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+static ULONG UdpSend(_Inout_ PDNS_RESOLVER Resolver, _Inout_ PDNS_QUERY Query)
+{
+    int ret = sendto(Resolver->Sockets[Query->Socket],
+                     reinterpret_cast<const char *>(Query->Packet + 2),
+                     Query->Length,
+                     0,
+                     reinterpret_cast<const SOCKADDR *>(&Resolver->Config.Server),
+                     Resolver->AddressLength);
+
+    Query->Attempts++;
+    Resolver->Statistics.Sent++;
+
+    if (SOCKET_ERROR == ret) {
+        int Error = WSAGetLastError();
+        if (WSAEWOULDBLOCK != Error) { //发送缓冲区满了的当作丢了，靠重传。
+            return Error;
+        }
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+static ULONGLONG RetransmitTimeout(_In_ PDNS_RESOLVER Resolver, _In_ ULONG Attempts)
+{
+    return (ULONGLONG)Resolver->Config.Timeout << min(Attempts - 1, (ULONG)6);
+}
+
+
+static void TcpClose(_Inout_ PDNS_RESOLVER Resolver, _In_ ULONG Index)
+{
+    PDNS_TCP Tcp = &Resolver->Tcp[Index];
+
+    closesocket(Tcp->Socket);
+    if (Tcp->Response) {
+        FREE(Tcp->Response);
+    }
+
+    RtlZeroMemory(Tcp, sizeof(DNS_TCP));
+    Tcp->Socket = INVALID_SOCKET;
+}
+
+
+static ULONG TcpStart(_Inout_ PDNS_RESOLVER Resolver, _In_ ULONG Index, _In_ ULONGLONG Now)
+/*
+功能：截断的查询改用TCP：非阻塞地连接，之后在DnsResolverPoll里发送和接收。
+*/
+{
+    PDNS_QUERY Query = &Resolver->Queries[Index];
+    ULONG Slot = DNS_RESOLVER_NIL;
+    u_long NonBlocking = 1;
+
+    for (ULONG i = 0; i < DNS_RESOLVER_MAX_TCP; i++) {
+        if (INVALID_SOCKET == Resolver->Tcp[i].Socket) {
+            Slot = i;
+            break;
+        }
+    }
+
+    if (DNS_RESOLVER_NIL == Slot) {
+        return ERROR_BUSY;
+    }
+
+    SOCKET Socket = socket(Resolver->Config.Server.si_family, SOCK_STREAM, IPPROTO_TCP);
+    if (INVALID_SOCKET == Socket) {
+        return WSAGetLastError();
+    }
+
+    if (SOCKET_ERROR == ioctlsocket(Socket, FIONBIO, &NonBlocking) ||
+        SOCKET_ERROR == connect(Socket,
+                                reinterpret_cast<const SOCKADDR *>(&Resolver->Config.Server),
+                                Resolver->AddressLength)) {
+        int Error = WSAGetLastError();
+        if (WSAEWOULDBLOCK != Error) {
+            closesocket(Socket);
+            return Error;
+        }
+    }
+
+    PDNS_TCP Tcp = &Resolver->Tcp[Slot];
+    Tcp->Socket = Socket;
+    Tcp->Query = Index;
+    Tcp->State = DNS_TCP_CONNECTING;
+
+    Query->State = DNS_QUERY_TCP;
+    Query->Tcp = Slot;
+    TimerRemove(Resolver, Index);
+    TimerInsert(Resolver, Index, Now + 2ULL * Resolver->Config.Timeout);
+
+    Resolver->Statistics.TcpFallbacks++;
+    return ERROR_SUCCESS;
+}
+
+
+static void TcpFail(_Inout_ PDNS_RESOLVER Resolver, _In_ ULONG Index, _In_ ULONG Error)
+{
+    ULONG Query = Resolver->Tcp[Index].Query;
+
+    TcpClose(Resolver, Index);
+    QueryComplete(Resolver, Query, Error, nullptr, 0, TRUE);
+}
+
+
+static void TcpEvent(_Inout_ PDNS_RESOLVER Resolver, _In_ ULONG Index, _In_ SHORT Events)
+{
+    PDNS_TCP Tcp = &Resolver->Tcp[Index];
+    PDNS_QUERY Query = &Resolver->Queries[Tcp->Query];
+
+    if ((Events & (POLLERR | POLLHUP | POLLNVAL)) && 0 == (Events & POLLRDNORM)) {
+        int Error = 0;
+        int Size = sizeof(Error);
+
+        if (SOCKET_ERROR ==
+                getsockopt(Tcp->Socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char *>(&Error), &Size) ||
+            0 == Error) {
+            Error = WSAECONNRESET;
+        }
+
+        TcpFail(Resolver, Index, Error);
+        return;
+    }
+
+    if (DNS_TCP_CONNECTING == Tcp->State && (Events & POLLWRNORM)) {
+        Tcp->State = DNS_TCP_SENDING;
+    }
+
+    if (DNS_TCP_SENDING == Tcp->State) {
+        int ret = send(Tcp->Socket,
+                       reinterpret_cast<const char *>(Query->Packet + Tcp->Sent),
+                       2 + Query->Length - Tcp->Sent,
+                       0);
+        if (SOCKET_ERROR == ret) {
+            int Error = WSAGetLastError();
+            if (WSAEWOULDBLOCK != Error) {
+                TcpFail(Resolver, Index, Error);
+            }
+
+            return;
+        }
+
+        Tcp->Sent += ret;
+        if (Tcp->Sent == 2u + Query->Length) {
+            Tcp->State = DNS_TCP_RECEIVING;
+        }
+
+        return;
+    }
+
+    if (DNS_TCP_RECEIVING != Tcp->State || 0 == (Events & POLLRDNORM)) {
+        return;
+    }
+
+    for (;;) {
+        int ret;
+
+        if (Tcp->Received < 2) {
+            ret = recv(Tcp->Socket, reinterpret_cast<char *>(Tcp->Prefix + Tcp->Received), 2 - Tcp->Received, 0);
+        } else {
+            ret = recv(Tcp->Socket,
+                       reinterpret_cast<char *>(Tcp->Response + Tcp->Received - 2),
+                       Tcp->Expected + 2 - Tcp->Received,
+                       0);
+        }
+
+        if (0 == ret) { //应答还没有收完就断开了。
+            TcpFail(Resolver, Index, ERROR_INVALID_DATA);
+            return;
+        }
+
+        if (SOCKET_ERROR == ret) {
+            int Error = WSAGetLastError();
+            if (WSAEWOULDBLOCK != Error) {
+                TcpFail(Resolver, Index, Error);
+            }
+
+            return;
+        }
+
+        Tcp->Received += ret;
+
+        if (2 == Tcp->Received) {
+            Tcp->Expected = ReadUshort(Tcp->Prefix);
+            if (Tcp->Expected < DNS_WIRE_HEADER_SIZE) {
+                Resolver->Statistics.Mismatched++;
+                TcpFail(Resolver, Index, ERROR_INVALID_DATA);
+                return;
+            }
+
+            Tcp->Response = reinterpret_cast<PBYTE>(MALLOC(Tcp->Expected));
+            if (nullptr == Tcp->Response) {
+                TcpFail(Resolver, Index, ERROR_NOT_ENOUGH_MEMORY);
+                return;
+            }
+        }
+
+        if (Tcp->Received == Tcp->Expected + 2) {
+            break;
+        }
+    }
+
+    if (!ResponseMatch(Query, Tcp->Response, Tcp->Expected, TRUE)) {
+        Resolver->Statistics.Mismatched++;
+        TcpFail(Resolver, Index, ERROR_INVALID_DATA);
+        return;
+    }
+
+    PBYTE Response = Tcp->Response;
+    ULONG Length = Tcp->Expected;
+    ULONG QueryIndex = Tcp->Query;
+
+    Tcp->Response = nullptr;
+    TcpClose(Resolver, Index);
+    QueryComplete(Resolver, QueryIndex, ERROR_SUCCESS, Response, Length, TRUE);
+    FREE(Response);
+}
+
+
+static void UdpReceive(_Inout_ PDNS_RESOLVER Resolver, _In_ ULONG Socket, _In_ ULONGLONG Now)
+/*
+功能：读完一个套接字上所有的应答（最多一批，以免别的套接字饿死）。
+*/
+{
+    for (int n = 0; n < 1024; n++) {
+        SOCKADDR_INET From;
+        int FromLength = sizeof(From);
+
+        int Length = recvfrom(Resolver->Sockets[Socket],
+                              reinterpret_cast<char *>(Resolver->Buffer),
+                              DNS_RESOLVER_RECEIVE,
+                              0,
+                              reinterpret_cast<SOCKADDR *>(&From),
+                              &FromLength);
+        if (SOCKET_ERROR == Length) {
+            int Error = WSAGetLastError();
+            if (WSAECONNRESET == Error || WSAEMSGSIZE == Error) { //之前的发送收到了ICMP端口不可达，或者报文太大。
+                continue;
+            }
+
+            break;
+        }
+
+        if (!AddressEqual(&From, &Resolver->Config.Server) || Length < DNS_WIRE_HEADER_SIZE) {
+            Resolver->Statistics.Mismatched++;
+            continue;
+        }
+
+        USHORT Entry = Resolver->IdMap[Socket * 0x10000 + ReadUshort(Resolver->Buffer)];
+        if (0 == Entry) { //没有这个ID的查询，或者已经完成了（重传后迟到的应答）。
+            Resolver->Statistics.Mismatched++;
+            continue;
+        }
+
+        ULONG Index = Entry - 1u;
+        PDNS_QUERY Query = &Resolver->Queries[Index];
+        if (DNS_QUERY_UDP != Query->State || !ResponseMatch(Query, Resolver->Buffer, Length, FALSE)) {
+            Resolver->Statistics.Mismatched++;
+            continue;
+        }
+
+        if ((ReadUshort(Resolver->Buffer + 2) & DNS_FLAG_TC) &&
+            0 == (Resolver->Config.Flags & DNS_RESOLVER_FLAG_NO_TCP)) {
+            ULONG ret = TcpStart(Resolver, Index, Now);
+            if (ERROR_SUCCESS == ret || (ERROR_BUSY == ret && Query->Attempts < Resolver->Config.Attempts)) {
+                continue; // TCP的连接满了的等重传后再试，最后一次的返回截断的应答。
+            }
+        }
+
+        QueryComplete(Resolver, Index, ERROR_SUCCESS, Resolver->Buffer, Length, FALSE);
+    }
+}
+
+
+static void TimerAdvance(_Inout_ PDNS_RESOLVER Resolver, _In_ ULONGLONG Now)
+/*
+功能：处理到期的查询：还有次数的重传，否则超时。
+
+落后了一圈以上的只需要处理一圈（每一格都检查到期时间）。
+*/
+{
+    ULONGLONG Target = Now / DNS_RESOLVER_TICK;
+
+    if (Target <= Resolver->Tick) {
+        return;
+    }
+
+    ULONGLONG First = Target - min(Target - Resolver->Tick, (ULONGLONG)DNS_RESOLVER_SLOTS) + 1;
+
+    for (ULONGLONG t = First; t <= Target; t++) {
+        ULONG Slot = (ULONG)(t % DNS_RESOLVER_SLOTS);
+        ULONG Index = Resolver->Slots[Slot];
+
+        Resolver->Tick = t; //之后插入的（包括回调里提交的）都在后面的格里。
+
+        while (DNS_RESOLVER_NIL != Index) {
+            PDNS_QUERY Query = &Resolver->Queries[Index];
+            ULONG Next = Query->Next;
+
+            if (Query->Due <= Now) {
+                TimerRemove(Resolver, Index);
+
+                if (DNS_QUERY_UDP == Query->State && Query->Attempts < Resolver->Config.Attempts) {
+                    ULONG ret = UdpSend(Resolver, Query);
+                    if (ERROR_SUCCESS == ret) {
+                        Resolver->Statistics.Retransmits++;
+                        TimerInsert(Resolver, Index, Now + RetransmitTimeout(Resolver, Query->Attempts));
+                    } else {
+                        QueryComplete(Resolver, Index, ret, nullptr, 0, FALSE);
+                    }
+                } else {
+                    Resolver->Statistics.Timeouts++;
+
+                    if (DNS_QUERY_TCP == Query->State) {
+                        TcpClose(Resolver, Query->Tcp);
+                    }
+
+                    QueryComplete(Resolver, Index, ERROR_TIMEOUT, nullptr, 0, DNS_QUERY_TCP == Query->State);
+                }
+            }
+
+            Index = Next;
+        }
+    }
+}
+
+
+static SOCKET UdpOpen(_Inout_ PDNS_RESOLVER Resolver)
+/*
+功能：创建一个非阻塞的UDP套接字，绑定一个随机的源端口（1024-65535，被占用的换一个）。
+*/
+{
+    ADDRESS_FAMILY Family = Resolver->Config.Server.si_family;
+    SOCKET Socket = socket(Family, SOCK_DGRAM, IPPROTO_UDP);
+    u_long NonBlocking = 1;
+    int Size = 1024 * 1024;
+
+    if (INVALID_SOCKET == Socket) {
+        return INVALID_SOCKET;
+    }
+
+    if (SOCKET_ERROR == ioctlsocket(Socket, FIONBIO, &NonBlocking)) {
+        closesocket(Socket);
+        return INVALID_SOCKET;
+    }
+
+    setsockopt(Socket, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char *>(&Size), sizeof(Size)); //失败了也能用。
+
+    for (int i = 0; i <= 16; i++) {
+        SOCKADDR_INET Local;
+        USHORT Port = (i < 16) ? (USHORT)(1024 + ResolverRandom(Resolver) % (0x10000 - 1024)) : 0;
+
+        RtlZeroMemory(&Local, sizeof(Local));
+        Local.si_family = Family;
+        if (AF_INET == Family) {
+            Local.Ipv4.sin_port = htons(Port);
+        } else {
+            Local.Ipv6.sin6_port = htons(Port);
+        }
+
+        if (SOCKET_ERROR != bind(Socket, reinterpret_cast<const SOCKADDR *>(&Local), Resolver->AddressLength)) {
+            return Socket;
+        }
+    }
+
+    closesocket(Socket);
+    return INVALID_SOCKET;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DnsResolverCreate(_In_ const DNS_RESOLVER_CONFIG * Config, _Out_ PDNS_RESOLVER * Resolver)
+/*
+功能：创建异步的DNS解析器。
+
+参数：
+Config：没有设置（0）的用默认值，见DNS_RESOLVER_CONFIG。
+
+返回值：
+ERROR_SUCCESS。
+ERROR_INVALID_PARAMETER：不是IPv4或者IPv6的服务器，套接字或者查询的个数太多。
+ERROR_NOT_ENOUGH_MEMORY。
+其他：WSAStartup，socket，bind等的错误。
+
+注意：用完要调用DnsResolverDestroy。
+*/
+{
+    *Resolver = nullptr;
+
+    if ((AF_INET != Config->Server.si_family && AF_INET6 != Config->Server.si_family) ||
+        Config->Sockets > DNS_RESOLVER_MAX_SOCKETS || Config->MaxQueries > DNS_RESOLVER_MAX_QUERIES) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    ULONG ret = ERROR_SUCCESS;
+    WSADATA wsaData;
+    PDNS_RESOLVER Temp = reinterpret_cast<PDNS_RESOLVER>(MALLOC(sizeof(struct _DNS_RESOLVER)));
+    if (nullptr == Temp) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    for (int i = 0; i < _ARRAYSIZE(Temp->Sockets); i++) {
+        Temp->Sockets[i] = INVALID_SOCKET;
+    }
+
+    for (int i = 0; i < _ARRAYSIZE(Temp->Tcp); i++) {
+        Temp->Tcp[i].Socket = INVALID_SOCKET;
+    }
+
+    for (int i = 0; i < _ARRAYSIZE(Temp->Slots); i++) {
+        Temp->Slots[i] = DNS_RESOLVER_NIL;
+    }
+
+    Temp->Config = *Config;
+    Temp->Config.Sockets = Config->Sockets ? Config->Sockets : 8;
+    Temp->Config.MaxQueries = Config->MaxQueries ? Config->MaxQueries : 4096;
+    Temp->Config.Timeout = Config->Timeout ? Config->Timeout : 1000;
+    Temp->Config.Attempts = Config->Attempts ? Config->Attempts : 3;
+    if (AF_INET == Config->Server.si_family) {
+        Temp->AddressLength = sizeof(SOCKADDR_IN);
+        if (0 == Temp->Config.Server.Ipv4.sin_port) {
+            Temp->Config.Server.Ipv4.sin_port = htons(53);
+        }
+    } else {
+        Temp->AddressLength = sizeof(SOCKADDR_IN6);
+        if (0 == Temp->Config.Server.Ipv6.sin6_port) {
+            Temp->Config.Server.Ipv6.sin6_port = htons(53);
+        }
+    }
+
+    Temp->RandomUsed = _ARRAYSIZE(Temp->Random);
+    Temp->Tick = GetTickCount64() / DNS_RESOLVER_TICK;
+    Temp->Statistics.Sockets = Temp->Config.Sockets;
+
+    ret = WSAStartup(MAKEWORD(2, 2), &wsaData);
+    if (ERROR_SUCCESS != ret) {
+        goto Cleanup;
+    }
+
+    Temp->WsaStarted = TRUE;
+
+    Temp->Queries = reinterpret_cast<PDNS_QUERY>(MALLOC(Temp->Config.MaxQueries * sizeof(DNS_QUERY)));
+    Temp->IdMap = reinterpret_cast<PUSHORT>(MALLOC((SIZE_T)Temp->Config.Sockets * 0x10000 * sizeof(USHORT)));
+    Temp->Buffer = reinterpret_cast<PBYTE>(MALLOC(DNS_RESOLVER_RECEIVE));
+    if (nullptr == Temp->Queries || nullptr == Temp->IdMap || nullptr == Temp->Buffer) {
+        ret = ERROR_NOT_ENOUGH_MEMORY;
+        goto Cleanup;
+    }
+
+    Temp->Free = DNS_RESOLVER_NIL;
+    for (ULONG i = Temp->Config.MaxQueries; i-- > 0;) {
+        Temp->Queries[i].Slot = DNS_RESOLVER_NIL;
+        Temp->Queries[i].Next = Temp->Free;
+        Temp->Free = i;
+    }
+
+    for (ULONG i = 0; i < Temp->Config.Sockets; i++) {
+        Temp->Sockets[i] = UdpOpen(Temp);
+        if (INVALID_SOCKET == Temp->Sockets[i]) {
+            ret = WSAGetLastError();
+            goto Cleanup;
+        }
+    }
+
+    Temp->Statistics.Bytes = sizeof(struct _DNS_RESOLVER) + Temp->Config.MaxQueries * sizeof(DNS_QUERY) +
+                             (SIZE_T)Temp->Config.Sockets * 0x10000 * sizeof(USHORT) + DNS_RESOLVER_RECEIVE;
+
+    *Resolver = Temp;
+    Temp = nullptr;
+
+Cleanup:
+    DnsResolverDestroy(Temp);
+
+    return ret;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI DnsResolverDestroy(_In_opt_ PDNS_RESOLVER Resolver)
+/*
+功能：销毁解析器。
+
+在途的查询以ERROR_CANCELLED调用回调（这时再提交的返回ERROR_CANCELLED）。
+*/
+{
+    if (nullptr == Resolver) {
+        return;
+    }
+
+    Resolver->Closing = TRUE;
+
+    if (Resolver->Queries && Resolver->IdMap) {
+        for (ULONG i = 0; i < Resolver->Config.MaxQueries; i++) {
+            PDNS_QUERY Query = &Resolver->Queries[i];
+
+            if (DNS_QUERY_FREE != Query->State) {
+                if (DNS_QUERY_TCP == Query->State) {
+                    TcpClose(Resolver, Query->Tcp);
+                }
+
+                QueryComplete(Resolver, i, ERROR_CANCELLED, nullptr, 0, DNS_QUERY_TCP == Query->State);
+            }
+        }
+    }
+
+    for (int i = 0; i < _ARRAYSIZE(Resolver->Sockets); i++) {
+        if (INVALID_SOCKET != Resolver->Sockets[i]) {
+            closesocket(Resolver->Sockets[i]);
+        }
+    }
+
+    if (Resolver->Queries) {
+        FREE(Resolver->Queries);
+    }
+
+    if (Resolver->IdMap) {
+        FREE(Resolver->IdMap);
+    }
+
+    if (Resolver->Buffer) {
+        FREE(Resolver->Buffer);
+    }
+
+    if (Resolver->WsaStarted) {
+        WSACleanup();
+    }
+
+    FREE(Resolver);
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DnsResolverSubmit(_In_ PDNS_RESOLVER Resolver,
+                               _In_z_ PCSTR Name,
+                               _In_ USHORT Type,
+                               _In_ DNS_RESOLVER_CALLBACK Callback,
+                               _In_opt_ PVOID Context)
+/*
+功能：提交（发送）一个查询，结果在DnsResolverPoll里通过回调返回。
+
+参数：
+Name：点分的名字，如："www.example.com"，支持转义（见DnsWireReadName）。
+Type：如：DNS_TYPE_A，DNS_TYPE_AAAA，DNS_TYPE_PTR。类别是IN。
+
+返回值：
+ERROR_SUCCESS：已经发送，之后一定会调用一次回调；或者命中了缓存，已经调用了回调。
+ERROR_BUSY：在途的查询到了上限（MaxQueries），要先DnsResolverPoll。
+ERROR_INVALID_PARAMETER：名字不合法（如：空的标签，超过255字节）。
+ERROR_CANCELLED：正在销毁。
+其他：sendto的错误。
+
+除了ERROR_SUCCESS，都不会调用回调。
+*/
+{
+    if (nullptr == Name || nullptr == Callback) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    if (Resolver->Closing) {
+        return ERROR_CANCELLED;
+    }
+
+    if (DNS_RESOLVER_NIL == Resolver->Free) {
+        return ERROR_BUSY;
+    }
+
+    ULONG Index = Resolver->Free;
+    PDNS_QUERY Query = &Resolver->Queries[Index];
+    ULONG Socket = 0;
+    USHORT Id = 0;
+    int i = 0;
+
+    for (; i < 16; i++) { //同一个套接字上的ID不能重复。
+        ULONG r = ResolverRandom(Resolver);
+
+        Socket = (r >> 16) % Resolver->Config.Sockets;
+        Id = (USHORT)r;
+        if (0 == Resolver->IdMap[Socket * 0x10000 + Id]) {
+            break;
+        }
+    }
+
+    if (16 == i) {
+        return ERROR_BUSY;
+    }
+
+    DNS_WRITER Writer;
+    USHORT Flags = (Resolver->Config.Flags & DNS_RESOLVER_FLAG_NO_RECURSION) ? 0 : DNS_FLAG_RD;
+
+    DnsWriterInit(&Writer, Query->Packet + 2, DNS_RESOLVER_PACKET, Id, Flags);
+    ULONG ret = DnsWriteQuestion(&Writer, Name, Type, DNS_CLASS_INTERNET);
+    if (ERROR_SUCCESS != ret) {
+        return ret;
+    }
+
+    Query->NameLength = (USHORT)(Writer.Length - DNS_WIRE_HEADER_SIZE - 4);
+
+    if (Resolver->Config.Cache && CacheAnswer(Resolver, Query, Type, Callback, Context)) {
+        return ERROR_SUCCESS;
+    }
+
+    if (0 == (Resolver->Config.Flags & DNS_RESOLVER_FLAG_NO_EDNS)) { // OPT的类别是UDP的报文的上限。
+        DnsWriteRecord(&Writer, DNS_SECTION_ADDITIONAL, ".", DNS_TYPE_OPT, DNS_RESOLVER_EDNS_SIZE, 0, nullptr, 0);
+    }
+
+    Query->Packet[0] = (BYTE)(Writer.Length >> 8);
+    Query->Packet[1] = (BYTE)Writer.Length;
+    Query->Length = (USHORT)Writer.Length;
+    Query->Socket = (USHORT)Socket;
+    Query->Id = Id;
+    Query->Type = Type;
+    Query->Callback = Callback;
+    Query->Context = Context;
+    Query->Attempts = 0;
+    Query->Start = GetTickCount64();
+
+    ret = UdpSend(Resolver, Query);
+    if (ERROR_SUCCESS != ret) {
+        return ret;
+    }
+
+    Resolver->Free = Query->Next;
+    Query->State = DNS_QUERY_UDP;
+    Resolver->IdMap[Socket * 0x10000 + Id] = (USHORT)(Index + 1);
+    TimerInsert(Resolver, Index, Query->Start + Resolver->Config.Timeout);
+
+    Resolver->Statistics.Pending++;
+    Resolver->Statistics.Submitted++;
+
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DnsResolverPoll(_In_ PDNS_RESOLVER Resolver, _In_ ULONG Timeout, _Out_opt_ PULONG Completed)
+/*
+功能：接收应答，处理重传和超时，调用完成的查询的回调。
+
+参数：
+Timeout：最多等待的毫秒数，有查询完成了就返回。0是不等待。
+Completed：这次完成的（调用了回调的）查询的个数。
+
+返回值：ERROR_SUCCESS，或者WSAPoll的错误。没有在途的查询的立即返回。
+
+注意：要有规律地调用（间隔不要超过Timeout的配置），否则重传会推迟。
+*/
+{
+    ULONG Before = Resolver->Completed;
+    ULONGLONG Deadline = GetTickCount64() + Timeout;
+    ULONG ret = ERROR_SUCCESS;
+
+    while (Resolver->Statistics.Pending) {
+        WSAPOLLFD Fds[DNS_RESOLVER_MAX_SOCKETS + DNS_RESOLVER_MAX_TCP];
+        ULONG Map[DNS_RESOLVER_MAX_TCP];
+        ULONG Sockets = Resolver->Config.Sockets;
+        ULONG Count = 0;
+
+        for (ULONG i = 0; i < Sockets; i++) {
+            Fds[Count].fd = Resolver->Sockets[i];
+            Fds[Count].events = POLLRDNORM;
+            Fds[Count].revents = 0;
+            Count++;
+        }
+
+        for (ULONG i = 0; i < DNS_RESOLVER_MAX_TCP; i++) {
+            if (INVALID_SOCKET != Resolver->Tcp[i].Socket) {
+                Map[Count - Sockets] = i;
+                Fds[Count].fd = Resolver->Tcp[i].Socket;
+                Fds[Count].events = (DNS_TCP_RECEIVING == Resolver->Tcp[i].State) ? POLLRDNORM : POLLWRNORM;
+                Fds[Count].revents = 0;
+                Count++;
+            }
+        }
+
+        ULONGLONG Now = GetTickCount64();
+        ULONG Wait = (Now < Deadline) ? (ULONG)min(Deadline - Now, (ULONGLONG)DNS_RESOLVER_TICK) : 0;
+
+        int n = WSAPoll(Fds, Count, Wait);
+        if (SOCKET_ERROR == n) {
+            ret = WSAGetLastError();
+            break;
+        }
+
+        Now = GetTickCount64();
+
+        for (ULONG i = 0; n > 0 && i < Count; i++) {
+            if (0 == Fds[i].revents) {
+                continue;
+            }
+
+            if (i < Sockets) {
+                UdpReceive(Resolver, i, Now);
+            } else {
+                TcpEvent(Resolver, Map[i - Sockets], Fds[i].revents);
+            }
+        }
+
+        TimerAdvance(Resolver, Now);
+
+        if (Resolver->Completed != Before || Now >= Deadline) {
+            break;
+        }
+    }
+
+    if (Completed) {
+        *Completed = Resolver->Completed - Before;
+    }
+
+    return ret;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI DnsResolverQuery(_In_ PDNS_RESOLVER Resolver, _Out_ PDNS_RESOLVER_INFORMATION Information)
+/*
+功能：获取解析器的统计信息。
+*/
+{
+    *Information = Resolver->Statistics;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,96 @@
+﻿#pragma once
+
+#include "pch.h"
+#include "DnsCache.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+typedef struct _DNS_RESOLVER DNS_RESOLVER, * PDNS_RESOLVER; //异步的DNS解析器，见DnsResolverCreate。不是线程安全的。
+
+
+#define DNS_RESOLVER_FLAG_NO_TCP       0x1 //截断的应答不用TCP重新查询，直接返回（应答的头里有TC）。
+#define DNS_RESOLVER_FLAG_NO_RECURSION 0x2 //不设置RD（向权威服务器查询）。
+#define DNS_RESOLVER_FLAG_NO_EDNS      0x4 //不带OPT记录（默认带，UDP的应答的上限是DNS_RESOLVER_EDNS_SIZE）。
+
+#define DNS_RESOLVER_EDNS_SIZE 1232 // DNS Flag Day 2020推荐的大小，不会分片。
+
+
+typedef struct _DNS_RESOLVER_CONFIG {
+    SOCKADDR_INET Server; //上游的服务器（IPv4或者IPv6），端口是0的用53。
+    ULONG Sockets;        // UDP套接字的个数，每个绑定一个随机的源端口。0的用默认的（8），最多64。
+    ULONG MaxQueries;     //同时在途的查询的上限，0的用默认的（4096），最多65534。
+    ULONG Timeout;        //第一次的超时（毫秒），之后每次重传加倍，TCP的是它的两倍。0的用默认的（1000）。
+    ULONG Attempts;       // UDP的发送次数（包括第一次），0的用默认的（3）。
+    ULONG Flags;          // DNS_RESOLVER_FLAG_*。
+    PDNS_CACHE Cache;     //可选的缓存（可以和别的解析器共享），收到的应答存进去，命中的不再发送。
+} DNS_RESOLVER_CONFIG, * PDNS_RESOLVER_CONFIG;
+
+
+//一个查询的结果，见DNS_RESOLVER_CALLBACK。
+typedef struct _DNS_RESOLVER_RESULT {
+    PVOID Context;          // DnsResolverSubmit的Context。
+    ULONG Status;           // ERROR_SUCCESS（收到了应答，不论RCODE），ERROR_TIMEOUT，ERROR_CANCELLED，TCP的错误等。
+    PCSTR Name;             //查询的名字（规范化后的）。
+    USHORT Type;            //查询的类型。
+    UCHAR Rcode;            //应答的RCODE，如：DNS_RCODE_NXDOMAIN。
+    BOOLEAN Tcp;            //应答是TCP的（UDP的被截断了）。
+    ULONG Attempts;         // UDP的发送次数，命中缓存的是0。
+    ULONG Elapsed;          //从提交到完成的毫秒数。
+    const BYTE * Response;  //完整的应答（可以用DnsWireParse解析），失败的是nullptr。
+    ULONG ResponseLength;
+} DNS_RESOLVER_RESULT, * PDNS_RESOLVER_RESULT;
+
+
+//查询完成的回调，在DnsResolverPoll（或者DnsResolverDestroy）里调用，命中缓存的在DnsResolverSubmit里调用。
+// Result和里面的指针只在回调里有效。
+//回调里可以调用DnsResolverSubmit，但是不能调用DnsResolverPoll和DnsResolverDestroy。
+typedef VOID(WINAPI * DNS_RESOLVER_CALLBACK)(_In_ const DNS_RESOLVER_RESULT * Result);
+
+
+typedef struct _DNS_RESOLVER_INFORMATION {
+    ULONG Pending;        //在途的查询。
+    ULONG Sockets;
+    UINT64 Submitted;
+    UINT64 Answered;      //收到了应答的（包括TCP的）。
+    UINT64 Sent;          // UDP发送的报文（包括重传）。
+    UINT64 Retransmits;
+    UINT64 Timeouts;
+    UINT64 TcpFallbacks;  //被截断后改用TCP的。
+    UINT64 Mismatched;    //丢弃的报文：来源，ID，问题不匹配的，畸形的（可能是伪造的）。
+    UINT64 Cached;        //命中缓存的（包括在Submitted里）。
+    SIZE_T Bytes;         //占用的内存。
+} DNS_RESOLVER_INFORMATION, * PDNS_RESOLVER_INFORMATION;
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C_START
+
+
+DLLEXPORT
+ULONG WINAPI DnsResolverCreate(_In_ const DNS_RESOLVER_CONFIG * Config, _Out_ PDNS_RESOLVER * Resolver);
+
+DLLEXPORT
+void WINAPI DnsResolverDestroy(_In_opt_ PDNS_RESOLVER Resolver);
+
+DLLEXPORT
+ULONG WINAPI DnsResolverSubmit(_In_ PDNS_RESOLVER Resolver,
+                               _In_z_ PCSTR Name,
+                               _In_ USHORT Type,
+                               _In_ DNS_RESOLVER_CALLBACK Callback,
+                               _In_opt_ PVOID Context);
+
+DLLEXPORT
+ULONG WINAPI DnsResolverPoll(_In_ PDNS_RESOLVER Resolver, _In_ ULONG Timeout, _Out_opt_ PULONG Completed);
+
+DLLEXPORT
+void WINAPI DnsResolverQuery(_In_ PDNS_RESOLVER Resolver, _Out_ PDNS_RESOLVER_INFORMATION Information);
+
+
+EXTERN_C_END
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,480 @@
+﻿#include "pch.h"
+#include "DnsReverse.h"
+#include "DnsWire.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/*
+批量的反向解析（PTR），用于大量的地址（如：连接表，路由的各跳，日志）。
+
+1.去重：相同的地址（不管端口和范围ID）只查询一次，结果共享。
+2.并发：用一个异步的解析器（DnsResolver），同时在途的查询的上限是配置的MaxQueries，满了就等。
+  配置里有缓存的，命中的不再发送。
+3.结果的顺序和输入的相同，放在一块内存里（名字也在里面），用DnsReverseFree释放。
+4.in-addr.arpa和ip6.arpa的名字直接逐个字节地写，不用sprintf之类的格式化。
+
+PTR的名字取应答的回答的节里的第一个PTR记录（RFC 2317的无类别的委派是先CNAME再PTR，也能处理）。
+
+参考：
+https://www.rfc-editor.org/rfc/rfc1035#section-3.5
+https://www.rfc-editor.org/rfc/rfc3596#section-2.5
+https://www.rfc-editor.org/rfc/rfc2317
+*/
+
+
+#define DNS_REVERSE_NIL        MAXULONG
+#define DNS_REVERSE_CHUNK_SIZE (64 * 1024 - 64)
+
+
+//回调里得到的名字先存在这里（一块一块地申请），最后复制到结果里。
+typedef struct _DNS_REVERSE_CHUNK {
+    struct _DNS_REVERSE_CHUNK * Next;
+    ULONG Used;
+    CHAR Data[DNS_REVERSE_CHUNK_SIZE];
+} DNS_REVERSE_CHUNK, * PDNS_REVERSE_CHUNK;
+
+
+typedef struct _DNS_REVERSE_BATCH DNS_REVERSE_BATCH, * PDNS_REVERSE_BATCH;
+
+
+//一个不同的地址。
+typedef struct _DNS_REVERSE_SLOT {
+    PDNS_REVERSE_BATCH Batch;
+    ULONG First;        //第一次出现的下标。
+    ULONG Status;
+    PCSTR Name;
+    ULONG NameLength;
+} DNS_REVERSE_SLOT, * PDNS_REVERSE_SLOT;
+
+
+struct _DNS_REVERSE_BATCH {
+    PDNS_REVERSE_SLOT Slots;
+    ULONG Unique;
+    ULONG Completed;
+    ULONG Resolved;
+    SIZE_T NameBytes;   //所有的名字的长度（包括结尾的0）的和。
+    PDNS_REVERSE_CHUNK Chunks;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static FORCEINLINE PSTR WriteOctet(_Out_writes_(4) PSTR p, _In_ ULONG Octet)
+/*
+功能：写一个0~255的十进制数（没有前导的0）和一个点，返回后面的位置。
+*/
+{
+    if (Octet >= 100) {
+        *p++ = (CHAR)('0' + Octet / 100);
+        Octet %= 100;
+        *p++ = (CHAR)('0' + Octet / 10);
+        Octet %= 10;
+    } else if (Octet >= 10) {
+        *p++ = (CHAR)('0' + Octet / 10);
+        Octet %= 10;
+    }
+
+    *p++ = (CHAR)('0' + Octet);
+    *p++ = '.';
+    return p;
+}
+
+
+static BOOLEAN AddressEqual(_In_ const SOCKADDR_INET * a, _In_ const SOCKADDR_INET * b)
+{
+    if (a->si_family != b->si_family) {
+        return FALSE;
+    }
+
+    if (AF_INET == a->si_family) {
+        return a->Ipv4.sin_addr.s_addr == b->Ipv4.sin_addr.s_addr;
+    }
+
+    return 0 == memcmp(&a->Ipv6.sin6_addr, &b->Ipv6.sin6_addr, sizeof(IN6_ADDR));
+}
+
+
+static ULONG AddressHash(_In_ const SOCKADDR_INET * Address)
+{
+    const BYTE * p;
+    ULONG Length;
+    ULONG Hash = 0x811c9dc5; // FNV-1a。
+
+    if (AF_INET == Address->si_family) {
+        p = reinterpret_cast<const BYTE *>(&Address->Ipv4.sin_addr);
+        Length = sizeof(IN_ADDR);
+    } else {
+        p = reinterpret_cast<const BYTE *>(&Address->Ipv6.sin6_addr);
+        Length = sizeof(IN6_ADDR);
+    }
+
+    for (ULONG i = 0; i < Length; i++) {
+        Hash = (Hash ^ p[i]) * 0x01000193;
+    }
+
+    return Hash ^ (Hash >> 15);
+}
+
+
+static PCSTR BatchSaveName(_Inout_ PDNS_REVERSE_BATCH Batch, _In_reads_(Length) PCSTR Name, _In_ ULONG Length)
+{
+    PDNS_REVERSE_CHUNK Chunk = Batch->Chunks;
+
+    if (nullptr == Chunk || Chunk->Used + Length + 1 > DNS_REVERSE_CHUNK_SIZE) {
+        Chunk = reinterpret_cast<PDNS_REVERSE_CHUNK>(MALLOC(sizeof(DNS_REVERSE_CHUNK)));
+        if (nullptr == Chunk) {
+            return nullptr;
+        }
+
+        Chunk->Next = Batch->Chunks;
+        Batch->Chunks = Chunk;
+    }
+
+    PSTR Copy = Chunk->Data + Chunk->Used;
+    RtlCopyMemory(Copy, Name, Length + 1);
+    Chunk->Used += Length + 1;
+    Batch->NameBytes += Length + 1;
+    return Copy;
+}
+
+
+static VOID WINAPI ReverseCallback(_In_ const DNS_RESOLVER_RESULT * Result)
+/*
+功能：取第一个PTR记录的名字。
+
+状态：超时等的是解析器的错误；RCODE不是0的是DNS_ERROR_RESPONSE_CODES_BASE + RCODE（如：NXDOMAIN是
+DNS_ERROR_RCODE_NAME_ERROR）；没有PTR记录的是DNS_INFO_NO_RECORDS。
+*/
+{
+    PDNS_REVERSE_SLOT Slot = reinterpret_cast<PDNS_REVERSE_SLOT>(Result->Context);
+    PDNS_REVERSE_BATCH Batch = Slot->Batch;
+    DNS_WIRE_MESSAGE Header;
+    DNS_WIRE_RECORD Records[16];
+    CHAR Name[DNS_WIRE_MAX_NAME_TEXT];
+
+    Batch->Completed++;
+
+    Slot->Status = Result->Status;
+    if (ERROR_SUCCESS != Result->Status) {
+        return;
+    }
+
+    if (Result->Rcode) {
+        Slot->Status = DNS_ERROR_RESPONSE_CODES_BASE + Result->Rcode;
+        return;
+    }
+
+    ULONG ret = DnsWireParse(Result->Response, Result->ResponseLength, &Header, Records, _ARRAYSIZE(Records));
+    if (ERROR_SUCCESS != ret && ERROR_INSUFFICIENT_BUFFER != ret) {
+        Slot->Status = ret;
+        return;
+    }
+
+    Slot->Status = DNS_INFO_NO_RECORDS;
+
+    ULONG First = Header.Count[DNS_SECTION_QUESTION];
+    ULONG Last = min(First + Header.Count[DNS_SECTION_ANSWER], (ULONG)_ARRAYSIZE(Records));
+    for (ULONG i = First; i < Last; i++) {
+        if (DNS_TYPE_PTR != Records[i].Type || DNS_CLASS_INTERNET != Records[i].Class) {
+            continue;
+        }
+
+        const BYTE * Response = Result->Response;
+        ULONG Length = 0;
+
+        ret = DnsWireReadName(Response, Result->ResponseLength, Records[i].Data, Name, sizeof(Name), nullptr);
+        if (ERROR_SUCCESS == ret) {
+            Length = (ULONG)strlen(Name);
+            Slot->Name = BatchSaveName(Batch, Name, Length);
+            ret = Slot->Name ? ERROR_SUCCESS : ERROR_NOT_ENOUGH_MEMORY;
+        }
+
+        Slot->Status = ret;
+        Slot->NameLength = Length;
+        Batch->Resolved += ERROR_SUCCESS == ret;
+        break;
+    }
+}
+
+
+static ULONG BatchDedupe(_Inout_ PDNS_REVERSE_BATCH Batch,
+                         _In_reads_(Count) const SOCKADDR_INET * Addresses,
+                         _In_ ULONG Count,
+                         _Out_writes_(Count) PULONG Map)
+/*
+功能：给每个不同的地址一个Slot，Map是输入的下标到Slot的下标（不支持的地址族的是DNS_REVERSE_NIL）。
+
+开放寻址的哈希表（线性探测），大小是2的幂，至少是地址个数的两倍。
+*/
+{
+    ULONG Size = 16;
+    while (Size < Count * 2) {
+        Size *= 2;
+    }
+
+    PULONG Table = reinterpret_cast<PULONG>(MALLOC(Size * sizeof(ULONG))); //存的是Slot的下标加1，0是空的。
+    if (nullptr == Table) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    for (ULONG i = 0; i < Count; i++) {
+        const SOCKADDR_INET * Address = &Addresses[i];
+
+        Map[i] = DNS_REVERSE_NIL;
+        if (AF_INET != Address->si_family && AF_INET6 != Address->si_family) {
+            continue;
+        }
+
+        ULONG h = AddressHash(Address) & (Size - 1);
+        for (;; h = (h + 1) & (Size - 1)) {
+            if (0 == Table[h]) {
+                PDNS_REVERSE_SLOT Slot = &Batch->Slots[Batch->Unique];
+
+                Slot->Batch = Batch;
+                Slot->First = i;
+                Slot->Status = ERROR_CANCELLED; //没有提交的。
+                Table[h] = ++Batch->Unique;
+                break;
+            }
+
+            if (AddressEqual(Address, &Addresses[Batch->Slots[Table[h] - 1].First])) {
+                break;
+            }
+        }
+
+        Map[i] = Table[h] - 1;
+    }
+
+    FREE(Table);
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG BatchResolve(_Inout_ PDNS_REVERSE_BATCH Batch,
+                          _In_ const DNS_RESOLVER_CONFIG * Config,
+                          _In_ const SOCKADDR_INET * Addresses,
+                          _Out_ PDNS_RESOLVER_INFORMATION Statistics)
+/*
+功能：提交所有的查询（在途的满了就等），直到全部完成。
+*/
+{
+    PDNS_RESOLVER Resolver = nullptr;
+    CHAR Name[DNS_REVERSE_NAME_SIZE];
+    ULONG Next = 0;
+
+    RtlZeroMemory(Statistics, sizeof(DNS_RESOLVER_INFORMATION));
+
+    ULONG ret = DnsResolverCreate(Config, &Resolver);
+    if (ERROR_SUCCESS != ret) {
+        return ret;
+    }
+
+    while (Batch->Completed < Batch->Unique) {
+        while (Next < Batch->Unique) {
+            PDNS_REVERSE_SLOT Slot = &Batch->Slots[Next];
+
+            DnsReverseName(&Addresses[Slot->First], Name, sizeof(Name));
+            ULONG Status = DnsResolverSubmit(Resolver, Name, DNS_TYPE_PTR, ReverseCallback, Slot);
+            if (ERROR_BUSY == Status) {
+                break;
+            }
+
+            if (ERROR_SUCCESS != Status) {
+                Slot->Status = Status;
+                Batch->Completed++;
+            }
+
+            Next++;
+        }
+
+        ret = DnsResolverPoll(Resolver, 100, nullptr);
+        if (ERROR_SUCCESS != ret) {
+            break;
+        }
+    }
+
+    DnsResolverQuery(Resolver, Statistics);
+    DnsResolverDestroy(Resolver); //出错的时候，在途的查询在这里被取消。
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DnsReverseName(_In_ const SOCKADDR_INET * Address, _Out_writes_(Size) PSTR Name, _In_ ULONG Size)
+/*
+功能：地址对应的反向解析的名字，如：4.3.2.1.in-addr.arpa，1.0.0.0...8.b.d.0.1.0.0.2.ip6.arpa。
+
+参数：
+Size：DNS_REVERSE_NAME_SIZE就够了。
+
+返回值：名字的长度（不包括结尾的0），0是不支持的地址族或者Name太小。
+*/
+{
+    static const CHAR Hex[] = "0123456789abcdef";
+    CHAR Buffer[DNS_REVERSE_NAME_SIZE];
+    PSTR p = Buffer;
+
+    if (AF_INET == Address->si_family) {
+        const BYTE * a = reinterpret_cast<const BYTE *>(&Address->Ipv4.sin_addr);
+
+        p = WriteOctet(p, a[3]);
+        p = WriteOctet(p, a[2]);
+        p = WriteOctet(p, a[1]);
+        p = WriteOctet(p, a[0]);
+        RtlCopyMemory(p, "in-addr.arpa", sizeof("in-addr.arpa"));
+        p += sizeof("in-addr.arpa") - 1;
+    } else if (AF_INET6 == Address->si_family) {
+        const BYTE * a = reinterpret_cast<const BYTE *>(&Address->Ipv6.sin6_addr);
+
+        for (int i = 15; i >= 0; i--) { //低的半字节在前。
+            p[0] = Hex[a[i] & 0xF];
+            p[1] = '.';
+            p[2] = Hex[a[i] >> 4];
+            p[3] = '.';
+            p += 4;
+        }
+
+        RtlCopyMemory(p, "ip6.arpa", sizeof("ip6.arpa"));
+        p += sizeof("ip6.arpa") - 1;
+    } else {
+        return 0;
+    }
+
+    ULONG Length = (ULONG)(p - Buffer);
+    if (Size <= Length) {
+        return 0;
+    }
+
+    RtlCopyMemory(Name, Buffer, Length + 1);
+    return Length;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DnsReverseLookup(_In_ const DNS_RESOLVER_CONFIG * Config,
+                              _In_reads_(Count) const SOCKADDR_INET * Addresses,
+                              _In_ ULONG Count,
+                              _Out_ PDNS_REVERSE_RESULT * Result)
+/*
+功能：批量的反向解析，同步的（在调用的线程里驱动一个异步的解析器），全部完成（或者超时）了才返回。
+
+参数：
+Config：见DnsResolverCreate。MaxQueries是并发的上限，Cache是可选的缓存。
+Addresses：IPv4或者IPv6的地址（端口和范围ID被忽略），可以有重复的。其他的地址族的结果是ERROR_INVALID_PARAMETER。
+Result：和Addresses一一对应的结果，用DnsReverseFree释放。
+
+返回值：
+ERROR_SUCCESS：每个地址的结果在Entries里（包括解析失败的）。
+其他：DnsResolverCreate，WSAPoll的错误，ERROR_NOT_ENOUGH_MEMORY等，没有结果。
+
+注意：解析失败（超时，NXDOMAIN等）不是这个函数的失败，见DNS_REVERSE_ENTRY.Status。
+*/
+{
+    DNS_REVERSE_BATCH Batch;
+    DNS_RESOLVER_INFORMATION Statistics;
+    PULONG Map = nullptr;
+    PDNS_REVERSE_RESULT Temp = nullptr;
+    ULONGLONG Start = GetTickCount64();
+    ULONG ret = ERROR_SUCCESS;
+    SIZE_T Size;
+    PSTR Strings;
+
+    *Result = nullptr;
+    RtlZeroMemory(&Batch, sizeof(Batch));
+
+    if (0 == Count || Count > MAXLONG / 2) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    Map = reinterpret_cast<PULONG>(MALLOC(Count * sizeof(ULONG)));
+    Batch.Slots = reinterpret_cast<PDNS_REVERSE_SLOT>(MALLOC(Count * sizeof(DNS_REVERSE_SLOT)));
+    if (nullptr == Map || nullptr == Batch.Slots) {
+        ret = ERROR_NOT_ENOUGH_MEMORY;
+        goto Cleanup;
+    }
+
+    ret = BatchDedupe(&Batch, Addresses, Count, Map);
+    if (ERROR_SUCCESS != ret) {
+        goto Cleanup;
+    }
+
+    if (Batch.Unique) {
+        ret = BatchResolve(&Batch, Config, Addresses, &Statistics);
+        if (ERROR_SUCCESS != ret) {
+            goto Cleanup;
+        }
+    } else {
+        RtlZeroMemory(&Statistics, sizeof(Statistics));
+    }
+
+    Size = FIELD_OFFSET(DNS_REVERSE_RESULT, Entries) + Count * sizeof(DNS_REVERSE_ENTRY) + Batch.NameBytes;
+    Temp = reinterpret_cast<PDNS_REVERSE_RESULT>(MALLOC(Size));
+    if (nullptr == Temp) {
+        ret = ERROR_NOT_ENOUGH_MEMORY;
+        goto Cleanup;
+    }
+
+    Strings = reinterpret_cast<PSTR>(&Temp->Entries[Count]);
+    for (ULONG i = 0; i < Batch.Unique; i++) { //名字移到结果里。
+        PDNS_REVERSE_SLOT Slot = &Batch.Slots[i];
+
+        if (Slot->Name) {
+            RtlCopyMemory(Strings, Slot->Name, Slot->NameLength + 1);
+            Slot->Name = Strings;
+            Strings += Slot->NameLength + 1;
+        }
+    }
+
+    for (ULONG i = 0; i < Count; i++) {
+        if (DNS_REVERSE_NIL == Map[i]) {
+            Temp->Entries[i].Status = ERROR_INVALID_PARAMETER;
+        } else {
+            Temp->Entries[i].Status = Batch.Slots[Map[i]].Status;
+            Temp->Entries[i].Name = Batch.Slots[Map[i]].Name;
+        }
+    }
+
+    Temp->Count = Count;
+    Temp->Unique = Batch.Unique;
+    Temp->Resolved = Batch.Resolved;
+    Temp->Statistics = Statistics;
+    Temp->Elapsed = (ULONG)(GetTickCount64() - Start);
+
+    *Result = Temp;
+
+Cleanup:
+    while (Batch.Chunks) {
+        PDNS_REVERSE_CHUNK Next = Batch.Chunks->Next;
+        FREE(Batch.Chunks);
+        Batch.Chunks = Next;
+    }
+
+    if (Batch.Slots) {
+        FREE(Batch.Slots);
+    }
+
+    if (Map) {
+        FREE(Map);
+    }
+
+    return ret;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI DnsReverseFree(_In_opt_ PDNS_REVERSE_RESULT Result)
+{
+    if (Result) {
+        FREE(Result);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,55 @@
+﻿#pragma once
+
+#include "pch.h"
+#include "DnsResolver.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#define DNS_REVERSE_NAME_SIZE 74 // ip6.arpa的名字（32个半字节，每个带一个点，加上"ip6.arpa"）和结尾的0。
+
+
+//一个地址的反向解析的结果。
+typedef struct _DNS_REVERSE_ENTRY {
+    ULONG Status; // ERROR_SUCCESS，DNS_ERROR_RCODE_NAME_ERROR，DNS_INFO_NO_RECORDS，ERROR_TIMEOUT等。
+    PCSTR Name;   // PTR记录的名字（第一个），失败的是nullptr。相同的地址的指向同一个字符串。
+} DNS_REVERSE_ENTRY, * PDNS_REVERSE_ENTRY;
+
+
+//批量的反向解析的结果，见DnsReverseLookup。一次申请的内存，用DnsReverseFree释放。
+typedef struct _DNS_REVERSE_RESULT {
+    ULONG Count;                         //地址的个数。
+    ULONG Unique;                        //去重后的（实际查询的）个数。
+    ULONG Resolved;                      //去重后的有名字的个数。
+    ULONG Elapsed;                       //毫秒。
+    DNS_RESOLVER_INFORMATION Statistics; //解析器的统计（发送，重传，缓存命中等）。
+    DNS_REVERSE_ENTRY Entries[1];        //和输入的地址一一对应（顺序相同），共Count个。
+} DNS_REVERSE_RESULT, * PDNS_REVERSE_RESULT;
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C_START
+
+
+DLLEXPORT
+ULONG WINAPI DnsReverseName(_In_ const SOCKADDR_INET * Address,
+                            _Out_writes_(Size) PSTR Name,
+                            _In_ ULONG Size);
+
+DLLEXPORT
+ULONG WINAPI DnsReverseLookup(_In_ const DNS_RESOLVER_CONFIG * Config,
+                              _In_reads_(Count) const SOCKADDR_INET * Addresses,
+                              _In_ ULONG Count,
+                              _Out_ PDNS_REVERSE_RESULT * Result);
+
+DLLEXPORT
+void WINAPI DnsReverseFree(_In_opt_ PDNS_REVERSE_RESULT Result);
+
+
+EXTERN_C_END
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,851 @@
+﻿#include "pch.h"
+#include "DnsWire.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/*
+DNS报文（RFC 1035）的线上格式的解码和编码。不依赖DnsQuery，也不申请内存。
+
+解码：
+1.一次扫描，把报文解析为记录的索引（DNS_WIRE_RECORD），只有偏移和长度，不复制名字和数据。
+2.所有的读取都检查边界；名字支持14位的压缩指针。
+3.防止指针的环：指针只能指向当前这一段的开始之前（严格地向前），所以跳转的次数是有限的；
+  再加上展开后的长度不超过255，畸形的报文最多读取O(255)次。
+4.名字在需要时再用DnsWireReadName转换为文本，标签里的'.'，'\'和不可打印的字符会被转义。
+
+编码：
+1.DNS_WRITER在调用者的缓冲区里按节的顺序追加问题和记录，头里的个数随时更新。
+2.名字压缩：已经写过的名字的每个后缀（的偏移）存在一个小的开放寻址的哈希表里，
+  写新的名字时从最长的后缀开始找，找到的就写一个指针。哈希只用来定位，最后比较报文里的内容（忽略大小写）。
+3.写入失败（缓冲区不够等）时恢复原状，已经写入的内容仍然是一个完整的报文。
+
+参考：
+https://www.rfc-editor.org/rfc/rfc1035#section-4.1.4
+https://www.rfc-editor.org/rfc/rfc9267 （Common Implementation Anti-Patterns Related to DNS RR Processing）
+*/
+
+
+#define DNS_WIRE_MAX_MESSAGE 0xFFFF //偏移是16位的；TCP的报文也不超过这个长度。
+#define DNS_WIRE_MAX_LABEL   63
+#define DNS_WIRE_MAX_POINTER 0x3FFF //压缩指针能表示的最大偏移。
+#define DNS_WIRE_MAX_LABELS  128    //一个名字最多的标签数（255字节，每个标签至少2字节）。
+
+
+//名字的游标：逐个标签地读取报文里的名字（跟随压缩指针）。
+typedef struct _DNS_NAME_CURSOR {
+    const BYTE * Message;
+    ULONG Length;
+    ULONG Position; //下一个要读的字节。
+    ULONG Limit;    //指针只能指向这之前（当前这一段的开始）。
+    ULONG Total;    //展开后的长度（线上格式）。
+    ULONG Consumed; //名字在原处占用的字节数，遇到第一个指针或者结尾后才有效（非0）。
+} DNS_NAME_CURSOR, * PDNS_NAME_CURSOR;
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//解码。
+
+
+static FORCEINLINE BYTE DnsLower(_In_ BYTE c)
+{
+    return (c >= 'A' && c <= 'Z') ? (BYTE)(c | 0x20) : c;
+}
+
+
+static void NameCursorInit(_Out_ PDNS_NAME_CURSOR Cursor,
+                           _In_reads_bytes_(Length) const BYTE * Message,
+                           _In_ ULONG Length,
+                           _In_ ULONG Offset)
+{
+    Cursor->Message = Message;
+    Cursor->Length = Length;
+    Cursor->Position = Offset;
+    Cursor->Limit = Offset;
+    Cursor->Total = 0;
+    Cursor->Consumed = 0;
+}
+
+
+static ULONG NameCursorNext(_Inout_ PDNS_NAME_CURSOR Cursor, _Out_ const BYTE ** Label, _Out_ PULONG Size)
+/*
+功能：读取下一个标签。
+
+参数：
+Label：标签的内容（不含长度字节），指向报文里面。
+Size：标签的长度，0表示名字结束了。
+
+返回值：ERROR_SUCCESS，或者ERROR_INVALID_DATA（越界，指针的环，过长，保留的标签类型）。
+*/
+{
+    *Label = nullptr;
+    *Size = 0;
+
+    for (;;) {
+        ULONG Position = Cursor->Position;
+        if (Position >= Cursor->Length) {
+            return ERROR_INVALID_DATA;
+        }
+
+        BYTE c = Cursor->Message[Position];
+        if (0xC0 == (c & 0xC0)) {
+            if (Position + 1 >= Cursor->Length) {
+                return ERROR_INVALID_DATA;
+            }
+
+            ULONG Target = ReadUshort(Cursor->Message + Position) & DNS_WIRE_MAX_POINTER;
+            if (Target >= Cursor->Limit) { //指向自己或者后面的，可能成环。
+                return ERROR_INVALID_DATA;
+            }
+
+            if (0 == Cursor->Consumed) {
+                Cursor->Consumed = Position + 2;
+            }
+
+            Cursor->Position = Target;
+            Cursor->Limit = Target;
+            continue;
+        }
+
+        if (c & 0xC0) { // 0x40和0x80：扩展的标签（RFC 6891已废弃）。
+            return ERROR_INVALID_DATA;
+        }
+
+        Cursor->Total += 1 + c;
+        if (Cursor->Total > DNS_WIRE_MAX_NAME) {
+            return ERROR_INVALID_DATA;
+        }
+
+        if (0 == c) {
+            if (0 == Cursor->Consumed) {
+                Cursor->Consumed = Position + 1;
+            }
+
+            Cursor->Position = Position + 1;
+            return ERROR_SUCCESS;
+        }
+
+        if (Position + 1 + c > Cursor->Length) {
+            return ERROR_INVALID_DATA;
+        }
+
+        *Label = Cursor->Message + Position + 1;
+        *Size = c;
+        Cursor->Position = Position + 1 + c;
+        return ERROR_SUCCESS;
+    }
+}
+
+
+static ULONG NameSkip(_In_reads_bytes_(Length) const BYTE * Message,
+                      _In_ ULONG Length,
+                      _In_ ULONG Offset,
+                      _Out_ PULONG Consumed)
+/*
+功能：检查名字（包括跟随的指针），返回它在原处占用的字节数（相对于Offset）。
+*/
+{
+    DNS_NAME_CURSOR Cursor;
+    const BYTE * Label;
+    ULONG Size;
+
+    NameCursorInit(&Cursor, Message, Length, Offset);
+
+    do {
+        ULONG ret = NameCursorNext(&Cursor, &Label, &Size);
+        if (ERROR_SUCCESS != ret) {
+            *Consumed = 0;
+            return ret;
+        }
+    } while (Size);
+
+    *Consumed = Cursor.Consumed - Offset;
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DnsWireParse(_In_reads_bytes_(Length) const BYTE * Message,
+                          _In_ ULONG Length,
+                          _Out_ PDNS_WIRE_MESSAGE Header,
+                          _Out_writes_opt_(Capacity) PDNS_WIRE_RECORD Records,
+                          _In_ ULONG Capacity)
+/*
+功能：一次扫描地解析DNS报文，得到头和所有的问题和记录的索引。
+
+参数：
+Records：按节的顺序存放，前Header->Count[DNS_SECTION_QUESTION]个是问题，依次类推。
+Capacity：可以是0（只检查报文，得到个数）。
+
+返回值：
+ERROR_SUCCESS。
+ERROR_INSUFFICIENT_BUFFER：报文是正确的，但是Records放不下，需要的个数是Header->Records，只填写了前Capacity个。
+ERROR_INVALID_DATA：畸形的或者截断的报文（如：TC的），Header->Records是前面解析成功的个数，那些仍然可以用。
+ERROR_INVALID_PARAMETER：报文超过65535字节。
+
+注意：不检查RDATA的内容，RDATA里的名字用DnsWireReadName读取的时候再检查。
+*/
+{
+    ULONG Position = DNS_WIRE_HEADER_SIZE;
+    ULONG Index = 0;
+
+    RtlZeroMemory(Header, sizeof(DNS_WIRE_MESSAGE));
+
+    if (Length > DNS_WIRE_MAX_MESSAGE) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    if (Length < DNS_WIRE_HEADER_SIZE) {
+        return ERROR_INVALID_DATA;
+    }
+
+    Header->Id = ReadUshort(Message);
+    Header->Flags = ReadUshort(Message + 2);
+    for (int i = 0; i < _ARRAYSIZE(Header->Count); i++) {
+        Header->Count[i] = ReadUshort(Message + 4 + 2 * i);
+    }
+
+    for (ULONG Section = 0; Section < _ARRAYSIZE(Header->Count); Section++) {
+        for (ULONG k = 0; k < Header->Count[Section]; k++) {
+            DNS_WIRE_RECORD Record;
+            ULONG NameLength;
+
+            ULONG ret = NameSkip(Message, Length, Position, &NameLength);
+            if (ERROR_SUCCESS != ret) {
+                Header->Records = Index;
+                Header->Length = Position;
+                return ret;
+            }
+
+            Record.Name = (USHORT)Position;
+            Record.NameLength = (USHORT)NameLength;
+            Position += NameLength;
+
+            if (DNS_SECTION_QUESTION == Section) {
+                if (Position + 4 > Length) {
+                    Header->Records = Index;
+                    Header->Length = Record.Name;
+                    return ERROR_INVALID_DATA;
+                }
+
+                Record.Type = ReadUshort(Message + Position);
+                Record.Class = ReadUshort(Message + Position + 2);
+                Record.Ttl = 0;
+                Record.Data = 0;
+                Record.DataLength = 0;
+                Position += 4;
+            } else {
+                if (Position + 10 > Length) {
+                    Header->Records = Index;
+                    Header->Length = Record.Name;
+                    return ERROR_INVALID_DATA;
+                }
+
+                Record.Type = ReadUshort(Message + Position);
+                Record.Class = ReadUshort(Message + Position + 2);
+                Record.Ttl = ReadUlong(Message + Position + 4);
+                Record.DataLength = ReadUshort(Message + Position + 8);
+                Position += 10;
+
+                if (Position + Record.DataLength > Length) {
+                    Header->Records = Index;
+                    Header->Length = Record.Name;
+                    return ERROR_INVALID_DATA;
+                }
+
+                Record.Data = (USHORT)Position;
+                Position += Record.DataLength;
+            }
+
+            if (Records && Index < Capacity) {
+                Records[Index] = Record;
+            }
+
+            Index++;
+        }
+    }
+
+    Header->Records = Index;
+    Header->Length = Position;
+    return Index > Capacity ? ERROR_INSUFFICIENT_BUFFER : ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DnsWireReadName(_In_reads_bytes_(Length) const BYTE * Message,
+                             _In_ ULONG Length,
+                             _In_ ULONG Offset,
+                             _Out_writes_z_(Characters) PSTR Name,
+                             _In_ SIZE_T Characters,
+                             _Out_opt_ PULONG Consumed)
+/*
+功能：把报文里的名字转换为点分的文本（末尾没有点，根是"."）。
+
+参数：
+Offset：如DNS_WIRE_RECORD.Name，或者RDATA里的名字（如：CNAME，NS，PTR的RDATA，MX的RDATA + 2）。
+Characters：DNS_WIRE_MAX_NAME_TEXT肯定够用；没有转义的名字不超过254个字符。
+Consumed：名字在原处占用的字节数（相对于Offset），可以用来读取RDATA里名字之后的字段（如：SOA）。
+
+返回值：ERROR_SUCCESS，ERROR_INVALID_DATA，ERROR_INSUFFICIENT_BUFFER。失败时Name是空的字符串。
+
+注意：标签里的'.'和'\'转义为\.和\\，不可打印的字符转义为\DDD（十进制），和dig的一样。
+*/
+{
+    DNS_NAME_CURSOR Cursor;
+    const BYTE * Label;
+    ULONG Size;
+    SIZE_T k = 0;
+    ULONG ret = ERROR_SUCCESS;
+
+    if (Consumed) {
+        *Consumed = 0;
+    }
+
+    if (0 == Characters) {
+        return ERROR_INSUFFICIENT_BUFFER;
+    }
+
+    Name[0] = 0;
+
+    if (Length > DNS_WIRE_MAX_MESSAGE) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    NameCursorInit(&Cursor, Message, Length, Offset);
+
+    for (;;) {
+        ret = NameCursorNext(&Cursor, &Label, &Size);
+        if (ERROR_SUCCESS != ret || 0 == Size) {
+            break;
+        }
+
+        if (k) {
+            if (k + 1 >= Characters) {
+                ret = ERROR_INSUFFICIENT_BUFFER;
+                break;
+            }
+
+            Name[k++] = '.';
+        }
+
+        for (ULONG i = 0; i < Size && ERROR_SUCCESS == ret; i++) {
+            BYTE c = Label[i];
+
+            if (c > 0x20 && c < 0x7f && c != '.' && c != '\\') {
+                if (k + 1 >= Characters) {
+                    ret = ERROR_INSUFFICIENT_BUFFER;
+                } else {
+                    Name[k++] = (char)c;
+                }
+            } else if (c == '.' || c == '\\') {
+                if (k + 2 >= Characters) {
+                    ret = ERROR_INSUFFICIENT_BUFFER;
+                } else {
+                    Name[k++] = '\\';
+                    Name[k++] = (char)c;
+                }
+            } else {
+                if (k + 4 >= Characters) {
+                    ret = ERROR_INSUFFICIENT_BUFFER;
+                } else {
+                    Name[k++] = '\\';
+                    Name[k++] = (char)('0' + c / 100);
+                    Name[k++] = (char)('0' + c / 10 % 10);
+                    Name[k++] = (char)('0' + c % 10);
+                }
+            }
+        }
+
+        if (ERROR_SUCCESS != ret) {
+            break;
+        }
+    }
+
+    if (ERROR_SUCCESS != ret) {
+        Name[0] = 0;
+        return ret;
+    }
+
+    if (0 == k) { //根。
+        if (Characters < 2) {
+            return ERROR_INSUFFICIENT_BUFFER;
+        }
+
+        Name[k++] = '.';
+    }
+
+    Name[k] = 0;
+
+    if (Consumed) {
+        *Consumed = Cursor.Consumed - Offset;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+BOOLEAN WINAPI DnsWireNameEqual(_In_reads_bytes_(Length) const BYTE * Message,
+                                _In_ ULONG Length,
+                                _In_ ULONG Offset1,
+                                _In_ ULONG Offset2)
+/*
+功能：比较报文里的两个名字（忽略ASCII的大小写）。如：应答里的问题和记录的名字。
+
+返回值：有畸形的名字的返回FALSE。
+*/
+{
+    DNS_NAME_CURSOR Cursor1, Cursor2;
+    const BYTE * Label1, * Label2;
+    ULONG Size1, Size2;
+
+    if (Length > DNS_WIRE_MAX_MESSAGE) {
+        return FALSE;
+    }
+
+    NameCursorInit(&Cursor1, Message, Length, Offset1);
+    NameCursorInit(&Cursor2, Message, Length, Offset2);
+
+    do {
+        if (ERROR_SUCCESS != NameCursorNext(&Cursor1, &Label1, &Size1) ||
+            ERROR_SUCCESS != NameCursorNext(&Cursor2, &Label2, &Size2) || Size1 != Size2) {
+            return FALSE;
+        }
+
+        for (ULONG i = 0; i < Size1; i++) {
+            if (DnsLower(Label1[i]) != DnsLower(Label2[i])) {
+                return FALSE;
+            }
+        }
+    } while (Size1);
+
+    return TRUE;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//编码。
+
+
+//文本的名字转换后的线上格式。
+typedef struct _DNS_WIRE_NAME {
+    BYTE Wire[DNS_WIRE_MAX_NAME];
+    ULONG Size;                         //包括结尾的0。
+    ULONG Labels;                       //标签的个数，根是0。
+    UCHAR Start[DNS_WIRE_MAX_LABELS];   //每个标签（的长度字节）在Wire里的偏移。
+    ULONG Hash[DNS_WIRE_MAX_LABELS];    //从每个标签开始的后缀的哈希。
+} DNS_WIRE_NAME, * PDNS_WIRE_NAME;
+
+
+static ULONG NameEncode(_In_z_ PCSTR Text, _Out_ PDNS_WIRE_NAME Name)
+/*
+功能：点分的文本转换为线上格式，并计算每个后缀的哈希（忽略大小写）。
+
+支持末尾的点，"."和""是根；支持DnsWireReadName输出的转义（\.，\\，\DDD）。
+*/
+{
+    ULONG Size = 0;
+    ULONG Labels = 0;
+    PCSTR p = Text;
+
+    if ('.' == p[0] && 0 == p[1]) {
+        p++;
+    }
+
+    while (*p) {
+        ULONG Start = Size;
+
+        if (Labels >= DNS_WIRE_MAX_LABELS || Size + 1 >= DNS_WIRE_MAX_NAME) {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        Name->Start[Labels++] = (UCHAR)Start;
+        Size++; //长度字节，后面再填。
+
+        while (*p && *p != '.') {
+            BYTE c = (BYTE)*p++;
+
+            if ('\\' == c) {
+                if (p[0] >= '0' && p[0] <= '9' && p[1] >= '0' && p[1] <= '9' && p[2] >= '0' && p[2] <= '9') {
+                    ULONG v = (p[0] - '0') * 100 + (p[1] - '0') * 10 + (p[2] - '0');
+                    if (v > 0xFF) {
+                        return ERROR_INVALID_PARAMETER;
+                    }
+
+                    c = (BYTE)v;
+                    p += 3;
+                } else if (*p) {
+                    c = (BYTE)*p++;
+                } else {
+                    return ERROR_INVALID_PARAMETER;
+                }
+            }
+
+            if (Size - Start > DNS_WIRE_MAX_LABEL || Size + 1 >= DNS_WIRE_MAX_NAME) {
+                return ERROR_INVALID_PARAMETER;
+            }
+
+            Name->Wire[Size++] = c;
+        }
+
+        if (Size - Start == 1) { //空的标签，如："a..b"，".a"。
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        Name->Wire[Start] = (BYTE)(Size - Start - 1);
+
+        if ('.' == *p) {
+            p++;
+        }
+    }
+
+    Name->Wire[Size++] = 0;
+    Name->Size = Size;
+    Name->Labels = Labels;
+
+    ULONG Hash = 0x811c9dc5; // FNV-1a，从最后一个标签向前累积。
+    for (ULONG i = Labels; i-- > 0;) {
+        ULONG End = (i + 1 < Labels) ? Name->Start[i + 1] : Size - 1;
+
+        for (ULONG j = Name->Start[i]; j < End; j++) {
+            Hash = (Hash ^ DnsLower(Name->Wire[j])) * 0x01000193;
+        }
+
+        Name->Hash[i] = Hash;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+static BOOLEAN WriterSuffixEqual(_In_ PDNS_WRITER Writer, _In_ ULONG Offset, _In_ const BYTE * Wire)
+/*
+功能：报文里Offset处的名字是否等于Wire（线上格式，没有压缩）。
+*/
+{
+    DNS_NAME_CURSOR Cursor;
+    const BYTE * Label;
+    ULONG Size;
+
+    NameCursorInit(&Cursor, Writer->Buffer, Writer->Length, Offset);
+
+    do {
+        if (ERROR_SUCCESS != NameCursorNext(&Cursor, &Label, &Size) || Size != *Wire) {
+            return FALSE;
+        }
+
+        for (ULONG i = 0; i < Size; i++) {
+            if (DnsLower(Label[i]) != DnsLower(Wire[1 + i])) {
+                return FALSE;
+            }
+        }
+
+        Wire += 1 + Size;
+    } while (Size);
+
+    return TRUE;
+}
+
+
+static ULONG WriterWriteName(_Inout_ PDNS_WRITER Writer, _In_z_ PCSTR Text)
+/*
+功能：写入一个名字，尽量压缩，并把新写入的后缀加到哈希表里。
+*/
+{
+    DNS_WIRE_NAME Name;
+    ULONG Found = MAXULONG; //找到的后缀的偏移。
+    ULONG Labels;           //原样写入的标签的个数。
+
+    ULONG ret = NameEncode(Text, &Name);
+    if (ERROR_SUCCESS != ret) {
+        return ret;
+    }
+
+    for (Labels = 0; Labels < Name.Labels && MAXULONG == Found; Labels++) {
+        ULONG Slot = Name.Hash[Labels] % DNS_WIRE_HASH_SIZE;
+
+        for (ULONG n = 0; n < DNS_WIRE_HASH_SIZE && Writer->Hash[Slot]; n++) {
+            if (WriterSuffixEqual(Writer, Writer->Hash[Slot], Name.Wire + Name.Start[Labels])) {
+                Found = Writer->Hash[Slot];
+                break;
+            }
+
+            Slot = (Slot + 1) % DNS_WIRE_HASH_SIZE;
+        }
+    }
+
+    if (MAXULONG != Found) {
+        Labels--; //找到的那个标签及之后的用指针代替。
+    }
+
+    ULONG InPlace = (Labels < Name.Labels) ? Name.Start[Labels] : Name.Size;
+    ULONG Size = InPlace + ((MAXULONG != Found) ? 2 : 0);
+    if (Writer->Length + Size > Writer->Capacity) {
+        return ERROR_INSUFFICIENT_BUFFER;
+    }
+
+    ULONG Offset = Writer->Length;
+    RtlCopyMemory(Writer->Buffer + Offset, Name.Wire, InPlace);
+    if (MAXULONG != Found) {
+        Writer->Buffer[Offset + InPlace] = (BYTE)(0xC0 | (Found >> 8));
+        Writer->Buffer[Offset + InPlace + 1] = (BYTE)Found;
+    }
+
+    Writer->Length += Size;
+
+    for (ULONG i = 0; i < Labels && Writer->Names < DNS_WIRE_HASH_SIZE * 3 / 4; i++) {
+        ULONG Suffix = Offset + Name.Start[i];
+        if (Suffix > DNS_WIRE_MAX_POINTER) {
+            break;
+        }
+
+        ULONG Slot = Name.Hash[i] % DNS_WIRE_HASH_SIZE;
+        while (Writer->Hash[Slot]) {
+            Slot = (Slot + 1) % DNS_WIRE_HASH_SIZE;
+        }
+
+        Writer->Hash[Slot] = (USHORT)Suffix;
+        Writer->Names++;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG WriterWriteBytes(_Inout_ PDNS_WRITER Writer,
+                              _In_reads_bytes_(Size) const void * Data,
+                              _In_ ULONG Size)
+{
+    if (Writer->Length + Size > Writer->Capacity) {
+        return ERROR_INSUFFICIENT_BUFFER;
+    }
+
+    RtlCopyMemory(Writer->Buffer + Writer->Length, Data, Size);
+    Writer->Length += Size;
+    return ERROR_SUCCESS;
+}
+
+
+static void WriteUshort(_Out_writes_bytes_(2) PBYTE p, _In_ USHORT Value)
+{
+    p[0] = (BYTE)(Value >> 8);
+    p[1] = (BYTE)Value;
+}
+
+
+static void WriteUlong(_Out_writes_bytes_(4) PBYTE p, _In_ ULONG Value)
+{
+    WriteUshort(p, (USHORT)(Value >> 16));
+    WriteUshort(p + 2, (USHORT)Value);
+}
+
+
+//写入失败时恢复的状态。
+typedef struct _DNS_WRITER_STATE {
+    ULONG Length;
+    ULONG Names;
+    USHORT Hash[DNS_WIRE_HASH_SIZE];
+} DNS_WRITER_STATE, * PDNS_WRITER_STATE;
+
+
+static ULONG WriterBegin(_Inout_ PDNS_WRITER Writer, _In_ ULONG Section, _Out_ PDNS_WRITER_STATE State)
+{
+    if (Section >= 4 || Section < Writer->Section) {
+        return ERROR_INVALID_PARAMETER; //只能按节的顺序写。
+    }
+
+    if (0xFFFF == ReadUshort(Writer->Buffer + 4 + 2 * Section)) {
+        return ERROR_ARITHMETIC_OVERFLOW;
+    }
+
+    State->Length = Writer->Length;
+    State->Names = Writer->Names;
+    RtlCopyMemory(State->Hash, Writer->Hash, sizeof(State->Hash));
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG WriterEnd(_Inout_ PDNS_WRITER Writer,
+                       _In_ ULONG Section,
+                       _In_ const DNS_WRITER_STATE * State,
+                       _In_ ULONG ret)
+{
+    if (ERROR_SUCCESS != ret) {
+        Writer->Length = State->Length;
+        Writer->Names = State->Names;
+        RtlCopyMemory(Writer->Hash, State->Hash, sizeof(Writer->Hash));
+        return ret;
+    }
+
+    PBYTE Count = Writer->Buffer + 4 + 2 * Section;
+    WriteUshort(Count, ReadUshort(Count) + 1);
+    Writer->Section = Section;
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DnsWriterInit(_Out_ PDNS_WRITER Writer,
+                           _Out_writes_bytes_(Capacity) PBYTE Buffer,
+                           _In_ ULONG Capacity,
+                           _In_ USHORT Id,
+                           _In_ USHORT Flags)
+/*
+功能：开始编码一个报文，写入头（各节的个数是0）。
+
+参数：
+Capacity：如：512（UDP），或者EDNS的大小。超过65535的部分不用。
+Flags：如：0x0100是标准的递归查询（RD）。
+
+之后用DnsWriteQuestion，DnsWriteRecord等按节的顺序追加，报文的长度是Writer->Length。
+*/
+{
+    RtlZeroMemory(Writer, sizeof(DNS_WRITER));
+
+    if (Capacity < DNS_WIRE_HEADER_SIZE) {
+        return ERROR_INSUFFICIENT_BUFFER;
+    }
+
+    Writer->Buffer = Buffer;
+    Writer->Capacity = min(Capacity, (ULONG)DNS_WIRE_MAX_MESSAGE);
+
+    RtlZeroMemory(Buffer, DNS_WIRE_HEADER_SIZE);
+    WriteUshort(Buffer, Id);
+    WriteUshort(Buffer + 2, Flags);
+    Writer->Length = DNS_WIRE_HEADER_SIZE;
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DnsWriteQuestion(_Inout_ PDNS_WRITER Writer, _In_z_ PCSTR Name, _In_ USHORT Type, _In_ USHORT Class)
+/*
+功能：追加一个问题。
+
+返回值：ERROR_SUCCESS，ERROR_INSUFFICIENT_BUFFER，ERROR_INVALID_PARAMETER（名字不对，或者已经写了记录）。
+失败时报文不变。
+*/
+{
+    DNS_WRITER_STATE State;
+    BYTE Fixed[4];
+
+    ULONG ret = WriterBegin(Writer, DNS_SECTION_QUESTION, &State);
+    if (ERROR_SUCCESS != ret) {
+        return ret;
+    }
+
+    WriteUshort(Fixed, Type);
+    WriteUshort(Fixed + 2, Class);
+
+    ret = WriterWriteName(Writer, Name);
+    if (ERROR_SUCCESS == ret) {
+        ret = WriterWriteBytes(Writer, Fixed, sizeof(Fixed));
+    }
+
+    return WriterEnd(Writer, DNS_SECTION_QUESTION, &State, ret);
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DnsWriteRecord(_Inout_ PDNS_WRITER Writer,
+                            _In_ ULONG Section,
+                            _In_z_ PCSTR Name,
+                            _In_ USHORT Type,
+                            _In_ USHORT Class,
+                            _In_ ULONG Ttl,
+                            _In_reads_bytes_opt_(DataLength) const void * Data,
+                            _In_ USHORT DataLength)
+/*
+功能：追加一个资源记录，RDATA原样写入（如：A的4字节，AAAA的16字节）。
+
+参数：
+Section：DNS_SECTION_ANSWER，DNS_SECTION_AUTHORITY或者DNS_SECTION_ADDITIONAL，不能比之前写的小。
+
+注意：RDATA里有名字的（NS，CNAME，PTR）用DnsWriteNameRecord，这样也能压缩。
+*/
+{
+    DNS_WRITER_STATE State;
+    BYTE Fixed[10];
+
+    if (DNS_SECTION_QUESTION == Section || (nullptr == Data && DataLength)) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    ULONG ret = WriterBegin(Writer, Section, &State);
+    if (ERROR_SUCCESS != ret) {
+        return ret;
+    }
+
+    WriteUshort(Fixed, Type);
+    WriteUshort(Fixed + 2, Class);
+    WriteUlong(Fixed + 4, Ttl);
+    WriteUshort(Fixed + 8, DataLength);
+
+    ret = WriterWriteName(Writer, Name);
+    if (ERROR_SUCCESS == ret) {
+        ret = WriterWriteBytes(Writer, Fixed, sizeof(Fixed));
+    }
+
+    if (ERROR_SUCCESS == ret && DataLength) {
+        ret = WriterWriteBytes(Writer, Data, DataLength);
+    }
+
+    return WriterEnd(Writer, Section, &State, ret);
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI DnsWriteNameRecord(_Inout_ PDNS_WRITER Writer,
+                                _In_ ULONG Section,
+                                _In_z_ PCSTR Name,
+                                _In_ USHORT Type,
+                                _In_ USHORT Class,
+                                _In_ ULONG Ttl,
+                                _In_z_ PCSTR Target)
+/*
+功能：追加一个RDATA只是一个名字的记录（NS，CNAME，PTR，DNAME），RDATA里的名字也压缩。
+
+注意：RFC 3597要求新的类型的RDATA里的名字不压缩，这样的用DnsWriteRecord。
+*/
+{
+    DNS_WRITER_STATE State;
+    BYTE Fixed[10];
+
+    if (DNS_SECTION_QUESTION == Section) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    ULONG ret = WriterBegin(Writer, Section, &State);
+    if (ERROR_SUCCESS != ret) {
+        return ret;
+    }
+
+    WriteUshort(Fixed, Type);
+    WriteUshort(Fixed + 2, Class);
+    WriteUlong(Fixed + 4, Ttl);
+
+    ret = WriterWriteName(Writer, Name);
+    if (ERROR_SUCCESS == ret) {
+        ret = WriterWriteBytes(Writer, Fixed, sizeof(Fixed));
+    }
+
+    if (ERROR_SUCCESS == ret) {
+        ULONG Data = Writer->Length;
+
+        ret = WriterWriteName(Writer, Target);
+        if (ERROR_SUCCESS == ret) {
+            WriteUshort(Writer->Buffer + Data - 2, (USHORT)(Writer->Length - Data));
+        }
+    }
+
+    return WriterEnd(Writer, Section, &State, ret);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
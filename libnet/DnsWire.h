@@ -0,0 +1,127 @@
+﻿#pragma once
+
+#include "pch.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#define DNS_WIRE_HEADER_SIZE    12
+#define DNS_WIRE_MAX_NAME       255  //线上格式的名字的最大长度（包括长度字节和结尾的0）。
+#define DNS_WIRE_MAX_NAME_TEXT  1024 //文本格式的名字的缓冲区的上限（每个字节最多转义为\DDD），见DnsWireReadName。
+#define DNS_WIRE_HASH_SIZE      64   //编码时记住的名字（后缀）的个数的上限，用于压缩。
+
+//DNS_WIRE_MESSAGE.Count的下标，也是DnsWriteRecord的Section。
+#define DNS_SECTION_QUESTION    0
+#define DNS_SECTION_ANSWER      1
+#define DNS_SECTION_AUTHORITY   2
+#define DNS_SECTION_ADDITIONAL  3
+
+
+//报文里的一个问题或者资源记录，只有偏移和长度，不复制数据。名字用DnsWireReadName读取。
+typedef struct _DNS_WIRE_RECORD {
+    USHORT Name;       //名字在报文里的偏移。
+    USHORT NameLength; //名字在原处占用的字节数（到结尾的0或者第一个压缩指针为止）。
+    USHORT Type;       //主机序，下同。
+    USHORT Class;
+    ULONG Ttl;         //问题的是0。
+    USHORT Data;       // RDATA在报文里的偏移，问题的是0。
+    USHORT DataLength;
+} DNS_WIRE_RECORD, * PDNS_WIRE_RECORD;
+
+
+//报文的头和各节的记录的个数，见DnsWireParse。
+typedef struct _DNS_WIRE_MESSAGE {
+    USHORT Id;
+    USHORT Flags;      // QR，Opcode，AA，TC，RD，RA，Z，RCODE。
+    USHORT Count[4];   //各节的记录的个数，下标是DNS_SECTION_*。记录按节的顺序排列。
+    ULONG Records;     //总的记录的个数（问题也算）。
+    ULONG Length;      //解析到的长度，小于报文的长度说明后面还有多余的数据。
+} DNS_WIRE_MESSAGE, * PDNS_WIRE_MESSAGE;
+
+
+//编码器，见DnsWriterInit。不申请内存，可以放在栈上。
+typedef struct _DNS_WRITER {
+    PBYTE Buffer;
+    ULONG Capacity;
+    ULONG Length;      //已经写入的长度。
+    ULONG Section;     //当前的节，只能按顺序写。
+    ULONG Names;       //哈希表里的名字的个数。
+    USHORT Hash[DNS_WIRE_HASH_SIZE]; //已经写过的名字（后缀）的偏移，0是空的（偏移不会是0）。
+} DNS_WRITER, * PDNS_WRITER;
+
+
+//报文里的大端的整数（不要求对齐），DnsWire.cpp和DnsResolver.cpp用。
+FORCEINLINE USHORT ReadUshort(_In_reads_bytes_(2) const BYTE * p)
+{
+    return (USHORT)((p[0] << 8) | p[1]);
+}
+
+
+FORCEINLINE ULONG ReadUlong(_In_reads_bytes_(4) const BYTE * p)
+{
+    return ((ULONG)p[0] << 24) | ((ULONG)p[1] << 16) | ((ULONG)p[2] << 8) | p[3];
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C_START
+
+
+DLLEXPORT
+ULONG WINAPI DnsWireParse(_In_reads_bytes_(Length) const BYTE * Message,
+                          _In_ ULONG Length,
+                          _Out_ PDNS_WIRE_MESSAGE Header,
+                          _Out_writes_opt_(Capacity) PDNS_WIRE_RECORD Records,
+                          _In_ ULONG Capacity);
+
+DLLEXPORT
+ULONG WINAPI DnsWireReadName(_In_reads_bytes_(Length) const BYTE * Message,
+                             _In_ ULONG Length,
+                             _In_ ULONG Offset,
+                             _Out_writes_z_(Characters) PSTR Name,
+                             _In_ SIZE_T Characters,
+                             _Out_opt_ PULONG Consumed);
+
+DLLEXPORT
+BOOLEAN WINAPI DnsWireNameEqual(_In_reads_bytes_(Length) const BYTE * Message,
+                                _In_ ULONG Length,
+                                _In_ ULONG Offset1,
+                                _In_ ULONG Offset2);
+
+DLLEXPORT
+ULONG WINAPI DnsWriterInit(_Out_ PDNS_WRITER Writer,
+                           _Out_writes_bytes_(Capacity) PBYTE Buffer,
+                           _In_ ULONG Capacity,
+                           _In_ USHORT Id,
+                           _In_ USHORT Flags);
+
+DLLEXPORT
+ULONG WINAPI DnsWriteQuestion(_Inout_ PDNS_WRITER Writer, _In_z_ PCSTR Name, _In_ USHORT Type, _In_ USHORT Class);
+
+DLLEXPORT
+ULONG WINAPI DnsWriteRecord(_Inout_ PDNS_WRITER Writer,
+                            _In_ ULONG Section,
+                            _In_z_ PCSTR Name,
+                            _In_ USHORT Type,
+                            _In_ USHORT Class,
+                            _In_ ULONG Ttl,
+                            _In_reads_bytes_opt_(DataLength) const void * Data,
+                            _In_ USHORT DataLength);
+
+DLLEXPORT
+ULONG WINAPI DnsWriteNameRecord(_Inout_ PDNS_WRITER Writer,
+                                _In_ ULONG Section,
+                                _In_z_ PCSTR Name,
+                                _In_ USHORT Type,
+                                _In_ USHORT Class,
+                                _In_ ULONG Ttl,
+                                _In_z_ PCSTR Target);
+
+
+EXTERN_C_END
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,976 @@
+﻿#include "pch.h"
+#include "Fragment.h"
+#include "Dissector.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/*
+IPv4/IPv6的分片和重组。
+
+分片（IpFragment）：
+把一个组好的以太帧按MTU切开，每个分片的头（以太头，IP头，IPv6的分片头）写到调用者提供的缓冲区里，
+负载直接指向原来的帧，不复制。结果是PACKET_SEGMENT（WSABUF的布局）的列表，可以直接用于分散/聚集的发送。
+
+重组（IpReassembler*）：
+1.按(源地址，目的地址，标识，协议)找数据报，哈希表和所有的缓冲区在创建时一次分配好，内存是有上限的。
+2.每个数据报从第一个分片到达时开始计时，超时的被丢弃；表满时淘汰最老的。
+3.用位图（8字节一块）记录收到的部分，所以能发现重叠和重复，重叠的按创建时指定的策略处理。
+4.重组好的数据报（第一个分片的头 + 负载）在内部的缓冲区里是连续的，直接返回指针，不再复制。
+
+注意：
+1.IPv4的DF会被清除（分片后的DF没有意义）；第一个分片之外的只带有复制标志的选项。
+2.IPv6的分片头插在不可分片的部分（Hop-by-Hop，Routing以及它之前的Destination Options）之后。
+3.重组器不是线程安全的，多线程请每个线程一个，或者自己加锁。
+*/
+
+
+#define REASSEMBLY_PAYLOAD_SIZE 0x10000
+#define REASSEMBLY_BITMAP_WORDS (REASSEMBLY_PAYLOAD_SIZE / 8 / 64)
+#define REASSEMBLY_NIL          MAXULONG
+
+
+typedef struct _REASSEMBLY_KEY {
+    BYTE Source[16];      // IPv4的只用前4个字节，其余是0。
+    BYTE Destination[16];
+    UINT32 Id;
+    UINT8 IpVersion;
+    UINT8 Protocol;       // IPv4头里的协议，或者IPv6的分片头里的Next Header。
+    UINT16 Reserved;
+} REASSEMBLY_KEY, * PREASSEMBLY_KEY;
+
+static_assert(sizeof(REASSEMBLY_KEY) == 40, "REASSEMBLY_KEY不应该有填充。");
+
+
+typedef struct _FRAGMENT_INFO {
+    ULONG L3Offset;
+    ULONG HeaderLength;     //以太头 + 不可分片的部分（不包括IPv6的分片头）。
+    ULONG NextHeaderOffset; // IPv6：指向分片头的那个Next Header字段（相对于帧），重组时改回原来的协议。
+    ULONG PayloadOffset;    //相对于帧。
+    ULONG PayloadLength;
+    ULONG Offset;           //这个分片在数据报里的偏移（字节）。
+    bool More;
+} FRAGMENT_INFO, * PFRAGMENT_INFO;
+
+
+typedef struct _REASSEMBLY_ENTRY {
+    REASSEMBLY_KEY Key;
+    UINT64 Deadline;
+    ULONG HashNext;     //同一个桶的下一个，或者空闲链表的下一个。
+    ULONG Older;        //按创建的顺序（也是超时的顺序）的双向链表。
+    ULONG Newer;
+    ULONG L3Offset;
+    ULONG HeaderLength; //第一个分片的头（放在负载的前面），0表示第一个分片还没到。
+    ULONG TotalLength;  //负载的长度，最后一个分片到了才知道，0表示还不知道。
+    ULONG MaxEnd;       //已经收到的负载的最大的结尾。
+    ULONG Received;     //已经收到的块数。
+    UINT64 Bitmap[REASSEMBLY_BITMAP_WORDS];
+    PBYTE Buffer;       // IP_FRAGMENT_HEADER_SIZE的头 + REASSEMBLY_PAYLOAD_SIZE的负载。
+} REASSEMBLY_ENTRY, * PREASSEMBLY_ENTRY;
+
+
+struct _IP_REASSEMBLER {
+    ULONG MaxDatagrams;
+    ULONG Timeout;
+    ULONG OverlapPolicy;
+    ULONG BucketMask;
+    UINT64 Seed;
+    ULONG FreeList;
+    ULONG Oldest;
+    ULONG Newest;
+    ULONG Completed; //上次返回的数据报，下次调用时才释放。
+    IP_REASSEMBLY_STATISTICS Statistics;
+    PULONG Buckets;
+    PREASSEMBLY_ENTRY Entries;
+    PBYTE Buffers;
+};
+
+
+static FORCEINLINE UINT16 ReadUint16(const BYTE * p)
+{
+    return (UINT16)((p[0] << 8) | p[1]);
+}
+
+
+static FORCEINLINE UINT32 ReadUint32(const BYTE * p)
+{
+    return ((UINT32)p[0] << 24) | ((UINT32)p[1] << 16) | ((UINT32)p[2] << 8) | p[3];
+}
+
+
+static FORCEINLINE void WriteUint16(PBYTE p, UINT16 Value)
+{
+    p[0] = (BYTE)(Value >> 8);
+    p[1] = (BYTE)Value;
+}
+
+
+static FORCEINLINE void WriteUint32(PBYTE p, UINT32 Value)
+{
+    WriteUint16(p, (UINT16)(Value >> 16));
+    WriteUint16(p + 2, (UINT16)Value);
+}
+
+
+static void SetIpv4Checksum(PBYTE Ip, ULONG HeaderLength)
+{
+    Ip[10] = 0;
+    Ip[11] = 0;
+    *reinterpret_cast<UINT16 *>(Ip + 10) = (UINT16)~ChecksumFold(ChecksumPartial(Ip, HeaderLength));
+}
+
+
+static bool WalkIpv6Extensions(_In_reads_bytes_(Length) const BYTE * Ip,
+                               _In_ ULONG Length,
+                               _Out_ PULONG Unfragmentable,
+                               _Out_ PULONG NextHeaderOffset,
+                               _Out_ bool * HasFragment)
+/*
+功能：找出IPv6包的不可分片部分（RFC 8200 4.5）。
+
+参数：
+Unfragmentable：IPv6头和不可分片的扩展头的长度。有分片头的，分片头就在这里。
+NextHeaderOffset：指向Unfragmentable处的那个Next Header字段的偏移（相对于IPv6头）。
+
+返回值：扩展头被截断了返回false。
+*/
+{
+    ULONG Current = sizeof(IPV6_HEADER);
+    ULONG NextHeaderField = offsetof(IPV6_HEADER, NextHeader);
+
+    *Unfragmentable = Current;
+    *NextHeaderOffset = NextHeaderField;
+    *HasFragment = false;
+
+    for (;;) {
+        UINT8 NextHeader = Ip[NextHeaderField];
+
+        if (IPPROTO_FRAGMENT == NextHeader) {
+            *Unfragmentable = Current; //分片头之前的都是不可分片的（包括Destination Options）。
+            *NextHeaderOffset = NextHeaderField;
+            *HasFragment = true;
+            return true;
+        }
+
+        if (IPPROTO_HOPOPTS != NextHeader && IPPROTO_ROUTING != NextHeader && IPPROTO_DSTOPTS != NextHeader) {
+            return true;
+        }
+
+        if (Length - Current < 8) {
+            return false;
+        }
+
+        ULONG ExtensionLength = (Ip[Current + 1] + 1) * 8;
+        if (Length - Current < ExtensionLength) {
+            return false;
+        }
+
+        NextHeaderField = Current;
+        Current += ExtensionLength;
+
+        if (IPPROTO_DSTOPTS != NextHeader) { // Destination Options只有后面还有Routing时才是不可分片的。
+            *Unfragmentable = Current;
+            *NextHeaderOffset = NextHeaderField;
+        }
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static ULONG FragmentIpv4(const BYTE * Frame,
+                          ULONG L3Offset,
+                          ULONG Available,
+                          ULONG Mtu,
+                          PBYTE HeaderSlab,
+                          SIZE_T HeaderSlabSize,
+                          PIP_FRAGMENT Fragments,
+                          PULONG Count)
+{
+    const BYTE * Ip = Frame + L3Offset;
+    ULONG HeaderLength = (Ip[0] & 0x0f) * 4;
+    ULONG TotalLength = ReadUint16(Ip + 2);
+
+    if (TotalLength > Available) {
+        return ERROR_INVALID_DATA;
+    }
+
+    //第一个分片之外的只带有复制标志的选项。
+    BYTE Options[40]{};
+    ULONG OptionsLength = 0;
+    for (ULONG i = sizeof(IPV4_HEADER); i < HeaderLength;) {
+        UINT8 Type = Ip[i];
+        if (0 == Type) { // EOL
+            break;
+        }
+
+        if (1 == Type) { // NOP
+            i++;
+            continue;
+        }
+
+        if (HeaderLength - i < 2 || Ip[i + 1] < 2 || HeaderLength - i < Ip[i + 1]) {
+            return ERROR_INVALID_DATA;
+        }
+
+        if (Type & 0x80) {
+            RtlCopyMemory(Options + OptionsLength, Ip + i, Ip[i + 1]);
+            OptionsLength += Ip[i + 1];
+        }
+
+        i += Ip[i + 1];
+    }
+
+    ULONG OtherHeaderLength = sizeof(IPV4_HEADER) + ((OptionsLength + 3) & ~3);
+    ULONG DataLength = TotalLength - HeaderLength;
+
+    if (Mtu < HeaderLength + 8) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    ULONG FirstMax = (Mtu - HeaderLength) & ~7;
+    ULONG OtherMax = (Mtu - OtherHeaderLength) & ~7;
+    ULONG Needed = 1 + (DataLength > FirstMax ? (DataLength - FirstMax + OtherMax - 1) / OtherMax : 0);
+
+    if (*Count < Needed || HeaderSlabSize < (SIZE_T)Needed * IP_FRAGMENT_HEADER_SIZE) {
+        *Count = Needed;
+        return ERROR_INSUFFICIENT_BUFFER;
+    }
+
+    ULONG Offset = 0;
+    for (ULONG i = 0; i < Needed; i++) {
+        PBYTE Header = HeaderSlab + (SIZE_T)i * IP_FRAGMENT_HEADER_SIZE;
+        ULONG IpHeaderLength = 0 == i ? HeaderLength : OtherHeaderLength;
+        ULONG Length = 0 == i ? FirstMax : OtherMax;
+        bool More = DataLength - Offset > Length;
+        if (!More) {
+            Length = DataLength - Offset;
+        }
+
+        RtlCopyMemory(Header, Frame, (SIZE_T)L3Offset + (0 == i ? HeaderLength : sizeof(IPV4_HEADER)));
+        PBYTE FragmentIp = Header + L3Offset;
+        if (i) {
+            RtlCopyMemory(FragmentIp + sizeof(IPV4_HEADER), Options, OtherHeaderLength - sizeof(IPV4_HEADER));
+            FragmentIp[0] = (BYTE)((4 << 4) | (OtherHeaderLength / 4));
+        }
+
+        WriteUint16(FragmentIp + 2, (UINT16)(IpHeaderLength + Length));
+        WriteUint16(FragmentIp + 6, (UINT16)((ReadUint16(Ip + 6) & 0x8000) | (More ? 0x2000 : 0) | (Offset / 8)));
+        SetIpv4Checksum(FragmentIp, IpHeaderLength);
+
+        Fragments[i].Header.Buffer = Header;
+        Fragments[i].Header.Length = L3Offset + IpHeaderLength;
+        Fragments[i].Payload.Buffer = Ip + HeaderLength + Offset;
+        Fragments[i].Payload.Length = Length;
+
+        Offset += Length;
+    }
+
+    *Count = Needed;
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG FragmentIpv6(const BYTE * Frame,
+                          ULONG L3Offset,
+                          ULONG Available,
+                          ULONG Mtu,
+                          UINT32 Identification,
+                          PBYTE HeaderSlab,
+                          SIZE_T HeaderSlabSize,
+                          PIP_FRAGMENT Fragments,
+                          PULONG Count)
+{
+    const BYTE * Ip = Frame + L3Offset;
+    ULONG TotalLength = sizeof(IPV6_HEADER) + ReadUint16(Ip + 4);
+
+    if (TotalLength > Available) {
+        return ERROR_INVALID_DATA;
+    }
+
+    ULONG Unfragmentable, NextHeaderOffset;
+    bool HasFragment;
+    if (!WalkIpv6Extensions(Ip, TotalLength, &Unfragmentable, &NextHeaderOffset, &HasFragment)) {
+        return ERROR_INVALID_DATA;
+    }
+
+    if (HasFragment) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    ULONG HeaderLength = Unfragmentable + sizeof(IPV6_FRAGMENT_HEADER);
+    if (L3Offset + HeaderLength > IP_FRAGMENT_HEADER_SIZE) {
+        return ERROR_NOT_SUPPORTED;
+    }
+
+    if (Mtu < HeaderLength + 8) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    ULONG DataLength = TotalLength - Unfragmentable;
+    ULONG MaxLength = (Mtu - HeaderLength) & ~7;
+    ULONG Needed = (DataLength + MaxLength - 1) / MaxLength;
+
+    if (*Count < Needed || HeaderSlabSize < (SIZE_T)Needed * IP_FRAGMENT_HEADER_SIZE) {
+        *Count = Needed;
+        return ERROR_INSUFFICIENT_BUFFER;
+    }
+
+    ULONG Offset = 0;
+    for (ULONG i = 0; i < Needed; i++) {
+        PBYTE Header = HeaderSlab + (SIZE_T)i * IP_FRAGMENT_HEADER_SIZE;
+        ULONG Length = DataLength - Offset > MaxLength ? MaxLength : DataLength - Offset;
+        bool More = Offset + Length < DataLength;
+
+        RtlCopyMemory(Header, Frame, (SIZE_T)L3Offset + Unfragmentable);
+        PBYTE FragmentIp = Header + L3Offset;
+        PBYTE FragmentHeader = FragmentIp + Unfragmentable;
+
+        FragmentHeader[0] = FragmentIp[NextHeaderOffset];
+        FragmentHeader[1] = 0;
+        WriteUint16(FragmentHeader + 2, (UINT16)(Offset | (More ? 1 : 0)));
+        WriteUint32(FragmentHeader + 4, Identification);
+
+        FragmentIp[NextHeaderOffset] = IPPROTO_FRAGMENT;
+        WriteUint16(FragmentIp + 4, (UINT16)(HeaderLength - sizeof(IPV6_HEADER) + Length));
+
+        Fragments[i].Header.Buffer = Header;
+        Fragments[i].Header.Length = L3Offset + HeaderLength;
+        Fragments[i].Payload.Buffer = Ip + Unfragmentable + Offset;
+        Fragments[i].Payload.Length = Length;
+
+        Offset += Length;
+    }
+
+    *Count = Needed;
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI IpFragment(_In_reads_bytes_(Size) const BYTE * Frame, //以太帧，如：PacketizeSyn4等组装的。
+                        _In_ SIZE_T Size,
+                        _In_ ULONG Mtu,              // IP包（不包括以太头）的最大长度，如：1500。
+                        _In_ UINT32 Identification, // IPv6分片头里的标识。IPv4的用IP头里的Identification。
+                        _Out_writes_bytes_(HeaderSlabSize) PBYTE HeaderSlab,
+                        _In_ SIZE_T HeaderSlabSize, //至少是分片数 * IP_FRAGMENT_HEADER_SIZE。
+                        _Out_writes_(*Count) PIP_FRAGMENT Fragments,
+                        _Inout_ PULONG Count)       //输入是Fragments的个数，输出是分片的个数。
+/*
+功能：把一个IPv4/IPv6的帧按MTU分片，负载不复制。
+
+不需要分片的，返回一个分片：头和负载都指向原来的帧，不使用HeaderSlab。
+
+返回值：
+ERROR_SUCCESS。
+ERROR_INSUFFICIENT_BUFFER：Fragments或者HeaderSlab不够，*Count是需要的分片的个数。
+ERROR_INVALID_PARAMETER：已经是分片了，或者MTU太小（放不下IP头和8字节的数据）。
+ERROR_NOT_SUPPORTED：IPv6的不可分片的扩展头太长了。
+其他：DissectPacket的错误。
+
+注意：Fragments里的指针指向Frame和HeaderSlab，发送完之前它们都要有效。
+*/
+{
+    if (Size > MAXUINT32) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    PACKET_INFO Info;
+    ULONG ret = DissectPacket(Frame, Size, &Info);
+    if (ERROR_SUCCESS != ret) {
+        return ret;
+    }
+
+    if (!(Info.Layers & (PACKET_LAYER_IPV4 | PACKET_LAYER_IPV6))) {
+        return ERROR_NOT_SUPPORTED;
+    }
+
+    if (Info.Layers & PACKET_LAYER_FRAGMENT) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    const BYTE * Ip = Frame + Info.L3Offset;
+    ULONG Available = (ULONG)Size - Info.L3Offset;
+    ULONG TotalLength = 4 == Info.IpVersion ? ReadUint16(Ip + 2) : sizeof(IPV6_HEADER) + ReadUint16(Ip + 4);
+
+    if (TotalLength <= Mtu && TotalLength <= Available) {
+        if (0 == *Count) {
+            *Count = 1;
+            return ERROR_INSUFFICIENT_BUFFER;
+        }
+
+        Fragments[0].Header.Buffer = Frame;
+        Fragments[0].Header.Length = Info.L3Offset + Info.L3Length;
+        Fragments[0].Payload.Buffer = Frame + Info.L3Offset + Info.L3Length;
+        Fragments[0].Payload.Length = TotalLength - Info.L3Length;
+        *Count = 1;
+        return ERROR_SUCCESS;
+    }
+
+    if (4 == Info.IpVersion) {
+        return FragmentIpv4(Frame, Info.L3Offset, Available, Mtu, HeaderSlab, HeaderSlabSize, Fragments, Count);
+    } else {
+        return FragmentIpv6(
+            Frame, Info.L3Offset, Available, Mtu, Identification, HeaderSlab, HeaderSlabSize, Fragments, Count);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static ULONG ParseFragment(const BYTE * Frame, SIZE_T Size, PREASSEMBLY_KEY Key, PFRAGMENT_INFO Fragment)
+/*
+功能：取出分片的键和位置。
+
+以太头和VLAN用DissectPacket处理。第一个分片的L4可能不完整，所以不看它的返回值，只要IP层解析了就行。
+*/
+{
+    PACKET_INFO Info;
+    ULONG ret = DissectPacket(Frame, Size, &Info);
+    if (!(Info.Layers & (PACKET_LAYER_IPV4 | PACKET_LAYER_IPV6))) {
+        return ERROR_SUCCESS == ret ? ERROR_INVALID_PARAMETER : ret;
+    }
+
+    const BYTE * Ip = Frame + Info.L3Offset;
+    ULONG Available = (ULONG)Size - Info.L3Offset;
+
+    RtlZeroMemory(Key, sizeof(REASSEMBLY_KEY));
+    RtlZeroMemory(Fragment, sizeof(FRAGMENT_INFO));
+    Key->IpVersion = Info.IpVersion;
+    Fragment->L3Offset = Info.L3Offset;
+
+    if (4 == Info.IpVersion) {
+        ULONG HeaderLength = (Ip[0] & 0x0f) * 4;
+        ULONG TotalLength = ReadUint16(Ip + 2);
+        if (TotalLength > Available) {
+            return ERROR_INSUFFICIENT_BUFFER; //截断的分片没法重组。
+        }
+
+        UINT16 FlagsAndOffset = ReadUint16(Ip + 6);
+        if (0 == (FlagsAndOffset & 0x3fff)) {
+            return ERROR_INVALID_PARAMETER; //不是分片。
+        }
+
+        RtlCopyMemory(Key->Source, Ip + offsetof(IPV4_HEADER, SourceAddress), sizeof(IN_ADDR));
+        RtlCopyMemory(Key->Destination, Ip + offsetof(IPV4_HEADER, DestinationAddress), sizeof(IN_ADDR));
+        Key->Id = ReadUint16(Ip + 4);
+        Key->Protocol = Ip[9];
+
+        Fragment->HeaderLength = Info.L3Offset + HeaderLength;
+        Fragment->PayloadOffset = Fragment->HeaderLength;
+        Fragment->PayloadLength = TotalLength - HeaderLength;
+        Fragment->Offset = (FlagsAndOffset & 0x1fff) * 8;
+        Fragment->More = (FlagsAndOffset & 0x2000) != 0;
+    } else {
+        ULONG TotalLength = sizeof(IPV6_HEADER) + ReadUint16(Ip + 4);
+        if (TotalLength > Available) {
+            return ERROR_INSUFFICIENT_BUFFER;
+        }
+
+        ULONG Unfragmentable, NextHeaderOffset;
+        bool HasFragment;
+        if (!WalkIpv6Extensions(Ip, TotalLength, &Unfragmentable, &NextHeaderOffset, &HasFragment)) {
+            return ERROR_INVALID_DATA;
+        }
+
+        if (!HasFragment) {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        if (TotalLength - Unfragmentable < sizeof(IPV6_FRAGMENT_HEADER)) {
+            return ERROR_INVALID_DATA;
+        }
+
+        const BYTE * FragmentHeader = Ip + Unfragmentable;
+        UINT16 OffsetAndFlags = ReadUint16(FragmentHeader + 2);
+
+        RtlCopyMemory(Key->Source, Ip + offsetof(IPV6_HEADER, SourceAddress), sizeof(IN6_ADDR));
+        RtlCopyMemory(Key->Destination, Ip + offsetof(IPV6_HEADER, DestinationAddress), sizeof(IN6_ADDR));
+        Key->Id = ReadUint32(FragmentHeader + 4);
+        Key->Protocol = FragmentHeader[0];
+
+        //原子分片（RFC 6946，偏移是0，没有M）也走这里，一个分片就完整了。
+        Fragment->HeaderLength = Info.L3Offset + Unfragmentable;
+        Fragment->NextHeaderOffset = Info.L3Offset + NextHeaderOffset;
+        Fragment->PayloadOffset = Fragment->HeaderLength + sizeof(IPV6_FRAGMENT_HEADER);
+        Fragment->PayloadLength = TotalLength - Unfragmentable - sizeof(IPV6_FRAGMENT_HEADER);
+        Fragment->Offset = OffsetAndFlags & 0xfff8;
+        Fragment->More = (OffsetAndFlags & 1) != 0;
+    }
+
+    if (Fragment->HeaderLength > IP_FRAGMENT_HEADER_SIZE) {
+        return ERROR_NOT_SUPPORTED;
+    }
+
+    if (0 == Fragment->PayloadLength || (Fragment->More && (Fragment->PayloadLength & 7)) ||
+        Fragment->Offset + Fragment->PayloadLength > MAXUINT16) {
+        return ERROR_INVALID_DATA;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+static FORCEINLINE ULONG HashKey(const REASSEMBLY_KEY * Key, UINT64 Seed)
+{
+    UINT64 Hash = Seed;
+
+    for (SIZE_T i = 0; i < sizeof(REASSEMBLY_KEY); i += sizeof(UINT64)) {
+        UINT64 Word;
+        RtlCopyMemory(&Word, reinterpret_cast<const BYTE *>(Key) + i, sizeof(Word));
+        Hash = (Hash ^ Word) * 0x9e3779b97f4a7c15ULL;
+        Hash ^= Hash >> 29;
+    }
+
+    return (ULONG)(Hash ^ (Hash >> 32));
+}
+
+
+static FORCEINLINE ULONG PopCount64(UINT64 Value)
+{
+    return __popcnt((UINT32)Value) + __popcnt((UINT32)(Value >> 32));
+}
+
+
+static ULONG BitmapCount(const UINT64 * Bitmap, ULONG First, ULONG Last)
+/*
+功能：[First, Last]之间已经置位的块数。
+*/
+{
+    ULONG Count = 0;
+
+    for (ULONG Word = First / 64; Word <= Last / 64; Word++) {
+        ULONG Low = Word == First / 64 ? First % 64 : 0;
+        ULONG High = Word == Last / 64 ? Last % 64 : 63;
+        UINT64 Mask = (MAXUINT64 >> (63 - High)) & (MAXUINT64 << Low);
+        Count += PopCount64(Bitmap[Word] & Mask);
+    }
+
+    return Count;
+}
+
+
+static ULONG BitmapSet(UINT64 * Bitmap, ULONG First, ULONG Last)
+/*
+功能：把[First, Last]之间的块置位，返回新置位的块数。
+*/
+{
+    ULONG Count = 0;
+
+    for (ULONG Word = First / 64; Word <= Last / 64; Word++) {
+        ULONG Low = Word == First / 64 ? First % 64 : 0;
+        ULONG High = Word == Last / 64 ? Last % 64 : 63;
+        UINT64 Mask = (MAXUINT64 >> (63 - High)) & (MAXUINT64 << Low);
+        Count += PopCount64(~Bitmap[Word] & Mask);
+        Bitmap[Word] |= Mask;
+    }
+
+    return Count;
+}
+
+
+static void UnlinkEntry(PIP_REASSEMBLER Reassembler, ULONG Index)
+/*
+功能：从哈希表和超时链表里摘掉，但不放回空闲链表。
+*/
+{
+    PREASSEMBLY_ENTRY Entry = &Reassembler->Entries[Index];
+    PULONG Link = &Reassembler->Buckets[HashKey(&Entry->Key, Reassembler->Seed) & Reassembler->BucketMask];
+
+    while (*Link != Index) {
+        Link = &Reassembler->Entries[*Link].HashNext;
+    }
+
+    *Link = Entry->HashNext;
+
+    if (REASSEMBLY_NIL == Entry->Older) {
+        Reassembler->Oldest = Entry->Newer;
+    } else {
+        Reassembler->Entries[Entry->Older].Newer = Entry->Newer;
+    }
+
+    if (REASSEMBLY_NIL == Entry->Newer) {
+        Reassembler->Newest = Entry->Older;
+    } else {
+        Reassembler->Entries[Entry->Newer].Older = Entry->Older;
+    }
+
+    Reassembler->Statistics.InUse--;
+}
+
+
+static void FreeEntry(PIP_REASSEMBLER Reassembler, ULONG Index)
+{
+    Reassembler->Entries[Index].HashNext = Reassembler->FreeList;
+    Reassembler->FreeList = Index;
+}
+
+
+static void ExpireEntries(PIP_REASSEMBLER Reassembler, UINT64 Now)
+{
+    while (REASSEMBLY_NIL != Reassembler->Oldest && Reassembler->Entries[Reassembler->Oldest].Deadline <= Now) {
+        ULONG Index = Reassembler->Oldest;
+        UnlinkEntry(Reassembler, Index);
+        FreeEntry(Reassembler, Index);
+        Reassembler->Statistics.Timeouts++;
+    }
+}
+
+
+static ULONG AllocateEntry(PIP_REASSEMBLER Reassembler, const REASSEMBLY_KEY * Key, ULONG Hash, UINT64 Now)
+{
+    if (REASSEMBLY_NIL == Reassembler->FreeList) {
+        ULONG Oldest = Reassembler->Oldest;
+        UnlinkEntry(Reassembler, Oldest);
+        FreeEntry(Reassembler, Oldest);
+        Reassembler->Statistics.Evictions++;
+    }
+
+    ULONG Index = Reassembler->FreeList;
+    PREASSEMBLY_ENTRY Entry = &Reassembler->Entries[Index];
+    Reassembler->FreeList = Entry->HashNext;
+
+    RtlCopyMemory(&Entry->Key, Key, sizeof(REASSEMBLY_KEY));
+    Entry->Deadline = Now + Reassembler->Timeout;
+    Entry->HeaderLength = 0;
+    Entry->TotalLength = 0;
+    Entry->MaxEnd = 0;
+    Entry->Received = 0;
+    RtlZeroMemory(Entry->Bitmap, sizeof(Entry->Bitmap));
+
+    PULONG Bucket = &Reassembler->Buckets[Hash & Reassembler->BucketMask];
+    Entry->HashNext = *Bucket;
+    *Bucket = Index;
+
+    Entry->Older = Reassembler->Newest;
+    Entry->Newer = REASSEMBLY_NIL;
+    if (REASSEMBLY_NIL == Reassembler->Newest) {
+        Reassembler->Oldest = Index;
+    } else {
+        Reassembler->Entries[Reassembler->Newest].Newer = Index;
+    }
+    Reassembler->Newest = Index;
+
+    Reassembler->Statistics.InUse++;
+
+    return Index;
+}
+
+
+static void CopyMissingBlocks(PREASSEMBLY_ENTRY Entry, const BYTE * Data, ULONG Offset, ULONG End)
+/*
+功能：只复制还没有收到的块（先到的优先）。
+*/
+{
+    PBYTE Payload = Entry->Buffer + IP_FRAGMENT_HEADER_SIZE;
+
+    for (ULONG Block = Offset / 8; Block <= (End - 1) / 8; Block++) {
+        if (Entry->Bitmap[Block / 64] & (1ULL << (Block % 64))) {
+            continue;
+        }
+
+        ULONG Start = Block * 8;
+        ULONG Stop = Start + 8 < End ? Start + 8 : End;
+        RtlCopyMemory(Payload + Start, Data + (Start - Offset), Stop - Start);
+    }
+}
+
+
+static bool FinishDatagram(PREASSEMBLY_ENTRY Entry)
+/*
+功能：把第一个分片的头改成完整的数据报的头。
+
+返回值：数据报超过了IP的最大长度返回false。
+*/
+{
+    PBYTE Header = Entry->Buffer + IP_FRAGMENT_HEADER_SIZE - Entry->HeaderLength;
+    PBYTE Ip = Header + Entry->L3Offset;
+    ULONG IpHeaderLength = Entry->HeaderLength - Entry->L3Offset;
+
+    if (4 == Entry->Key.IpVersion) {
+        if (IpHeaderLength + Entry->TotalLength > MAXUINT16) {
+            return false;
+        }
+
+        WriteUint16(Ip + 2, (UINT16)(IpHeaderLength + Entry->TotalLength));
+        WriteUint16(Ip + 6, ReadUint16(Ip + 6) & ~0x3fff);
+        SetIpv4Checksum(Ip, IpHeaderLength);
+    } else {
+        if (IpHeaderLength - sizeof(IPV6_HEADER) + Entry->TotalLength > MAXUINT16) {
+            return false;
+        }
+
+        WriteUint16(Ip + 4, (UINT16)(IpHeaderLength - sizeof(IPV6_HEADER) + Entry->TotalLength));
+    }
+
+    return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI IpReassemblerDestroy(_In_ PIP_REASSEMBLER Reassembler)
+{
+    if (nullptr == Reassembler) {
+        return;
+    }
+
+    if (Reassembler->Buffers) {
+        FREE(Reassembler->Buffers);
+    }
+
+    if (Reassembler->Entries) {
+        FREE(Reassembler->Entries);
+    }
+
+    if (Reassembler->Buckets) {
+        FREE(Reassembler->Buckets);
+    }
+
+    FREE(Reassembler);
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI IpReassemblerCreate(_In_ ULONG MaxDatagrams, //同时重组的数据报的个数，不超过IP_REASSEMBLY_MAX_DATAGRAMS。
+                                 _In_ ULONG Timeout,      //毫秒，从第一个分片到达时算起。如：30000。
+                                 _In_ ULONG OverlapPolicy, // IP_REASSEMBLY_OVERLAP_*。
+                                 _Out_ PIP_REASSEMBLER * Reassembler)
+/*
+功能：创建IP分片的重组器。
+
+所有的内存（每个数据报64KB多）在这里一次分配好，之后重组时不再分配。
+
+注意：用完要调用IpReassemblerDestroy。
+*/
+{
+    *Reassembler = nullptr;
+
+    if (0 == MaxDatagrams || MaxDatagrams > IP_REASSEMBLY_MAX_DATAGRAMS || 0 == Timeout ||
+        OverlapPolicy > IP_REASSEMBLY_OVERLAP_LAST) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    ULONG ret = ERROR_SUCCESS;
+    ULONG BucketCount = 1;
+    PIP_REASSEMBLER Temp = reinterpret_cast<PIP_REASSEMBLER>(MALLOC(sizeof(struct _IP_REASSEMBLER)));
+    if (nullptr == Temp) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    while (BucketCount < MaxDatagrams * 2) {
+        BucketCount *= 2;
+    }
+
+    Temp->MaxDatagrams = MaxDatagrams;
+    Temp->Timeout = Timeout;
+    Temp->OverlapPolicy = OverlapPolicy;
+    Temp->BucketMask = BucketCount - 1;
+    Temp->Oldest = REASSEMBLY_NIL;
+    Temp->Newest = REASSEMBLY_NIL;
+    Temp->Completed = REASSEMBLY_NIL;
+
+    Temp->Buckets = reinterpret_cast<PULONG>(MALLOC(BucketCount * sizeof(ULONG)));
+    Temp->Entries = reinterpret_cast<PREASSEMBLY_ENTRY>(MALLOC(MaxDatagrams * sizeof(REASSEMBLY_ENTRY)));
+    Temp->Buffers = reinterpret_cast<PBYTE>(
+        MALLOC((SIZE_T)MaxDatagrams * (IP_FRAGMENT_HEADER_SIZE + REASSEMBLY_PAYLOAD_SIZE)));
+    if (nullptr == Temp->Buckets || nullptr == Temp->Entries || nullptr == Temp->Buffers) {
+        ret = ERROR_NOT_ENOUGH_MEMORY;
+        goto Cleanup;
+    }
+
+    //哈希的种子是随机的，以免别人构造冲突的分片。
+    if (!BCRYPT_SUCCESS(BCryptGenRandom(nullptr,
+                                        reinterpret_cast<PUCHAR>(&Temp->Seed),
+                                        sizeof(Temp->Seed),
+                                        BCRYPT_USE_SYSTEM_PREFERRED_RNG))) {
+        ret = ERROR_GEN_FAILURE;
+        goto Cleanup;
+    }
+
+    for (ULONG i = 0; i < BucketCount; i++) {
+        Temp->Buckets[i] = REASSEMBLY_NIL;
+    }
+
+    Temp->FreeList = REASSEMBLY_NIL;
+    for (ULONG i = MaxDatagrams; i-- > 0;) {
+        Temp->Entries[i].Buffer = Temp->Buffers + (SIZE_T)i * (IP_FRAGMENT_HEADER_SIZE + REASSEMBLY_PAYLOAD_SIZE);
+        FreeEntry(Temp, i);
+    }
+
+    *Reassembler = Temp;
+    Temp = nullptr;
+
+Cleanup:
+    IpReassemblerDestroy(Temp);
+
+    return ret;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI IpReassemblerAdd(_In_ PIP_REASSEMBLER Reassembler,
+                              _In_reads_bytes_(Size) const BYTE * Frame, //以太帧。
+                              _In_ SIZE_T Size,
+                              _In_ UINT64 Now, //毫秒，0表示用GetTickCount64。抓包文件里的用报文的时间戳。
+                              _Out_ const BYTE ** Datagram,
+                              _Out_ PSIZE_T DatagramSize)
+/*
+功能：加入一个分片，数据报完整了就返回重组好的帧。
+
+重组好的帧的以太头和IP头来自第一个分片（IPv6的去掉了分片头），负载是所有分片的数据。
+
+返回值：
+ERROR_SUCCESS：重组完成，见Datagram和DatagramSize。
+ERROR_IO_PENDING：分片已经保存，数据报还不完整。
+ERROR_INVALID_PARAMETER：不是IP分片。
+ERROR_INVALID_DATA：畸形的分片，或者按IP_REASSEMBLY_OVERLAP_DROP丢弃了整个数据报。
+ERROR_INSUFFICIENT_BUFFER：分片被截断了（如：抓包的snaplen）。
+ERROR_NOT_SUPPORTED：头太长了（超过IP_FRAGMENT_HEADER_SIZE）。
+
+注意：Datagram指向重组器内部的缓冲区，下次调用IpReassemblerAdd或者IpReassemblerDestroy之前有效。
+*/
+{
+    *Datagram = nullptr;
+    *DatagramSize = 0;
+
+    if (REASSEMBLY_NIL != Reassembler->Completed) {
+        FreeEntry(Reassembler, Reassembler->Completed);
+        Reassembler->Completed = REASSEMBLY_NIL;
+    }
+
+    if (0 == Now) {
+        Now = GetTickCount64();
+    }
+
+    ExpireEntries(Reassembler, Now);
+
+    if (Size > MAXUINT32) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    REASSEMBLY_KEY Key;
+    FRAGMENT_INFO Fragment;
+    ULONG ret = ParseFragment(Frame, Size, &Key, &Fragment);
+    if (ERROR_INVALID_DATA == ret) {
+        Reassembler->Statistics.Malformed++;
+    }
+
+    if (ERROR_SUCCESS != ret) {
+        return ret;
+    }
+
+    Reassembler->Statistics.Fragments++;
+
+    ULONG Hash = HashKey(&Key, Reassembler->Seed);
+    ULONG Index = Reassembler->Buckets[Hash & Reassembler->BucketMask];
+    while (REASSEMBLY_NIL != Index && 0 != memcmp(&Reassembler->Entries[Index].Key, &Key, sizeof(Key))) {
+        Index = Reassembler->Entries[Index].HashNext;
+    }
+
+    if (REASSEMBLY_NIL == Index) {
+        Index = AllocateEntry(Reassembler, &Key, Hash, Now);
+    }
+
+    PREASSEMBLY_ENTRY Entry = &Reassembler->Entries[Index];
+    ULONG End = Fragment.Offset + Fragment.PayloadLength;
+
+    //和已知的结尾矛盾的，整个数据报都不可信了。
+    if ((Entry->TotalLength && (End > Entry->TotalLength || (!Fragment.More && End != Entry->TotalLength))) ||
+        (!Fragment.More && Entry->MaxEnd > End)) {
+        UnlinkEntry(Reassembler, Index);
+        FreeEntry(Reassembler, Index);
+        Reassembler->Statistics.Malformed++;
+        return ERROR_INVALID_DATA;
+    }
+
+    ULONG First = Fragment.Offset / 8;
+    ULONG Last = (End - 1) / 8;
+    ULONG Present = BitmapCount(Entry->Bitmap, First, Last);
+    const BYTE * Data = Frame + Fragment.PayloadOffset;
+    PBYTE Payload = Entry->Buffer + IP_FRAGMENT_HEADER_SIZE;
+
+    if (0 == Present) {
+        RtlCopyMemory(Payload + Fragment.Offset, Data, Fragment.PayloadLength);
+    } else if (Present == Last - First + 1) {
+        Reassembler->Statistics.Duplicates++;
+        if (IP_REASSEMBLY_OVERLAP_LAST == Reassembler->OverlapPolicy) {
+            RtlCopyMemory(Payload + Fragment.Offset, Data, Fragment.PayloadLength);
+        }
+    } else {
+        Reassembler->Statistics.Overlaps++;
+
+        switch (Reassembler->OverlapPolicy) {
+        case IP_REASSEMBLY_OVERLAP_FIRST:
+            CopyMissingBlocks(Entry, Data, Fragment.Offset, End);
+            break;
+        case IP_REASSEMBLY_OVERLAP_LAST:
+            RtlCopyMemory(Payload + Fragment.Offset, Data, Fragment.PayloadLength);
+            break;
+        default:
+            UnlinkEntry(Reassembler, Index);
+            FreeEntry(Reassembler, Index);
+            return ERROR_INVALID_DATA;
+        }
+    }
+
+    Entry->Received += BitmapSet(Entry->Bitmap, First, Last);
+
+    if (End > Entry->MaxEnd) {
+        Entry->MaxEnd = End;
+    }
+
+    if (!Fragment.More) {
+        Entry->TotalLength = End;
+    }
+
+    if (0 == Fragment.Offset && 0 == Entry->HeaderLength) { //第一个分片的头放在负载的前面。
+        PBYTE Header = Payload - Fragment.HeaderLength;
+        RtlCopyMemory(Header, Frame, Fragment.HeaderLength);
+        if (6 == Key.IpVersion) {
+            Header[Fragment.NextHeaderOffset] = Key.Protocol;
+        }
+
+        Entry->L3Offset = Fragment.L3Offset;
+        Entry->HeaderLength = Fragment.HeaderLength;
+    }
+
+    if (0 == Entry->TotalLength || 0 == Entry->HeaderLength || Entry->Received != (Entry->TotalLength + 7) / 8) {
+        return ERROR_IO_PENDING;
+    }
+
+    UnlinkEntry(Reassembler, Index);
+
+    if (!FinishDatagram(Entry)) {
+        FreeEntry(Reassembler, Index);
+        Reassembler->Statistics.Malformed++;
+        return ERROR_INVALID_DATA;
+    }
+
+    Reassembler->Completed = Index;
+    Reassembler->Statistics.Datagrams++;
+
+    *Datagram = Payload - Entry->HeaderLength;
+    *DatagramSize = (SIZE_T)Entry->HeaderLength + Entry->TotalLength;
+
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI IpReassemblerGetStatistics(_In_ PIP_REASSEMBLER Reassembler,
+                                       _Out_ PIP_REASSEMBLY_STATISTICS Statistics)
+{
+    RtlCopyMemory(Statistics, &Reassembler->Statistics, sizeof(IP_REASSEMBLY_STATISTICS));
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
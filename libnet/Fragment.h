@@ -0,0 +1,84 @@
+﻿#pragma once
+
+#include "pch.h"
+#include "raw.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+//IpFragment的结果：一个分片由两段组成，头在调用者提供的缓冲区里，负载指向原来的包（不复制）。
+//两个成员都是PACKET_SEGMENT（WSABUF的布局），所以可以当作两个WSABUF的数组直接发送。
+typedef struct _IP_FRAGMENT {
+    PACKET_SEGMENT Header;  //以太头（包括VLAN）+ IP头（IPv6的包括不可分片的扩展头和分片头）。
+    PACKET_SEGMENT Payload; //这个分片的数据。
+} IP_FRAGMENT, * PIP_FRAGMENT;
+
+//IpFragment的头缓冲区里每个分片占的大小。
+#define IP_FRAGMENT_HEADER_SIZE 256
+
+
+//IpReassemblerCreate的重叠策略。
+#define IP_REASSEMBLY_OVERLAP_DROP  0 //丢弃整个数据报（RFC 5722），完全重复的分片除外。
+#define IP_REASSEMBLY_OVERLAP_FIRST 1 //保留先到的数据。
+#define IP_REASSEMBLY_OVERLAP_LAST  2 //用后到的数据覆盖。
+
+#define IP_REASSEMBLY_MAX_DATAGRAMS 4096 //同时重组的数据报的个数的上限，每个占64KB多。
+
+typedef struct _IP_REASSEMBLER IP_REASSEMBLER, * PIP_REASSEMBLER;
+
+typedef struct _IP_REASSEMBLY_STATISTICS {
+    UINT64 Fragments;  //收到的分片。
+    UINT64 Datagrams;  //重组完成的数据报。
+    UINT64 Timeouts;   //超时丢弃的数据报。
+    UINT64 Evictions;  //表满时淘汰的（最老的）数据报。
+    UINT64 Overlaps;   //部分重叠的分片。
+    UINT64 Duplicates; //完全重复的分片。
+    UINT64 Malformed;  //畸形的分片（长度不是8的倍数，超过64KB，和已知的结尾矛盾等）。
+    UINT32 InUse;      //正在重组的数据报。
+    UINT32 Reserved;
+} IP_REASSEMBLY_STATISTICS, * PIP_REASSEMBLY_STATISTICS;
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C_START
+
+
+DLLEXPORT
+ULONG WINAPI IpFragment(_In_reads_bytes_(Size) const BYTE * Frame,
+                        _In_ SIZE_T Size,
+                        _In_ ULONG Mtu,
+                        _In_ UINT32 Identification,
+                        _Out_writes_bytes_(HeaderSlabSize) PBYTE HeaderSlab,
+                        _In_ SIZE_T HeaderSlabSize,
+                        _Out_writes_(*Count) PIP_FRAGMENT Fragments,
+                        _Inout_ PULONG Count);
+
+DLLEXPORT
+ULONG WINAPI IpReassemblerCreate(_In_ ULONG MaxDatagrams,
+                                 _In_ ULONG Timeout,
+                                 _In_ ULONG OverlapPolicy,
+                                 _Out_ PIP_REASSEMBLER * Reassembler);
+
+DLLEXPORT
+ULONG WINAPI IpReassemblerAdd(_In_ PIP_REASSEMBLER Reassembler,
+                              _In_reads_bytes_(Size) const BYTE * Frame,
+                              _In_ SIZE_T Size,
+                              _In_ UINT64 Now,
+                              _Out_ const BYTE ** Datagram,
+                              _Out_ PSIZE_T DatagramSize);
+
+DLLEXPORT
+void WINAPI IpReassemblerGetStatistics(_In_ PIP_REASSEMBLER Reassembler,
+                                       _Out_ PIP_REASSEMBLY_STATISTICS Statistics);
+
+DLLEXPORT
+void WINAPI IpReassemblerDestroy(_In_ PIP_REASSEMBLER Reassembler);
+
+
+EXTERN_C_END
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
@@ -9,6 +9,30 @@
 int _cdecl special_ip();
 
 
+//CidrIteratorInit的顺序。
+#define CIDR_ORDER_SEQUENTIAL 0 //依次加一。
+#define CIDR_ORDER_STRIDED    1 //按（奇数的）步长跳跃，回绕，每个地址恰好一次。
+#define CIDR_ORDER_SHUFFLED   2 //由种子决定的伪随机的排列，每个地址恰好一次。
+
+//CidrIteratorInit的标志。
+#define CIDR_FLAG_HOST_ORDER 0x1 // IPv4的结果是主机序的UINT32，默认是网络序（IN_ADDR）。
+
+
+//CIDR的枚举器，见CidrIteratorInit。不申请内存，可以直接复制和保存。
+typedef struct _CIDR_ITERATOR {
+    ADDRESS_FAMILY Family; // AF_INET或者AF_INET6。
+    UINT8 PrefixLength;
+    UINT8 HostBits;        //主机部分的位数，地址的个数是2^HostBits。IPv4的最多32，IPv6的最多64。
+    ULONG Order;           // CIDR_ORDER_*。
+    ULONG Flags;           // CIDR_FLAG_*。
+    BOOLEAN Exhausted;     //已经枚举完了。
+    UINT64 Offset;         //下一个地址的序号（从0开始），可以保存下来，之后用CidrIteratorSeek继续。
+    UINT64 Mask;           // 2^HostBits - 1。
+    UINT64 Base[2];        //网络地址（主机序），Base[0]是IPv6的高64位，IPv4的只用Base[1]的低32位。
+    UINT64 Key[5];         //步长，起点或者排列的参数。
+} CIDR_ITERATOR, * PCIDR_ITERATOR;
+
+
 EXTERN_C_START
 
 
@@ -18,5 +42,56 @@ void WINAPI EnumIPv4ByMask(const char * ipv4, const char * mask);
 DLLEXPORT
 void WINAPI EnumIPv4ByMasks(const char * ipv4, BYTE mask);
 
+DLLEXPORT
+ULONG WINAPI CidrIteratorInit(_Out_ PCIDR_ITERATOR Iterator,
+                              _In_ ADDRESS_FAMILY Family,
+                              _In_ const void * Address,
+                              _In_ UINT8 PrefixLength,
+                              _In_ ULONG Order,
+                              _In_ UINT64 Parameter,
+                              _In_ ULONG Flags);
+
+DLLEXPORT
+ULONG WINAPI CidrIteratorInitFromString(_Out_ PCIDR_ITERATOR Iterator,
+                                        _In_z_ PCSTR Cidr,
+                                        _In_ ULONG Order,
+                                        _In_ UINT64 Parameter,
+                                        _In_ ULONG Flags);
+
+DLLEXPORT
+ULONG WINAPI CidrIteratorNext(_Inout_ PCIDR_ITERATOR Iterator,
+                              _Out_ PVOID Addresses,
+                              _In_ ULONG Capacity,
+                              _Out_ PULONG Count);
+
+DLLEXPORT
+ULONG WINAPI CidrIteratorSeek(_Inout_ PCIDR_ITERATOR Iterator, _In_ UINT64 Offset);
+
+DLLEXPORT
+ULONG WINAPI ParseIPv4Batch(_In_reads_(Count) const PCSTR * Strings,
+                            _In_ ULONG Count,
+                            _Out_writes_(Count) PIN_ADDR Addresses,
+                            _Out_writes_opt_(Count) PBOOLEAN Valid);
+
+DLLEXPORT
+ULONG WINAPI ParseIPv6Batch(_In_reads_(Count) const PCSTR * Strings,
+                            _In_ ULONG Count,
+                            _Out_writes_(Count) PIN6_ADDR Addresses,
+                            _Out_writes_opt_(Count) PBOOLEAN Valid);
+
+DLLEXPORT
+ULONG WINAPI FormatIPv4Batch(_In_reads_(Count) const IN_ADDR * Addresses,
+                             _In_ ULONG Count,
+                             _Out_writes_bytes_(Count * Stride) PSTR Buffer,
+                             _In_ SIZE_T Stride,
+                             _Out_writes_opt_(Count) PULONG Lengths);
+
+DLLEXPORT
+ULONG WINAPI FormatIPv6Batch(_In_reads_(Count) const IN6_ADDR * Addresses,
+                             _In_ ULONG Count,
+                             _Out_writes_bytes_(Count * Stride) PSTR Buffer,
+                             _In_ SIZE_T Stride,
+                             _Out_writes_opt_(Count) PULONG Lengths);
+
 
 EXTERN_C_END
@@ -0,0 +1,355 @@
+﻿#include "pch.h"
+#include "IpClass.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/*
+地址的分类：把任意的IPv4/IPv6地址映射到IANA的特殊用途地址的类别（回环，私网，CGNAT，文档，组播的范围，Teredo等）。
+
+用途：给连接表（netstat的导出等）的每个地址打标签，数量大，所以不能逐个地址地走一串if。
+
+实现：
+1.前缀的列表（按长度排序）在编译时（constexpr）生成一个每层8位的多位trie，IPv4的二十几个表，IPv6的五十几个表，
+  每个表256字节，都在L1缓存里。
+2.表项：0表示沿用这个表的默认的类别（建子表时从父表项继承，所以建表不需要填满整个表），
+  1~0x7f是类别 + 1，0x80 | i表示下一层是第i个表。
+3.查找：每层一次查表，没有比较。大部分的IPv4地址一次（第一个字节）就能确定，
+  特殊的前缀最多4层（IPv4）和16层（IPv6的/128）。
+4.IPv6的组播按范围（第二个字节的低4位）分类，展开成ff00::/8下的256个/16。
+
+参考：
+https://www.iana.org/assignments/iana-ipv4-special-registry/iana-ipv4-special-registry.xhtml
+https://www.iana.org/assignments/iana-ipv6-special-registry/iana-ipv6-special-registry.xhtml
+RFC 4291，RFC 7346（IPv6组播的范围），RFC 2365（IPv4的管理范围的组播）。
+*/
+
+
+#define IP_CLASS_TABLE_FLAG 0x80
+
+
+struct IpClassPrefix {
+    BYTE Address[16]; //网络序，没写的是0。
+    UINT8 PrefixLength;
+    UINT8 Class;
+};
+
+
+struct IpClassInformation {
+    PCSTR Name;
+    ULONG Flags;
+};
+
+
+//下标是IP_CLASS_*。
+static constexpr IpClassInformation IpClassTable[IP_CLASS_COUNT] = {
+    {"global", IP_CLASS_FLAG_GLOBAL},
+    {"unspecified", 0},
+    {"loopback", IP_CLASS_FLAG_LOCAL},
+    {"private", IP_CLASS_FLAG_PRIVATE},
+    {"shared", IP_CLASS_FLAG_PRIVATE},
+    {"link-local", IP_CLASS_FLAG_LOCAL},
+    {"unique-local", IP_CLASS_FLAG_PRIVATE},
+    {"site-local", IP_CLASS_FLAG_PRIVATE | IP_CLASS_FLAG_DEPRECATED},
+    {"documentation", 0},
+    {"benchmarking", 0},
+    {"protocol", 0},
+    {"as112", IP_CLASS_FLAG_GLOBAL},
+    {"amt", IP_CLASS_FLAG_GLOBAL},
+    {"6to4-relay", IP_CLASS_FLAG_GLOBAL | IP_CLASS_FLAG_DEPRECATED},
+    {"reserved", 0},
+    {"broadcast", IP_CLASS_FLAG_LOCAL},
+    {"teredo", IP_CLASS_FLAG_GLOBAL | IP_CLASS_FLAG_EMBEDDED_IPV4},
+    {"6to4", IP_CLASS_FLAG_GLOBAL | IP_CLASS_FLAG_EMBEDDED_IPV4},
+    {"ipv4-mapped", IP_CLASS_FLAG_EMBEDDED_IPV4},
+    {"nat64", IP_CLASS_FLAG_GLOBAL | IP_CLASS_FLAG_EMBEDDED_IPV4},
+    {"discard", 0},
+    {"orchid", IP_CLASS_FLAG_GLOBAL},
+    {"srv6", 0},
+    {"multicast-interface", IP_CLASS_FLAG_MULTICAST | IP_CLASS_FLAG_LOCAL},
+    {"multicast-link", IP_CLASS_FLAG_MULTICAST | IP_CLASS_FLAG_LOCAL},
+    {"multicast-admin", IP_CLASS_FLAG_MULTICAST},
+    {"multicast-site", IP_CLASS_FLAG_MULTICAST},
+    {"multicast-organization", IP_CLASS_FLAG_MULTICAST},
+    {"multicast-global", IP_CLASS_FLAG_MULTICAST | IP_CLASS_FLAG_GLOBAL},
+    {"multicast-other", IP_CLASS_FLAG_MULTICAST},
+};
+
+
+//按前缀的长度排序（建表时长的覆盖短的）。
+static constexpr IpClassPrefix Ipv4Prefixes[] = {
+    {{224}, 4, IP_CLASS_MULTICAST_GLOBAL},
+    {{240}, 4, IP_CLASS_RESERVED},
+    {{0}, 8, IP_CLASS_UNSPECIFIED},
+    {{10}, 8, IP_CLASS_PRIVATE},
+    {{127}, 8, IP_CLASS_LOOPBACK},
+    {{239}, 8, IP_CLASS_MULTICAST_ADMIN},
+    {{100, 64}, 10, IP_CLASS_SHARED},
+    {{172, 16}, 12, IP_CLASS_PRIVATE},
+    {{239, 192}, 14, IP_CLASS_MULTICAST_ORGANIZATION},
+    {{198, 18}, 15, IP_CLASS_BENCHMARKING},
+    {{169, 254}, 16, IP_CLASS_LINK_LOCAL},
+    {{192, 168}, 16, IP_CLASS_PRIVATE},
+    {{239, 255}, 16, IP_CLASS_MULTICAST_SITE},
+    {{192, 0, 0}, 24, IP_CLASS_PROTOCOL},
+    {{192, 0, 2}, 24, IP_CLASS_DOCUMENTATION},
+    {{192, 31, 196}, 24, IP_CLASS_AS112},
+    {{192, 52, 193}, 24, IP_CLASS_AMT},
+    {{192, 88, 99}, 24, IP_CLASS_6TO4_RELAY},
+    {{192, 175, 48}, 24, IP_CLASS_AS112},
+    {{198, 51, 100}, 24, IP_CLASS_DOCUMENTATION},
+    {{203, 0, 113}, 24, IP_CLASS_DOCUMENTATION},
+    {{224, 0, 0}, 24, IP_CLASS_MULTICAST_LINK},
+    {{233, 252, 0}, 24, IP_CLASS_DOCUMENTATION}, // MCAST-TEST-NET
+    {{255, 255, 255, 255}, 32, IP_CLASS_BROADCAST},
+};
+
+
+//按前缀的长度排序。ff00::/8下的组播的范围见MakeIpClassTrie。
+static constexpr IpClassPrefix Ipv6Prefixes[] = {
+    {{0}, 0, IP_CLASS_RESERVED},
+    {{0x20}, 3, IP_CLASS_GLOBAL},
+    {{0xfc}, 7, IP_CLASS_UNIQUE_LOCAL},
+    {{0xff}, 8, IP_CLASS_MULTICAST_OTHER},
+    {{0xfe, 0x80}, 10, IP_CLASS_LINK_LOCAL},
+    {{0xfe, 0xc0}, 10, IP_CLASS_SITE_LOCAL},
+    {{0x20, 0x02}, 16, IP_CLASS_6TO4},
+    {{0x5f, 0x00}, 16, IP_CLASS_SRV6},
+    {{0x3f, 0xff}, 20, IP_CLASS_DOCUMENTATION},
+    {{0x20, 0x01}, 23, IP_CLASS_PROTOCOL},
+    {{0x20, 0x01, 0x00, 0x10}, 28, IP_CLASS_ORCHID},
+    {{0x20, 0x01, 0x00, 0x20}, 28, IP_CLASS_ORCHID},
+    {{0x20, 0x01, 0x00, 0x00}, 32, IP_CLASS_TEREDO},
+    {{0x20, 0x01, 0x00, 0x03}, 32, IP_CLASS_AMT},
+    {{0x20, 0x01, 0x0d, 0xb8}, 32, IP_CLASS_DOCUMENTATION},
+    {{0x20, 0x01, 0x00, 0x02, 0x00, 0x00}, 48, IP_CLASS_BENCHMARKING},
+    {{0x20, 0x01, 0x00, 0x04, 0x01, 0x12}, 48, IP_CLASS_AS112},
+    {{0x26, 0x20, 0x00, 0x4f, 0x80, 0x00}, 48, IP_CLASS_AS112},
+    {{0x00, 0x64, 0xff, 0x9b, 0x00, 0x01}, 48, IP_CLASS_NAT64},
+    {{0x01, 0x00}, 64, IP_CLASS_DISCARD},
+    {{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff}, 96, IP_CLASS_IPV4_MAPPED},
+    {{0x00, 0x64, 0xff, 0x9b}, 96, IP_CLASS_NAT64},
+    {{0}, 128, IP_CLASS_UNSPECIFIED},
+    {{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1}, 128, IP_CLASS_LOOPBACK},
+};
+
+
+//IPv6组播的范围（RFC 7346）-> 类别。
+static constexpr UINT8 Ipv6MulticastScope[16] = {
+    IP_CLASS_MULTICAST_OTHER,        // 0：保留。
+    IP_CLASS_MULTICAST_INTERFACE,    // 1
+    IP_CLASS_MULTICAST_LINK,         // 2
+    IP_CLASS_MULTICAST_OTHER,        // 3：Realm-Local。
+    IP_CLASS_MULTICAST_ADMIN,        // 4
+    IP_CLASS_MULTICAST_SITE,         // 5
+    IP_CLASS_MULTICAST_OTHER,        // 6
+    IP_CLASS_MULTICAST_OTHER,        // 7
+    IP_CLASS_MULTICAST_ORGANIZATION, // 8
+    IP_CLASS_MULTICAST_OTHER,        // 9
+    IP_CLASS_MULTICAST_OTHER,        // a
+    IP_CLASS_MULTICAST_OTHER,        // b
+    IP_CLASS_MULTICAST_OTHER,        // c
+    IP_CLASS_MULTICAST_OTHER,        // d
+    IP_CLASS_MULTICAST_GLOBAL,       // e
+    IP_CLASS_MULTICAST_OTHER,        // f：保留。
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//编译时建表。
+
+
+template <ULONG Tables>
+struct IpClassTrie {
+    UINT8 Entry[Tables][256];
+    UINT8 Default[Tables]; //表项是0时的类别。
+    ULONG Count;           //用了的表的个数。
+};
+
+
+template <ULONG Tables>
+constexpr void IpClassInsert(IpClassTrie<Tables> & Trie, const BYTE * Address, UINT8 PrefixLength, UINT8 Class)
+/*
+功能：插入一个前缀，和已有的前缀重叠的部分被覆盖，所以要按长度从短到长插入。
+*/
+{
+    ULONG Table = 0;
+    ULONG Level = 0;
+
+    for (; (Level + 1) * 8 < PrefixLength; Level++) {
+        UINT8 & Entry = Trie.Entry[Table][Address[Level]];
+
+        if (0 == (Entry & IP_CLASS_TABLE_FLAG)) {
+            ULONG New = Trie.Count++; //超出Tables的话编译失败。
+            Trie.Default[New] = Entry ? (UINT8)(Entry - 1) : Trie.Default[Table];
+            Entry = (UINT8)(IP_CLASS_TABLE_FLAG | New);
+        }
+
+        Table = Entry & ~IP_CLASS_TABLE_FLAG;
+    }
+
+    const ULONG Bits = PrefixLength - Level * 8; // 0~8。
+    const ULONG First = Address[Level] & (0xff00 >> Bits) & 0xff;
+    for (ULONG i = First; i < First + (1u << (8 - Bits)); i++) {
+        Trie.Entry[Table][i] = (UINT8)(Class + 1);
+    }
+}
+
+
+template <ULONG Tables, SIZE_T Count>
+constexpr IpClassTrie<Tables> MakeIpClassTrie(const IpClassPrefix (&Prefixes)[Count], bool Ipv6)
+{
+    IpClassTrie<Tables> Trie{};
+
+    Trie.Count = 1;
+    Trie.Default[0] = IP_CLASS_GLOBAL;
+
+    for (SIZE_T i = 0; i < Count; i++) {
+        IpClassInsert(Trie, Prefixes[i].Address, Prefixes[i].PrefixLength, Prefixes[i].Class);
+    }
+
+    if (Ipv6) { //列表里没有ff00::/8下的更长的前缀，所以最后插入也不会覆盖什么。
+        for (ULONG Second = 0; Second < 256; Second++) {
+            const BYTE Address[16] = {0xff, (BYTE)Second};
+            IpClassInsert(Trie, Address, 16, Ipv6MulticastScope[Second & 0xf]);
+        }
+    }
+
+    return Trie;
+}
+
+
+template <SIZE_T Count>
+constexpr bool IpClassIsSorted(const IpClassPrefix (&Prefixes)[Count])
+{
+    for (SIZE_T i = 1; i < Count; i++) {
+        if (Prefixes[i - 1].PrefixLength > Prefixes[i].PrefixLength) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static_assert(IpClassIsSorted(Ipv4Prefixes), "Ipv4Prefixes must be sorted by prefix length");
+static_assert(IpClassIsSorted(Ipv6Prefixes), "Ipv6Prefixes must be sorted by prefix length");
+
+
+//先用足够大的表建一次得到表的个数，再按实际的个数建。
+static constexpr ULONG Ipv4Tables = MakeIpClassTrie<127>(Ipv4Prefixes, false).Count;
+static constexpr ULONG Ipv6Tables = MakeIpClassTrie<127>(Ipv6Prefixes, true).Count;
+static constexpr IpClassTrie<Ipv4Tables> Ipv4Trie = MakeIpClassTrie<Ipv4Tables>(Ipv4Prefixes, false);
+static constexpr IpClassTrie<Ipv6Tables> Ipv6Trie = MakeIpClassTrie<Ipv6Tables>(Ipv6Prefixes, true);
+
+
+template <ULONG Tables>
+static constexpr FORCEINLINE UINT8 IpClassLookup(const IpClassTrie<Tables> & Trie, const BYTE * Address)
+{
+    ULONG Table = 0;
+
+    for (ULONG Level = 0;; Level++) {
+        const UINT8 Entry = Trie.Entry[Table][Address[Level]];
+
+        if (0 == (Entry & IP_CLASS_TABLE_FLAG)) {
+            return Entry ? (UINT8)(Entry - 1) : Trie.Default[Table];
+        }
+
+        Table = Entry & ~IP_CLASS_TABLE_FLAG;
+    }
+}
+
+
+//编译时的检查。
+constexpr BYTE Ipv4Sample[][4] = {{127, 0, 0, 1}, {100, 127, 255, 255}, {255, 255, 255, 254}, {239, 255, 0, 1}};
+constexpr BYTE Ipv6Sample[][16] = {{0},
+                                   {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2},
+                                   {0xff, 0x12},
+                                   {0x20, 0x01, 0x01}};
+
+static_assert(IpClassLookup(Ipv4Trie, Ipv4Sample[0]) == IP_CLASS_LOOPBACK, "");
+static_assert(IpClassLookup(Ipv4Trie, Ipv4Sample[1]) == IP_CLASS_SHARED, "");
+static_assert(IpClassLookup(Ipv4Trie, Ipv4Sample[2]) == IP_CLASS_RESERVED, "");
+static_assert(IpClassLookup(Ipv4Trie, Ipv4Sample[3]) == IP_CLASS_MULTICAST_SITE, "");
+static_assert(IpClassLookup(Ipv6Trie, Ipv6Sample[0]) == IP_CLASS_UNSPECIFIED, "");
+static_assert(IpClassLookup(Ipv6Trie, Ipv6Sample[1]) == IP_CLASS_RESERVED, "");
+static_assert(IpClassLookup(Ipv6Trie, Ipv6Sample[2]) == IP_CLASS_MULTICAST_LINK, "");
+static_assert(IpClassLookup(Ipv6Trie, Ipv6Sample[3]) == IP_CLASS_PROTOCOL, "");
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//接口。
+
+
+EXTERN_C
+DLLEXPORT
+UINT8 WINAPI IpClassify4(_In_ const IN_ADDR * Address)
+/*
+功能：IPv4地址的类别（IP_CLASS_*）。
+
+注意：最长的前缀优先，如：239.255.0.1是IP_CLASS_MULTICAST_SITE，不是IP_CLASS_MULTICAST_ADMIN。
+*/
+{
+    return IpClassLookup(Ipv4Trie, (const BYTE *)Address);
+}
+
+
+EXTERN_C
+DLLEXPORT
+UINT8 WINAPI IpClassify6(_In_ const IN6_ADDR * Address)
+/*
+功能：IPv6地址的类别（IP_CLASS_*）。
+
+注意：IPv4映射的，6to4，Teredo等地址按IPv6的前缀分类，不看里面的IPv4地址。
+*/
+{
+    return IpClassLookup(Ipv6Trie, (const BYTE *)Address);
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI IpClassify4Batch(_In_reads_(Count) const IN_ADDR * Addresses,
+                             _In_ ULONG Count,
+                             _Out_writes_(Count) PUINT8 Classes)
+{
+    for (ULONG i = 0; i < Count; i++) {
+        Classes[i] = IpClassLookup(Ipv4Trie, (const BYTE *)&Addresses[i]);
+    }
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI IpClassify6Batch(_In_reads_(Count) const IN6_ADDR * Addresses,
+                             _In_ ULONG Count,
+                             _Out_writes_(Count) PUINT8 Classes)
+{
+    for (ULONG i = 0; i < Count; i++) {
+        Classes[i] = IpClassLookup(Ipv6Trie, (const BYTE *)&Addresses[i]);
+    }
+}
+
+
+EXTERN_C
+DLLEXPORT
+PCSTR WINAPI IpClassName(_In_ UINT8 Class)
+/*
+功能：类别的名字，如："private"，"multicast-link"。未知的返回"unknown"。
+*/
+{
+    return Class < IP_CLASS_COUNT ? IpClassTable[Class].Name : "unknown";
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI IpClassFlags(_In_ UINT8 Class)
+/*
+功能：类别的标志（IP_CLASS_FLAG_*）。
+*/
+{
+    return Class < IP_CLASS_COUNT ? IpClassTable[Class].Flags : 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,84 @@
+﻿#pragma once
+
+#include "pch.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+//地址的类别（IANA的IPv4/IPv6 Special-Purpose Address Registry，以及组播的范围），见IpClassify4。
+#define IP_CLASS_GLOBAL                 0  //普通的公网地址（不在下面的任何一类里）。
+#define IP_CLASS_UNSPECIFIED            1  // 0.0.0.0/8（This network），::/128。
+#define IP_CLASS_LOOPBACK               2  // 127.0.0.0/8，::1/128。
+#define IP_CLASS_PRIVATE                3  // 10.0.0.0/8，172.16.0.0/12，192.168.0.0/16。
+#define IP_CLASS_SHARED                 4  // 100.64.0.0/10（运营商级NAT，CGNAT）。
+#define IP_CLASS_LINK_LOCAL             5  // 169.254.0.0/16，fe80::/10。
+#define IP_CLASS_UNIQUE_LOCAL           6  // fc00::/7。
+#define IP_CLASS_SITE_LOCAL             7  // fec0::/10（已废弃）。
+#define IP_CLASS_DOCUMENTATION          8  // 192.0.2.0/24等，2001:db8::/32，3fff::/20。
+#define IP_CLASS_BENCHMARKING           9  // 198.18.0.0/15，2001:2::/48。
+#define IP_CLASS_PROTOCOL               10 // IETF协议的分配：192.0.0.0/24，2001::/23。
+#define IP_CLASS_AS112                  11 // 192.31.196.0/24，192.175.48.0/24，2001:4:112::/48，2620:4f:8000::/48。
+#define IP_CLASS_AMT                    12 // 192.52.193.0/24，2001:3::/32。
+#define IP_CLASS_6TO4_RELAY             13 // 192.88.99.0/24（已废弃）。
+#define IP_CLASS_RESERVED               14 // 240.0.0.0/4，IPv6的未分配的空间（2000::/3之外的）。
+#define IP_CLASS_BROADCAST              15 // 255.255.255.255/32。
+#define IP_CLASS_TEREDO                 16 // 2001::/32。
+#define IP_CLASS_6TO4                   17 // 2002::/16。
+#define IP_CLASS_IPV4_MAPPED            18 // ::ffff:0:0/96。
+#define IP_CLASS_NAT64                  19 // 64:ff9b::/96，64:ff9b:1::/48。
+#define IP_CLASS_DISCARD                20 // 100::/64。
+#define IP_CLASS_ORCHID                 21 // 2001:10::/28（已废弃），2001:20::/28。
+#define IP_CLASS_SRV6                   22 // 5f00::/16（SRv6的SID）。
+#define IP_CLASS_MULTICAST_INTERFACE    23 // ff01::/16等（范围1）。
+#define IP_CLASS_MULTICAST_LINK         24 // 224.0.0.0/24，ff02::/16等（范围2）。
+#define IP_CLASS_MULTICAST_ADMIN        25 // 239.0.0.0/8的其余部分，ff04::/16等（范围4）。
+#define IP_CLASS_MULTICAST_SITE         26 // 239.255.0.0/16，ff05::/16等（范围5）。
+#define IP_CLASS_MULTICAST_ORGANIZATION 27 // 239.192.0.0/14，ff08::/16等（范围8）。
+#define IP_CLASS_MULTICAST_GLOBAL       28 // 224.0.0.0/4的其余部分，ff0e::/16等（范围e）。
+#define IP_CLASS_MULTICAST_OTHER        29 // IPv6的其他的（保留的，未分配的）范围。
+#define IP_CLASS_COUNT                  30
+
+
+//IpClassFlags的标志。
+#define IP_CLASS_FLAG_GLOBAL        0x1  //全局可达（IANA的Globally Reachable，N/A的也算）。
+#define IP_CLASS_FLAG_MULTICAST     0x2
+#define IP_CLASS_FLAG_LOCAL         0x4  //不出本机或者本链路（回环，链路本地，本地范围的组播）。
+#define IP_CLASS_FLAG_PRIVATE       0x8  //私有的，内部的（私网，CGNAT，ULA，站点本地）。
+#define IP_CLASS_FLAG_EMBEDDED_IPV4 0x10 //地址里含有IPv4地址（6to4，Teredo，IPv4映射，NAT64）。
+#define IP_CLASS_FLAG_DEPRECATED    0x20
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C_START
+
+
+DLLEXPORT
+UINT8 WINAPI IpClassify4(_In_ const IN_ADDR * Address);
+
+DLLEXPORT
+UINT8 WINAPI IpClassify6(_In_ const IN6_ADDR * Address);
+
+DLLEXPORT
+void WINAPI IpClassify4Batch(_In_reads_(Count) const IN_ADDR * Addresses,
+                             _In_ ULONG Count,
+                             _Out_writes_(Count) PUINT8 Classes);
+
+DLLEXPORT
+void WINAPI IpClassify6Batch(_In_reads_(Count) const IN6_ADDR * Addresses,
+                             _In_ ULONG Count,
+                             _Out_writes_(Count) PUINT8 Classes);
+
+DLLEXPORT
+PCSTR WINAPI IpClassName(_In_ UINT8 Class);
+
+DLLEXPORT
+ULONG WINAPI IpClassFlags(_In_ UINT8 Class);
+
+
+EXTERN_C_END
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
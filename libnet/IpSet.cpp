@@ -0,0 +1,1289 @@
+﻿#include "pch.h"
+#include "IpSet.h"
+#include "IpText.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/*
+IP地址的集合：并，交，差，包含，最少的CIDR的表示，大文件的流式的导入。
+
+用途：黑名单，白名单（如：数百万行的地址列表）的合并和去重，生成尽量少的防火墙规则等。
+
+结构：
+1.IPv4和IPv6分开存储，都是按起始地址排序的，不相交，不相邻的闭区间[First, Last]。
+  IPv4的区间8字节，IPv6的32字节（主机序的两个64位），和行数无关，只和合并后的区间的个数有关。
+2.添加只是追加到末尾，查询和运算前再规范化（排序，合并），这样导入N行是O(N log N)。
+  数组满时先规范化一次，合并后仍然超过一半的再扩大，所以导入时占用的内存不超过（合并后的）区间的4倍。
+  按顺序添加的（大部分的列表是排好序的）不用排序。
+3.并，交，差都是两个有序的区间的数组的一次线性的扫描，O(N + M)。
+4.区间转换为最少的CIDR：从区间的开始，每次取以它对齐的并且不超出区间的最大的块，这是最优的。
+  但是防火墙（INetFwRule::put_RemoteAddresses）直接支持a-b的写法，一个区间就是一个条目，
+  所以IpSetFormatFirewallAddresses按区间输出，只有恰好是一个前缀的才写成a/n。
+
+注意：集合不是线程安全的，查询和运算会规范化（修改）参数里的集合。
+*/
+
+
+#define IP_SET_MIN_CAPACITY 256
+#define IP_SET_READ_SIZE    (1024 * 1024) // IpSetLoadFile每次读取的大小。
+#define IP_SET_MAX_LINE     4096          //更长的行当作无法解析的。
+
+
+typedef struct _IP_KEY6 { //IPv6的地址，主机序。
+    UINT64 High;
+    UINT64 Low;
+} IP_KEY6, * PIP_KEY6;
+
+
+template <typename Key>
+struct IpRange {
+    Key First;
+    Key Last;
+};
+
+
+template <typename Key>
+struct IpRangeList {
+    IpRange<Key> * Ranges;
+    ULONG Count;
+    ULONG Capacity;
+    BOOLEAN Sorted; //按First排好序（没有排序的追加）。
+    BOOLEAN Dirty;  //规范化后又有追加。
+};
+
+
+struct _IP_SET {
+    IpRangeList<UINT32> List4;
+    IpRangeList<IP_KEY6> List6;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//键的运算，IPv4和IPv6的重载。
+
+
+static FORCEINLINE bool KeyLess(UINT32 a, UINT32 b)
+{
+    return a < b;
+}
+
+
+static FORCEINLINE bool KeyLess(const IP_KEY6 & a, const IP_KEY6 & b)
+{
+    return a.High < b.High || (a.High == b.High && a.Low < b.Low);
+}
+
+
+static FORCEINLINE bool KeyIncrement(_Inout_ PUINT32 Key) //返回是否溢出。
+{
+    return 0 == ++*Key;
+}
+
+
+static FORCEINLINE bool KeyIncrement(_Inout_ PIP_KEY6 Key)
+{
+    if (0 == ++Key->Low) {
+        return 0 == ++Key->High;
+    }
+
+    return false;
+}
+
+
+static FORCEINLINE void KeyDecrement(_Inout_ PUINT32 Key)
+{
+    --*Key;
+}
+
+
+static FORCEINLINE void KeyDecrement(_Inout_ PIP_KEY6 Key)
+{
+    if (0 == Key->Low--) {
+        --Key->High;
+    }
+}
+
+
+static FORCEINLINE bool KeyAdjacent(UINT32 Last, UINT32 First) //First <= Last + 1。
+{
+    return First <= Last || First - 1 == Last;
+}
+
+
+static FORCEINLINE bool KeyAdjacent(const IP_KEY6 & Last, const IP_KEY6 & First)
+{
+    IP_KEY6 Next = Last;
+
+    return !KeyLess(Last, First) || KeyIncrement(&Next) || (Next.High == First.High && Next.Low == First.Low);
+}
+
+
+static FORCEINLINE ULONG TrailingZeros64(UINT64 Value) //Value不为0。
+{
+    ULONG Index;
+
+    if (_BitScanForward(&Index, (ULONG)Value)) {
+        return Index;
+    }
+
+    _BitScanForward(&Index, (ULONG)(Value >> 32));
+    return Index + 32;
+}
+
+
+static FORCEINLINE ULONG HighestBit64(UINT64 Value) //Value不为0。
+{
+    ULONG Index;
+
+    if (_BitScanReverse(&Index, (ULONG)(Value >> 32))) {
+        return Index + 32;
+    }
+
+    _BitScanReverse(&Index, (ULONG)Value);
+    return Index;
+}
+
+
+static ULONG BlockBits(UINT32 First, UINT32 Last)
+/*
+功能：从First开始的，以First对齐的，不超出Last的最大的块的位数（块的大小是2的幂）。
+*/
+{
+    UINT64 Span = (UINT64)Last - First + 1;
+    ULONG Bits = HighestBit64(Span);
+
+    if (First) {
+        ULONG Aligned;
+        _BitScanForward(&Aligned, First);
+        Bits = min(Bits, Aligned);
+    }
+
+    return Bits;
+}
+
+
+static ULONG BlockBits(const IP_KEY6 & First, const IP_KEY6 & Last)
+{
+    IP_KEY6 Span; // Last - First，加1可能溢出，所以单独处理。
+    ULONG Bits;
+
+    Span.Low = Last.Low - First.Low;
+    Span.High = Last.High - First.High - (Last.Low < First.Low ? 1 : 0);
+
+    if (MAXUINT64 == Span.High && MAXUINT64 == Span.Low) {
+        Bits = 128;
+    } else {
+        KeyIncrement(&Span);
+        Bits = Span.High ? HighestBit64(Span.High) + 64 : HighestBit64(Span.Low);
+    }
+
+    if (First.Low) {
+        Bits = min(Bits, TrailingZeros64(First.Low));
+    } else if (First.High) {
+        Bits = min(Bits, TrailingZeros64(First.High) + 64);
+    }
+
+    return Bits;
+}
+
+
+static FORCEINLINE bool KeyAddBlock(_Inout_ PUINT32 Key, ULONG Bits) //返回是否溢出。
+{
+    UINT64 Next = (UINT64)*Key + (1ULL << Bits);
+
+    *Key = (UINT32)Next;
+    return Next > MAXUINT32;
+}
+
+
+static FORCEINLINE bool KeyAddBlock(_Inout_ PIP_KEY6 Key, ULONG Bits)
+{
+    if (128 == Bits) {
+        return true;
+    }
+
+    if (Bits >= 64) {
+        Key->High += 1ULL << (Bits - 64);
+        return Key->High < 1ULL << (Bits - 64);
+    }
+
+    Key->Low += 1ULL << Bits;
+    if (Key->Low < 1ULL << Bits) {
+        return 0 == ++Key->High;
+    }
+
+    return false;
+}
+
+
+static FORCEINLINE UINT32 KeyFromAddress(const IN_ADDR * Address)
+{
+    return ntohl(Address->S_un.S_addr);
+}
+
+
+static FORCEINLINE IP_KEY6 KeyFromAddress(const IN6_ADDR * Address)
+{
+    IP_KEY6 Key;
+    UINT64 Word[2];
+
+    RtlCopyMemory(Word, Address, sizeof(Word));
+    Key.High = _byteswap_uint64(Word[0]);
+    Key.Low = _byteswap_uint64(Word[1]);
+    return Key;
+}
+
+
+static FORCEINLINE void KeyToAddress(UINT32 Key, _Out_ PIN_ADDR Address)
+{
+    Address->S_un.S_addr = htonl(Key);
+}
+
+
+static FORCEINLINE void KeyToAddress(const IP_KEY6 & Key, _Out_ PIN6_ADDR Address)
+{
+    UINT64 Word[2] = {_byteswap_uint64(Key.High), _byteswap_uint64(Key.Low)};
+
+    RtlCopyMemory(Address, Word, sizeof(Word));
+}
+
+
+static FORCEINLINE ULONG KeyWidth(UINT32)
+{
+    return 32;
+}
+
+
+static FORCEINLINE ULONG KeyWidth(const IP_KEY6 &)
+{
+    return 128;
+}
+
+
+static int __cdecl CompareRange4(const void * a, const void * b)
+{
+    const IpRange<UINT32> * x = (const IpRange<UINT32> *)a;
+    const IpRange<UINT32> * y = (const IpRange<UINT32> *)b;
+
+    return KeyLess(x->First, y->First) ? -1 : (KeyLess(y->First, x->First) ? 1 : 0);
+}
+
+
+static int __cdecl CompareRange6(const void * a, const void * b)
+{
+    const IpRange<IP_KEY6> * x = (const IpRange<IP_KEY6> *)a;
+    const IpRange<IP_KEY6> * y = (const IpRange<IP_KEY6> *)b;
+
+    return KeyLess(x->First, y->First) ? -1 : (KeyLess(y->First, x->First) ? 1 : 0);
+}
+
+
+static FORCEINLINE void SortRanges(IpRange<UINT32> * Ranges, ULONG Count)
+{
+    qsort(Ranges, Count, sizeof(IpRange<UINT32>), CompareRange4);
+}
+
+
+static FORCEINLINE void SortRanges(IpRange<IP_KEY6> * Ranges, ULONG Count)
+{
+    qsort(Ranges, Count, sizeof(IpRange<IP_KEY6>), CompareRange6);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//区间的数组。
+
+
+template <typename Key>
+static ULONG RangeListReserve(_Inout_ IpRangeList<Key> * List, _In_ ULONG Capacity)
+{
+    if (Capacity <= List->Capacity) {
+        return ERROR_SUCCESS;
+    }
+
+    IpRange<Key> * Ranges = (IpRange<Key> *)MALLOC((SIZE_T)Capacity * sizeof(IpRange<Key>));
+    if (nullptr == Ranges) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    if (List->Ranges) {
+        RtlCopyMemory(Ranges, List->Ranges, (SIZE_T)List->Count * sizeof(IpRange<Key>));
+        FREE(List->Ranges);
+    }
+
+    List->Ranges = Ranges;
+    List->Capacity = Capacity;
+    return ERROR_SUCCESS;
+}
+
+
+template <typename Key>
+static void RangeListFree(_Inout_ IpRangeList<Key> * List)
+{
+    if (List->Ranges) {
+        FREE(List->Ranges);
+    }
+
+    RtlZeroMemory(List, sizeof(IpRangeList<Key>));
+}
+
+
+template <typename Key>
+static void RangeListNormalize(_Inout_ IpRangeList<Key> * List)
+/*
+功能：排序，合并相交的和相邻的区间。
+*/
+{
+    if (!List->Dirty) {
+        return;
+    }
+
+    if (!List->Sorted) {
+        SortRanges(List->Ranges, List->Count);
+    }
+
+    ULONG Out = 0;
+    for (ULONG i = 1; i < List->Count; i++) {
+        IpRange<Key> * Current = &List->Ranges[Out];
+        const IpRange<Key> * Next = &List->Ranges[i];
+
+        if (KeyAdjacent(Current->Last, Next->First)) {
+            if (KeyLess(Current->Last, Next->Last)) {
+                Current->Last = Next->Last;
+            }
+        } else {
+            List->Ranges[++Out] = *Next;
+        }
+    }
+
+    if (List->Count) {
+        List->Count = Out + 1;
+    }
+
+    List->Sorted = TRUE;
+    List->Dirty = FALSE;
+}
+
+
+template <typename Key>
+static ULONG RangeListAppend(_Inout_ IpRangeList<Key> * List, const Key & First, const Key & Last)
+{
+    if (List->Count == List->Capacity) {
+        RangeListNormalize(List);
+
+        if (List->Count >= List->Capacity / 2) {
+            if (List->Capacity > MAXULONG / 2) {
+                return ERROR_NOT_ENOUGH_MEMORY;
+            }
+
+            ULONG ret = RangeListReserve(List, max(List->Capacity * 2, IP_SET_MIN_CAPACITY));
+            if (ERROR_SUCCESS != ret) {
+                return ret;
+            }
+        }
+    }
+
+    if (List->Count && KeyLess(First, List->Ranges[List->Count - 1].First)) {
+        List->Sorted = FALSE;
+    }
+
+    List->Ranges[List->Count].First = First;
+    List->Ranges[List->Count].Last = Last;
+    List->Count++;
+    List->Dirty = TRUE;
+    return ERROR_SUCCESS;
+}
+
+
+template <typename Key>
+static ULONG RangeListPush(_Inout_ IpRangeList<Key> * List, const Key & First, const Key & Last)
+/*
+功能：运算的结果的追加（已预留空间，有序），和前一个相邻的合并。
+*/
+{
+    if (List->Count && KeyAdjacent(List->Ranges[List->Count - 1].Last, First)) {
+        if (KeyLess(List->Ranges[List->Count - 1].Last, Last)) {
+            List->Ranges[List->Count - 1].Last = Last;
+        }
+    } else {
+        List->Ranges[List->Count].First = First;
+        List->Ranges[List->Count].Last = Last;
+        List->Count++;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+template <typename Key>
+static bool RangeListContains(_Inout_ IpRangeList<Key> * List, const Key & Value)
+{
+    RangeListNormalize(List);
+
+    ULONG Low = 0, High = List->Count; //找最后一个First <= Value的。
+    while (Low < High) {
+        ULONG Middle = Low + (High - Low) / 2;
+        if (KeyLess(Value, List->Ranges[Middle].First)) {
+            High = Middle;
+        } else {
+            Low = Middle + 1;
+        }
+    }
+
+    return Low && !KeyLess(List->Ranges[Low - 1].Last, Value);
+}
+
+
+template <typename Key>
+static void RangeListUnion(const IpRangeList<Key> * A, const IpRangeList<Key> * B, _Inout_ IpRangeList<Key> * Out)
+{
+    ULONG i = 0, j = 0;
+
+    while (i < A->Count || j < B->Count) {
+        const IpRange<Key> * Next;
+
+        if (j == B->Count || (i < A->Count && KeyLess(A->Ranges[i].First, B->Ranges[j].First))) {
+            Next = &A->Ranges[i++];
+        } else {
+            Next = &B->Ranges[j++];
+        }
+
+        RangeListPush(Out, Next->First, Next->Last);
+    }
+}
+
+
+template <typename Key>
+static void RangeListIntersect(const IpRangeList<Key> * A,
+                               const IpRangeList<Key> * B,
+                               _Inout_ IpRangeList<Key> * Out)
+{
+    ULONG i = 0, j = 0;
+
+    while (i < A->Count && j < B->Count) {
+        const IpRange<Key> * x = &A->Ranges[i];
+        const IpRange<Key> * y = &B->Ranges[j];
+        const Key & First = KeyLess(x->First, y->First) ? y->First : x->First;
+        const Key & Last = KeyLess(x->Last, y->Last) ? x->Last : y->Last;
+
+        if (!KeyLess(Last, First)) {
+            RangeListPush(Out, First, Last);
+        }
+
+        if (KeyLess(x->Last, y->Last)) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+}
+
+
+template <typename Key>
+static void RangeListDifference(const IpRangeList<Key> * A,
+                                const IpRangeList<Key> * B,
+                                _Inout_ IpRangeList<Key> * Out)
+{
+    ULONG j = 0;
+
+    for (ULONG i = 0; i < A->Count; i++) {
+        Key First = A->Ranges[i].First;
+        const Key & Last = A->Ranges[i].Last;
+        bool Done = false;
+
+        while (j < B->Count && KeyLess(B->Ranges[j].Last, First)) { //在First之前的。
+            j++;
+        }
+
+        for (ULONG k = j; !Done && k < B->Count && !KeyLess(Last, B->Ranges[k].First); k++) {
+            const IpRange<Key> * y = &B->Ranges[k];
+
+            if (KeyLess(First, y->First)) {
+                Key Before = y->First;
+                KeyDecrement(&Before);
+                RangeListPush(Out, First, Before);
+            }
+
+            if (!KeyLess(y->Last, Last)) {
+                Done = true; //剩下的都被减掉了，B的这个区间可能还和A的下一个区间相交，所以j不变。
+            } else {
+                First = y->Last;
+                KeyIncrement(&First);
+                j = k;
+            }
+        }
+
+        if (!Done) {
+            RangeListPush(Out, First, Last);
+        }
+    }
+}
+
+
+template <typename Key>
+static ULONG RangeListPrefixes(const IpRangeList<Key> * List,
+                               ADDRESS_FAMILY Family,
+                               _Out_writes_opt_(Capacity) PLPM_PREFIX Prefixes,
+                               ULONG Capacity,
+                               _Inout_ PULONG Count)
+/*
+功能：每个区间转换为最少的CIDR（见文件开头的说明），Count累加（即使超出了Capacity）。
+*/
+{
+    for (ULONG i = 0; i < List->Count; i++) {
+        Key First = List->Ranges[i].First;
+        const Key & Last = List->Ranges[i].Last;
+
+        for (;;) {
+            ULONG Bits = BlockBits(First, Last);
+
+            if (Prefixes && *Count < Capacity) {
+                PLPM_PREFIX Prefix = &Prefixes[*Count];
+                RtlZeroMemory(Prefix, sizeof(LPM_PREFIX));
+                Prefix->Family = Family;
+                Prefix->PrefixLength = (UINT8)(KeyWidth(First) - Bits);
+                Prefix->Value = i;
+                if constexpr (sizeof(Key) == sizeof(UINT32)) {
+                    KeyToAddress(First, (PIN_ADDR)Prefix->Address);
+                } else {
+                    KeyToAddress(First, (PIN6_ADDR)Prefix->Address);
+                }
+            }
+
+            if (MAXULONG == *Count) {
+                return ERROR_ARITHMETIC_OVERFLOW;
+            }
+
+            (*Count)++;
+
+            if (KeyAddBlock(&First, Bits) || KeyLess(Last, First)) {
+                break;
+            }
+        }
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//文本的解析。
+
+
+static FORCEINLINE bool IsBlank(char c)
+{
+    return ' ' == c || '\t' == c || '\r' == c || '\n' == c || '\v' == c || '\f' == c;
+}
+
+
+static void Trim(_Inout_ const char ** Begin, _Inout_ const char ** End)
+{
+    while (*Begin < *End && IsBlank(**Begin)) {
+        (*Begin)++;
+    }
+
+    while (*End > *Begin && IsBlank((*End)[-1])) {
+        (*End)--;
+    }
+}
+
+
+static bool ParseAddress(_In_reads_(Length) const char * String,
+                         _In_ SIZE_T Length,
+                         _Out_ ADDRESS_FAMILY * Family,
+                         _Out_ PIN6_ADDR Address)
+/*
+功能：解析一个IPv4或者IPv6的地址（有冒号的是IPv6），IPv4的存在Address的前4个字节。
+*/
+{
+    if (memchr(String, ':', Length)) {
+        *Family = AF_INET6;
+        return IpText::ParseIpv6(String, Length, Address);
+    }
+
+    *Family = AF_INET;
+    RtlZeroMemory(Address, sizeof(IN6_ADDR));
+    return IpText::ParseIpv4(String, Length, (PIN_ADDR)Address);
+}
+
+
+static ULONG AddEntry(_In_ PIP_SET Set, _In_reads_(Length) const char * Entry, _In_ SIZE_T Length)
+/*
+功能：添加一个条目：地址，地址/前缀长度，地址-地址。前后的空白会被忽略。
+
+返回值：ERROR_INVALID_PARAMETER表示无法解析。
+*/
+{
+    const char * Begin = Entry;
+    const char * End = Entry + Length;
+    ADDRESS_FAMILY Family, LastFamily;
+    IN6_ADDR First, Last;
+
+    Trim(&Begin, &End);
+    if (Begin == End) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    const char * Slash = (const char *)memchr(Begin, '/', End - Begin);
+    const char * Dash = (const char *)memchr(Begin, '-', End - Begin);
+
+    if (Slash) {
+        const char * Digits = Slash + 1;
+        const char * AddressEnd = Slash;
+        ULONG PrefixLength = 0;
+
+        Trim(&Begin, &AddressEnd);
+        Trim(&Digits, &End);
+        if (Dash || Digits == End || End - Digits > 3) {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        for (const char * p = Digits; p < End; p++) {
+            if (*p < '0' || *p > '9') {
+                return ERROR_INVALID_PARAMETER;
+            }
+
+            PrefixLength = PrefixLength * 10 + (*p - '0');
+        }
+
+        if (!ParseAddress(Begin, AddressEnd - Begin, &Family, &First) ||
+            PrefixLength > (AF_INET == Family ? 32u : 128u)) {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        return IpSetAddPrefix(Set, Family, &First, (UINT8)PrefixLength);
+    }
+
+    if (Dash) {
+        const char * FirstEnd = Dash;
+        const char * LastBegin = Dash + 1;
+
+        Trim(&Begin, &FirstEnd);
+        Trim(&LastBegin, &End);
+        if (!ParseAddress(Begin, FirstEnd - Begin, &Family, &First) ||
+            !ParseAddress(LastBegin, End - LastBegin, &LastFamily, &Last) || Family != LastFamily) {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        return IpSetAddRange(Set, Family, &First, &Last);
+    }
+
+    if (!ParseAddress(Begin, End - Begin, &Family, &First)) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    return IpSetAddRange(Set, Family, &First, &First);
+}
+
+
+static ULONG AddLines(_In_ PIP_SET Set,
+                      _In_reads_bytes_(Size) const char * Text,
+                      _In_ SIZE_T Size,
+                      _Inout_ PIP_SET_LOAD_STATISTICS Statistics)
+/*
+功能：逐行添加，最后一行可以没有换行符。#和;之后的是注释，空行和只有注释的行被忽略。
+*/
+{
+    const char * End = Text + Size;
+
+    for (const char * Line = Text; Line < End;) {
+        const char * LineEnd = (const char *)memchr(Line, '\n', End - Line);
+        if (nullptr == LineEnd) {
+            LineEnd = End;
+        }
+
+        const char * EntryEnd = Line;
+        while (EntryEnd < LineEnd && '#' != *EntryEnd && ';' != *EntryEnd) {
+            EntryEnd++;
+        }
+
+        const char * Begin = Line;
+        Trim(&Begin, &EntryEnd);
+
+        Statistics->Lines++;
+
+        if (Begin < EntryEnd) {
+            ULONG ret = AddEntry(Set, Begin, EntryEnd - Begin);
+            if (ERROR_SUCCESS == ret) {
+                Statistics->Entries++;
+            } else if (ERROR_INVALID_PARAMETER == ret) {
+                if (0 == Statistics->BadLines++) {
+                    Statistics->FirstBadLine = Statistics->Lines;
+                }
+            } else {
+                return ret;
+            }
+        }
+
+        Line = LineEnd + 1;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//接口。
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI IpSetCreate(_Out_ PIP_SET * Set)
+/*
+功能：创建一个空的地址集合。
+
+参数：
+Set：用IpSetDestroy释放。
+*/
+{
+    *Set = (PIP_SET)MALLOC(sizeof(IP_SET));
+    if (nullptr == *Set) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    (*Set)->List4.Sorted = TRUE;
+    (*Set)->List6.Sorted = TRUE;
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI IpSetDestroy(_In_opt_ PIP_SET Set)
+{
+    if (Set) {
+        RangeListFree(&Set->List4);
+        RangeListFree(&Set->List6);
+        FREE(Set);
+    }
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI IpSetAddRange(_In_ PIP_SET Set,
+                           _In_ ADDRESS_FAMILY Family,
+                           _In_ const void * First,
+                           _In_ const void * Last)
+/*
+功能：添加一个地址的区间（包含两端）。
+
+参数：
+Family：AF_INET或者AF_INET6。
+First，Last：IN_ADDR或者IN6_ADDR，First不大于Last。
+*/
+{
+    if (AF_INET == Family) {
+        UINT32 a = KeyFromAddress((const IN_ADDR *)First);
+        UINT32 b = KeyFromAddress((const IN_ADDR *)Last);
+        if (KeyLess(b, a)) {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        return RangeListAppend(&Set->List4, a, b);
+    }
+
+    if (AF_INET6 == Family) {
+        IP_KEY6 a = KeyFromAddress((const IN6_ADDR *)First);
+        IP_KEY6 b = KeyFromAddress((const IN6_ADDR *)Last);
+        if (KeyLess(b, a)) {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        return RangeListAppend(&Set->List6, a, b);
+    }
+
+    return ERROR_INVALID_PARAMETER;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI IpSetAddPrefix(_In_ PIP_SET Set,
+                            _In_ ADDRESS_FAMILY Family,
+                            _In_ const void * Address,
+                            _In_ UINT8 PrefixLength)
+/*
+功能：添加一个前缀，主机部分会被忽略。
+*/
+{
+    if (AF_INET == Family && PrefixLength <= 32) {
+        UINT32 Mask = PrefixLength ? MAXUINT32 << (32 - PrefixLength) : 0;
+        UINT32 First = KeyFromAddress((const IN_ADDR *)Address) & Mask;
+
+        return RangeListAppend(&Set->List4, First, First | ~Mask);
+    }
+
+    if (AF_INET6 == Family && PrefixLength <= 128) {
+        IP_KEY6 First = KeyFromAddress((const IN6_ADDR *)Address);
+        UINT64 MaskHigh = PrefixLength >= 64 ? MAXUINT64 : (PrefixLength ? MAXUINT64 << (64 - PrefixLength) : 0);
+        UINT64 MaskLow = PrefixLength <= 64 ? 0 : MAXUINT64 << (128 - PrefixLength);
+        IP_KEY6 Last;
+
+        First.High &= MaskHigh;
+        First.Low &= MaskLow;
+        Last.High = First.High | ~MaskHigh;
+        Last.Low = First.Low | ~MaskLow;
+        return RangeListAppend(&Set->List6, First, Last);
+    }
+
+    return ERROR_INVALID_PARAMETER;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI IpSetAddString(_In_ PIP_SET Set, _In_z_ PCSTR Entry)
+/*
+功能：添加一个文本的条目。
+
+参数：
+Entry：如：192.168.1.1，10.0.0.0/8，10.0.0.1-10.0.0.9，2001:db8::/32，fe80::1-fe80::ff。
+
+返回值：ERROR_INVALID_PARAMETER表示无法解析。
+*/
+{
+    return AddEntry(Set, Entry, strlen(Entry));
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI IpSetLoadText(_In_ PIP_SET Set,
+                           _In_reads_bytes_(Size) const char * Text,
+                           _In_ SIZE_T Size,
+                           _Out_opt_ PIP_SET_LOAD_STATISTICS Statistics)
+/*
+功能：导入内存里的地址列表，每行一个条目（格式见IpSetAddString），#和;之后的是注释。
+
+返回值：无法解析的行不算失败，只计入Statistics。
+*/
+{
+    IP_SET_LOAD_STATISTICS Local{};
+    PIP_SET_LOAD_STATISTICS Stat = Statistics ? Statistics : &Local;
+
+    RtlZeroMemory(Stat, sizeof(IP_SET_LOAD_STATISTICS));
+    return AddLines(Set, Text, Size, Stat);
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI IpSetLoadFile(_In_ PIP_SET Set,
+                           _In_z_ PCWSTR FileName,
+                           _Out_opt_ PIP_SET_LOAD_STATISTICS Statistics)
+/*
+功能：流式地导入地址列表文件（格式见IpSetLoadText），内存的占用和文件的大小无关。
+
+注意：每次读取1MB，不完整的最后一行留到下次。超过IP_SET_MAX_LINE的行当作无法解析的。
+*/
+{
+    IP_SET_LOAD_STATISTICS Local{};
+    PIP_SET_LOAD_STATISTICS Stat = Statistics ? Statistics : &Local;
+    HANDLE File = INVALID_HANDLE_VALUE;
+    char * Buffer = nullptr;
+    SIZE_T Carry = 0;      // Buffer开头的，上次剩下的不完整的行。
+    bool Skipping = false; //正在跳过一个过长的行。
+    ULONG ret = ERROR_SUCCESS;
+
+    RtlZeroMemory(Stat, sizeof(IP_SET_LOAD_STATISTICS));
+
+    File = CreateFileW(FileName,
+                       GENERIC_READ,
+                       FILE_SHARE_READ,
+                       nullptr,
+                       OPEN_EXISTING,
+                       FILE_FLAG_SEQUENTIAL_SCAN,
+                       nullptr);
+    if (INVALID_HANDLE_VALUE == File) {
+        ret = GetLastError();
+        goto Cleanup;
+    }
+
+    Buffer = (char *)MALLOC(IP_SET_MAX_LINE + IP_SET_READ_SIZE);
+    if (nullptr == Buffer) {
+        ret = ERROR_NOT_ENOUGH_MEMORY;
+        goto Cleanup;
+    }
+
+    for (;;) {
+        DWORD Read = 0;
+        if (!ReadFile(File, Buffer + Carry, IP_SET_READ_SIZE, &Read, nullptr)) {
+            ret = GetLastError();
+            break;
+        }
+
+        if (0 == Read) {
+            if (Carry && !Skipping) {
+                ret = AddLines(Set, Buffer, Carry, Stat);
+            }
+
+            break;
+        }
+
+        SIZE_T Size = Carry + Read;
+        char * Begin = Buffer;
+
+        if (Skipping) {
+            char * LineEnd = (char *)memchr(Buffer, '\n', Size);
+            if (nullptr == LineEnd) {
+                Carry = 0;
+                continue;
+            }
+
+            Skipping = false;
+            Begin = LineEnd + 1;
+        }
+
+        char * Last = Begin; //最后一个完整的行之后。
+        for (char * p = Buffer + Size; p > Begin; p--) {
+            if ('\n' == p[-1]) {
+                Last = p;
+                break;
+            }
+        }
+
+        ret = AddLines(Set, Begin, Last - Begin, Stat);
+        if (ERROR_SUCCESS != ret) {
+            break;
+        }
+
+        Carry = Buffer + Size - Last;
+        if (Carry >= IP_SET_MAX_LINE) {
+            Stat->Lines++;
+            if (0 == Stat->BadLines++) {
+                Stat->FirstBadLine = Stat->Lines;
+            }
+
+            Carry = 0;
+            Skipping = true;
+        } else {
+            MoveMemory(Buffer, Last, Carry);
+        }
+    }
+
+Cleanup:
+    if (Buffer) {
+        FREE(Buffer);
+    }
+
+    if (INVALID_HANDLE_VALUE != File) {
+        CloseHandle(File);
+    }
+
+    return ret;
+}
+
+
+EXTERN_C
+DLLEXPORT
+BOOLEAN WINAPI IpSetContains(_In_ PIP_SET Set, _In_ ADDRESS_FAMILY Family, _In_ const void * Address)
+/*
+功能：地址是否在集合里，O(log N)。
+
+参数：
+Address：IN_ADDR或者IN6_ADDR。
+*/
+{
+    if (AF_INET == Family) {
+        return RangeListContains(&Set->List4, KeyFromAddress((const IN_ADDR *)Address));
+    }
+
+    if (AF_INET6 == Family) {
+        return RangeListContains(&Set->List6, KeyFromAddress((const IN6_ADDR *)Address));
+    }
+
+    return FALSE;
+}
+
+
+typedef enum _IP_SET_OPERATION {
+    IpSetOperationUnion,
+    IpSetOperationIntersect,
+    IpSetOperationDifference
+} IP_SET_OPERATION;
+
+
+template <typename Key>
+static ULONG RangeListOperate(_Inout_ IpRangeList<Key> * A,
+                              _Inout_ IpRangeList<Key> * B,
+                              _In_ IP_SET_OPERATION Operation,
+                              _Inout_ IpRangeList<Key> * Out)
+{
+    RangeListNormalize(A);
+    RangeListNormalize(B);
+
+    UINT64 Capacity = (UINT64)A->Count + B->Count; //结果的区间的个数的上限（差集：B的每个区间最多多分出一段）。
+    if (Capacity > MAXULONG) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    ULONG ret = RangeListReserve(Out, max((ULONG)Capacity, 1UL));
+    if (ERROR_SUCCESS != ret) {
+        return ret;
+    }
+
+    switch (Operation) {
+    case IpSetOperationUnion:
+        RangeListUnion(A, B, Out);
+        break;
+    case IpSetOperationIntersect:
+        RangeListIntersect(A, B, Out);
+        break;
+    default:
+        RangeListDifference(A, B, Out);
+        break;
+    }
+
+    Out->Sorted = TRUE;
+    Out->Dirty = FALSE;
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG IpSetOperate(_In_ PIP_SET A, _In_ PIP_SET B, _In_ IP_SET_OPERATION Operation, _Out_ PIP_SET * Result)
+{
+    ULONG ret = IpSetCreate(Result);
+    if (ERROR_SUCCESS != ret) {
+        return ret;
+    }
+
+    ret = RangeListOperate(&A->List4, &B->List4, Operation, &(*Result)->List4);
+    if (ERROR_SUCCESS == ret) {
+        ret = RangeListOperate(&A->List6, &B->List6, Operation, &(*Result)->List6);
+    }
+
+    if (ERROR_SUCCESS != ret) {
+        IpSetDestroy(*Result);
+        *Result = nullptr;
+    }
+
+    return ret;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI IpSetUnion(_In_ PIP_SET A, _In_ PIP_SET B, _Out_ PIP_SET * Result)
+/*
+功能：并集，O(N + M)。
+
+参数：
+Result：新的集合，用IpSetDestroy释放。A和B不变（只是被规范化）。
+*/
+{
+    return IpSetOperate(A, B, IpSetOperationUnion, Result);
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI IpSetIntersect(_In_ PIP_SET A, _In_ PIP_SET B, _Out_ PIP_SET * Result)
+/*
+功能：交集，O(N + M)。参数同IpSetUnion。
+*/
+{
+    return IpSetOperate(A, B, IpSetOperationIntersect, Result);
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI IpSetDifference(_In_ PIP_SET A, _In_ PIP_SET B, _Out_ PIP_SET * Result)
+/*
+功能：差集（在A里不在B里的），O(N + M)。参数同IpSetUnion。
+*/
+{
+    return IpSetOperate(A, B, IpSetOperationDifference, Result);
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI IpSetQuery(_In_ PIP_SET Set, _Out_ PIP_SET_INFORMATION Information)
+{
+    RangeListNormalize(&Set->List4);
+    RangeListNormalize(&Set->List6);
+
+    RtlZeroMemory(Information, sizeof(IP_SET_INFORMATION));
+    Information->Ranges[0] = Set->List4.Count;
+    Information->Ranges[1] = Set->List6.Count;
+    Information->Bytes = sizeof(IP_SET) + (SIZE_T)Set->List4.Capacity * sizeof(IpRange<UINT32>) +
+                         (SIZE_T)Set->List6.Capacity * sizeof(IpRange<IP_KEY6>);
+
+    for (ULONG i = 0; i < Set->List4.Count; i++) {
+        Information->Addresses4 += (UINT64)Set->List4.Ranges[i].Last - Set->List4.Ranges[i].First + 1;
+    }
+
+    for (ULONG i = 0; i < Set->List6.Count; i++) {
+        const IpRange<IP_KEY6> * Range = &Set->List6.Ranges[i];
+        double High = (double)Range->Last.High - (double)Range->First.High;
+        double Low = (double)Range->Last.Low - (double)Range->First.Low;
+        Information->Addresses6 += High * 18446744073709551616.0 + Low + 1;
+    }
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI IpSetGetPrefixes(_In_ PIP_SET Set,
+                              _In_ ADDRESS_FAMILY Family,
+                              _Out_writes_opt_(Capacity) PLPM_PREFIX Prefixes,
+                              _In_ ULONG Capacity,
+                              _Out_ PULONG Count)
+/*
+功能：把集合表示为最少的（不相交的）CIDR。
+
+参数：
+Family：AF_INET，AF_INET6，或者AF_UNSPEC（先IPv4后IPv6）。
+Prefixes：每个前缀的Value是它所在的区间（按地址族分别）的下标。可以是nullptr（只取个数）。
+Count：需要的个数。
+
+返回值：Capacity不够时返回ERROR_INSUFFICIENT_BUFFER，Count是需要的个数。
+
+注意：结果可以直接给LpmBuild。
+*/
+{
+    ULONG ret = ERROR_SUCCESS;
+
+    *Count = 0;
+
+    if (AF_INET != Family && AF_INET6 != Family && AF_UNSPEC != Family) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    if (AF_INET6 != Family) {
+        RangeListNormalize(&Set->List4);
+        ret = RangeListPrefixes(&Set->List4, AF_INET, Prefixes, Capacity, Count);
+    }
+
+    if (ERROR_SUCCESS == ret && AF_INET != Family) {
+        RangeListNormalize(&Set->List6);
+        ret = RangeListPrefixes(&Set->List6, AF_INET6, Prefixes, Capacity, Count);
+    }
+
+    if (ERROR_SUCCESS == ret && *Count > Capacity) {
+        ret = ERROR_INSUFFICIENT_BUFFER;
+    }
+
+    return ret;
+}
+
+
+template <typename Key>
+static SIZE_T FormatRange(const IpRange<Key> * Range, _Out_writes_(IpText::Ipv6BufferSize * 2) char * Text)
+/*
+功能：一个区间的防火墙的写法：a，a/n（恰好是一个前缀），a-b。
+*/
+{
+    char * Out = Text;
+    ULONG Bits = BlockBits(Range->First, Range->Last);
+    Key End = Range->First;
+    bool Prefix; //区间恰好是一个前缀。
+
+    if (KeyAddBlock(&End, Bits)) {
+        Prefix = true; //块到了地址空间的结尾，区间也是。
+    } else {
+        KeyDecrement(&End);
+        Prefix = !KeyLess(End, Range->Last) && !KeyLess(Range->Last, End);
+    }
+
+    if constexpr (sizeof(Key) == sizeof(UINT32)) {
+        IN_ADDR Address;
+        KeyToAddress(Range->First, &Address);
+        Out += IpText::FormatIpv4(&Address, Out);
+        if (!Prefix) {
+            *Out++ = '-';
+            KeyToAddress(Range->Last, &Address);
+            Out += IpText::FormatIpv4(&Address, Out);
+        }
+    } else {
+        IN6_ADDR Address;
+        KeyToAddress(Range->First, &Address);
+        Out += IpText::FormatIpv6(&Address, Out);
+        if (!Prefix) {
+            *Out++ = '-';
+            KeyToAddress(Range->Last, &Address);
+            Out += IpText::FormatIpv6(&Address, Out);
+        }
+    }
+
+    if (Prefix && Bits) {
+        Out += sprintf_s(Out, 8, "/%lu", KeyWidth(Range->First) - Bits);
+    }
+
+    return Out - Text;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI IpSetFormatFirewallAddresses(_In_ PIP_SET Set,
+                                          _In_ ULONG Start,
+                                          _In_ ULONG MaxEntries,
+                                          _Out_writes_(Characters) PWSTR Buffer,
+                                          _In_ SIZE_T Characters,
+                                          _Out_ PULONG Next)
+/*
+功能：生成防火墙规则的地址（INetFwRule::put_RemoteAddresses，put_LocalAddresses）的文本。
+
+参数：
+Start：从第几个区间开始（先IPv4后IPv6）。
+MaxEntries：最多几个区间（条目），每个区间是一个条目（a，a/n，a-b），逗号分隔。
+Buffer：以0结尾。
+Next：下一次的Start，等于区间的总数时表示完了。
+
+返回值：Start已经是最后时返回ERROR_NO_MORE_ITEMS，Buffer连一个条目都放不下时返回ERROR_INSUFFICIENT_BUFFER。
+*/
+{
+    ULONG Total;
+    SIZE_T Used = 0;
+
+    RangeListNormalize(&Set->List4);
+    RangeListNormalize(&Set->List6);
+
+    Total = Set->List4.Count + Set->List6.Count;
+    *Next = Start;
+
+    if (Start >= Total) {
+        return ERROR_NO_MORE_ITEMS;
+    }
+
+    if (0 == Characters) {
+        return ERROR_INSUFFICIENT_BUFFER;
+    }
+
+    Buffer[0] = 0;
+
+    for (ULONG i = Start; i < Total && i - Start < MaxEntries; i++) {
+        char Text[IpText::Ipv6BufferSize * 2];
+        SIZE_T Length;
+
+        if (i < Set->List4.Count) {
+            Length = FormatRange(&Set->List4.Ranges[i], Text);
+        } else {
+            Length = FormatRange(&Set->List6.Ranges[i - Set->List4.Count], Text);
+        }
+
+        SIZE_T Comma = Used ? 1 : 0;
+        if (Used + Comma + Length + 1 > Characters) {
+            break;
+        }
+
+        if (Comma) {
+            Buffer[Used++] = L',';
+        }
+
+        for (SIZE_T k = 0; k < Length; k++) {
+            Buffer[Used++] = (WCHAR)Text[k];
+        }
+
+        Buffer[Used] = 0;
+        *Next = i + 1;
+    }
+
+    return *Next == Start ? ERROR_INSUFFICIENT_BUFFER : ERROR_SUCCESS;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
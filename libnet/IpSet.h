@@ -0,0 +1,104 @@
+﻿#pragma once
+
+#include "pch.h"
+#include "Lpm.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+typedef struct _IP_SET IP_SET, * PIP_SET; //IPv4和IPv6的地址的集合（按区间存储），不是线程安全的。
+
+
+typedef struct _IP_SET_INFORMATION {
+    ULONG Ranges[2];     //下标0是IPv4的，1是IPv6的：不相交，不相邻的区间的个数。
+    UINT64 Addresses4;   // IPv4的地址的个数。
+    double Addresses6;   // IPv6的地址的个数（近似）。
+    SIZE_T Bytes;        //占用的内存。
+} IP_SET_INFORMATION, * PIP_SET_INFORMATION;
+
+
+typedef struct _IP_SET_LOAD_STATISTICS {
+    UINT64 Lines;        //总的行数。
+    UINT64 Entries;      //有效的条目。
+    UINT64 BadLines;     //无法解析的行（空行和注释不算）。
+    UINT64 FirstBadLine; //第一个无法解析的行的行号（从1开始），没有的是0。
+} IP_SET_LOAD_STATISTICS, * PIP_SET_LOAD_STATISTICS;
+
+
+#define IP_SET_FIREWALL_ENTRIES 1000 //每条防火墙规则的地址的个数的上限（AddRemoteAddressRules）。
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C_START
+
+
+DLLEXPORT
+ULONG WINAPI IpSetCreate(_Out_ PIP_SET * Set);
+
+DLLEXPORT
+void WINAPI IpSetDestroy(_In_opt_ PIP_SET Set);
+
+DLLEXPORT
+ULONG WINAPI IpSetAddRange(_In_ PIP_SET Set,
+                           _In_ ADDRESS_FAMILY Family,
+                           _In_ const void * First,
+                           _In_ const void * Last);
+
+DLLEXPORT
+ULONG WINAPI IpSetAddPrefix(_In_ PIP_SET Set,
+                            _In_ ADDRESS_FAMILY Family,
+                            _In_ const void * Address,
+                            _In_ UINT8 PrefixLength);
+
+DLLEXPORT
+ULONG WINAPI IpSetAddString(_In_ PIP_SET Set, _In_z_ PCSTR Entry);
+
+DLLEXPORT
+ULONG WINAPI IpSetLoadText(_In_ PIP_SET Set,
+                           _In_reads_bytes_(Size) const char * Text,
+                           _In_ SIZE_T Size,
+                           _Out_opt_ PIP_SET_LOAD_STATISTICS Statistics);
+
+DLLEXPORT
+ULONG WINAPI IpSetLoadFile(_In_ PIP_SET Set,
+                           _In_z_ PCWSTR FileName,
+                           _Out_opt_ PIP_SET_LOAD_STATISTICS Statistics);
+
+DLLEXPORT
+BOOLEAN WINAPI IpSetContains(_In_ PIP_SET Set, _In_ ADDRESS_FAMILY Family, _In_ const void * Address);
+
+DLLEXPORT
+ULONG WINAPI IpSetUnion(_In_ PIP_SET A, _In_ PIP_SET B, _Out_ PIP_SET * Result);
+
+DLLEXPORT
+ULONG WINAPI IpSetIntersect(_In_ PIP_SET A, _In_ PIP_SET B, _Out_ PIP_SET * Result);
+
+DLLEXPORT
+ULONG WINAPI IpSetDifference(_In_ PIP_SET A, _In_ PIP_SET B, _Out_ PIP_SET * Result);
+
+DLLEXPORT
+void WINAPI IpSetQuery(_In_ PIP_SET Set, _Out_ PIP_SET_INFORMATION Information);
+
+DLLEXPORT
+ULONG WINAPI IpSetGetPrefixes(_In_ PIP_SET Set,
+                              _In_ ADDRESS_FAMILY Family,
+                              _Out_writes_opt_(Capacity) PLPM_PREFIX Prefixes,
+                              _In_ ULONG Capacity,
+                              _Out_ PULONG Count);
+
+DLLEXPORT
+ULONG WINAPI IpSetFormatFirewallAddresses(_In_ PIP_SET Set,
+                                          _In_ ULONG Start,
+                                          _In_ ULONG MaxEntries,
+                                          _Out_writes_(Characters) PWSTR Buffer,
+                                          _In_ SIZE_T Characters,
+                                          _Out_ PULONG Next);
+
+
+EXTERN_C_END
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
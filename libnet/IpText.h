@@ -0,0 +1,736 @@
+﻿/*
+IPv4和IPv6地址的文本的解析和格式化（只有头文件，C++17）。
+
+用途：代替逐个调用的InetPtonA，InetNtopA，inet_ntoa，RtlIpv4AddressToString等，
+用于大量的地址的转换（日志的导入，连接表的导出等）。导出的批量接口见ParseIPv4Batch等（IpAddr.cpp）。
+
+格式（和InetPtonA/InetNtopA一致）：
+1.IPv4：四段点分十进制，每段1~3位，不大于255。不接受前导零（如：01.2.3.4，避免和八进制的写法混淆）。
+2.IPv6的解析：1~4位的十六进制（大小写都可以），最多一个::（至少代表一段），最后两段可以是IPv4。
+  不接受区域（%）和方括号。
+3.IPv6的格式化（RFC 5952）：小写，去掉前导零，最长的（至少两段的，一样长的取第一个）连续的零段压缩成::。
+  以下的地址的最后两段写成IPv4（和Windows的RtlIpv6AddressToString一样）：
+  ::ffff:a.b.c.d（IPv4映射），::ffff:0:a.b.c.d（IPv4转换），::a.b.c.d（IPv4兼容，::和::1除外），
+  x:x:x:x:0:5efe:a.b.c.d和x:x:x:x:200:5efe:a.b.c.d（ISATAP）。
+
+实现：
+1.IPv4的解析（SSE4.1）：一次读入16字节，比较得到数字和点的位图，由各段的长度（3^4种）查表得到一个shuffle，
+  把各段的数字右对齐到各自的32位里，再用乘加（pmaddubsw，pmaddwd）一次算出4个值。
+2.IPv6的解析（SSE4.1）：一次分类48字节（冒号，点，十六进制数字），同时把字符转换为数值，之后按冒号的位图取各段。
+3.IPv6的格式化（SSE4.1）：用pshufb把16字节一次转换为32个十六进制字符，同时比较得到零段的位图，
+  最长的零段查表（256项）。
+4.IPv4的格式化：查表（每个字节的文本和长度），每段一次4字节的写入，比SIMD的还快，所以没有SIMD的版本。
+5.运行时检查CPU（CPUID），不支持SSE4.1的和非x86/x64的用标量的实现，结果完全一样。
+6.只用标准的头文件（SIMD的除外），MSVC，GCC和Clang都可以编译，不依赖pch.h和Windows的类型。
+  地址是网络序的4或16字节，和IN_ADDR/in_addr，IN6_ADDR/in6_addr的内存布局一样，所以参数是void指针。
+
+注意：
+1.Parse*的String不必以0结尾，Length是准确的长度（不含结尾的0）。
+2.Format*的缓冲区的大小见Ipv4BufferSize，Ipv6BufferSize，结果以0结尾，返回值是长度（不含结尾的0）。
+  写入时可能会整块地写（超出实际的长度），但不会超出缓冲区的大小。
+3.Address不要求对齐。
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define IPTEXT_X86
+#if defined(_MSC_VER)
+#define IPTEXT_SSE41 // MSVC不需要指定目标就可以用SSE4.1的内部函数。
+#else
+#include <cpuid.h>
+#include <immintrin.h>
+#define IPTEXT_SSE41 __attribute__((target("sse4.1")))
+#endif
+#endif
+
+
+namespace IpText
+{
+constexpr size_t Ipv4MaxLength = 15;  // 255.255.255.255
+constexpr size_t Ipv6MaxLength = 45;  // ffff:ffff:ffff:ffff:ffff:ffff:255.255.255.255
+constexpr size_t Ipv4BufferSize = 16; // FormatIpv4的缓冲区的大小。
+constexpr size_t Ipv6BufferSize = 46; // FormatIpv6的缓冲区的大小。
+constexpr size_t Ipv6HexSize = 36;    // HexIpv6*的缓冲区的大小：32个字符，加上每段4字节的读取越过结尾的部分。
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//编译期生成的表。
+
+
+struct DecimalTable {
+    char Text[256][4];   //"ddd."，不足4字节的补0（按字节存，和字节序无关）。
+    uint8_t Length[256]; //数字的个数。
+};
+
+
+constexpr DecimalTable MakeDecimalTable()
+{
+    DecimalTable Table{};
+
+    for (uint32_t i = 0; i < 256; i++) {
+        char * Digits = Table.Text[i];
+        uint8_t Length = 0;
+
+        if (i >= 100) {
+            Digits[Length++] = (char)('0' + i / 100);
+        }
+
+        if (i >= 10) {
+            Digits[Length++] = (char)('0' + i / 10 % 10);
+        }
+
+        Digits[Length++] = (char)('0' + i % 10);
+        Digits[Length] = '.';
+
+        Table.Length[i] = Length;
+    }
+
+    return Table;
+}
+
+
+inline constexpr DecimalTable Decimal = MakeDecimalTable();
+
+
+struct ZeroRunTable {
+    uint8_t Run[256]; //零段的位图（第i位是第i段）-> 最长的零段（起点 << 4 | 长度），长度小于2的是0。
+};
+
+
+constexpr ZeroRunTable MakeZeroRunTable()
+{
+    ZeroRunTable Table{};
+
+    for (uint32_t Mask = 0; Mask < 256; Mask++) {
+        uint8_t BestStart = 0, BestLength = 0;
+
+        for (uint8_t Start = 0; Start < 8;) {
+            uint8_t Length = 0;
+            while (Start + Length < 8 && (Mask & (1 << (Start + Length)))) {
+                Length++;
+            }
+
+            if (Length > BestLength) { //一样长的取第一个。
+                BestStart = Start;
+                BestLength = Length;
+            }
+
+            Start += Length ? Length : 1;
+        }
+
+        Table.Run[Mask] = (BestLength >= 2) ? (uint8_t)(BestStart << 4 | BestLength) : 0;
+    }
+
+    return Table;
+}
+
+
+inline constexpr ZeroRunTable ZeroRun = MakeZeroRunTable();
+
+
+#ifdef IPTEXT_X86
+struct Ipv4ShuffleTable {
+    uint8_t Pattern[81][16]; //下标是各段的长度（1~3）减一组成的三进制数。
+};
+
+
+constexpr Ipv4ShuffleTable MakeIpv4ShuffleTable()
+/*
+每段占一个32位：[百位，十位，个位，0]，没有的位是0x80（pshufb的结果是0）。
+*/
+{
+    Ipv4ShuffleTable Table{};
+
+    for (uint32_t Index = 0; Index < 81; Index++) {
+        const uint32_t Length[4] = {Index / 27 + 1, Index / 9 % 3 + 1, Index / 3 % 3 + 1, Index % 3 + 1};
+        uint32_t Start = 0;
+
+        for (uint32_t Part = 0; Part < 4; Part++) {
+            uint8_t * Lane = &Table.Pattern[Index][Part * 4];
+
+            for (uint32_t i = 0; i < 4; i++) {
+                Lane[i] = 0x80;
+            }
+
+            for (uint32_t i = 0; i < Length[Part]; i++) {
+                Lane[3 - Length[Part] + i] = (uint8_t)(Start + i);
+            }
+
+            Start += Length[Part] + 1;
+        }
+    }
+
+    return Table;
+}
+
+
+inline constexpr Ipv4ShuffleTable Ipv4Shuffle = MakeIpv4ShuffleTable();
+#endif
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//位运算（Value不能是0）。
+
+
+inline uint32_t LowestBit(uint32_t Value)
+{
+#if defined(_MSC_VER)
+    unsigned long Index;
+    _BitScanForward(&Index, Value);
+    return Index;
+#else
+    return (uint32_t)__builtin_ctz(Value);
+#endif
+}
+
+
+inline uint32_t HighestBit(uint32_t Value)
+{
+#if defined(_MSC_VER)
+    unsigned long Index;
+    _BitScanReverse(&Index, Value);
+    return Index;
+#else
+    return 31 - (uint32_t)__builtin_clz(Value);
+#endif
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//标量的实现。
+
+
+inline bool ParseIpv4Scalar(const char * String, size_t Length, void * Address)
+{
+    uint8_t Octets[4];
+    size_t i = 0;
+
+    memset(Address, 0, 4);
+
+    for (int Part = 0; Part < 4; Part++) {
+        const size_t Start = i;
+        uint32_t Octet = 0;
+
+        while (i < Length && i - Start < 3 && (uint8_t)(String[i] - '0') <= 9) {
+            Octet = Octet * 10 + (String[i] - '0');
+            i++;
+        }
+
+        if (i == Start || Octet > 255 || (i - Start > 1 && '0' == String[Start])) {
+            return false;
+        }
+
+        Octets[Part] = (uint8_t)Octet;
+
+        if (Part < 3) {
+            if (i >= Length || '.' != String[i]) {
+                return false;
+            }
+
+            i++;
+        }
+    }
+
+    if (i != Length) {
+        return false;
+    }
+
+    memcpy(Address, Octets, 4);
+
+    return true;
+}
+
+
+//IPv6的文本的分类：第i位对应第i个字符，Nibble是十六进制数字的值。
+struct Ipv6Classes {
+    uint64_t Colon;
+    uint64_t Dot;
+    uint64_t Hex;
+    uint8_t Nibble[48];
+};
+
+
+inline void ClassifyIpv6Scalar(const char * String,
+                               size_t Length,
+                               Ipv6Classes * Classes)
+{
+    Classes->Colon = Classes->Dot = Classes->Hex = 0;
+
+    for (size_t i = 0; i < Length; i++) {
+        const char c = String[i];
+        const uint8_t Digit = (uint8_t)(c - '0');
+        const uint8_t Alpha = (uint8_t)((c | 0x20) - 'a');
+
+        if (Digit <= 9) {
+            Classes->Hex |= 1ULL << i;
+            Classes->Nibble[i] = Digit;
+        } else if (Alpha <= 5) {
+            Classes->Hex |= 1ULL << i;
+            Classes->Nibble[i] = Alpha + 10;
+        } else if (':' == c) {
+            Classes->Colon |= 1ULL << i;
+        } else if ('.' == c) {
+            Classes->Dot |= 1ULL << i;
+        }
+    }
+}
+
+
+inline uint32_t HexIpv6Scalar(const void * Address, char * Chars)
+/*
+功能：每段4个十六进制字符（含前导零），返回零段的位图。
+*/
+{
+    static constexpr char Digits[] = "0123456789abcdef";
+    const uint8_t * Bytes = static_cast<const uint8_t *>(Address);
+    uint32_t ZeroMask = 0;
+
+    for (int i = 0; i < 16; i++) {
+        Chars[2 * i] = Digits[Bytes[i] >> 4];
+        Chars[2 * i + 1] = Digits[Bytes[i] & 0xf];
+    }
+
+    for (int i = 0; i < 8; i++) {
+        if (0 == (Bytes[2 * i] | Bytes[2 * i + 1])) {
+            ZeroMask |= 1 << i;
+        }
+    }
+
+    return ZeroMask;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// SSE4.1的实现。
+
+
+#ifdef IPTEXT_X86
+IPTEXT_SSE41 inline bool ParseIpv4Sse41(const char * String, size_t Length, void * Address)
+{
+    memset(Address, 0, 4);
+
+    if (Length < 7 || Length > Ipv4MaxLength) {
+        return false;
+    }
+
+    alignas(16) char Buffer[16] = {0};
+    memcpy(Buffer, String, Length);
+
+    const __m128i Text = _mm_load_si128(reinterpret_cast<const __m128i *>(Buffer));
+    const __m128i Digits = _mm_sub_epi8(Text, _mm_set1_epi8('0'));
+    const __m128i IsDigit = _mm_cmpeq_epi8(_mm_max_epu8(Digits, _mm_set1_epi8(9)), _mm_set1_epi8(9));
+    const uint32_t DigitMask = (uint32_t)_mm_movemask_epi8(IsDigit);
+    uint32_t DotMask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(Text, _mm_set1_epi8('.')));
+    const uint32_t LengthMask = (1UL << Length) - 1;
+
+    if (((DigitMask | DotMask) & LengthMask) != LengthMask) {
+        return false;
+    }
+
+    uint32_t Dot[3];
+    for (int i = 0; i < 3; i++) { //正好3个点（不用popcnt，有的支持SSE4.1的CPU没有这个指令）。
+        if (0 == DotMask) {
+            return false;
+        }
+
+        Dot[i] = LowestBit(DotMask);
+        DotMask &= DotMask - 1;
+    }
+
+    if (DotMask) {
+        return false;
+    }
+
+    const uint32_t Part[4] = {Dot[0], Dot[1] - Dot[0] - 1, Dot[2] - Dot[1] - 1, (uint32_t)Length - Dot[2] - 1};
+    const uint32_t Start[4] = {0, Dot[0] + 1, Dot[1] + 1, Dot[2] + 1};
+
+    for (int i = 0; i < 4; i++) {
+        if (Part[i] - 1 > 2 || (Part[i] > 1 && '0' == Buffer[Start[i]])) {
+            return false;
+        }
+    }
+
+    const uint32_t Index = (Part[0] - 1) * 27 + (Part[1] - 1) * 9 + (Part[2] - 1) * 3 + (Part[3] - 1);
+    const __m128i Pattern = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Ipv4Shuffle.Pattern[Index]));
+    const __m128i Aligned = _mm_shuffle_epi8(Digits, Pattern);
+    const __m128i Pairs = _mm_maddubs_epi16(Aligned, _mm_set1_epi32(0x00010a64)); //[100, 10, 1, 0]。
+    const __m128i Values = _mm_madd_epi16(Pairs, _mm_set1_epi16(1));
+
+    if (!_mm_testz_si128(_mm_cmpgt_epi32(Values, _mm_set1_epi32(255)), _mm_set1_epi32(-1))) {
+        return false;
+    }
+
+    const __m128i Bytes = _mm_packus_epi16(_mm_packus_epi32(Values, Values), Values);
+    const uint32_t Value = (uint32_t)_mm_cvtsi128_si32(Bytes);
+    memcpy(Address, &Value, 4);
+
+    return true;
+}
+
+
+IPTEXT_SSE41 inline void ClassifyIpv6Sse41(const char * String,
+                              size_t Length,
+                              Ipv6Classes * Classes)
+/*
+注意：Length不大于Ipv6MaxLength。
+*/
+{
+    alignas(16) char Buffer[48] = {0};
+    memcpy(Buffer, String, Length);
+
+    Classes->Colon = Classes->Dot = Classes->Hex = 0;
+
+    for (int i = 0; i < 3; i++) {
+        const __m128i Text = _mm_load_si128(reinterpret_cast<const __m128i *>(Buffer + 16 * i));
+        const __m128i Digit = _mm_sub_epi8(Text, _mm_set1_epi8('0'));
+        const __m128i Alpha = _mm_sub_epi8(_mm_or_si128(Text, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+        const __m128i IsDigit = _mm_cmpeq_epi8(_mm_max_epu8(Digit, _mm_set1_epi8(9)), _mm_set1_epi8(9));
+        const __m128i IsAlpha = _mm_cmpeq_epi8(_mm_max_epu8(Alpha, _mm_set1_epi8(5)), _mm_set1_epi8(5));
+        const __m128i Nibble = _mm_blendv_epi8(_mm_add_epi8(Alpha, _mm_set1_epi8(10)), Digit, IsDigit);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(Classes->Nibble + 16 * i), Nibble);
+
+        const uint64_t Shift = 16 * i;
+        Classes->Hex |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_or_si128(IsDigit, IsAlpha)) << Shift;
+        Classes->Colon |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(Text, _mm_set1_epi8(':'))) << Shift;
+        Classes->Dot |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(Text, _mm_set1_epi8('.'))) << Shift;
+    }
+}
+
+
+IPTEXT_SSE41 inline uint32_t HexIpv6Sse41(const void * Address, char * Chars)
+{
+    const __m128i Bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Address));
+    const __m128i Low = _mm_and_si128(Bytes, _mm_set1_epi8(0x0f));
+    const __m128i High = _mm_and_si128(_mm_srli_epi16(Bytes, 4), _mm_set1_epi8(0x0f));
+    const __m128i Digits =
+        _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+
+    const __m128i First = _mm_shuffle_epi8(Digits, _mm_unpacklo_epi8(High, Low));  //第0~3段。
+    const __m128i Second = _mm_shuffle_epi8(Digits, _mm_unpackhi_epi8(High, Low)); //第4~7段。
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(Chars), First);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(Chars + 16), Second);
+
+    const __m128i Zero = _mm_cmpeq_epi16(Bytes, _mm_setzero_si128());
+
+    return (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(Zero, _mm_setzero_si128()));
+}
+
+
+inline bool IsSse41Supported()
+/*
+功能：CPUID.1:ECX.SSSE3[bit 9]和SSE4.1[bit 19]。SSE的寄存器不需要检查操作系统的支持。
+*/
+{
+#if defined(_MSC_VER)
+    int CpuInfo[4] = {0};
+
+    __cpuid(CpuInfo, 1);
+
+    return (CpuInfo[2] & (1 << 9)) && (CpuInfo[2] & (1 << 19));
+#else
+    unsigned int Eax, Ebx, Ecx, Edx;
+
+    if (!__get_cpuid(1, &Eax, &Ebx, &Ecx, &Edx)) {
+        return false;
+    }
+
+    return (Ecx & (1 << 9)) && (Ecx & (1 << 19));
+#endif
+}
+
+
+inline bool UseSse41()
+{
+    static const bool Supported = IsSse41Supported(); //只检查一次（局部静态变量的初始化是线程安全的）。
+
+    return Supported;
+}
+#endif
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//公共的部分。
+
+
+inline bool ParseIpv6Classified(const char * String,
+                                size_t Length,
+                                const Ipv6Classes * Classes,
+                                void * Address)
+/*
+功能：根据分类的结果取各段。
+*/
+{
+    const uint64_t LengthMask = (1ULL << Length) - 1;
+    uint16_t Words[8] = {0};
+    size_t End = Length; //十六进制部分的结尾（有IPv4的，包括IPv4前面的那个冒号）。
+    uint32_t Groups = 8; //十六进制部分的段数。
+    uint32_t Count = 0;
+    int32_t Gap = -1;    // ::的位置（在第几段）。
+    size_t i = 0;
+    uint8_t Ipv4[4]{};
+
+    if ((Classes->Colon | Classes->Dot | Classes->Hex) != LengthMask) {
+        return false;
+    }
+
+    if (Classes->Dot) {
+        uint32_t LastColon;
+
+        if (Classes->Colon >> 32) {
+            LastColon = HighestBit((uint32_t)(Classes->Colon >> 32)) + 32;
+        } else if (Classes->Colon) {
+            LastColon = HighestBit((uint32_t)Classes->Colon);
+        } else {
+            return false;
+        }
+
+        if (Classes->Dot & ((2ULL << LastColon) - 1)) {
+            return false;
+        }
+
+        if (!ParseIpv4Scalar(String + LastColon + 1, Length - LastColon - 1, Ipv4)) {
+            return false;
+        }
+
+        End = LastColon + 1;
+        Groups = 6;
+    }
+
+    if (Classes->Colon & 1) {
+        if (0 == (Classes->Colon & 2)) {
+            return false;
+        }
+
+        Gap = 0;
+        i = 2;
+    }
+
+    while (i < End) {
+        const size_t Start = i;
+        uint32_t Value = 0;
+
+        while (i < End && (Classes->Hex & (1ULL << i))) {
+            Value = (Value << 4) | Classes->Nibble[i];
+            i++;
+        }
+
+        if (i == Start || i - Start > 4 || Count == Groups) {
+            return false;
+        }
+
+        Words[Count++] = (uint16_t)Value;
+
+        if (i == End) {
+            break;
+        }
+
+        i++; //冒号。
+
+        if (i == End) {
+            if (Groups == 8) { //结尾是单个的冒号。
+                return false;
+            }
+
+            break;
+        }
+
+        if (Classes->Colon & (1ULL << i)) {
+            if (Gap >= 0) {
+                return false;
+            }
+
+            Gap = (int32_t)Count;
+            i++;
+        }
+    }
+
+    if (Gap >= 0) {
+        if (Count == Groups) {
+            return false;
+        }
+
+        const uint32_t Tail = Count - Gap;
+        for (uint32_t j = 0; j < Tail; j++) {
+            Words[Groups - 1 - j] = Words[Count - 1 - j];
+            Words[Count - 1 - j] = 0;
+        }
+    } else if (Count != Groups) {
+        return false;
+    }
+
+    uint8_t * Bytes = static_cast<uint8_t *>(Address);
+
+    for (int j = 0; j < 8; j++) {
+        Bytes[2 * j] = (uint8_t)(Words[j] >> 8);
+        Bytes[2 * j + 1] = (uint8_t)Words[j];
+    }
+
+    if (6 == Groups) {
+        memcpy(&Bytes[12], Ipv4, sizeof(Ipv4));
+    }
+
+    return true;
+}
+
+
+inline size_t FormatIpv4(const void * Address, char * Buffer)
+{
+    char * Out = Buffer;
+
+    for (int i = 0; i < 4; i++) {
+        const uint8_t Octet = static_cast<const uint8_t *>(Address)[i];
+        memcpy(Out, Decimal.Text[Octet], 4);
+        Out += Decimal.Length[Octet] + 1;
+    }
+
+    Out[-1] = 0;
+
+    return Out - Buffer - 1;
+}
+
+
+inline bool IsIpv6WithIpv4(const void * Address)
+/*
+功能：最后两段是否写成IPv4（见文件开头的说明）。
+*/
+{
+    const uint8_t * b = static_cast<const uint8_t *>(Address);
+    uint64_t High;
+    memcpy(&High, b, sizeof(High));
+
+    if (0 == High) {
+        const uint32_t w4 = (b[8] << 8) | b[9], w5 = (b[10] << 8) | b[11];
+        const uint32_t w6 = (b[12] << 8) | b[13], w7 = (b[14] << 8) | b[15];
+
+        if ((0 == w4 && 0xffff == w5) || (0xffff == w4 && 0 == w5)) {
+            return true;
+        }
+
+        if (0 == w4 && 0 == w5) {
+            return w6 != 0 || w7 > 1;
+        }
+    }
+
+    return (0 == b[8] || 0x02 == b[8]) && 0 == b[9] && 0x5e == b[10] && 0xfe == b[11];
+}
+
+
+inline size_t FormatIpv6Hexed(const void * Address,
+                              const char * Chars,
+                              uint32_t ZeroMask,
+                              char * Buffer)
+{
+    const uint8_t * Bytes = static_cast<const uint8_t *>(Address);
+    const bool WithIpv4 = IsIpv6WithIpv4(Address);
+    const uint32_t HexWords = WithIpv4 ? 6 : 8;
+    const uint8_t Run = ZeroRun.Run[ZeroMask & ((1 << HexWords) - 1)];
+    const uint32_t RunStart = Run >> 4, RunLength = Run & 0xf;
+    char * Out = Buffer;
+
+    for (uint32_t i = 0; i < HexWords; i++) {
+        if (RunLength && i == RunStart) {
+            if (0 == i) {
+                *Out++ = ':';
+            }
+
+            *Out++ = ':';
+            i += RunLength - 1;
+            continue;
+        }
+
+        const uint32_t Digits = HighestBit((Bytes[2 * i] << 8) | Bytes[2 * i + 1] | 1) / 4 + 1;
+
+        memcpy(Out, Chars + 4 * i + 4 - Digits, 4);
+        Out += Digits;
+        *Out++ = ':';
+    }
+
+    if (WithIpv4) {
+        Out += FormatIpv4(&Bytes[12], Out);
+    } else {
+        if (0 == RunLength || RunStart + RunLength != HexWords) {
+            Out--; //最后一段后面的冒号。
+        }
+
+        *Out = 0;
+    }
+
+    return Out - Buffer;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//接口。
+
+
+inline bool ParseIpv4(const char * String, size_t Length, void * Address)
+{
+#ifdef IPTEXT_X86
+    if (UseSse41()) {
+        return ParseIpv4Sse41(String, Length, Address);
+    }
+#endif
+
+    return ParseIpv4Scalar(String, Length, Address);
+}
+
+
+inline bool ParseIpv6(const char * String, size_t Length, void * Address)
+{
+    Ipv6Classes Classes;
+
+    memset(Address, 0, 16);
+
+    if (0 == Length || Length > Ipv6MaxLength) {
+        return false;
+    }
+
+#ifdef IPTEXT_X86
+    if (UseSse41()) {
+        ClassifyIpv6Sse41(String, Length, &Classes);
+    } else {
+        ClassifyIpv6Scalar(String, Length, &Classes);
+    }
+#else
+    ClassifyIpv6Scalar(String, Length, &Classes);
+#endif
+
+    if (!ParseIpv6Classified(String, Length, &Classes, Address)) {
+        memset(Address, 0, 16);
+        return false;
+    }
+
+    return true;
+}
+
+
+inline size_t FormatIpv6(const void * Address, char * Buffer)
+{
+    char Chars[Ipv6HexSize];
+    uint32_t ZeroMask;
+
+#ifdef IPTEXT_X86
+    if (UseSse41()) {
+        ZeroMask = HexIpv6Sse41(Address, Chars);
+    } else {
+        ZeroMask = HexIpv6Scalar(Address, Chars);
+    }
+#else
+    ZeroMask = HexIpv6Scalar(Address, Chars);
+#endif
+
+    return FormatIpv6Hexed(Address, Chars, ZeroMask, Buffer);
+}
+} // namespace IpText
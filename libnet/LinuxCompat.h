@@ -0,0 +1,93 @@
+﻿#pragma once
+
+/*
+Linux上单独编译的文件（TableBackendLinux.cpp，OwnerCache.cpp，Dissector.cpp，Pcap.cpp，
+test/DissectorTest.cpp，test/PcapTest.cpp，test/DissectorBenchmark.cpp，test/OwnerCacheBenchmark.cpp，
+test/TableBackendLinuxBenchmark.cpp）用到的Windows的类型和定义（值同Windows）。
+
+Windows上就是pch.h，这些都来自Windows的头文件。
+*/
+
+#ifdef _WIN32
+#include "pch.h"
+#else
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef int32_t BOOL;
+typedef uint8_t UINT8, * PUINT8, BYTE, * PBYTE;
+typedef uint16_t UINT16;
+typedef uint32_t UINT32;
+typedef int32_t INT32;
+typedef int64_t INT64;
+typedef uint16_t USHORT, ADDRESS_FAMILY;
+typedef uint32_t ULONG, * PULONG;
+typedef uint64_t UINT64, * PUINT64;
+typedef size_t SIZE_T;
+typedef void * PVOID;
+typedef const char * PCSTR;
+
+#define TRUE  1
+#define FALSE 0
+
+#define MAXUINT16 ((UINT16)~((UINT16)0))
+#define MAXUINT32 ((UINT32)~((UINT32)0))
+
+#define WINAPI
+#define FORCEINLINE    inline __attribute__((always_inline))
+#define DLLEXPORT      __attribute__((visibility("default")))
+#define EXTERN_C       extern "C"
+#define EXTERN_C_START extern "C" {
+#define EXTERN_C_END   }
+
+#define _In_
+#define _In_opt_
+#define _In_z_
+#define _Out_
+#define _Out_opt_
+#define _Inout_
+#define _In_reads_(Count)
+#define _In_reads_bytes_(Size)
+#define _Out_writes_(Count)
+
+#define UNREFERENCED_PARAMETER(P) (void)(P)
+#define _countof(Array)           (sizeof(Array) / sizeof((Array)[0]))
+#define FIELD_OFFSET(Type, Field) ((ULONG)offsetof(Type, Field))
+
+#define RtlZeroMemory(Destination, Length)         memset((Destination), 0, (Length))
+#define RtlCopyMemory(Destination, Source, Length) memcpy((Destination), (Source), (Length))
+
+#define _byteswap_ushort(x) __builtin_bswap16(x)
+#define _byteswap_ulong(x)  __builtin_bswap32(x)
+
+#define MALLOC(x) calloc(1, (x))
+#define FREE(x)   free(x)
+
+#define ERROR_SUCCESS             0
+#define ERROR_FILE_NOT_FOUND      2
+#define ERROR_ACCESS_DENIED       5
+#define ERROR_NOT_ENOUGH_MEMORY   8
+#define ERROR_INVALID_DATA        13
+#define ERROR_WRITE_FAULT         29
+#define ERROR_GEN_FAILURE         31
+#define ERROR_NOT_SUPPORTED       50
+#define ERROR_INVALID_PARAMETER   87
+#define ERROR_INSUFFICIENT_BUFFER 122
+#define ERROR_NO_MORE_ITEMS       259
+#define ERROR_NOT_FOUND           1168
+
+#define MIB_TCP_STATE_CLOSED     1
+#define MIB_TCP_STATE_LISTEN     2
+#define MIB_TCP_STATE_SYN_SENT   3
+#define MIB_TCP_STATE_SYN_RCVD   4
+#define MIB_TCP_STATE_ESTAB      5
+#define MIB_TCP_STATE_FIN_WAIT1  6
+#define MIB_TCP_STATE_FIN_WAIT2  7
+#define MIB_TCP_STATE_CLOSE_WAIT 8
+#define MIB_TCP_STATE_CLOSING    9
+#define MIB_TCP_STATE_LAST_ACK   10
+#define MIB_TCP_STATE_TIME_WAIT  11
+#endif
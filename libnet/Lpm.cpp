@@ -0,0 +1,1021 @@
+﻿#include "pch.h"
+#include "Lpm.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/*
+最长前缀匹配（LPM），用于按路由表，白名单等前缀给大量的地址分类。
+
+结构（Poptrie，IPv4和IPv6共用一套代码）：
+1.地址的前16位直接查表（Direct，65536项）。
+2.之后每6位一层，每个节点用两个64位的位图描述64个槽：
+  Vector：哪些槽是子节点，子节点在Nodes里是连续的，第k个子节点是Base1 + popcnt(Vector的低k位)；
+  Leafvec：哪些槽开始一段新的值（相邻的相同的值只存一份），叶子在Leaves里是连续的。
+3.IPv4最多3层（16 + 6 + 6 + 6），IPv6最多19层，每层一次popcnt和一次内存访问。
+
+构建：
+1.前缀按长度从短到长（同样长度的按输入的顺序）插入一个不压缩的多位trie（每个节点64个槽），
+  短的前缀展开（controlled prefix expansion）到它覆盖的所有的槽，新建的子节点继承父槽的值（leaf pushing），
+  所以长的前缀自然覆盖短的，查找时不需要回溯。
+2.再压缩成Poptrie，中间的trie随即释放。
+
+建好的表是只读的，替换用LPM_INDEX：别的线程重建好新表后原子地替换指针，查找的线程不受影响。
+
+参考：
+Poptrie: A Compressed Trie with Population Count for Fast and Scalable Software IP Routing Table Lookup
+(SIGCOMM 2015).
+*/
+
+
+#define LPM_DIRECT_BITS 16
+#define LPM_STRIDE      6
+#define LPM_SLOTS       (1 << LPM_STRIDE)
+#define LPM_NODE_FLAG   0x80000000 //槽（和Direct的项）的最高位为1时，其余的位是节点的下标，否则是值 + 1（0表示没有）。
+#define LPM_BATCH       8
+
+
+typedef struct _POPTRIE_NODE {
+    UINT64 Vector;  //哪些槽是子节点。
+    UINT64 Leafvec; //哪些槽开始一段新的值。
+    UINT32 Base0;   //第一个叶子在Leaves里的下标。
+    UINT32 Base1;   //第一个子节点在Nodes里的下标。
+} POPTRIE_NODE, * PPOPTRIE_NODE;
+
+
+typedef struct _LPM_TRIE {
+    PUINT32 Direct; //没有这个地址族的前缀时为nullptr。
+    PPOPTRIE_NODE Nodes;
+    PUINT32 Leaves; //值 + 1。
+    ULONG NodeCount;
+    ULONG LeafCount;
+    ULONG PrefixCount;
+} LPM_TRIE, * PLPM_TRIE;
+
+
+struct _LPM_TABLE {
+    volatile LONG References;
+    LPM_TRIE Trie[2]; //下标0是IPv4的，1是IPv6的。
+    PMIB_IPFORWARD_ROW2 Routes;
+    ULONG RouteCount;
+};
+
+
+struct _LPM_INDEX {
+    SRWLOCK Lock;                 //保护Current的读取和引用计数的增加。
+    PLPM_TABLE Current;
+    PTP_WORK Work;                //在线程池里重建路由表。
+    HANDLE Notification;          // NotifyRouteChange2的句柄。
+    ADDRESS_FAMILY Family;        //重建的地址族。
+    volatile LONG Pending;        //还没有处理的重建请求的个数，不是0的时候有且只有一个重建在进行（或已提交）。
+    volatile ULONG LastError;     //上一次重建的结果，只在重建的回调里写。
+};
+
+
+//构建时用的不压缩的多位trie，槽的编码同Direct。
+typedef struct _LPM_BUILDER {
+    PUINT32 Direct;
+    PUINT32 Nodes; //每个节点LPM_SLOTS个槽。
+    ULONG NodeCount;
+    ULONG NodeCapacity;
+} LPM_BUILDER, * PLPM_BUILDER;
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static FORCEINLINE ULONG LpmPopCount64(UINT64 Value)
+{
+#if defined(_M_X64)
+    return (ULONG)__popcnt64(Value);
+#else
+    return __popcnt((UINT32)Value) + __popcnt((UINT32)(Value >> 32));
+#endif
+}
+
+
+static FORCEINLINE UINT32 LpmChunk(UINT64 High, UINT64 Low, UINT32 Offset)
+/*
+功能：取128位的键（High是高64位）里从Offset（从最高位数起）开始的6位，超出128位的部分按0。
+
+注意：Offset是16 + 6k，不会跨越High和Low（58 + 6 = 64）。
+*/
+{
+    if (Offset < 64) {
+        return (UINT32)(High >> (64 - LPM_STRIDE - Offset)) & (LPM_SLOTS - 1);
+    }
+
+    if (Offset <= 128 - LPM_STRIDE) {
+        return (UINT32)(Low >> (128 - LPM_STRIDE - Offset)) & (LPM_SLOTS - 1);
+    }
+
+    return (UINT32)(Low << (Offset - (128 - LPM_STRIDE))) & (LPM_SLOTS - 1);
+}
+
+
+static FORCEINLINE UINT32 LpmWalk(_In_ const LPM_TRIE * Trie, _In_ UINT32 Entry, _In_ UINT64 High, _In_ UINT64 Low)
+/*
+功能：从Direct的项开始往下找，返回值（没有匹配的是LPM_NO_MATCH）。
+*/
+{
+    UINT32 Offset = LPM_DIRECT_BITS;
+
+    while (Entry & LPM_NODE_FLAG) {
+        const POPTRIE_NODE * Node = &Trie->Nodes[Entry & ~LPM_NODE_FLAG];
+        const UINT32 Index = LpmChunk(High, Low, Offset);
+        const UINT64 Below = ((UINT64)2 << Index) - 1; //第0~Index位。Index为63时移位的结果是0，减一后是全1。
+
+        if (Node->Vector & ((UINT64)1 << Index)) {
+            Entry = LPM_NODE_FLAG | (Node->Base1 + LpmPopCount64(Node->Vector & Below) - 1);
+        } else {
+            Entry = Trie->Leaves[Node->Base0 + LpmPopCount64(Node->Leafvec & Below) - 1];
+        }
+
+        Offset += LPM_STRIDE;
+    }
+
+    return Entry - 1;
+}
+
+
+static FORCEINLINE void LpmKey4(_In_ const IN_ADDR * Address, _Out_ PUINT64 High, _Out_ PUINT64 Low)
+{
+    *High = (UINT64)ntohl(Address->S_un.S_addr) << 32;
+    *Low = 0;
+}
+
+
+static FORCEINLINE void LpmKey6(_In_ const void * Address, _Out_ PUINT64 High, _Out_ PUINT64 Low)
+{
+    UINT64 Word[2];
+    RtlCopyMemory(Word, Address, sizeof(Word));
+    *High = _byteswap_uint64(Word[0]);
+    *Low = _byteswap_uint64(Word[1]);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//构建。
+
+
+static ULONG BuilderNewNode(_Inout_ PLPM_BUILDER Builder, _In_ UINT32 Fill, _Out_ PULONG Index)
+/*
+功能：新建一个节点，所有的槽都是Fill（父槽原来的值）。
+
+注意：可能会重新分配Nodes，之前取得的指向Nodes的指针都会失效。
+*/
+{
+    if (Builder->NodeCount == Builder->NodeCapacity) {
+        ULONG Capacity = Builder->NodeCapacity ? Builder->NodeCapacity * 2 : 1024;
+        if (Capacity > (LPM_NODE_FLAG - 1) / LPM_SLOTS) {
+            return ERROR_NOT_ENOUGH_MEMORY;
+        }
+
+        PUINT32 Nodes = (PUINT32)MALLOC((SIZE_T)Capacity * LPM_SLOTS * sizeof(UINT32));
+        if (nullptr == Nodes) {
+            return ERROR_NOT_ENOUGH_MEMORY;
+        }
+
+        if (Builder->Nodes) {
+            RtlCopyMemory(Nodes, Builder->Nodes, (SIZE_T)Builder->NodeCount * LPM_SLOTS * sizeof(UINT32));
+            FREE(Builder->Nodes);
+        }
+
+        Builder->Nodes = Nodes;
+        Builder->NodeCapacity = Capacity;
+    }
+
+    *Index = Builder->NodeCount++;
+
+    PUINT32 Slots = &Builder->Nodes[(SIZE_T)*Index * LPM_SLOTS];
+    for (ULONG i = 0; i < LPM_SLOTS; i++) {
+        Slots[i] = Fill;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG BuilderInsert(_Inout_ PLPM_BUILDER Builder,
+                           _In_ UINT64 High,
+                           _In_ UINT64 Low,
+                           _In_ UINT8 PrefixLength,
+                           _In_ UINT32 Entry)
+/*
+功能：插入一个前缀（Entry是值 + 1）。
+
+注意：必须按前缀的长度从短到长插入。这样展开时覆盖的槽都还不是子节点
+（子节点只会由更长的前缀创建），直接覆盖就行了。
+*/
+{
+    if (PrefixLength <= LPM_DIRECT_BITS) {
+        const ULONG Span = 1UL << (LPM_DIRECT_BITS - PrefixLength);
+        const ULONG First = (ULONG)(High >> (64 - LPM_DIRECT_BITS)) & ~(Span - 1);
+
+        for (ULONG i = 0; i < Span; i++) {
+            Builder->Direct[First + i] = Entry;
+        }
+
+        return ERROR_SUCCESS;
+    }
+
+    PUINT32 Slot = &Builder->Direct[High >> (64 - LPM_DIRECT_BITS)];
+    UINT32 Offset = LPM_DIRECT_BITS;
+
+    for (;;) {
+        ULONG Child = 0;
+
+        if (*Slot & LPM_NODE_FLAG) {
+            Child = *Slot & ~LPM_NODE_FLAG;
+        } else {
+            //第一层之后Slot指向Nodes，新建节点可能会重新分配Nodes，先记下它的位置。
+            const SIZE_T SlotOffset = (Offset > LPM_DIRECT_BITS) ? Slot - Builder->Nodes : 0;
+
+            ULONG ret = BuilderNewNode(Builder, *Slot, &Child);
+            if (ERROR_SUCCESS != ret) {
+                return ret;
+            }
+
+            if (Offset > LPM_DIRECT_BITS) {
+                Slot = Builder->Nodes + SlotOffset;
+            }
+
+            *Slot = LPM_NODE_FLAG | Child;
+        }
+
+        PUINT32 Slots = &Builder->Nodes[(SIZE_T)Child * LPM_SLOTS];
+        const UINT32 Index = LpmChunk(High, Low, Offset);
+
+        if (PrefixLength <= Offset + LPM_STRIDE) {
+            const ULONG Span = 1UL << (Offset + LPM_STRIDE - PrefixLength);
+            const ULONG First = Index & ~(Span - 1);
+
+            for (ULONG i = 0; i < Span; i++) {
+                Slots[First + i] = Entry;
+            }
+
+            return ERROR_SUCCESS;
+        }
+
+        Slot = &Slots[Index];
+        Offset += LPM_STRIDE;
+    }
+}
+
+
+static void CompressNode(_In_ const LPM_BUILDER * Builder,
+                         _In_ ULONG Source,
+                         _Inout_ PLPM_TRIE Trie,
+                         _In_ ULONG Target,
+                         _Inout_ PULONG NextNode)
+/*
+功能：把中间的trie的一个节点（及其子树）压缩成Poptrie的节点。
+
+子节点在Nodes里要连续，所以先给所有的子节点占好位置，再逐个递归。
+*/
+{
+    const UINT32 * Slots = &Builder->Nodes[(SIZE_T)Source * LPM_SLOTS];
+    PPOPTRIE_NODE Node = &Trie->Nodes[Target];
+    UINT64 Vector = 0;
+    UINT64 Leafvec = 0;
+    UINT32 Previous = 0;
+    bool First = true;
+
+    Node->Base0 = Trie->LeafCount;
+
+    for (ULONG i = 0; i < LPM_SLOTS; i++) {
+        if (Slots[i] & LPM_NODE_FLAG) {
+            Vector |= (UINT64)1 << i;
+            continue;
+        }
+
+        if (First || Slots[i] != Previous) {
+            Leafvec |= (UINT64)1 << i;
+            Trie->Leaves[Trie->LeafCount++] = Slots[i];
+            Previous = Slots[i];
+            First = false;
+        }
+    }
+
+    Node->Vector = Vector;
+    Node->Leafvec = Leafvec;
+    Node->Base1 = *NextNode;
+    *NextNode += LpmPopCount64(Vector);
+
+    ULONG Child = Node->Base1;
+    for (ULONG i = 0; i < LPM_SLOTS; i++) {
+        if (Slots[i] & LPM_NODE_FLAG) {
+            CompressNode(Builder, Slots[i] & ~LPM_NODE_FLAG, Trie, Child++, NextNode);
+        }
+    }
+}
+
+
+static ULONG CompressTrie(_In_ const LPM_BUILDER * Builder, _Inout_ PLPM_TRIE Trie)
+/*
+功能：把中间的trie压缩成Poptrie。叶子的个数事先数好，一次分配。
+*/
+{
+    ULONG LeafCount = 0;
+
+    for (ULONG n = 0; n < Builder->NodeCount; n++) {
+        const UINT32 * Slots = &Builder->Nodes[(SIZE_T)n * LPM_SLOTS];
+        UINT32 Previous = 0;
+        bool First = true;
+
+        for (ULONG i = 0; i < LPM_SLOTS; i++) {
+            if (0 == (Slots[i] & LPM_NODE_FLAG) && (First || Slots[i] != Previous)) {
+                Previous = Slots[i];
+                First = false;
+                LeafCount++;
+            }
+        }
+    }
+
+    Trie->Direct = (PUINT32)MALLOC(((SIZE_T)1 << LPM_DIRECT_BITS) * sizeof(UINT32));
+    Trie->Nodes = (PPOPTRIE_NODE)MALLOC(max(Builder->NodeCount, 1) * sizeof(POPTRIE_NODE));
+    Trie->Leaves = (PUINT32)MALLOC(max(LeafCount, 1) * sizeof(UINT32));
+    if (nullptr == Trie->Direct || nullptr == Trie->Nodes || nullptr == Trie->Leaves) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    ULONG NextNode = 0;
+    for (ULONG i = 0; i < (1 << LPM_DIRECT_BITS); i++) {
+        UINT32 Entry = Builder->Direct[i];
+
+        if (Entry & LPM_NODE_FLAG) {
+            ULONG Target = NextNode++;
+            CompressNode(Builder, Entry & ~LPM_NODE_FLAG, Trie, Target, &NextNode);
+            Entry = LPM_NODE_FLAG | Target;
+        }
+
+        Trie->Direct[i] = Entry;
+    }
+
+    _ASSERTE(NextNode == Builder->NodeCount && Trie->LeafCount == LeafCount);
+    Trie->NodeCount = NextNode;
+
+    return ERROR_SUCCESS;
+}
+
+
+static int __cdecl CompareUint64(const void * a, const void * b)
+{
+    const UINT64 x = *(const UINT64 *)a;
+    const UINT64 y = *(const UINT64 *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+static void FreeTrie(_Inout_ PLPM_TRIE Trie)
+{
+    if (Trie->Direct) {
+        FREE(Trie->Direct);
+    }
+
+    if (Trie->Nodes) {
+        FREE(Trie->Nodes);
+    }
+
+    if (Trie->Leaves) {
+        FREE(Trie->Leaves);
+    }
+
+    RtlZeroMemory(Trie, sizeof(LPM_TRIE));
+}
+
+
+static ULONG BuildTrie(_In_reads_(Count) const LPM_PREFIX * Prefixes,
+                       _In_reads_(Count) const UINT64 * Order,
+                       _In_ ULONG Count,
+                       _In_ ADDRESS_FAMILY Family,
+                       _Inout_ PLPM_TRIE Trie)
+/*
+功能：用一个地址族的前缀（按Order的顺序）建立Poptrie。
+*/
+{
+    LPM_BUILDER Builder{};
+    ULONG ret = ERROR_SUCCESS;
+
+    for (ULONG i = 0; i < Count; i++) {
+        if (Prefixes[(ULONG)Order[i]].Family == Family) {
+            Trie->PrefixCount++;
+        }
+    }
+
+    if (0 == Trie->PrefixCount) {
+        return ERROR_SUCCESS;
+    }
+
+    Builder.Direct = (PUINT32)MALLOC(((SIZE_T)1 << LPM_DIRECT_BITS) * sizeof(UINT32));
+    if (nullptr == Builder.Direct) {
+        ret = ERROR_NOT_ENOUGH_MEMORY;
+        goto Cleanup;
+    }
+
+    for (ULONG i = 0; i < Count; i++) {
+        const LPM_PREFIX * Prefix = &Prefixes[(ULONG)Order[i]];
+        UINT64 High, Low;
+
+        if (Prefix->Family != Family) {
+            continue;
+        }
+
+        if (AF_INET == Family) {
+            LpmKey4((const IN_ADDR *)Prefix->Address, &High, &Low);
+        } else {
+            LpmKey6(Prefix->Address, &High, &Low);
+        }
+
+        ret = BuilderInsert(&Builder, High, Low, Prefix->PrefixLength, Prefix->Value + 1);
+        if (ERROR_SUCCESS != ret) {
+            goto Cleanup;
+        }
+    }
+
+    ret = CompressTrie(&Builder, Trie);
+
+Cleanup:
+    if (Builder.Direct) {
+        FREE(Builder.Direct);
+    }
+
+    if (Builder.Nodes) {
+        FREE(Builder.Nodes);
+    }
+
+    if (ERROR_SUCCESS != ret) {
+        FreeTrie(Trie);
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI LpmBuild(_In_reads_(Count) const LPM_PREFIX * Prefixes, _In_ ULONG Count, _Out_ PLPM_TABLE * Table)
+/*
+功能：用前缀的列表建立最长前缀匹配的表。
+
+参数：
+Prefixes：IPv4和IPv6的可以混在一起。同一个前缀出现多次的，后面的覆盖前面的。
+Table：用完后调用LpmRelease。
+
+返回值：ERROR_SUCCESS，ERROR_INVALID_PARAMETER或者ERROR_NOT_ENOUGH_MEMORY。
+*/
+{
+    PLPM_TABLE Temp = nullptr;
+    PUINT64 Order = nullptr;
+    ULONG ret = ERROR_SUCCESS;
+
+    *Table = nullptr;
+
+    for (ULONG i = 0; i < Count; i++) {
+        const UINT8 MaxLength = (AF_INET == Prefixes[i].Family) ? 32 : 128;
+
+        if ((AF_INET != Prefixes[i].Family && AF_INET6 != Prefixes[i].Family) ||
+            Prefixes[i].PrefixLength > MaxLength || Prefixes[i].Value > LPM_MAX_VALUE) {
+            return ERROR_INVALID_PARAMETER;
+        }
+    }
+
+    Temp = (PLPM_TABLE)MALLOC(sizeof(LPM_TABLE));
+    Order = (PUINT64)MALLOC(max(Count, 1) * sizeof(UINT64));
+    if (nullptr == Temp || nullptr == Order) {
+        ret = ERROR_NOT_ENOUGH_MEMORY;
+        goto Cleanup;
+    }
+
+    Temp->References = 1;
+
+    //按（长度，下标）排序，即稳定地按长度排序。
+    for (ULONG i = 0; i < Count; i++) {
+        Order[i] = ((UINT64)Prefixes[i].PrefixLength << 32) | i;
+    }
+
+    qsort(Order, Count, sizeof(UINT64), CompareUint64);
+
+    ret = BuildTrie(Prefixes, Order, Count, AF_INET, &Temp->Trie[0]);
+    if (ERROR_SUCCESS != ret) {
+        goto Cleanup;
+    }
+
+    ret = BuildTrie(Prefixes, Order, Count, AF_INET6, &Temp->Trie[1]);
+    if (ERROR_SUCCESS != ret) {
+        goto Cleanup;
+    }
+
+    *Table = Temp;
+    Temp = nullptr;
+
+Cleanup:
+    if (Order) {
+        FREE(Order);
+    }
+
+    if (Temp) {
+        LpmRelease(Temp);
+    }
+
+    return ret;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI LpmBuildFromRouteTable(_In_ ADDRESS_FAMILY Family, _Out_ PLPM_TABLE * Table)
+/*
+功能：用（GetIpForwardTable2获取的）系统的路由表建立最长前缀匹配的表。
+
+参数：
+Family：AF_INET，AF_INET6或者AF_UNSPEC（两者都要）。
+
+用法：
+UINT32 Value = LpmLookup4(Table, &Destination);
+if (LPM_NO_MATCH != Value) {
+    MIB_IPFORWARD_ROW2 Route;
+    LpmGetRoute(Table, Value, &Route); //Route.NextHop，Route.InterfaceIndex等。
+}
+
+注意：
+1.前缀相同的路由取Metric最小的。只考虑了路由的Metric，没有加上接口的Metric，所以和GetBestRoute2的结果可能不同。
+2.路由表会变，需要时请重建（见LpmIndexRebuildFromRouteTable）。
+*/
+{
+    PMIB_IPFORWARD_TABLE2 ForwardTable = nullptr;
+    PLPM_PREFIX Prefixes = nullptr;
+    PUINT64 Order = nullptr;
+    PLPM_TABLE Temp = nullptr;
+    ULONG Count = 0;
+
+    *Table = nullptr;
+
+    ULONG ret = GetIpForwardTable2(Family, &ForwardTable);
+    if (NO_ERROR != ret) {
+        return ret;
+    }
+
+    Count = ForwardTable->NumEntries;
+    if (Count > LPM_MAX_VALUE) {
+        ret = ERROR_INVALID_DATA;
+        goto Cleanup;
+    }
+
+    Prefixes = (PLPM_PREFIX)MALLOC(max(Count, 1) * sizeof(LPM_PREFIX));
+    Order = (PUINT64)MALLOC(max(Count, 1) * sizeof(UINT64));
+    if (nullptr == Prefixes || nullptr == Order) {
+        ret = ERROR_NOT_ENOUGH_MEMORY;
+        goto Cleanup;
+    }
+
+    //Metric大的在前，LpmBuild里同样的前缀后面的覆盖前面的，所以最后留下的是Metric最小的。
+    for (ULONG i = 0; i < Count; i++) {
+        Order[i] = ((UINT64)(MAXULONG - ForwardTable->Table[i].Metric) << 32) | i;
+    }
+
+    qsort(Order, Count, sizeof(UINT64), CompareUint64);
+
+    for (ULONG i = 0; i < Count; i++) {
+        const ULONG n = (ULONG)Order[i];
+        const IP_ADDRESS_PREFIX * Prefix = &ForwardTable->Table[n].DestinationPrefix;
+
+        Prefixes[i].Family = Prefix->Prefix.si_family;
+        Prefixes[i].PrefixLength = Prefix->PrefixLength;
+        Prefixes[i].Value = n;
+
+        if (AF_INET == Prefix->Prefix.si_family) {
+            RtlCopyMemory(Prefixes[i].Address, &Prefix->Prefix.Ipv4.sin_addr, sizeof(IN_ADDR));
+        } else {
+            RtlCopyMemory(Prefixes[i].Address, &Prefix->Prefix.Ipv6.sin6_addr, sizeof(IN6_ADDR));
+        }
+    }
+
+    ret = LpmBuild(Prefixes, Count, &Temp);
+    if (ERROR_SUCCESS != ret) {
+        goto Cleanup;
+    }
+
+    Temp->Routes = (PMIB_IPFORWARD_ROW2)MALLOC(max(Count, 1) * sizeof(MIB_IPFORWARD_ROW2));
+    if (nullptr == Temp->Routes) {
+        ret = ERROR_NOT_ENOUGH_MEMORY;
+        goto Cleanup;
+    }
+
+    RtlCopyMemory(Temp->Routes, ForwardTable->Table, Count * sizeof(MIB_IPFORWARD_ROW2));
+    Temp->RouteCount = Count;
+
+    *Table = Temp;
+    Temp = nullptr;
+
+Cleanup:
+    if (Temp) {
+        LpmRelease(Temp);
+    }
+
+    if (Order) {
+        FREE(Order);
+    }
+
+    if (Prefixes) {
+        FREE(Prefixes);
+    }
+
+    FreeMibTable(ForwardTable);
+
+    return ret;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI LpmGetRoute(_In_ const LPM_TABLE * Table, _In_ UINT32 Value, _Out_ PMIB_IPFORWARD_ROW2 Route)
+/*
+功能：取LpmBuildFromRouteTable建的表里，查找的结果（Value）对应的路由。
+
+返回值：ERROR_SUCCESS或者ERROR_NOT_FOUND（LPM_NO_MATCH，或者不是用路由表建的）。
+*/
+{
+    if (Value >= Table->RouteCount) {
+        RtlZeroMemory(Route, sizeof(MIB_IPFORWARD_ROW2));
+        return ERROR_NOT_FOUND;
+    }
+
+    *Route = Table->Routes[Value];
+
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI LpmQueryTable(_In_ const LPM_TABLE * Table, _Out_ PLPM_TABLE_INFORMATION Information)
+{
+    RtlZeroMemory(Information, sizeof(LPM_TABLE_INFORMATION));
+
+    Information->Bytes = sizeof(LPM_TABLE) + (SIZE_T)Table->RouteCount * sizeof(MIB_IPFORWARD_ROW2);
+    Information->Routes = Table->RouteCount;
+
+    for (int i = 0; i < 2; i++) {
+        const LPM_TRIE * Trie = &Table->Trie[i];
+
+        Information->Prefixes[i] = Trie->PrefixCount;
+        Information->Nodes[i] = Trie->NodeCount;
+        Information->Leaves[i] = Trie->LeafCount;
+
+        if (Trie->Direct) {
+            Information->Bytes += ((SIZE_T)1 << LPM_DIRECT_BITS) * sizeof(UINT32) +
+                                  (SIZE_T)Trie->NodeCount * sizeof(POPTRIE_NODE) +
+                                  (SIZE_T)Trie->LeafCount * sizeof(UINT32);
+        }
+    }
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI LpmAddRef(_In_ PLPM_TABLE Table)
+{
+    InterlockedIncrement(&Table->References);
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI LpmRelease(_In_opt_ PLPM_TABLE Table)
+/*
+功能：减少引用计数，为0时释放。
+*/
+{
+    if (nullptr == Table || InterlockedDecrement(&Table->References) != 0) {
+        return;
+    }
+
+    FreeTrie(&Table->Trie[0]);
+    FreeTrie(&Table->Trie[1]);
+
+    if (Table->Routes) {
+        FREE(Table->Routes);
+    }
+
+    FREE(Table);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//查找。
+
+
+EXTERN_C
+DLLEXPORT
+UINT32 WINAPI LpmLookup4(_In_ const LPM_TABLE * Table, _In_ const IN_ADDR * Address)
+/*
+功能：查找IPv4地址的最长匹配的前缀。
+
+返回值：前缀的值，没有匹配的返回LPM_NO_MATCH。
+*/
+{
+    const LPM_TRIE * Trie = &Table->Trie[0];
+    UINT64 High, Low;
+
+    if (nullptr == Trie->Direct) {
+        return LPM_NO_MATCH;
+    }
+
+    LpmKey4(Address, &High, &Low);
+
+    return LpmWalk(Trie, Trie->Direct[High >> (64 - LPM_DIRECT_BITS)], High, Low);
+}
+
+
+EXTERN_C
+DLLEXPORT
+UINT32 WINAPI LpmLookup6(_In_ const LPM_TABLE * Table, _In_ const IN6_ADDR * Address)
+/*
+功能：查找IPv6地址的最长匹配的前缀。
+
+返回值：前缀的值，没有匹配的返回LPM_NO_MATCH。
+*/
+{
+    const LPM_TRIE * Trie = &Table->Trie[1];
+    UINT64 High, Low;
+
+    if (nullptr == Trie->Direct) {
+        return LPM_NO_MATCH;
+    }
+
+    LpmKey6(Address, &High, &Low);
+
+    return LpmWalk(Trie, Trie->Direct[High >> (64 - LPM_DIRECT_BITS)], High, Low);
+}
+
+
+static void LpmLookupBatch(_In_ const LPM_TRIE * Trie,
+                           _In_reads_bytes_(Count * Stride) const BYTE * Addresses,
+                           _In_ ULONG Stride,
+                           _In_ ULONG Count,
+                           _Out_writes_(Count) PUINT32 Values)
+/*
+功能：批量查找。每LPM_BATCH个一组：先查Direct并预取第一层的节点，再逐个往下找，
+这样各个地址的内存访问可以重叠，而不是一个接一个地等待缓存未命中。
+*/
+{
+    if (nullptr == Trie->Direct) {
+        for (ULONG i = 0; i < Count; i++) {
+            Values[i] = LPM_NO_MATCH;
+        }
+
+        return;
+    }
+
+    for (ULONG i = 0; i < Count; i += LPM_BATCH) {
+        const ULONG n = min(LPM_BATCH, Count - i);
+        UINT64 High[LPM_BATCH], Low[LPM_BATCH];
+        UINT32 Entry[LPM_BATCH];
+
+        for (ULONG j = 0; j < n; j++) {
+            const BYTE * Address = Addresses + (SIZE_T)(i + j) * Stride;
+
+            if (sizeof(IN_ADDR) == Stride) {
+                LpmKey4((const IN_ADDR *)Address, &High[j], &Low[j]);
+            } else {
+                LpmKey6(Address, &High[j], &Low[j]);
+            }
+
+            Entry[j] = Trie->Direct[High[j] >> (64 - LPM_DIRECT_BITS)];
+            if (Entry[j] & LPM_NODE_FLAG) {
+                PreFetchCacheLine(PF_TEMPORAL_LEVEL_1, &Trie->Nodes[Entry[j] & ~LPM_NODE_FLAG]);
+            }
+        }
+
+        for (ULONG j = 0; j < n; j++) {
+            Values[i + j] = LpmWalk(Trie, Entry[j], High[j], Low[j]);
+        }
+    }
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI LpmLookup4Batch(_In_ const LPM_TABLE * Table,
+                            _In_reads_(Count) const IN_ADDR * Addresses,
+                            _In_ ULONG Count,
+                            _Out_writes_(Count) PUINT32 Values)
+/*
+功能：批量查找IPv4地址，结果和逐个调用LpmLookup4的一样。
+*/
+{
+    LpmLookupBatch(&Table->Trie[0], (const BYTE *)Addresses, sizeof(IN_ADDR), Count, Values);
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI LpmLookup6Batch(_In_ const LPM_TABLE * Table,
+                            _In_reads_(Count) const IN6_ADDR * Addresses,
+                            _In_ ULONG Count,
+                            _Out_writes_(Count) PUINT32 Values)
+/*
+功能：批量查找IPv6地址，结果和逐个调用LpmLookup6的一样。
+*/
+{
+    LpmLookupBatch(&Table->Trie[1], (const BYTE *)Addresses, sizeof(IN6_ADDR), Count, Values);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/*
+LPM_INDEX：当前的表。
+
+查找的线程：Table = LpmIndexAcquire(Index); 批量查找; LpmRelease(Table);
+重建的线程：LpmBuild*建好新表后LpmIndexPublish，旧表在最后一个使用者释放后才被释放。
+
+锁只保护取指针和增加引用计数的那一瞬间（共享模式），替换时只是在独占模式下换一下指针，
+建表（耗时的部分）完全在锁外，所以查找的线程不会被重建阻塞。
+*/
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI LpmIndexCreate(_Out_ PLPM_INDEX * Index)
+{
+    *Index = (PLPM_INDEX)MALLOC(sizeof(LPM_INDEX));
+    if (nullptr == *Index) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    InitializeSRWLock(&(*Index)->Lock);
+
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI LpmIndexPublish(_In_ PLPM_INDEX Index, _In_opt_ PLPM_TABLE Table)
+/*
+功能：替换当前的表。
+
+参数：
+Table：接管调用者的一个引用（调用后不要再LpmRelease）。可以是nullptr。
+*/
+{
+    AcquireSRWLockExclusive(&Index->Lock);
+    PLPM_TABLE Old = Index->Current;
+    Index->Current = Table;
+    ReleaseSRWLockExclusive(&Index->Lock);
+
+    LpmRelease(Old);
+}
+
+
+EXTERN_C
+DLLEXPORT
+PLPM_TABLE WINAPI LpmIndexAcquire(_In_ PLPM_INDEX Index)
+/*
+功能：取当前的表（增加了引用计数），用完后调用LpmRelease。
+
+返回值：还没有发布过表时是nullptr。
+*/
+{
+    AcquireSRWLockShared(&Index->Lock);
+    PLPM_TABLE Table = Index->Current;
+    if (Table) {
+        InterlockedIncrement(&Table->References);
+    }
+    ReleaseSRWLockShared(&Index->Lock);
+
+    return Table;
+}
+
+
+static VOID CALLBACK LpmRebuildCallback(_Inout_ PTP_CALLBACK_INSTANCE Instance,
+                                        _Inout_opt_ PVOID Context,
+                                        _Inout_ PTP_WORK Work)
+{
+    UNREFERENCED_PARAMETER(Instance);
+    UNREFERENCED_PARAMETER(Work);
+
+    PLPM_INDEX Index = (PLPM_INDEX)Context;
+    LONG Requests = InterlockedCompareExchange(&Index->Pending, 0, 0);
+
+    // Pending不是0时不会再提交，所以同时只有这一个重建，发布的顺序就是建表的顺序。
+    //建表期间又有路由变化的（Pending变了）再建一次，直到建表期间没有新的请求。
+    for (;;) {
+        PLPM_TABLE Table = nullptr;
+
+        ULONG ret = LpmBuildFromRouteTable(Index->Family, &Table);
+        if (ERROR_SUCCESS == ret) {
+            LpmIndexPublish(Index, Table);
+        }
+
+        Index->LastError = ret;
+
+        LONG Current = InterlockedCompareExchange(&Index->Pending, 0, Requests);
+        if (Current == Requests) {
+            break; //清零之后的请求会重新提交。
+        }
+
+        Requests = Current;
+    }
+}
+
+
+static VOID NETIOAPI_API_ LpmRouteChangeCallback(_In_ PVOID CallerContext,
+                                                 _In_opt_ PMIB_IPFORWARD_ROW2 Row,
+                                                 _In_ MIB_NOTIFICATION_TYPE NotificationType)
+{
+    UNREFERENCED_PARAMETER(Row);
+    UNREFERENCED_PARAMETER(NotificationType);
+
+    PLPM_INDEX Index = (PLPM_INDEX)CallerContext;
+
+    if (1 == InterlockedIncrement(&Index->Pending)) { //有重建在进行的由它再建一次。
+        SubmitThreadpoolWork(Index->Work);
+    }
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI LpmIndexRebuildFromRouteTable(_In_ PLPM_INDEX Index, _In_ ADDRESS_FAMILY Family, _In_ BOOLEAN Watch)
+/*
+功能：在线程池里用系统的路由表重建，完成后替换当前的表。立即返回。
+
+参数：
+Family：见LpmBuildFromRouteTable。
+Watch：为TRUE时，之后路由表每次变化都自动重建（频繁的变化会被合并）。
+
+返回值：提交的结果。重建的结果见LpmIndexWait。
+
+注意：一个LPM_INDEX只应该调用一次Watch为TRUE的，Family以最后一次调用的为准。
+*/
+{
+    if (nullptr == Index->Work) {
+        Index->Work = CreateThreadpoolWork(LpmRebuildCallback, Index, nullptr);
+        if (nullptr == Index->Work) {
+            return GetLastError();
+        }
+    }
+
+    Index->Family = Family;
+
+    if (Watch && nullptr == Index->Notification) {
+        ULONG ret = NotifyRouteChange2(Family, LpmRouteChangeCallback, Index, FALSE, &Index->Notification);
+        if (NO_ERROR != ret) {
+            Index->Notification = nullptr;
+            return ret;
+        }
+    }
+
+    if (1 == InterlockedIncrement(&Index->Pending)) { //有重建在进行的由它再建一次。
+        SubmitThreadpoolWork(Index->Work);
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI LpmIndexWait(_In_ PLPM_INDEX Index)
+/*
+功能：等待已经提交的重建完成。
+
+返回值：上一次重建的结果（LpmBuildFromRouteTable的返回值）。
+*/
+{
+    if (Index->Work) {
+        WaitForThreadpoolWorkCallbacks(Index->Work, FALSE);
+    }
+
+    return Index->LastError;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI LpmIndexDestroy(_In_ PLPM_INDEX Index)
+/*
+功能：停止监视路由表，等待正在进行的重建，释放当前的表（还在使用的在最后一个LpmRelease时释放）。
+*/
+{
+    if (Index->Notification) {
+        CancelMibChangeNotify2(Index->Notification);
+    }
+
+    if (Index->Work) {
+        WaitForThreadpoolWorkCallbacks(Index->Work, TRUE);
+        CloseThreadpoolWork(Index->Work);
+    }
+
+    LpmIndexPublish(Index, nullptr);
+
+    FREE(Index);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
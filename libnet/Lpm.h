@@ -0,0 +1,100 @@
+﻿#pragma once
+
+#include "pch.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#define LPM_NO_MATCH  MAXUINT32  // LpmLookup*没有匹配的前缀时返回的值。
+#define LPM_MAX_VALUE 0x7ffffffe //前缀的值的上限。
+
+
+//一个前缀，见LpmBuild。
+typedef struct _LPM_PREFIX {
+    ADDRESS_FAMILY Family; // AF_INET或者AF_INET6。
+    UINT8 PrefixLength;
+    UINT8 Reserved;
+    UINT32 Value;          //匹配时返回的值（如：路由的下标，标签），不大于LPM_MAX_VALUE。
+    BYTE Address[16];      //网络序，IPv4的只用前4个字节。主机部分会被忽略。
+} LPM_PREFIX, * PLPM_PREFIX;
+
+
+typedef struct _LPM_TABLE_INFORMATION {
+    ULONG Prefixes[2]; //下标0是IPv4的，1是IPv6的，下同。
+    ULONG Nodes[2];
+    ULONG Leaves[2];
+    ULONG Routes;      // LpmBuildFromRouteTable保存的路由的个数。
+    SIZE_T Bytes;      //总共占用的内存。
+} LPM_TABLE_INFORMATION, * PLPM_TABLE_INFORMATION;
+
+
+typedef struct _LPM_TABLE LPM_TABLE, * PLPM_TABLE; //建好后只读，多个线程可以同时查找。有引用计数。
+typedef struct _LPM_INDEX LPM_INDEX, * PLPM_INDEX; //当前的LPM_TABLE，可以在别的线程重建后原子地替换。
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C_START
+
+
+DLLEXPORT
+ULONG WINAPI LpmBuild(_In_reads_(Count) const LPM_PREFIX * Prefixes, _In_ ULONG Count, _Out_ PLPM_TABLE * Table);
+
+DLLEXPORT
+ULONG WINAPI LpmBuildFromRouteTable(_In_ ADDRESS_FAMILY Family, _Out_ PLPM_TABLE * Table);
+
+DLLEXPORT
+ULONG WINAPI LpmGetRoute(_In_ const LPM_TABLE * Table, _In_ UINT32 Value, _Out_ PMIB_IPFORWARD_ROW2 Route);
+
+DLLEXPORT
+void WINAPI LpmQueryTable(_In_ const LPM_TABLE * Table, _Out_ PLPM_TABLE_INFORMATION Information);
+
+DLLEXPORT
+void WINAPI LpmAddRef(_In_ PLPM_TABLE Table);
+
+DLLEXPORT
+void WINAPI LpmRelease(_In_opt_ PLPM_TABLE Table);
+
+DLLEXPORT
+UINT32 WINAPI LpmLookup4(_In_ const LPM_TABLE * Table, _In_ const IN_ADDR * Address);
+
+DLLEXPORT
+UINT32 WINAPI LpmLookup6(_In_ const LPM_TABLE * Table, _In_ const IN6_ADDR * Address);
+
+DLLEXPORT
+void WINAPI LpmLookup4Batch(_In_ const LPM_TABLE * Table,
+                            _In_reads_(Count) const IN_ADDR * Addresses,
+                            _In_ ULONG Count,
+                            _Out_writes_(Count) PUINT32 Values);
+
+DLLEXPORT
+void WINAPI LpmLookup6Batch(_In_ const LPM_TABLE * Table,
+                            _In_reads_(Count) const IN6_ADDR * Addresses,
+                            _In_ ULONG Count,
+                            _Out_writes_(Count) PUINT32 Values);
+
+DLLEXPORT
+ULONG WINAPI LpmIndexCreate(_Out_ PLPM_INDEX * Index);
+
+DLLEXPORT
+void WINAPI LpmIndexPublish(_In_ PLPM_INDEX Index, _In_opt_ PLPM_TABLE Table);
+
+DLLEXPORT
+PLPM_TABLE WINAPI LpmIndexAcquire(_In_ PLPM_INDEX Index);
+
+DLLEXPORT
+ULONG WINAPI LpmIndexRebuildFromRouteTable(_In_ PLPM_INDEX Index, _In_ ADDRESS_FAMILY Family, _In_ BOOLEAN Watch);
+
+DLLEXPORT
+ULONG WINAPI LpmIndexWait(_In_ PLPM_INDEX Index);
+
+DLLEXPORT
+void WINAPI LpmIndexDestroy(_In_ PLPM_INDEX Index);
+
+
+EXTERN_C_END
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,990 @@
+﻿#include "OwnerCache.h"
+#include "TableBackend.h"
+
+#ifdef _WIN32
+#include "TableSnapshot.h"
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/*
+连接的所属进程（模块）的缓存。
+
+GetOwnerModuleFromTcpEntry等每一行都要打开进程，查映像的路径（服务的还要查服务的名字），
+而几千行的表一般只属于十几个进程。这里按进程缓存查到的结果，批量的一次查一个表。
+
+1.键：PID和进程的创建时间。行里只有PID，所以条目记下查的时候的进程（Windows的是有SYNCHRONIZE的句柄，
+  Linux的是pidfd，都不行的是/proc/[pid]/stat的starttime），用之前确认还是这个进程（进程退出后PID会被重用），
+  退出了的删掉重查。一次调用（一批）里每个条目最多确认一次。
+  Windows的同一个进程（svchost）里的不同的服务的OwningModuleInfo不同，也是键的一部分。
+2.查不到的（没有权限，进程已经退出等）也缓存（否定的），和没有办法确认进程的一样，OWNER_CACHE_MAX_AGE后过期。
+3.条目满了淘汰最久没有用到的（遍历，只在满了时），这次调用用到过的不淘汰（返回的指针要在调用后有效）。
+4.Linux的Name是/proc/[pid]/comm，Path是/proc/[pid]/exe（readlink），和Windows的一样走这个缓存。
+
+注意：
+1.OWNER_CACHE不是线程安全的，多线程的用OwnerCacheAcquireDefault，或者自己加锁。
+2.Windows的条目持有进程的句柄，进程退出后在下次用到或者OwnerCacheSweep时才关闭。
+3.Linux的这个文件和TableBackendLinux.cpp一起编译，如：
+  g++ -std=c++17 -O2 -shared -fPIC TableBackendLinux.cpp OwnerCache.cpp -o libnet.so
+
+参考：
+https://learn.microsoft.com/en-us/windows/win32/api/iphlpapi/nf-iphlpapi-getownermodulefrompidandinfo
+https://man7.org/linux/man-pages/man2/pidfd_open.2.html
+https://man7.org/linux/man-pages/man5/proc_pid_stat.5.html
+*/
+
+
+#define OWNER_CACHE_MAX_ENTRIES (1 << 20)
+#define OWNER_CACHE_MAX_PIDFDS  256 // Linux的最多占用的pidfd，超过的比较starttime（不占文件描述符）。
+
+
+typedef struct _OWNER_CACHE_ENTRY {
+    struct _OWNER_CACHE_ENTRY * Next; //哈希桶的链表。
+    OWNER_MODULE Module;              // Name和Path指向Strings。
+    UINT64 Inserted;                  //毫秒（单调的时钟）。
+    SIZE_T Size;                      //占用的内存，包括这个头。
+    ULONG Hash;
+    ULONG Status;                     //查的结果，ERROR_SUCCESS以外的是否定的条目。
+    ULONG Validated;                  //上一次确认进程还在的调用的序号（OWNER_CACHE的Epoch）。
+    ULONG Used;                       //上一次用到的调用的序号，满了时淘汰最旧的。
+#ifdef _WIN32
+    HANDLE Process;                   //打不开的是nullptr。
+    UINT64 ModuleInfo[OWNER_MODULE_INFO_SIZE];
+#else
+    int PidFd;                        //没有的是-1。
+#endif
+    OWNER_CHAR Strings[1];            // Name和Path，都以0结尾。
+} OWNER_CACHE_ENTRY, * POWNER_CACHE_ENTRY;
+
+
+struct _OWNER_CACHE {
+    POWNER_CACHE_ENTRY * Buckets;
+    ULONG BucketMask;
+    ULONG MaxEntries;
+    ULONG Entries;
+    ULONG Epoch;       //每次OwnerCacheLookup，OwnerCacheResolve等加1。
+    SIZE_T Bytes;      //条目占用的内存。
+
+    PVOID Scratch;     //查系统用的缓冲区，只增不减。
+    ULONG ScratchSize;
+#ifndef _WIN32
+    ULONG PidFds;
+#endif
+
+    UINT64 Lookups;
+    UINT64 Hits;
+    UINT64 Misses;
+    UINT64 NegativeHits;
+    UINT64 Invalidations;
+    UINT64 Evictions;
+};
+
+
+//批量查找时记住上一行的结果，相邻的同一个进程（表一般是按进程聚集的）不用再查哈希表。
+typedef struct _OWNER_CACHE_PREVIOUS {
+    BOOL Valid;
+    ULONG Pid;
+    const UINT64 * ModuleInfo;
+    const OWNER_MODULE * Module;
+    ULONG Status;
+} OWNER_CACHE_PREVIOUS, * POWNER_CACHE_PREVIOUS;
+
+
+#ifdef _WIN32
+static SRWLOCK g_OwnerCacheLock = SRWLOCK_INIT;
+#else
+static pthread_mutex_t g_OwnerCacheLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+static POWNER_CACHE g_OwnerCache; // OwnerCacheAcquireDefault，进程退出前不释放。
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//平台相关的：时钟，查进程，确认进程还在。
+
+
+#ifdef _WIN32
+
+
+static UINT64 TickCount()
+{
+    return GetTickCount64();
+}
+
+
+static void CloseEntry(_Inout_ POWNER_CACHE Cache, _Inout_ POWNER_CACHE_ENTRY Entry)
+{
+    UNREFERENCED_PARAMETER(Cache);
+
+    if (Entry->Process) {
+        CloseHandle(Entry->Process);
+        Entry->Process = nullptr;
+    }
+}
+
+
+static BOOL IsProcessAlive(_In_ POWNER_CACHE_ENTRY Entry, _In_ UINT64 Now)
+{
+    if (Entry->Process) {
+        return WAIT_TIMEOUT == WaitForSingleObject(Entry->Process, 0);
+    }
+
+    return Now - Entry->Inserted < OWNER_CACHE_MAX_AGE; //系统进程等打不开的，PID可能已经被重用了。
+}
+
+
+static ULONG QueryOwner(_Inout_ POWNER_CACHE Cache,
+                        _In_ ULONG Pid,
+                        _In_opt_ const UINT64 * ModuleInfo,
+                        _Out_ POWNER_CACHE_ENTRY * Result)
+/*
+功能：查系统，生成一个条目（包括否定的）。
+
+返回值：ERROR_SUCCESS（条目的Status是查的结果），或者ERROR_NOT_ENOUGH_MEMORY。
+
+注意：先打开进程再查，确认的是查到的这个进程。
+*/
+{
+    *Result = nullptr;
+
+    UINT64 Info[OWNER_MODULE_INFO_SIZE] = {};
+    if (ModuleInfo) {
+        RtlCopyMemory(Info, ModuleInfo, sizeof(Info));
+    }
+
+    UINT64 CreateTime = 0;
+    HANDLE Process = OpenProcess(SYNCHRONIZE | PROCESS_QUERY_LIMITED_INFORMATION, FALSE, Pid);
+    if (Process) {
+        FILETIME Create{}, Exit{}, Kernel{}, User{};
+
+        if (GetProcessTimes(Process, &Create, &Exit, &Kernel, &User)) {
+            CreateTime = (static_cast<UINT64>(Create.dwHighDateTime) << 32) | Create.dwLowDateTime;
+        }
+    }
+
+    ULONG Status = ERROR_INSUFFICIENT_BUFFER;
+    for (ULONG Tries = 0; ERROR_INSUFFICIENT_BUFFER == Status && Tries < 4; Tries++) {
+        DWORD Size = Cache->ScratchSize;
+
+        Status = GetOwnerModuleFromPidAndInfo(Pid,
+                                              Info,
+                                              TCPIP_OWNER_MODULE_INFO_BASIC,
+                                              Cache->Scratch,
+                                              &Size);
+        if (ERROR_INSUFFICIENT_BUFFER == Status) {
+            PVOID Scratch = MALLOC(Size);
+            if (nullptr == Scratch) {
+                Status = ERROR_NOT_ENOUGH_MEMORY;
+                break;
+            }
+
+            FREE(Cache->Scratch);
+            Cache->Scratch = Scratch;
+            Cache->ScratchSize = Size;
+        }
+    }
+
+    PCWSTR Name = L"";
+    PCWSTR Path = L"";
+    if (ERROR_SUCCESS == Status) {
+        auto Basic = reinterpret_cast<PTCPIP_OWNER_MODULE_BASIC_INFO>(Cache->Scratch);
+
+        Name = Basic->pModuleName ? Basic->pModuleName : L"";
+        Path = Basic->pModulePath ? Basic->pModulePath : L"";
+    }
+
+    SIZE_T NameLength = wcslen(Name) + 1;
+    SIZE_T PathLength = wcslen(Path) + 1;
+    SIZE_T Size = FIELD_OFFSET(OWNER_CACHE_ENTRY, Strings) + (NameLength + PathLength) * sizeof(WCHAR);
+    auto Entry = reinterpret_cast<POWNER_CACHE_ENTRY>(ERROR_NOT_ENOUGH_MEMORY == Status ? nullptr : MALLOC(Size));
+    if (nullptr == Entry) {
+        if (Process) {
+            CloseHandle(Process);
+        }
+
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    RtlCopyMemory(Entry->Strings, Name, NameLength * sizeof(WCHAR));
+    RtlCopyMemory(Entry->Strings + NameLength, Path, PathLength * sizeof(WCHAR));
+    RtlCopyMemory(Entry->ModuleInfo, Info, sizeof(Info));
+
+    Entry->Module.Pid = Pid;
+    Entry->Module.CreateTime = CreateTime;
+    Entry->Module.Name = Entry->Strings;
+    Entry->Module.Path = Entry->Strings + NameLength;
+    Entry->Size = Size;
+    Entry->Status = Status;
+    Entry->Process = Process;
+
+    *Result = Entry;
+    return ERROR_SUCCESS;
+}
+
+
+#else
+
+
+static UINT64 TickCount()
+{
+    struct timespec Now;
+
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (UINT64)Now.tv_sec * 1000 + (UINT64)Now.tv_nsec / 1000000;
+}
+
+
+static ULONG ErrnoToStatus(_In_ int Error)
+{
+    switch (Error) {
+    case 0:
+        return ERROR_SUCCESS;
+    case ENOENT:
+    case ESRCH:
+        return ERROR_NOT_FOUND; //进程已经退出了，同GetOwnerModuleFromPidAndInfo。
+    case EACCES:
+    case EPERM:
+        return ERROR_ACCESS_DENIED;
+    case ENOMEM:
+        return ERROR_NOT_ENOUGH_MEMORY;
+    default:
+        return ERROR_GEN_FAILURE;
+    }
+}
+
+
+static ULONG ReadProcFile(_In_ ULONG Pid,
+                          _In_ PCSTR File,
+                          _Out_writes_(Size) char * Buffer,
+                          _In_ ULONG Size,
+                          _Out_ PULONG Length)
+/*
+功能：读/proc/[pid]/File的开头（最多Size - 1个字节），以0结尾。
+*/
+{
+    char Path[64];
+
+    *Length = 0;
+    Buffer[0] = 0;
+    snprintf(Path, sizeof(Path), "/proc/%u/%s", Pid, File);
+
+    int Fd = open(Path, O_RDONLY | O_CLOEXEC);
+    if (Fd < 0) {
+        return ErrnoToStatus(errno);
+    }
+
+    ssize_t Bytes = read(Fd, Buffer, Size - 1);
+    ULONG Status = Bytes < 0 ? ErrnoToStatus(errno) : ERROR_SUCCESS;
+    close(Fd);
+
+    if (ERROR_SUCCESS == Status) {
+        Buffer[Bytes] = 0;
+        *Length = (ULONG)Bytes;
+    }
+
+    return Status;
+}
+
+
+static ULONG ReadStartTime(_In_ ULONG Pid, _Out_ PUINT64 StartTime)
+/*
+功能：/proc/[pid]/stat的第22个字段（starttime，开机后的时钟滴答数），同一个PID的不同的进程的不同。
+
+注意：第2个字段（comm）可以有空格和括号，从最后一个')'往后数。
+*/
+{
+    char Buffer[512];
+    ULONG Length = 0;
+
+    *StartTime = 0;
+
+    ULONG Status = ReadProcFile(Pid, "stat", Buffer, sizeof(Buffer), &Length);
+    if (ERROR_SUCCESS != Status) {
+        return Status;
+    }
+
+    const char * Text = strrchr(Buffer, ')');
+    if (nullptr == Text) {
+        return ERROR_INVALID_DATA;
+    }
+
+    for (ULONG Field = 2; Field < 22; Field++) { //第3个字段（state）开始，每个前面一个空格。
+        Text = strchr(Text + 1, ' ');
+        if (nullptr == Text) {
+            return ERROR_INVALID_DATA;
+        }
+    }
+
+    char * End = nullptr;
+    *StartTime = strtoull(Text + 1, &End, 10);
+    return End == Text + 1 ? ERROR_INVALID_DATA : ERROR_SUCCESS;
+}
+
+
+static int OpenPidFd(_Inout_ POWNER_CACHE Cache, _In_ ULONG Pid)
+{
+#ifdef SYS_pidfd_open
+    if (Cache->PidFds < OWNER_CACHE_MAX_PIDFDS) {
+        int PidFd = (int)syscall(SYS_pidfd_open, (pid_t)Pid, 0);
+        if (PidFd >= 0) { //有FD_CLOEXEC。
+            Cache->PidFds++;
+        }
+
+        return PidFd;
+    }
+#else
+    UNREFERENCED_PARAMETER(Cache);
+    UNREFERENCED_PARAMETER(Pid);
+#endif
+
+    return -1;
+}
+
+
+static void CloseEntry(_Inout_ POWNER_CACHE Cache, _Inout_ POWNER_CACHE_ENTRY Entry)
+{
+    if (Entry->PidFd >= 0) {
+        close(Entry->PidFd);
+        Entry->PidFd = -1;
+        Cache->PidFds--;
+    }
+}
+
+
+static BOOL IsProcessAlive(_In_ POWNER_CACHE_ENTRY Entry, _In_ UINT64 Now)
+{
+    UNREFERENCED_PARAMETER(Now);
+
+    if (Entry->PidFd >= 0) {
+        struct pollfd Poll = {Entry->PidFd, POLLIN, 0};
+
+        return 0 == poll(&Poll, 1, 0); //进程退出（包括僵尸）后可读。
+    }
+
+    if (ERROR_SUCCESS != Entry->Status) {
+        return TRUE; //按时间过期，见IsEntryValid。
+    }
+
+    UINT64 StartTime = 0;
+    return ERROR_SUCCESS == ReadStartTime(Entry->Module.Pid, &StartTime) && StartTime == Entry->Module.CreateTime;
+}
+
+
+static ULONG QueryOwner(_Inout_ POWNER_CACHE Cache,
+                        _In_ ULONG Pid,
+                        _In_opt_ const UINT64 * ModuleInfo,
+                        _Out_ POWNER_CACHE_ENTRY * Result)
+/*
+功能：读/proc/[pid]/comm和exe，生成一个条目（包括否定的）。
+
+返回值：ERROR_SUCCESS（条目的Status是查的结果），或者ERROR_NOT_ENOUGH_MEMORY。
+
+注意：
+1.先打开pidfd再读，确认的是读到的这个进程。
+2.exe没有权限（别的用户的进程）或者没有（内核线程）的，Path是空串，Name还是有的。
+*/
+{
+    UNREFERENCED_PARAMETER(ModuleInfo); // Linux的行里没有。
+
+    *Result = nullptr;
+
+    char Name[64];
+    ULONG NameLength = 0;
+    ULONG PathLength = 0;
+    UINT64 CreateTime = 0;
+    int PidFd = -1;
+    ULONG Status = ERROR_NOT_FOUND;
+    char * Path = reinterpret_cast<char *>(Cache->Scratch);
+
+    Name[0] = 0;
+    Path[0] = 0;
+
+    if (Pid) { //没有/proc/0。
+        PidFd = OpenPidFd(Cache, Pid);
+
+        Status = ReadStartTime(Pid, &CreateTime);
+        if (ERROR_SUCCESS == Status) {
+            Status = ReadProcFile(Pid, "comm", Name, sizeof(Name), &NameLength);
+        }
+    }
+
+    if (ERROR_SUCCESS == Status) {
+        while (NameLength && '\n' == Name[NameLength - 1]) {
+            Name[--NameLength] = 0;
+        }
+
+        char Link[64];
+        snprintf(Link, sizeof(Link), "/proc/%u/exe", Pid);
+
+        ssize_t Bytes = readlink(Link, Path, Cache->ScratchSize - 1);
+        PathLength = Bytes > 0 ? (ULONG)Bytes : 0;
+        Path[PathLength] = 0;
+    } else {
+        NameLength = 0;
+        Name[0] = 0;
+    }
+
+    SIZE_T Size = FIELD_OFFSET(OWNER_CACHE_ENTRY, Strings) + NameLength + 1 + PathLength + 1;
+    auto Entry = reinterpret_cast<POWNER_CACHE_ENTRY>(ERROR_NOT_ENOUGH_MEMORY == Status ? nullptr : MALLOC(Size));
+    if (nullptr == Entry) {
+        if (PidFd >= 0) {
+            close(PidFd);
+            Cache->PidFds--;
+        }
+
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    memcpy(Entry->Strings, Name, NameLength + 1);
+    memcpy(Entry->Strings + NameLength + 1, Path, PathLength + 1);
+
+    Entry->Module.Pid = Pid;
+    Entry->Module.CreateTime = CreateTime;
+    Entry->Module.Name = Entry->Strings;
+    Entry->Module.Path = Entry->Strings + NameLength + 1;
+    Entry->Size = Size;
+    Entry->Status = Status;
+    Entry->PidFd = PidFd;
+
+    *Result = Entry;
+    return ERROR_SUCCESS;
+}
+
+
+#endif
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//哈希表。
+
+
+static BOOL SameModuleInfo(_In_opt_ const UINT64 * Left, _In_opt_ const UINT64 * Right)
+/*
+功能：nullptr等同于全0。
+*/
+{
+    if (Left == Right) {
+        return TRUE;
+    }
+
+    for (ULONG i = 0; i < OWNER_MODULE_INFO_SIZE; i++) {
+        if ((Left ? Left[i] : 0) != (Right ? Right[i] : 0)) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+static ULONG KeyHash(_In_ ULONG Pid, _In_opt_ const UINT64 * ModuleInfo)
+{
+    UINT64 Key = Pid;
+
+#ifdef _WIN32
+    if (ModuleInfo) {
+        for (ULONG i = 0; i < OWNER_MODULE_INFO_SIZE; i++) {
+            Key = (Key ^ ModuleInfo[i]) * 0x100000001B3;
+        }
+    }
+#else
+    UNREFERENCED_PARAMETER(ModuleInfo);
+#endif
+
+    Key ^= Key >> 33; // MurmurHash3的fmix64。
+    Key *= 0xFF51AFD7ED558CCD;
+    Key ^= Key >> 33;
+    Key *= 0xC4CEB9FE1A85EC53;
+    Key ^= Key >> 33;
+    return (ULONG)Key;
+}
+
+
+static BOOL IsEntryValid(_In_ POWNER_CACHE_ENTRY Entry, _In_ UINT64 Now)
+/*
+功能：否定的条目过期了，或者进程已经退出了（PID可能被重用了）的无效。
+*/
+{
+    if (ERROR_SUCCESS != Entry->Status && Now - Entry->Inserted >= OWNER_CACHE_MAX_AGE) {
+        return FALSE;
+    }
+
+    return IsProcessAlive(Entry, Now);
+}
+
+
+static POWNER_CACHE_ENTRY FindEntry(_In_ POWNER_CACHE Cache,
+                                    _In_ ULONG Hash,
+                                    _In_ ULONG Pid,
+                                    _In_opt_ const UINT64 * ModuleInfo)
+{
+    for (POWNER_CACHE_ENTRY Entry = Cache->Buckets[Hash & Cache->BucketMask]; Entry; Entry = Entry->Next) {
+        if (Entry->Hash != Hash || Entry->Module.Pid != Pid) {
+            continue;
+        }
+
+#ifdef _WIN32
+        if (!SameModuleInfo(Entry->ModuleInfo, ModuleInfo)) {
+            continue;
+        }
+#else
+        UNREFERENCED_PARAMETER(ModuleInfo);
+#endif
+
+        return Entry;
+    }
+
+    return nullptr;
+}
+
+
+static void RemoveEntry(_Inout_ POWNER_CACHE Cache, _Inout_ POWNER_CACHE_ENTRY Entry)
+{
+    POWNER_CACHE_ENTRY * Link = &Cache->Buckets[Entry->Hash & Cache->BucketMask];
+
+    while (*Link != Entry) {
+        Link = &(*Link)->Next;
+    }
+
+    *Link = Entry->Next;
+    Cache->Entries--;
+    Cache->Bytes -= Entry->Size;
+
+    CloseEntry(Cache, Entry);
+    FREE(Entry);
+}
+
+
+static BOOL EvictEntry(_Inout_ POWNER_CACHE Cache)
+/*
+功能：淘汰最久没有用到的一个条目。这次调用用到过的不淘汰。
+
+返回值：都是这次调用用到过的，没有淘汰的返回FALSE。
+*/
+{
+    POWNER_CACHE_ENTRY Oldest = nullptr;
+    ULONG OldestAge = 0;
+
+    for (ULONG i = 0; i <= Cache->BucketMask; i++) {
+        for (POWNER_CACHE_ENTRY Entry = Cache->Buckets[i]; Entry; Entry = Entry->Next) {
+            ULONG Age = Cache->Epoch - Entry->Used; //序号回绕也对。
+
+            if (Age > OldestAge) {
+                Oldest = Entry;
+                OldestAge = Age;
+            }
+        }
+    }
+
+    if (nullptr == Oldest) {
+        return FALSE;
+    }
+
+    RemoveEntry(Cache, Oldest);
+    Cache->Evictions++;
+    return TRUE;
+}
+
+
+static ULONG ResolveOne(_Inout_ POWNER_CACHE Cache,
+                        _In_ ULONG Pid,
+                        _In_opt_ const UINT64 * ModuleInfo,
+                        _In_ UINT64 Now,
+                        _Out_ const OWNER_MODULE ** Module)
+/*
+功能：查一个进程，先查缓存（确认进程还在），没有的查系统并加入缓存。
+
+返回值：条目的Status（否定的*Module是nullptr），或者ERROR_NOT_ENOUGH_MEMORY。
+*/
+{
+    *Module = nullptr;
+    Cache->Lookups++;
+
+    ULONG Hash = KeyHash(Pid, ModuleInfo);
+    POWNER_CACHE_ENTRY Entry = FindEntry(Cache, Hash, Pid, ModuleInfo);
+    if (Entry && Entry->Validated != Cache->Epoch) {
+        if (IsEntryValid(Entry, Now)) {
+            Entry->Validated = Cache->Epoch;
+        } else {
+            RemoveEntry(Cache, Entry);
+            Cache->Invalidations++;
+            Entry = nullptr;
+        }
+    }
+
+    if (Entry) {
+        Cache->Hits++;
+        if (ERROR_SUCCESS != Entry->Status) {
+            Cache->NegativeHits++;
+        }
+    } else {
+        Cache->Misses++;
+
+        ULONG ret = QueryOwner(Cache, Pid, ModuleInfo, &Entry);
+        if (ERROR_SUCCESS != ret) {
+            return ret;
+        }
+
+        while (Cache->Entries >= Cache->MaxEntries && EvictEntry(Cache)) {
+            //都是这次用到的，暂时超过上限。
+        }
+
+        POWNER_CACHE_ENTRY * Bucket = &Cache->Buckets[Hash & Cache->BucketMask];
+
+        Entry->Hash = Hash;
+        Entry->Inserted = Now;
+        Entry->Validated = Cache->Epoch;
+        Entry->Next = *Bucket;
+        *Bucket = Entry;
+        Cache->Entries++;
+        Cache->Bytes += Entry->Size;
+    }
+
+    Entry->Used = Cache->Epoch;
+    if (ERROR_SUCCESS == Entry->Status) {
+        *Module = &Entry->Module;
+    }
+
+    return Entry->Status;
+}
+
+
+static ULONG ResolveNext(_Inout_ POWNER_CACHE Cache,
+                         _Inout_ POWNER_CACHE_PREVIOUS Previous,
+                         _In_ ULONG Pid,
+                         _In_opt_ const UINT64 * ModuleInfo,
+                         _In_ UINT64 Now,
+                         _Out_ const OWNER_MODULE ** Module)
+/*
+功能：批量查找的一行，和上一行是同一个进程（和模块）的直接用上一行的。
+
+返回值：ERROR_SUCCESS，或者ERROR_NOT_ENOUGH_MEMORY。
+*/
+{
+    if (Previous->Valid && Previous->Pid == Pid && SameModuleInfo(Previous->ModuleInfo, ModuleInfo)) {
+        Cache->Lookups++;
+        Cache->Hits++;
+        if (ERROR_SUCCESS != Previous->Status) {
+            Cache->NegativeHits++;
+        }
+
+        *Module = Previous->Module;
+        return ERROR_SUCCESS;
+    }
+
+    ULONG Status = ResolveOne(Cache, Pid, ModuleInfo, Now, Module);
+    if (ERROR_NOT_ENOUGH_MEMORY == Status) {
+        Previous->Valid = FALSE;
+        return Status;
+    }
+
+    Previous->Valid = TRUE;
+    Previous->Pid = Pid;
+    Previous->ModuleInfo = ModuleInfo;
+    Previous->Module = *Module;
+    Previous->Status = Status;
+    return ERROR_SUCCESS;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI OwnerCacheCreate(_In_ ULONG MaxEntries, _Out_ POWNER_CACHE * Cache)
+/*
+功能：创建进程的所属模块的缓存。
+
+参数：
+MaxEntries：条目（进程，Windows的是进程和模块）的上限，0是OWNER_CACHE_DEFAULT_ENTRIES。
+
+注意：用完要调用OwnerCacheDestroy。
+*/
+{
+    *Cache = nullptr;
+
+    if (0 == MaxEntries) {
+        MaxEntries = OWNER_CACHE_DEFAULT_ENTRIES;
+    }
+
+    if (MaxEntries > OWNER_CACHE_MAX_ENTRIES) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    ULONG BucketCount = 16;
+    while (BucketCount < MaxEntries) {
+        BucketCount *= 2;
+    }
+
+    ULONG ret = ERROR_SUCCESS;
+    auto Temp = reinterpret_cast<POWNER_CACHE>(MALLOC(sizeof(struct _OWNER_CACHE)));
+    if (nullptr == Temp) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    Temp->BucketMask = BucketCount - 1;
+    Temp->MaxEntries = MaxEntries;
+#ifdef _WIN32
+    Temp->ScratchSize = 1024; //一般的路径和服务名够了，不够的查的时候扩大。
+#else
+    Temp->ScratchSize = PATH_MAX + 1;
+#endif
+
+    Temp->Buckets = reinterpret_cast<POWNER_CACHE_ENTRY *>(MALLOC(BucketCount * sizeof(POWNER_CACHE_ENTRY)));
+    Temp->Scratch = MALLOC(Temp->ScratchSize);
+    if (nullptr == Temp->Buckets || nullptr == Temp->Scratch) {
+        ret = ERROR_NOT_ENOUGH_MEMORY;
+        goto Cleanup;
+    }
+
+    *Cache = Temp;
+    Temp = nullptr;
+
+Cleanup:
+    OwnerCacheDestroy(Temp);
+
+    return ret;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI OwnerCacheDestroy(_In_opt_ POWNER_CACHE Cache)
+/*
+功能：销毁缓存，关闭条目持有的进程的句柄（pidfd）。之前返回的OWNER_MODULE都不能再用了。
+*/
+{
+    if (nullptr == Cache) {
+        return;
+    }
+
+    if (Cache->Buckets) {
+        for (ULONG i = 0; i <= Cache->BucketMask; i++) {
+            while (Cache->Buckets[i]) {
+                RemoveEntry(Cache, Cache->Buckets[i]);
+            }
+        }
+
+        FREE(Cache->Buckets);
+    }
+
+    if (Cache->Scratch) {
+        FREE(Cache->Scratch);
+    }
+
+    FREE(Cache);
+}
+
+
+EXTERN_C
+DLLEXPORT
+POWNER_CACHE WINAPI OwnerCacheAcquireDefault()
+/*
+功能：取进程共享的缓存（默认的大小）并加锁，第一次调用时创建。
+
+返回值：失败的返回nullptr（没有加锁）。
+
+注意：
+1.成功的用完（包括用完返回的OWNER_MODULE）要调用OwnerCacheReleaseDefault，中间不要再调用这个（不可重入）。
+2.libnet的GetOwnerModuleFromTcp4EntryEx等共享这个。
+*/
+{
+#ifdef _WIN32
+    AcquireSRWLockExclusive(&g_OwnerCacheLock);
+#else
+    pthread_mutex_lock(&g_OwnerCacheLock);
+#endif
+
+    if (nullptr == g_OwnerCache && ERROR_SUCCESS != OwnerCacheCreate(0, &g_OwnerCache)) {
+        OwnerCacheReleaseDefault();
+        return nullptr;
+    }
+
+    return g_OwnerCache;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI OwnerCacheReleaseDefault()
+/*
+功能：释放OwnerCacheAcquireDefault加的锁。
+*/
+{
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(&g_OwnerCacheLock);
+#else
+    pthread_mutex_unlock(&g_OwnerCacheLock);
+#endif
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI OwnerCacheLookup(_In_ POWNER_CACHE Cache,
+                              _In_ ULONG Pid,
+                              _In_opt_ const UINT64 * ModuleInfo,
+                              _Out_ const OWNER_MODULE ** Module)
+/*
+功能：查一个进程的所属模块。
+
+参数：
+ModuleInfo：OWNER_MODULE的表的行的OwningModuleInfo（Windows的服务的要有），nullptr等同于全0。Linux的忽略。
+Module：查到的，在下一次调用这个缓存的函数（OwnerCacheQuery除外）前有效。查不到的是nullptr。
+
+返回值：
+ERROR_SUCCESS，或者查的错误（如：ERROR_NOT_FOUND，ERROR_ACCESS_DENIED），否定的结果也缓存。
+ERROR_NOT_ENOUGH_MEMORY。
+*/
+{
+    *Module = nullptr;
+
+    if (nullptr == Cache) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    Cache->Epoch++;
+    return ResolveOne(Cache, Pid, ModuleInfo, TickCount(), Module);
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI OwnerCacheResolve(_In_ POWNER_CACHE Cache,
+                               _In_reads_(Count) const OWNER_CACHE_REQUEST * Requests,
+                               _In_ ULONG Count,
+                               _Out_writes_(Count) const OWNER_MODULE ** Modules)
+/*
+功能：批量查（如：一个表的所有的行）。
+
+参数：
+Modules：每一项的结果，查不到的是nullptr。同一个进程的指向同一个OWNER_MODULE，
+         都在下一次调用这个缓存的函数（OwnerCacheQuery除外）前有效。
+
+返回值：ERROR_SUCCESS，ERROR_INVALID_PARAMETER，ERROR_NOT_ENOUGH_MEMORY（之后的项都是nullptr）。
+
+注意：一次调用里每个进程最多确认一次是否还在，最多查一次系统。
+*/
+{
+    if (nullptr == Cache || (Count && (nullptr == Requests || nullptr == Modules))) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    OWNER_CACHE_PREVIOUS Previous = {};
+    UINT64 Now = TickCount();
+    ULONG ret = ERROR_SUCCESS;
+
+    Cache->Epoch++;
+    for (ULONG i = 0; i < Count; i++) {
+        Modules[i] = nullptr;
+
+        if (ERROR_SUCCESS == ret) {
+            ret = ResolveNext(Cache, &Previous, Requests[i].Pid, Requests[i].ModuleInfo, Now, &Modules[i]);
+        }
+    }
+
+    return ret;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI OwnerCacheResolveRows(_In_ POWNER_CACHE Cache,
+                                   _In_reads_(Count) const TABLE_BACKEND_ROW * Rows,
+                                   _In_ ULONG Count,
+                                   _Out_writes_(Count) const OWNER_MODULE ** Modules)
+/*
+功能：同OwnerCacheResolve，查TableBackendEnumerate的行的OwningPid（没有ModuleInfo）。
+
+注意：可以在TABLE_BACKEND_CALLBACK里直接调用。
+*/
+{
+    if (nullptr == Cache || (Count && (nullptr == Rows || nullptr == Modules))) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    OWNER_CACHE_PREVIOUS Previous = {};
+    UINT64 Now = TickCount();
+    ULONG ret = ERROR_SUCCESS;
+
+    Cache->Epoch++;
+    for (ULONG i = 0; i < Count; i++) {
+        Modules[i] = nullptr;
+
+        if (ERROR_SUCCESS == ret) {
+            ret = ResolveNext(Cache, &Previous, Rows[i].OwningPid, nullptr, Now, &Modules[i]);
+        }
+    }
+
+    return ret;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI OwnerCacheSweep(_In_ POWNER_CACHE Cache)
+/*
+功能：删掉进程已经退出的和过期的条目，关闭它们的句柄（pidfd）。
+
+长期运行的（如：定时轮询连接表的）可以定时调用，以免一直持有退出的进程的句柄。
+*/
+{
+    if (nullptr == Cache) {
+        return;
+    }
+
+    UINT64 Now = TickCount();
+
+    Cache->Epoch++;
+    for (ULONG i = 0; i <= Cache->BucketMask; i++) {
+        POWNER_CACHE_ENTRY Entry = Cache->Buckets[i];
+
+        while (Entry) {
+            POWNER_CACHE_ENTRY Next = Entry->Next;
+
+            if (IsEntryValid(Entry, Now)) {
+                Entry->Validated = Cache->Epoch;
+            } else {
+                RemoveEntry(Cache, Entry);
+                Cache->Invalidations++;
+            }
+
+            Entry = Next;
+        }
+    }
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI OwnerCacheQuery(_In_ POWNER_CACHE Cache, _Out_ POWNER_CACHE_INFORMATION Information)
+/*
+功能：统计。命中率是Hits / Lookups。
+*/
+{
+    memset(Information, 0, sizeof(OWNER_CACHE_INFORMATION));
+
+    if (nullptr == Cache) {
+        return;
+    }
+
+    Information->Lookups = Cache->Lookups;
+    Information->Hits = Cache->Hits;
+    Information->Misses = Cache->Misses;
+    Information->NegativeHits = Cache->NegativeHits;
+    Information->Invalidations = Cache->Invalidations;
+    Information->Evictions = Cache->Evictions;
+    Information->Entries = Cache->Entries;
+    Information->MaxEntries = Cache->MaxEntries;
+    Information->Bytes = sizeof(struct _OWNER_CACHE) + (Cache->BucketMask + 1) * sizeof(POWNER_CACHE_ENTRY) +
+                         Cache->ScratchSize + Cache->Bytes;
+}
@@ -0,0 +1,101 @@
+﻿#pragma once
+
+#include "LinuxCompat.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+typedef struct _OWNER_CACHE OWNER_CACHE, * POWNER_CACHE; //进程的所属模块的缓存，见OwnerCacheResolve。不是线程安全的。
+typedef struct _TABLE_BACKEND_ROW TABLE_BACKEND_ROW; //见TableBackend.h，OwnerCacheResolveRows用。
+
+
+#ifdef _WIN32
+typedef WCHAR OWNER_CHAR; // Windows的字符串是UTF-16。
+#define OWNER_MODULE_INFO_SIZE TCPIP_OWNING_MODULE_SIZE
+#else
+typedef char OWNER_CHAR;  // Linux的是文件名原样的字节（一般是UTF-8）。
+#define OWNER_MODULE_INFO_SIZE 16
+#endif
+
+#define OWNER_CACHE_DEFAULT_ENTRIES 4096
+#define OWNER_CACHE_MAX_AGE         2000 //不能等待进程退出的条目（打不开进程的，否定的）的有效期（毫秒）。
+
+
+//一个进程（或者服务）的所属模块。
+typedef struct _OWNER_MODULE {
+    ULONG Pid;
+    ULONG Reserved;
+    UINT64 CreateTime;        // Windows的是进程的创建时间（FILETIME），Linux的是/proc/[pid]/stat的starttime。
+    const OWNER_CHAR * Name;  // Windows的pModuleName（服务的是服务名），Linux的comm。
+    const OWNER_CHAR * Path;  // Windows的pModulePath，Linux的/proc/[pid]/exe（没有权限的是空串）。
+} OWNER_MODULE, * POWNER_MODULE;
+
+
+//批量查找的一项。
+typedef struct _OWNER_CACHE_REQUEST {
+    ULONG Pid;
+    const UINT64 * ModuleInfo; // OWNER_MODULE的行的OwningModuleInfo（OWNER_MODULE_INFO_SIZE个），可以是nullptr。
+} OWNER_CACHE_REQUEST, * POWNER_CACHE_REQUEST;
+
+
+typedef struct _OWNER_CACHE_INFORMATION {
+    UINT64 Lookups;        //查找的行数（批量的每一行都算）。
+    UINT64 Hits;           //缓存里有的（包括否定的）。
+    UINT64 Misses;         //实际去查系统的次数。
+    UINT64 NegativeHits;   //命中的是查不到的（没有权限，进程已经退出等）。
+    UINT64 Invalidations;  //进程退出（或者过期）而删掉的。
+    UINT64 Evictions;      //满了淘汰的。
+    ULONG Entries;
+    ULONG MaxEntries;
+    SIZE_T Bytes;
+} OWNER_CACHE_INFORMATION, * POWNER_CACHE_INFORMATION;
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C_START
+
+
+DLLEXPORT
+ULONG WINAPI OwnerCacheCreate(_In_ ULONG MaxEntries, _Out_ POWNER_CACHE * Cache);
+
+DLLEXPORT
+void WINAPI OwnerCacheDestroy(_In_opt_ POWNER_CACHE Cache);
+
+DLLEXPORT
+POWNER_CACHE WINAPI OwnerCacheAcquireDefault();
+
+DLLEXPORT
+void WINAPI OwnerCacheReleaseDefault();
+
+DLLEXPORT
+ULONG WINAPI OwnerCacheLookup(_In_ POWNER_CACHE Cache,
+                              _In_ ULONG Pid,
+                              _In_opt_ const UINT64 * ModuleInfo,
+                              _Out_ const OWNER_MODULE ** Module);
+
+DLLEXPORT
+ULONG WINAPI OwnerCacheResolve(_In_ POWNER_CACHE Cache,
+                               _In_reads_(Count) const OWNER_CACHE_REQUEST * Requests,
+                               _In_ ULONG Count,
+                               _Out_writes_(Count) const OWNER_MODULE ** Modules);
+
+DLLEXPORT
+ULONG WINAPI OwnerCacheResolveRows(_In_ POWNER_CACHE Cache,
+                                   _In_reads_(Count) const TABLE_BACKEND_ROW * Rows,
+                                   _In_ ULONG Count,
+                                   _Out_writes_(Count) const OWNER_MODULE ** Modules);
+
+DLLEXPORT
+void WINAPI OwnerCacheSweep(_In_ POWNER_CACHE Cache);
+
+DLLEXPORT
+void WINAPI OwnerCacheQuery(_In_ POWNER_CACHE Cache, _Out_ POWNER_CACHE_INFORMATION Information);
+
+
+EXTERN_C_END
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
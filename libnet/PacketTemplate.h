@@ -0,0 +1,299 @@
+﻿/*
+编译期的报文模板（只有头文件，C++17）。
+
+用法：用类型把L2/L3/L4/选项组合起来，如：
+
+using Syn4 = PacketTemplate::EthernetFrame<PacketTemplate::Ipv4,
+                                           PacketTemplate::Tcp<TH_SYN, PacketTemplate::Options<PacketTemplate::Mss>>>;
+Syn4::Build(buffer, SrcMac, DesMac, &Source, &Destination, th_sport, th_dport, 0, 0);
+
+编译期完成的：
+1.各层的偏移和长度，IP头里的长度，TCP头里的th_len。
+2.所有固定的字段（版本，TTL，DF，标志，窗口，选项等）组成的模板（Template）。
+3.校验和的固定部分（IPv4头里固定的字段；TCP头，选项，伪首部里的协议和长度）预先累加（IpSum/TcpSum）。
+
+运行时只复制模板，填写可变的字段（MAC，地址，端口，序号，确认号），再把这些字段累加到预先算好的和上。
+
+导出的C接口（如：PacketizeSyn4，PacketizeSyn6，PacketizeAck4，PacketizeAck6）就是这些模板的实例。
+
+注意：
+1.累加用的是和ChecksumPartial一样的小端的16位字，所以只适用于小端的CPU（x86/x64/ARM64的Windows）。
+2.L3和L4的偏移都是偶数，所以各段的和可以直接相加。
+*/
+
+
+#pragma once
+
+#include "pch.h"
+#include "raw.h"
+
+#include <array>
+#include <cstddef>
+
+
+namespace PacketTemplate
+{
+template <SIZE_T N>
+using Bytes = std::array<BYTE, N>;
+
+
+template <SIZE_T N>
+constexpr void Put16(Bytes<N> & Frame, SIZE_T Offset, UINT16 Value) //网络序。
+{
+    Frame[Offset] = (BYTE)(Value >> 8);
+    Frame[Offset + 1] = (BYTE)Value;
+}
+
+
+template <SIZE_T N>
+constexpr UINT64 Sum(const Bytes<N> & Frame, SIZE_T Offset, SIZE_T Length)
+/*
+功能：编译期的累加，和运行时的ChecksumPartial一样，按小端取16位的字。
+
+注意：Offset必须是偶数。
+*/
+{
+    UINT64 Result = 0;
+
+    for (SIZE_T i = 0; i + 1 < Length; i += 2) {
+        Result += Frame[Offset + i] | (Frame[Offset + i + 1] << 8);
+    }
+
+    if (Length & 1) {
+        Result += Frame[Offset + Length - 1];
+    }
+
+    return Result;
+}
+
+
+constexpr UINT64 Swap16(UINT16 Value) //主机序的值在报文里（网络序）按小端取出来的字。
+{
+    return (UINT16)((Value >> 8) | (Value << 8));
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// TCP选项。和InitTcpMss/InitTcpWs/InitTcpSp填写的一样。
+
+
+struct Mss {
+    static constexpr SIZE_T Size = sizeof(TCP_OPT_MSS);
+
+    template <SIZE_T N>
+    static constexpr void Build(Bytes<N> & Frame, SIZE_T Offset)
+    {
+        Frame[Offset] = TH_OPT_MSS;
+        Frame[Offset + 1] = 4;
+        Put16(Frame, Offset + 2, 1460);
+    }
+};
+
+
+struct WindowScale {
+    static constexpr SIZE_T Size = sizeof(TCP_OPT_WS);
+
+    template <SIZE_T N>
+    static constexpr void Build(Bytes<N> & Frame, SIZE_T Offset)
+    {
+        Frame[Offset] = TH_OPT_WS;
+        Frame[Offset + 1] = 3;
+        Frame[Offset + 2] = 8;
+    }
+};
+
+
+struct SackPermitted {
+    static constexpr SIZE_T Size = sizeof(TCP_OPT_SACK_PERMITTED);
+
+    template <SIZE_T N>
+    static constexpr void Build(Bytes<N> & Frame, SIZE_T Offset)
+    {
+        Frame[Offset] = TH_OPT_SACK_PERMITTED;
+        Frame[Offset + 1] = 2;
+    }
+};
+
+
+struct Nop {
+    static constexpr SIZE_T Size = 1;
+
+    template <SIZE_T N>
+    static constexpr void Build(Bytes<N> & Frame, SIZE_T Offset)
+    {
+        Frame[Offset] = TH_OPT_NOP;
+    }
+};
+
+
+template <typename... Option>
+struct Options {
+    static constexpr SIZE_T Size = (0 + ... + Option::Size);
+    static_assert(Size % 4 == 0, "TCP的选项要填充到4字节的倍数（用Nop）。");
+
+    template <SIZE_T N>
+    static constexpr void Build(Bytes<N> & Frame, SIZE_T Offset)
+    {
+        ((Option::Build(Frame, Offset), Offset += Option::Size), ...);
+    }
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// L3。和InitIpv4Header/InitIpv6HeaderForTcp填写的一样。
+
+
+struct Ipv4 {
+    static constexpr SIZE_T Size = sizeof(IPV4_HEADER);
+    static constexpr UINT16 EtherType = ETHERNET_TYPE_IPV4;
+    static constexpr SIZE_T AddressOffset = offsetof(IPV4_HEADER, SourceAddress); //紧接着是目的地址。
+    static constexpr SIZE_T AddressSize = sizeof(IN_ADDR);
+    static constexpr bool HasChecksum = true;
+    static constexpr SIZE_T ChecksumOffset = offsetof(IPV4_HEADER, HeaderChecksum);
+
+    template <SIZE_T N>
+    static constexpr void Build(Bytes<N> & Frame, SIZE_T Offset, UINT8 Protocol, SIZE_T PayloadLength)
+    {
+        Frame[Offset] = (4 << 4) | (Size / 4);
+        Put16(Frame, Offset + 2, (UINT16)(Size + PayloadLength));
+        Put16(Frame, Offset + 6, 0x4000); // DF
+        Frame[Offset + 8] = 128;
+        Frame[Offset + 9] = Protocol;
+    }
+};
+
+
+struct Ipv6 {
+    static constexpr SIZE_T Size = sizeof(IPV6_HEADER);
+    static constexpr UINT16 EtherType = ETHERNET_TYPE_IPV6;
+    static constexpr SIZE_T AddressOffset = offsetof(IPV6_HEADER, SourceAddress); //紧接着是目的地址。
+    static constexpr SIZE_T AddressSize = sizeof(IN6_ADDR);
+    static constexpr bool HasChecksum = false;
+    static constexpr SIZE_T ChecksumOffset = 0;
+
+    template <SIZE_T N>
+    static constexpr void Build(Bytes<N> & Frame, SIZE_T Offset, UINT8 NextHeader, SIZE_T PayloadLength)
+    {
+        Frame[Offset] = 6 << 4;
+        Put16(Frame, Offset + 4, (UINT16)PayloadLength);
+        Frame[Offset + 6] = NextHeader;
+        Frame[Offset + 7] = 128;
+    }
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// L4。和InitTcpHeader填写的一样。
+
+
+template <UINT8 Flags, typename TcpOptions = Options<>>
+struct Tcp {
+    static constexpr SIZE_T Size = sizeof(TCP_HDR) + TcpOptions::Size;
+    static constexpr UINT8 Protocol = IPPROTO_TCP;
+    static_assert(Size / 4 <= 0xf, "TCP头太长了。");
+
+    template <SIZE_T N>
+    static constexpr void Build(Bytes<N> & Frame, SIZE_T Offset)
+    {
+        Frame[Offset + 12] = (BYTE)((Size / 4) << 4); // th_len
+        Frame[Offset + 13] = Flags;
+        Put16(Frame, Offset + 14, 65535);
+        TcpOptions::Build(Frame, Offset + sizeof(TCP_HDR));
+    }
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+template <typename L3, typename L4>
+struct EthernetFrame {
+    static constexpr SIZE_T L3Offset = sizeof(ETHERNET_HEADER);
+    static constexpr SIZE_T L4Offset = L3Offset + L3::Size;
+    static constexpr SIZE_T Size = L4Offset + L4::Size;
+    static constexpr SIZE_T AddressOffset = L3Offset + L3::AddressOffset; //源地址，紧接着是目的地址。
+
+    static_assert(L4Offset % 2 == 0, "L4的偏移必须是偶数。");
+
+    static constexpr Bytes<Size> MakeTemplate()
+    {
+        Bytes<Size> Frame{};
+
+        Put16(Frame, offsetof(ETHERNET_HEADER, Type), L3::EtherType);
+        L3::Build(Frame, L3Offset, L4::Protocol, L4::Size);
+        L4::Build(Frame, L4Offset);
+
+        return Frame;
+    }
+
+    static constexpr Bytes<Size> Template = MakeTemplate();
+
+    //IP头里固定的字段的和（地址和校验和都是0）。
+    static constexpr UINT64 IpSum = L3::HasChecksum ? Sum(Template, L3Offset, L3::Size) : 0;
+
+    //L4里固定的字段的和，加上伪首部里的协议和长度（IPv4和IPv6的在累加时是一样的）。
+    static constexpr UINT64 TcpSum = Sum(Template, L4Offset, L4::Size) + Swap16(L4::Protocol) + Swap16(L4::Size);
+
+    static FORCEINLINE void Build(_Out_writes_bytes_(Size) PBYTE Buffer,
+                                  _In_reads_bytes_(6) const BYTE * SrcMac,
+                                  _In_reads_bytes_(6) const BYTE * DesMac,
+                                  _In_reads_bytes_(L3::AddressSize) const void * SourceAddress,
+                                  _In_reads_bytes_(L3::AddressSize) const void * DestinationAddress,
+                                  _In_ UINT16 th_sport, //网络序。
+                                  _In_ UINT16 th_dport, //网络序。
+                                  _In_ SEQ_NUM th_seq,  //网络序。
+                                  _In_ SEQ_NUM th_ack)  //网络序。
+    {
+        RtlCopyMemory(Buffer, Template.data(), Size);
+
+        PETHERNET_HEADER eth_hdr = reinterpret_cast<PETHERNET_HEADER>(Buffer);
+        RtlCopyMemory(&eth_hdr->Destination, DesMac, sizeof(eth_hdr->Destination));
+        RtlCopyMemory(&eth_hdr->Source, SrcMac, sizeof(eth_hdr->Source));
+
+        PBYTE Address = Buffer + AddressOffset;
+        RtlCopyMemory(Address, SourceAddress, L3::AddressSize);
+        RtlCopyMemory(Address + L3::AddressSize, DestinationAddress, L3::AddressSize);
+        UINT64 AddressSum = 0;
+        for (SIZE_T i = 0; i < 2 * L3::AddressSize; i += sizeof(UINT32)) { //次数是常量，编译器会展开。
+            UINT32 Word;
+            RtlCopyMemory(&Word, Address + i, sizeof(Word));
+            AddressSum += (UINT64)Word;
+        }
+
+        if constexpr (L3::HasChecksum) {
+            *reinterpret_cast<UINT16 *>(Buffer + L3Offset + L3::ChecksumOffset) =
+                (UINT16)~ChecksumFold(IpSum + AddressSum);
+        }
+
+        PTCP_HDR tcp_hdr = reinterpret_cast<PTCP_HDR>(Buffer + L4Offset);
+        tcp_hdr->th_sport = th_sport;
+        tcp_hdr->th_dport = th_dport;
+        tcp_hdr->th_seq = th_seq;
+        tcp_hdr->th_ack = th_ack;
+
+        UINT64 VariableSum = AddressSum + th_sport + th_dport + (th_seq & 0xffff) + (th_seq >> 16) +
+                             (th_ack & 0xffff) + (th_ack >> 16);
+        tcp_hdr->th_sum = (UINT16)~ChecksumFold(TcpSum + VariableSum);
+    }
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// 导出的组包函数用到的实例。
+
+
+using Syn4 = EthernetFrame<Ipv4, Tcp<TH_SYN, Options<Mss>>>; // PacketizeSyn4，PacketizeProbe4。
+static_assert(Syn4::Size == sizeof(RAW_TCP) + sizeof(TCP_OPT_MSS), "和RAW_TCP的布局不一致。");
+
+using Syn6 = EthernetFrame<Ipv6, Tcp<TH_SYN>>; // PacketizeSyn6，PacketizeProbe6。
+static_assert(Syn6::Size == sizeof(RAW6_TCP), "和RAW6_TCP的布局不一致。");
+
+using AckOptions = Options<Mss, Nop, WindowScale, Nop, Nop, SackPermitted>; // TCP_OPT的布局。
+static_assert(AckOptions::Size == sizeof(TCP_OPT), "和TCP_OPT的布局不一致。");
+
+using Ack4 = EthernetFrame<Ipv4, Tcp<TH_ACK | TH_SYN, AckOptions>>; // PacketizeAck4。
+static_assert(Ack4::Size == sizeof(RAW_TCP) + sizeof(TCP_OPT), "和RAW_TCP的布局不一致。");
+
+using Ack6 = EthernetFrame<Ipv6, Tcp<TH_ACK | TH_SYN, AckOptions>>; // PacketizeAck6。
+static_assert(Ack6::Size == sizeof(RAW6_TCP) + sizeof(TCP_OPT), "和RAW6_TCP的布局不一致。");
+} // namespace PacketTemplate
@@ -0,0 +1,971 @@
+﻿#include "Pcap.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/*
+pcap/pcapng文件的读写。
+
+用途：把组好的包保存下来，用于回放，比较，以及离线地测试解析和校验和的代码。
+
+写：先写到一个大的缓冲区里，满了再一次性地写到文件。
+读：映射文件的一个窗口（PCAP_READER_WINDOW_SIZE，起点按分配粒度对齐），读到窗口外面了再重新映射，
+逐个返回记录的位置，不复制数据。这样几个GB的文件在32位的进程里也能读（放不下整个文件的映射）。
+Windows上用MapViewOfFile，Linux上用mmap（见test/PcapTest.cpp）。
+
+时间戳统一用纳秒（自1970-01-01 UTC）：
+1.pcap用纳秒的格式（magic 0xa1b23c4d），读的时候也支持微秒的格式，以及字节序相反的文件。
+2.pcapng的接口描述块写上if_tsresol = 9，读的时候按各个接口的if_tsresol换算。
+
+https://www.ietf.org/archive/id/draft-ietf-opsawg-pcap-01.html
+https://www.ietf.org/archive/id/draft-ietf-opsawg-pcapng-01.html
+*/
+
+
+#define PCAP_WRITER_BUFFER_SIZE (1024 * 1024)
+#define PCAPNG_MAX_INTERFACES   64
+
+#ifndef PCAP_READER_WINDOW_SIZE
+#define PCAP_READER_WINDOW_SIZE (64 * 1024 * 1024) // test/PcapTest.cpp改小了，测试跨窗口的记录。
+#endif
+
+#ifdef _WIN32
+typedef HANDLE PCAP_FILE;
+#define PcapCloseFile CloseHandle
+#else
+typedef int PCAP_FILE;
+#define PcapCloseFile close
+#endif
+
+
+#pragma pack(push, 1)
+
+typedef struct _PCAP_FILE_HEADER {
+    UINT32 Magic;
+    UINT16 VersionMajor;
+    UINT16 VersionMinor;
+    INT32 ThisZone;
+    UINT32 SigFigs;
+    UINT32 SnapLen;
+    UINT32 LinkType;
+} PCAP_FILE_HEADER, * PPCAP_FILE_HEADER;
+
+typedef struct _PCAP_RECORD_HEADER {
+    UINT32 Seconds;
+    UINT32 Fraction; //微秒或者纳秒，取决于文件头的Magic。
+    UINT32 CapturedLength;
+    UINT32 OriginalLength;
+} PCAP_RECORD_HEADER, * PPCAP_RECORD_HEADER;
+
+typedef struct _PCAPNG_SECTION_HEADER {
+    UINT32 BlockType;
+    UINT32 BlockLength;
+    UINT32 ByteOrderMagic;
+    UINT16 VersionMajor;
+    UINT16 VersionMinor;
+    INT64 SectionLength;
+    UINT32 BlockLength2;
+} PCAPNG_SECTION_HEADER;
+
+typedef struct _PCAPNG_INTERFACE_DESCRIPTION {
+    UINT32 BlockType;
+    UINT32 BlockLength;
+    UINT16 LinkType;
+    UINT16 Reserved;
+    UINT32 SnapLen;
+    UINT16 TsResolCode; //选项：if_tsresol。
+    UINT16 TsResolLength;
+    UINT8 TsResol;
+    UINT8 TsResolPadding[3];
+    UINT16 EndCode; //选项：opt_endofopt。
+    UINT16 EndLength;
+    UINT32 BlockLength2;
+} PCAPNG_INTERFACE_DESCRIPTION;
+
+typedef struct _PCAPNG_ENHANCED_PACKET {
+    UINT32 BlockType;
+    UINT32 BlockLength;
+    UINT32 InterfaceId;
+    UINT32 TimestampHigh;
+    UINT32 TimestampLow;
+    UINT32 CapturedLength;
+    UINT32 OriginalLength;
+    // BYTE Data[];（填充到4字节对齐）
+    // UINT32 BlockLength2;
+} PCAPNG_ENHANCED_PACKET;
+
+#pragma pack(pop)
+
+
+struct _PCAP_WRITER {
+    PCAP_FILE File;
+    ULONG Format;
+    UINT32 SnapLen;
+    ULONG Used;
+    ULONG Error; //第一次写失败的错误码，之后的写都直接返回它。
+    BYTE Buffer[PCAP_WRITER_BUFFER_SIZE];
+};
+
+
+typedef struct _PCAPNG_INTERFACE {
+    UINT32 LinkType;
+    UINT8 TsResol;
+} PCAPNG_INTERFACE;
+
+
+struct _PCAP_READER {
+    PCAP_FILE File;
+#ifdef _WIN32
+    HANDLE Mapping; //整个文件的映射对象（不占地址空间），窗口是它的视图。
+#endif
+    const BYTE * View; //当前映射的窗口，见PcapMapWindow。
+    UINT64 ViewOffset; //窗口在文件里的偏移，按Granularity对齐。
+    SIZE_T ViewSize;
+    ULONG Granularity; // Windows的是分配粒度（一般是64KB），Linux的是页的大小。
+    UINT64 Size;
+    UINT64 Offset;
+    ULONG Format;
+
+    // pcap
+    bool Swapped;
+    bool Nanoseconds;
+    UINT32 LinkType;
+
+    // pcapng（当前的节）
+    ULONG InterfaceCount;
+    PCAPNG_INTERFACE Interfaces[PCAPNG_MAX_INTERFACES];
+};
+
+
+#ifndef _WIN32
+static ULONG ErrnoToStatus(_In_ int Error)
+{
+    switch (Error) {
+    case 0:
+        return ERROR_SUCCESS;
+    case ENOENT:
+        return ERROR_FILE_NOT_FOUND;
+    case EACCES:
+    case EPERM:
+        return ERROR_ACCESS_DENIED;
+    case ENOMEM:
+        return ERROR_NOT_ENOUGH_MEMORY;
+    default:
+        return ERROR_GEN_FAILURE;
+    }
+}
+#endif
+
+
+static UINT64 GetUnixTimeNanoseconds()
+{
+#ifdef _WIN32
+    FILETIME FileTime;
+    GetSystemTimePreciseAsFileTime(&FileTime);
+
+    UINT64 Ticks = ((UINT64)FileTime.dwHighDateTime << 32) | FileTime.dwLowDateTime; // 100ns，自1601-01-01。
+    return (Ticks - 116444736000000000ULL) * 100;
+#else
+    struct timespec Now;
+
+    clock_gettime(CLOCK_REALTIME, &Now);
+    return (UINT64)Now.tv_sec * 1000000000 + (UINT64)Now.tv_nsec;
+#endif
+}
+
+
+static ULONG PcapWriteFile(_Inout_ PPCAP_WRITER Writer, _In_reads_bytes_(Size) const void * Data, _In_ ULONG Size)
+/*
+功能：直接写到文件。
+
+返回值：失败的话记到Writer->Error里，之后的写都直接返回它。
+*/
+{
+#ifdef _WIN32
+    DWORD Written = 0;
+    if (!WriteFile(Writer->File, Data, Size, &Written, nullptr) || Written != Size) {
+        Writer->Error = GetLastError();
+        if (ERROR_SUCCESS == Writer->Error) {
+            Writer->Error = ERROR_WRITE_FAULT;
+        }
+    }
+#else
+    const BYTE * Next = reinterpret_cast<const BYTE *>(Data);
+
+    while (Size) { //可能只写了一部分（如：被信号打断）。
+        ssize_t Written = write(Writer->File, Next, Size);
+        if (Written < 0 && EINTR == errno) {
+            continue;
+        }
+
+        if (Written <= 0) {
+            Writer->Error = Written < 0 ? ErrnoToStatus(errno) : ERROR_WRITE_FAULT;
+            break;
+        }
+
+        Next += Written;
+        Size -= (ULONG)Written;
+    }
+#endif
+
+    return Writer->Error;
+}
+
+
+static ULONG PcapFlush(_Inout_ PPCAP_WRITER Writer)
+{
+    if (Writer->Used) {
+        ULONG ret = PcapWriteFile(Writer, Writer->Buffer, Writer->Used);
+        if (ERROR_SUCCESS != ret) {
+            return ret;
+        }
+
+        Writer->Used = 0;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG PcapAppend(_Inout_ PPCAP_WRITER Writer, _In_reads_bytes_(Size) const void * Data, _In_ ULONG Size)
+/*
+功能：追加到写缓冲区，满了就写到文件。
+
+比缓冲区还大的数据（很少见），先写缓冲区里的，再直接写它。
+*/
+{
+    if (Size > sizeof(Writer->Buffer) - Writer->Used) {
+        ULONG ret = PcapFlush(Writer);
+        if (ERROR_SUCCESS != ret) {
+            return ret;
+        }
+
+        if (Size > sizeof(Writer->Buffer)) {
+            return PcapWriteFile(Writer, Data, Size);
+        }
+    }
+
+    RtlCopyMemory(Writer->Buffer + Writer->Used, Data, Size);
+    Writer->Used += Size;
+
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI PcapOpenWriter(_In_z_ const PCAP_CHAR * FileName,
+                            _In_ ULONG Format,   // PCAP_FORMAT_PCAP或者PCAP_FORMAT_PCAPNG。
+                            _In_ ULONG LinkType, //如：PCAP_LINKTYPE_ETHERNET。
+                            _Out_ PPCAP_WRITER * Writer)
+/*
+功能：创建（覆盖）一个pcap/pcapng文件，并写入文件头。
+
+注意：用完要调用PcapCloseWriter，否则缓冲区里的数据不会写到文件。
+*/
+{
+    *Writer = nullptr;
+
+    if (PCAP_FORMAT_PCAP != Format && PCAP_FORMAT_PCAPNG != Format) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    if (PCAP_FORMAT_PCAPNG == Format && LinkType > MAXUINT16) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    PPCAP_WRITER Temp = reinterpret_cast<PPCAP_WRITER>(MALLOC(sizeof(struct _PCAP_WRITER)));
+    if (nullptr == Temp) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+#ifdef _WIN32
+    Temp->File = CreateFileW(FileName, GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+                             FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (INVALID_HANDLE_VALUE == Temp->File) {
+        ULONG ret = GetLastError();
+        FREE(Temp);
+        return ret;
+    }
+#else
+    Temp->File = open(FileName, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (Temp->File < 0) {
+        ULONG ret = ErrnoToStatus(errno);
+        FREE(Temp);
+        return ret;
+    }
+#endif
+
+    Temp->Format = Format;
+    Temp->SnapLen = PCAP_MAX_SNAPLEN;
+
+    ULONG ret = ERROR_SUCCESS;
+
+    if (PCAP_FORMAT_PCAP == Format) {
+        PCAP_FILE_HEADER Header{};
+        Header.Magic = PCAP_MAGIC_NANOSECONDS;
+        Header.VersionMajor = 2;
+        Header.VersionMinor = 4;
+        Header.SnapLen = Temp->SnapLen;
+        Header.LinkType = LinkType;
+        ret = PcapAppend(Temp, &Header, sizeof(Header));
+    } else {
+        PCAPNG_SECTION_HEADER Section{};
+        Section.BlockType = PCAPNG_BLOCK_SECTION_HEADER;
+        Section.BlockLength = sizeof(Section);
+        Section.ByteOrderMagic = PCAPNG_BYTE_ORDER_MAGIC;
+        Section.VersionMajor = 1;
+        Section.VersionMinor = 0;
+        Section.SectionLength = -1; //未知。
+        Section.BlockLength2 = sizeof(Section);
+
+        PCAPNG_INTERFACE_DESCRIPTION Interface{};
+        Interface.BlockType = PCAPNG_BLOCK_INTERFACE;
+        Interface.BlockLength = sizeof(Interface);
+        Interface.LinkType = (UINT16)LinkType;
+        Interface.SnapLen = Temp->SnapLen;
+        Interface.TsResolCode = PCAPNG_OPTION_IF_TSRESOL;
+        Interface.TsResolLength = 1;
+        Interface.TsResol = 9; //纳秒。
+        Interface.EndCode = PCAPNG_OPTION_END;
+        Interface.BlockLength2 = sizeof(Interface);
+
+        ret = PcapAppend(Temp, &Section, sizeof(Section));
+        if (ERROR_SUCCESS == ret) {
+            ret = PcapAppend(Temp, &Interface, sizeof(Interface));
+        }
+    }
+
+    if (ERROR_SUCCESS != ret) {
+        PcapCloseFile(Temp->File);
+        FREE(Temp);
+        return ret;
+    }
+
+    *Writer = Temp;
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI PcapWritePacket(_In_ PPCAP_WRITER Writer,
+                             _In_ UINT64 Timestamp, //纳秒，自1970-01-01 UTC。0表示当前的时间。
+                             _In_reads_bytes_(Length) const BYTE * Frame,
+                             _In_ ULONG Length,
+                             _In_ ULONG OriginalLength) //线路上的长度，0表示和Length一样。
+/*
+功能：写一个帧，如：packetize_icmpv4_echo_request，PacketizeSyn4等组好的包。
+
+注意：超过SnapLen的部分被截掉（OriginalLength不变）。
+*/
+{
+    if (ERROR_SUCCESS != Writer->Error) {
+        return Writer->Error;
+    }
+
+    if (0 == Timestamp) {
+        Timestamp = GetUnixTimeNanoseconds();
+    }
+
+    if (0 == OriginalLength) {
+        OriginalLength = Length;
+    }
+
+    if (Length > Writer->SnapLen) {
+        Length = Writer->SnapLen;
+    }
+
+    ULONG ret;
+
+    if (PCAP_FORMAT_PCAP == Writer->Format) {
+        PCAP_RECORD_HEADER Record;
+        Record.Seconds = (UINT32)(Timestamp / 1000000000);
+        Record.Fraction = (UINT32)(Timestamp % 1000000000);
+        Record.CapturedLength = Length;
+        Record.OriginalLength = OriginalLength;
+
+        ret = PcapAppend(Writer, &Record, sizeof(Record));
+        if (ERROR_SUCCESS == ret) {
+            ret = PcapAppend(Writer, Frame, Length);
+        }
+    } else {
+        ULONG Padded = (Length + 3) & ~3UL;
+        UINT32 BlockLength = sizeof(PCAPNG_ENHANCED_PACKET) + Padded + sizeof(UINT32);
+        const BYTE Padding[4]{};
+
+        PCAPNG_ENHANCED_PACKET Block;
+        Block.BlockType = PCAPNG_BLOCK_ENHANCED_PACKET;
+        Block.BlockLength = BlockLength;
+        Block.InterfaceId = 0;
+        Block.TimestampHigh = (UINT32)(Timestamp >> 32);
+        Block.TimestampLow = (UINT32)Timestamp;
+        Block.CapturedLength = Length;
+        Block.OriginalLength = OriginalLength;
+
+        ret = PcapAppend(Writer, &Block, sizeof(Block));
+        if (ERROR_SUCCESS == ret) {
+            ret = PcapAppend(Writer, Frame, Length);
+        }
+        if (ERROR_SUCCESS == ret && Padded != Length) {
+            ret = PcapAppend(Writer, Padding, Padded - Length);
+        }
+        if (ERROR_SUCCESS == ret) {
+            ret = PcapAppend(Writer, &BlockLength, sizeof(BlockLength));
+        }
+    }
+
+    return ret;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI PcapWriteBatch(_In_ PPCAP_WRITER Writer,
+                            _In_ UINT64 Timestamp, //纳秒，自1970-01-01 UTC。0表示当前的时间。
+                            _In_ const BYTE * Slab,
+                            _In_reads_(Count) const PACKET_SPAN * Spans,
+                            _In_ ULONG Count)
+/*
+功能：写PacketizeSyn4Batch等批量组的包，每个帧的时间戳都一样。
+*/
+{
+    if (0 == Timestamp) {
+        Timestamp = GetUnixTimeNanoseconds();
+    }
+
+    for (ULONG i = 0; i < Count; i++) {
+        ULONG ret = PcapWritePacket(Writer, Timestamp, Slab + Spans[i].Offset, Spans[i].Length, 0);
+        if (ERROR_SUCCESS != ret) {
+            return ret;
+        }
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI PcapCloseWriter(_In_ PPCAP_WRITER Writer)
+/*
+功能：把缓冲区里剩下的数据写到文件，并关闭文件。
+
+返回值：写文件的错误（如果有的话）。
+*/
+{
+    ULONG ret = Writer->Error;
+    if (ERROR_SUCCESS == ret) {
+        ret = PcapFlush(Writer);
+    }
+
+    PcapCloseFile(Writer->File);
+    FREE(Writer);
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static FORCEINLINE UINT32 PcapRead32(const BYTE * p, bool Swapped)
+{
+    UINT32 Value;
+    RtlCopyMemory(&Value, p, sizeof(Value));
+    return Swapped ? _byteswap_ulong(Value) : Value;
+}
+
+
+static FORCEINLINE UINT16 PcapRead16(const BYTE * p, bool Swapped)
+{
+    UINT16 Value;
+    RtlCopyMemory(&Value, p, sizeof(Value));
+    return Swapped ? _byteswap_ushort(Value) : Value;
+}
+
+
+static void PcapUnmapWindow(_Inout_ PPCAP_READER Reader)
+{
+    if (Reader->View) {
+#ifdef _WIN32
+        UnmapViewOfFile(Reader->View);
+#else
+        munmap(const_cast<BYTE *>(Reader->View), Reader->ViewSize);
+#endif
+        Reader->View = nullptr;
+        Reader->ViewSize = 0;
+    }
+}
+
+
+static ULONG PcapMapWindow(_Inout_ PPCAP_READER Reader,
+                           _In_ UINT64 Offset,
+                           _In_ UINT64 Length,
+                           _Out_ const BYTE ** Data)
+/*
+功能：确保文件的[Offset, Offset + Length)在映射的窗口里，不在就重新映射，返回Offset在内存里的位置。
+
+新的窗口从Offset所在的分配粒度开始，一般是PCAP_READER_WINDOW_SIZE大，
+跨过窗口（或者比窗口还大）的记录就映射得大一些，保证整个记录是连续的；到文件末尾为止。
+
+注意：调用者保证Offset + Length不超过文件的大小。重新映射之后，之前返回的指针都失效了。
+*/
+{
+    if (Reader->View && Offset >= Reader->ViewOffset &&
+        Offset + Length <= Reader->ViewOffset + Reader->ViewSize) {
+        *Data = Reader->View + (Offset - Reader->ViewOffset);
+        return ERROR_SUCCESS;
+    }
+
+    *Data = nullptr;
+    PcapUnmapWindow(Reader);
+
+    UINT64 ViewOffset = Offset - Offset % Reader->Granularity;
+    UINT64 ViewSize = Offset - ViewOffset + Length;
+    if (ViewSize < PCAP_READER_WINDOW_SIZE) {
+        ViewSize = PCAP_READER_WINDOW_SIZE;
+    }
+
+    if (ViewSize > Reader->Size - ViewOffset) {
+        ViewSize = Reader->Size - ViewOffset;
+    }
+
+    SIZE_T Size = (SIZE_T)ViewSize;
+    if (Size != ViewSize) {
+        return ERROR_NOT_ENOUGH_MEMORY; // 32位的进程里，超过4GB的记录。
+    }
+
+#ifdef _WIN32
+    const void * View =
+        MapViewOfFile(Reader->Mapping, FILE_MAP_READ, (DWORD)(ViewOffset >> 32), (DWORD)ViewOffset, Size);
+    if (nullptr == View) {
+        return GetLastError();
+    }
+#else
+    void * View = mmap(nullptr, Size, PROT_READ, MAP_SHARED, Reader->File, (off_t)ViewOffset);
+    if (MAP_FAILED == View) {
+        return ErrnoToStatus(errno);
+    }
+
+    madvise(View, Size, MADV_SEQUENTIAL); //同FILE_FLAG_SEQUENTIAL_SCAN，只是建议，失败了也无所谓。
+#endif
+
+    Reader->View = reinterpret_cast<const BYTE *>(View);
+    Reader->ViewOffset = ViewOffset;
+    Reader->ViewSize = Size;
+
+    *Data = Reader->View + (Offset - ViewOffset);
+    return ERROR_SUCCESS;
+}
+
+
+static UINT64 PcapngToNanoseconds(UINT64 Timestamp, UINT8 TsResol)
+/*
+功能：按接口的if_tsresol把时间戳换算为纳秒。
+
+最高位为0表示10的负几次方（默认是6，即微秒），为1表示2的负几次方。
+
+注意：2的负几次方的小数部分最多有63位，乘以10^9会超出64位，所以指数大于32的分成高低32位分别相乘
+（10^9小于2^32，各自的积不超过2^62），再右移，结果和128位的乘法一样（不用_umul128，x86上也可以用）。
+*/
+{
+    static const UINT64 PowerOf10[] = {1ULL,
+                                       10ULL,
+                                       100ULL,
+                                       1000ULL,
+                                       10000ULL,
+                                       100000ULL,
+                                       1000000ULL,
+                                       10000000ULL,
+                                       100000000ULL,
+                                       1000000000ULL};
+
+    UINT8 Exponent = TsResol & 0x7f;
+
+    if (TsResol & 0x80) {
+        if (Exponent >= 64) {
+            return 0;
+        }
+
+        UINT64 Fraction = Timestamp & ((1ULL << Exponent) - 1);
+        UINT64 Nanoseconds;
+
+        if (Exponent <= 32) {
+            Nanoseconds = (Fraction * 1000000000ULL) >> Exponent;
+        } else {
+            UINT64 High = (Fraction >> 32) * 1000000000ULL;
+            UINT64 Low = (Fraction & MAXUINT32) * 1000000000ULL;
+            Nanoseconds = (High + (Low >> 32)) >> (Exponent - 32); //积的低32位在右移时都会被移掉。
+        }
+
+        return (Timestamp >> Exponent) * 1000000000ULL + Nanoseconds;
+    }
+
+    if (Exponent <= 9) {
+        return Timestamp * PowerOf10[9 - Exponent];
+    }
+
+    for (UINT8 i = 9; i < Exponent && Timestamp; i++) {
+        Timestamp /= 10;
+    }
+
+    return Timestamp;
+}
+
+
+static ULONG PcapNextPcapRecord(_Inout_ PPCAP_READER Reader, _Out_ PPCAP_PACKET Packet)
+{
+    UINT64 Remaining = Reader->Size - Reader->Offset;
+    if (Remaining < sizeof(PCAP_RECORD_HEADER)) {
+        return 0 == Remaining ? ERROR_NO_MORE_ITEMS : ERROR_INVALID_DATA;
+    }
+
+    const BYTE * Record;
+    ULONG ret = PcapMapWindow(Reader, Reader->Offset, sizeof(PCAP_RECORD_HEADER), &Record);
+    if (ERROR_SUCCESS != ret) {
+        return ret;
+    }
+
+    UINT32 Seconds = PcapRead32(Record, Reader->Swapped);
+    UINT32 Fraction = PcapRead32(Record + 4, Reader->Swapped);
+    UINT32 CapturedLength = PcapRead32(Record + 8, Reader->Swapped);
+    UINT32 OriginalLength = PcapRead32(Record + 12, Reader->Swapped);
+
+    if (Remaining - sizeof(PCAP_RECORD_HEADER) < CapturedLength) {
+        return ERROR_INVALID_DATA;
+    }
+
+    ret = PcapMapWindow(Reader, Reader->Offset, sizeof(PCAP_RECORD_HEADER) + CapturedLength, &Record); //可能跨窗口。
+    if (ERROR_SUCCESS != ret) {
+        return ret;
+    }
+
+    Packet->Data = Record + sizeof(PCAP_RECORD_HEADER);
+    Packet->Length = CapturedLength;
+    Packet->OriginalLength = OriginalLength;
+    Packet->LinkType = Reader->LinkType;
+    Packet->Timestamp = Seconds * 1000000000ULL + (Reader->Nanoseconds ? Fraction : Fraction * 1000ULL);
+
+    Reader->Offset += sizeof(PCAP_RECORD_HEADER) + CapturedLength;
+
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG PcapNextPcapngBlock(_Inout_ PPCAP_READER Reader, _Out_ PPCAP_PACKET Packet)
+/*
+功能：返回下一个包（EPB或者SPB），顺便处理SHB和IDB，跳过其他的块。
+*/
+{
+    for (;;) {
+        UINT64 Remaining = Reader->Size - Reader->Offset;
+        if (0 == Remaining) {
+            return ERROR_NO_MORE_ITEMS;
+        }
+
+        if (Remaining < 12) {
+            return ERROR_INVALID_DATA;
+        }
+
+        const BYTE * Block;
+        ULONG ret = PcapMapWindow(Reader, Reader->Offset, 12, &Block);
+        if (ERROR_SUCCESS != ret) {
+            return ret;
+        }
+
+        UINT32 BlockType = PcapRead32(Block, false); // SHB的类型是回文，和字节序无关。
+
+        if (PCAPNG_BLOCK_SECTION_HEADER == BlockType) { //新的节，可能换了字节序。
+            UINT32 Magic = PcapRead32(Block + 8, false);
+            if (PCAPNG_BYTE_ORDER_MAGIC == Magic) {
+                Reader->Swapped = false;
+            } else if (_byteswap_ulong(PCAPNG_BYTE_ORDER_MAGIC) == Magic) {
+                Reader->Swapped = true;
+            } else {
+                return ERROR_INVALID_DATA;
+            }
+
+            Reader->InterfaceCount = 0;
+        } else {
+            BlockType = PcapRead32(Block, Reader->Swapped);
+        }
+
+        UINT32 BlockLength = PcapRead32(Block + 4, Reader->Swapped);
+        if (BlockLength < 12 || (BlockLength & 3) || BlockLength > Remaining) {
+            return ERROR_INVALID_DATA;
+        }
+
+        ret = PcapMapWindow(Reader, Reader->Offset, BlockLength, &Block); //可能跨窗口。
+        if (ERROR_SUCCESS != ret) {
+            return ret;
+        }
+
+        Reader->Offset += BlockLength;
+
+        const BYTE * Body = Block + 8;
+        UINT32 BodyLength = BlockLength - 12;
+
+        switch (BlockType) {
+        case PCAPNG_BLOCK_INTERFACE:
+        {
+            if (BodyLength < 8) {
+                return ERROR_INVALID_DATA;
+            }
+
+            if (PCAPNG_MAX_INTERFACES == Reader->InterfaceCount) {
+                return ERROR_NOT_SUPPORTED;
+            }
+
+            PCAPNG_INTERFACE & Interface = Reader->Interfaces[Reader->InterfaceCount++];
+            Interface.LinkType = PcapRead16(Body, Reader->Swapped);
+            Interface.TsResol = 6;
+
+            for (UINT32 i = 8; BodyLength - i >= 4;) { //选项。
+                UINT16 Code = PcapRead16(Body + i, Reader->Swapped);
+                UINT16 Length = PcapRead16(Body + i + 2, Reader->Swapped);
+                UINT32 Padded = (Length + 3u) & ~3u;
+
+                if (PCAPNG_OPTION_END == Code || BodyLength - i - 4 < Padded) {
+                    break;
+                }
+
+                if (PCAPNG_OPTION_IF_TSRESOL == Code && 1 == Length) {
+                    Interface.TsResol = Body[i + 4];
+                }
+
+                i += 4 + Padded;
+            }
+
+            break;
+        }
+        case PCAPNG_BLOCK_ENHANCED_PACKET:
+        {
+            if (BodyLength < 20) {
+                return ERROR_INVALID_DATA;
+            }
+
+            UINT32 InterfaceId = PcapRead32(Body, Reader->Swapped);
+            UINT64 Timestamp = ((UINT64)PcapRead32(Body + 4, Reader->Swapped) << 32) |
+                               PcapRead32(Body + 8, Reader->Swapped);
+            UINT32 CapturedLength = PcapRead32(Body + 12, Reader->Swapped);
+
+            if (InterfaceId >= Reader->InterfaceCount || CapturedLength > BodyLength - 20) {
+                return ERROR_INVALID_DATA;
+            }
+
+            const PCAPNG_INTERFACE & Interface = Reader->Interfaces[InterfaceId];
+
+            Packet->Data = Body + 20;
+            Packet->Length = CapturedLength;
+            Packet->OriginalLength = PcapRead32(Body + 16, Reader->Swapped);
+            Packet->LinkType = Interface.LinkType;
+            Packet->Timestamp = PcapngToNanoseconds(Timestamp, Interface.TsResol);
+            return ERROR_SUCCESS;
+        }
+        case PCAPNG_BLOCK_SIMPLE_PACKET:
+        {
+            if (BodyLength < 4 || 0 == Reader->InterfaceCount) {
+                return ERROR_INVALID_DATA;
+            }
+
+            UINT32 OriginalLength = PcapRead32(Body, Reader->Swapped);
+
+            Packet->Data = Body + 4;
+            Packet->Length = OriginalLength < BodyLength - 4 ? OriginalLength : BodyLength - 4;
+            Packet->OriginalLength = OriginalLength;
+            Packet->LinkType = Reader->Interfaces[0].LinkType;
+            Packet->Timestamp = 0; // SPB没有时间戳。
+            return ERROR_SUCCESS;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI PcapOpenReader(_In_z_ const PCAP_CHAR * FileName, _Out_ PPCAP_READER * Reader)
+/*
+功能：打开一个pcap/pcapng文件，并映射开头的窗口。
+
+注意：用完要调用PcapCloseReader。PcapNextPacket返回的数据只在下一次PcapNextPacket之前有效（窗口会换）。
+*/
+{
+    *Reader = nullptr;
+
+    PPCAP_READER Temp = reinterpret_cast<PPCAP_READER>(MALLOC(sizeof(struct _PCAP_READER)));
+    if (nullptr == Temp) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    ULONG ret = ERROR_SUCCESS;
+    const BYTE * Header;
+    UINT32 Magic;
+#ifdef _WIN32
+    SYSTEM_INFO SystemInfo;
+    LARGE_INTEGER FileSize;
+
+    GetSystemInfo(&SystemInfo);
+    Temp->Granularity = SystemInfo.dwAllocationGranularity;
+
+    Temp->File = CreateFileW(FileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (INVALID_HANDLE_VALUE == Temp->File) {
+        ret = GetLastError();
+        goto Cleanup;
+    }
+
+    if (!GetFileSizeEx(Temp->File, &FileSize)) {
+        ret = GetLastError();
+        goto Cleanup;
+    }
+
+    Temp->Size = FileSize.QuadPart;
+#else
+    struct stat Stat;
+
+    Temp->Granularity = (ULONG)sysconf(_SC_PAGESIZE);
+
+    Temp->File = open(FileName, O_RDONLY | O_CLOEXEC);
+    if (Temp->File < 0) {
+        ret = ErrnoToStatus(errno);
+        goto Cleanup;
+    }
+
+    if (fstat(Temp->File, &Stat) < 0) {
+        ret = ErrnoToStatus(errno);
+        goto Cleanup;
+    }
+
+    Temp->Size = (UINT64)Stat.st_size;
+#endif
+
+    if (Temp->Size < sizeof(UINT32)) {
+        ret = ERROR_INVALID_DATA;
+        goto Cleanup;
+    }
+
+#ifdef _WIN32
+    Temp->Mapping = CreateFileMappingW(Temp->File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (nullptr == Temp->Mapping) {
+        ret = GetLastError();
+        goto Cleanup;
+    }
+#endif
+
+    ret = PcapMapWindow(Temp, 0, sizeof(UINT32), &Header);
+    if (ERROR_SUCCESS != ret) {
+        goto Cleanup;
+    }
+
+    Magic = PcapRead32(Header, false);
+
+    if (PCAPNG_BLOCK_SECTION_HEADER == Magic) {
+        Temp->Format = PCAP_FORMAT_PCAPNG; //文件头也是一个块，由PcapNextPcapngBlock处理。
+        goto Cleanup;
+    }
+
+    if (Temp->Size < sizeof(PCAP_FILE_HEADER)) {
+        ret = ERROR_INVALID_DATA;
+        goto Cleanup;
+    }
+
+    switch (Magic) {
+    case PCAP_MAGIC_MICROSECONDS:
+        break;
+    case PCAP_MAGIC_NANOSECONDS:
+        Temp->Nanoseconds = true;
+        break;
+    case PCAP_MAGIC_MICROSECONDS_SWAPPED:
+        Temp->Swapped = true;
+        break;
+    case PCAP_MAGIC_NANOSECONDS_SWAPPED:
+        Temp->Swapped = true;
+        Temp->Nanoseconds = true;
+        break;
+    default:
+        ret = ERROR_INVALID_DATA;
+        goto Cleanup;
+    }
+
+    ret = PcapMapWindow(Temp, 0, sizeof(PCAP_FILE_HEADER), &Header);
+    if (ERROR_SUCCESS != ret) {
+        goto Cleanup;
+    }
+
+    Temp->Format = PCAP_FORMAT_PCAP;
+    Temp->LinkType = PcapRead32(Header + FIELD_OFFSET(PCAP_FILE_HEADER, LinkType), Temp->Swapped);
+    Temp->Offset = sizeof(PCAP_FILE_HEADER);
+
+Cleanup:
+    if (ERROR_SUCCESS != ret) {
+        PcapCloseReader(Temp);
+    } else {
+        *Reader = Temp;
+    }
+
+    return ret;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI PcapNextPacket(_Inout_ PPCAP_READER Reader, _Out_ PPCAP_PACKET Packet)
+/*
+功能：返回下一个包在映射的窗口里的位置（不复制）。
+
+返回值：
+ERROR_SUCCESS：成功。
+ERROR_NO_MORE_ITEMS：读完了。
+ERROR_INVALID_DATA：文件损坏（如：被截断）。
+其他：重新映射窗口失败（如：32位的进程的地址空间不够）。
+
+注意：上一次返回的Packet->Data（可能）失效了，要留着的话，调用之前先复制。
+*/
+{
+    RtlZeroMemory(Packet, sizeof(PCAP_PACKET));
+
+    if (PCAP_FORMAT_PCAP == Reader->Format) {
+        return PcapNextPcapRecord(Reader, Packet);
+    }
+
+    return PcapNextPcapngBlock(Reader, Packet);
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI PcapCloseReader(_In_ PPCAP_READER Reader)
+/*
+功能：解除窗口的映射，关闭文件。PcapOpenReader失败的时候也用它清理（各个成员可能还没有打开）。
+*/
+{
+    PcapUnmapWindow(Reader);
+
+#ifdef _WIN32
+    if (Reader->Mapping) {
+        CloseHandle(Reader->Mapping);
+    }
+
+    if (Reader->File && INVALID_HANDLE_VALUE != Reader->File) {
+        CloseHandle(Reader->File);
+    }
+#else
+    if (Reader->File >= 0) {
+        close(Reader->File);
+    }
+#endif
+
+    FREE(Reader);
+}
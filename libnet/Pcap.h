@@ -0,0 +1,99 @@
+﻿#pragma once
+
+#include "LinuxCompat.h" // Linux上单独编译，见test/PcapTest.cpp。
+
+#ifdef _WIN32
+#include "raw.h" // PACKET_SPAN。
+#else
+//批量组包时每个帧在缓冲区里的位置，同raw.h，见PcapWriteBatch。
+typedef struct _PACKET_SPAN {
+    SIZE_T Offset; //相对于缓冲区开始的偏移。
+    ULONG Length;  //帧的长度。
+} PACKET_SPAN, * PPACKET_SPAN;
+#endif
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+//pcap/pcapng文件的读写，见PcapOpenWriter/PcapOpenReader。
+#define PCAP_FORMAT_PCAP        1
+#define PCAP_FORMAT_PCAPNG      2
+#define PCAP_LINKTYPE_ETHERNET  1
+
+//文件格式里的常量，Pcap.cpp和test/PcapBenchmark.cpp（手工构造文件）用。
+#define PCAP_MAGIC_MICROSECONDS 0xa1b2c3d4
+#define PCAP_MAGIC_NANOSECONDS  0xa1b23c4d
+#define PCAP_MAGIC_MICROSECONDS_SWAPPED 0xd4c3b2a1
+#define PCAP_MAGIC_NANOSECONDS_SWAPPED  0x4d3cb2a1
+
+#define PCAPNG_BLOCK_SECTION_HEADER     0x0A0D0D0A
+#define PCAPNG_BLOCK_INTERFACE          0x00000001
+#define PCAPNG_BLOCK_SIMPLE_PACKET      0x00000003
+#define PCAPNG_BLOCK_ENHANCED_PACKET    0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC         0x1A2B3C4D
+#define PCAPNG_OPTION_END               0
+#define PCAPNG_OPTION_IF_TSRESOL        9
+
+#define PCAP_MAX_SNAPLEN        262144 //写的时候超过的部分截掉。
+
+typedef struct _PCAP_WRITER PCAP_WRITER, * PPCAP_WRITER;
+typedef struct _PCAP_READER PCAP_READER, * PPCAP_READER;
+
+
+#ifdef _WIN32
+typedef WCHAR PCAP_CHAR; // Windows的文件名是UTF-16。
+#else
+typedef char PCAP_CHAR;  // Linux的是原样的字节（一般是UTF-8）。
+#endif
+
+
+typedef struct _PCAP_PACKET {
+    const BYTE * Data;     //指向映射的窗口，不是复制的，下一次PcapNextPacket之前有效。
+    UINT32 Length;         //文件里的长度。
+    UINT32 OriginalLength; //线路上的长度。
+    UINT64 Timestamp;      //纳秒，自1970-01-01 UTC。
+    UINT32 LinkType;
+} PCAP_PACKET, * PPCAP_PACKET;
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C_START
+
+
+DLLEXPORT
+ULONG WINAPI PcapOpenWriter(_In_z_ const PCAP_CHAR * FileName,
+                            _In_ ULONG Format,
+                            _In_ ULONG LinkType,
+                            _Out_ PPCAP_WRITER * Writer);
+
+DLLEXPORT
+ULONG WINAPI PcapWritePacket(_In_ PPCAP_WRITER Writer,
+                             _In_ UINT64 Timestamp,
+                             _In_reads_bytes_(Length) const BYTE * Frame,
+                             _In_ ULONG Length,
+                             _In_ ULONG OriginalLength);
+
+DLLEXPORT
+ULONG WINAPI PcapWriteBatch(_In_ PPCAP_WRITER Writer,
+                            _In_ UINT64 Timestamp,
+                            _In_ const BYTE * Slab,
+                            _In_reads_(Count) const PACKET_SPAN * Spans,
+                            _In_ ULONG Count);
+
+DLLEXPORT
+ULONG WINAPI PcapCloseWriter(_In_ PPCAP_WRITER Writer);
+
+DLLEXPORT
+ULONG WINAPI PcapOpenReader(_In_z_ const PCAP_CHAR * FileName, _Out_ PPCAP_READER * Reader);
+
+DLLEXPORT
+ULONG WINAPI PcapNextPacket(_Inout_ PPCAP_READER Reader, _Out_ PPCAP_PACKET Packet);
+
+DLLEXPORT
+void WINAPI PcapCloseReader(_In_ PPCAP_READER Reader);
+
+
+EXTERN_C_END
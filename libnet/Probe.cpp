@@ -0,0 +1,355 @@
+﻿#include "pch.h"
+#include "Probe.h"
+#include "Dissector.h"
+#include "PacketTemplate.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/*
+无状态的探测（SYN cookie式的）。
+
+发出的SYN：
+1.源端口 = PortBase + SipHash(密钥，目的地址，目的端口，纪元) % PortCount。
+2.初始序号 = SipHash(密钥，目的地址，目的端口，源端口，纪元)的低32位。
+
+收到的回应（SYN+ACK或者RST+ACK）：
+它的源地址和源端口就是探测的目的地址和目的端口，用它们重新计算源端口和初始序号，
+再和回应的目的端口，确认号减一比较，相等就是自己发出的探测的回应。
+
+这样验证和归属都是O(1)的，不需要为每个探测保存状态，几百万个探测同时在途时内存也不会增长。
+
+注意：
+1.纪元由调用者递增（如：每轮扫描，或者每隔一段时间），匹配时接受当前的和上一个纪元。
+2.密钥要保密，否则别人可以伪造回应。
+*/
+
+
+#pragma pack(push, 1)
+typedef struct _PROBE_HASH_INPUT { // SipHash的输入，固定32字节。
+    BYTE Address[16];              // IPv4的只用前4个字节，其余是0。
+    UINT32 Epoch;
+    UINT16 DestinationPort;        //主机序。
+    UINT16 SourcePort;             //主机序，算源端口时是0。
+    UINT8 IpVersion;
+    UINT8 Stage;                   // PROBE_STAGE_*，区分两次计算。
+    UINT16 Reserved;
+    UINT32 Reserved2;
+} PROBE_HASH_INPUT, * PPROBE_HASH_INPUT;
+#pragma pack(pop)
+
+static_assert(sizeof(PROBE_HASH_INPUT) == 32, "SipHash的输入应该是32字节。");
+
+#define PROBE_STAGE_PORT 1
+#define PROBE_STAGE_SEQ  2
+
+
+static FORCEINLINE UINT64 Rotl64(UINT64 Value, int Shift)
+{
+    return (Value << Shift) | (Value >> (64 - Shift));
+}
+
+
+#define SIP_ROUND(v0, v1, v2, v3) \
+    do {                          \
+        v0 += v1;                 \
+        v1 = Rotl64(v1, 13);      \
+        v1 ^= v0;                 \
+        v0 = Rotl64(v0, 32);      \
+        v2 += v3;                 \
+        v3 = Rotl64(v3, 16);      \
+        v3 ^= v2;                 \
+        v0 += v3;                 \
+        v3 = Rotl64(v3, 21);      \
+        v3 ^= v0;                 \
+        v2 += v1;                 \
+        v1 = Rotl64(v1, 17);      \
+        v1 ^= v2;                 \
+        v2 = Rotl64(v2, 32);      \
+    } while (0)
+
+
+static UINT64 SipHash24(_In_ const UINT64 Key[2], _In_ const PROBE_HASH_INPUT * Input)
+/*
+功能：SipHash-2-4（小端）。
+
+输入的长度固定是32字节（4个字），所以没有处理不足8字节的尾部，最后一个块只有长度。
+*/
+{
+    UINT64 v0 = 0x736f6d6570736575ULL ^ Key[0];
+    UINT64 v1 = 0x646f72616e646f6dULL ^ Key[1];
+    UINT64 v2 = 0x6c7967656e657261ULL ^ Key[0];
+    UINT64 v3 = 0x7465646279746573ULL ^ Key[1];
+    const BYTE * Data = reinterpret_cast<const BYTE *>(Input);
+
+    for (SIZE_T i = 0; i < sizeof(PROBE_HASH_INPUT); i += sizeof(UINT64)) {
+        UINT64 m;
+        RtlCopyMemory(&m, Data + i, sizeof(m));
+        v3 ^= m;
+        SIP_ROUND(v0, v1, v2, v3);
+        SIP_ROUND(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+
+    UINT64 b = (UINT64)sizeof(PROBE_HASH_INPUT) << 56;
+    v3 ^= b;
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+
+static FORCEINLINE void InitHashInput(_Out_ PPROBE_HASH_INPUT Input,
+                                      _In_ UINT8 IpVersion,
+                                      _In_ const void * Address,
+                                      _In_ UINT16 DestinationPort,
+                                      _In_ UINT32 Epoch)
+{
+    RtlZeroMemory(Input, sizeof(PROBE_HASH_INPUT));
+    RtlCopyMemory(Input->Address, Address, 4 == IpVersion ? sizeof(IN_ADDR) : sizeof(IN6_ADDR));
+    Input->Epoch = Epoch;
+    Input->DestinationPort = DestinationPort;
+    Input->IpVersion = IpVersion;
+}
+
+
+static FORCEINLINE UINT16 ProbeSourcePort(_In_ const PROBE_CONTEXT * Context, _Inout_ PPROBE_HASH_INPUT Input)
+{
+    Input->SourcePort = 0;
+    Input->Stage = PROBE_STAGE_PORT;
+    return (UINT16)(Context->PortBase + (SipHash24(Context->Key, Input) >> 32) % Context->PortCount);
+}
+
+
+static FORCEINLINE UINT32 ProbeIsn(_In_ const PROBE_CONTEXT * Context,
+                                   _Inout_ PPROBE_HASH_INPUT Input,
+                                   _In_ UINT16 SourcePort)
+{
+    Input->SourcePort = SourcePort;
+    Input->Stage = PROBE_STAGE_SEQ;
+    return (UINT32)SipHash24(Context->Key, Input);
+}
+
+
+static void ProbeSequence(_In_ const PROBE_CONTEXT * Context,
+                          _In_ UINT8 IpVersion,
+                          _In_ const void * DestinationAddress,
+                          _In_ UINT16 th_dport,
+                          _Out_ PUINT16 th_sport,
+                          _Out_ SEQ_NUM * th_seq)
+{
+    PROBE_HASH_INPUT Input;
+
+    InitHashInput(&Input, IpVersion, DestinationAddress, ntohs(th_dport), Context->Epoch);
+
+    UINT16 SourcePort = ProbeSourcePort(Context, &Input);
+    UINT32 Isn = ProbeIsn(Context, &Input, SourcePort);
+
+    *th_sport = htons(SourcePort);
+    *th_seq = htonl(Isn);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI ProbeInitialize(_Out_ PPROBE_CONTEXT Context,
+                             _In_reads_bytes_opt_(16) const BYTE * Key, // NULL：随机生成。
+                             _In_ UINT16 PortBase,                       //主机序。
+                             _In_ UINT16 PortCount)
+/*
+功能：初始化无状态的探测。
+
+参数：
+Key：SipHash的密钥，16字节。NULL表示用系统的随机数生成器生成。
+     多个进程（或者机器）分担同一个扫描时，用同样的密钥和纪元，回应可以在任何一个上匹配。
+PortBase和PortCount：源端口的范围，不能为空，也不能超过65535。
+                     建议避开本机的动态端口范围，并用防火墙丢弃这些端口收到的包，以免系统回应RST。
+
+返回值：ERROR_SUCCESS，ERROR_INVALID_PARAMETER，ERROR_GEN_FAILURE（生成随机数失败）。
+*/
+{
+    if (nullptr == Context || 0 == PortCount || (ULONG)PortBase + PortCount > 0x10000) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    RtlZeroMemory(Context, sizeof(PROBE_CONTEXT));
+
+    if (Key) {
+        RtlCopyMemory(Context->Key, Key, sizeof(Context->Key));
+    } else {
+        NTSTATUS Status = BCryptGenRandom(nullptr,
+                                          reinterpret_cast<PUCHAR>(Context->Key),
+                                          sizeof(Context->Key),
+                                          BCRYPT_USE_SYSTEM_PREFERRED_RNG);
+        if (!BCRYPT_SUCCESS(Status)) {
+            return ERROR_GEN_FAILURE;
+        }
+    }
+
+    Context->PortBase = PortBase;
+    Context->PortCount = PortCount;
+
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI ProbeSequence4(_In_ const PROBE_CONTEXT * Context,
+                           _In_ const IN_ADDR * DestinationAddress,
+                           _In_ UINT16 th_dport, //网络序。
+                           _Out_ PUINT16 th_sport, //网络序。
+                           _Out_ SEQ_NUM * th_seq) //网络序。
+/*
+功能：计算发往DestinationAddress:th_dport的探测的源端口和初始序号（当前纪元）。
+
+用于自己组包（如：PacketizeSyn4Batch之后再改）的场合，一般直接用PacketizeProbe4。
+*/
+{
+    ProbeSequence(Context, 4, DestinationAddress, th_dport, th_sport, th_seq);
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI ProbeSequence6(_In_ const PROBE_CONTEXT * Context,
+                           _In_ const IN6_ADDR * DestinationAddress,
+                           _In_ UINT16 th_dport, //网络序。
+                           _Out_ PUINT16 th_sport, //网络序。
+                           _Out_ SEQ_NUM * th_seq) //网络序。
+/*
+功能：ProbeSequence4的IPv6版。
+*/
+{
+    ProbeSequence(Context, 6, DestinationAddress, th_dport, th_sport, th_seq);
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI PacketizeProbe4(_In_ const PROBE_CONTEXT * Context,
+                            _In_reads_bytes_(6) const BYTE * SrcMac,
+                            _In_reads_bytes_(6) const BYTE * DesMac,
+                            _In_ const IN_ADDR * SourceAddress,
+                            _In_ const IN_ADDR * DestinationAddress,
+                            _In_ UINT16 th_dport, //网络序。
+                            _Out_ PBYTE buffer)   //长度是sizeof(RAW_TCP) + sizeof(TCP_OPT_MSS)。
+/*
+功能：组装IPv4的探测（SYN包，带MSS选项），源端口和初始序号由ProbeSequence4计算。
+
+除了源端口和序号，和PacketizeSyn4组装的一样。
+*/
+{
+    UINT16 th_sport;
+    SEQ_NUM th_seq;
+
+    ProbeSequence(Context, 4, DestinationAddress, th_dport, &th_sport, &th_seq);
+    PacketTemplate::Syn4::Build(
+        buffer, SrcMac, DesMac, SourceAddress, DestinationAddress, th_sport, th_dport, th_seq, 0);
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI PacketizeProbe6(_In_ const PROBE_CONTEXT * Context,
+                            _In_reads_bytes_(6) const BYTE * SrcMac,
+                            _In_reads_bytes_(6) const BYTE * DesMac,
+                            _In_ const IN6_ADDR * SourceAddress,
+                            _In_ const IN6_ADDR * DestinationAddress,
+                            _In_ UINT16 th_dport, //网络序。
+                            _Out_ PBYTE buffer)   //长度是sizeof(RAW6_TCP)。
+/*
+功能：PacketizeProbe4的IPv6版，和PacketizeSyn6组装的一样（除了源端口和序号）。
+*/
+{
+    UINT16 th_sport;
+    SEQ_NUM th_seq;
+
+    ProbeSequence(Context, 6, DestinationAddress, th_dport, &th_sport, &th_seq);
+    PacketTemplate::Syn6::Build(
+        buffer, SrcMac, DesMac, SourceAddress, DestinationAddress, th_sport, th_dport, th_seq, 0);
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI ProbeMatchReply(_In_ const PROBE_CONTEXT * Context,
+                             _In_reads_bytes_(Size) const BYTE * Frame, //以太帧。
+                             _In_ SIZE_T Size,
+                             _Out_ PPROBE_REPLY Reply)
+/*
+功能：判断收到的帧是不是自己发出的探测（PacketizeProbe4/6）的回应，是的话给出探测的目的地址和端口。
+
+只接受SYN+ACK（端口开放）和RST+ACK（端口关闭，按RFC 793，RST回应SYN时会带上ACK）。
+先用DissectPacket解析，再按回应的源地址和源端口重新计算，不查表。
+
+返回值：
+ERROR_SUCCESS：是自己的探测的回应，见Reply。
+ERROR_NOT_FOUND：不是（别的流量，伪造的，或者纪元太旧的回应）。
+其他：DissectPacket的错误（截断或者畸形的帧）。
+*/
+{
+    PACKET_INFO Info;
+    ULONG ret = DissectPacket(Frame, Size, &Info);
+    if (ERROR_SUCCESS != ret) {
+        return ret;
+    }
+
+    if (!(Info.Layers & PACKET_LAYER_TCP)) {
+        return ERROR_NOT_FOUND;
+    }
+
+    UINT8 Flags = Info.TcpFlags & (TH_SYN | TH_ACK | TH_RST);
+    if ((TH_SYN | TH_ACK) != Flags && (TH_RST | TH_ACK) != Flags) {
+        return ERROR_NOT_FOUND;
+    }
+
+    if ((UINT16)(Info.DestinationPort - Context->PortBase) >= Context->PortCount) {
+        return ERROR_NOT_FOUND;
+    }
+
+    //回应的源地址就是探测的目的地址。
+    const BYTE * SourceAddress = Frame + Info.L3Offset +
+                                 (4 == Info.IpVersion ? offsetof(IPV4_HEADER, SourceAddress)
+                                                      : offsetof(IPV6_HEADER, SourceAddress));
+
+    PROBE_HASH_INPUT Input;
+    UINT32 Epochs[] = {Context->Epoch, Context->Epoch - 1};
+
+    for (auto Epoch : Epochs) {
+        InitHashInput(&Input, Info.IpVersion, SourceAddress, Info.SourcePort, Epoch);
+
+        //先比较序号（别人的流量绝大多数在这里就被排除了），再确认源端口也是这个纪元算出来的。
+        if (Info.Ack - 1 != ProbeIsn(Context, &Input, Info.DestinationPort)) {
+            continue;
+        }
+
+        if (Info.DestinationPort != ProbeSourcePort(Context, &Input)) {
+            continue;
+        }
+
+        RtlZeroMemory(Reply, sizeof(PROBE_REPLY));
+        Reply->IpVersion = Info.IpVersion;
+        Reply->TcpFlags = Info.TcpFlags;
+        Reply->Port = Info.SourcePort;
+        Reply->Epoch = Epoch;
+        RtlCopyMemory(Reply->Address, Input.Address, sizeof(Reply->Address));
+
+        return ERROR_SUCCESS;
+    }
+
+    return ERROR_NOT_FOUND;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,87 @@
+﻿#pragma once
+
+#include "pch.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/*
+无状态的探测（SYN cookie式的）。见ProbeInitialize。
+
+源端口和初始序号（ISN）都由密钥和(目的地址，目的端口，纪元)算出来，
+收到的回应（SYN+ACK或者RST+ACK）只需重新计算一次就能验证和归属，不需要为每个探测保存状态。
+*/
+typedef struct _PROBE_CONTEXT {
+    UINT64 Key[2];    // SipHash的密钥。
+    UINT32 Epoch;     //纪元，由调用者递增（如：每轮扫描）。匹配时也接受上一个纪元的回应。
+    UINT16 PortBase;  //源端口的范围：[PortBase, PortBase + PortCount)，主机序。
+    UINT16 PortCount;
+} PROBE_CONTEXT, * PPROBE_CONTEXT;
+
+
+//ProbeMatchReply的结果。所有的数值都是主机序。
+typedef struct _PROBE_REPLY {
+    UINT8 IpVersion;  // 4或者6。
+    UINT8 TcpFlags;   //回应的TCP标志，如：TH_SYN | TH_ACK（端口开放），TH_RST | TH_ACK（端口关闭）。
+    UINT16 Port;      //探测的目的端口。
+    UINT32 Epoch;     //探测所在的纪元。
+    BYTE Address[16]; //探测的目的地址，IPv4的只用前4个字节。
+} PROBE_REPLY, * PPROBE_REPLY;
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C_START
+
+
+DLLEXPORT
+ULONG WINAPI ProbeInitialize(_Out_ PPROBE_CONTEXT Context,
+                             _In_reads_bytes_opt_(16) const BYTE * Key,
+                             _In_ UINT16 PortBase,
+                             _In_ UINT16 PortCount);
+
+DLLEXPORT
+void WINAPI ProbeSequence4(_In_ const PROBE_CONTEXT * Context,
+                           _In_ const IN_ADDR * DestinationAddress,
+                           _In_ UINT16 th_dport,
+                           _Out_ PUINT16 th_sport,
+                           _Out_ SEQ_NUM * th_seq);
+
+DLLEXPORT
+void WINAPI ProbeSequence6(_In_ const PROBE_CONTEXT * Context,
+                           _In_ const IN6_ADDR * DestinationAddress,
+                           _In_ UINT16 th_dport,
+                           _Out_ PUINT16 th_sport,
+                           _Out_ SEQ_NUM * th_seq);
+
+DLLEXPORT
+void WINAPI PacketizeProbe4(_In_ const PROBE_CONTEXT * Context,
+                            _In_reads_bytes_(6) const BYTE * SrcMac,
+                            _In_reads_bytes_(6) const BYTE * DesMac,
+                            _In_ const IN_ADDR * SourceAddress,
+                            _In_ const IN_ADDR * DestinationAddress,
+                            _In_ UINT16 th_dport,
+                            _Out_ PBYTE buffer);
+
+DLLEXPORT
+void WINAPI PacketizeProbe6(_In_ const PROBE_CONTEXT * Context,
+                            _In_reads_bytes_(6) const BYTE * SrcMac,
+                            _In_reads_bytes_(6) const BYTE * DesMac,
+                            _In_ const IN6_ADDR * SourceAddress,
+                            _In_ const IN6_ADDR * DestinationAddress,
+                            _In_ UINT16 th_dport,
+                            _Out_ PBYTE buffer);
+
+DLLEXPORT
+ULONG WINAPI ProbeMatchReply(_In_ const PROBE_CONTEXT * Context,
+                             _In_reads_bytes_(Size) const BYTE * Frame,
+                             _In_ SIZE_T Size,
+                             _Out_ PPROBE_REPLY Reply);
+
+
+EXTERN_C_END
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
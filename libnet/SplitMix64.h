@@ -0,0 +1,18 @@
+﻿#pragma once
+
+/*
+splitmix64：基准测试和随机化（如：CidrIteratorInit的打乱）用的伪随机数。
+
+快，状态只有64位，同样的种子得到同样的序列（基准测试可以重现）。不是密码学安全的。
+
+https://prng.di.unimi.it/splitmix64.c
+*/
+
+
+inline UINT64 SplitMix64(_Inout_ PUINT64 State)
+{
+    UINT64 z = (*State += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
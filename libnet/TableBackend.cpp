@@ -0,0 +1,176 @@
+﻿#include "pch.h"
+#include "TableBackend.h"
+#include "TableDiff.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/*
+取连接表的后端：各个平台用同样的接口（TableBackendEnumerate）取同样的行（TABLE_BACKEND_ROW）。
+
+1.Windows：TABLE_BACKEND_IPHELPER，即GetExtendedTcpTable和GetExtendedUdpTable的OWNER_PID的表，
+  每个表一个TABLE_SNAPSHOT（缓冲区跨调用重用），行用TableDiffGetRow统一，按批交给回调。
+2.Linux：TABLE_BACKEND_NETLINK和TABLE_BACKEND_PROCFS，见TableBackendLinux.cpp（不在这个工程里编译）。
+
+Windows的表本来就有PID，忽略TABLE_BACKEND_NO_PIDS。
+*/
+
+
+//行的格式和TABLE_DIFF_ROW的一样，可以直接用TableDiffGetRow。
+static_assert(sizeof(TABLE_BACKEND_ROW) == sizeof(TABLE_DIFF_ROW), "");
+static_assert(FIELD_OFFSET(TABLE_BACKEND_ROW, State) == FIELD_OFFSET(TABLE_DIFF_ROW, State), "");
+static_assert(FIELD_OFFSET(TABLE_BACKEND_ROW, OwningPid) == FIELD_OFFSET(TABLE_DIFF_ROW, OwningPid), "");
+static_assert(FIELD_OFFSET(TABLE_BACKEND_ROW, LocalAddress) == FIELD_OFFSET(TABLE_DIFF_ROW, LocalAddress), "");
+static_assert(FIELD_OFFSET(TABLE_BACKEND_ROW, RemoteAddress) == FIELD_OFFSET(TABLE_DIFF_ROW, RemoteAddress), "");
+
+
+#define TABLE_BACKEND_TABLES 4 // TCP4，TCP6，UDP4，UDP6。
+
+
+struct _TABLE_BACKEND {
+    ULONG Type;
+    ULONG Flags;
+    TABLE_SNAPSHOT Snapshots[TABLE_BACKEND_TABLES];
+    TABLE_BACKEND_ROW Rows[TABLE_BACKEND_BATCH];
+    ULONG Enumerations;
+    UINT64 Total;
+};
+
+
+//一个表的参数。
+typedef struct _BACKEND_TABLE {
+    ULONG Table; // TABLE_BACKEND_TCP4等。
+    ULONG Kind;
+    ULONG Family;
+    ULONG Class;
+} BACKEND_TABLE, * PBACKEND_TABLE;
+
+
+static const BACKEND_TABLE g_BackendTables[TABLE_BACKEND_TABLES] = {
+    {TABLE_BACKEND_TCP4, TABLE_SNAPSHOT_TCP_EXTENDED, AF_INET, TCP_TABLE_OWNER_PID_ALL},
+    {TABLE_BACKEND_TCP6, TABLE_SNAPSHOT_TCP_EXTENDED, AF_INET6, TCP_TABLE_OWNER_PID_ALL},
+    {TABLE_BACKEND_UDP4, TABLE_SNAPSHOT_UDP_EXTENDED, AF_INET, UDP_TABLE_OWNER_PID},
+    {TABLE_BACKEND_UDP6, TABLE_SNAPSHOT_UDP_EXTENDED, AF_INET6, UDP_TABLE_OWNER_PID},
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI TableBackendCreate(_In_ ULONG Type, _In_ ULONG Flags, _Out_ PTABLE_BACKEND * Backend)
+/*
+功能：创建取连接表的后端。
+
+参数：
+Type：TABLE_BACKEND_DEFAULT或TABLE_BACKEND_IPHELPER。
+Flags：TABLE_BACKEND_NO_PIDS等。
+
+返回值：Linux的后端（TABLE_BACKEND_NETLINK等）是ERROR_NOT_SUPPORTED。
+*/
+{
+    *Backend = nullptr;
+
+    if (TABLE_BACKEND_DEFAULT == Type) {
+        Type = TABLE_BACKEND_IPHELPER;
+    }
+
+    if (TABLE_BACKEND_IPHELPER != Type) {
+        return TABLE_BACKEND_NETLINK == Type || TABLE_BACKEND_PROCFS == Type ? ERROR_NOT_SUPPORTED
+                                                                             : ERROR_INVALID_PARAMETER;
+    }
+
+    PTABLE_BACKEND Result = reinterpret_cast<PTABLE_BACKEND>(MALLOC(sizeof(TABLE_BACKEND)));
+    if (nullptr == Result) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    Result->Type = Type;
+    Result->Flags = Flags;
+    for (ULONG i = 0; i < TABLE_BACKEND_TABLES; i++) {
+        const BACKEND_TABLE * Table = &g_BackendTables[i];
+        ULONG Status = TableSnapshotInit(&Result->Snapshots[i], Table->Kind, Table->Family, Table->Class, FALSE);
+        if (ERROR_SUCCESS != Status) {
+            TableBackendDestroy(Result);
+            return Status;
+        }
+    }
+
+    *Backend = Result;
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI TableBackendDestroy(_In_opt_ PTABLE_BACKEND Backend)
+{
+    if (nullptr == Backend) {
+        return;
+    }
+
+    for (ULONG i = 0; i < TABLE_BACKEND_TABLES; i++) {
+        TableSnapshotFree(&Backend->Snapshots[i]);
+    }
+
+    FREE(Backend);
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI TableBackendEnumerate(_In_ PTABLE_BACKEND Backend,
+                                   _In_ ULONG Tables,
+                                   _In_ TABLE_BACKEND_CALLBACK Callback,
+                                   _In_opt_ PVOID Context)
+/*
+功能：取当前的连接表（和侦听表），按批（TABLE_BACKEND_BATCH行）交给回调。
+
+参数：
+Tables：TABLE_BACKEND_TCP4等的组合，按TCP4，TCP6，UDP4，UDP6的顺序。
+*/
+{
+    ULONG Status = ERROR_SUCCESS;
+    ULONG Count = 0;
+
+    for (ULONG i = 0; i < TABLE_BACKEND_TABLES && ERROR_SUCCESS == Status; i++) {
+        PTABLE_SNAPSHOT Snapshot = &Backend->Snapshots[i];
+        if (!(Tables & g_BackendTables[i].Table)) {
+            continue;
+        }
+
+        Status = TableSnapshotRefresh(Snapshot);
+        for (ULONG Row = 0; ERROR_SUCCESS == Status && Row < Snapshot->Count; Row++) {
+            Status = TableDiffGetRow(Snapshot, Row, reinterpret_cast<PTABLE_DIFF_ROW>(&Backend->Rows[Count]));
+            if (ERROR_SUCCESS == Status && ++Count == TABLE_BACKEND_BATCH) {
+                Backend->Total += Count;
+                Status = Callback(Context, Backend->Rows, Count);
+                Count = 0;
+            }
+        }
+    }
+
+    if (ERROR_SUCCESS == Status && Count) {
+        Backend->Total += Count;
+        Status = Callback(Context, Backend->Rows, Count);
+    }
+
+    Backend->Enumerations++;
+    return Status;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI TableBackendGetInformation(_In_ PTABLE_BACKEND Backend, _Out_ PTABLE_BACKEND_INFORMATION Information)
+{
+    RtlZeroMemory(Information, sizeof(TABLE_BACKEND_INFORMATION));
+
+    Information->Type = Backend->Type;
+    Information->Enumerations = Backend->Enumerations;
+    Information->Rows = Backend->Total;
+    Information->Bytes = sizeof(TABLE_BACKEND);
+    for (ULONG i = 0; i < TABLE_BACKEND_TABLES; i++) {
+        Information->Bytes += Backend->Snapshots[i].Capacity;
+    }
+}
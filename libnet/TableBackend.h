@@ -0,0 +1,89 @@
+﻿#pragma once
+
+#include "LinuxCompat.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+typedef struct _TABLE_BACKEND TABLE_BACKEND, * PTABLE_BACKEND; //取连接表的后端，见TableBackendEnumerate。不是线程安全的。
+
+
+// TableBackendCreate的Type。
+#define TABLE_BACKEND_DEFAULT  0 // Windows的是TABLE_BACKEND_IPHELPER，Linux的是TABLE_BACKEND_NETLINK。
+#define TABLE_BACKEND_IPHELPER 1 // GetExtendedTcpTable和GetExtendedUdpTable（OWNER_PID），只有Windows的。
+#define TABLE_BACKEND_NETLINK  2 // NETLINK_SOCK_DIAG（inet_diag），内核不支持的表改读/proc/net，只有Linux的。
+#define TABLE_BACKEND_PROCFS   3 //读/proc/net/tcp，tcp6，udp，udp6，只有Linux的。
+
+// TableBackendCreate的Flags。
+#define TABLE_BACKEND_NO_PIDS 0x1 //不找所属的进程（OwningPid是0）。Linux的找进程要遍历/proc/*/fd，比取表慢得多。
+
+// TableBackendEnumerate的Tables。
+#define TABLE_BACKEND_TCP4 0x1
+#define TABLE_BACKEND_TCP6 0x2
+#define TABLE_BACKEND_UDP4 0x4
+#define TABLE_BACKEND_UDP6 0x8
+#define TABLE_BACKEND_ALL  (TABLE_BACKEND_TCP4 | TABLE_BACKEND_TCP6 | TABLE_BACKEND_UDP4 | TABLE_BACKEND_UDP6)
+
+#define TABLE_BACKEND_BATCH 256 //回调一次最多的行数。
+
+
+//各个后端的行统一后的格式，同TABLE_DIFF_ROW（Windows的可以直接当作TABLE_DIFF_ROW用）。
+//端口是主机字节序；IPv4的地址在前4个字节，其余是0。Family是本平台的AF_INET或AF_INET6。
+typedef struct _TABLE_BACKEND_ROW {
+    ADDRESS_FAMILY Family;
+    UINT8 Protocol;        // IPPROTO_TCP或IPPROTO_UDP。
+    UINT8 Reserved;
+    USHORT LocalPort;
+    USHORT RemotePort;     // Windows的UDP的是0，Linux的连接过（connect）的UDP的有。
+    ULONG State;           // TCP的MIB_TCP_STATE（Linux的也换算成这个），UDP的是0。
+    ULONG OwningPid;       //找不到的（没有权限，进程已经退出等）和TABLE_BACKEND_NO_PIDS的是0。
+    UINT8 LocalAddress[16];
+    UINT8 RemoteAddress[16];
+} TABLE_BACKEND_ROW, * PTABLE_BACKEND_ROW;
+
+
+//返回ERROR_SUCCESS以外的值会中止这次枚举（TableBackendEnumerate返回这个值）。
+typedef ULONG(WINAPI * TABLE_BACKEND_CALLBACK)(_In_opt_ PVOID Context,
+                                               _In_reads_(Count) const TABLE_BACKEND_ROW * Rows,
+                                               _In_ ULONG Count);
+
+
+typedef struct _TABLE_BACKEND_INFORMATION {
+    ULONG Type;          //实际用的后端，TABLE_BACKEND_DEFAULT换算后的。
+    ULONG Enumerations;
+    UINT64 Rows;         //累计的行数。
+    ULONG Fallbacks;     // TABLE_BACKEND_NETLINK的内核不支持，改读/proc/net的表的个数。
+    ULONG IndexBuilds;   // Linux的inode到PID的索引的重建次数。
+    ULONG Inodes;        //索引里的socket的个数。
+    UINT64 Unmapped;     //有inode但是找不到进程的行。
+    SIZE_T Bytes;        //占用的内存。
+} TABLE_BACKEND_INFORMATION, * PTABLE_BACKEND_INFORMATION;
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C_START
+
+
+DLLEXPORT
+ULONG WINAPI TableBackendCreate(_In_ ULONG Type, _In_ ULONG Flags, _Out_ PTABLE_BACKEND * Backend);
+
+DLLEXPORT
+void WINAPI TableBackendDestroy(_In_opt_ PTABLE_BACKEND Backend);
+
+DLLEXPORT
+ULONG WINAPI TableBackendEnumerate(_In_ PTABLE_BACKEND Backend,
+                                   _In_ ULONG Tables,
+                                   _In_ TABLE_BACKEND_CALLBACK Callback,
+                                   _In_opt_ PVOID Context);
+
+DLLEXPORT
+void WINAPI TableBackendGetInformation(_In_ PTABLE_BACKEND Backend, _Out_ PTABLE_BACKEND_INFORMATION Information);
+
+
+EXTERN_C_END
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,902 @@
+﻿#include "TableBackend.h"
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/inet_diag.h>
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/*
+Linux的取连接表的后端（TABLE_BACKEND_NETLINK和TABLE_BACKEND_PROCFS）。
+
+这个文件不在Windows的工程里编译，Linux上和TableBackend.h（及OwnerCache.cpp）单独编译，如：
+g++ -std=c++17 -O2 -shared -fPIC TableBackendLinux.cpp OwnerCache.cpp -o libnet.so
+
+1.NETLINK_SOCK_DIAG：每个表（TCP/UDP，IPv4/IPv6）一个SOCK_DIAG_BY_FAMILY的dump请求，
+  内核直接给二进制的inet_diag_msg，不用格式化和解析文本，是读/proc/net的几十倍快。
+  内核没有这个协议的（如：没有加载udp_diag，返回ENOENT）或者不允许的，这个表改读/proc/net。
+2./proc/net/tcp等：用固定的缓冲区分块读，逐行解析，不随行数增加内存。
+3.进程：行里只有socket的inode。遍历/proc/[pid]/fd的符号链接（socket:[inode]）建inode到PID的索引，
+  索引跨调用重用，只在有找不到的inode时重建（一次枚举最多一次），重建后还找不到的也记下（PID是0），
+  以后不再为它重建（如：没有权限看别的用户的进程）。
+4.TCP的状态换算成MIB_TCP_STATE，和Windows的一样；NEW_SYN_RECV（半连接）算SYN_RCVD。
+
+注意：
+1.socket被子进程继承后原来的进程退出了，索引没有重建前还是原来的PID。
+2.看到的是当前的网络命名空间的。
+
+参考：
+https://man7.org/linux/man-pages/man7/sock_diag.7.html
+https://www.kernel.org/doc/html/latest/networking/proc_net_tcp.html
+*/
+
+
+#define TABLE_BACKEND_BUFFER_SIZE  (64 * 1024) // netlink的接收和/proc/net的读的缓冲区。
+#define TABLE_BACKEND_INDEX_BITS   10          //索引的哈希表至少1 << 10项。
+#define TABLE_BACKEND_LINUX_STATES 13          // Linux的TCP的状态，TCP_ESTABLISHED(1)到TCP_NEW_SYN_RECV(12)。
+
+
+//一个inode到PID的映射，Inode是0的是空的。
+typedef struct _INODE_ENTRY {
+    UINT64 Inode;
+    ULONG Pid; //找不到进程的是0。
+    ULONG Reserved;
+} INODE_ENTRY, * PINODE_ENTRY;
+
+
+struct _TABLE_BACKEND {
+    ULONG Type;
+    ULONG Flags;
+    int Netlink; //没有打开的是-1。
+    ULONG Sequence;
+    ULONG Unsupported; // netlink不支持的表（TABLE_BACKEND_TCP4等）。
+
+    PUINT8 Buffer;
+
+    TABLE_BACKEND_ROW Rows[TABLE_BACKEND_BATCH]; //攒够一批再找进程，交给回调。
+    UINT64 RowInodes[TABLE_BACKEND_BATCH];
+    ULONG Count;
+    TABLE_BACKEND_CALLBACK Callback;
+    PVOID Context;
+
+    PINODE_ENTRY Index;
+    ULONG IndexBits;
+    ULONG IndexCount;
+    BOOL IndexFresh; //这次枚举已经重建过了。
+
+    ULONG Enumerations;
+    UINT64 Total;
+    ULONG Fallbacks;
+    ULONG IndexBuilds;
+    UINT64 Unmapped;
+};
+
+
+//一个表的参数。
+typedef struct _BACKEND_TABLE {
+    ULONG Table; // TABLE_BACKEND_TCP4等。
+    UINT8 Family;
+    UINT8 Protocol;
+    PCSTR Path;
+} BACKEND_TABLE, * PBACKEND_TABLE;
+
+
+static const BACKEND_TABLE g_BackendTables[] = {
+    {TABLE_BACKEND_TCP4, AF_INET, IPPROTO_TCP, "/proc/net/tcp"},
+    {TABLE_BACKEND_TCP6, AF_INET6, IPPROTO_TCP, "/proc/net/tcp6"},
+    {TABLE_BACKEND_UDP4, AF_INET, IPPROTO_UDP, "/proc/net/udp"},
+    {TABLE_BACKEND_UDP6, AF_INET6, IPPROTO_UDP, "/proc/net/udp6"},
+};
+
+
+// Linux的TCP的状态（include/net/tcp_states.h）到MIB_TCP_STATE。
+static const ULONG g_LinuxTcpStates[TABLE_BACKEND_LINUX_STATES] = {
+    0,
+    MIB_TCP_STATE_ESTAB,      // TCP_ESTABLISHED
+    MIB_TCP_STATE_SYN_SENT,   // TCP_SYN_SENT
+    MIB_TCP_STATE_SYN_RCVD,   // TCP_SYN_RECV
+    MIB_TCP_STATE_FIN_WAIT1,  // TCP_FIN_WAIT1
+    MIB_TCP_STATE_FIN_WAIT2,  // TCP_FIN_WAIT2
+    MIB_TCP_STATE_TIME_WAIT,  // TCP_TIME_WAIT
+    MIB_TCP_STATE_CLOSED,     // TCP_CLOSE
+    MIB_TCP_STATE_CLOSE_WAIT, // TCP_CLOSE_WAIT
+    MIB_TCP_STATE_LAST_ACK,   // TCP_LAST_ACK
+    MIB_TCP_STATE_LISTEN,     // TCP_LISTEN
+    MIB_TCP_STATE_CLOSING,    // TCP_CLOSING
+    MIB_TCP_STATE_SYN_RCVD,   // TCP_NEW_SYN_RECV
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//inode到PID的索引。
+
+
+static ULONG ErrnoToStatus(_In_ int Error)
+{
+    switch (Error) {
+    case 0:
+        return ERROR_SUCCESS;
+    case ENOENT:
+        return ERROR_FILE_NOT_FOUND;
+    case EACCES:
+    case EPERM:
+        return ERROR_ACCESS_DENIED;
+    case ENOMEM:
+    case ENOBUFS:
+        return ERROR_NOT_ENOUGH_MEMORY;
+    case EPROTONOSUPPORT:
+    case EAFNOSUPPORT:
+    case EOPNOTSUPP:
+        return ERROR_NOT_SUPPORTED;
+    default:
+        return ERROR_GEN_FAILURE;
+    }
+}
+
+
+static ULONG HashInode(_In_ UINT64 Inode, _In_ ULONG Bits)
+{
+    return (ULONG)((Inode * 0x9E3779B97F4A7C15ULL) >> (64 - Bits));
+}
+
+
+static PINODE_ENTRY FindInode(_In_ PINODE_ENTRY Index, _In_ ULONG Bits, _In_ UINT64 Inode)
+/*
+功能：Inode所在的，或者应该放的（空的）项。
+*/
+{
+    ULONG Mask = (1UL << Bits) - 1;
+
+    for (ULONG i = HashInode(Inode, Bits);; i = (i + 1) & Mask) {
+        if (Index[i].Inode == Inode || 0 == Index[i].Inode) {
+            return &Index[i];
+        }
+    }
+}
+
+
+static ULONG ReserveIndex(_Inout_ PTABLE_BACKEND Backend, _In_ ULONG Bits)
+/*
+功能：清空索引，至少1 << Bits项。
+*/
+{
+    if (nullptr == Backend->Index || Backend->IndexBits < Bits) {
+        PINODE_ENTRY Index = reinterpret_cast<PINODE_ENTRY>(MALLOC(sizeof(INODE_ENTRY) << Bits));
+        if (nullptr == Index) {
+            return ERROR_NOT_ENOUGH_MEMORY;
+        }
+
+        FREE(Backend->Index);
+        Backend->Index = Index;
+        Backend->IndexBits = Bits;
+    } else {
+        memset(Backend->Index, 0, sizeof(INODE_ENTRY) << Backend->IndexBits);
+    }
+
+    Backend->IndexCount = 0;
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG InsertInode(_Inout_ PTABLE_BACKEND Backend, _In_ UINT64 Inode, _In_ ULONG Pid)
+/*
+功能：记下Inode的进程，已经有的不变（共享的socket算第一个找到的进程的）。超过一半满就加倍。
+*/
+{
+    PINODE_ENTRY Entry = FindInode(Backend->Index, Backend->IndexBits, Inode);
+    if (Entry->Inode) {
+        return ERROR_SUCCESS;
+    }
+
+    Entry->Inode = Inode;
+    Entry->Pid = Pid;
+    if (++Backend->IndexCount <= (1UL << Backend->IndexBits) / 2) {
+        return ERROR_SUCCESS;
+    }
+
+    ULONG Bits = Backend->IndexBits + 1;
+    PINODE_ENTRY Index = reinterpret_cast<PINODE_ENTRY>(MALLOC(sizeof(INODE_ENTRY) << Bits));
+    if (nullptr == Index) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    for (ULONG i = 0; i < (1UL << Backend->IndexBits); i++) {
+        if (Backend->Index[i].Inode) {
+            *FindInode(Index, Bits, Backend->Index[i].Inode) = Backend->Index[i];
+        }
+    }
+
+    FREE(Backend->Index);
+    Backend->Index = Index;
+    Backend->IndexBits = Bits;
+    return ERROR_SUCCESS;
+}
+
+
+static BOOL ParsePid(_In_ PCSTR Name, _Out_ PULONG Pid)
+{
+    ULONG Value = 0;
+
+    *Pid = 0;
+    if (0 == *Name) {
+        return FALSE;
+    }
+
+    for (; *Name; Name++) {
+        if (*Name < '0' || *Name > '9') {
+            return FALSE;
+        }
+
+        Value = Value * 10 + (ULONG)(*Name - '0');
+    }
+
+    *Pid = Value;
+    return TRUE;
+}
+
+
+static ULONG ScanProcess(_Inout_ PTABLE_BACKEND Backend, _In_ ULONG Pid)
+/*
+功能：把进程的所有的socket（/proc/[pid]/fd下的socket:[inode]）加到索引里。
+
+没有权限的，已经退出的进程忽略。
+*/
+{
+    char Path[64];
+    char Link[64];
+    ULONG Status = ERROR_SUCCESS;
+
+    snprintf(Path, sizeof(Path), "/proc/%u/fd", Pid);
+    int Fd = open(Path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (Fd < 0) {
+        return ERROR_SUCCESS;
+    }
+
+    DIR * Fds = fdopendir(Fd);
+    if (nullptr == Fds) {
+        close(Fd);
+        return ERROR_SUCCESS;
+    }
+
+    for (struct dirent * Entry = readdir(Fds); Entry && ERROR_SUCCESS == Status; Entry = readdir(Fds)) {
+        if ('.' == Entry->d_name[0]) {
+            continue;
+        }
+
+        ssize_t Length = readlinkat(Fd, Entry->d_name, Link, sizeof(Link) - 1);
+        if (Length <= 9 || 0 != memcmp(Link, "socket:[", 8) || ']' != Link[Length - 1]) {
+            continue;
+        }
+
+        UINT64 Inode = 0;
+        for (ssize_t i = 8; i < Length - 1; i++) {
+            Inode = Inode * 10 + (UINT64)(Link[i] - '0');
+        }
+
+        if (Inode) {
+            Status = InsertInode(Backend, Inode, Pid);
+        }
+    }
+
+    closedir(Fds);
+    return Status;
+}
+
+
+static ULONG BuildIndex(_Inout_ PTABLE_BACKEND Backend)
+/*
+功能：遍历所有的进程重建inode到PID的索引。
+*/
+{
+    ULONG Status = ReserveIndex(Backend, Backend->IndexBits ? Backend->IndexBits : TABLE_BACKEND_INDEX_BITS);
+    if (ERROR_SUCCESS != Status) {
+        return Status;
+    }
+
+    DIR * Proc = opendir("/proc");
+    if (nullptr == Proc) {
+        return ErrnoToStatus(errno);
+    }
+
+    for (struct dirent * Entry = readdir(Proc); Entry && ERROR_SUCCESS == Status; Entry = readdir(Proc)) {
+        ULONG Pid = 0;
+        if (ParsePid(Entry->d_name, &Pid)) {
+            Status = ScanProcess(Backend, Pid);
+        }
+    }
+
+    closedir(Proc);
+    Backend->IndexFresh = TRUE;
+    Backend->IndexBuilds++;
+    return Status;
+}
+
+
+static ULONG MapPids(_Inout_ PTABLE_BACKEND Backend)
+/*
+功能：给攒下的行找进程。有找不到的就先重建索引（一次枚举最多一次）。
+*/
+{
+    if (!Backend->IndexFresh) {
+        for (ULONG i = 0; i < Backend->Count; i++) {
+            UINT64 Inode = Backend->RowInodes[i];
+            if (0 == Inode) {
+                continue;
+            }
+
+            if (nullptr == Backend->Index || 0 == FindInode(Backend->Index, Backend->IndexBits, Inode)->Inode) {
+                ULONG Status = BuildIndex(Backend);
+                if (ERROR_SUCCESS != Status) {
+                    return Status;
+                }
+
+                break;
+            }
+        }
+    }
+
+    for (ULONG i = 0; i < Backend->Count; i++) {
+        UINT64 Inode = Backend->RowInodes[i];
+        if (0 == Inode) { // TIME_WAIT等没有socket的。
+            continue;
+        }
+
+        PINODE_ENTRY Entry = FindInode(Backend->Index, Backend->IndexBits, Inode);
+        if (Entry->Inode) {
+            Backend->Rows[i].OwningPid = Entry->Pid;
+            Backend->Unmapped += (0 == Entry->Pid);
+            continue;
+        }
+
+        ULONG Status = InsertInode(Backend, Inode, 0); //重建后还找不到的，记下，以后不再为它重建。
+        if (ERROR_SUCCESS != Status) {
+            return Status;
+        }
+
+        Backend->Unmapped++;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//行。
+
+
+static ULONG FlushRows(_Inout_ PTABLE_BACKEND Backend)
+{
+    ULONG Count = Backend->Count;
+    if (0 == Count) {
+        return ERROR_SUCCESS;
+    }
+
+    if (!(Backend->Flags & TABLE_BACKEND_NO_PIDS)) {
+        ULONG Status = MapPids(Backend);
+        if (ERROR_SUCCESS != Status) {
+            return Status;
+        }
+    }
+
+    Backend->Count = 0;
+    Backend->Total += Count;
+    return Backend->Callback(Backend->Context, Backend->Rows, Count);
+}
+
+
+static PTABLE_BACKEND_ROW NextRow(_Inout_ PTABLE_BACKEND Backend,
+                                  _In_ const BACKEND_TABLE * Table,
+                                  _In_ ULONG LinuxState,
+                                  _In_ UINT64 Inode)
+/*
+功能：下一行（清零的），填好了协议，地址族，状态和inode。
+*/
+{
+    PTABLE_BACKEND_ROW Row = &Backend->Rows[Backend->Count];
+
+    memset(Row, 0, sizeof(TABLE_BACKEND_ROW));
+    Row->Family = Table->Family;
+    Row->Protocol = Table->Protocol;
+    if (IPPROTO_TCP == Table->Protocol && LinuxState < TABLE_BACKEND_LINUX_STATES) {
+        Row->State = g_LinuxTcpStates[LinuxState];
+    }
+
+    Backend->RowInodes[Backend->Count] = Inode;
+    return Row;
+}
+
+
+static ULONG CommitRow(_Inout_ PTABLE_BACKEND Backend)
+{
+    if (++Backend->Count < TABLE_BACKEND_BATCH) {
+        return ERROR_SUCCESS;
+    }
+
+    return FlushRows(Backend);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//NETLINK_SOCK_DIAG。
+
+
+static ULONG SendDumpRequest(_Inout_ PTABLE_BACKEND Backend, _In_ const BACKEND_TABLE * Table)
+{
+    struct {
+        struct nlmsghdr Header;
+        struct inet_diag_req_v2 Request;
+    } Message;
+    struct sockaddr_nl Kernel;
+
+    if (Backend->Netlink < 0) {
+        Backend->Netlink = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+        if (Backend->Netlink < 0) {
+            return ErrnoToStatus(errno);
+        }
+    }
+
+    memset(&Message, 0, sizeof(Message));
+    Message.Header.nlmsg_len = sizeof(Message);
+    Message.Header.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    Message.Header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    Message.Header.nlmsg_seq = ++Backend->Sequence;
+    Message.Request.sdiag_family = Table->Family;
+    Message.Request.sdiag_protocol = Table->Protocol;
+    Message.Request.idiag_states = ((1U << TABLE_BACKEND_LINUX_STATES) - 1) & ~1U; //和/proc/net的一样。
+
+    memset(&Kernel, 0, sizeof(Kernel));
+    Kernel.nl_family = AF_NETLINK;
+
+    ssize_t Sent = 0;
+    do {
+        Sent = sendto(Backend->Netlink, &Message, sizeof(Message), 0, (struct sockaddr *)&Kernel, sizeof(Kernel));
+    } while (Sent < 0 && EINTR == errno);
+
+    return Sent < 0 ? ErrnoToStatus(errno) : ERROR_SUCCESS;
+}
+
+
+static ULONG AddDiagRow(_Inout_ PTABLE_BACKEND Backend,
+                        _In_ const BACKEND_TABLE * Table,
+                        _In_ const struct inet_diag_msg * Diag)
+{
+    PTABLE_BACKEND_ROW Row = NextRow(Backend, Table, Diag->idiag_state, Diag->idiag_inode);
+    SIZE_T Length = AF_INET6 == Table->Family ? 16 : 4;
+
+    Row->LocalPort = ntohs(Diag->id.idiag_sport);
+    Row->RemotePort = ntohs(Diag->id.idiag_dport);
+    memcpy(Row->LocalAddress, Diag->id.idiag_src, Length);
+    memcpy(Row->RemoteAddress, Diag->id.idiag_dst, Length);
+    return CommitRow(Backend);
+}
+
+
+static ULONG DumpNetlink(_Inout_ PTABLE_BACKEND Backend, _In_ const BACKEND_TABLE * Table, _Out_ PULONG Rows)
+/*
+功能：用一个dump请求取一个表。
+
+返回值：内核不支持的是ERROR_NOT_SUPPORTED（*Rows是0），调用者改读/proc/net。
+*/
+{
+    *Rows = 0;
+
+    ULONG Status = SendDumpRequest(Backend, Table);
+    if (ERROR_SUCCESS != Status) {
+        return ERROR_ACCESS_DENIED == Status ? ERROR_NOT_SUPPORTED : Status;
+    }
+
+    for (;;) {
+        ssize_t Received = recv(Backend->Netlink, Backend->Buffer, TABLE_BACKEND_BUFFER_SIZE, MSG_TRUNC);
+        if (Received < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+
+            return ErrnoToStatus(errno);
+        }
+
+        if (Received > TABLE_BACKEND_BUFFER_SIZE) { // MSG_TRUNC的返回消息实际的大小，截断的不能丢掉。
+            return ERROR_INSUFFICIENT_BUFFER;
+        }
+
+        int Length = (int)Received;
+        for (struct nlmsghdr * Header = (struct nlmsghdr *)Backend->Buffer; NLMSG_OK(Header, Length);
+             Header = NLMSG_NEXT(Header, Length)) {
+            if (Header->nlmsg_seq != Backend->Sequence) { //以前中止的dump的。
+                continue;
+            }
+
+            if (NLMSG_DONE == Header->nlmsg_type) {
+                return ERROR_SUCCESS;
+            }
+
+            if (NLMSG_ERROR == Header->nlmsg_type) {
+                const struct nlmsgerr * Error = (const struct nlmsgerr *)NLMSG_DATA(Header);
+                int Code = Header->nlmsg_len >= NLMSG_LENGTH(sizeof(struct nlmsgerr)) ? -Error->error : EINVAL;
+                if (0 == *Rows && (ENOENT == Code || EOPNOTSUPP == Code || EPROTONOSUPPORT == Code ||
+                                   EACCES == Code || EPERM == Code)) {
+                    return ERROR_NOT_SUPPORTED;
+                }
+
+                return ErrnoToStatus(Code);
+            }
+
+            if (SOCK_DIAG_BY_FAMILY != Header->nlmsg_type ||
+                Header->nlmsg_len < NLMSG_LENGTH(sizeof(struct inet_diag_msg))) {
+                continue;
+            }
+
+            (*Rows)++;
+            Status = AddDiagRow(Backend, Table, (const struct inet_diag_msg *)NLMSG_DATA(Header));
+            if (ERROR_SUCCESS != Status) {
+                return Status;
+            }
+        }
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+///proc/net的表。
+
+
+static int HexDigit(_In_ char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+
+    c |= 0x20;
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+
+static BOOL ParseHex(_Inout_ const char ** Text, _In_ const char * End, _In_ ULONG Digits, _Out_ PULONG Value)
+/*
+功能：解析正好Digits个（Digits是0的是至少一个）十六进制的数字。
+*/
+{
+    const char * p = *Text;
+    ULONG n = 0;
+
+    *Value = 0;
+    for (; p < End && (0 == Digits || n < Digits); p++, n++) {
+        int Digit = HexDigit(*p);
+        if (Digit < 0) {
+            break;
+        }
+
+        *Value = (*Value << 4) | (ULONG)Digit;
+    }
+
+    *Text = p;
+    return Digits ? n == Digits : n > 0;
+}
+
+
+static BOOL ParseEndpoint(_Inout_ const char ** Text,
+                          _In_ const char * End,
+                          _In_ ULONG Family,
+                          _Out_writes_(16) PUINT8 Address,
+                          _Out_ USHORT * Port)
+/*
+功能：解析一个地址和端口，如：0100007F:0277。
+
+内核是按32位的主机字节序的整数打印的（%08X），还原回去就是网络字节序的地址。
+*/
+{
+    ULONG Words = AF_INET6 == Family ? 4 : 1;
+    ULONG Value = 0;
+
+    while (*Text < End && ' ' == **Text) {
+        (*Text)++;
+    }
+
+    for (ULONG i = 0; i < Words; i++) {
+        if (!ParseHex(Text, End, 8, &Value)) {
+            return FALSE;
+        }
+
+        memcpy(Address + i * sizeof(ULONG), &Value, sizeof(ULONG));
+    }
+
+    if (*Text >= End || ':' != **Text) {
+        return FALSE;
+    }
+
+    (*Text)++;
+    if (!ParseHex(Text, End, 4, &Value)) {
+        return FALSE;
+    }
+
+    *Port = (USHORT)Value;
+    return TRUE;
+}
+
+
+static BOOL SkipFields(_Inout_ const char ** Text, _In_ const char * End, _In_ ULONG Fields)
+{
+    const char * p = *Text;
+
+    for (ULONG i = 0; i < Fields; i++) {
+        while (p < End && ' ' == *p) {
+            p++;
+        }
+
+        if (p >= End) {
+            return FALSE;
+        }
+
+        while (p < End && ' ' != *p) {
+            p++;
+        }
+    }
+
+    *Text = p;
+    return TRUE;
+}
+
+
+static ULONG ParseProcLine(_Inout_ PTABLE_BACKEND Backend,
+                           _In_ const BACKEND_TABLE * Table,
+                           _In_ const char * Line,
+                           _In_ const char * End)
+/*
+功能：解析一行，如（TCP和UDP的一样）：
+   0: 0100007F:0277 00000000:0000 0A 00000000:00000000 00:00000000 00000000     0        0 12345 1 ...
+即：序号，本地，远程，状态，tx_queue:rx_queue，tr:tm->when，retrnsmt，uid，timeout，inode。
+*/
+{
+    UINT8 LocalAddress[16]{};
+    UINT8 RemoteAddress[16]{};
+    USHORT LocalPort = 0;
+    USHORT RemotePort = 0;
+    ULONG State = 0;
+    UINT64 Inode = 0;
+    const char * p = Line;
+
+    if (!SkipFields(&p, End, 1) || !ParseEndpoint(&p, End, Table->Family, LocalAddress, &LocalPort) ||
+        !ParseEndpoint(&p, End, Table->Family, RemoteAddress, &RemotePort)) {
+        return ERROR_INVALID_DATA;
+    }
+
+    while (p < End && ' ' == *p) {
+        p++;
+    }
+
+    if (!ParseHex(&p, End, 0, &State) || !SkipFields(&p, End, 5)) {
+        return ERROR_INVALID_DATA;
+    }
+
+    while (p < End && ' ' == *p) {
+        p++;
+    }
+
+    if (p >= End || *p < '0' || *p > '9') {
+        return ERROR_INVALID_DATA;
+    }
+
+    for (; p < End && *p >= '0' && *p <= '9'; p++) {
+        Inode = Inode * 10 + (UINT64)(*p - '0');
+    }
+
+    PTABLE_BACKEND_ROW Row = NextRow(Backend, Table, State, Inode);
+    Row->LocalPort = LocalPort;
+    Row->RemotePort = RemotePort;
+    memcpy(Row->LocalAddress, LocalAddress, sizeof(LocalAddress));
+    memcpy(Row->RemoteAddress, RemoteAddress, sizeof(RemoteAddress));
+    return CommitRow(Backend);
+}
+
+
+static ULONG ReadProcNet(_Inout_ PTABLE_BACKEND Backend, _In_ const BACKEND_TABLE * Table)
+/*
+功能：分块读一个/proc/net的表，逐行解析，不完整的最后一行留到下一块。第一行是标题。
+*/
+{
+    ULONG Status = ERROR_SUCCESS;
+    SIZE_T Pending = 0;
+    BOOL Header = TRUE;
+
+    int Fd = open(Table->Path, O_RDONLY | O_CLOEXEC);
+    if (Fd < 0) {
+        return ErrnoToStatus(errno);
+    }
+
+    for (;;) {
+        ssize_t Read = read(Fd, Backend->Buffer + Pending, TABLE_BACKEND_BUFFER_SIZE - Pending);
+        if (Read < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+
+            Status = ErrnoToStatus(errno);
+            break;
+        }
+
+        const char * Line = (const char *)Backend->Buffer;
+        const char * End = Line + Pending + Read;
+        for (;;) {
+            const char * NewLine = (const char *)memchr(Line, '\n', End - Line);
+            if (nullptr == NewLine) {
+                if (0 == Read && Line < End) { //最后一行没有换行的。
+                    NewLine = End;
+                } else {
+                    break;
+                }
+            }
+
+            if (Header) {
+                Header = FALSE;
+            } else if (NewLine > Line) {
+                Status = ParseProcLine(Backend, Table, Line, NewLine);
+                if (ERROR_SUCCESS != Status) {
+                    goto Cleanup;
+                }
+            }
+
+            Line = NewLine < End ? NewLine + 1 : End;
+        }
+
+        if (0 == Read) {
+            break;
+        }
+
+        Pending = End - Line;
+        if (Pending == TABLE_BACKEND_BUFFER_SIZE) { //一行比缓冲区还长。
+            Status = ERROR_INVALID_DATA;
+            break;
+        }
+
+        memmove(Backend->Buffer, Line, Pending);
+    }
+
+Cleanup:
+    close(Fd);
+    return Status;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI TableBackendCreate(_In_ ULONG Type, _In_ ULONG Flags, _Out_ PTABLE_BACKEND * Backend)
+/*
+功能：创建取连接表的后端。
+
+参数：
+Type：TABLE_BACKEND_DEFAULT（即TABLE_BACKEND_NETLINK）或TABLE_BACKEND_PROCFS。
+Flags：TABLE_BACKEND_NO_PIDS等。
+
+返回值：TABLE_BACKEND_IPHELPER是ERROR_NOT_SUPPORTED。
+*/
+{
+    *Backend = nullptr;
+
+    if (TABLE_BACKEND_DEFAULT == Type) {
+        Type = TABLE_BACKEND_NETLINK;
+    }
+
+    if (TABLE_BACKEND_NETLINK != Type && TABLE_BACKEND_PROCFS != Type) {
+        return TABLE_BACKEND_IPHELPER == Type ? ERROR_NOT_SUPPORTED : ERROR_INVALID_PARAMETER;
+    }
+
+    PTABLE_BACKEND Result = reinterpret_cast<PTABLE_BACKEND>(MALLOC(sizeof(TABLE_BACKEND)));
+    if (nullptr == Result) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    Result->Buffer = reinterpret_cast<PUINT8>(MALLOC(TABLE_BACKEND_BUFFER_SIZE));
+    if (nullptr == Result->Buffer) {
+        FREE(Result);
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    Result->Type = Type;
+    Result->Flags = Flags;
+    Result->Netlink = -1;
+    *Backend = Result;
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI TableBackendDestroy(_In_opt_ PTABLE_BACKEND Backend)
+{
+    if (nullptr == Backend) {
+        return;
+    }
+
+    if (Backend->Netlink >= 0) {
+        close(Backend->Netlink);
+    }
+
+    FREE(Backend->Index);
+    FREE(Backend->Buffer);
+    FREE(Backend);
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI TableBackendEnumerate(_In_ PTABLE_BACKEND Backend,
+                                   _In_ ULONG Tables,
+                                   _In_ TABLE_BACKEND_CALLBACK Callback,
+                                   _In_opt_ PVOID Context)
+/*
+功能：取当前的连接表（和侦听表），按批（TABLE_BACKEND_BATCH行）交给回调。
+
+参数：
+Tables：TABLE_BACKEND_TCP4等的组合，按TCP4，TCP6，UDP4，UDP6的顺序。
+
+注意：回调中止的，netlink的socket关掉重开（丢掉没有读完的dump）。
+*/
+{
+    ULONG Status = ERROR_SUCCESS;
+
+    Backend->Count = 0;
+    Backend->Callback = Callback;
+    Backend->Context = Context;
+    Backend->IndexFresh = FALSE;
+
+    for (ULONG i = 0; i < _countof(g_BackendTables) && ERROR_SUCCESS == Status; i++) {
+        const BACKEND_TABLE * Table = &g_BackendTables[i];
+        if (!(Tables & Table->Table)) {
+            continue;
+        }
+
+        if (TABLE_BACKEND_NETLINK == Backend->Type && !(Backend->Unsupported & Table->Table)) {
+            ULONG Rows = 0;
+            Status = DumpNetlink(Backend, Table, &Rows);
+            if (ERROR_SUCCESS != Status && Backend->Netlink >= 0) {
+                close(Backend->Netlink);
+                Backend->Netlink = -1;
+            }
+
+            if (ERROR_NOT_SUPPORTED != Status || Rows) {
+                continue;
+            }
+
+            Backend->Unsupported |= Table->Table; //以后这个表直接读/proc/net。
+            Backend->Fallbacks++;
+        }
+
+        Status = ReadProcNet(Backend, Table);
+    }
+
+    if (ERROR_SUCCESS == Status) {
+        Status = FlushRows(Backend);
+    }
+
+    Backend->Count = 0;
+    Backend->Enumerations++;
+    return Status;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI TableBackendGetInformation(_In_ PTABLE_BACKEND Backend, _Out_ PTABLE_BACKEND_INFORMATION Information)
+{
+    memset(Information, 0, sizeof(TABLE_BACKEND_INFORMATION));
+
+    Information->Type = Backend->Type;
+    Information->Enumerations = Backend->Enumerations;
+    Information->Rows = Backend->Total;
+    Information->Fallbacks = Backend->Fallbacks;
+    Information->IndexBuilds = Backend->IndexBuilds;
+    Information->Inodes = Backend->IndexCount;
+    Information->Unmapped = Backend->Unmapped;
+    Information->Bytes = sizeof(TABLE_BACKEND) + TABLE_BACKEND_BUFFER_SIZE +
+                         (Backend->Index ? sizeof(INODE_ENTRY) << Backend->IndexBits : 0);
+}
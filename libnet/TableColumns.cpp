@@ -0,0 +1,1453 @@
+﻿#include "pch.h"
+#include "TableColumns.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/*
+连接表的列式（struct of arrays）的表示和分析用的内核。
+
+MIB_TCPROW_OWNER_PID是24字节一行，MIB_TCP6ROW_OWNER_MODULE是192字节一行（大部分是模块信息），
+按状态，PID，端口分组时每行只用到其中的几个字节，其余的也要经过缓存，大表的统计是受内存带宽限制的。
+
+这里的做法：
+1.每一列一个连续的数组（状态，地址族，协议是1字节，端口2字节，PID 4字节，地址16字节），
+  IPv4和IPv6的行放在同一张表里，地址统一为16字节（IPv4的是::ffff:a.b.c.d）。
+2.过滤的结果是选择位图（一行一位，64行一个字），多个条件依次按位与，已经是0的块直接跳过。
+3.过滤和按状态计数用SIMD（SSE2/AVX2）一次处理16/32行，运行时根据CPU的特性（CPUID）选择，
+  选择一次，以后直接调用。非x86/x64的用标量的实现，结果完全一样。
+4.按状态计数：状态只有13个取值，每个状态一个字节的计数器（每个SIMD通道一个），定期归并，不用散列。
+5.按PID，远程地址分组：开放寻址的哈希表（内存跨调用重用），只和分组数有关，和行数无关；
+  然后用堆在原地选出前N个，再排序这N个。
+
+注意：
+1.选择位图的大小是TABLE_COLUMNS_SELECTION_WORDS(Count)个UINT64，Count之后的位总是0。
+2.不是线程安全的，分组会用到表里的哈希表。
+
+参考：
+https://docs.microsoft.com/en-us/windows/win32/api/tcpmib/ns-tcpmib-mib_tcprow_owner_pid
+https://docs.microsoft.com/en-us/windows/win32/api/tcpmib/ns-tcpmib-mib_tcp6row_owner_module
+*/
+
+
+#define TABLE_COLUMNS_HEADROOM_SHIFT 2    //多留需要的行数的1/4。
+#define TABLE_COLUMNS_MIN_ROWS       1024 //第一次至少申请这么多行。
+#define TABLE_COLUMNS_ROW_BYTES      (3 + 2 * sizeof(USHORT) + sizeof(ULONG) + 2 * sizeof(IN6_ADDR)) //每行的字节数。
+#define TABLE_COLUMNS_FLUSH_BLOCKS   60   //字节的计数器每个块最多加4，这么多块归并一次，不会超过255。
+#define TABLE_COLUMNS_MIN_GROUPS     1024 //分组的哈希表的最小的大小（2的幂）。
+
+
+//行的前面的成员是一样的，可以用同一个函数追加。
+static_assert(FIELD_OFFSET(MIB_TCPROW2, dwOwningPid) == FIELD_OFFSET(MIB_TCPROW_OWNER_PID, dwOwningPid), "");
+static_assert(FIELD_OFFSET(MIB_TCPROW_OWNER_MODULE, dwOwningPid) ==
+                  FIELD_OFFSET(MIB_TCPROW_OWNER_PID, dwOwningPid), "");
+static_assert(FIELD_OFFSET(MIB_TCP6ROW2, State) == FIELD_OFFSET(MIB_TCP6ROW_OWNER_PID, dwState), "");
+static_assert(FIELD_OFFSET(MIB_TCP6ROW2, dwOwningPid) == FIELD_OFFSET(MIB_TCP6ROW_OWNER_PID, dwOwningPid), "");
+static_assert(FIELD_OFFSET(MIB_TCP6ROW_OWNER_MODULE, dwOwningPid) ==
+                  FIELD_OFFSET(MIB_TCP6ROW_OWNER_PID, dwOwningPid), "");
+static_assert(FIELD_OFFSET(MIB_UDP6ROW_OWNER_MODULE, dwOwningPid) ==
+                  FIELD_OFFSET(MIB_UDP6ROW_OWNER_PID, dwOwningPid), "");
+
+
+//选择位图的一个字里，Selection[w] &= (Column[w * 64 + i] == Value)。
+typedef void (*MATCH_BYTES)(_In_ const UINT8 * Column,
+                            _In_ UINT8 Value,
+                            _Inout_ PUINT64 Selection,
+                            _In_ ULONG Words);
+typedef void (*MATCH_WORDS)(_In_ const USHORT * Column,
+                            _In_ USHORT Value,
+                            _Inout_ PUINT64 Selection,
+                            _In_ ULONG Words);
+typedef void (*MATCH_LONGS)(_In_ const ULONG * Column,
+                            _In_ ULONG Value,
+                            _Inout_ PUINT64 Selection,
+                            _In_ ULONG Words);
+
+//同上，条件是状态在States（位的集合）里。
+typedef void (*MATCH_STATES)(_In_ const UINT8 * Column,
+                             _In_ ULONG States,
+                             _Inout_ PUINT64 Selection,
+                             _In_ ULONG Words);
+
+//Counts[State] += 选中的行数，Selection是nullptr的是全部的Words * 64行。
+typedef void (*COUNT_STATES)(_In_ const UINT8 * Column,
+                             _In_opt_ const UINT64 * Selection,
+                             _In_ ULONG Words,
+                             _Inout_updates_(TABLE_COLUMNS_STATES) PULONG Counts);
+
+
+typedef struct _COLUMN_KERNELS {
+    const char * Name;
+    MATCH_BYTES MatchBytes;
+    MATCH_WORDS MatchWords;
+    MATCH_LONGS MatchLongs;
+    MATCH_STATES MatchStates;
+    COUNT_STATES CountStates;
+} COLUMN_KERNELS, * PCOLUMN_KERNELS;
+
+
+//分组的哈希表的一项，Count是0的是空的。
+typedef struct _GROUP_ENTRY {
+    UINT64 Key[2]; // PID的只用Key[0]；地址的是原样的16字节。
+    ULONG Count;
+    ULONG Reserved;
+} GROUP_ENTRY, * PGROUP_ENTRY;
+
+
+typedef int(__cdecl * GROUP_COMPARE)(_In_ const void * A, _In_ const void * B);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//位操作。
+
+
+static ULONG PopCount64(_In_ UINT64 x)
+/*
+功能：64位的1的个数。
+
+不用POPCNT指令，SSE2的CPU不一定支持。这个只在每64行用一次。
+*/
+{
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (ULONG)((x * 0x0101010101010101ULL) >> 56);
+}
+
+
+static ULONG LowestBit(_In_ UINT64 x)
+/*
+功能：最低的1的位置，x不能是0。x86没有_BitScanForward64，分两半。
+*/
+{
+    unsigned long Index = 0;
+
+    if ((ULONG)x) {
+        _BitScanForward(&Index, (ULONG)x);
+        return Index;
+    }
+
+    _BitScanForward(&Index, (ULONG)(x >> 32));
+    return Index + 32;
+}
+
+
+static UINT64 GetSelection(_In_ const TABLE_COLUMNS * Columns, _In_opt_ const UINT64 * Selection, _In_ ULONG Word)
+/*
+功能：选择位图的第Word个字，Selection是nullptr的是全部的行。
+*/
+{
+    if (Selection) {
+        return Selection[Word];
+    }
+
+    ULONG Rows = Columns->Count - Word * TABLE_COLUMNS_BLOCK;
+    return Rows >= TABLE_COLUMNS_BLOCK ? ~0ULL : (1ULL << Rows) - 1;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//标量的实现，适用于不支持SSE2的CPU（如：ARM64），也是SIMD的实现的参照。
+
+
+static void MatchBytesScalar(_In_ const UINT8 * Column,
+                             _In_ UINT8 Value,
+                             _Inout_ PUINT64 Selection,
+                             _In_ ULONG Words)
+{
+    for (ULONG w = 0; w < Words; w++, Column += TABLE_COLUMNS_BLOCK) {
+        if (0 == Selection[w]) {
+            continue;
+        }
+
+        UINT64 Bits = 0;
+        for (ULONG i = 0; i < TABLE_COLUMNS_BLOCK; i++) {
+            Bits |= (UINT64)(Column[i] == Value) << i;
+        }
+
+        Selection[w] &= Bits;
+    }
+}
+
+
+static void MatchWordsScalar(_In_ const USHORT * Column,
+                             _In_ USHORT Value,
+                             _Inout_ PUINT64 Selection,
+                             _In_ ULONG Words)
+{
+    for (ULONG w = 0; w < Words; w++, Column += TABLE_COLUMNS_BLOCK) {
+        if (0 == Selection[w]) {
+            continue;
+        }
+
+        UINT64 Bits = 0;
+        for (ULONG i = 0; i < TABLE_COLUMNS_BLOCK; i++) {
+            Bits |= (UINT64)(Column[i] == Value) << i;
+        }
+
+        Selection[w] &= Bits;
+    }
+}
+
+
+static void MatchLongsScalar(_In_ const ULONG * Column,
+                             _In_ ULONG Value,
+                             _Inout_ PUINT64 Selection,
+                             _In_ ULONG Words)
+{
+    for (ULONG w = 0; w < Words; w++, Column += TABLE_COLUMNS_BLOCK) {
+        if (0 == Selection[w]) {
+            continue;
+        }
+
+        UINT64 Bits = 0;
+        for (ULONG i = 0; i < TABLE_COLUMNS_BLOCK; i++) {
+            Bits |= (UINT64)(Column[i] == Value) << i;
+        }
+
+        Selection[w] &= Bits;
+    }
+}
+
+
+static void MatchStatesScalar(_In_ const UINT8 * Column,
+                              _In_ ULONG States,
+                              _Inout_ PUINT64 Selection,
+                              _In_ ULONG Words)
+{
+    for (ULONG w = 0; w < Words; w++, Column += TABLE_COLUMNS_BLOCK) {
+        if (0 == Selection[w]) {
+            continue;
+        }
+
+        UINT64 Bits = 0;
+        for (ULONG i = 0; i < TABLE_COLUMNS_BLOCK; i++) {
+            Bits |= (UINT64)((States >> Column[i]) & 1) << i;
+        }
+
+        Selection[w] &= Bits;
+    }
+}
+
+
+static void CountStatesScalar(_In_ const UINT8 * Column,
+                              _In_opt_ const UINT64 * Selection,
+                              _In_ ULONG Words,
+                              _Inout_updates_(TABLE_COLUMNS_STATES) PULONG Counts)
+{
+    for (ULONG w = 0; w < Words; w++, Column += TABLE_COLUMNS_BLOCK) {
+        UINT64 Bits = Selection ? Selection[w] : ~0ULL;
+
+        if (~0ULL == Bits) {
+            for (ULONG i = 0; i < TABLE_COLUMNS_BLOCK; i++) {
+                Counts[Column[i]]++;
+            }
+
+            continue;
+        }
+
+        while (Bits) {
+            Counts[Column[LowestBit(Bits)]]++;
+            Bits &= Bits - 1;
+        }
+    }
+}
+
+
+#if defined(_M_IX86) || defined(_M_X64)
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// SSE2的实现，一次16个字节。
+
+
+static void MatchBytesSse2(_In_ const UINT8 * Column,
+                           _In_ UINT8 Value,
+                           _Inout_ PUINT64 Selection,
+                           _In_ ULONG Words)
+{
+    const __m128i Target = _mm_set1_epi8((char)Value);
+
+    for (ULONG w = 0; w < Words; w++, Column += TABLE_COLUMNS_BLOCK) {
+        if (0 == Selection[w]) {
+            continue;
+        }
+
+        UINT64 Bits = 0;
+        for (ULONG i = 0; i < 4; i++) {
+            __m128i V = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Column + i * 16));
+            Bits |= (UINT64)(ULONG)_mm_movemask_epi8(_mm_cmpeq_epi8(V, Target)) << (i * 16);
+        }
+
+        Selection[w] &= Bits;
+    }
+}
+
+
+static void MatchWordsSse2(_In_ const USHORT * Column,
+                           _In_ USHORT Value,
+                           _Inout_ PUINT64 Selection,
+                           _In_ ULONG Words)
+/*
+两个16位的比较结果（0或者-1）用有符号的饱和压缩为16个字节，顺序不变。
+*/
+{
+    const __m128i Target = _mm_set1_epi16((short)Value);
+
+    for (ULONG w = 0; w < Words; w++, Column += TABLE_COLUMNS_BLOCK) {
+        if (0 == Selection[w]) {
+            continue;
+        }
+
+        UINT64 Bits = 0;
+        for (ULONG i = 0; i < 4; i++) {
+            __m128i V0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Column + i * 16));
+            __m128i V1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Column + i * 16 + 8));
+            __m128i Packed = _mm_packs_epi16(_mm_cmpeq_epi16(V0, Target), _mm_cmpeq_epi16(V1, Target));
+            Bits |= (UINT64)(ULONG)_mm_movemask_epi8(Packed) << (i * 16);
+        }
+
+        Selection[w] &= Bits;
+    }
+}
+
+
+static void MatchLongsSse2(_In_ const ULONG * Column,
+                           _In_ ULONG Value,
+                           _Inout_ PUINT64 Selection,
+                           _In_ ULONG Words)
+{
+    const __m128i Target = _mm_set1_epi32((int)Value);
+
+    for (ULONG w = 0; w < Words; w++, Column += TABLE_COLUMNS_BLOCK) {
+        if (0 == Selection[w]) {
+            continue;
+        }
+
+        UINT64 Bits = 0;
+        for (ULONG i = 0; i < 4; i++) {
+            const ULONG * p = Column + i * 16;
+            __m128i C0 = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), Target);
+            __m128i C1 = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 4)), Target);
+            __m128i C2 = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 8)), Target);
+            __m128i C3 = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 12)), Target);
+            __m128i Packed = _mm_packs_epi16(_mm_packs_epi32(C0, C1), _mm_packs_epi32(C2, C3));
+            Bits |= (UINT64)(ULONG)_mm_movemask_epi8(Packed) << (i * 16);
+        }
+
+        Selection[w] &= Bits;
+    }
+}
+
+
+static void MatchStatesSse2(_In_ const UINT8 * Column,
+                            _In_ ULONG States,
+                            _Inout_ PUINT64 Selection,
+                            _In_ ULONG Words)
+/*
+SSE2没有pshufb，集合里的每个状态比较一次再按位或，一般只有一两个状态。
+*/
+{
+    __m128i Targets[TABLE_COLUMNS_STATES];
+    ULONG Count = 0;
+
+    for (ULONG State = 0; State < TABLE_COLUMNS_STATES; State++) {
+        if (States & (1UL << State)) {
+            Targets[Count++] = _mm_set1_epi8((char)State);
+        }
+    }
+
+    for (ULONG w = 0; w < Words; w++, Column += TABLE_COLUMNS_BLOCK) {
+        if (0 == Selection[w]) {
+            continue;
+        }
+
+        UINT64 Bits = 0;
+        for (ULONG i = 0; i < 4; i++) {
+            __m128i V = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Column + i * 16));
+            __m128i Match = _mm_setzero_si128();
+
+            for (ULONG k = 0; k < Count; k++) {
+                Match = _mm_or_si128(Match, _mm_cmpeq_epi8(V, Targets[k]));
+            }
+
+            Bits |= (UINT64)(ULONG)_mm_movemask_epi8(Match) << (i * 16);
+        }
+
+        Selection[w] &= Bits;
+    }
+}
+
+
+static __m128i ExpandBits16(_In_ ULONG Bits, _In_ __m128i BitValues)
+/*
+功能：16位的位图展开为16个字节的掩码（第i位是1的第i个字节是0xff）。
+*/
+{
+    __m128i V = _mm_cvtsi32_si128((int)Bits);
+    V = _mm_unpacklo_epi8(V, V);  // b0 b0 b1 b1 ...
+    V = _mm_unpacklo_epi16(V, V); // b0 x 4，b1 x 4 ...
+    V = _mm_unpacklo_epi32(V, V); // b0 x 8，b1 x 8。
+    return _mm_cmpeq_epi8(_mm_and_si128(V, BitValues), BitValues);
+}
+
+
+static void FlushCounts128(_Inout_updates_(TABLE_COLUMNS_STATES) __m128i * Accumulators,
+                           _Inout_updates_(TABLE_COLUMNS_STATES) PULONG Counts)
+/*
+功能：把字节的计数器加到Counts里（psadbw横向求和）并清零。
+*/
+{
+    const __m128i Zero = _mm_setzero_si128();
+
+    for (ULONG State = 0; State < TABLE_COLUMNS_STATES; State++) {
+        __m128i Sum = _mm_sad_epu8(Accumulators[State], Zero);
+        Counts[State] += (ULONG)_mm_cvtsi128_si32(Sum) + (ULONG)_mm_cvtsi128_si32(_mm_srli_si128(Sum, 8));
+        Accumulators[State] = Zero;
+    }
+}
+
+
+static void CountStatesSse2(_In_ const UINT8 * Column,
+                            _In_opt_ const UINT64 * Selection,
+                            _In_ ULONG Words,
+                            _Inout_updates_(TABLE_COLUMNS_STATES) PULONG Counts)
+/*
+每个状态16个字节的计数器，比较的结果（-1）和选择的掩码按位与后减去。
+*/
+{
+    const __m128i BitValues = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    __m128i Accumulators[TABLE_COLUMNS_STATES];
+    __m128i Targets[TABLE_COLUMNS_STATES];
+    ULONG Blocks = 0;
+
+    for (ULONG State = 0; State < TABLE_COLUMNS_STATES; State++) {
+        Accumulators[State] = _mm_setzero_si128();
+        Targets[State] = _mm_set1_epi8((char)State);
+    }
+
+    for (ULONG w = 0; w < Words; w++, Column += TABLE_COLUMNS_BLOCK) {
+        UINT64 Bits = Selection ? Selection[w] : ~0ULL;
+        if (0 == Bits) {
+            continue;
+        }
+
+        for (ULONG i = 0; i < 4; i++) {
+            __m128i V = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Column + i * 16));
+
+            if (~0ULL != Bits) {
+                //没选中的行当作一个不存在的状态。
+                __m128i Mask = ExpandBits16((ULONG)(Bits >> (i * 16)) & 0xffff, BitValues);
+                V = _mm_or_si128(_mm_and_si128(Mask, V), _mm_andnot_si128(Mask, _mm_set1_epi8(-1)));
+            }
+
+            for (ULONG State = 0; State < TABLE_COLUMNS_STATES; State++) {
+                Accumulators[State] = _mm_sub_epi8(Accumulators[State], _mm_cmpeq_epi8(V, Targets[State]));
+            }
+        }
+
+        if (++Blocks == TABLE_COLUMNS_FLUSH_BLOCKS) {
+            FlushCounts128(Accumulators, Counts);
+            Blocks = 0;
+        }
+    }
+
+    FlushCounts128(Accumulators, Counts);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// AVX2的实现，一次32个字节。
+//注意：MSVC下使用AVX2的内建函数不需要/arch:AVX2，但是调用前必须检查CPU和操作系统的支持。
+
+
+static void MatchBytesAvx2(_In_ const UINT8 * Column,
+                           _In_ UINT8 Value,
+                           _Inout_ PUINT64 Selection,
+                           _In_ ULONG Words)
+{
+    const __m256i Target = _mm256_set1_epi8((char)Value);
+
+    for (ULONG w = 0; w < Words; w++, Column += TABLE_COLUMNS_BLOCK) {
+        if (0 == Selection[w]) {
+            continue;
+        }
+
+        __m256i V0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Column));
+        __m256i V1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Column + 32));
+        UINT64 Bits = (UINT64)(ULONG)_mm256_movemask_epi8(_mm256_cmpeq_epi8(V0, Target));
+        Bits |= (UINT64)(ULONG)_mm256_movemask_epi8(_mm256_cmpeq_epi8(V1, Target)) << 32;
+
+        Selection[w] &= Bits;
+    }
+
+    _mm256_zeroupper();
+}
+
+
+static void MatchWordsAvx2(_In_ const USHORT * Column,
+                           _In_ USHORT Value,
+                           _Inout_ PUINT64 Selection,
+                           _In_ ULONG Words)
+/*
+vpacksswb是在两个128位的通道里各自压缩的，结果的4个64位依次是V0的低半，V1的低半，V0的高半，V1的高半，
+再用vpermq（0xD8）恢复顺序。
+*/
+{
+    const __m256i Target = _mm256_set1_epi16((short)Value);
+
+    for (ULONG w = 0; w < Words; w++, Column += TABLE_COLUMNS_BLOCK) {
+        if (0 == Selection[w]) {
+            continue;
+        }
+
+        UINT64 Bits = 0;
+        for (ULONG i = 0; i < 2; i++) {
+            __m256i V0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Column + i * 32));
+            __m256i V1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Column + i * 32 + 16));
+            __m256i Packed = _mm256_packs_epi16(_mm256_cmpeq_epi16(V0, Target), _mm256_cmpeq_epi16(V1, Target));
+            Packed = _mm256_permute4x64_epi64(Packed, 0xD8);
+            Bits |= (UINT64)(ULONG)_mm256_movemask_epi8(Packed) << (i * 32);
+        }
+
+        Selection[w] &= Bits;
+    }
+
+    _mm256_zeroupper();
+}
+
+
+static void MatchLongsAvx2(_In_ const ULONG * Column,
+                           _In_ ULONG Value,
+                           _Inout_ PUINT64 Selection,
+                           _In_ ULONG Words)
+{
+    const __m256i Target = _mm256_set1_epi32((int)Value);
+
+    for (ULONG w = 0; w < Words; w++, Column += TABLE_COLUMNS_BLOCK) {
+        if (0 == Selection[w]) {
+            continue;
+        }
+
+        UINT64 Bits = 0;
+        for (ULONG i = 0; i < 8; i++) {
+            __m256i V = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Column + i * 8));
+            __m256 Match = _mm256_castsi256_ps(_mm256_cmpeq_epi32(V, Target));
+            Bits |= (UINT64)(ULONG)_mm256_movemask_ps(Match) << (i * 8);
+        }
+
+        Selection[w] &= Bits;
+    }
+
+    _mm256_zeroupper();
+}
+
+
+static void MatchStatesAvx2(_In_ const UINT8 * Column,
+                            _In_ ULONG States,
+                            _Inout_ PUINT64 Selection,
+                            _In_ ULONG Words)
+/*
+状态都小于16，用vpshufb查一个16字节的表（集合里的是0xff），一次得到32行的结果。
+*/
+{
+    UINT8 Table[16] = {0};
+    for (ULONG State = 0; State < TABLE_COLUMNS_STATES; State++) {
+        Table[State] = (States & (1UL << State)) ? 0xff : 0;
+    }
+
+    const __m256i Lookup =
+        _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(Table)));
+
+    for (ULONG w = 0; w < Words; w++, Column += TABLE_COLUMNS_BLOCK) {
+        if (0 == Selection[w]) {
+            continue;
+        }
+
+        __m256i V0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Column));
+        __m256i V1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Column + 32));
+        UINT64 Bits = (UINT64)(ULONG)_mm256_movemask_epi8(_mm256_shuffle_epi8(Lookup, V0));
+        Bits |= (UINT64)(ULONG)_mm256_movemask_epi8(_mm256_shuffle_epi8(Lookup, V1)) << 32;
+
+        Selection[w] &= Bits;
+    }
+
+    _mm256_zeroupper();
+}
+
+
+static __m256i ExpandBits32(_In_ ULONG Bits, _In_ __m256i Spread, _In_ __m256i BitValues)
+/*
+功能：32位的位图展开为32个字节的掩码。vpshufb在每个128位的通道里把第k个字节复制8份。
+*/
+{
+    __m256i V = _mm256_shuffle_epi8(_mm256_set1_epi32((int)Bits), Spread);
+    return _mm256_cmpeq_epi8(_mm256_and_si256(V, BitValues), BitValues);
+}
+
+
+static void FlushCounts256(_Inout_updates_(TABLE_COLUMNS_STATES) __m256i * Accumulators,
+                           _Inout_updates_(TABLE_COLUMNS_STATES) PULONG Counts)
+{
+    const __m256i Zero = _mm256_setzero_si256();
+
+    for (ULONG State = 0; State < TABLE_COLUMNS_STATES; State++) {
+        __m256i Sum = _mm256_sad_epu8(Accumulators[State], Zero);
+        __m128i Half = _mm_add_epi64(_mm256_castsi256_si128(Sum), _mm256_extracti128_si256(Sum, 1));
+        Counts[State] += (ULONG)_mm_cvtsi128_si32(Half) + (ULONG)_mm_cvtsi128_si32(_mm_srli_si128(Half, 8));
+        Accumulators[State] = Zero;
+    }
+}
+
+
+static void CountStatesAvx2(_In_ const UINT8 * Column,
+                            _In_opt_ const UINT64 * Selection,
+                            _In_ ULONG Words,
+                            _Inout_updates_(TABLE_COLUMNS_STATES) PULONG Counts)
+{
+    const __m256i Spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                            2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i BitValues = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                                               1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m256i Invalid = _mm256_set1_epi8(-1);
+    __m256i Accumulators[TABLE_COLUMNS_STATES];
+    ULONG Blocks = 0;
+
+    for (ULONG State = 0; State < TABLE_COLUMNS_STATES; State++) {
+        Accumulators[State] = _mm256_setzero_si256();
+    }
+
+    for (ULONG w = 0; w < Words; w++, Column += TABLE_COLUMNS_BLOCK) {
+        UINT64 Bits = Selection ? Selection[w] : ~0ULL;
+        if (0 == Bits) {
+            continue;
+        }
+
+        for (ULONG i = 0; i < 2; i++) {
+            __m256i V = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Column + i * 32));
+
+            if (~0ULL != Bits) {
+                __m256i Mask = ExpandBits32((ULONG)(Bits >> (i * 32)), Spread, BitValues);
+                V = _mm256_blendv_epi8(Invalid, V, Mask);
+            }
+
+            for (ULONG State = 0; State < TABLE_COLUMNS_STATES; State++) {
+                __m256i Target = _mm256_set1_epi8((char)State);
+                Accumulators[State] = _mm256_sub_epi8(Accumulators[State], _mm256_cmpeq_epi8(V, Target));
+            }
+        }
+
+        if (++Blocks == TABLE_COLUMNS_FLUSH_BLOCKS) {
+            FlushCounts256(Accumulators, Counts);
+            Blocks = 0;
+        }
+    }
+
+    FlushCounts256(Accumulators, Counts);
+    _mm256_zeroupper();
+}
+
+
+static bool IsAvx2Supported()
+/*
+功能：检查CPU和操作系统是否都支持AVX2。
+
+1.CPUID.1:ECX.OSXSAVE[bit 27]和AVX[bit 28]。
+2.XCR0的XMM和YMM的状态位（bit 1和bit 2），即操作系统保存了YMM寄存器。
+3.CPUID.(EAX=7,ECX=0):EBX.AVX2[bit 5]。
+*/
+{
+    int CpuInfo[4] = {0};
+
+    __cpuid(CpuInfo, 0);
+    if (CpuInfo[0] < 7) {
+        return false;
+    }
+
+    __cpuid(CpuInfo, 1);
+    if ((CpuInfo[2] & (1 << 27)) == 0 || (CpuInfo[2] & (1 << 28)) == 0) {
+        return false;
+    }
+
+    if ((_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+
+    __cpuidex(CpuInfo, 7, 0);
+
+    return (CpuInfo[1] & (1 << 5)) != 0;
+}
+
+
+#endif
+
+
+static const COLUMN_KERNELS ScalarKernels = {
+    "scalar", MatchBytesScalar, MatchWordsScalar, MatchLongsScalar, MatchStatesScalar, CountStatesScalar};
+
+#if defined(_M_IX86) || defined(_M_X64)
+static const COLUMN_KERNELS Sse2Kernels = {
+    "sse2", MatchBytesSse2, MatchWordsSse2, MatchLongsSse2, MatchStatesSse2, CountStatesSse2};
+
+static const COLUMN_KERNELS Avx2Kernels = {
+    "avx2", MatchBytesAvx2, MatchWordsAvx2, MatchLongsAvx2, MatchStatesAvx2, CountStatesAvx2};
+#endif
+
+
+static const COLUMN_KERNELS * SelectColumnKernels()
+/*
+功能：根据CPU的特性选择内核。x86和x64都支持SSE2。
+*/
+{
+#if defined(_M_IX86) || defined(_M_X64)
+    if (IsAvx2Supported()) {
+        return &Avx2Kernels;
+    }
+
+    return &Sse2Kernels;
+#else
+    return &ScalarKernels;
+#endif
+}
+
+
+//DLL加载时（全局对象的初始化）选择一次，以后不再改变，多线程下也无需同步。
+static const COLUMN_KERNELS * const g_ColumnKernels = SelectColumnKernels();
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//构建。
+
+
+static void SetColumns(_Inout_ PTABLE_COLUMNS Columns, _In_ PVOID Buffer, _In_ ULONG Capacity)
+/*
+功能：在一块内存里依次放各列，大的在前。Capacity是64的倍数，所以每一列的起点都按64字节对齐（相对Buffer）。
+*/
+{
+    PUCHAR p = reinterpret_cast<PUCHAR>(Buffer);
+
+    Columns->LocalAddress = reinterpret_cast<PIN6_ADDR>(p);
+    p += (SIZE_T)Capacity * sizeof(IN6_ADDR);
+    Columns->RemoteAddress = reinterpret_cast<PIN6_ADDR>(p);
+    p += (SIZE_T)Capacity * sizeof(IN6_ADDR);
+    Columns->Pid = reinterpret_cast<PULONG>(p);
+    p += (SIZE_T)Capacity * sizeof(ULONG);
+    Columns->LocalPort = reinterpret_cast<PUSHORT>(p);
+    p += (SIZE_T)Capacity * sizeof(USHORT);
+    Columns->RemotePort = reinterpret_cast<PUSHORT>(p);
+    p += (SIZE_T)Capacity * sizeof(USHORT);
+    Columns->Family = p;
+    p += Capacity;
+    Columns->Protocol = p;
+    p += Capacity;
+    Columns->State = p;
+}
+
+
+static ULONG Reserve(_Inout_ PTABLE_COLUMNS Columns, _In_ UINT64 Rows)
+/*
+功能：保证能放下Rows行，不够的按需要的多留1/4，原有的行复制过去。
+*/
+{
+    if (Rows <= Columns->Capacity) {
+        return ERROR_SUCCESS;
+    }
+
+    UINT64 Capacity = max(Rows + (Rows >> TABLE_COLUMNS_HEADROOM_SHIFT), (UINT64)TABLE_COLUMNS_MIN_ROWS);
+    Capacity = (Capacity + TABLE_COLUMNS_BLOCK - 1) & ~(UINT64)(TABLE_COLUMNS_BLOCK - 1);
+    if (Capacity > MAXULONG || Capacity * TABLE_COLUMNS_ROW_BYTES > (SIZE_T)-1) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    PVOID Buffer = MALLOC((SIZE_T)(Capacity * TABLE_COLUMNS_ROW_BYTES));
+    if (nullptr == Buffer) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    TABLE_COLUMNS Old = *Columns;
+    SetColumns(Columns, Buffer, (ULONG)Capacity);
+
+    if (Old.Buffer) {
+        ULONG n = Old.Count;
+        RtlCopyMemory(Columns->LocalAddress, Old.LocalAddress, (SIZE_T)n * sizeof(IN6_ADDR));
+        RtlCopyMemory(Columns->RemoteAddress, Old.RemoteAddress, (SIZE_T)n * sizeof(IN6_ADDR));
+        RtlCopyMemory(Columns->Pid, Old.Pid, (SIZE_T)n * sizeof(ULONG));
+        RtlCopyMemory(Columns->LocalPort, Old.LocalPort, (SIZE_T)n * sizeof(USHORT));
+        RtlCopyMemory(Columns->RemotePort, Old.RemotePort, (SIZE_T)n * sizeof(USHORT));
+        RtlCopyMemory(Columns->Family, Old.Family, n);
+        RtlCopyMemory(Columns->Protocol, Old.Protocol, n);
+        RtlCopyMemory(Columns->State, Old.State, n);
+        FREE(Old.Buffer);
+    }
+
+    Columns->Buffer = Buffer;
+    Columns->Capacity = (ULONG)Capacity;
+    Columns->Grows++;
+    return ERROR_SUCCESS;
+}
+
+
+static void MapAddress4(_In_ DWORD Address, _Out_ PIN6_ADDR Out)
+/*
+功能：IPv4的地址转换为IPv4映射的IPv6的地址（::ffff:a.b.c.d）。
+*/
+{
+    RtlZeroMemory(Out, sizeof(IN6_ADDR));
+    Out->u.Byte[10] = 0xff;
+    Out->u.Byte[11] = 0xff;
+    RtlCopyMemory(&Out->u.Byte[12], &Address, sizeof(DWORD));
+}
+
+
+static UINT8 GetState(_In_ DWORD State)
+{
+    return State < TABLE_COLUMNS_STATES ? (UINT8)State : 0;
+}
+
+
+static ULONG AppendTcp4Rows(_Inout_ PTABLE_COLUMNS Columns,
+                            _In_ const UCHAR * Rows,
+                            _In_ ULONG RowSize,
+                            _In_ ULONG Count)
+/*
+功能：追加MIB_TCPROW_OWNER_PID（MIB_TCPROW_OWNER_MODULE，MIB_TCPROW2）的行。
+*/
+{
+    ULONG Status = Reserve(Columns, (UINT64)Columns->Count + Count);
+    if (ERROR_SUCCESS != Status) {
+        return Status;
+    }
+
+    ULONG n = Columns->Count;
+    for (ULONG i = 0; i < Count; i++, n++, Rows += RowSize) {
+        auto Row = reinterpret_cast<const MIB_TCPROW_OWNER_PID *>(Rows);
+
+        Columns->Family[n] = AF_INET;
+        Columns->Protocol[n] = IPPROTO_TCP;
+        Columns->State[n] = GetState(Row->dwState);
+        Columns->LocalPort[n] = ntohs((USHORT)Row->dwLocalPort);
+        Columns->RemotePort[n] = ntohs((USHORT)Row->dwRemotePort);
+        Columns->Pid[n] = Row->dwOwningPid;
+        MapAddress4(Row->dwLocalAddr, &Columns->LocalAddress[n]);
+        MapAddress4(Row->dwRemoteAddr, &Columns->RemoteAddress[n]);
+    }
+
+    Columns->Count = n;
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG AppendTcp6Rows(_Inout_ PTABLE_COLUMNS Columns,
+                            _In_ const UCHAR * Rows,
+                            _In_ ULONG RowSize,
+                            _In_ ULONG Count)
+/*
+功能：追加MIB_TCP6ROW_OWNER_PID（MIB_TCP6ROW_OWNER_MODULE，MIB_TCP6ROW2）的行。
+*/
+{
+    ULONG Status = Reserve(Columns, (UINT64)Columns->Count + Count);
+    if (ERROR_SUCCESS != Status) {
+        return Status;
+    }
+
+    ULONG n = Columns->Count;
+    for (ULONG i = 0; i < Count; i++, n++, Rows += RowSize) {
+        auto Row = reinterpret_cast<const MIB_TCP6ROW_OWNER_PID *>(Rows);
+
+        Columns->Family[n] = AF_INET6;
+        Columns->Protocol[n] = IPPROTO_TCP;
+        Columns->State[n] = GetState(Row->dwState);
+        Columns->LocalPort[n] = ntohs((USHORT)Row->dwLocalPort);
+        Columns->RemotePort[n] = ntohs((USHORT)Row->dwRemotePort);
+        Columns->Pid[n] = Row->dwOwningPid;
+        RtlCopyMemory(&Columns->LocalAddress[n], Row->ucLocalAddr, sizeof(IN6_ADDR));
+        RtlCopyMemory(&Columns->RemoteAddress[n], Row->ucRemoteAddr, sizeof(IN6_ADDR));
+    }
+
+    Columns->Count = n;
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG AppendUdpRows(_Inout_ PTABLE_COLUMNS Columns,
+                           _In_ ULONG Family,
+                           _In_ const UCHAR * Rows,
+                           _In_ ULONG RowSize,
+                           _In_ ULONG Count)
+/*
+功能：追加MIB_UDPROW_OWNER_PID或MIB_UDP6ROW_OWNER_PID（及对应的OWNER_MODULE）的行。
+*/
+{
+    ULONG Status = Reserve(Columns, (UINT64)Columns->Count + Count);
+    if (ERROR_SUCCESS != Status) {
+        return Status;
+    }
+
+    ULONG n = Columns->Count;
+    for (ULONG i = 0; i < Count; i++, n++, Rows += RowSize) {
+        Columns->Family[n] = (UINT8)Family;
+        Columns->Protocol[n] = IPPROTO_UDP;
+        Columns->State[n] = 0;
+        Columns->RemotePort[n] = 0;
+        RtlZeroMemory(&Columns->RemoteAddress[n], sizeof(IN6_ADDR));
+
+        if (AF_INET6 == Family) {
+            auto Row = reinterpret_cast<const MIB_UDP6ROW_OWNER_PID *>(Rows);
+            Columns->LocalPort[n] = ntohs((USHORT)Row->dwLocalPort);
+            Columns->Pid[n] = Row->dwOwningPid;
+            RtlCopyMemory(&Columns->LocalAddress[n], Row->ucLocalAddr, sizeof(IN6_ADDR));
+        } else {
+            auto Row = reinterpret_cast<const MIB_UDPROW_OWNER_PID *>(Rows);
+            Columns->LocalPort[n] = ntohs((USHORT)Row->dwLocalPort);
+            Columns->Pid[n] = Row->dwOwningPid;
+            MapAddress4(Row->dwLocalAddr, &Columns->LocalAddress[n]);
+        }
+    }
+
+    Columns->Count = n;
+    return ERROR_SUCCESS;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//查询。
+
+
+static ULONG FilterRows(_In_ const COLUMN_KERNELS * Kernels,
+                        _In_ const TABLE_COLUMNS * Columns,
+                        _In_ const TABLE_COLUMNS_FILTER * Filter,
+                        _Out_ PUINT64 Selection)
+{
+    ULONG Words = TABLE_COLUMNS_SELECTION_WORDS(Columns->Count);
+
+    for (ULONG w = 0; w < Words; w++) {
+        Selection[w] = GetSelection(Columns, nullptr, w);
+    }
+
+    if (Filter->Flags & TABLE_COLUMNS_MATCH_STATES) {
+        Kernels->MatchStates(Columns->State, Filter->States, Selection, Words);
+    }
+
+    if (Filter->Flags & TABLE_COLUMNS_MATCH_FAMILY) {
+        Kernels->MatchBytes(Columns->Family, Filter->Family, Selection, Words);
+    }
+
+    if (Filter->Flags & TABLE_COLUMNS_MATCH_PROTOCOL) {
+        Kernels->MatchBytes(Columns->Protocol, Filter->Protocol, Selection, Words);
+    }
+
+    if (Filter->Flags & TABLE_COLUMNS_MATCH_LOCAL_PORT) {
+        Kernels->MatchWords(Columns->LocalPort, Filter->LocalPort, Selection, Words);
+    }
+
+    if (Filter->Flags & TABLE_COLUMNS_MATCH_REMOTE_PORT) {
+        Kernels->MatchWords(Columns->RemotePort, Filter->RemotePort, Selection, Words);
+    }
+
+    if (Filter->Flags & TABLE_COLUMNS_MATCH_PID) {
+        Kernels->MatchLongs(Columns->Pid, Filter->Pid, Selection, Words);
+    }
+
+    ULONG Matched = 0;
+    for (ULONG w = 0; w < Words; w++) {
+        Matched += PopCount64(Selection[w]);
+    }
+
+    return Matched;
+}
+
+
+static void CountRowsByState(_In_ const COLUMN_KERNELS * Kernels,
+                             _In_ const TABLE_COLUMNS * Columns,
+                             _In_opt_ const UINT64 * Selection,
+                             _Out_writes_(TABLE_COLUMNS_STATES) PULONG Counts)
+{
+    RtlZeroMemory(Counts, TABLE_COLUMNS_STATES * sizeof(ULONG));
+
+    if (Selection) {
+        Kernels->CountStates(Columns->State, Selection, TABLE_COLUMNS_SELECTION_WORDS(Columns->Count), Counts);
+        return;
+    }
+
+    //整块的不用选择位图，最后不满一块的用标量的。
+    ULONG Full = Columns->Count / TABLE_COLUMNS_BLOCK;
+    Kernels->CountStates(Columns->State, nullptr, Full, Counts);
+
+    for (ULONG i = Full * TABLE_COLUMNS_BLOCK; i < Columns->Count; i++) {
+        Counts[Columns->State[i]]++;
+    }
+}
+
+
+static ULONG ReserveGroups(_Inout_ PTABLE_COLUMNS Columns, _In_ ULONG Size)
+/*
+功能：保证哈希表至少有Size（2的幂）项，并把前Size项清零。
+*/
+{
+    if (Size > Columns->GroupCapacity) {
+        if (Columns->Groups) {
+            FREE(Columns->Groups);
+        }
+
+        Columns->GroupCapacity = 0;
+        Columns->Groups = MALLOC((SIZE_T)Size * sizeof(GROUP_ENTRY));
+        if (nullptr == Columns->Groups) {
+            return ERROR_NOT_ENOUGH_MEMORY;
+        }
+
+        Columns->GroupCapacity = Size;
+        return ERROR_SUCCESS;
+    }
+
+    RtlZeroMemory(Columns->Groups, (SIZE_T)Size * sizeof(GROUP_ENTRY));
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG HashKey(_In_ const UINT64 * Key, _In_ ULONG Bits)
+{
+    UINT64 Hash = (Key[0] ^ (Key[1] * 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL;
+    return (ULONG)(Hash >> (64 - Bits));
+}
+
+
+static PGROUP_ENTRY FindGroup(_In_ PGROUP_ENTRY Groups, _In_ ULONG Bits, _In_ const UINT64 * Key)
+/*
+功能：找到键所在的项，没有的返回应当放的空项。
+*/
+{
+    ULONG Mask = (1UL << Bits) - 1;
+
+    for (ULONG i = HashKey(Key, Bits);; i = (i + 1) & Mask) {
+        PGROUP_ENTRY Entry = &Groups[i];
+        if (0 == Entry->Count || (Entry->Key[0] == Key[0] && Entry->Key[1] == Key[1])) {
+            return Entry;
+        }
+    }
+}
+
+
+static ULONG GrowGroups(_Inout_ PTABLE_COLUMNS Columns, _Inout_ PULONG Bits)
+/*
+功能：哈希表加倍，重新插入已有的项。
+*/
+{
+    ULONG OldSize = 1UL << *Bits;
+    PGROUP_ENTRY Old = reinterpret_cast<PGROUP_ENTRY>(Columns->Groups);
+    PGROUP_ENTRY New = reinterpret_cast<PGROUP_ENTRY>(MALLOC((SIZE_T)OldSize * 2 * sizeof(GROUP_ENTRY)));
+    if (nullptr == New) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    for (ULONG i = 0; i < OldSize; i++) {
+        if (Old[i].Count) {
+            *FindGroup(New, *Bits + 1, Old[i].Key) = Old[i];
+        }
+    }
+
+    FREE(Old);
+    Columns->Groups = New;
+    Columns->GroupCapacity = OldSize * 2;
+    (*Bits)++;
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG GroupRows(_Inout_ PTABLE_COLUMNS Columns,
+                       _In_opt_ const UINT64 * Selection,
+                       _In_ BOOL ByAddress,
+                       _Out_ PULONG Groups)
+/*
+功能：选中的行按PID或者远程地址分组计数，结果在Columns->Groups的前*Groups项（压缩过的）。
+
+哈希表从TABLE_COLUMNS_MIN_GROUPS项开始（只清零用到的部分），超过一半就加倍。
+*/
+{
+    ULONG Bits = 0;
+    ULONG Used = 0;
+
+    *Groups = 0;
+    while ((1UL << Bits) < TABLE_COLUMNS_MIN_GROUPS) {
+        Bits++;
+    }
+
+    ULONG Status = ReserveGroups(Columns, 1UL << Bits);
+    if (ERROR_SUCCESS != Status) {
+        return Status;
+    }
+
+    ULONG Words = TABLE_COLUMNS_SELECTION_WORDS(Columns->Count);
+    for (ULONG w = 0; w < Words; w++) {
+        UINT64 Selected = GetSelection(Columns, Selection, w);
+
+        while (Selected) {
+            ULONG Row = w * TABLE_COLUMNS_BLOCK + LowestBit(Selected);
+            UINT64 Key[2] = {0, 0};
+
+            Selected &= Selected - 1;
+            if (ByAddress) {
+                RtlCopyMemory(Key, &Columns->RemoteAddress[Row], sizeof(Key));
+            } else {
+                Key[0] = Columns->Pid[Row];
+            }
+
+            PGROUP_ENTRY Entry = FindGroup(reinterpret_cast<PGROUP_ENTRY>(Columns->Groups), Bits, Key);
+            if (Entry->Count++) {
+                continue;
+            }
+
+            Entry->Key[0] = Key[0];
+            Entry->Key[1] = Key[1];
+            if (++Used > (1UL << Bits) / 2) {
+                Status = GrowGroups(Columns, &Bits);
+                if (ERROR_SUCCESS != Status) {
+                    return Status;
+                }
+            }
+        }
+    }
+
+    //压缩到前面。
+    PGROUP_ENTRY Entries = reinterpret_cast<PGROUP_ENTRY>(Columns->Groups);
+    ULONG n = 0;
+    for (ULONG i = 0; i < (1UL << Bits); i++) {
+        if (Entries[i].Count) {
+            Entries[n++] = Entries[i];
+        }
+    }
+
+    *Groups = n;
+    return ERROR_SUCCESS;
+}
+
+
+static int __cdecl ComparePidGroup(_In_ const void * A, _In_ const void * B)
+/*
+功能：排在前面的（Count大的，相同的PID小的）返回负数。
+*/
+{
+    auto x = reinterpret_cast<const GROUP_ENTRY *>(A);
+    auto y = reinterpret_cast<const GROUP_ENTRY *>(B);
+
+    if (x->Count != y->Count) {
+        return x->Count > y->Count ? -1 : 1;
+    }
+
+    return x->Key[0] < y->Key[0] ? -1 : (x->Key[0] > y->Key[0] ? 1 : 0);
+}
+
+
+static int __cdecl CompareAddressGroup(_In_ const void * A, _In_ const void * B)
+{
+    auto x = reinterpret_cast<const GROUP_ENTRY *>(A);
+    auto y = reinterpret_cast<const GROUP_ENTRY *>(B);
+
+    if (x->Count != y->Count) {
+        return x->Count > y->Count ? -1 : 1;
+    }
+
+    return memcmp(x->Key, y->Key, sizeof(x->Key));
+}
+
+
+static void SiftDown(_Inout_updates_(Count) PGROUP_ENTRY Heap,
+                     _In_ ULONG Count,
+                     _In_ ULONG Index,
+                     _In_ GROUP_COMPARE Compare)
+/*
+功能：堆顶是排在最后的（最差的）。
+*/
+{
+    for (;;) {
+        ULONG Worst = Index;
+        ULONG Left = Index * 2 + 1;
+        ULONG Right = Left + 1;
+
+        if (Left < Count && Compare(&Heap[Left], &Heap[Worst]) > 0) {
+            Worst = Left;
+        }
+
+        if (Right < Count && Compare(&Heap[Right], &Heap[Worst]) > 0) {
+            Worst = Right;
+        }
+
+        if (Worst == Index) {
+            return;
+        }
+
+        GROUP_ENTRY Temp = Heap[Index];
+        Heap[Index] = Heap[Worst];
+        Heap[Worst] = Temp;
+        Index = Worst;
+    }
+}
+
+
+static ULONG SelectTop(_Inout_updates_(Groups) PGROUP_ENTRY Entries,
+                       _In_ ULONG Groups,
+                       _In_ ULONG Count,
+                       _In_ GROUP_COMPARE Compare)
+/*
+功能：把排在最前的Count个（按顺序）放到Entries的前面，返回个数。
+
+前Count个建堆（堆顶是最差的），其余的比堆顶好的替换堆顶，最后只排序这Count个。
+*/
+{
+    if (Count >= Groups) {
+        qsort(Entries, Groups, sizeof(GROUP_ENTRY), Compare);
+        return Groups;
+    }
+
+    if (0 == Count) {
+        return 0;
+    }
+
+    for (ULONG i = Count / 2; i-- > 0;) {
+        SiftDown(Entries, Count, i, Compare);
+    }
+
+    for (ULONG i = Count; i < Groups; i++) {
+        if (Compare(&Entries[i], &Entries[0]) < 0) {
+            Entries[0] = Entries[i];
+            SiftDown(Entries, Count, 0, Compare);
+        }
+    }
+
+    qsort(Entries, Count, sizeof(GROUP_ENTRY), Compare);
+    return Count;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI TableColumnsInit(_Out_ PTABLE_COLUMNS Columns)
+{
+    RtlZeroMemory(Columns, sizeof(TABLE_COLUMNS));
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI TableColumnsReset(_Inout_ PTABLE_COLUMNS Columns)
+/*
+功能：清空所有的行，保留缓冲区，用于每次重新构建。
+*/
+{
+    Columns->Count = 0;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI TableColumnsAppend(_Inout_ PTABLE_COLUMNS Columns, _In_ const TABLE_SNAPSHOT * Snapshot)
+/*
+功能：追加一个快照的所有的行。
+
+参数：
+Snapshot：刷新成功的，带PID的表：TABLE_SNAPSHOT_TCP2，TABLE_SNAPSHOT_TCP6_2，
+          TABLE_SNAPSHOT_TCP_EXTENDED的OWNER_PID和OWNER_MODULE的，TABLE_SNAPSHOT_UDP_EXTENDED的OWNER_PID和OWNER_MODULE的。
+
+返回值：ERROR_SUCCESS，ERROR_INVALID_PARAMETER，ERROR_NOT_SUPPORTED（不支持的表），ERROR_NOT_ENOUGH_MEMORY。
+
+注意：IPv4和IPv6的（以及TCP和UDP的）可以追加到同一个表里。
+*/
+{
+    if (nullptr == Snapshot->Rows) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    const UCHAR * Rows = reinterpret_cast<const UCHAR *>(Snapshot->Rows);
+    BOOL V6 = AF_INET6 == Snapshot->Family;
+
+    switch (Snapshot->Kind) {
+    case TABLE_SNAPSHOT_TCP2:
+        return AppendTcp4Rows(Columns, Rows, Snapshot->RowSize, Snapshot->Count);
+    case TABLE_SNAPSHOT_TCP6_2:
+        return AppendTcp6Rows(Columns, Rows, Snapshot->RowSize, Snapshot->Count);
+    case TABLE_SNAPSHOT_TCP_EXTENDED:
+        if (Snapshot->Class < TCP_TABLE_OWNER_PID_LISTENER || Snapshot->Class > TCP_TABLE_OWNER_MODULE_ALL) {
+            return ERROR_NOT_SUPPORTED;
+        }
+
+        if (V6) {
+            return AppendTcp6Rows(Columns, Rows, Snapshot->RowSize, Snapshot->Count);
+        }
+
+        return AppendTcp4Rows(Columns, Rows, Snapshot->RowSize, Snapshot->Count);
+    case TABLE_SNAPSHOT_UDP_EXTENDED:
+        if (UDP_TABLE_OWNER_PID != Snapshot->Class && UDP_TABLE_OWNER_MODULE != Snapshot->Class) {
+            return ERROR_NOT_SUPPORTED;
+        }
+
+        return AppendUdpRows(Columns, V6 ? AF_INET6 : AF_INET, Rows, Snapshot->RowSize, Snapshot->Count);
+    default:
+        return ERROR_NOT_SUPPORTED;
+    }
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI TableColumnsAppendTcp4(_Inout_ PTABLE_COLUMNS Columns, _In_ const MIB_TCPTABLE_OWNER_PID * Table)
+/*
+功能：追加GetExtendedTcpTable（AF_INET，TCP_TABLE_OWNER_PID_*）的表。
+*/
+{
+    return AppendTcp4Rows(Columns,
+                          reinterpret_cast<const UCHAR *>(Table->table),
+                          sizeof(MIB_TCPROW_OWNER_PID),
+                          Table->dwNumEntries);
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI TableColumnsAppendTcp6(_Inout_ PTABLE_COLUMNS Columns, _In_ const MIB_TCP6TABLE_OWNER_MODULE * Table)
+/*
+功能：追加GetExtendedTcpTable（AF_INET6，TCP_TABLE_OWNER_MODULE_*）的表。模块的信息不要。
+*/
+{
+    return AppendTcp6Rows(Columns,
+                          reinterpret_cast<const UCHAR *>(Table->table),
+                          sizeof(MIB_TCP6ROW_OWNER_MODULE),
+                          Table->dwNumEntries);
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI TableColumnsFilter(_In_ const TABLE_COLUMNS * Columns,
+                                _In_ const TABLE_COLUMNS_FILTER * Filter,
+                                _Out_writes_(TABLE_COLUMNS_SELECTION_WORDS(Columns->Count)) PUINT64 Selection)
+/*
+功能：按条件（Filter->Flags指定的各列的条件都满足）过滤，得到选择位图。
+
+返回值：选中的行数。
+
+注意：Flags是0的选中全部的行。
+*/
+{
+    return FilterRows(g_ColumnKernels, Columns, Filter, Selection);
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI TableColumnsCountByState(_In_ const TABLE_COLUMNS * Columns,
+                                     _In_opt_ const UINT64 * Selection,
+                                     _Out_writes_(TABLE_COLUMNS_STATES) PULONG Counts)
+/*
+功能：按状态计数，Counts[MIB_TCP_STATE_ESTAB]是ESTABLISHED的个数，Counts[0]是UDP的（和不认识的状态）。
+
+参数：
+Selection：TableColumnsFilter的结果，nullptr的是全部的行。
+*/
+{
+    CountRowsByState(g_ColumnKernels, Columns, Selection, Counts);
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI TableColumnsTopPids(_Inout_ PTABLE_COLUMNS Columns,
+                                 _In_opt_ const UINT64 * Selection,
+                                 _In_ ULONG Count,
+                                 _Out_writes_to_(Count, *Returned) PTABLE_COLUMNS_PID_COUNT Top,
+                                 _Out_ PULONG Returned,
+                                 _Out_opt_ PULONG Groups)
+/*
+功能：按PID分组计数，给出行数最多的Count个。
+
+参数：
+Returned：Top里的个数，不超过Count。
+Groups：PID的个数。要得到全部的PID的计数，可以先取Groups，再用它作为Count。
+
+返回值：ERROR_SUCCESS或者ERROR_NOT_ENOUGH_MEMORY。
+*/
+{
+    ULONG n = 0;
+
+    *Returned = 0;
+    if (Groups) {
+        *Groups = 0;
+    }
+
+    ULONG Status = GroupRows(Columns, Selection, FALSE, &n);
+    if (ERROR_SUCCESS != Status) {
+        return Status;
+    }
+
+    PGROUP_ENTRY Entries = reinterpret_cast<PGROUP_ENTRY>(Columns->Groups);
+    ULONG Selected = SelectTop(Entries, n, Count, ComparePidGroup);
+    for (ULONG i = 0; i < Selected; i++) {
+        Top[i].Pid = (ULONG)Entries[i].Key[0];
+        Top[i].Count = Entries[i].Count;
+    }
+
+    *Returned = Selected;
+    if (Groups) {
+        *Groups = n;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI TableColumnsTopRemoteAddresses(_Inout_ PTABLE_COLUMNS Columns,
+                                            _In_opt_ const UINT64 * Selection,
+                                            _In_ ULONG Count,
+                                            _Out_writes_to_(Count, *Returned) PTABLE_COLUMNS_ADDRESS_COUNT Top,
+                                            _Out_ PULONG Returned,
+                                            _Out_opt_ PULONG Groups)
+/*
+功能：按远程地址分组计数，给出行数最多的Count个。参数同TableColumnsTopPids。
+
+注意：侦听的和UDP的远程地址是全0（IPv4的是::ffff:0.0.0.0），一般先过滤掉（如只要MIB_TCP_STATE_ESTAB的）。
+*/
+{
+    ULONG n = 0;
+
+    *Returned = 0;
+    if (Groups) {
+        *Groups = 0;
+    }
+
+    ULONG Status = GroupRows(Columns, Selection, TRUE, &n);
+    if (ERROR_SUCCESS != Status) {
+        return Status;
+    }
+
+    PGROUP_ENTRY Entries = reinterpret_cast<PGROUP_ENTRY>(Columns->Groups);
+    ULONG Selected = SelectTop(Entries, n, Count, CompareAddressGroup);
+    for (ULONG i = 0; i < Selected; i++) {
+        RtlCopyMemory(&Top[i].Address, Entries[i].Key, sizeof(IN6_ADDR));
+        Top[i].Count = Entries[i].Count;
+    }
+
+    *Returned = Selected;
+    if (Groups) {
+        *Groups = n;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI TableColumnsFree(_Inout_ PTABLE_COLUMNS Columns)
+{
+    if (Columns->Buffer) {
+        FREE(Columns->Buffer);
+    }
+
+    if (Columns->Groups) {
+        FREE(Columns->Groups);
+    }
+
+    RtlZeroMemory(Columns, sizeof(TABLE_COLUMNS));
+}
@@ -0,0 +1,124 @@
+﻿#pragma once
+
+#include "pch.h"
+#include "TableSnapshot.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#define TABLE_COLUMNS_BLOCK  64 //行数按这个对齐，一个选择位图的字（UINT64）对应一块。
+#define TABLE_COLUMNS_STATES 13 // State列的取值：0（UDP，未知的）和MIB_TCP_STATE_CLOSED到MIB_TCP_STATE_DELETE_TCB。
+
+#define TABLE_COLUMNS_SELECTION_WORDS(Count) (((Count) + TABLE_COLUMNS_BLOCK - 1) / TABLE_COLUMNS_BLOCK)
+
+
+//连接表的列式（struct of arrays）的表示，见TableColumnsAppend。
+//每一列是一个连续的数组，分组和过滤只读用到的列。IPv4和IPv6的地址统一为16字节（IPv4的是映射的地址）。
+//缓冲区只增不减，反复构建时重用，不是线程安全的。用TableColumnsInit初始化，TableColumnsFree释放。
+typedef struct _TABLE_COLUMNS {
+    ULONG Count;
+    ULONG Capacity;          //行数，TABLE_COLUMNS_BLOCK的倍数。
+    PUINT8 Family;           // AF_INET或AF_INET6。
+    PUINT8 Protocol;         // IPPROTO_TCP或IPPROTO_UDP。
+    PUINT8 State;            // TCP的MIB_TCP_STATE，UDP的和不认识的是0。
+    PUSHORT LocalPort;       //主机字节序。
+    PUSHORT RemotePort;      // UDP的是0。
+    PULONG Pid;
+    PIN6_ADDR LocalAddress;  // IPv4的是::ffff:a.b.c.d。
+    PIN6_ADDR RemoteAddress;
+    PVOID Buffer;            //所有的列在一块内存里。
+    ULONG Grows;
+    PVOID Groups;            //分组用的哈希表，内部用。
+    ULONG GroupCapacity;
+} TABLE_COLUMNS, * PTABLE_COLUMNS;
+
+
+// TABLE_COLUMNS_FILTER的Flags，即比较哪些列，都是相等（State是集合）。
+#define TABLE_COLUMNS_MATCH_FAMILY      0x01
+#define TABLE_COLUMNS_MATCH_PROTOCOL    0x02
+#define TABLE_COLUMNS_MATCH_STATES      0x04
+#define TABLE_COLUMNS_MATCH_PID         0x08
+#define TABLE_COLUMNS_MATCH_LOCAL_PORT  0x10
+#define TABLE_COLUMNS_MATCH_REMOTE_PORT 0x20
+
+
+typedef struct _TABLE_COLUMNS_FILTER {
+    ULONG Flags;
+    UINT8 Family;
+    UINT8 Protocol;
+    USHORT LocalPort;  //主机字节序。
+    USHORT RemotePort;
+    USHORT Reserved;
+    ULONG States;      //状态的集合，第n位是State为n的，如：1 << MIB_TCP_STATE_ESTAB。
+    ULONG Pid;
+} TABLE_COLUMNS_FILTER, * PTABLE_COLUMNS_FILTER;
+
+
+//分组的结果，按Count从大到小，相同的按键从小到大。
+typedef struct _TABLE_COLUMNS_PID_COUNT {
+    ULONG Pid;
+    ULONG Count;
+} TABLE_COLUMNS_PID_COUNT, * PTABLE_COLUMNS_PID_COUNT;
+
+typedef struct _TABLE_COLUMNS_ADDRESS_COUNT {
+    IN6_ADDR Address;
+    ULONG Count;
+} TABLE_COLUMNS_ADDRESS_COUNT, * PTABLE_COLUMNS_ADDRESS_COUNT;
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C_START
+
+
+DLLEXPORT
+void WINAPI TableColumnsInit(_Out_ PTABLE_COLUMNS Columns);
+
+DLLEXPORT
+void WINAPI TableColumnsReset(_Inout_ PTABLE_COLUMNS Columns);
+
+DLLEXPORT
+ULONG WINAPI TableColumnsAppend(_Inout_ PTABLE_COLUMNS Columns, _In_ const TABLE_SNAPSHOT * Snapshot);
+
+DLLEXPORT
+ULONG WINAPI TableColumnsAppendTcp4(_Inout_ PTABLE_COLUMNS Columns, _In_ const MIB_TCPTABLE_OWNER_PID * Table);
+
+DLLEXPORT
+ULONG WINAPI TableColumnsAppendTcp6(_Inout_ PTABLE_COLUMNS Columns, _In_ const MIB_TCP6TABLE_OWNER_MODULE * Table);
+
+DLLEXPORT
+ULONG WINAPI TableColumnsFilter(_In_ const TABLE_COLUMNS * Columns,
+                                _In_ const TABLE_COLUMNS_FILTER * Filter,
+                                _Out_writes_(TABLE_COLUMNS_SELECTION_WORDS(Columns->Count)) PUINT64 Selection);
+
+DLLEXPORT
+void WINAPI TableColumnsCountByState(_In_ const TABLE_COLUMNS * Columns,
+                                     _In_opt_ const UINT64 * Selection,
+                                     _Out_writes_(TABLE_COLUMNS_STATES) PULONG Counts);
+
+DLLEXPORT
+ULONG WINAPI TableColumnsTopPids(_Inout_ PTABLE_COLUMNS Columns,
+                                 _In_opt_ const UINT64 * Selection,
+                                 _In_ ULONG Count,
+                                 _Out_writes_to_(Count, *Returned) PTABLE_COLUMNS_PID_COUNT Top,
+                                 _Out_ PULONG Returned,
+                                 _Out_opt_ PULONG Groups);
+
+DLLEXPORT
+ULONG WINAPI TableColumnsTopRemoteAddresses(_Inout_ PTABLE_COLUMNS Columns,
+                                            _In_opt_ const UINT64 * Selection,
+                                            _In_ ULONG Count,
+                                            _Out_writes_to_(Count, *Returned) PTABLE_COLUMNS_ADDRESS_COUNT Top,
+                                            _Out_ PULONG Returned,
+                                            _Out_opt_ PULONG Groups);
+
+DLLEXPORT
+void WINAPI TableColumnsFree(_Inout_ PTABLE_COLUMNS Columns);
+
+
+EXTERN_C_END
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,1024 @@
+﻿#include "pch.h"
+#include "TableDiff.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/*
+连接表的增量：比较相邻的两次快照（TABLE_SNAPSHOT），给出打开，关闭和变化（状态，所属进程）的连接。
+
+1.各种表的行先统一成TABLE_DIFF_ROW，键是（协议，地址族，本地地址和端口，远程地址和端口）的64位哈希。
+2.排序合并（sort-merge）：这次的键按（哈希，PID）排序，和保存的上一次的（已经有序）归并。
+  哈希是均匀的，只对高22位做两趟基数排序，剩下的几乎有序，再插入排序一遍。
+  同一个四元组的多行（如UDP的重复绑定，不同进程的侦听）先按PID配对，剩下的依次配对为PID的变化。
+3.排序后按键的顺序重新统一一遍行（随机读快照，顺序写），归并和保存都是顺序访问的。
+  只保存上一次的键（和完整的行），每次只排序新的表；缓冲区只增不减，跨调用重用，完整的行交换而不是复制。
+4.TABLE_DIFF_COMPACT：每行只保存16字节（哈希，PID，状态），比较时也只比哈希（64位，冲突可以忽略），
+  关闭的事件只有哈希，原来的PID和状态。
+5.事件按批（TABLE_DIFF_BATCH个）交给回调，不随事件数增加内存。
+
+注意：端口，地址的比较都不含IPv6的scope id。
+*/
+
+
+#define DIFF_RADIX_BITS    11
+#define DIFF_RADIX_SIZE    (1 << DIFF_RADIX_BITS)
+#define DIFF_RADIX_PASSES  2                   //只排高22位。
+#define DIFF_SMALL_SORT    64                  //少于这么多个的用插入排序。
+#define DIFF_MATCHED       0x80000000          //状态的最高位：同一个哈希的多行配对时的标记。
+
+
+//排序用的（这次的）键。
+typedef struct _DIFF_KEY {
+    UINT64 Hash;
+    ULONG Pid;
+    ULONG Index; //快照里的行号。
+} DIFF_KEY, * PDIFF_KEY;
+
+
+//保存的（上一次的）键，按（Hash，Pid）有序。
+typedef struct _DIFF_SAVED {
+    UINT64 Hash;
+    ULONG Pid;
+    ULONG State;
+} DIFF_SAVED, * PDIFF_SAVED;
+
+
+typedef void (*DIFF_NORMALIZE)(_In_ const UCHAR * Row, _Out_ PTABLE_DIFF_ROW Out);
+
+
+struct _TABLE_DIFF {
+    ULONG Flags;
+
+    PDIFF_SAVED Saved;        //上一次的，共Count个。
+    PTABLE_DIFF_ROW Rows;     //和Saved一一对应，TABLE_DIFF_COMPACT的是nullptr。
+    ULONG Count;
+    ULONG SavedCapacity;
+    ULONG RowsCapacity;
+
+    PDIFF_KEY Keys;           //这次的，排序后。
+    PDIFF_KEY Scratch;
+    PULONG States;            //这次的，和Keys一一对应，最高位是DIFF_MATCHED。
+    PTABLE_DIFF_ROW NewRows;  //这次的，和Keys一一对应，TABLE_DIFF_COMPACT的是nullptr。
+    ULONG Capacity;
+    ULONG NewRowsCapacity;
+
+    ULONG Histogram[DIFF_RADIX_PASSES][DIFF_RADIX_SIZE];
+
+    //一次比较的状态。
+    const TABLE_SNAPSHOT * Snapshot;
+    DIFF_NORMALIZE Normalize;
+    TABLE_DIFF_CALLBACK Callback;
+    PVOID Context;
+    ULONG Status;
+    ULONG Pending;
+    TABLE_DIFF_EVENT Batch[TABLE_DIFF_BATCH];
+
+    ULONG Updates;
+    UINT64 Opened;
+    UINT64 Closed;
+    UINT64 Changed;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//行的统一。
+
+
+static void CopyAddress4(_In_ DWORD Address, _Out_writes_(16) PUINT8 Out)
+{
+    RtlCopyMemory(Out, &Address, sizeof(DWORD));
+}
+
+
+static void NormalizeTcp4(_In_ const UCHAR * Row, _Out_ PTABLE_DIFF_ROW Out)
+{
+    auto Tcp = reinterpret_cast<const MIB_TCPROW *>(Row);
+
+    RtlZeroMemory(Out, sizeof(TABLE_DIFF_ROW));
+    Out->Family = AF_INET;
+    Out->Protocol = IPPROTO_TCP;
+    Out->LocalPort = ntohs((USHORT)Tcp->dwLocalPort);
+    Out->RemotePort = ntohs((USHORT)Tcp->dwRemotePort);
+    Out->State = Tcp->dwState;
+    CopyAddress4(Tcp->dwLocalAddr, Out->LocalAddress);
+    CopyAddress4(Tcp->dwRemoteAddr, Out->RemoteAddress);
+}
+
+
+static void NormalizeTcp4Pid(_In_ const UCHAR * Row, _Out_ PTABLE_DIFF_ROW Out)
+/*
+MIB_TCPROW_OWNER_PID，MIB_TCPROW_OWNER_MODULE和MIB_TCPROW2的前面的成员是一样的。
+*/
+{
+    auto Tcp = reinterpret_cast<const MIB_TCPROW_OWNER_PID *>(Row);
+
+    RtlZeroMemory(Out, sizeof(TABLE_DIFF_ROW));
+    Out->Family = AF_INET;
+    Out->Protocol = IPPROTO_TCP;
+    Out->LocalPort = ntohs((USHORT)Tcp->dwLocalPort);
+    Out->RemotePort = ntohs((USHORT)Tcp->dwRemotePort);
+    Out->State = Tcp->dwState;
+    Out->OwningPid = Tcp->dwOwningPid;
+    CopyAddress4(Tcp->dwLocalAddr, Out->LocalAddress);
+    CopyAddress4(Tcp->dwRemoteAddr, Out->RemoteAddress);
+}
+
+
+static void NormalizeTcp6(_In_ const UCHAR * Row, _Out_ PTABLE_DIFF_ROW Out)
+{
+    auto Tcp = reinterpret_cast<const MIB_TCP6ROW *>(Row);
+
+    RtlZeroMemory(Out, sizeof(TABLE_DIFF_ROW));
+    Out->Family = AF_INET6;
+    Out->Protocol = IPPROTO_TCP;
+    Out->LocalPort = ntohs((USHORT)Tcp->dwLocalPort);
+    Out->RemotePort = ntohs((USHORT)Tcp->dwRemotePort);
+    Out->State = (ULONG)Tcp->State;
+    RtlCopyMemory(Out->LocalAddress, &Tcp->LocalAddr, 16);
+    RtlCopyMemory(Out->RemoteAddress, &Tcp->RemoteAddr, 16);
+}
+
+
+static void NormalizeTcp6Row2(_In_ const UCHAR * Row, _Out_ PTABLE_DIFF_ROW Out)
+{
+    auto Tcp = reinterpret_cast<const MIB_TCP6ROW2 *>(Row);
+
+    RtlZeroMemory(Out, sizeof(TABLE_DIFF_ROW));
+    Out->Family = AF_INET6;
+    Out->Protocol = IPPROTO_TCP;
+    Out->LocalPort = ntohs((USHORT)Tcp->dwLocalPort);
+    Out->RemotePort = ntohs((USHORT)Tcp->dwRemotePort);
+    Out->State = (ULONG)Tcp->State;
+    Out->OwningPid = Tcp->dwOwningPid;
+    RtlCopyMemory(Out->LocalAddress, &Tcp->LocalAddr, 16);
+    RtlCopyMemory(Out->RemoteAddress, &Tcp->RemoteAddr, 16);
+}
+
+
+static void NormalizeTcp6Pid(_In_ const UCHAR * Row, _Out_ PTABLE_DIFF_ROW Out)
+/*
+MIB_TCP6ROW_OWNER_PID和MIB_TCP6ROW_OWNER_MODULE的前面的成员是一样的。
+*/
+{
+    auto Tcp = reinterpret_cast<const MIB_TCP6ROW_OWNER_PID *>(Row);
+
+    RtlZeroMemory(Out, sizeof(TABLE_DIFF_ROW));
+    Out->Family = AF_INET6;
+    Out->Protocol = IPPROTO_TCP;
+    Out->LocalPort = ntohs((USHORT)Tcp->dwLocalPort);
+    Out->RemotePort = ntohs((USHORT)Tcp->dwRemotePort);
+    Out->State = Tcp->dwState;
+    Out->OwningPid = Tcp->dwOwningPid;
+    RtlCopyMemory(Out->LocalAddress, Tcp->ucLocalAddr, 16);
+    RtlCopyMemory(Out->RemoteAddress, Tcp->ucRemoteAddr, 16);
+}
+
+
+static void NormalizeUdp4(_In_ const UCHAR * Row, _Out_ PTABLE_DIFF_ROW Out)
+{
+    auto Udp = reinterpret_cast<const MIB_UDPROW *>(Row);
+
+    RtlZeroMemory(Out, sizeof(TABLE_DIFF_ROW));
+    Out->Family = AF_INET;
+    Out->Protocol = IPPROTO_UDP;
+    Out->LocalPort = ntohs((USHORT)Udp->dwLocalPort);
+    CopyAddress4(Udp->dwLocalAddr, Out->LocalAddress);
+}
+
+
+static void NormalizeUdp4Pid(_In_ const UCHAR * Row, _Out_ PTABLE_DIFF_ROW Out)
+/*
+MIB_UDPROW_OWNER_PID和MIB_UDPROW_OWNER_MODULE的前面的成员是一样的。
+*/
+{
+    auto Udp = reinterpret_cast<const MIB_UDPROW_OWNER_PID *>(Row);
+
+    RtlZeroMemory(Out, sizeof(TABLE_DIFF_ROW));
+    Out->Family = AF_INET;
+    Out->Protocol = IPPROTO_UDP;
+    Out->LocalPort = ntohs((USHORT)Udp->dwLocalPort);
+    Out->OwningPid = Udp->dwOwningPid;
+    CopyAddress4(Udp->dwLocalAddr, Out->LocalAddress);
+}
+
+
+static void NormalizeUdp6(_In_ const UCHAR * Row, _Out_ PTABLE_DIFF_ROW Out)
+{
+    auto Udp = reinterpret_cast<const MIB_UDP6ROW *>(Row);
+
+    RtlZeroMemory(Out, sizeof(TABLE_DIFF_ROW));
+    Out->Family = AF_INET6;
+    Out->Protocol = IPPROTO_UDP;
+    Out->LocalPort = ntohs((USHORT)Udp->dwLocalPort);
+    RtlCopyMemory(Out->LocalAddress, &Udp->dwLocalAddr, 16);
+}
+
+
+static void NormalizeUdp6Pid(_In_ const UCHAR * Row, _Out_ PTABLE_DIFF_ROW Out)
+/*
+MIB_UDP6ROW_OWNER_PID和MIB_UDP6ROW_OWNER_MODULE的前面的成员是一样的。
+*/
+{
+    auto Udp = reinterpret_cast<const MIB_UDP6ROW_OWNER_PID *>(Row);
+
+    RtlZeroMemory(Out, sizeof(TABLE_DIFF_ROW));
+    Out->Family = AF_INET6;
+    Out->Protocol = IPPROTO_UDP;
+    Out->LocalPort = ntohs((USHORT)Udp->dwLocalPort);
+    Out->OwningPid = Udp->dwOwningPid;
+    RtlCopyMemory(Out->LocalAddress, Udp->ucLocalAddr, 16);
+}
+
+
+static DIFF_NORMALIZE GetNormalize(_In_ const TABLE_SNAPSHOT * Snapshot)
+/*
+功能：按快照的Kind（Family，Class）选择行的转换函数，不支持的返回nullptr。
+*/
+{
+    BOOL V6 = AF_INET6 == Snapshot->Family;
+
+    switch (Snapshot->Kind) {
+    case TABLE_SNAPSHOT_TCP:
+        return NormalizeTcp4;
+    case TABLE_SNAPSHOT_TCP2:
+        return NormalizeTcp4Pid;
+    case TABLE_SNAPSHOT_TCP6:
+        return NormalizeTcp6;
+    case TABLE_SNAPSHOT_TCP6_2:
+        return NormalizeTcp6Row2;
+    case TABLE_SNAPSHOT_TCP_EXTENDED:
+        if (Snapshot->Class <= TCP_TABLE_BASIC_ALL) {
+            return V6 ? nullptr : NormalizeTcp4;
+        }
+
+        if (Snapshot->Class <= TCP_TABLE_OWNER_MODULE_ALL) {
+            return V6 ? NormalizeTcp6Pid : NormalizeTcp4Pid;
+        }
+
+        return nullptr;
+    case TABLE_SNAPSHOT_UDP:
+        return NormalizeUdp4;
+    case TABLE_SNAPSHOT_UDP6:
+        return NormalizeUdp6;
+    case TABLE_SNAPSHOT_UDP_EXTENDED:
+        if (UDP_TABLE_BASIC == Snapshot->Class) {
+            return V6 ? NormalizeUdp6 : NormalizeUdp4;
+        }
+
+        if (UDP_TABLE_OWNER_PID == Snapshot->Class || UDP_TABLE_OWNER_MODULE == Snapshot->Class) {
+            return V6 ? NormalizeUdp6Pid : NormalizeUdp4Pid;
+        }
+
+        return nullptr;
+    default:
+        return nullptr;
+    }
+}
+
+
+static UINT64 Mix64(_In_ UINT64 x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+
+static UINT64 HashRow(_In_ const TABLE_DIFF_ROW * Row)
+/*
+功能：键（协议，地址族，地址和端口）的哈希，不含状态和PID。
+*/
+{
+    UINT64 Words[4];
+    RtlCopyMemory(Words, Row->LocalAddress, sizeof(Words));
+
+    UINT64 Head = (UINT64)Row->Family | ((UINT64)Row->Protocol << 16) | ((UINT64)Row->LocalPort << 32) |
+                  ((UINT64)Row->RemotePort << 48);
+
+    UINT64 Hash = Mix64(Head ^ 0x9e3779b97f4a7c15ULL);
+    Hash = Mix64(Hash ^ Words[0]);
+    Hash = Mix64(Hash ^ Words[1]);
+    Hash = Mix64(Hash ^ Words[2]);
+    return Mix64(Hash ^ Words[3]);
+}
+
+
+static BOOL SameKey(_In_ const TABLE_DIFF_ROW * A, _In_ const TABLE_DIFF_ROW * B)
+{
+    return A->Family == B->Family && A->Protocol == B->Protocol && A->LocalPort == B->LocalPort &&
+           A->RemotePort == B->RemotePort && 0 == memcmp(A->LocalAddress, B->LocalAddress, 16) &&
+           0 == memcmp(A->RemoteAddress, B->RemoteAddress, 16);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//排序。
+
+
+static BOOL KeyLess(_In_ const DIFF_KEY * A, _In_ const DIFF_KEY * B)
+{
+    return A->Hash < B->Hash || (A->Hash == B->Hash && A->Pid < B->Pid);
+}
+
+
+static void InsertionSort(_Inout_updates_(Count) PDIFF_KEY Keys, _In_ ULONG Count)
+{
+    for (ULONG i = 1; i < Count; i++) {
+        DIFF_KEY Key = Keys[i];
+        ULONG j = i;
+
+        for (; j > 0 && KeyLess(&Key, &Keys[j - 1]); j--) {
+            Keys[j] = Keys[j - 1];
+        }
+
+        Keys[j] = Key;
+    }
+}
+
+
+static void SortKeys(_Inout_ PTABLE_DIFF Diff, _In_ ULONG Count)
+/*
+功能：按（Hash，Pid）排序Diff->Keys。
+
+先按Hash的高22位做两趟LSD基数排序（每次11位），这时只有高22位相同的（很少）还是乱的，
+再整个插入排序一遍，代价接近线性。Hash相同的（同一个四元组的多行）也在这一遍按Pid排好。
+*/
+{
+    PDIFF_KEY Keys = Diff->Keys;
+
+    if (Count < DIFF_SMALL_SORT) {
+        InsertionSort(Keys, Count);
+        return;
+    }
+
+    RtlZeroMemory(Diff->Histogram, sizeof(Diff->Histogram));
+    for (ULONG i = 0; i < Count; i++) {
+        UINT64 Hash = Keys[i].Hash;
+        for (int Pass = 0; Pass < DIFF_RADIX_PASSES; Pass++) {
+            int Shift = 64 - (DIFF_RADIX_PASSES - Pass) * DIFF_RADIX_BITS;
+            Diff->Histogram[Pass][(Hash >> Shift) & (DIFF_RADIX_SIZE - 1)]++;
+        }
+    }
+
+    PDIFF_KEY Source = Keys;
+    PDIFF_KEY Target = Diff->Scratch;
+    for (int Pass = 0; Pass < DIFF_RADIX_PASSES; Pass++) {
+        PULONG Offsets = Diff->Histogram[Pass];
+        int Shift = 64 - (DIFF_RADIX_PASSES - Pass) * DIFF_RADIX_BITS;
+
+        if (Offsets[(Source[0].Hash >> Shift) & (DIFF_RADIX_SIZE - 1)] == Count) {
+            continue; //这一位都一样。
+        }
+
+        ULONG Sum = 0;
+        for (ULONG Digit = 0; Digit < DIFF_RADIX_SIZE; Digit++) {
+            ULONG n = Offsets[Digit];
+            Offsets[Digit] = Sum;
+            Sum += n;
+        }
+
+        for (ULONG i = 0; i < Count; i++) {
+            Target[Offsets[(Source[i].Hash >> Shift) & (DIFF_RADIX_SIZE - 1)]++] = Source[i];
+        }
+
+        PDIFF_KEY Temp = Source;
+        Source = Target;
+        Target = Temp;
+    }
+
+    if (Source != Keys) {
+        RtlCopyMemory(Keys, Source, (SIZE_T)Count * sizeof(DIFF_KEY));
+    }
+
+    InsertionSort(Keys, Count);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//事件。
+
+
+static void Flush(_Inout_ PTABLE_DIFF Diff)
+{
+    if (Diff->Pending && ERROR_SUCCESS == Diff->Status) {
+        Diff->Status = Diff->Callback(Diff->Context, Diff->Batch, Diff->Pending);
+    }
+
+    Diff->Pending = 0;
+}
+
+
+static PTABLE_DIFF_EVENT NewEvent(_Inout_ PTABLE_DIFF Diff, _In_ ULONG Type, _In_ UINT64 Key)
+/*
+功能：批里的下一个事件，没有回调（或者回调已经中止）的返回nullptr。
+*/
+{
+    if (nullptr == Diff->Callback || ERROR_SUCCESS != Diff->Status) {
+        return nullptr;
+    }
+
+    if (TABLE_DIFF_BATCH == Diff->Pending) {
+        Flush(Diff);
+        if (ERROR_SUCCESS != Diff->Status) {
+            return nullptr;
+        }
+    }
+
+    PTABLE_DIFF_EVENT Event = &Diff->Batch[Diff->Pending++];
+    RtlZeroMemory(Event, sizeof(TABLE_DIFF_EVENT));
+    Event->Type = Type;
+    Event->Key = Key;
+
+    switch (Type) {
+    case TABLE_DIFF_OPENED:
+        Diff->Opened++;
+        break;
+    case TABLE_DIFF_CLOSED:
+        Diff->Closed++;
+        break;
+    default:
+        Diff->Changed++;
+        break;
+    }
+
+    return Event;
+}
+
+
+static void GetNewRow(_In_ PTABLE_DIFF Diff, _In_ ULONG New, _Out_ PTABLE_DIFF_ROW Row)
+/*
+功能：这次的（排序后的）第New行。
+*/
+{
+    if (Diff->NewRows) {
+        *Row = Diff->NewRows[New];
+    } else {
+        const UCHAR * Rows = reinterpret_cast<const UCHAR *>(Diff->Snapshot->Rows);
+        Diff->Normalize(Rows + (SIZE_T)Diff->Keys[New].Index * Diff->Snapshot->RowSize, Row);
+    }
+}
+
+
+static void EmitOpened(_Inout_ PTABLE_DIFF Diff, _In_ ULONG New)
+{
+    PTABLE_DIFF_EVENT Event = NewEvent(Diff, TABLE_DIFF_OPENED, Diff->Keys[New].Hash);
+    if (Event) {
+        GetNewRow(Diff, New, &Event->Row);
+    }
+}
+
+
+static void EmitClosed(_Inout_ PTABLE_DIFF Diff, _In_ ULONG Old)
+{
+    const DIFF_SAVED * Saved = &Diff->Saved[Old];
+    PTABLE_DIFF_EVENT Event = NewEvent(Diff, TABLE_DIFF_CLOSED, Saved->Hash);
+    if (Event) {
+        Event->OldState = Saved->State & ~DIFF_MATCHED;
+        Event->OldPid = Saved->Pid;
+        if (Diff->Rows) {
+            Event->Row = Diff->Rows[Old];
+        } else {
+            Event->Row.State = Event->OldState;
+            Event->Row.OwningPid = Event->OldPid;
+        }
+    }
+}
+
+
+static BOOL Pair(_Inout_ PTABLE_DIFF Diff, _In_ ULONG Old, _In_ ULONG New)
+/*
+功能：上一次的第Old行和这次的第New行是同一个连接，状态或者PID不同的给出变化的事件。
+
+返回值：FALSE是哈希冲突（只有完整的模式才能发现），调用者应当当作不同的连接。
+*/
+{
+    const DIFF_SAVED * Saved = &Diff->Saved[Old];
+    const DIFF_KEY * Key = &Diff->Keys[New];
+
+    if (Diff->Rows && !SameKey(&Diff->Rows[Old], &Diff->NewRows[New])) {
+        return FALSE;
+    }
+
+    ULONG OldState = Saved->State & ~DIFF_MATCHED;
+    ULONG NewState = Diff->States[New] & ~DIFF_MATCHED;
+    ULONG Changes = 0;
+
+    if (OldState != NewState) {
+        Changes |= TABLE_DIFF_STATE_CHANGED;
+    }
+
+    if (Saved->Pid != Key->Pid) {
+        Changes |= TABLE_DIFF_PID_CHANGED;
+    }
+
+    if (Changes) {
+        PTABLE_DIFF_EVENT Event = NewEvent(Diff, TABLE_DIFF_CHANGED, Key->Hash);
+        if (Event) {
+            Event->Changes = Changes;
+            Event->OldState = OldState;
+            Event->OldPid = Saved->Pid;
+            GetNewRow(Diff, New, &Event->Row);
+        }
+    }
+
+    return TRUE;
+}
+
+
+static void MatchRun(_Inout_ PTABLE_DIFF Diff,
+                     _In_ ULONG OldBegin,
+                     _In_ ULONG OldEnd,
+                     _In_ ULONG NewBegin,
+                     _In_ ULONG NewEnd)
+/*
+功能：哈希相同的一段（同一个四元组的多行）的配对。
+
+1.PID相同的配对（两边都按PID有序，归并）。
+2.剩下的依次配对，是PID的变化。
+3.再剩下的是关闭或者打开的。
+*/
+{
+    for (ULONG i = OldBegin, j = NewBegin; i < OldEnd && j < NewEnd;) {
+        ULONG Pid = Diff->Keys[j].Pid;
+
+        if (Diff->Saved[i].Pid < Pid) {
+            i++;
+        } else if (Diff->Saved[i].Pid > Pid) {
+            j++;
+        } else {
+            if (Pair(Diff, i, j)) {
+                Diff->Saved[i].State |= DIFF_MATCHED;
+                Diff->States[j] |= DIFF_MATCHED;
+            }
+
+            i++;
+            j++;
+        }
+    }
+
+    ULONG i = OldBegin;
+    ULONG j = NewBegin;
+    for (;;) {
+        while (i < OldEnd && (Diff->Saved[i].State & DIFF_MATCHED)) {
+            i++;
+        }
+
+        while (j < NewEnd && (Diff->States[j] & DIFF_MATCHED)) {
+            j++;
+        }
+
+        if (i == OldEnd || j == NewEnd) {
+            break;
+        }
+
+        if (!Pair(Diff, i, j)) { //哈希冲突。
+            EmitClosed(Diff, i);
+            EmitOpened(Diff, j);
+        }
+
+        i++;
+        j++;
+    }
+
+    for (; i < OldEnd; i++) {
+        if (!(Diff->Saved[i].State & DIFF_MATCHED)) {
+            EmitClosed(Diff, i);
+        }
+    }
+
+    for (; j < NewEnd; j++) {
+        if (!(Diff->States[j] & DIFF_MATCHED)) {
+            EmitOpened(Diff, j);
+        }
+    }
+}
+
+
+static void Merge(_Inout_ PTABLE_DIFF Diff, _In_ ULONG Count)
+/*
+功能：上一次的（Diff->Saved）和这次的（排序后的Diff->Keys）归并。
+*/
+{
+    ULONG i = 0;
+    ULONG j = 0;
+
+    while (i < Diff->Count || j < Count) {
+        if (j == Count || (i < Diff->Count && Diff->Saved[i].Hash < Diff->Keys[j].Hash)) {
+            EmitClosed(Diff, i++);
+            continue;
+        }
+
+        if (i == Diff->Count || Diff->Keys[j].Hash < Diff->Saved[i].Hash) {
+            EmitOpened(Diff, j++);
+            continue;
+        }
+
+        ULONG OldEnd = i + 1;
+        ULONG NewEnd = j + 1;
+        while (OldEnd < Diff->Count && Diff->Saved[OldEnd].Hash == Diff->Saved[i].Hash) {
+            OldEnd++;
+        }
+
+        while (NewEnd < Count && Diff->Keys[NewEnd].Hash == Diff->Keys[j].Hash) {
+            NewEnd++;
+        }
+
+        if (OldEnd - i == 1 && NewEnd - j == 1) {
+            if (!Pair(Diff, i, j)) {
+                EmitClosed(Diff, i);
+                EmitOpened(Diff, j);
+            }
+        } else {
+            MatchRun(Diff, i, OldEnd, j, NewEnd);
+        }
+
+        i = OldEnd;
+        j = NewEnd;
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//内存。
+
+
+static ULONG Reserve(_Inout_ PVOID * Buffer, _In_ ULONG Count, _In_ SIZE_T Size)
+{
+    if (*Buffer) {
+        FREE(*Buffer);
+    }
+
+    *Buffer = MALLOC(max((SIZE_T)Count * Size, (SIZE_T)1));
+    return *Buffer ? ERROR_SUCCESS : ERROR_NOT_ENOUGH_MEMORY;
+}
+
+
+static ULONG ReserveRows(_Inout_ PTABLE_DIFF_ROW * Rows, _Inout_ PULONG Capacity, _In_ ULONG Count)
+/*
+功能：完整的行的缓冲区（只增不减，多留1/4）。Rows和NewRows每次交换，各自记着大小。
+*/
+{
+    if (Count <= *Capacity) {
+        return ERROR_SUCCESS;
+    }
+
+    UINT64 NewCapacity = (UINT64)Count + Count / 4;
+    *Capacity = 0;
+
+    ULONG Status = Reserve(reinterpret_cast<PVOID *>(Rows), (ULONG)NewCapacity, sizeof(TABLE_DIFF_ROW));
+    if (ERROR_SUCCESS == Status) {
+        *Capacity = (ULONG)NewCapacity;
+    }
+
+    return Status;
+}
+
+
+static ULONG ReserveWork(_Inout_ PTABLE_DIFF Diff, _In_ ULONG Count)
+/*
+功能：这次的表用的缓冲区（只增不减，多留1/4）。
+*/
+{
+    if ((UINT64)Count + Count / 4 > MAXULONG / sizeof(TABLE_DIFF_ROW)) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    if (!(Diff->Flags & TABLE_DIFF_COMPACT)) {
+        ULONG Status = ReserveRows(&Diff->NewRows, &Diff->NewRowsCapacity, Count);
+        if (ERROR_SUCCESS != Status) {
+            return Status;
+        }
+    }
+
+    if (Count <= Diff->Capacity) {
+        return ERROR_SUCCESS;
+    }
+
+    UINT64 Capacity = (UINT64)Count + Count / 4;
+    Diff->Capacity = 0;
+
+    ULONG Status = Reserve(reinterpret_cast<PVOID *>(&Diff->Keys), (ULONG)Capacity, sizeof(DIFF_KEY));
+    if (ERROR_SUCCESS == Status) {
+        Status = Reserve(reinterpret_cast<PVOID *>(&Diff->Scratch), (ULONG)Capacity, sizeof(DIFF_KEY));
+    }
+
+    if (ERROR_SUCCESS == Status) {
+        Status = Reserve(reinterpret_cast<PVOID *>(&Diff->States), (ULONG)Capacity, sizeof(ULONG));
+    }
+
+    if (ERROR_SUCCESS == Status) {
+        Diff->Capacity = (ULONG)Capacity;
+    }
+
+    return Status;
+}
+
+
+static ULONG ReserveSaved(_Inout_ PTABLE_DIFF Diff, _In_ ULONG Count)
+{
+    if (Count <= Diff->SavedCapacity) {
+        return ERROR_SUCCESS;
+    }
+
+    UINT64 Capacity = (UINT64)Count + Count / 4;
+    Diff->SavedCapacity = 0;
+    Diff->Count = 0;
+
+    ULONG Status = Reserve(reinterpret_cast<PVOID *>(&Diff->Saved), (ULONG)Capacity, sizeof(DIFF_SAVED));
+    if (ERROR_SUCCESS == Status) {
+        Diff->SavedCapacity = (ULONG)Capacity;
+    }
+
+    return Status;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI TableDiffCreate(_In_ ULONG Flags, _Out_ PTABLE_DIFF * Diff)
+/*
+功能：创建一个连接表的增量的对象。
+
+参数：
+Flags：0或者TABLE_DIFF_COMPACT。
+
+注意：用TableDiffDestroy释放。
+*/
+{
+    *Diff = nullptr;
+
+    if (Flags & ~TABLE_DIFF_COMPACT) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    auto Result = reinterpret_cast<PTABLE_DIFF>(MALLOC(sizeof(TABLE_DIFF)));
+    if (nullptr == Result) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    Result->Flags = Flags;
+    *Diff = Result;
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI TableDiffDestroy(_In_opt_ PTABLE_DIFF Diff)
+{
+    if (nullptr == Diff) {
+        return;
+    }
+
+    PVOID Buffers[] = {Diff->Saved, Diff->Rows, Diff->Keys, Diff->Scratch, Diff->States, Diff->NewRows};
+    for (ULONG i = 0; i < _countof(Buffers); i++) {
+        if (Buffers[i]) {
+            FREE(Buffers[i]);
+        }
+    }
+
+    FREE(Diff);
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI TableDiffUpdate(_In_ PTABLE_DIFF Diff,
+                             _In_ const TABLE_SNAPSHOT * Snapshot,
+                             _In_opt_ TABLE_DIFF_CALLBACK Callback,
+                             _In_opt_ PVOID Context)
+/*
+功能：把快照和上一次的比较，给出打开，关闭和变化的连接，然后记下这个快照（的键）作为下一次比较的基准。
+
+参数：
+Snapshot：刷新成功的快照（Rows不是nullptr）。不要求排序（Order）。
+Callback：nullptr的只记下基准，不给出事件（如第一次）。
+
+返回值：ERROR_SUCCESS，ERROR_INVALID_PARAMETER，ERROR_NOT_SUPPORTED（不支持的表），
+ERROR_NOT_ENOUGH_MEMORY（这时基准变为空的，下次的都是打开的），或者回调返回的值。
+
+注意：
+1.第一次的（没有基准时）每一行都是打开的。
+2.可以混用不同的表（如TCP和UDP），但是键不同，会给出全部关闭和全部打开。
+3.一次调用内回调的Events只在回调期间有效。
+*/
+{
+    if (nullptr == Snapshot->Rows) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    DIFF_NORMALIZE Normalize = GetNormalize(Snapshot);
+    if (nullptr == Normalize) {
+        return ERROR_NOT_SUPPORTED;
+    }
+
+    ULONG Count = Snapshot->Count;
+    ULONG Status = ReserveWork(Diff, Count);
+    if (ERROR_SUCCESS != Status) {
+        return Status;
+    }
+
+    //统一，哈希，排序。
+    const UCHAR * Rows = reinterpret_cast<const UCHAR *>(Snapshot->Rows);
+    for (ULONG i = 0; i < Count; i++) {
+        TABLE_DIFF_ROW Normalized;
+
+        Normalize(Rows + (SIZE_T)i * Snapshot->RowSize, &Normalized);
+        Diff->Keys[i].Hash = HashRow(&Normalized);
+        Diff->Keys[i].Pid = Normalized.OwningPid;
+        Diff->Keys[i].Index = i;
+    }
+
+    SortKeys(Diff, Count);
+
+    //按排序后的顺序取出状态（和完整的行），后面都是顺序访问。
+    for (ULONG k = 0; k < Count; k++) {
+        TABLE_DIFF_ROW Local;
+        PTABLE_DIFF_ROW Normalized = Diff->NewRows ? &Diff->NewRows[k] : &Local;
+
+        Normalize(Rows + (SIZE_T)Diff->Keys[k].Index * Snapshot->RowSize, Normalized);
+        Diff->States[k] = Normalized->State & ~DIFF_MATCHED;
+    }
+
+    Diff->Snapshot = Snapshot;
+    Diff->Normalize = Normalize;
+    Diff->Callback = Callback;
+    Diff->Context = Context;
+    Diff->Status = ERROR_SUCCESS;
+    Diff->Pending = 0;
+
+    Merge(Diff, Count);
+    if (Callback) {
+        Flush(Diff);
+    }
+
+    //记下这次的。
+    Status = ReserveSaved(Diff, Count);
+    if (ERROR_SUCCESS != Status) {
+        return Status;
+    }
+
+    for (ULONG k = 0; k < Count; k++) {
+        Diff->Saved[k].Hash = Diff->Keys[k].Hash;
+        Diff->Saved[k].Pid = Diff->Keys[k].Pid;
+        Diff->Saved[k].State = Diff->States[k] & ~DIFF_MATCHED;
+    }
+
+    if (Diff->NewRows) {
+        PTABLE_DIFF_ROW Temp = Diff->Rows;
+        ULONG TempCapacity = Diff->RowsCapacity;
+
+        Diff->Rows = Diff->NewRows;
+        Diff->RowsCapacity = Diff->NewRowsCapacity;
+        Diff->NewRows = Temp;
+        Diff->NewRowsCapacity = TempCapacity;
+    }
+
+    Diff->Count = Count;
+    Diff->Updates++;
+    Diff->Snapshot = nullptr;
+    return Diff->Status;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI TableDiffCompare(_In_ const TABLE_SNAPSHOT * Old,
+                              _In_ const TABLE_SNAPSHOT * New,
+                              _In_ TABLE_DIFF_CALLBACK Callback,
+                              _In_opt_ PVOID Context)
+/*
+功能：比较两个快照，相当于一个临时的TABLE_DIFF先后更新Old和New。
+
+注意：连续轮询的应当用TableDiffUpdate，每次只处理新的快照。
+*/
+{
+    PTABLE_DIFF Diff = nullptr;
+    ULONG Status = TableDiffCreate(0, &Diff);
+    if (ERROR_SUCCESS != Status) {
+        return Status;
+    }
+
+    Status = TableDiffUpdate(Diff, Old, nullptr, nullptr);
+    if (ERROR_SUCCESS == Status) {
+        Status = TableDiffUpdate(Diff, New, Callback, Context);
+    }
+
+    TableDiffDestroy(Diff);
+    return Status;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI TableDiffGetRow(_In_ const TABLE_SNAPSHOT * Snapshot, _In_ ULONG Index, _Out_ PTABLE_DIFF_ROW Row)
+/*
+功能：快照的第Index行的统一的格式。
+*/
+{
+    RtlZeroMemory(Row, sizeof(TABLE_DIFF_ROW));
+
+    if (nullptr == Snapshot->Rows || Index >= Snapshot->Count) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    DIFF_NORMALIZE Normalize = GetNormalize(Snapshot);
+    if (nullptr == Normalize) {
+        return ERROR_NOT_SUPPORTED;
+    }
+
+    Normalize(reinterpret_cast<const UCHAR *>(Snapshot->Rows) + (SIZE_T)Index * Snapshot->RowSize, Row);
+    return ERROR_SUCCESS;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI TableDiffGetInformation(_In_ PTABLE_DIFF Diff, _Out_ PTABLE_DIFF_INFORMATION Information)
+{
+    RtlZeroMemory(Information, sizeof(TABLE_DIFF_INFORMATION));
+
+    Information->Rows = Diff->Count;
+    Information->Updates = Diff->Updates;
+    Information->Opened = Diff->Opened;
+    Information->Closed = Diff->Closed;
+    Information->Changed = Diff->Changed;
+    Information->Bytes = sizeof(TABLE_DIFF) + (SIZE_T)Diff->SavedCapacity * sizeof(DIFF_SAVED) +
+                         (SIZE_T)Diff->Capacity * (2 * sizeof(DIFF_KEY) + sizeof(ULONG)) +
+                         ((SIZE_T)Diff->RowsCapacity + Diff->NewRowsCapacity) * sizeof(TABLE_DIFF_ROW);
+}
+
+
+static void PrintEndpoint(_In_ FILE * File,
+                          _In_ ADDRESS_FAMILY Family,
+                          _In_reads_(16) const UINT8 * Address,
+                          _In_ USHORT Port)
+{
+    char Text[INET6_ADDRSTRLEN]{};
+
+    InetNtopA(Family, Address, Text, sizeof(Text));
+    fprintf(File, AF_INET6 == Family ? "[%s]:%u" : "%s:%u", Text, Port);
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI TableDiffPrint(_In_opt_ PVOID Context,
+                            _In_reads_(Count) const TABLE_DIFF_EVENT * Events,
+                            _In_ ULONG Count)
+/*
+功能：打印事件的TABLE_DIFF_CALLBACK，一个事件一行。
+
+参数：
+Context：FILE *，nullptr的是stdout。
+
+注意：状态的名字同PrintTcpConnectionState。
+*/
+{
+    FILE * File = Context ? reinterpret_cast<FILE *>(Context) : stdout;
+
+    for (ULONG i = 0; i < Count; i++) {
+        const TABLE_DIFF_EVENT * Event = &Events[i];
+        const TABLE_DIFF_ROW * Row = &Event->Row;
+        PCSTR Type = TABLE_DIFF_OPENED == Event->Type   ? "OPENED"
+                     : TABLE_DIFF_CLOSED == Event->Type ? "CLOSED"
+                                                        : "CHANGED";
+
+        if (AF_UNSPEC == Row->Family) { // TABLE_DIFF_COMPACT的关闭的。
+            fprintf(File, "%-7s key:%016llx pid:%u\n", Type, Event->Key, Event->OldPid);
+            continue;
+        }
+
+        fprintf(File, "%-7s %s ", Type, IPPROTO_TCP == Row->Protocol ? "TCP" : "UDP");
+        PrintEndpoint(File, Row->Family, Row->LocalAddress, Row->LocalPort);
+        if (IPPROTO_TCP == Row->Protocol) {
+            fprintf(File, " -> ");
+            PrintEndpoint(File, Row->Family, Row->RemoteAddress, Row->RemotePort);
+
+            PCSTR State = GetTcpConnectionStateName(Row->State);
+            if (Event->Changes & TABLE_DIFF_STATE_CHANGED) {
+                PCSTR OldState = GetTcpConnectionStateName(Event->OldState);
+                fprintf(File, " %s -> %s", OldState ? OldState : "UNKNOWN", State ? State : "UNKNOWN");
+            } else {
+                fprintf(File, " %s", State ? State : "UNKNOWN");
+            }
+        }
+
+        if (Event->Changes & TABLE_DIFF_PID_CHANGED) {
+            fprintf(File, " pid:%u -> %u\n", Event->OldPid, Row->OwningPid);
+        } else {
+            fprintf(File, " pid:%u\n", Row->OwningPid);
+        }
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,107 @@
+﻿#pragma once
+
+#include "pch.h"
+#include "TableSnapshot.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+typedef struct _TABLE_DIFF TABLE_DIFF, * PTABLE_DIFF; //连接表的增量，见TableDiffUpdate。不是线程安全的。
+
+
+// TableDiffCreate的Flags。
+#define TABLE_DIFF_COMPACT 0x1 //每行只保存16字节（键的哈希，PID，状态），关闭的事件没有地址和端口。
+
+// TABLE_DIFF_EVENT的Type。
+#define TABLE_DIFF_OPENED  1
+#define TABLE_DIFF_CLOSED  2
+#define TABLE_DIFF_CHANGED 3
+
+// TABLE_DIFF_EVENT的Changes。
+#define TABLE_DIFF_STATE_CHANGED 0x1 // TCP的状态（MIB_TCP_STATE）变了。
+#define TABLE_DIFF_PID_CHANGED   0x2 //同一个四元组的所属进程变了。
+
+#define TABLE_DIFF_BATCH 256 //回调一次最多的事件数。
+
+
+//各种表的行统一后的格式。端口是主机字节序；IPv4的地址在前4个字节，其余是0。
+typedef struct _TABLE_DIFF_ROW {
+    ADDRESS_FAMILY Family; // AF_INET或AF_INET6，TABLE_DIFF_COMPACT的关闭的事件是AF_UNSPEC。
+    UINT8 Protocol;        // IPPROTO_TCP或IPPROTO_UDP。
+    UINT8 Reserved;
+    USHORT LocalPort;
+    USHORT RemotePort;     // UDP的是0。
+    ULONG State;           // TCP的MIB_TCP_STATE，UDP的是0。
+    ULONG OwningPid;       //没有进程信息的表（GetTcpTable等）是0。
+    UINT8 LocalAddress[16];
+    UINT8 RemoteAddress[16];
+} TABLE_DIFF_ROW, * PTABLE_DIFF_ROW;
+
+
+typedef struct _TABLE_DIFF_EVENT {
+    ULONG Type;
+    ULONG Changes;     // TABLE_DIFF_CHANGED的TABLE_DIFF_STATE_CHANGED等。
+    ULONG OldState;    // TABLE_DIFF_CHANGED和TABLE_DIFF_CLOSED的原来的状态和PID。
+    ULONG OldPid;
+    UINT64 Key;        //四元组（和协议）的哈希，同一个连接的各个事件的相同。
+    TABLE_DIFF_ROW Row; //打开和变化的是现在的行，关闭的是原来的行。
+} TABLE_DIFF_EVENT, * PTABLE_DIFF_EVENT;
+
+
+//返回ERROR_SUCCESS以外的值会中止这次比较（TableDiffUpdate返回这个值，但是已经记下了新的表）。
+typedef ULONG(WINAPI * TABLE_DIFF_CALLBACK)(_In_opt_ PVOID Context,
+                                            _In_reads_(Count) const TABLE_DIFF_EVENT * Events,
+                                            _In_ ULONG Count);
+
+
+typedef struct _TABLE_DIFF_INFORMATION {
+    ULONG Rows;      //记下的（上一次的）表的行数。
+    ULONG Updates;
+    UINT64 Opened;   //累计的各类事件的个数。
+    UINT64 Closed;
+    UINT64 Changed;
+    SIZE_T Bytes;    //占用的内存。
+} TABLE_DIFF_INFORMATION, * PTABLE_DIFF_INFORMATION;
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C_START
+
+
+DLLEXPORT
+ULONG WINAPI TableDiffCreate(_In_ ULONG Flags, _Out_ PTABLE_DIFF * Diff);
+
+DLLEXPORT
+void WINAPI TableDiffDestroy(_In_opt_ PTABLE_DIFF Diff);
+
+DLLEXPORT
+ULONG WINAPI TableDiffUpdate(_In_ PTABLE_DIFF Diff,
+                             _In_ const TABLE_SNAPSHOT * Snapshot,
+                             _In_opt_ TABLE_DIFF_CALLBACK Callback,
+                             _In_opt_ PVOID Context);
+
+DLLEXPORT
+ULONG WINAPI TableDiffCompare(_In_ const TABLE_SNAPSHOT * Old,
+                              _In_ const TABLE_SNAPSHOT * New,
+                              _In_ TABLE_DIFF_CALLBACK Callback,
+                              _In_opt_ PVOID Context);
+
+DLLEXPORT
+ULONG WINAPI TableDiffGetRow(_In_ const TABLE_SNAPSHOT * Snapshot, _In_ ULONG Index, _Out_ PTABLE_DIFF_ROW Row);
+
+DLLEXPORT
+void WINAPI TableDiffGetInformation(_In_ PTABLE_DIFF Diff, _Out_ PTABLE_DIFF_INFORMATION Information);
+
+DLLEXPORT
+ULONG WINAPI TableDiffPrint(_In_opt_ PVOID Context,
+                            _In_reads_(Count) const TABLE_DIFF_EVENT * Events,
+                            _In_ ULONG Count);
+
+
+EXTERN_C_END
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
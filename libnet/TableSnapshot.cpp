@@ -0,0 +1,380 @@
+﻿#include "pch.h"
+#include "TableSnapshot.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/*
+TCP/UDP的连接表（侦听表）的可重用的快照。
+
+原来的EnumTcpTable等每次都是：申请一个表头大小的内存，调用一次得到ERROR_INSUFFICIENT_BUFFER和需要的大小，
+释放，再按这个大小申请，再调用一次。每100毫秒轮询一次，有几十万个套接字的机器上，
+大块内存的申请和释放（缺页）和两次系统调用的开销是可以测出来的。
+
+这里的做法：
+1.缓冲区只增不减，跨调用保留。增大时按需要的大小多留1/4（至少若干行），表稍有增长不用重新申请。
+2.表在两次调用之间变大（ERROR_INSUFFICIENT_BUFFER）时，按新的大小增大后重试，最多TABLE_SNAPSHOT_MAX_TRIES次。
+3.不打印，只给出行的指针，行数和行的大小；C++的可以用TableSnapshotRows按类型访问。
+4.缓冲区会被API整个覆盖，所以申请时不清零（不用MALLOC），少碰没用到的页。
+
+参考：
+https://docs.microsoft.com/en-us/windows/win32/api/iphlpapi/nf-iphlpapi-getextendedtcptable
+https://docs.microsoft.com/en-us/windows/win32/api/iphlpapi/nf-iphlpapi-getextendedudptable
+*/
+
+
+#define TABLE_SNAPSHOT_INITIAL_SIZE   (16 * 1024) //第一次刷新前的大小，一般的机器一次就够了。
+#define TABLE_SNAPSHOT_HEADROOM_SHIFT 2           //多留需要的大小的1/4。
+#define TABLE_SNAPSHOT_HEADROOM_ROWS  64          //至少多留这么多行。
+#define TABLE_SNAPSHOT_ALIGNMENT      4096
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//表的布局。
+
+
+static ULONG GetTcpExtendedLayout(_In_ ULONG Family,
+                                  _In_ ULONG Class,
+                                  _Out_ PULONG RowSize,
+                                  _Out_ PULONG RowOffset)
+{
+    switch (Class) {
+    case TCP_TABLE_BASIC_LISTENER:
+    case TCP_TABLE_BASIC_CONNECTIONS:
+    case TCP_TABLE_BASIC_ALL:
+        if (AF_INET6 == Family) {
+            return ERROR_NOT_SUPPORTED; // GetExtendedTcpTable也不支持。
+        }
+
+        *RowSize = sizeof(MIB_TCPROW);
+        *RowOffset = FIELD_OFFSET(MIB_TCPTABLE, table);
+        return ERROR_SUCCESS;
+    case TCP_TABLE_OWNER_PID_LISTENER:
+    case TCP_TABLE_OWNER_PID_CONNECTIONS:
+    case TCP_TABLE_OWNER_PID_ALL:
+        if (AF_INET6 == Family) {
+            *RowSize = sizeof(MIB_TCP6ROW_OWNER_PID);
+            *RowOffset = FIELD_OFFSET(MIB_TCP6TABLE_OWNER_PID, table);
+        } else {
+            *RowSize = sizeof(MIB_TCPROW_OWNER_PID);
+            *RowOffset = FIELD_OFFSET(MIB_TCPTABLE_OWNER_PID, table);
+        }
+
+        return ERROR_SUCCESS;
+    case TCP_TABLE_OWNER_MODULE_LISTENER:
+    case TCP_TABLE_OWNER_MODULE_CONNECTIONS:
+    case TCP_TABLE_OWNER_MODULE_ALL:
+        if (AF_INET6 == Family) {
+            *RowSize = sizeof(MIB_TCP6ROW_OWNER_MODULE);
+            *RowOffset = FIELD_OFFSET(MIB_TCP6TABLE_OWNER_MODULE, table);
+        } else {
+            *RowSize = sizeof(MIB_TCPROW_OWNER_MODULE);
+            *RowOffset = FIELD_OFFSET(MIB_TCPTABLE_OWNER_MODULE, table);
+        }
+
+        return ERROR_SUCCESS;
+    default:
+        return ERROR_INVALID_PARAMETER;
+    }
+}
+
+
+static ULONG GetUdpExtendedLayout(_In_ ULONG Family,
+                                  _In_ ULONG Class,
+                                  _Out_ PULONG RowSize,
+                                  _Out_ PULONG RowOffset)
+{
+    switch (Class) {
+    case UDP_TABLE_BASIC:
+        if (AF_INET6 == Family) {
+            *RowSize = sizeof(MIB_UDP6ROW);
+            *RowOffset = FIELD_OFFSET(MIB_UDP6TABLE, table);
+        } else {
+            *RowSize = sizeof(MIB_UDPROW);
+            *RowOffset = FIELD_OFFSET(MIB_UDPTABLE, table);
+        }
+
+        return ERROR_SUCCESS;
+    case UDP_TABLE_OWNER_PID:
+        if (AF_INET6 == Family) {
+            *RowSize = sizeof(MIB_UDP6ROW_OWNER_PID);
+            *RowOffset = FIELD_OFFSET(MIB_UDP6TABLE_OWNER_PID, table);
+        } else {
+            *RowSize = sizeof(MIB_UDPROW_OWNER_PID);
+            *RowOffset = FIELD_OFFSET(MIB_UDPTABLE_OWNER_PID, table);
+        }
+
+        return ERROR_SUCCESS;
+    case UDP_TABLE_OWNER_MODULE:
+        if (AF_INET6 == Family) {
+            *RowSize = sizeof(MIB_UDP6ROW_OWNER_MODULE);
+            *RowOffset = FIELD_OFFSET(MIB_UDP6TABLE_OWNER_MODULE, table);
+        } else {
+            *RowSize = sizeof(MIB_UDPROW_OWNER_MODULE);
+            *RowOffset = FIELD_OFFSET(MIB_UDPTABLE_OWNER_MODULE, table);
+        }
+
+        return ERROR_SUCCESS;
+    default:
+        return ERROR_INVALID_PARAMETER;
+    }
+}
+
+
+static ULONG GetLayout(_In_ const TABLE_SNAPSHOT * Snapshot, _Out_ PULONG RowSize, _Out_ PULONG RowOffset)
+/*
+功能：行的大小和第一行在表里的偏移（有的行有8字节对齐的成员，偏移不是4）。
+*/
+{
+    *RowSize = 0;
+    *RowOffset = 0;
+
+    if ((TABLE_SNAPSHOT_TCP_EXTENDED == Snapshot->Kind || TABLE_SNAPSHOT_UDP_EXTENDED == Snapshot->Kind) &&
+        AF_INET != Snapshot->Family && AF_INET6 != Snapshot->Family) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    switch (Snapshot->Kind) {
+    case TABLE_SNAPSHOT_TCP:
+        *RowSize = sizeof(MIB_TCPROW);
+        *RowOffset = FIELD_OFFSET(MIB_TCPTABLE, table);
+        return ERROR_SUCCESS;
+    case TABLE_SNAPSHOT_TCP2:
+        *RowSize = sizeof(MIB_TCPROW2);
+        *RowOffset = FIELD_OFFSET(MIB_TCPTABLE2, table);
+        return ERROR_SUCCESS;
+    case TABLE_SNAPSHOT_TCP6:
+        *RowSize = sizeof(MIB_TCP6ROW);
+        *RowOffset = FIELD_OFFSET(MIB_TCP6TABLE, table);
+        return ERROR_SUCCESS;
+    case TABLE_SNAPSHOT_TCP6_2:
+        *RowSize = sizeof(MIB_TCP6ROW2);
+        *RowOffset = FIELD_OFFSET(MIB_TCP6TABLE2, table);
+        return ERROR_SUCCESS;
+    case TABLE_SNAPSHOT_TCP_EXTENDED:
+        return GetTcpExtendedLayout(Snapshot->Family, Snapshot->Class, RowSize, RowOffset);
+    case TABLE_SNAPSHOT_UDP:
+        *RowSize = sizeof(MIB_UDPROW);
+        *RowOffset = FIELD_OFFSET(MIB_UDPTABLE, table);
+        return ERROR_SUCCESS;
+    case TABLE_SNAPSHOT_UDP6:
+        *RowSize = sizeof(MIB_UDP6ROW);
+        *RowOffset = FIELD_OFFSET(MIB_UDP6TABLE, table);
+        return ERROR_SUCCESS;
+    case TABLE_SNAPSHOT_UDP_EXTENDED:
+        return GetUdpExtendedLayout(Snapshot->Family, Snapshot->Class, RowSize, RowOffset);
+    default:
+        return ERROR_INVALID_PARAMETER;
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//缓冲区和调用。
+
+
+static ULONG Grow(_Inout_ PTABLE_SNAPSHOT Snapshot, _In_ ULONGLONG Size)
+/*
+功能：把缓冲区增大到至少Size（按页对齐）。原来的内容不保留（反正要重新调用）。
+*/
+{
+    if (Size <= Snapshot->Capacity) {
+        return ERROR_SUCCESS;
+    }
+
+    Size = (Size + TABLE_SNAPSHOT_ALIGNMENT - 1) & ~(ULONGLONG)(TABLE_SNAPSHOT_ALIGNMENT - 1);
+    if (Size > MAXULONG) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    if (Snapshot->Buffer) {
+        FREE(Snapshot->Buffer);
+        Snapshot->Buffer = nullptr;
+        Snapshot->Capacity = 0;
+    }
+
+    Snapshot->Buffer = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)Size);
+    if (nullptr == Snapshot->Buffer) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    Snapshot->Capacity = (ULONG)Size;
+    Snapshot->Grows++;
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG QueryTable(_In_ const TABLE_SNAPSHOT * Snapshot, _Inout_ PULONG Size)
+{
+    PVOID Buffer = Snapshot->Buffer;
+    BOOL Order = Snapshot->Order;
+
+#pragma prefast(push)
+#pragma prefast(disable : 28020, "表达式“*_Param_(2)>=sizeof(MIB_TCPTABLE)”对此调用无效")
+    switch (Snapshot->Kind) {
+    case TABLE_SNAPSHOT_TCP:
+        return GetTcpTable(reinterpret_cast<PMIB_TCPTABLE>(Buffer), Size, Order);
+    case TABLE_SNAPSHOT_TCP2:
+        return GetTcpTable2(reinterpret_cast<PMIB_TCPTABLE2>(Buffer), Size, Order);
+    case TABLE_SNAPSHOT_TCP6:
+        return GetTcp6Table(reinterpret_cast<PMIB_TCP6TABLE>(Buffer), Size, Order);
+    case TABLE_SNAPSHOT_TCP6_2:
+        return GetTcp6Table2(reinterpret_cast<PMIB_TCP6TABLE2>(Buffer), Size, Order);
+    case TABLE_SNAPSHOT_TCP_EXTENDED:
+        return GetExtendedTcpTable(Buffer, Size, Order, Snapshot->Family, (TCP_TABLE_CLASS)Snapshot->Class, 0);
+    case TABLE_SNAPSHOT_UDP:
+        return GetUdpTable(reinterpret_cast<PMIB_UDPTABLE>(Buffer), Size, Order);
+    case TABLE_SNAPSHOT_UDP6:
+        return GetUdp6Table(reinterpret_cast<PMIB_UDP6TABLE>(Buffer), Size, Order);
+    case TABLE_SNAPSHOT_UDP_EXTENDED:
+        return GetExtendedUdpTable(Buffer, Size, Order, Snapshot->Family, (UDP_TABLE_CLASS)Snapshot->Class, 0);
+    default:
+        return ERROR_INVALID_PARAMETER;
+    }
+#pragma prefast(pop)
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI TableSnapshotInit(_Out_ PTABLE_SNAPSHOT Snapshot,
+                               _In_ ULONG Kind,
+                               _In_ ULONG Family,
+                               _In_ ULONG Class,
+                               _In_ BOOL Order)
+/*
+功能：初始化一个快照，不申请内存。
+
+参数：
+Kind：TABLE_SNAPSHOT_TCP等。
+Family：TABLE_SNAPSHOT_TCP_EXTENDED和TABLE_SNAPSHOT_UDP_EXTENDED的AF_INET或AF_INET6，其他的忽略。
+Class：TABLE_SNAPSHOT_TCP_EXTENDED的TCP_TABLE_CLASS，TABLE_SNAPSHOT_UDP_EXTENDED的UDP_TABLE_CLASS，其他的忽略。
+Order：让系统排序。
+
+返回值：ERROR_INVALID_PARAMETER，ERROR_NOT_SUPPORTED（AF_INET6的TCP_TABLE_BASIC_XXX）。
+
+注意：用完调用TableSnapshotFree。也可以用TABLE_SNAPSHOT_INITIALIZER静态初始化。
+*/
+{
+    RtlZeroMemory(Snapshot, sizeof(TABLE_SNAPSHOT));
+    Snapshot->Kind = Kind;
+    Snapshot->Family = Family;
+    Snapshot->Class = Class;
+    Snapshot->Order = Order;
+
+    ULONG RowSize = 0;
+    ULONG RowOffset = 0;
+    return GetLayout(Snapshot, &RowSize, &RowOffset);
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI TableSnapshotReserve(_Inout_ PTABLE_SNAPSHOT Snapshot, _In_ ULONG Rows)
+/*
+功能：预先申请能放下Rows行的缓冲区，已知表的规模时可以省掉第一次刷新时的重试。
+
+注意：按当前的Kind，Family和Class计算；只增不减。
+*/
+{
+    ULONG RowSize = 0;
+    ULONG RowOffset = 0;
+    ULONG Status = GetLayout(Snapshot, &RowSize, &RowOffset);
+    if (ERROR_SUCCESS != Status) {
+        return Status;
+    }
+
+    ULONG Previous = Snapshot->Capacity;
+    Status = Grow(Snapshot, RowOffset + (ULONGLONG)Rows * RowSize);
+    if (Previous != Snapshot->Capacity) {
+        Snapshot->Rows = nullptr; //旧的内容没有了。
+        Snapshot->Count = 0;
+    }
+
+    return Status;
+}
+
+
+EXTERN_C
+DLLEXPORT
+ULONG WINAPI TableSnapshotRefresh(_Inout_ PTABLE_SNAPSHOT Snapshot)
+/*
+功能：重新获取整个表，尽量重用上次的缓冲区。
+
+返回值：ERROR_SUCCESS，ERROR_NOT_ENOUGH_MEMORY，
+ERROR_INSUFFICIENT_BUFFER（表在TABLE_SNAPSHOT_MAX_TRIES次调用之间一直在变大），及API本身的错误。
+
+注意：
+1.成功后Rows指向第一行，共Count行，每行RowSize字节，到下次刷新（或者释放）前有效。
+2.失败后Rows是nullptr，Count是0，缓冲区保留。
+3.稳定时只有一次系统调用，没有内存申请。
+*/
+{
+    ULONG RowSize = 0;
+    ULONG RowOffset = 0;
+    ULONG Status = GetLayout(Snapshot, &RowSize, &RowOffset);
+
+    Snapshot->Rows = nullptr;
+    Snapshot->Count = 0;
+    Snapshot->RowSize = RowSize;
+    if (ERROR_SUCCESS != Status) {
+        return Status;
+    }
+
+    Status = Grow(Snapshot, TABLE_SNAPSHOT_INITIAL_SIZE);
+    if (ERROR_SUCCESS != Status) {
+        return Status;
+    }
+
+    for (int Try = 0; Try < TABLE_SNAPSHOT_MAX_TRIES; Try++) {
+        ULONG Size = Snapshot->Capacity;
+        Status = QueryTable(Snapshot, &Size);
+        if (ERROR_INSUFFICIENT_BUFFER != Status) {
+            break;
+        }
+
+        Snapshot->Retries++;
+
+        //按需要的大小多留一些，下次（和这次的重试时）表稍有增长也放得下。
+        ULONGLONG Needed = max(Size, Snapshot->Capacity);
+        ULONGLONG Headroom = max(Needed >> TABLE_SNAPSHOT_HEADROOM_SHIFT,
+                                 (ULONGLONG)RowSize * TABLE_SNAPSHOT_HEADROOM_ROWS);
+        ULONG GrowStatus = Grow(Snapshot, Needed + Headroom);
+        if (ERROR_SUCCESS != GrowStatus) {
+            return GrowStatus;
+        }
+    }
+
+    if (ERROR_SUCCESS == Status) {
+        ULONG Count = *reinterpret_cast<PDWORD>(Snapshot->Buffer); //所有的表的第一个成员都是dwNumEntries。
+        _ASSERTE(RowOffset + (ULONGLONG)Count * RowSize <= Snapshot->Capacity);
+        Snapshot->Rows = reinterpret_cast<PUCHAR>(Snapshot->Buffer) + RowOffset;
+        Snapshot->Count = Count;
+        Snapshot->Refreshes++;
+    }
+
+    return Status;
+}
+
+
+EXTERN_C
+DLLEXPORT
+void WINAPI TableSnapshotFree(_Inout_ PTABLE_SNAPSHOT Snapshot)
+/*
+功能：释放缓冲区。Kind等保留，之后还可以再刷新。
+*/
+{
+    if (Snapshot->Buffer) {
+        FREE(Snapshot->Buffer);
+    }
+
+    Snapshot->Buffer = nullptr;
+    Snapshot->Capacity = 0;
+    Snapshot->Rows = nullptr;
+    Snapshot->Count = 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
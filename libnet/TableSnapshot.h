@@ -0,0 +1,103 @@
+﻿#pragma once
+
+#include "pch.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+// TABLE_SNAPSHOT的Kind，即调用哪个API。
+#define TABLE_SNAPSHOT_TCP          1 // GetTcpTable，MIB_TCPROW。
+#define TABLE_SNAPSHOT_TCP2         2 // GetTcpTable2，MIB_TCPROW2。
+#define TABLE_SNAPSHOT_TCP6         3 // GetTcp6Table，MIB_TCP6ROW。
+#define TABLE_SNAPSHOT_TCP6_2       4 // GetTcp6Table2，MIB_TCP6ROW2。
+#define TABLE_SNAPSHOT_TCP_EXTENDED 5 // GetExtendedTcpTable，行的类型由Family和Class（TCP_TABLE_CLASS）决定。
+#define TABLE_SNAPSHOT_UDP          6 // GetUdpTable，MIB_UDPROW。
+#define TABLE_SNAPSHOT_UDP6         7 // GetUdp6Table，MIB_UDP6ROW。
+#define TABLE_SNAPSHOT_UDP_EXTENDED 8 // GetExtendedUdpTable，行的类型由Family和Class（UDP_TABLE_CLASS）决定。
+
+#define TABLE_SNAPSHOT_MAX_TRIES 8    //表在两次调用之间一直变大时，最多调用的次数。
+
+
+//一个连接表（或侦听表）的快照，见TableSnapshotRefresh。
+//缓冲区只增不减，反复刷新时重用，不是线程安全的。可以放在栈上或者全局变量里（TABLE_SNAPSHOT_INITIALIZER）。
+//两次刷新之间可以修改Family，Class和Order。
+typedef struct _TABLE_SNAPSHOT {
+    ULONG Kind;
+    ULONG Family;    //扩展的表的AF_INET或AF_INET6，其他的忽略。
+    ULONG Class;     //扩展的表的TCP_TABLE_CLASS或UDP_TABLE_CLASS，其他的忽略。
+    BOOL Order;      //让系统按地址和端口排序。有额外的开销，轮询的一般不需要。
+    PVOID Buffer;    //整个表（MIB_XXXTABLE）。
+    ULONG Capacity;  // Buffer的大小。
+    PVOID Rows;      //指向Buffer里的第一行，刷新失败的是nullptr。
+    ULONG RowSize;
+    ULONG Count;     //行数。
+    ULONG Refreshes; //成功刷新的次数。
+    ULONG Grows;     //重新申请内存的次数。
+    ULONG Retries;   //返回ERROR_INSUFFICIENT_BUFFER的次数（包括表在两次调用之间变大的）。
+} TABLE_SNAPSHOT, * PTABLE_SNAPSHOT;
+
+#define TABLE_SNAPSHOT_INITIALIZER(Kind, Family, Class, Order) {(Kind), (Family), (Class), (Order)}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+EXTERN_C_START
+
+
+DLLEXPORT
+ULONG WINAPI TableSnapshotInit(_Out_ PTABLE_SNAPSHOT Snapshot,
+                               _In_ ULONG Kind,
+                               _In_ ULONG Family,
+                               _In_ ULONG Class,
+                               _In_ BOOL Order);
+
+DLLEXPORT
+ULONG WINAPI TableSnapshotReserve(_Inout_ PTABLE_SNAPSHOT Snapshot, _In_ ULONG Rows);
+
+DLLEXPORT
+ULONG WINAPI TableSnapshotRefresh(_Inout_ PTABLE_SNAPSHOT Snapshot);
+
+DLLEXPORT
+void WINAPI TableSnapshotFree(_Inout_ PTABLE_SNAPSHOT Snapshot);
+
+
+EXTERN_C_END
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifdef __cplusplus
+
+
+//按行的类型访问快照，如：
+//for (auto & Row : TableSnapshotRows<MIB_TCPROW_OWNER_PID>(&Snapshot)) {...}
+//行的类型要和Kind（及Family，Class）对应，只检查大小，不对的返回空的。
+template <typename Row>
+struct TABLE_SNAPSHOT_SPAN {
+    Row * Rows;
+    ULONG Count;
+
+    Row * begin() const { return Rows; }
+    Row * end() const { return Rows + Count; }
+    Row & operator[](ULONG Index) const { return Rows[Index]; }
+};
+
+
+template <typename Row>
+TABLE_SNAPSHOT_SPAN<Row> TableSnapshotRows(_In_ const TABLE_SNAPSHOT * Snapshot)
+{
+    if (nullptr == Snapshot->Rows || sizeof(Row) != Snapshot->RowSize) {
+        return {nullptr, 0}; //没有刷新成功，或者类型不对。
+    }
+
+    return {reinterpret_cast<Row *>(Snapshot->Rows), Snapshot->Count};
+}
+
+
+#endif
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
@@ -189,6 +189,7 @@
 #include <regex>
 #include <map>
 #include <set>
+#include <charconv>
 
 using namespace std;
 
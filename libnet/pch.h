@@ -29,6 +29,7 @@
 
 void DisplayError(_In_ DWORD dwMessageId);
 void GetTimeString(LARGE_INTEGER UtcTime, _Out_ LPWSTR TimeString);
+PCSTR GetTcpConnectionStateName(_In_ DWORD dwState);
 void PrintTcpConnectionState(_In_ DWORD dwState);
 void PrintInterfaceType(_In_ WORD Type);
 void PrintNeighborState(_In_ NL_NEIGHBOR_STATE State);
@@ -0,0 +1,165 @@
+﻿/*
+DissectPacket的验证和基准测试：先用手工构造的帧验证解析的结果，再测单核每秒能解析的包数。
+
+Linux上：
+g++ -std=c++17 -O2 -I../libnet DissectorBenchmark.cpp ../libnet/Dissector.cpp
+
+Windows上（VS的开发人员命令提示符下），还测PacketizeSyn4/PacketizeSyn6组的包：
+cl /std:c++17 /O2 /EHsc /DUNICODE /D_UNICODE /wd4819 /I..\libnet DissectorBenchmark.cpp ..\libnet\Dissector.cpp
+    ..\libnet\raw.cpp
+
+都不在test.vcxproj的生成里。更细的（截断的，畸形的帧）单元测试见DissectorTest.cpp。
+*/
+
+
+#include "Dissector.h"
+
+#ifdef _WIN32
+#include "raw.h"
+#else
+#include <netinet/in.h>
+#include <time.h>
+#endif
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static UINT64 NowNanoseconds()
+{
+#ifdef _WIN32
+    LARGE_INTEGER Frequency, Counter;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Counter);
+    return (UINT64)((double)Counter.QuadPart * 1e9 / Frequency.QuadPart);
+#else
+    struct timespec Now;
+
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (UINT64)Now.tv_sec * 1000000000 + (UINT64)Now.tv_nsec;
+#endif
+}
+
+
+static void DissectBenchmark()
+/*
+功能：报文解析的验证和微基准测试（微测）。
+
+1.先用几个手工构造的帧（字节数组）验证解析的结果，包括截断的和畸形的。
+2.再测试单核每秒能解析的包数（Mpps）。
+*/
+{
+    // VLAN 100 + IPv4（4字节的选项）+ TCP SYN（MSS 1460，WS 7，SACK_PERMITTED，Timestamp）+ 4字节的负载。
+    static const BYTE Tcp4Frame[] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0x81, 0x00, 0x00, 0x64,
+        0x08, 0x00, 0x46, 0x00, 0x00, 0x44, 0x12, 0x34, 0x40, 0x00, 0x40, 0x06, 0x00, 0x00, 0xc0, 0xa8,
+        0x01, 0x02, 0x0a, 0x00, 0x00, 0x01, 0x01, 0x01, 0x01, 0x00, 0xc0, 0x00, 0x00, 0x50, 0x00, 0x00,
+        0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0xa0, 0x02, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00, 0x02, 0x04,
+        0x05, 0xb4, 0x01, 0x03, 0x03, 0x07, 0x04, 0x02, 0x08, 0x0a, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00,
+        0x00, 0x00, 0xde, 0xad, 0xbe, 0xef,
+    };
+
+    // IPv6 + Hop-by-Hop + Fragment（偏移0，MF）+ UDP 53 + 4字节的负载 + 以太网的填充。
+    static const BYTE Udp6Frame[] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0x86, 0xdd, 0x60, 0x00,
+        0x00, 0x00, 0x00, 0x1c, 0x00, 0x40, 0x20, 0x01, 0x0d, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x20, 0x01, 0x0d, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x2c, 0x00, 0x01, 0x04, 0x00, 0x00, 0x00, 0x00, 0x11, 0x00,
+        0x00, 0x01, 0x12, 0x34, 0x56, 0x78, 0x30, 0x39, 0x00, 0x35, 0x00, 0x0c, 0x00, 0x00, 0x01, 0x02,
+        0x03, 0x04, 0x00, 0x00,
+    };
+
+    struct {
+        const char * Name;
+        bool Passed;
+    } Cases[16]{};
+    int CaseCount = 0;
+    PACKET_INFO Info;
+    ULONG ret;
+
+    ret = DissectPacket(Tcp4Frame, sizeof(Tcp4Frame), &Info);
+    Cases[CaseCount++] = {"tcp4",
+                          ERROR_SUCCESS == ret && 1 == Info.VlanCount && 100 == Info.VlanId[0] &&
+                              0x0800 == Info.EtherType && 18 == Info.L3Offset && 24 == Info.L3Length &&
+                              64 == Info.HopLimit && IPPROTO_TCP == Info.Protocol && 42 == Info.L4Offset &&
+                              40 == Info.L4Length && 49152 == Info.SourcePort && 80 == Info.DestinationPort &&
+                              1 == Info.Seq && 0x02 == Info.TcpFlags && 1460 == Info.Mss &&
+                              7 == Info.WindowScale && 1 == Info.TsVal &&
+                              (PACKET_TCP_OPT_MSS | PACKET_TCP_OPT_WS | PACKET_TCP_OPT_SACK_PERMITTED |
+                               PACKET_TCP_OPT_TIMESTAMP) == Info.TcpOptions &&
+                              82 == Info.PayloadOffset && 4 == Info.PayloadLength};
+
+    ret = DissectPacket(Udp6Frame, sizeof(Udp6Frame), &Info);
+    Cases[CaseCount++] = {"udp6",
+                          ERROR_SUCCESS == ret && 0 == Info.VlanCount && 6 == Info.IpVersion &&
+                              64 == Info.HopLimit && 56 == Info.L3Length && IPPROTO_UDP == Info.Protocol &&
+                              (Info.Layers & PACKET_LAYER_FRAGMENT) && 0x12345678 == Info.FragmentId &&
+                              0 == Info.FragmentOffset && 12345 == Info.SourcePort &&
+                              53 == Info.DestinationPort && 78 == Info.PayloadOffset &&
+                              4 == Info.PayloadLength};
+
+    ret = DissectPacket(Tcp4Frame, 60, &Info); //截断在TCP的选项里。
+    Cases[CaseCount++] = {"truncated",
+                          ERROR_INSUFFICIENT_BUFFER == ret && (Info.Layers & PACKET_LAYER_IPV4) &&
+                              !(Info.Layers & PACKET_LAYER_TCP)};
+
+    BYTE Malformed[sizeof(Tcp4Frame)];
+    RtlCopyMemory(Malformed, Tcp4Frame, sizeof(Tcp4Frame));
+    Malformed[63] = 0; // MSS选项的长度为0。
+    ret = DissectPacket(Malformed, sizeof(Malformed), &Info);
+    Cases[CaseCount++] = {"malformed", ERROR_INVALID_DATA == ret};
+
+    for (int i = 0; i < CaseCount; i++) {
+        printf("%s: %s\n", Cases[i].Name, Cases[i].Passed ? "ok" : "FAILED");
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //吞吐量。
+
+#ifdef _WIN32
+    BYTE Syn4[sizeof(RAW_TCP) + sizeof(TCP_OPT_MSS)]{};
+    BYTE Syn6[sizeof(RAW6_TCP)]{};
+    BYTE Mac[6]{};
+    IN_ADDR Source4{}, Destination4{};
+    IN6_ADDR Source6{}, Destination6{};
+    PacketizeSyn4(Mac, Mac, &Source4, &Destination4, htons(49152), htons(80), Syn4);
+    PacketizeSyn6(Mac, Mac, &Source6, &Destination6, htons(49152), htons(80), Syn6);
+#endif
+
+    struct {
+        const char * Name;
+        const BYTE * Frame;
+        SIZE_T Size;
+    } Frames[] = {
+#ifdef _WIN32
+        {"syn4", Syn4, sizeof(Syn4)},
+        {"syn6", Syn6, sizeof(Syn6)},
+#endif
+        {"vlan-tcp4-opt", Tcp4Frame, sizeof(Tcp4Frame)},
+        {"udp6-ext", Udp6Frame, sizeof(Udp6Frame)},
+    };
+
+    const UINT64 Loops = 20000000;
+
+    for (auto & Frame : Frames) {
+        volatile UINT32 Sink = 0;
+        UINT64 Start = NowNanoseconds();
+
+        for (UINT64 i = 0; i < Loops; i++) {
+            DissectPacket(Frame.Frame, Frame.Size, &Info);
+            Sink = Sink + Info.PayloadOffset;
+        }
+
+        double Seconds = (double)(NowNanoseconds() - Start) / 1e9;
+        printf("%-16s%8.2f Mpps%8.2f ns/packet\n", Frame.Name, Loops / Seconds / 1e6, Seconds * 1e9 / Loops);
+    }
+}
+
+
+int main()
+{
+    DissectBenchmark();
+
+    return 0;
+}
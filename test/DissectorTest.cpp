@@ -0,0 +1,450 @@
+﻿/*
+DissectPacket的单元测试，输入都是手工构造的字节数组。
+
+不依赖Windows，Linux上单独编译运行（不在test.vcxproj的生成里）：
+g++ -std=c++17 -O2 -Wall -Wextra -fsanitize=address,undefined -I../libnet DissectorTest.cpp ../libnet/Dissector.cpp
+
+覆盖：VLAN（含QinQ），IPv4的选项，IPv6的扩展头链，TCP的选项，截断的和畸形的帧。
+截断的帧都复制到刚好那么大的堆内存里再解析，越界读由AddressSanitizer发现。
+*/
+
+
+#include "Dissector.h"
+
+#include <netinet/in.h>
+
+#include <vector>
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+typedef std::vector<BYTE> FRAME;
+
+
+static int Failures;
+
+
+#define CHECK(Condition)                                                                                   \
+    do {                                                                                                   \
+        if (!(Condition)) {                                                                                \
+            printf("%s:%d: %s\n", __FUNCTION__, __LINE__, #Condition);                                    \
+            Failures++;                                                                                    \
+        }                                                                                                  \
+    } while (0)
+
+
+static void Put16(FRAME & Frame, UINT16 Value)
+{
+    Frame.push_back((BYTE)(Value >> 8));
+    Frame.push_back((BYTE)Value);
+}
+
+
+static void Put32(FRAME & Frame, UINT32 Value)
+{
+    Put16(Frame, (UINT16)(Value >> 16));
+    Put16(Frame, (UINT16)Value);
+}
+
+
+static void Append(FRAME & Frame, const FRAME & Bytes)
+{
+    Frame.insert(Frame.end(), Bytes.begin(), Bytes.end());
+}
+
+
+static FRAME Ethernet(UINT16 Type, const std::vector<UINT16> & Vlans = {})
+/*
+功能：以太头，Vlans是外层在前的VLAN ID，外层用0x88A8（QinQ），其余的用0x8100。
+*/
+{
+    FRAME Frame = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb};
+
+    for (size_t i = 0; i < Vlans.size(); i++) {
+        Put16(Frame, (Vlans.size() > 1 && 0 == i) ? 0x88A8 : 0x8100);
+        Put16(Frame, (UINT16)(0xe000 | Vlans[i])); //优先级7，检查会去掉。
+    }
+
+    Put16(Frame, Type);
+    return Frame;
+}
+
+
+static FRAME Ipv4(UINT8 Protocol, const FRAME & Options, SIZE_T PayloadLength, UINT16 FlagsAndOffset = 0x4000)
+/*
+功能：IPv4头，Options的长度要是4的倍数。PayloadLength是头之后的长度（写到Total Length里）。
+*/
+{
+    FRAME Header;
+    UINT16 HeaderLength = (UINT16)(20 + Options.size());
+
+    Header.push_back((BYTE)(0x40 | HeaderLength / 4));
+    Header.push_back(0);
+    Put16(Header, (UINT16)(HeaderLength + PayloadLength));
+    Put16(Header, 0x1234);
+    Put16(Header, FlagsAndOffset);
+    Header.push_back(64);
+    Header.push_back(Protocol);
+    Put16(Header, 0);
+    Put32(Header, 0xc0a80102);
+    Put32(Header, 0x0a000001);
+    Append(Header, Options);
+    return Header;
+}
+
+
+static FRAME Ipv6(UINT8 NextHeader, SIZE_T PayloadLength)
+{
+    FRAME Header;
+
+    Put32(Header, 0x60000000);
+    Put16(Header, (UINT16)PayloadLength);
+    Header.push_back(NextHeader);
+    Header.push_back(255);
+
+    for (int i = 0; i < 2; i++) {
+        Put32(Header, 0x20010db8);
+        Put32(Header, 0);
+        Put32(Header, 0);
+        Put32(Header, 1 + i);
+    }
+
+    return Header;
+}
+
+
+static FRAME Extension(UINT8 NextHeader, UINT8 Length8)
+/*
+功能：Hop-by-Hop，Routing和Destination Options这种格式的扩展头，长度是(Length8 + 1) * 8，内容是PadN。
+*/
+{
+    FRAME Header = {NextHeader, Length8, 0x01, (BYTE)((Length8 + 1) * 8 - 4)};
+
+    Header.resize((Length8 + 1) * 8);
+    return Header;
+}
+
+
+static FRAME Tcp(UINT8 Flags, const FRAME & Options)
+/*
+功能：TCP头，端口49152到80，Seq 1，Ack 2，Window 0x1000，Options的长度要是4的倍数。
+*/
+{
+    FRAME Header;
+
+    Put16(Header, 49152);
+    Put16(Header, 80);
+    Put32(Header, 1);
+    Put32(Header, 2);
+    Header.push_back((BYTE)((20 + Options.size()) / 4 << 4));
+    Header.push_back(Flags);
+    Put16(Header, 0x1000);
+    Put32(Header, 0);
+    Append(Header, Options);
+    return Header;
+}
+
+
+static FRAME Udp(UINT16 Source, UINT16 Destination, SIZE_T PayloadLength)
+{
+    FRAME Header;
+
+    Put16(Header, Source);
+    Put16(Header, Destination);
+    Put16(Header, (UINT16)(8 + PayloadLength));
+    Put16(Header, 0);
+    return Header;
+}
+
+
+static ULONG Dissect(const FRAME & Frame, SIZE_T Size, PPACKET_INFO Info)
+/*
+功能：把Frame的前Size个字节复制到刚好那么大的堆内存里再解析，这样越界读都能被发现。
+*/
+{
+    BYTE * Copy = (BYTE *)malloc(Size ? Size : 1);
+    memcpy(Copy, Frame.data(), Size);
+    ULONG ret = DissectPacket(Copy, Size, Info);
+    free(Copy);
+    return ret;
+}
+
+
+static ULONG Dissect(const FRAME & Frame, PPACKET_INFO Info)
+{
+    return Dissect(Frame, Frame.size(), Info);
+}
+
+
+static void CheckEveryPrefix(const FRAME & Frame, UINT32 L4Offset, UINT32 PayloadOffset)
+/*
+功能：截断到每一个长度都不能越界，缺了头的要返回ERROR_INSUFFICIENT_BUFFER，头完整的（只少了负载）要成功。
+*/
+{
+    PACKET_INFO Info;
+
+    for (SIZE_T Size = 0; Size < Frame.size(); Size++) {
+        ULONG ret = Dissect(Frame, Size, &Info);
+
+        if (Size < PayloadOffset) {
+            CHECK(ERROR_INSUFFICIENT_BUFFER == ret);
+            CHECK(Size < L4Offset || Info.L4Offset == L4Offset);
+        } else {
+            CHECK(ERROR_SUCCESS == ret);
+            CHECK(PayloadOffset == Info.PayloadOffset);
+            CHECK(Size - PayloadOffset == Info.PayloadLength); //以实际抓到的为准。
+        }
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static void TestVlan()
+{
+    PACKET_INFO Info;
+    FRAME Frame = Ethernet(0x0800, {100});
+    Append(Frame, Ipv4(IPPROTO_UDP, {}, 8 + 4));
+    Append(Frame, Udp(12345, 53, 4));
+    Append(Frame, {1, 2, 3, 4});
+
+    CHECK(ERROR_SUCCESS == Dissect(Frame, &Info));
+    CHECK((PACKET_LAYER_ETHERNET | PACKET_LAYER_VLAN | PACKET_LAYER_IPV4 | PACKET_LAYER_UDP |
+           PACKET_LAYER_PAYLOAD) == Info.Layers);
+    CHECK(1 == Info.VlanCount && 100 == Info.VlanId[0]);
+    CHECK(0x0800 == Info.EtherType && 18 == Info.L3Offset && 38 == Info.L4Offset && 46 == Info.PayloadOffset);
+    CHECK(12345 == Info.SourcePort && 53 == Info.DestinationPort && 4 == Info.PayloadLength);
+
+    FRAME QinQ = Ethernet(0x86dd, {10, 4095});
+    Append(QinQ, Ipv6(IPPROTO_UDP, 8));
+    Append(QinQ, Udp(1, 2, 0));
+
+    CHECK(ERROR_SUCCESS == Dissect(QinQ, &Info));
+    CHECK(2 == Info.VlanCount && 10 == Info.VlanId[0] && 4095 == Info.VlanId[1]);
+    CHECK(0x86dd == Info.EtherType && 22 == Info.L3Offset && 62 == Info.L4Offset && 0 == Info.PayloadLength);
+
+    FRAME TooMany = Ethernet(0x0800, {1, 2, 3});
+    Append(TooMany, Ipv4(IPPROTO_UDP, {}, 8));
+    Append(TooMany, Udp(1, 2, 0));
+    CHECK(ERROR_NOT_SUPPORTED == Dissect(TooMany, &Info));
+
+    FRAME Arp = Ethernet(0x0806, {7}); //不认识的以太类型，都算负载。
+    Append(Arp, FRAME(28));
+    CHECK(ERROR_SUCCESS == Dissect(Arp, &Info));
+    CHECK(0x0806 == Info.EtherType && 18 == Info.PayloadOffset && 28 == Info.PayloadLength);
+
+    CHECK(ERROR_INSUFFICIENT_BUFFER == Dissect(Frame, 13, &Info)); //以太类型不完整。
+    CHECK(ERROR_INSUFFICIENT_BUFFER == Dissect(Frame, 16, &Info)); // VLAN标签不完整。
+}
+
+
+static void TestIpv4Options()
+{
+    PACKET_INFO Info;
+    FRAME Options = {0x94, 0x04, 0x00, 0x00, 0x01, 0x01, 0x01, 0x00}; // Router Alert + NOP + NOP + NOP + EOL。
+    FRAME Frame = Ethernet(0x0800);
+    Append(Frame, Ipv4(IPPROTO_UDP, Options, 8 + 2));
+    Append(Frame, Udp(68, 67, 2));
+    Append(Frame, {0xaa, 0xbb});
+    SIZE_T Size = Frame.size();
+    Frame.resize(60); //以太网的最小帧，填充不算负载。
+
+    CHECK(ERROR_SUCCESS == Dissect(Frame, &Info));
+    CHECK(4 == Info.IpVersion && 64 == Info.HopLimit && IPPROTO_UDP == Info.Protocol);
+    CHECK(14 == Info.L3Offset && 28 == Info.L3Length && 42 == Info.L4Offset && 8 == Info.L4Length);
+    CHECK(50 == Info.PayloadOffset && 2 == Info.PayloadLength && Size == Info.PayloadOffset + Info.PayloadLength);
+
+    FRAME Fragment = Ethernet(0x0800); //第二个分片：没有L4头。
+    Append(Fragment, Ipv4(IPPROTO_TCP, {}, 16, 0x2000 | 185));
+    Append(Fragment, FRAME(16));
+
+    CHECK(ERROR_SUCCESS == Dissect(Fragment, &Info));
+    CHECK((Info.Layers & PACKET_LAYER_FRAGMENT) && !(Info.Layers & PACKET_LAYER_TCP));
+    CHECK(1480 == Info.FragmentOffset && 0x1234 == Info.FragmentId);
+    CHECK(34 == Info.PayloadOffset && 16 == Info.PayloadLength);
+
+    FRAME Short = Frame;
+    Short[14] = 0x44; // IHL 4，比最小的头还短。
+    CHECK(ERROR_INVALID_DATA == Dissect(Short, &Info));
+
+    FRAME Version = Frame;
+    Version[14] = 0x57;
+    CHECK(ERROR_INVALID_DATA == Dissect(Version, &Info));
+
+    FRAME Total = Frame;
+    Total[16] = 0;
+    Total[17] = 20; // Total Length比头（含选项）短。
+    CHECK(ERROR_INVALID_DATA == Dissect(Total, &Info));
+
+    CHECK(ERROR_INSUFFICIENT_BUFFER == Dissect(Frame, 14 + 24, &Info)); //截断在选项里。
+    CHECK((Info.Layers & PACKET_LAYER_ETHERNET) && !(Info.Layers & PACKET_LAYER_IPV4));
+}
+
+
+static void TestIpv6Extensions()
+{
+    PACKET_INFO Info;
+
+    // Hop-by-Hop（8）+ Routing（24）+ Fragment（8）+ Destination Options（16）+ TCP。
+    FRAME Frame = Ethernet(0x86dd);
+    FRAME Tail;
+    Append(Tail, Extension(IPPROTO_ROUTING, 0));
+    Append(Tail, Extension(IPPROTO_FRAGMENT, 2));
+    Append(Tail, {IPPROTO_DSTOPTS, 0, 0x00, 0x01, 0xca, 0xfe, 0xba, 0xbe}); // MF，Id 0xcafebabe。
+    Append(Tail, Extension(IPPROTO_TCP, 1));
+    Append(Tail, Tcp(0x18, {}));
+    Append(Tail, {'G', 'E', 'T', ' '});
+    Append(Frame, Ipv6(IPPROTO_HOPOPTS, Tail.size()));
+    Append(Frame, Tail);
+
+    CHECK(ERROR_SUCCESS == Dissect(Frame, &Info));
+    CHECK(6 == Info.IpVersion && 255 == Info.HopLimit && IPPROTO_TCP == Info.Protocol);
+    CHECK(14 == Info.L3Offset && 40 + 56 == Info.L3Length && 110 == Info.L4Offset && 20 == Info.L4Length);
+    CHECK((Info.Layers & PACKET_LAYER_FRAGMENT) && 0 == Info.FragmentOffset && 0xcafebabe == Info.FragmentId);
+    CHECK(0x18 == Info.TcpFlags && 130 == Info.PayloadOffset && 4 == Info.PayloadLength);
+
+    CheckEveryPrefix(Frame, 110, 130);
+
+    FRAME Later = Ethernet(0x86dd); //非第一个分片，后面的不再当作扩展头。
+    Append(Later, Ipv6(IPPROTO_FRAGMENT, 8 + 16));
+    Append(Later, {IPPROTO_UDP, 0, 0x05, 0xa8, 0, 0, 0, 1}); //偏移1448。
+    Append(Later, FRAME(16, 0x3c));
+
+    CHECK(ERROR_SUCCESS == Dissect(Later, &Info));
+    CHECK(IPPROTO_UDP == Info.Protocol && 1448 == Info.FragmentOffset && !(Info.Layers & PACKET_LAYER_UDP));
+    CHECK(62 == Info.PayloadOffset && 16 == Info.PayloadLength);
+
+    FRAME Ah = Ethernet(0x86dd); // AH的长度是(Payload Len + 2) * 4。
+    Append(Ah, Ipv6(IPPROTO_AH, 24 + 8));
+    FRAME AhHeader = {IPPROTO_UDP, 4};
+    AhHeader.resize(24);
+    Append(Ah, AhHeader);
+    Append(Ah, Udp(500, 500, 0));
+
+    CHECK(ERROR_SUCCESS == Dissect(Ah, &Info));
+    CHECK(IPPROTO_UDP == Info.Protocol && 64 == Info.L3Length && 500 == Info.DestinationPort);
+
+    FRAME NoNext = Ethernet(0x86dd); // No Next Header之后的都是负载。
+    Append(NoNext, Ipv6(59, 6));
+    Append(NoNext, FRAME(6));
+    CHECK(ERROR_SUCCESS == Dissect(NoNext, &Info));
+    CHECK(59 == Info.Protocol && 54 == Info.PayloadOffset && 6 == Info.PayloadLength);
+
+    FRAME Overrun = Ethernet(0x86dd); //扩展头的长度超出了Payload Length。
+    Append(Overrun, Ipv6(IPPROTO_HOPOPTS, 8));
+    Append(Overrun, Extension(IPPROTO_TCP, 3));
+    CHECK(ERROR_INSUFFICIENT_BUFFER == Dissect(Overrun, &Info));
+
+    FRAME Version = Frame;
+    Version[14] = 0x40;
+    CHECK(ERROR_INVALID_DATA == Dissect(Version, &Info));
+}
+
+
+static void TestTcpOptions()
+{
+    PACKET_INFO Info;
+    FRAME Options = {
+        0x02, 0x04, 0x05, 0xb4,                                     // MSS 1460
+        0x01,                                                       // NOP
+        0x03, 0x03, 0x0e,                                           // WS 14
+        0x04, 0x02,                                                 // SACK_PERMITTED
+        0x08, 0x0a, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, // Timestamp
+        0xfd, 0x04, 0xab, 0xcd,                                     //实验用的（不认识，跳过）。
+        0x00, 0x00, 0x00, 0x00,                                     // EOL + 填充
+    };
+    FRAME Frame = Ethernet(0x0800);
+    Append(Frame, Ipv4(IPPROTO_TCP, {}, 20 + Options.size()));
+    Append(Frame, Tcp(0x02, Options));
+
+    CHECK(ERROR_SUCCESS == Dissect(Frame, &Info));
+    CHECK(49152 == Info.SourcePort && 80 == Info.DestinationPort && 1 == Info.Seq && 2 == Info.Ack);
+    CHECK(0x1000 == Info.Window && 0x02 == Info.TcpFlags && 48 == Info.L4Length);
+    CHECK((PACKET_TCP_OPT_MSS | PACKET_TCP_OPT_WS | PACKET_TCP_OPT_SACK_PERMITTED | PACKET_TCP_OPT_TIMESTAMP) ==
+          Info.TcpOptions);
+    CHECK(1460 == Info.Mss && 14 == Info.WindowScale && 0x11223344 == Info.TsVal && 0x55667788 == Info.TsEcr);
+    CHECK(82 == Info.PayloadOffset && 0 == Info.PayloadLength);
+
+    CheckEveryPrefix(Frame, 34, 82);
+
+    FRAME AfterEol = Frame; // EOL之后的不再解析。
+    AfterEol[34 + 20] = 0x00;
+    CHECK(ERROR_SUCCESS == Dissect(AfterEol, &Info));
+    CHECK(0 == Info.TcpOptions && 0 == Info.Mss);
+
+    FRAME BadMss = Frame; //长度不对的已知选项忽略。
+    BadMss[34 + 21] = 0x03;
+    BadMss[34 + 23] = 0x01;
+    CHECK(ERROR_SUCCESS == Dissect(BadMss, &Info));
+    CHECK(!(Info.TcpOptions & PACKET_TCP_OPT_MSS) && (Info.TcpOptions & PACKET_TCP_OPT_WS));
+
+    FRAME Zero = Frame;
+    Zero[34 + 21] = 0x00; //长度为0，会死循环的。
+    CHECK(ERROR_INVALID_DATA == Dissect(Zero, &Info));
+
+    FRAME One = Frame;
+    One[34 + 21] = 0x01;
+    CHECK(ERROR_INVALID_DATA == Dissect(One, &Info));
+
+    FRAME Past = Frame;
+    Past[34 + 20 + 20] = 0xfd;
+    Past[34 + 20 + 21] = 0x10; //超出了TCP头（Data Offset）的结束。
+    CHECK(ERROR_INVALID_DATA == Dissect(Past, &Info));
+
+    FRAME Lone = Frame; //最后一个字节是选项的类型，没有长度。
+    Lone[34 + 20 + 24] = 0x01;
+    Lone[34 + 20 + 25] = 0x01;
+    Lone[34 + 20 + 26] = 0x01;
+    Lone[34 + 20 + 27] = 0x02;
+    CHECK(ERROR_INVALID_DATA == Dissect(Lone, &Info));
+
+    FRAME Offset = Frame;
+    Offset[34 + 12] = 0x40; // Data Offset是4，比最小的头还短。
+    CHECK(ERROR_INVALID_DATA == Dissect(Offset, &Info));
+}
+
+
+static void TestTruncated()
+{
+    PACKET_INFO Info;
+
+    FRAME Udp4 = Ethernet(0x0800, {5});
+    Append(Udp4, Ipv4(IPPROTO_UDP, {0x01, 0x01, 0x01, 0x00}, 8 + 3));
+    Append(Udp4, Udp(1024, 2048, 3));
+    Append(Udp4, {1, 2, 3});
+    CheckEveryPrefix(Udp4, 42, 50);
+
+    FRAME Icmp6 = Ethernet(0x86dd);
+    Append(Icmp6, Ipv6(IPPROTO_ICMPV6, 8));
+    Append(Icmp6, {128, 0, 0, 0, 0, 1, 0, 1}); // Echo Request。
+    CheckEveryPrefix(Icmp6, 54, 58);
+    CHECK(ERROR_SUCCESS == Dissect(Icmp6, &Info));
+    CHECK((Info.Layers & PACKET_LAYER_ICMP) && 128 == Info.SourcePort && 0 == Info.DestinationPort);
+
+    FRAME Udp6 = Ethernet(0x86dd);
+    Append(Udp6, Ipv6(IPPROTO_UDP, 8));
+    Append(Udp6, Udp(1, 2, 0));
+    Udp6[54 + 5] = 4; // UDP的长度比头还短。
+    CHECK(ERROR_INVALID_DATA == Dissect(Udp6, &Info));
+
+    CHECK(ERROR_INSUFFICIENT_BUFFER == Dissect(Udp4, 0, &Info));
+    CHECK(0 == Info.Layers);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+int main()
+{
+    TestVlan();
+    TestIpv4Options();
+    TestIpv6Extensions();
+    TestTcpOptions();
+    TestTruncated();
+
+    printf("%s\n", Failures ? "FAILED" : "ok");
+    return Failures ? 1 : 0;
+}
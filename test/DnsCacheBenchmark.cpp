@@ -0,0 +1,408 @@
+﻿/*
+DNS缓存（DnsCache.cpp）的验证和基准测试：键和过期，肯定和否定的应答，淘汰，getnameinfo，以及多线程的查找。
+
+Windows上单独编译运行（不在test.vcxproj的生成里），VS的开发人员命令提示符下：
+cl /std:c++17 /O2 /EHsc /DUNICODE /D_UNICODE /wd4819 DnsCacheBenchmark.cpp ..\libnet\DnsWire.cpp
+    ..\libnet\DnsReverse.cpp ..\libnet\DnsResolver.cpp
+
+直接包含DnsCache.cpp，键的验证要用它里面的NormalizeName（static的）。
+*/
+
+
+#include "..\libnet\DnsCache.cpp"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#define DNS_BENCH_THREADS 8
+
+
+typedef struct _DNS_CACHE_BENCH {
+    PDNS_CACHE Cache;
+    ULONG Names;
+    ULONG Lookups;             //每个线程的。
+    volatile LONG Thread;
+    volatile LONG Errors;
+} DNS_CACHE_BENCH, * PDNS_CACHE_BENCH;
+
+
+static ULONG BuildResponse(_Out_writes_bytes_(Capacity) PBYTE Buffer,
+                           _In_ ULONG Capacity,
+                           _In_z_ PCSTR Name,
+                           _In_ USHORT Rcode,
+                           _In_ ULONG Answers,
+                           _In_ BOOLEAN Soa)
+/*
+功能：构造一个应答。回答的TTL依次是300，120，...；SOA的TTL是3600，MINIMUM是30。
+*/
+{
+    static const BYTE SoaData[] = {2,   'n', 's', 0,   4, 'h', 'o', 's', 't', 0,   0, 0, 0, 1,   0, 0, 0x0E, 0x10,
+                                   0,   0,   2,   0x58, 0, 0,   0x93, 0x80,  0,   0, 0, 30};
+    DNS_WRITER Writer;
+
+    DnsWriterInit(&Writer, Buffer, Capacity, 0x1234, (USHORT)(DNS_FLAG_QR | 0x0100 | 0x0080 | Rcode));
+    DnsWriteQuestion(&Writer, Name, DNS_TYPE_A, DNS_CLASS_INTERNET);
+    for (ULONG i = 0; i < Answers; i++) {
+        ULONG Address = htonl(0x0A000001 + i);
+        DnsWriteRecord(&Writer,
+                       DNS_SECTION_ANSWER,
+                       Name,
+                       DNS_TYPE_A,
+                       DNS_CLASS_INTERNET,
+                       i ? 120 : 300,
+                       &Address,
+                       sizeof(Address));
+    }
+
+    if (Soa) {
+        DnsWriteRecord(&Writer,
+                       DNS_SECTION_AUTHORITY,
+                       "example.com",
+                       DNS_TYPE_SOA,
+                       DNS_CLASS_INTERNET,
+                       3600,
+                       SoaData,
+                       sizeof(SoaData));
+    }
+
+    return Writer.Length;
+}
+
+
+static ULONG BenchFind(_In_ PDNS_CACHE Cache, _In_z_ PCSTR Name, _In_ ULONGLONG Now)
+{
+    return CacheLookup(Cache, Name, DNS_TYPE_A, DNS_CLASS_INTERNET, nullptr, nullptr, nullptr, Now);
+}
+
+
+static BOOLEAN BenchFunctional()
+/*
+功能：键的规范化，过期，TTL的调整，否定的缓存，内存的上限和CLOCK淘汰。用内部的带时间的函数，不用等待。
+*/
+{
+    PDNS_CACHE Cache = nullptr;
+    DNS_CACHE_INFORMATION Information;
+    BYTE Message[512];
+    BYTE Out[512];
+    char Text[64];
+    ULONG Length, Ttl;
+    ULONGLONG Now = GetTickCount64();
+    BOOLEAN Good = TRUE;
+
+    if (ERROR_SUCCESS != DnsCacheCreate(0, 0, &Cache)) {
+        printf("DnsCacheCreate LastError:%d\n", GetLastError());
+        return FALSE;
+    }
+
+    //名字忽略大小写和末尾的点，类型和类别是键的一部分。
+    CacheInsert(Cache, "Www.Example.COM.", DNS_TYPE_A, DNS_CLASS_INTERNET, 0, "a", 2, 10, FALSE, Now);
+    Length = sizeof(Text);
+    Good &= ERROR_SUCCESS == CacheLookup(Cache, "www.example.com", DNS_TYPE_A, DNS_CLASS_INTERNET, Text, &Length,
+                                         &Ttl, Now + 9999) && 2 == Length && 0 == strcmp(Text, "a") && 1 == Ttl;
+    Good &= ERROR_NOT_FOUND == CacheLookup(Cache, "www.example.com", DNS_TYPE_AAAA, DNS_CLASS_INTERNET, nullptr,
+                                           nullptr, nullptr, Now);
+    Good &= ERROR_NOT_FOUND == BenchFind(Cache, "WWW.example.com", Now + 10000); //过期了。
+
+    Length = 1;
+    Good &= ERROR_MORE_DATA == CacheLookup(Cache, "www.example.com", DNS_TYPE_A, DNS_CLASS_INTERNET, Text, &Length,
+                                           nullptr, Now) && 2 == Length;
+
+    CacheInsert(Cache, "www.example.com", DNS_TYPE_A, DNS_CLASS_INTERNET, 0, "a", 2, 0, FALSE, Now); // TTL是0的删除。
+    Good &= ERROR_NOT_FOUND == BenchFind(Cache, "www.example.com", Now);
+    printf("keys and expiry: %s\n", Good ? "ok" : "FAILED");
+
+    //末尾的点要按转义判断：foo\.的点是转义的，foo\\.的是根。
+    {
+        static const struct {
+            PCSTR Name;
+            PCSTR Key;
+        } Keys[] = {
+            {"Foo.", "foo"},
+            {"foo\\.", "foo\\."},
+            {"foo\\\\.", "foo\\\\"},
+            {"foo\\\\\\.", "foo\\\\\\."},
+            {"a\\046.", "a\\046"},
+            {"a\\04.", "a\\04"}, //不是\DDD，只转义了0。
+            {"a\\.B.", "a\\.b"},
+            {".", "."},
+            {"", "."},
+        };
+        char Key[DNS_WIRE_MAX_NAME_TEXT];
+        USHORT KeyLength;
+        BOOLEAN Ok = TRUE;
+
+        for (ULONG i = 0; i < _ARRAYSIZE(Keys); i++) {
+            Ok &= ERROR_SUCCESS == NormalizeName(Keys[i].Name, Key, &KeyLength) &&
+                  strlen(Keys[i].Key) == KeyLength && 0 == strcmp(Key, Keys[i].Key);
+        }
+
+        // foo\\.和foo\\是同一个键，和foo\.（转义的点）不是。
+        CacheInsert(Cache, "foo\\\\.", DNS_TYPE_A, DNS_CLASS_INTERNET, 0, "b", 2, 10, FALSE, Now);
+        Ok &= ERROR_SUCCESS == BenchFind(Cache, "FOO\\\\", Now);
+        Ok &= ERROR_NOT_FOUND == BenchFind(Cache, "foo\\.", Now);
+
+        printf("escaped keys: %s\n", Ok ? "ok" : "FAILED");
+        Good &= Ok;
+    }
+
+    //正的应答：TTL是最小的，取出时报文里的TTL减去了经过的时间。
+    {
+        DNS_WIRE_MESSAGE Header;
+        DNS_WIRE_RECORD Records[4];
+
+        Length = BuildResponse(Message, sizeof(Message), "Two.Example.com", 0, 2, FALSE);
+        BOOLEAN Ok = ERROR_SUCCESS == CacheInsertResponse(Cache, Message, Length, Now);
+
+        Length = sizeof(Out);
+        Ok &= ERROR_SUCCESS == CacheLookup(Cache, "two.example.com", DNS_TYPE_A, DNS_CLASS_INTERNET, Out, &Length,
+                                           &Ttl, Now + 50000) && 70 == Ttl;
+        Ok &= ERROR_SUCCESS == DnsWireParse(Out, Length, &Header, Records, _ARRAYSIZE(Records)) &&
+              250 == Records[1].Ttl && 70 == Records[2].Ttl;
+        Ok &= ERROR_NOT_FOUND == BenchFind(Cache, "two.example.com", Now + 120000);
+
+        //原来的报文（缓存里的）不变。
+        Length = sizeof(Out);
+        Ok &= ERROR_SUCCESS == CacheLookup(Cache, "two.example.com", DNS_TYPE_A, DNS_CLASS_INTERNET, Out, &Length,
+                                           &Ttl, Now) && 120 == Ttl &&
+              ERROR_SUCCESS == DnsWireParse(Out, Length, &Header, Records, _ARRAYSIZE(Records)) &&
+              300 == Records[1].Ttl;
+
+        printf("positive response: %s\n", Ok ? "ok" : "FAILED");
+        Good &= Ok;
+    }
+
+    //否定的应答：TTL是SOA的MINIMUM，没有SOA的不缓存。
+    {
+        Length = BuildResponse(Message, sizeof(Message), "nx.example.com", DNS_RCODE_NXDOMAIN, 0, TRUE);
+        BOOLEAN Ok = ERROR_SUCCESS == CacheInsertResponse(Cache, Message, Length, Now);
+        Ok &= DNS_ERROR_RCODE_NAME_ERROR == CacheLookup(Cache, "nx.example.com", DNS_TYPE_A, DNS_CLASS_INTERNET,
+                                                        nullptr, nullptr, &Ttl, Now) && 30 == Ttl;
+        Ok &= ERROR_NOT_FOUND == BenchFind(Cache, "nx.example.com", Now + 30000);
+
+        Length = BuildResponse(Message, sizeof(Message), "nodata.example.com", 0, 0, TRUE);
+        Ok &= ERROR_SUCCESS == CacheInsertResponse(Cache, Message, Length, Now);
+        Ok &= DNS_INFO_NO_RECORDS == BenchFind(Cache, "nodata.example.com", Now);
+
+        Length = BuildResponse(Message, sizeof(Message), "nosoa.example.com", DNS_RCODE_NXDOMAIN, 0, FALSE);
+        Ok &= ERROR_NOT_SUPPORTED == CacheInsertResponse(Cache, Message, Length, Now);
+        Ok &= ERROR_NOT_FOUND == BenchFind(Cache, "nosoa.example.com", Now);
+
+        Length = BuildResponse(Message, sizeof(Message), "fail.example.com", 2, 0, TRUE); // SERVFAIL。
+        Ok &= ERROR_NOT_SUPPORTED == CacheInsertResponse(Cache, Message, Length, Now);
+
+        printf("negative response: %s\n", Ok ? "ok" : "FAILED");
+        Good &= Ok;
+    }
+
+    DnsCacheDestroy(Cache);
+    Cache = nullptr;
+
+    //内存的上限：一个片，不断地插入，常用的（每次都查找的）留下来。
+    if (ERROR_SUCCESS == DnsCacheCreate(DNS_CACHE_MIN_BYTES, 1, &Cache)) {
+        const ULONG Hot = 32;
+        ULONG Missing = 0;
+        ULONG MaxBytes = 0;
+
+        for (ULONG i = 0; i < 20000; i++) {
+            StringCchPrintfA(Text, _ARRAYSIZE(Text), "cold-%lu.example.com", i);
+            CacheInsert(Cache, Text, DNS_TYPE_A, DNS_CLASS_INTERNET, 0, Text, 40, 600, FALSE, Now);
+
+            if (i < Hot) {
+                StringCchPrintfA(Text, _ARRAYSIZE(Text), "hot-%lu.example.com", i);
+                CacheInsert(Cache, Text, DNS_TYPE_A, DNS_CLASS_INTERNET, 0, Text, 40, 600, FALSE, Now);
+            }
+
+            for (ULONG j = 0; j < Hot && 0 == i % 16; j++) {
+                StringCchPrintfA(Text, _ARRAYSIZE(Text), "hot-%lu.example.com", j);
+                Missing += ERROR_SUCCESS != BenchFind(Cache, Text, Now) && j <= i;
+            }
+
+            DnsCacheQuery(Cache, &Information);
+            MaxBytes = max(MaxBytes, (ULONG)Information.Bytes);
+        }
+
+        BOOLEAN Ok = 0 == Missing && MaxBytes <= DNS_CACHE_MIN_BYTES && Information.Evictions > 10000;
+        printf("eviction: %lu entries, %lu bytes (max %lu), %llu evictions, %lu hot missing, %s\n",
+               Information.Entries,
+               (ULONG)Information.Bytes,
+               MaxBytes,
+               Information.Evictions,
+               Missing,
+               Ok ? "ok" : "FAILED");
+        Good &= Ok;
+
+        DnsCacheDestroy(Cache);
+    }
+
+    return Good;
+}
+
+
+static BOOLEAN BenchNameInfo()
+/*
+功能：127.0.0.1的反向解析，第二次的（包括NI_NOFQDN的第二次）命中缓存。
+*/
+{
+    SOCKADDR_IN Address;
+    char Host[NI_MAXHOST];
+    char Cached[NI_MAXHOST];
+    DNS_CACHE_INFORMATION Before, After;
+    WSADATA wsaData;
+
+    if (ERROR_SUCCESS != WSAStartup(MAKEWORD(2, 2), &wsaData)) {
+        printf("WSAStartup LastError:%d\n", WSAGetLastError());
+        return FALSE;
+    }
+
+    PDNS_CACHE Cache = DnsCacheDefault();
+    if (nullptr == Cache) {
+        printf("DnsCacheDefault LastError:%d\n", GetLastError());
+        WSACleanup();
+        return FALSE;
+    }
+
+    RtlZeroMemory(&Address, sizeof(Address));
+    Address.sin_family = AF_INET;
+    Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    DnsCacheQuery(Cache, &Before);
+    int rc1 = DnsCacheGetNameInfo((SOCKADDR *)&Address, sizeof(Address), Host, sizeof(Host), 0);
+    int rc2 = DnsCacheGetNameInfo((SOCKADDR *)&Address, sizeof(Address), Cached, sizeof(Cached), 0);
+    int rc3 = DnsCacheGetNameInfo((SOCKADDR *)&Address, sizeof(Address), Cached, sizeof(Cached), NI_NOFQDN);
+    int rc4 = DnsCacheGetNameInfo((SOCKADDR *)&Address, sizeof(Address), Cached, sizeof(Cached), NI_NOFQDN);
+    DnsCacheQuery(Cache, &After);
+
+    //没有名字（负的缓存）时是数字的地址，也一样。
+    BOOLEAN Good = 0 == rc1 && 0 == rc2 && 0 == rc3 && 0 == rc4 &&
+                   After.Hits + After.NegativeHits - Before.Hits - Before.NegativeHits == 2 &&
+                   After.Misses - Before.Misses == 2;
+    printf("nameinfo: 127.0.0.1 -> %s (%s), %s\n", Host, Cached, Good ? "ok" : "FAILED");
+
+    WSACleanup();
+    return Good;
+}
+
+
+static VOID CALLBACK BenchLookupCallback(_Inout_ PTP_CALLBACK_INSTANCE Instance,
+                                         _Inout_opt_ PVOID Context,
+                                         _Inout_ PTP_WORK Work)
+{
+    PDNS_CACHE_BENCH Bench = reinterpret_cast<PDNS_CACHE_BENCH>(Context);
+    ULONG Seed = (ULONG)InterlockedIncrement(&Bench->Thread) * 0x9E3779B9;
+    LONG Errors = 0;
+    char Name[64];
+    BYTE Data[64];
+
+    UNREFERENCED_PARAMETER(Instance);
+    UNREFERENCED_PARAMETER(Work);
+
+    for (ULONG i = 0; i < Bench->Lookups; i++) {
+        Seed = Seed * 1664525 + 1013904223;
+
+        ULONG n = (Seed >> 8) % Bench->Names;
+        ULONG Length = sizeof(Data);
+
+        StringCchPrintfA(Name, _ARRAYSIZE(Name), "host-%lu.bench.example", n);
+        if (ERROR_SUCCESS != DnsCacheLookup(Bench->Cache, Name, DNS_TYPE_A, DNS_CLASS_INTERNET, Data, &Length,
+                                            nullptr) || sizeof(ULONG) != Length || 0 != memcmp(Data, &n, Length)) {
+            Errors++;
+        }
+    }
+
+    InterlockedAdd(&Bench->Errors, Errors);
+}
+
+
+static void BenchThroughput(_In_ ULONG Shards, _Inout_ PULONG Errors)
+/*
+功能：多个线程同时查找（都命中）。
+*/
+{
+    DNS_CACHE_BENCH Bench;
+    DNS_CACHE_INFORMATION Information;
+    LARGE_INTEGER Frequency, Start, End;
+    char Name[64];
+
+    RtlZeroMemory(&Bench, sizeof(Bench));
+    Bench.Names = 100000;
+    Bench.Lookups = 1000000;
+
+    ULONG ret = DnsCacheCreate(64 * 1024 * 1024, Shards, &Bench.Cache);
+    if (ERROR_SUCCESS != ret) {
+        printf("DnsCacheCreate LastError:%lu\n", ret);
+        (*Errors)++;
+        return;
+    }
+
+    for (ULONG i = 0; i < Bench.Names; i++) {
+        StringCchPrintfA(Name, _ARRAYSIZE(Name), "host-%lu.bench.example", i);
+        DnsCacheInsert(Bench.Cache, Name, DNS_TYPE_A, DNS_CLASS_INTERNET, ERROR_SUCCESS, &i, sizeof(i), 3600);
+    }
+
+    PTP_WORK Work = CreateThreadpoolWork(BenchLookupCallback, &Bench, nullptr);
+    if (nullptr == Work) {
+        printf("CreateThreadpoolWork LastError:%d\n", GetLastError());
+        DnsCacheDestroy(Bench.Cache);
+        (*Errors)++;
+        return;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (int i = 0; i < DNS_BENCH_THREADS; i++) {
+        SubmitThreadpoolWork(Work);
+    }
+
+    WaitForThreadpoolWorkCallbacks(Work, FALSE);
+    QueryPerformanceCounter(&End);
+    CloseThreadpoolWork(Work);
+
+    double Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+    ULONGLONG Total = (ULONGLONG)Bench.Lookups * DNS_BENCH_THREADS;
+
+    DnsCacheQuery(Bench.Cache, &Information);
+    printf("lookup: %lu shards, %d threads, %llu lookups in %.2f s, %.1f M/s, %llu hits, %ld errors, %.1f MB\n",
+           Information.Shards,
+           DNS_BENCH_THREADS,
+           Total,
+           Seconds,
+           Total / Seconds / 1000000,
+           Information.Hits,
+           Bench.Errors,
+           Information.Bytes / 1048576.0);
+    *Errors += Bench.Errors || Information.Hits != Total;
+
+    DnsCacheDestroy(Bench.Cache);
+}
+
+
+static void DnsCacheBenchmark()
+/*
+功能：DNS缓存的验证和基准测试。
+
+1.功能：见BenchFunctional。
+2.反向解析：第二次的来自缓存。
+3.吞吐量：多线程的查找，一个片（一把锁）和多个片的比较。
+*/
+{
+    ULONG Errors = 0;
+
+    Errors += BenchFunctional() ? 0 : 1;
+    Errors += BenchNameInfo() ? 0 : 1;
+    BenchThroughput(1, &Errors);
+    BenchThroughput(64, &Errors);
+
+    printf("%s\n", Errors ? "FAILED" : "ok");
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+int _cdecl main()
+{
+    DnsCacheBenchmark();
+
+    return 0;
+}
@@ -0,0 +1,628 @@
+﻿/*
+DNS记录的格式化（DnsFormat.cpp）的验证和基准测试。
+
+Windows上单独编译运行（不在test.vcxproj的生成里），VS的开发人员命令提示符下：
+cl /std:c++17 /O2 /EHsc /DUNICODE /D_UNICODE /wd4819 DnsFormatBenchmark.cpp ..\libnet\DnsWire.cpp
+    ..\libnet\IpAddr.cpp ..\libnet\IpClass.cpp
+
+直接包含DnsFormat.cpp，验证要用它里面的FORMAT_OUTPUT和PutText等（static的）。
+*/
+
+
+#include "..\libnet\DnsFormat.cpp"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#define DNS_FORMAT_SAMPLES 17
+#define DNS_FORMAT_STRIDE  (sizeof(DNS_RECORD) + 256) //变长的数据（TXT的字符串数组，DS的摘要等）的空间。
+
+
+//收集Flush的数据（验证用），或者只计数（基准测试用，Data是nullptr）。
+typedef struct _FORMAT_SINK {
+    PCHAR Data;
+    SIZE_T Capacity;
+    SIZE_T Length;
+    ULONG Checksum;
+} FORMAT_SINK, * PFORMAT_SINK;
+
+
+static ULONG WINAPI SinkFlush(_In_opt_ PVOID Context,
+                              _In_reads_bytes_(Length) const char * Data,
+                              _In_ ULONG Length)
+{
+    PFORMAT_SINK Sink = (PFORMAT_SINK)Context;
+
+    if (Sink->Data) {
+        if (Sink->Length + Length > Sink->Capacity) {
+            return ERROR_INSUFFICIENT_BUFFER;
+        }
+
+        RtlCopyMemory(Sink->Data + Sink->Length, Data, Length);
+    }
+
+    Sink->Length += Length;
+    Sink->Checksum += (BYTE)Data[0] + (BYTE)Data[Length - 1];
+    return ERROR_SUCCESS;
+}
+
+
+static void MakeSamples(_Out_writes_bytes_(DNS_FORMAT_SAMPLES * DNS_FORMAT_STRIDE) PBYTE Block)
+/*
+功能：每种格式化的类型一个记录（Block是清零的），按顺序用pNext连起来。
+*/
+{
+    static WCHAR Www[] = L"www.example.com";
+    static WCHAR Zone[] = L"example.com";
+    static WCHAR Txt0[] = L"v=spf1 -all";
+    static WCHAR Txt1[] = L"say \"hi\"\\ ok";
+    static WCHAR Txt2[] = L"tab\there";
+    static WCHAR Txt3[] = L"\x00e9t\x00e9";
+    static WCHAR Alias[] = L"alias.example.com";
+    static WCHAR Mail[] = L"mail.example.com";
+    static WCHAR Ns1[] = L"ns1.example.com.";
+    static WCHAR Admin[] = L"hostmaster.example.com.";
+    static WCHAR Service[] = L"_sip._tcp.example.com";
+    static WCHAR Sip[] = L"sip.example.com";
+    static WCHAR Reverse[] = L"1.2.0.192.in-addr.arpa";
+    static WCHAR Hash[] = L"0p9mhaveqvm6t7vbl5lop2u3t2rp3tom.example.com";
+    static WCHAR Cpu[] = L"PC";
+    static WCHAR Os[] = L"Windows";
+    static const BYTE Bitmap[] = {0x00, 0x07, 0x62, 0x01, 0x80, 0x08, 0x00, 0x03, 0x80};
+    PDNS_RECORD Records[DNS_FORMAT_SAMPLES];
+
+    for (ULONG i = 0; i < DNS_FORMAT_SAMPLES; i++) {
+        Records[i] = (PDNS_RECORD)(Block + i * DNS_FORMAT_STRIDE);
+        if (i + 1 < DNS_FORMAT_SAMPLES) {
+            Records[i]->pNext = (PDNS_RECORD)(Block + (i + 1) * DNS_FORMAT_STRIDE);
+        }
+        Records[i]->pName = Zone;
+        Records[i]->dwTtl = 300;
+        Records[i]->Flags.S.Section = 1;
+        Records[i]->Flags.S.CharSet = DnsCharSetUnicode;
+    }
+
+    Records[0]->pName = Www;
+    Records[0]->wType = DNS_TYPE_A;
+    Records[0]->Data.A.IpAddress = 0x010200C0; // 192.0.2.1
+
+    Records[1]->pName = Www;
+    Records[1]->wType = DNS_TYPE_AAAA;
+    Records[1]->Data.AAAA.Ip6Address.IP6Byte[0] = 0x20;
+    Records[1]->Data.AAAA.Ip6Address.IP6Byte[1] = 0x01;
+    Records[1]->Data.AAAA.Ip6Address.IP6Byte[2] = 0x0d;
+    Records[1]->Data.AAAA.Ip6Address.IP6Byte[3] = 0xb8;
+    Records[1]->Data.AAAA.Ip6Address.IP6Byte[15] = 1;
+
+    Records[2]->pName = Alias;
+    Records[2]->wType = DNS_TYPE_CNAME;
+    Records[2]->Data.CNAME.pNameHost = Www;
+
+    Records[3]->wType = DNS_TYPE_MX;
+    Records[3]->Data.MX.wPreference = 10;
+    Records[3]->Data.MX.pNameExchange = Mail;
+
+    Records[4]->wType = DNS_TYPE_TEXT;
+    Records[4]->Data.TXT.dwStringCount = 4;
+    Records[4]->Data.TXT.pStringArray[0] = Txt0;
+    Records[4]->Data.TXT.pStringArray[1] = Txt1;
+    Records[4]->Data.TXT.pStringArray[2] = Txt2;
+    Records[4]->Data.TXT.pStringArray[3] = Txt3;
+
+    Records[5]->wType = DNS_TYPE_SOA;
+    Records[5]->dwTtl = 3600;
+    Records[5]->Data.SOA.pNamePrimaryServer = Ns1;
+    Records[5]->Data.SOA.pNameAdministrator = Admin;
+    Records[5]->Data.SOA.dwSerialNo = 2024010101;
+    Records[5]->Data.SOA.dwRefresh = 7200;
+    Records[5]->Data.SOA.dwRetry = 3600;
+    Records[5]->Data.SOA.dwExpire = 1209600;
+    Records[5]->Data.SOA.dwDefaultTtl = 300;
+
+    Records[6]->pName = Service;
+    Records[6]->wType = DNS_TYPE_SRV;
+    Records[6]->Data.SRV.wPriority = 10;
+    Records[6]->Data.SRV.wWeight = 60;
+    Records[6]->Data.SRV.wPort = 5060;
+    Records[6]->Data.SRV.pNameTarget = Sip;
+
+    Records[7]->pName = Reverse;
+    Records[7]->wType = DNS_TYPE_PTR;
+    Records[7]->Data.PTR.pNameHost = Www;
+
+    Records[8]->wType = DNS_TYPE_DS;
+    Records[8]->Data.DS.wKeyTag = 12345;
+    Records[8]->Data.DS.chAlgorithm = 8;
+    Records[8]->Data.DS.chDigestType = 2;
+    Records[8]->Data.DS.wDigestLength = 32;
+    for (ULONG i = 0; i < 32; i++) {
+        Records[8]->Data.DS.Digest[i] = (BYTE)(i * 7);
+    }
+
+    Records[9]->wType = DNS_TYPE_DNSKEY;
+    Records[9]->Data.KEY.wFlags = 257;
+    Records[9]->Data.KEY.chProtocol = 3;
+    Records[9]->Data.KEY.chAlgorithm = 8;
+    Records[9]->Data.KEY.wKeyLength = 5;
+    RtlCopyMemory(Records[9]->Data.KEY.Key, "hello", 5);
+
+    Records[10]->wType = DNS_TYPE_RRSIG;
+    Records[10]->Data.SIG.wTypeCovered = DNS_TYPE_A;
+    Records[10]->Data.SIG.chAlgorithm = 8;
+    Records[10]->Data.SIG.chLabelCount = 2;
+    Records[10]->Data.SIG.dwOriginalTtl = 300;
+    Records[10]->Data.SIG.dwExpiration = 1700000000;
+    Records[10]->Data.SIG.dwTimeSigned = 1690000000;
+    Records[10]->Data.SIG.wKeyTag = 12345;
+    Records[10]->Data.SIG.pNameSigner = Zone;
+    Records[10]->Data.SIG.wSignatureLength = 4;
+    RtlCopyMemory(Records[10]->Data.SIG.Signature, "\x01\x02\x03\x04", 4);
+
+    Records[11]->wType = DNS_TYPE_NSEC;
+    Records[11]->Data.NSEC.pNextDomainName = Www;
+    Records[11]->Data.NSEC.wTypeBitMapsLength = 9;
+    RtlCopyMemory(Records[11]->Data.NSEC.TypeBitMaps, Bitmap, sizeof(Bitmap));
+
+    Records[12]->pName = Hash;
+    Records[12]->wType = DNS_TYPE_NSEC3;
+    Records[12]->Data.NSEC3.chAlgorithm = 1;
+    Records[12]->Data.NSEC3.wIterations = 10;
+    Records[12]->Data.NSEC3.bSaltLength = 4;
+    Records[12]->Data.NSEC3.bHashLength = 20;
+    Records[12]->Data.NSEC3.wTypeBitMapsLength = 8;
+    RtlCopyMemory(Records[12]->Data.NSEC3.chData, "\xAA\xBB\xCC\xDD", 4);
+    for (ULONG i = 0; i < 20; i++) {
+        Records[12]->Data.NSEC3.chData[4 + i] = (BYTE)(i * 13);
+    }
+    RtlCopyMemory(Records[12]->Data.NSEC3.chData + 24, "\x00\x06\x40\x00\x00\x00\x00\x02", 8); // A RRSIG
+
+    Records[13]->wType = DNS_TYPE_NSEC3PARAM;
+    Records[13]->dwTtl = 0;
+    Records[13]->Data.NSEC3PARAM.chAlgorithm = 1;
+    Records[13]->Data.NSEC3PARAM.wIterations = 10;
+
+    Records[14]->wType = DNS_TYPE_NULL;
+    Records[14]->Data.Null.dwByteCount = 3;
+    RtlCopyMemory(Records[14]->Data.Null.Data, "\x01\x02\x03", 3);
+
+    Records[15]->pName = Www;
+    Records[15]->wType = DNS_TYPE_HINFO;
+    Records[15]->Data.HINFO.dwStringCount = 2;
+    Records[15]->Data.HINFO.pStringArray[0] = Cpu;
+    Records[15]->Data.HINFO.pStringArray[1] = Os;
+
+    Records[16]->pName = Www;
+    Records[16]->wType = DNS_TYPE_WKS; //不支持的类型：只有TEXT格式写（头）。
+}
+
+
+static ULONG ExpectFormat(_In_ const DNS_RECORD * Record,
+                          _In_ ULONG Format,
+                          _In_z_ PCSTR Expected,
+                          _In_ BOOLEAN Suffix)
+/*
+功能：检查一个记录的格式化的结果（Suffix：只比较结尾）。返回错误的个数。
+*/
+{
+    char Buffer[DNS_FORMAT_BUFFER_SIZE];
+    ULONG Length = 0;
+    const ULONG Status = DnsFormatRecord(Record, Format, Buffer, sizeof(Buffer), &Length);
+    const SIZE_T Size = strlen(Expected);
+
+    if (ERROR_SUCCESS != Status || Length < Size || strcmp(Buffer + (Suffix ? Length - Size : 0), Expected)) {
+        printf("type %u format %lu: got \"%.*s\"\n", Record->wType, Format, (int)Length, Buffer);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+static ULONG VerifyText(_In_reads_(DNS_FORMAT_SAMPLES) PDNS_RECORD * Records)
+/*
+功能：各个格式的典型的输出；TEXT格式和原来的XxxRecordPrint的printf的输出相同。
+*/
+{
+    char Old[512];
+    ULONG Errors = 0;
+
+    Errors += ExpectFormat(Records[0], DNS_FORMAT_ZONE, "www.example.com.\t300\tIN\tA\t192.0.2.1\n", FALSE);
+    Errors += ExpectFormat(Records[0],
+                           DNS_FORMAT_JSON,
+                           "{\"name\":\"www.example.com\",\"type\":\"A\",\"ttl\":300,\"section\":1,"
+                           "\"address\":\"192.0.2.1\"}",
+                           FALSE);
+    Errors += ExpectFormat(Records[1], DNS_FORMAT_ZONE, "\tAAAA\t2001:db8::1\n", TRUE);
+    Errors += ExpectFormat(Records[4],
+                           DNS_FORMAT_ZONE,
+                           "\tTXT\t\"v=spf1 -all\" \"say \\\"hi\\\"\\\\ ok\" "
+                           "\"tab\\009here\" \"\\195\\169t\\195\\169\"\n",
+                           TRUE);
+    Errors += ExpectFormat(Records[4],
+                           DNS_FORMAT_JSON,
+                           ",\"strings\":[\"v=spf1 -all\",\"say \\\"hi\\\"\\\\ ok\","
+                           "\"tab\\u0009here\",\"\xC3\xA9t\xC3\xA9\"]}",
+                           TRUE);
+    Errors += ExpectFormat(Records[5],
+                           DNS_FORMAT_ZONE,
+                           "example.com.\t3600\tIN\tSOA\tns1.example.com. hostmaster.example.com. "
+                           "2024010101 7200 3600 1209600 300\n",
+                           FALSE);
+    Errors += ExpectFormat(Records[8],
+                           DNS_FORMAT_ZONE,
+                           "\tDS\t12345 8 2 00070E151C232A31383F464D545B626970777E858C939AA1A8AFB6BDC4CBD2D9\n",
+                           TRUE);
+    Errors += ExpectFormat(Records[9], DNS_FORMAT_ZONE, "\tDNSKEY\t257 3 8 aGVsbG8=\n", TRUE);
+    Errors += ExpectFormat(Records[10],
+                           DNS_FORMAT_ZONE,
+                           "\tRRSIG\tA 8 2 300 1700000000 1690000000 12345 example.com. AQIDBA==\n",
+                           TRUE);
+    Errors += ExpectFormat(Records[11],
+                           DNS_FORMAT_ZONE,
+                           "\tNSEC\twww.example.com. A NS SOA MX TXT AAAA RRSIG NSEC DNSKEY\n",
+                           TRUE);
+    Errors += ExpectFormat(Records[11],
+                           DNS_FORMAT_JSON,
+                           "\"types\":[\"A\",\"NS\",\"SOA\",\"MX\",\"TXT\",\"AAAA\","
+                           "\"RRSIG\",\"NSEC\",\"DNSKEY\"]}",
+                           TRUE);
+    Errors += ExpectFormat(Records[12],
+                           DNS_FORMAT_ZONE,
+                           "\tNSEC3\t1 0 10 AABBCCDD 006HK9PK8575MQ3LGA7PPADMOF8DRQNN A RRSIG\n",
+                           TRUE);
+    Errors += ExpectFormat(Records[13], DNS_FORMAT_ZONE, "\tNSEC3PARAM\t1 0 10 -\n", TRUE);
+    Errors += ExpectFormat(Records[14], DNS_FORMAT_ZONE, "\tNULL\t\\# 3 010203\n", TRUE);
+    Errors += ExpectFormat(Records[15], DNS_FORMAT_ZONE, "\tHINFO\t\"PC\" \"Windows\"\n", TRUE);
+
+    sprintf_s(Old, sizeof(Old), "\tDataLength     = %u\n\tIP address     = %s\n", 0, "192.0.2.1");
+    Errors += ExpectFormat(Records[0], DNS_FORMAT_TEXT, Old, TRUE);
+    sprintf_s(Old, sizeof(Old), "\tPreference     = %u\n\tExchange       = %s\n", 10, "mail.example.com");
+    Errors += ExpectFormat(Records[3], DNS_FORMAT_TEXT, Old, TRUE);
+    sprintf_s(Old,
+              sizeof(Old),
+              "\tString[%d]      = %s\n\tString[%d]      = %s\n",
+              1,
+              "PC",
+              2,
+              "Windows");
+    Errors += ExpectFormat(Records[15], DNS_FORMAT_TEXT, Old, TRUE);
+    sprintf_s(Old,
+              sizeof(Old),
+              "\tPriority       = %u\n\tWeight         = %u\n\tPort           = %u\n\tTarget Host    = %s\n",
+              10,
+              60,
+              5060,
+              "sip.example.com");
+    Errors += ExpectFormat(Records[6], DNS_FORMAT_TEXT, Old, TRUE);
+    sprintf_s(Old,
+              sizeof(Old),
+              "\tFlags                = 0x%04x\n\tProtocol             = %u\n\tAlgorithm            = %u\n",
+              257,
+              3,
+              8);
+    Errors += ExpectFormat(Records[9], DNS_FORMAT_TEXT, Old, TRUE);
+    sprintf_s(Old,
+              sizeof(Old),
+              "\tHashAlgorithm                   = %u\n\tFlags                           = 0x%02x\n"
+              "\tIterations                      = %u\n",
+              1,
+              0,
+              10);
+    Errors += ExpectFormat(Records[12], DNS_FORMAT_TEXT, Old, TRUE);
+    sprintf_s(Old, sizeof(Old), "\tReserved       = %u\n\tDataLength     = %u\n", 0, 0);
+    Errors += ExpectFormat(Records[16], DNS_FORMAT_TEXT, Old, TRUE);
+
+    return Errors;
+}
+
+
+static ULONG VerifyLength(_In_ const DNS_RECORD * Records)
+/*
+功能：需要的长度是准确的：少一个字节的返回ERROR_INSUFFICIENT_BUFFER，并且没有写到Capacity之外。
+*/
+{
+    char Buffer[DNS_FORMAT_BUFFER_SIZE];
+    char Exact[DNS_FORMAT_BUFFER_SIZE];
+    ULONG Errors = 0;
+
+    for (const DNS_RECORD * Record = Records; Record; Record = Record->pNext) {
+        for (ULONG Format = DNS_FORMAT_TEXT; Format <= DNS_FORMAT_BINARY; Format++) {
+            ULONG Length = 0;
+            ULONG Small = 0;
+            ULONG Status = DnsFormatRecord(Record, Format, nullptr, 0, &Length);
+
+            if (ERROR_NOT_SUPPORTED == Status) {
+                continue;
+            }
+
+            if (ERROR_INSUFFICIENT_BUFFER != Status || 0 == Length || Length >= sizeof(Buffer)) {
+                Errors++;
+                continue;
+            }
+
+            RtlFillMemory(Buffer, sizeof(Buffer), 0xCC);
+            Status = DnsFormatRecord(Record, Format, Buffer, Length - 1, &Small);
+            if (ERROR_INSUFFICIENT_BUFFER != Status || Small != Length || (BYTE)Buffer[Length - 1] != 0xCC) {
+                Errors++;
+            }
+
+            Status = DnsFormatRecord(Record, Format, Exact, Length, &Small);
+            if (ERROR_SUCCESS != Status || Small != Length || memcmp(Buffer, Exact, Length - 1)) {
+                Errors++;
+            }
+        }
+    }
+
+    return Errors;
+}
+
+
+static ULONG VerifyBinary(_In_ const DNS_RECORD * Records)
+/*
+功能：二进制的格式加上报文的头，能被DnsWireParse解析，类型，TTL，名字和RDATA的长度一致。
+*/
+{
+    BYTE Message[DNS_FORMAT_BUFFER_SIZE] = {0};
+    DNS_WIRE_MESSAGE Header;
+    DNS_WIRE_RECORD Parsed[DNS_FORMAT_SAMPLES];
+    const DNS_RECORD * Expected[DNS_FORMAT_SAMPLES];
+    ULONG Length = DNS_WIRE_HEADER_SIZE;
+    ULONG Count = 0;
+    ULONG Errors = 0;
+
+    for (const DNS_RECORD * Record = Records; Record; Record = Record->pNext) {
+        ULONG Size = 0;
+
+        if (ERROR_SUCCESS == DnsFormatRecord(Record,
+                                             DNS_FORMAT_BINARY,
+                                             (PCHAR)Message + Length,
+                                             sizeof(Message) - Length,
+                                             &Size)) {
+            Expected[Count++] = Record;
+            Length += Size;
+        }
+    }
+
+    Message[7] = (BYTE)Count; // ANCOUNT
+    if (ERROR_SUCCESS != DnsWireParse(Message, Length, &Header, Parsed, _ARRAYSIZE(Parsed)) ||
+        Header.Records != Count || Header.Length != Length) {
+        return 1;
+    }
+
+    for (ULONG i = 0; i < Count; i++) {
+        char Name[DNS_WIRE_MAX_NAME_TEXT];
+        char Text[DNS_WIRE_MAX_NAME_TEXT];
+        FORMAT_OUTPUT Out;
+
+        OutputInit(&Out, DNS_FORMAT_TEXT, Text, sizeof(Text) - 1, 0);
+        PutText(&Out, Expected[i]->pName, TRUE, ESCAPE_NONE);
+        Text[Out.Length] = 0;
+
+        DnsWireReadName(Message, Length, Parsed[i].Name, Name, sizeof(Name), nullptr);
+        if (Parsed[i].Type != Expected[i]->wType || Parsed[i].Ttl != Expected[i]->dwTtl || strcmp(Name, Text)) {
+            Errors++;
+        }
+    }
+
+    if (Parsed[0].DataLength != 4 || Parsed[1].DataLength != 16 || Parsed[5].DataLength != 20 + 17 + 24) {
+        Errors++;
+    }
+
+    return Errors;
+}
+
+
+static ULONG VerifyWriter(_In_ const DNS_RECORD * Records)
+/*
+功能：流式的写入和逐个DnsFormatRecord的结果相同，缓冲区很小（每个记录都要分段）时也相同。
+*/
+{
+    const SIZE_T Capacity = 64 * 1024;
+    PCHAR Large = (PCHAR)MALLOC(Capacity * 3);
+    PCHAR Small = Large + Capacity;
+    PCHAR Concat = Small + Capacity;
+    ULONG Errors = 0;
+
+    if (nullptr == Large) {
+        return 1;
+    }
+
+    for (ULONG Format = DNS_FORMAT_TEXT; Format <= DNS_FORMAT_BINARY; Format++) {
+        char Buffer[DNS_FORMAT_BUFFER_SIZE];
+        char Tiny[16];
+        FORMAT_SINK Sink1 = {Large, Capacity, 0, 0};
+        FORMAT_SINK Sink2 = {Small, Capacity, 0, 0};
+        DNS_FORMAT_WRITER Writer1;
+        DNS_FORMAT_WRITER Writer2;
+        SIZE_T Length = 0;
+        ULONG Skipped = 0;
+
+        DnsFormatWriterInit(&Writer1, Format, Buffer, sizeof(Buffer), SinkFlush, &Sink1);
+        DnsFormatWriterInit(&Writer2, Format, Tiny, sizeof(Tiny), SinkFlush, &Sink2);
+        if (DnsFormatWriterAppend(&Writer1, Records) || DnsFormatWriterFinish(&Writer1) ||
+            DnsFormatWriterAppend(&Writer2, Records) || DnsFormatWriterFinish(&Writer2)) {
+            Errors++;
+            continue;
+        }
+
+        for (const DNS_RECORD * Record = Records; Record; Record = Record->pNext) {
+            ULONG Size = 0;
+
+            if (Format == DNS_FORMAT_JSON) {
+                const char * Separator = Length ? ",\n" : "[\n";
+
+                RtlCopyMemory(Concat + Length, Separator, 2);
+                Length += 2;
+            }
+
+            const ULONG Status =
+                DnsFormatRecord(Record, Format, Concat + Length, (ULONG)(Capacity - Length), &Size);
+
+            if (ERROR_SUCCESS == Status) {
+                Length += Size;
+            } else {
+                Length -= Format == DNS_FORMAT_JSON ? 2 : 0;
+                Skipped++;
+            }
+        }
+
+        if (Format == DNS_FORMAT_JSON) {
+            RtlCopyMemory(Concat + Length, "\n]\n", 3);
+            Length += 3;
+        }
+
+        if (Sink1.Length != Length || Sink2.Length != Length || memcmp(Large, Concat, Length) ||
+            memcmp(Small, Concat, Length) || Writer1.Skipped != Skipped || Writer1.Written != Length ||
+            Writer1.Records + Skipped != DNS_FORMAT_SAMPLES) {
+            printf("writer: format %lu mismatch\n", Format);
+            Errors++;
+        }
+    }
+
+    FREE(Large);
+    return Errors;
+}
+
+
+static void DnsFormatBenchmark()
+/*
+功能：DNS记录的格式化的验证和基准测试。
+
+1.各个格式的典型的输出，TEXT格式和原来的printf的输出一致；需要的长度的准确性；
+  二进制的格式能被DnsWireParse解析；流式的写入（包括很小的缓冲区）和逐个格式化的结果一致。
+2.各个格式的速度（记录/秒，MB/秒），以及和sprintf的比较。
+*/
+{
+    const ULONG Count = 20000;
+    const ULONG Rounds = 10;
+    PBYTE Samples = (PBYTE)MALLOC(DNS_FORMAT_SAMPLES * DNS_FORMAT_STRIDE);
+    PBYTE List = (PBYTE)MALLOC((SIZE_T)Count * DNS_FORMAT_STRIDE);
+    PDNS_RECORD Records[DNS_FORMAT_SAMPLES];
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG Errors = 0;
+
+    if (nullptr == Samples || nullptr == List) {
+        printf("LastError:%d\n", GetLastError());
+        goto Cleanup;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    MakeSamples(Samples);
+    for (ULONG i = 0; i < DNS_FORMAT_SAMPLES; i++) {
+        Records[i] = (PDNS_RECORD)(Samples + i * DNS_FORMAT_STRIDE);
+    }
+
+    {
+        ULONG Text = VerifyText(Records);
+        ULONG Length = VerifyLength(Records[0]);
+        ULONG Binary = VerifyBinary(Records[0]);
+        ULONG Writer = VerifyWriter(Records[0]);
+
+        printf("verify: text %s, length %s, binary %s, writer %s\n",
+               Text ? "FAILED" : "ok",
+               Length ? "FAILED" : "ok",
+               Binary ? "FAILED" : "ok",
+               Writer ? "FAILED" : "ok");
+        Errors += Text + Length + Binary + Writer;
+    }
+
+    for (ULONG i = 0; i < Count; i++) { //不支持的类型（最后一个）不放进去。
+        const PBYTE Record = List + (SIZE_T)i * DNS_FORMAT_STRIDE;
+
+        RtlCopyMemory(Record, Records[i % (DNS_FORMAT_SAMPLES - 1)], DNS_FORMAT_STRIDE);
+        ((PDNS_RECORD)Record)->pNext = i + 1 < Count ? (PDNS_RECORD)(Record + DNS_FORMAT_STRIDE) : nullptr;
+    }
+
+    for (ULONG Format = DNS_FORMAT_TEXT; Format <= DNS_FORMAT_BINARY; Format++) {
+        static const PCSTR Names[] = {"text", "zone", "json", "binary"};
+        char Buffer[DNS_FORMAT_BUFFER_SIZE * 16];
+        FORMAT_SINK Sink = {nullptr, 0, 0, 0};
+
+        QueryPerformanceCounter(&Start);
+        for (ULONG r = 0; r < Rounds; r++) {
+            DNS_FORMAT_WRITER Writer;
+
+            DnsFormatWriterInit(&Writer, Format, Buffer, sizeof(Buffer), SinkFlush, &Sink);
+            if (DnsFormatWriterAppend(&Writer, (PDNS_RECORD)List) || DnsFormatWriterFinish(&Writer) ||
+                Writer.Records != Count) {
+                Errors++;
+            }
+        }
+        QueryPerformanceCounter(&End);
+
+        double Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+        printf("%s: %.2f M records/s, %.0f MB/s, %.1f bytes/record (%lu)\n",
+               Names[Format],
+               (double)Rounds * Count / Seconds / 1e6,
+               (double)Sink.Length / Seconds / 1048576,
+               (double)Sink.Length / Rounds / Count,
+               Sink.Checksum);
+    }
+
+    {
+        char Buffer[256];
+        ULONG Checksum = 0;
+        double Seconds[2];
+
+        QueryPerformanceCounter(&Start);
+        for (ULONG r = 0; r < Rounds * 10; r++) {
+            for (ULONG i = 0; i < DNS_FORMAT_SAMPLES - 1; i++) {
+                IN_ADDR Address{};
+                char Text[MAX_ADDRESS_STRING_LENGTH];
+
+                Address.S_un.S_addr = Records[0]->Data.A.IpAddress + r;
+                RtlIpv4AddressToStringA(&Address, Text);
+                Checksum += sprintf_s(Buffer,
+                                      sizeof(Buffer),
+                                      "%ls.\t%u\tIN\tA\t%s\n",
+                                      Records[0]->pName,
+                                      Records[0]->dwTtl,
+                                      Text);
+            }
+        }
+        QueryPerformanceCounter(&End);
+        Seconds[0] = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+
+        QueryPerformanceCounter(&Start);
+        for (ULONG r = 0; r < Rounds * 10; r++) {
+            for (ULONG i = 0; i < DNS_FORMAT_SAMPLES - 1; i++) {
+                ULONG Length = 0;
+
+                Records[0]->Data.A.IpAddress += r;
+                DnsFormatRecord(Records[0], DNS_FORMAT_ZONE, Buffer, sizeof(Buffer), &Length);
+                Records[0]->Data.A.IpAddress -= r;
+                Checksum += Length;
+            }
+        }
+        QueryPerformanceCounter(&End);
+        Seconds[1] = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+
+        printf("zone A: sprintf %.2f M/s, DnsFormatRecord %.2f M/s (%lu)\n",
+               (double)Rounds * 10 * (DNS_FORMAT_SAMPLES - 1) / Seconds[0] / 1e6,
+               (double)Rounds * 10 * (DNS_FORMAT_SAMPLES - 1) / Seconds[1] / 1e6,
+               Checksum);
+    }
+
+    printf("%s\n", Errors ? "FAILED" : "ok");
+
+Cleanup:
+    if (List) {
+        FREE(List);
+    }
+
+    if (Samples) {
+        FREE(Samples);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+int _cdecl main()
+{
+    DnsFormatBenchmark();
+
+    return 0;
+}
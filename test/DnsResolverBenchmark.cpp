@@ -0,0 +1,571 @@
+﻿/*
+异步DNS解析器（DnsResolver.cpp）的验证和基准测试，服务器是同一个线程里的桩。
+
+Windows上单独编译运行（不在test.vcxproj的生成里），VS的开发人员命令提示符下：
+cl /std:c++17 /O2 /EHsc /DUNICODE /D_UNICODE /wd4819 DnsResolverBenchmark.cpp ..\libnet\DnsWire.cpp
+    ..\libnet\DnsCache.cpp ..\libnet\DnsReverse.cpp
+
+直接包含DnsResolver.cpp，桩要用它里面的DNS_RESOLVER_PACKET等（static的）。
+*/
+
+
+#include "..\libnet\DnsResolver.cpp"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//测试：同一个线程里的一个本地的（127.0.0.1）DNS服务器的桩。
+
+
+#define DNS_STUB_CONNECTIONS 16
+#define DNS_STUB_DROP        101 //大约每这么多个名字丢一个（第一次的UDP的查询）。
+#define DNS_STUB_TCP_ANSWERS 20
+#define DNS_STUB_BOGUS       0x06060606 //伪造的应答里的地址，不应该被接受。
+
+
+typedef struct _DNS_STUB {
+    SOCKET Udp;
+    SOCKET Rogue;       //从别的端口发送伪造的应答。
+    SOCKET Listen;      //和Udp是同一个端口。
+    SOCKET Connections[DNS_STUB_CONNECTIONS];
+    ULONG Received[DNS_STUB_CONNECTIONS];
+    BYTE In[DNS_STUB_CONNECTIONS][2 + DNS_RESOLVER_PACKET];
+    SOCKADDR_INET Address;
+    BYTE Dropped[0x10000 / 8]; //丢过的名字（哈希的高16位），重传的不再丢。
+} DNS_STUB, * PDNS_STUB;
+
+
+typedef struct _DNS_BENCH {
+    ULONG Completed;
+    ULONG Cancelled;
+    ULONG Errors;
+} DNS_BENCH, * PDNS_BENCH;
+
+
+static ULONG DnsNameHash(_In_z_ PCSTR Name) //忽略大小写的FNV-1a，桩用它作为A记录的地址。
+{
+    ULONG Hash = 0x811c9dc5;
+
+    for (PCSTR p = Name; *p; p++) {
+        BYTE c = (BYTE)*p;
+        Hash = (Hash ^ ((c >= 'A' && c <= 'Z') ? c | 0x20 : c)) * 0x01000193;
+    }
+
+    return Hash;
+}
+
+
+static ULONG StubBuild(_Out_writes_bytes_(Capacity) PBYTE Out,
+                       _In_ ULONG Capacity,
+                       _In_ USHORT Id,
+                       _In_ USHORT Flags,
+                       _In_z_ PCSTR Name,
+                       _In_ USHORT Type,
+                       _In_ ULONG Answers,
+                       _In_ ULONG Address)
+{
+    DNS_WRITER Writer;
+
+    DnsWriterInit(&Writer, Out, Capacity, Id, Flags);
+    DnsWriteQuestion(&Writer, Name, Type, DNS_CLASS_INTERNET);
+    for (ULONG i = 0; i < Answers; i++) {
+        ULONG Data = htonl(Address + i);
+        DnsWriteRecord(&Writer, DNS_SECTION_ANSWER, Name, DNS_TYPE_A, DNS_CLASS_INTERNET, 60, &Data, sizeof(Data));
+    }
+
+    return Writer.Length;
+}
+
+
+static void StubClose(_Inout_ PDNS_STUB Stub)
+{
+    SOCKET * Sockets[] = {&Stub->Udp, &Stub->Rogue, &Stub->Listen};
+
+    for (int i = 0; i < _ARRAYSIZE(Sockets); i++) {
+        if (INVALID_SOCKET != *Sockets[i]) {
+            closesocket(*Sockets[i]);
+        }
+    }
+
+    for (int i = 0; i < DNS_STUB_CONNECTIONS; i++) {
+        if (INVALID_SOCKET != Stub->Connections[i]) {
+            closesocket(Stub->Connections[i]);
+        }
+    }
+}
+
+
+static ULONG StubOpen(_Out_ PDNS_STUB Stub)
+/*
+功能：打开桩：127.0.0.1上的一个UDP端口和同一个端口的TCP的监听，都是非阻塞的。
+*/
+{
+    SOCKET * Sockets[] = {&Stub->Udp, &Stub->Rogue, &Stub->Listen};
+    u_long NonBlocking = 1;
+    int Size = 4 * 1024 * 1024;
+    int Length = sizeof(SOCKADDR_IN);
+
+    RtlZeroMemory(Stub, sizeof(DNS_STUB));
+    Stub->Udp = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    Stub->Rogue = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    Stub->Listen = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    for (int i = 0; i < DNS_STUB_CONNECTIONS; i++) {
+        Stub->Connections[i] = INVALID_SOCKET;
+    }
+
+    Stub->Address.si_family = AF_INET;
+    Stub->Address.Ipv4.sin_addr.s_addr = htonl(0x7F000001);
+
+    for (int i = 0; i < _ARRAYSIZE(Sockets); i++) {
+        if (INVALID_SOCKET == *Sockets[i] || SOCKET_ERROR == ioctlsocket(*Sockets[i], FIONBIO, &NonBlocking)) {
+            return WSAGetLastError();
+        }
+    }
+
+    setsockopt(Stub->Udp, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char *>(&Size), sizeof(Size));
+
+    PSOCKADDR Address = reinterpret_cast<PSOCKADDR>(&Stub->Address);
+
+    if (SOCKET_ERROR == bind(Stub->Udp, Address, sizeof(SOCKADDR_IN)) ||
+        SOCKET_ERROR == getsockname(Stub->Udp, Address, &Length) ||
+        SOCKET_ERROR == bind(Stub->Listen, Address, sizeof(SOCKADDR_IN)) || SOCKET_ERROR == listen(Stub->Listen, 64)) {
+        return WSAGetLastError();
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+static void StubUdp(_Inout_ PDNS_STUB Stub)
+/*
+功能：回答所有的UDP的查询。名字的前缀决定行为：
+sink-：不回答（超时）；nx-：NXDOMAIN；tc-：截断（TC）；
+spoof-：先发送三个伪造的应答（别的端口的，ID错误的，问题错误的），再发送正确的；
+其余的：一个A记录，地址是名字的哈希。名字的哈希是DNS_STUB_DROP的倍数的，第一次的查询丢掉（验证重传）。
+回答的名字用大写的（验证忽略大小写的比较）。
+*/
+{
+    BYTE In[DNS_RESOLVER_PACKET + 64];
+    BYTE Out[512];
+    char Name[DNS_WIRE_MAX_NAME_TEXT];
+
+    for (;;) {
+        SOCKADDR_INET From;
+        int FromLength = sizeof(From);
+        DNS_WIRE_MESSAGE Header;
+        DNS_WIRE_RECORD Question;
+
+        int Length = recvfrom(Stub->Udp,
+                              reinterpret_cast<char *>(In),
+                              sizeof(In),
+                              0,
+                              reinterpret_cast<SOCKADDR *>(&From),
+                              &FromLength);
+        if (SOCKET_ERROR == Length) {
+            break;
+        }
+
+        ULONG ret = DnsWireParse(In, Length, &Header, &Question, 1); //后面还有OPT记录。
+        if ((ERROR_SUCCESS != ret && ERROR_INSUFFICIENT_BUFFER != ret) ||
+            0 == Header.Count[DNS_SECTION_QUESTION] ||
+            ERROR_SUCCESS != DnsWireReadName(In, Length, Question.Name, Name, sizeof(Name), nullptr)) {
+            continue;
+        }
+
+        ULONG Hash = DnsNameHash(Name);
+        ULONG Bit = (Hash >> 16) & 0xFFFF;
+
+        if (0 == strncmp(Name, "sink-", 5)) {
+            continue;
+        }
+
+        if (0 == Hash % DNS_STUB_DROP && 0 == (Stub->Dropped[Bit / 8] & (1 << (Bit % 8)))) {
+            Stub->Dropped[Bit / 8] |= (BYTE)(1 << (Bit % 8));
+            continue;
+        }
+
+        for (PSTR p = Name; *p; p++) {
+            if (*p >= 'a' && *p <= 'z') {
+                *p -= 0x20;
+            }
+        }
+
+        USHORT Flags = DNS_FLAG_QR | DNS_FLAG_RD | 0x80; // RA。
+        ULONG Size;
+
+        if (0 == strncmp(Name, "NX-", 3)) {
+            Size = StubBuild(Out, sizeof(Out), Header.Id, Flags | DNS_RCODE_NXDOMAIN, Name, Question.Type, 0, 0);
+        } else if (0 == strncmp(Name, "TC-", 3)) {
+            Size = StubBuild(Out, sizeof(Out), Header.Id, Flags | DNS_FLAG_TC, Name, Question.Type, 0, 0);
+        } else {
+            if (0 == strncmp(Name, "SPOOF-", 6)) {
+                const SOCKADDR * To = reinterpret_cast<const SOCKADDR *>(&From);
+                USHORT Wrong = Header.Id ^ 0x5A5A;
+
+                Size = StubBuild(Out, sizeof(Out), Header.Id, Flags, Name, Question.Type, 1, DNS_STUB_BOGUS);
+                sendto(Stub->Rogue, reinterpret_cast<const char *>(Out), Size, 0, To, FromLength);
+
+                Size = StubBuild(Out, sizeof(Out), Wrong, Flags, Name, Question.Type, 1, DNS_STUB_BOGUS);
+                sendto(Stub->Udp, reinterpret_cast<const char *>(Out), Size, 0, To, FromLength);
+
+                Name[0] = 'Z';
+                Size = StubBuild(Out, sizeof(Out), Header.Id, Flags, Name, Question.Type, 1, DNS_STUB_BOGUS);
+                sendto(Stub->Udp, reinterpret_cast<const char *>(Out), Size, 0, To, FromLength);
+                Name[0] = 'S';
+            }
+
+            Size = StubBuild(Out, sizeof(Out), Header.Id, Flags, Name, Question.Type, 1, Hash);
+        }
+
+        sendto(Stub->Udp,
+               reinterpret_cast<const char *>(Out),
+               Size,
+               0,
+               reinterpret_cast<const SOCKADDR *>(&From),
+               FromLength);
+    }
+}
+
+
+static void StubTcp(_Inout_ PDNS_STUB Stub)
+/*
+功能：接受TCP的连接，每个连接回答一个查询（DNS_STUB_TCP_ANSWERS个A记录）后关闭。
+*/
+{
+    BYTE Out[2 + 1024];
+    char Name[DNS_WIRE_MAX_NAME_TEXT];
+    u_long NonBlocking = 1;
+
+    for (int i = 0; i < DNS_STUB_CONNECTIONS; i++) {
+        if (INVALID_SOCKET == Stub->Connections[i]) {
+            SOCKET Socket = accept(Stub->Listen, nullptr, nullptr);
+            if (INVALID_SOCKET == Socket) {
+                break;
+            }
+
+            ioctlsocket(Socket, FIONBIO, &NonBlocking);
+            Stub->Connections[i] = Socket;
+            Stub->Received[i] = 0;
+        }
+    }
+
+    for (int i = 0; i < DNS_STUB_CONNECTIONS; i++) {
+        SOCKET Socket = Stub->Connections[i];
+        PBYTE In = Stub->In[i];
+
+        if (INVALID_SOCKET == Socket) {
+            continue;
+        }
+
+        int ret = recv(Socket,
+                       reinterpret_cast<char *>(In + Stub->Received[i]),
+                       sizeof(Stub->In[i]) - Stub->Received[i],
+                       0);
+        if (0 == ret || (SOCKET_ERROR == ret && WSAEWOULDBLOCK != WSAGetLastError())) {
+            closesocket(Socket);
+            Stub->Connections[i] = INVALID_SOCKET;
+            continue;
+        }
+
+        if (ret > 0) {
+            Stub->Received[i] += ret;
+        }
+
+        ULONG Received = Stub->Received[i];
+        if (Received < 2 || Received < 2u + ReadUshort(In)) {
+            continue;
+        }
+
+        DNS_WIRE_MESSAGE Header;
+        DNS_WIRE_RECORD Question;
+        ULONG Length = ReadUshort(In);
+
+        ret = DnsWireParse(In + 2, Length, &Header, &Question, 1);
+        if ((ERROR_SUCCESS == ret || ERROR_INSUFFICIENT_BUFFER == ret) && Header.Count[DNS_SECTION_QUESTION] &&
+            ERROR_SUCCESS == DnsWireReadName(In + 2, Length, Question.Name, Name, sizeof(Name), nullptr)) {
+            ULONG Size = StubBuild(Out + 2,
+                                   sizeof(Out) - 2,
+                                   Header.Id,
+                                   DNS_FLAG_QR | DNS_FLAG_RD | 0x80,
+                                   Name,
+                                   Question.Type,
+                                   DNS_STUB_TCP_ANSWERS,
+                                   DnsNameHash(Name));
+
+            Out[0] = (BYTE)(Size >> 8);
+            Out[1] = (BYTE)Size;
+            send(Socket, reinterpret_cast<const char *>(Out), 2 + Size, 0); //很小，一次就能发完。
+        }
+
+        closesocket(Socket);
+        Stub->Connections[i] = INVALID_SOCKET;
+    }
+}
+
+
+static VOID WINAPI BenchCallback(_In_ const DNS_RESOLVER_RESULT * Result)
+/*
+功能：按名字的前缀检查结果，见StubUdp。
+*/
+{
+    PDNS_BENCH Bench = reinterpret_cast<PDNS_BENCH>(Result->Context);
+    DNS_WIRE_MESSAGE Header;
+    DNS_WIRE_RECORD Records[32];
+    BOOLEAN Good;
+
+    Bench->Completed++;
+
+    if (ERROR_CANCELLED == Result->Status) {
+        Bench->Cancelled++;
+        return;
+    }
+
+    if (0 == strncmp(Result->Name, "sink-", 5)) {
+        Good = ERROR_TIMEOUT == Result->Status && 3 == Result->Attempts && nullptr == Result->Response;
+    } else if (ERROR_SUCCESS != Result->Status ||
+               ERROR_SUCCESS != DnsWireParse(Result->Response, Result->ResponseLength, &Header, Records, 32)) {
+        Good = FALSE;
+    } else if (0 == strncmp(Result->Name, "nx-", 3)) {
+        Good = DNS_RCODE_NXDOMAIN == Result->Rcode && 0 == Header.Count[DNS_SECTION_ANSWER];
+    } else {
+        const DNS_WIRE_RECORD * Answer = &Records[Header.Count[DNS_SECTION_QUESTION]];
+        ULONG Expected = (0 == strncmp(Result->Name, "tc-", 3)) ? DNS_STUB_TCP_ANSWERS : 1;
+
+        Good = 0 == Result->Rcode && Expected == Header.Count[DNS_SECTION_ANSWER] &&
+               (Expected > 1) == (Result->Tcp != FALSE) && DNS_TYPE_A == Answer->Type && 4 == Answer->DataLength &&
+               DnsNameHash(Result->Name) == ReadUlong(Result->Response + Answer->Data);
+    }
+
+    if (!Good) {
+        if (Bench->Errors++ < 10) {
+            printf("%s: status %lu, rcode %d, tcp %d, attempts %lu\n",
+                   Result->Name,
+                   Result->Status,
+                   Result->Rcode,
+                   Result->Tcp,
+                   Result->Attempts);
+        }
+    }
+}
+
+
+static ULONG BenchRun(_Inout_ PDNS_RESOLVER Resolver,
+                      _Inout_ PDNS_STUB Stub,
+                      _Inout_ PDNS_BENCH Bench,
+                      _In_ ULONG Count,
+                      _In_ BOOLEAN Mixed)
+/*
+功能：提交Count个查询（在途的满了就等），直到全部完成。Mixed的混合各种前缀的名字，否则都是普通的。
+*/
+{
+    ULONG Next = 0;
+    ULONG Sinks = 0;
+
+    while (Next < Count || Bench->Completed < Count) {
+        while (Next < Count) {
+            char Name[64];
+            PCSTR Prefix = "Host-";
+
+            if (Mixed) {
+                switch (Next % 40) {
+                case 0:
+                    Prefix = "nx-";
+                    break;
+                case 1:
+                    Prefix = "tc-";
+                    break;
+                case 2:
+                    Prefix = "spoof-";
+                    break;
+                case 3:
+                    Prefix = Next < 400 ? "sink-" : Prefix;
+                    Sinks += Next < 400;
+                    break;
+                }
+            }
+
+            StringCchPrintfA(Name, _ARRAYSIZE(Name), "%s%lu.Bench.Example", Prefix, Next);
+            ULONG ret = DnsResolverSubmit(Resolver, Name, DNS_TYPE_A, BenchCallback, Bench);
+            if (ERROR_BUSY == ret) {
+                break;
+            }
+
+            if (ERROR_SUCCESS != ret) {
+                printf("DnsResolverSubmit %s: %lu\n", Name, ret);
+                Bench->Errors++;
+                Bench->Completed++;
+            }
+
+            Next++;
+        }
+
+        StubUdp(Stub);
+        StubTcp(Stub);
+        DnsResolverPoll(Resolver, 1, nullptr);
+    }
+
+    return Sinks;
+}
+
+
+static void DnsResolverBenchmark()
+/*
+功能：异步DNS解析器的验证和基准测试，服务器是同一个线程里的桩（见StubUdp）。
+
+1.混合的查询：丢包后的重传，NXDOMAIN，截断后的TCP，伪造的应答的丢弃，超时。
+2.吞吐量：大量的普通的查询，在途的查询保持在上限。
+3.带缓存的：同样的查询第二遍不再发送。
+4.销毁时在途的查询被取消。
+*/
+{
+    const ULONG Functional = 4000;
+    const ULONG Throughput = 200000;
+    DNS_STUB Stub;
+    DNS_RESOLVER_CONFIG Config;
+    DNS_RESOLVER_INFORMATION Information;
+    PDNS_RESOLVER Resolver = nullptr;
+    DNS_BENCH Bench;
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG Errors = 0;
+    WSADATA wsaData;
+
+    if (ERROR_SUCCESS != WSAStartup(MAKEWORD(2, 2), &wsaData)) {
+        printf("WSAStartup LastError:%d\n", WSAGetLastError());
+        return;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+
+    ULONG ret = StubOpen(&Stub);
+    if (ERROR_SUCCESS != ret) {
+        printf("stub LastError:%lu\n", ret);
+        StubClose(&Stub);
+        WSACleanup();
+        return;
+    }
+
+    RtlZeroMemory(&Config, sizeof(Config));
+    Config.Server = Stub.Address;
+    Config.Timeout = 100;
+
+    ret = DnsResolverCreate(&Config, &Resolver);
+    if (ERROR_SUCCESS != ret) {
+        printf("DnsResolverCreate LastError:%lu\n", ret);
+        StubClose(&Stub);
+        WSACleanup();
+        return;
+    }
+
+    {
+        RtlZeroMemory(&Bench, sizeof(Bench));
+        ULONG Sinks = BenchRun(Resolver, &Stub, &Bench, Functional, TRUE);
+        ULONG Spoofs = Functional / 40;
+
+        DnsResolverQuery(Resolver, &Information);
+        BOOLEAN Good = 0 == Bench.Errors && 0 == Information.Pending && Information.Timeouts == Sinks &&
+                       Information.TcpFallbacks == Functional / 40 && Information.Mismatched >= 3 * Spoofs;
+
+        printf("functional: %lu queries, %llu sent, %llu retransmits, %llu timeouts, %llu tcp, %llu dropped, %s\n",
+               Functional,
+               Information.Sent,
+               Information.Retransmits,
+               Information.Timeouts,
+               Information.TcpFallbacks,
+               Information.Mismatched,
+               Good ? "ok" : "FAILED");
+        Errors += Good ? 0 : 1 + Bench.Errors;
+    }
+
+    {
+        DNS_RESOLVER_INFORMATION Before = Information;
+
+        RtlZeroMemory(&Bench, sizeof(Bench));
+        QueryPerformanceCounter(&Start);
+        BenchRun(Resolver, &Stub, &Bench, Throughput, FALSE);
+        QueryPerformanceCounter(&End);
+
+        double Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+        DnsResolverQuery(Resolver, &Information);
+        printf("throughput: %lu queries in %.2f s, %.0f queries/s, %llu retransmits, %lu errors, %.1f MB\n",
+               Throughput,
+               Seconds,
+               Throughput / Seconds,
+               Information.Retransmits - Before.Retransmits,
+               Bench.Errors,
+               Information.Bytes / 1048576.0);
+        Errors += Bench.Errors;
+    }
+
+    {
+        const ULONG Count = 2000;
+        PDNS_CACHE Cache = nullptr;
+        PDNS_RESOLVER Cached = nullptr;
+        DNS_RESOLVER_INFORMATION First;
+
+        Config.Cache = nullptr;
+        ret = DnsCacheCreate(0, 0, &Config.Cache);
+        if (ERROR_SUCCESS == ret) {
+            Cache = Config.Cache;
+            ret = DnsResolverCreate(&Config, &Cached);
+        }
+
+        if (ERROR_SUCCESS == ret) {
+            RtlZeroMemory(&Bench, sizeof(Bench));
+            BenchRun(Cached, &Stub, &Bench, Count, FALSE);
+            DnsResolverQuery(Cached, &First);
+
+            Bench.Completed = 0;
+            BenchRun(Cached, &Stub, &Bench, Count, FALSE); //第二遍的都来自缓存。
+            DnsResolverQuery(Cached, &Information);
+
+            BOOLEAN Good = 0 == Bench.Errors && Count == Information.Cached && First.Sent == Information.Sent;
+            printf("cache: %lu queries twice, %llu sent, %llu cached, %s\n",
+                   Count,
+                   Information.Sent,
+                   Information.Cached,
+                   Good ? "ok" : "FAILED");
+            Errors += Good ? 0 : 1 + Bench.Errors;
+        } else {
+            printf("cache LastError:%lu\n", ret);
+            Errors++;
+        }
+
+        DnsResolverDestroy(Cached);
+        DnsCacheDestroy(Cache);
+        Config.Cache = nullptr;
+    }
+
+    {
+        ULONG Submitted = 0;
+
+        RtlZeroMemory(&Bench, sizeof(Bench));
+        for (ULONG i = 0; i < 100; i++) {
+            char Name[64];
+
+            StringCchPrintfA(Name, _ARRAYSIZE(Name), "sink-%lu.cancel.example", i);
+            Submitted += ERROR_SUCCESS == DnsResolverSubmit(Resolver, Name, DNS_TYPE_AAAA, BenchCallback, &Bench);
+        }
+
+        DnsResolverDestroy(Resolver);
+        Resolver = nullptr;
+
+        BOOLEAN Good = 100 == Submitted && 100 == Bench.Cancelled;
+        printf("cancel: %lu submitted, %lu cancelled, %s\n", Submitted, Bench.Cancelled, Good ? "ok" : "FAILED");
+        Errors += Good ? 0 : 1;
+    }
+
+    printf("%s\n", Errors ? "FAILED" : "ok");
+
+    StubClose(&Stub);
+    WSACleanup();
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+int _cdecl main()
+{
+    DnsResolverBenchmark();
+
+    return 0;
+}
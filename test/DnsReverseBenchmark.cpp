@@ -0,0 +1,424 @@
+﻿/*
+反向解析（DnsReverse.cpp）的验证和基准测试，服务器是另一个线程里的桩。
+
+Windows上单独编译运行（不在test.vcxproj的生成里），VS的开发人员命令提示符下：
+cl /std:c++17 /O2 /EHsc /DUNICODE /D_UNICODE /wd4819 DnsReverseBenchmark.cpp ..\libnet\DnsReverse.cpp
+    ..\libnet\DnsWire.cpp ..\libnet\DnsResolver.cpp ..\libnet\DnsCache.cpp
+*/
+
+
+#include "..\libnet\pch.h"
+#include "..\libnet\DnsReverse.h"
+#include "..\libnet\DnsWire.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//测试：另一个线程里的一个本地的（127.0.0.1）DNS服务器的桩。
+//应答的PTR的名字是"ptr."加上查询的名字，第一个标签是13的是NXDOMAIN，14的没有记录。
+
+
+typedef struct _DNS_REVERSE_STUB {
+    SOCKET Socket;
+    SOCKADDR_INET Address;
+    volatile LONG Stop;
+    ULONG Queries;
+} DNS_REVERSE_STUB, * PDNS_REVERSE_STUB;
+
+
+static ULONG StubAnswer(_In_reads_bytes_(Length) const BYTE * In,
+                        _In_ ULONG Length,
+                        _Out_writes_bytes_(Capacity) PBYTE Out,
+                        _In_ ULONG Capacity)
+{
+    DNS_WIRE_MESSAGE Header;
+    DNS_WIRE_RECORD Question;
+    DNS_WRITER Writer;
+    CHAR Name[DNS_WIRE_MAX_NAME_TEXT];
+    CHAR Target[DNS_WIRE_MAX_NAME_TEXT];
+
+    ULONG ret = DnsWireParse(In, Length, &Header, &Question, 1);
+    if ((ERROR_SUCCESS != ret && ERROR_INSUFFICIENT_BUFFER != ret) || 0 == Header.Count[DNS_SECTION_QUESTION] ||
+        ERROR_SUCCESS != DnsWireReadName(In, Length, Question.Name, Name, sizeof(Name), nullptr)) {
+        return 0;
+    }
+
+    USHORT Rcode = (0 == strncmp(Name, "13.", 3)) ? DNS_RCODE_NXDOMAIN : 0;
+
+    DnsWriterInit(&Writer, Out, Capacity, Header.Id, (USHORT)(0x8000 | 0x0100 | 0x0080 | Rcode));
+    DnsWriteQuestion(&Writer, Name, Question.Type, DNS_CLASS_INTERNET);
+    if (0 == Rcode && strncmp(Name, "14.", 3)) {
+        StringCchPrintfA(Target, _ARRAYSIZE(Target), "ptr.%s", Name);
+        DnsWriteNameRecord(&Writer, DNS_SECTION_ANSWER, Name, DNS_TYPE_PTR, DNS_CLASS_INTERNET, 3600, Target);
+    }
+
+    return Writer.Length;
+}
+
+
+static VOID CALLBACK StubCallback(_Inout_ PTP_CALLBACK_INSTANCE Instance,
+                                  _Inout_opt_ PVOID Context,
+                                  _Inout_ PTP_WORK Work)
+{
+    PDNS_REVERSE_STUB Stub = reinterpret_cast<PDNS_REVERSE_STUB>(Context);
+    BYTE In[512];
+    BYTE Out[1024];
+
+    UNREFERENCED_PARAMETER(Instance);
+    UNREFERENCED_PARAMETER(Work);
+
+    while (!Stub->Stop) {
+        WSAPOLLFD Fd;
+
+        Fd.fd = Stub->Socket;
+        Fd.events = POLLRDNORM;
+        Fd.revents = 0;
+        if (WSAPoll(&Fd, 1, 10) <= 0) {
+            continue;
+        }
+
+        for (;;) {
+            SOCKADDR_INET From;
+            int FromLength = sizeof(From);
+
+            int n = recvfrom(Stub->Socket, reinterpret_cast<char *>(In), sizeof(In), 0,
+                             reinterpret_cast<SOCKADDR *>(&From), &FromLength);
+            if (n <= 0) {
+                break;
+            }
+
+            ULONG Length = StubAnswer(In, n, Out, sizeof(Out));
+            if (Length) {
+                sendto(Stub->Socket, reinterpret_cast<const char *>(Out), Length, 0,
+                       reinterpret_cast<const SOCKADDR *>(&From), FromLength);
+                Stub->Queries++;
+            }
+        }
+    }
+}
+
+
+static ULONG StubOpen(_Out_ PDNS_REVERSE_STUB Stub)
+{
+    u_long NonBlocking = 1;
+    int Size = 4 * 1024 * 1024;
+    int Length = sizeof(SOCKADDR_IN);
+
+    RtlZeroMemory(Stub, sizeof(DNS_REVERSE_STUB));
+    Stub->Address.Ipv4.sin_family = AF_INET;
+    Stub->Address.Ipv4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    Stub->Socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (INVALID_SOCKET == Stub->Socket) {
+        return WSAGetLastError();
+    }
+
+    SOCKADDR * Address = reinterpret_cast<SOCKADDR *>(&Stub->Address);
+    setsockopt(Stub->Socket, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char *>(&Size), sizeof(Size));
+    setsockopt(Stub->Socket, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char *>(&Size), sizeof(Size));
+    if (SOCKET_ERROR == ioctlsocket(Stub->Socket, FIONBIO, &NonBlocking) ||
+        SOCKET_ERROR == bind(Stub->Socket, Address, sizeof(SOCKADDR_IN)) ||
+        SOCKET_ERROR == getsockname(Stub->Socket, Address, &Length)) {
+        ULONG ret = WSAGetLastError();
+        closesocket(Stub->Socket);
+        Stub->Socket = INVALID_SOCKET;
+        return ret;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG BenchCheck(_In_ const SOCKADDR_INET * Address, _In_ const DNS_REVERSE_ENTRY * Entry)
+/*
+功能：按桩的规则检查一个结果，对的返回0。
+*/
+{
+    CHAR Name[DNS_REVERSE_NAME_SIZE];
+    CHAR Expected[DNS_REVERSE_NAME_SIZE + 4];
+
+    if (0 == DnsReverseName(Address, Name, sizeof(Name))) {
+        return ERROR_INVALID_PARAMETER != Entry->Status;
+    }
+
+    if (0 == strncmp(Name, "13.", 3)) {
+        return DNS_ERROR_RCODE_NAME_ERROR != Entry->Status || Entry->Name;
+    }
+
+    if (0 == strncmp(Name, "14.", 3)) {
+        return DNS_INFO_NO_RECORDS != Entry->Status || Entry->Name;
+    }
+
+    StringCchPrintfA(Expected, _ARRAYSIZE(Expected), "ptr.%s", Name);
+    return ERROR_SUCCESS != Entry->Status || nullptr == Entry->Name || strcmp(Entry->Name, Expected);
+}
+
+
+static ULONG BenchNames()
+/*
+功能：DnsReverseName和用StringCchPrintfA格式化的比较：结果相同，速度。
+*/
+{
+    const ULONG Count = 1000000;
+    SOCKADDR_INET Address;
+    CHAR Name[DNS_REVERSE_NAME_SIZE];
+    CHAR Expected[DNS_REVERSE_NAME_SIZE];
+    LARGE_INTEGER Frequency, Start, Middle, End;
+    ULONG Errors = 0;
+    ULONG Seed = 1;
+    SIZE_T Sum = 0;
+
+    QueryPerformanceFrequency(&Frequency);
+    RtlZeroMemory(&Address, sizeof(Address));
+
+    for (int Family = 0; Family < 2; Family++) {
+        Address.si_family = Family ? AF_INET6 : AF_INET;
+
+        QueryPerformanceCounter(&Start);
+        for (ULONG i = 0; i < Count; i++) {
+            Seed = Seed * 1664525 + 1013904223;
+            Address.Ipv6.sin6_addr.s6_addr[i & 15] = (UCHAR)(Seed >> 24);
+            Address.Ipv4.sin_addr.s_addr = Seed;
+            Sum += DnsReverseName(&Address, Name, sizeof(Name));
+        }
+        QueryPerformanceCounter(&Middle);
+
+        for (ULONG i = 0; i < Count; i++) {
+            Seed = Seed * 1664525 + 1013904223;
+            Address.Ipv6.sin6_addr.s6_addr[i & 15] = (UCHAR)(Seed >> 24);
+            Address.Ipv4.sin_addr.s_addr = Seed;
+
+            const BYTE * a = Family ? Address.Ipv6.sin6_addr.s6_addr
+                                    : reinterpret_cast<const BYTE *>(&Address.Ipv4.sin_addr);
+            if (Family) {
+                for (int j = 0; j < 16; j++) {
+                    StringCchPrintfA(Expected + j * 4, 5, "%x.%x.", a[15 - j] & 0xF, a[15 - j] >> 4);
+                }
+
+                StringCchCopyA(Expected + 64, _ARRAYSIZE(Expected) - 64, "ip6.arpa");
+            } else {
+                StringCchPrintfA(Expected,
+                                 _ARRAYSIZE(Expected),
+                                 "%u.%u.%u.%u.in-addr.arpa",
+                                 a[3],
+                                 a[2],
+                                 a[1],
+                                 a[0]);
+            }
+
+            if (i % 16 == 0) { //抽查。
+                DnsReverseName(&Address, Name, sizeof(Name));
+                Errors += 0 != strcmp(Name, Expected);
+            }
+        }
+        QueryPerformanceCounter(&End);
+
+        printf("%s names: %.1f ns each, sprintf %.1f ns, %lu mismatches\n",
+               Family ? "ip6.arpa" : "in-addr.arpa",
+               (Middle.QuadPart - Start.QuadPart) * 1e9 / Frequency.QuadPart / Count,
+               (End.QuadPart - Middle.QuadPart) * 1e9 / Frequency.QuadPart / Count,
+               Errors);
+    }
+
+    RtlZeroMemory(&Address, sizeof(Address));
+    Address.si_family = AF_INET;
+    Errors += 0 != DnsReverseName(&Address, Name, 20) || 20 != DnsReverseName(&Address, Name, 21); //刚好放不下。
+    Address.si_family = AF_UNSPEC;
+    Errors += 0 != DnsReverseName(&Address, Name, sizeof(Name));
+
+    return Errors + (0 == Sum);
+}
+
+
+static ULONG BenchFunctional(_In_ const DNS_RESOLVER_CONFIG * Config)
+/*
+功能：重复的，不支持的，NXDOMAIN的，没有记录的地址，IPv6的。
+*/
+{
+    SOCKADDR_INET Addresses[10];
+    PDNS_REVERSE_RESULT Result = nullptr;
+    ULONG Errors = 0;
+    static const BYTE v6[16] = {0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1};
+    static const ULONG v4[] = {0x01020304, 0x0A00000D, 0x0A00000E, 0x01020304, 0xFFFFFFFF, 0, 0x6400006D};
+
+    RtlZeroMemory(Addresses, sizeof(Addresses));
+    for (int i = 0; i < _ARRAYSIZE(v4); i++) {
+        Addresses[i].Ipv4.sin_family = AF_INET;
+        Addresses[i].Ipv4.sin_port = htons((USHORT)i); //端口不影响去重。
+        Addresses[i].Ipv4.sin_addr.s_addr = htonl(v4[i]);
+    }
+
+    Addresses[7].si_family = AF_INET6;
+    RtlCopyMemory(&Addresses[7].Ipv6.sin6_addr, v6, sizeof(v6));
+    Addresses[8] = Addresses[7];
+    Addresses[9].si_family = AF_UNSPEC;
+
+    ULONG ret = DnsReverseLookup(Config, Addresses, _ARRAYSIZE(Addresses), &Result);
+    if (ERROR_SUCCESS != ret) {
+        printf("DnsReverseLookup LastError:%lu\n", ret);
+        return 1;
+    }
+
+    for (int i = 0; i < _ARRAYSIZE(Addresses); i++) {
+        Errors += BenchCheck(&Addresses[i], &Result->Entries[i]);
+    }
+
+    Errors += Result->Unique != 7 || Result->Resolved != 5 || Result->Entries[0].Name != Result->Entries[3].Name;
+    Errors += 0 != strcmp(Result->Entries[0].Name, "ptr.4.3.2.1.in-addr.arpa") ||
+              0 != strcmp(Result->Entries[6].Name, "ptr.109.0.0.100.in-addr.arpa") ||
+              0 != strcmp(Result->Entries[8].Name,
+                          "ptr.1.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.8.b.d.0.1.0.0.2.ip6.arpa");
+
+    printf("functional: %lu addresses, %lu unique, %lu resolved, %s\n",
+           Result->Count,
+           Result->Unique,
+           Result->Resolved,
+           Errors ? "FAILED" : "ok");
+
+    DnsReverseFree(Result);
+    return Errors;
+}
+
+
+static ULONG BenchThroughput(_In_ const DNS_RESOLVER_CONFIG * Config, _In_z_ PCSTR Title)
+/*
+功能：100000个地址（80000个不同的，其余的是重复的，打乱了顺序）。
+*/
+{
+    const ULONG Count = 100000;
+    const ULONG Unique = 80000;
+    PDNS_REVERSE_RESULT Result = nullptr;
+    ULONG Errors = 0;
+    ULONG Seed = 7;
+
+    PSOCKADDR_INET Addresses = reinterpret_cast<PSOCKADDR_INET>(MALLOC(Count * sizeof(SOCKADDR_INET)));
+    if (nullptr == Addresses) {
+        printf("LastError:%d\n", GetLastError());
+        return 1;
+    }
+
+    for (ULONG i = 0; i < Count; i++) {
+        Seed = Seed * 1664525 + 1013904223;
+        if (i < Unique) {
+            Addresses[i].Ipv4.sin_family = AF_INET;
+            Addresses[i].Ipv4.sin_addr.s_addr = htonl(0x0A000000 + i * 7); // 10.0.0.0/8里的不同的地址。
+        } else {
+            Addresses[i] = Addresses[Seed % Unique];
+        }
+    }
+
+    for (ULONG i = Count - 1; i > 0; i--) {
+        Seed = Seed * 1664525 + 1013904223;
+
+        SOCKADDR_INET Temp = Addresses[i];
+        ULONG j = Seed % (i + 1);
+        Addresses[i] = Addresses[j];
+        Addresses[j] = Temp;
+    }
+
+    ULONG ret = DnsReverseLookup(Config, Addresses, Count, &Result);
+    if (ERROR_SUCCESS != ret) {
+        printf("DnsReverseLookup LastError:%lu\n", ret);
+        FREE(Addresses);
+        return 1;
+    }
+
+    for (ULONG i = 0; i < Count; i++) {
+        Errors += BenchCheck(&Addresses[i], &Result->Entries[i]);
+    }
+
+    printf("%s: %lu addresses, %lu unique, %lu resolved in %.2f s, %llu sent, %llu retransmits, %llu cached, "
+           "%lu errors\n",
+           Title,
+           Result->Count,
+           Result->Unique,
+           Result->Resolved,
+           Result->Elapsed / 1000.0,
+           Result->Statistics.Sent,
+           Result->Statistics.Retransmits,
+           Result->Statistics.Cached,
+           Errors);
+    Errors += Result->Unique != Unique;
+
+    DnsReverseFree(Result);
+    FREE(Addresses);
+    return Errors;
+}
+
+
+static void DnsReverseBenchmark()
+/*
+功能：批量的反向解析的验证和基准测试，服务器是另一个线程里的桩（见StubAnswer）。
+
+1.名字的构造：和sprintf的结果比较，速度。
+2.功能：去重，顺序，各种状态。
+3.吞吐量：100000个地址；再来一遍，带缓存的不再发送。
+*/
+{
+    DNS_REVERSE_STUB Stub;
+    DNS_RESOLVER_CONFIG Config;
+    PDNS_CACHE Cache = nullptr;
+    ULONG Errors = 0;
+    WSADATA wsaData;
+
+    Errors += BenchNames();
+
+    if (ERROR_SUCCESS != WSAStartup(MAKEWORD(2, 2), &wsaData)) {
+        printf("WSAStartup LastError:%d\n", WSAGetLastError());
+        return;
+    }
+
+    ULONG ret = StubOpen(&Stub);
+    if (ERROR_SUCCESS != ret) {
+        printf("stub LastError:%lu\n", ret);
+        WSACleanup();
+        return;
+    }
+
+    PTP_WORK Work = CreateThreadpoolWork(StubCallback, &Stub, nullptr);
+    if (nullptr == Work) {
+        printf("CreateThreadpoolWork LastError:%d\n", GetLastError());
+        closesocket(Stub.Socket);
+        WSACleanup();
+        return;
+    }
+
+    SubmitThreadpoolWork(Work);
+
+    RtlZeroMemory(&Config, sizeof(Config));
+    Config.Server = Stub.Address;
+    Config.Timeout = 200;
+
+    Errors += BenchFunctional(&Config);
+    Errors += BenchThroughput(&Config, "throughput");
+
+    ret = DnsCacheCreate(0, 0, &Cache);
+    if (ERROR_SUCCESS == ret) {
+        Config.Cache = Cache;
+        Errors += BenchThroughput(&Config, "cold cache");
+        Errors += BenchThroughput(&Config, "warm cache");
+        DnsCacheDestroy(Cache);
+    } else {
+        printf("DnsCacheCreate LastError:%lu\n", ret);
+        Errors++;
+    }
+
+    InterlockedExchange(&Stub.Stop, 1);
+    WaitForThreadpoolWorkCallbacks(Work, FALSE);
+    CloseThreadpoolWork(Work);
+    closesocket(Stub.Socket);
+
+    printf("%s\n", Errors ? "FAILED" : "ok");
+
+    WSACleanup();
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+int _cdecl main()
+{
+    DnsReverseBenchmark();
+
+    return 0;
+}
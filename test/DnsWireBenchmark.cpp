@@ -0,0 +1,481 @@
+﻿/*
+DNS报文的编解码（DnsWire.cpp）的验证，基准测试和模糊测试。
+
+Windows上单独编译运行（不在test.vcxproj的生成里），VS的开发人员命令提示符下：
+cl /std:c++17 /O2 /EHsc /DUNICODE /D_UNICODE /wd4819 DnsWireBenchmark.cpp ..\libnet\DnsWire.cpp
+*/
+
+
+#include "..\libnet\pch.h"
+#include "..\libnet\DnsWire.h"
+#include "..\libnet\SplitMix64.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#define DNS_WIRE_CORPUS  64   //基准测试用的报文的个数。
+#define DNS_WIRE_SIZE    1232 //每个报文的缓冲区（EDNS推荐的大小）。
+
+
+static void RandomName(_Inout_ PUINT64 Seed,
+                       _In_ PCSTR Zone,
+                       _Out_writes_z_(Characters) PSTR Name,
+                       _In_ SIZE_T Characters)
+/*
+功能：Zone下的一个随机的名字，一到三个随机的标签，偶尔有大写。
+*/
+{
+    static const char Alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789-ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    UINT64 r = SplitMix64(Seed);
+    ULONG Labels = 1 + (ULONG)(r % 3);
+    SIZE_T k = 0;
+
+    for (ULONG i = 0; i < Labels && k + 20 < Characters; i++) {
+        ULONG Size = 1 + (ULONG)((r >> (8 + 8 * i)) % 12);
+
+        for (ULONG j = 0; j < Size; j++) {
+            Name[k++] = Alphabet[SplitMix64(Seed) % (sizeof(Alphabet) - 1)];
+        }
+
+        Name[k++] = '.';
+    }
+
+    StringCchCopyA(Name + k, Characters - k, Zone);
+}
+
+
+static ULONG BuildMessage(_Inout_ PUINT64 Seed,
+                          _Out_ PDNS_WRITER Writer,
+                          _Out_writes_bytes_(DNS_WIRE_SIZE) PBYTE Buffer)
+/*
+功能：生成一个典型的应答（问题，CNAME，几个A和AAAA，NS和它们的地址），并检查往返（编码后再解码，内容一样）。
+
+返回值：错误的个数。
+*/
+{
+    static const PCSTR Zones[] = {"example.com", "example.net", "Example.ORG", "co.uk", "test"};
+    char Owners[16][128]{};  //每个记录的名字。
+    char Targets[16][128]{}; // CNAME和NS的RDATA。
+    USHORT Types[16]{};
+    ULONG Count = 0;
+    ULONG Errors = 0;
+    UINT64 r = SplitMix64(Seed);
+    PCSTR Zone = Zones[r % _ARRAYSIZE(Zones)];
+    PCSTR Host = Owners[0]; // A和AAAA的名字。
+
+    DnsWriterInit(Writer, Buffer, DNS_WIRE_SIZE, (USHORT)r, 0x8180);
+
+    RandomName(Seed, Zone, Owners[Count], sizeof(Owners[0]));
+    Types[Count] = DNS_TYPE_A;
+    Errors += ERROR_SUCCESS != DnsWriteQuestion(Writer, Owners[Count], DNS_TYPE_A, DNS_CLASS_INTERNET);
+    Count++;
+
+    if (r & 0x100) { //先是一个CNAME。
+        StringCchCopyA(Owners[Count], sizeof(Owners[0]), Owners[0]);
+        RandomName(Seed, Zone, Targets[Count], sizeof(Targets[0]));
+        Types[Count] = DNS_TYPE_CNAME;
+        Host = Targets[Count];
+        Errors += ERROR_SUCCESS != DnsWriteNameRecord(
+                      Writer, DNS_SECTION_ANSWER, Owners[Count], DNS_TYPE_CNAME, 1, 300, Targets[Count]);
+        Count++;
+    }
+
+    for (ULONG i = 0; i < 1 + ((r >> 12) % 4); i++) {
+        UINT32 Address = (UINT32)SplitMix64(Seed);
+        StringCchCopyA(Owners[Count], sizeof(Owners[0]), Host);
+        Types[Count] = DNS_TYPE_A;
+        Errors += ERROR_SUCCESS !=
+                  DnsWriteRecord(Writer, DNS_SECTION_ANSWER, Owners[Count], DNS_TYPE_A, 1, 60, &Address, 4);
+        Count++;
+    }
+
+    for (ULONG i = 0; i < 2; i++) {
+        BYTE Address[16];
+        *(PUINT64)Address = SplitMix64(Seed);
+        *(PUINT64)(Address + 8) = SplitMix64(Seed);
+        StringCchCopyA(Owners[Count], sizeof(Owners[0]), Host);
+        Types[Count] = DNS_TYPE_AAAA;
+        Errors += ERROR_SUCCESS !=
+                  DnsWriteRecord(Writer, DNS_SECTION_ANSWER, Owners[Count], DNS_TYPE_AAAA, 1, 60, Address, 16);
+        Count++;
+    }
+
+    for (ULONG i = 0; i < 2; i++) {
+        StringCchCopyA(Owners[Count], sizeof(Owners[0]), Zone);
+        StringCchPrintfA(Targets[Count], sizeof(Targets[0]), "ns%lu.%s", i + 1, Zone);
+        Types[Count] = DNS_TYPE_NS;
+        Errors += ERROR_SUCCESS != DnsWriteNameRecord(
+                      Writer, DNS_SECTION_AUTHORITY, Owners[Count], DNS_TYPE_NS, 1, 86400, Targets[Count]);
+        Count++;
+    }
+
+    for (ULONG i = 0; i < 2; i++) {
+        UINT32 Address = (UINT32)SplitMix64(Seed);
+        StringCchCopyA(Owners[Count], sizeof(Owners[0]), Targets[Count - 2]);
+        Types[Count] = DNS_TYPE_A;
+        Errors += ERROR_SUCCESS !=
+                  DnsWriteRecord(Writer, DNS_SECTION_ADDITIONAL, Owners[Count], DNS_TYPE_A, 1, 86400, &Address, 4);
+        Count++;
+    }
+
+    //往返的检查：记录的名字，NS和CNAME的RDATA。
+    DNS_WIRE_MESSAGE Header;
+    DNS_WIRE_RECORD Records[16];
+    char Text[DNS_WIRE_MAX_NAME_TEXT];
+    ULONG Length = Writer->Length;
+    ULONG Consumed;
+
+    if (ERROR_SUCCESS != DnsWireParse(Buffer, Writer->Length, &Header, Records, _ARRAYSIZE(Records)) ||
+        Header.Records != Count || Header.Length != Writer->Length) {
+        return Errors + 1;
+    }
+
+    for (ULONG i = 0; i < Count; i++) {
+        const DNS_WIRE_RECORD * Record = &Records[i];
+
+        if (ERROR_SUCCESS != DnsWireReadName(Buffer, Length, Record->Name, Text, sizeof(Text), nullptr) ||
+            0 != strcmp(Text, Owners[i]) || Record->Type != Types[i]) {
+            Errors++;
+        }
+
+        if (Targets[i][0] &&
+            (ERROR_SUCCESS != DnsWireReadName(Buffer, Length, Record->Data, Text, sizeof(Text), &Consumed) ||
+             0 != strcmp(Text, Targets[i]) || Consumed != Record->DataLength)) {
+            Errors++;
+        }
+    }
+
+    return Errors;
+}
+
+
+static ULONG VerifyMalformed()
+/*
+功能：手工构造的畸形的名字（指针的环，越界，过长等）都要被拒绝。
+
+返回值：错误的个数。
+*/
+{
+    static const BYTE Header[] = {0x12, 0x34, 0x81, 0x80, 0, 1, 0, 0, 0, 0, 0, 0};
+    static const struct {
+        BYTE Name[8];
+        ULONG Size;
+        BOOLEAN Complete; //后面加上类型和类。
+    } Cases[] = {
+        {{0xC0, 0x0C}, 2, TRUE},             //指向自己。
+        {{0x01, 'a', 0xC0, 0x0C}, 4, TRUE},  //指向自己的开始：a.a.a...
+        {{0xC0, 0x0E, 0x00}, 3, TRUE},       //向后的指针。
+        {{0x01, 'a', 0xC0, 0x0E}, 4, TRUE},  //指向后面的自己。
+        {{0x41, 'a', 0x00}, 3, TRUE},        // 0x40的标签类型。
+        {{0x81, 'a', 0x00}, 3, TRUE},        // 0x80的标签类型。
+        {{0xC0}, 1, FALSE},                  //截断的指针。
+        {{0x05, 'a', 'b'}, 3, FALSE},        //截断的标签。
+        {{0x01, 'a'}, 2, FALSE},             //没有结尾的0。
+    };
+    BYTE Message[DNS_WIRE_HEADER_SIZE + 300];
+    DNS_WIRE_MESSAGE Message2;
+    char Text[DNS_WIRE_MAX_NAME_TEXT];
+    ULONG Errors = 0;
+
+    for (int i = 0; i < _ARRAYSIZE(Cases); i++) {
+        ULONG Length = DNS_WIRE_HEADER_SIZE + Cases[i].Size;
+
+        RtlCopyMemory(Message, Header, sizeof(Header));
+        RtlCopyMemory(Message + DNS_WIRE_HEADER_SIZE, Cases[i].Name, Cases[i].Size);
+        if (Cases[i].Complete) {
+            Message[Length++] = 0;
+            Message[Length++] = 1;
+            Message[Length++] = 0;
+            Message[Length++] = 1;
+        }
+
+        if (ERROR_INVALID_DATA != DnsWireParse(Message, Length, &Message2, nullptr, 0) ||
+            ERROR_INVALID_DATA !=
+                DnsWireReadName(Message, Length, DNS_WIRE_HEADER_SIZE, Text, sizeof(Text), nullptr)) {
+            printf("malformed case %d accepted\n", i);
+            Errors++;
+        }
+    }
+
+    //两个互相指向的指针（后一个指向前一个是合法的，前一个指向后一个不是）。
+    {
+        static const BYTE Loop[] = {0x12, 0x34, 0x81, 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0xC0, 0x0E, 0xC0, 0x0C};
+        if (ERROR_INVALID_DATA != DnsWireReadName(Loop, sizeof(Loop), 14, Text, sizeof(Text), nullptr) ||
+            ERROR_INVALID_DATA != DnsWireReadName(Loop, sizeof(Loop), 12, Text, sizeof(Text), nullptr)) {
+            printf("pointer loop accepted\n");
+            Errors++;
+        }
+    }
+
+    //展开后超过255字节：4个63字节的标签（256字节）。
+    {
+        ULONG Length = DNS_WIRE_HEADER_SIZE;
+
+        RtlCopyMemory(Message, Header, sizeof(Header));
+        for (int i = 0; i < 4; i++) {
+            Message[Length++] = 63;
+            RtlFillMemory(Message + Length, 63, 'a');
+            Length += 63;
+        }
+
+        Message[Length++] = 0;
+        ULONG ret = DnsWireReadName(Message, Length, DNS_WIRE_HEADER_SIZE, Text, sizeof(Text), nullptr);
+        if (ERROR_INVALID_DATA != ret) {
+            printf("long name accepted\n");
+            Errors++;
+        }
+    }
+
+    //转义的往返，缓冲区太小。
+    {
+        DNS_WRITER Writer;
+        ULONG Offset = DNS_WIRE_HEADER_SIZE;
+
+        DnsWriterInit(&Writer, Message, sizeof(Message), 0, 0);
+        DnsWriteQuestion(&Writer, "a\\.b\\\\c\\000\\255.Example.", 1, 1);
+
+        if (ERROR_SUCCESS != DnsWireReadName(Message, Writer.Length, Offset, Text, sizeof(Text), nullptr) ||
+            0 != strcmp(Text, "a\\.b\\\\c\\000\\255.Example") ||
+            ERROR_INSUFFICIENT_BUFFER != DnsWireReadName(Message, Writer.Length, Offset, Text, 8, nullptr) ||
+            0 != Text[0] || ERROR_INVALID_PARAMETER != DnsWriteQuestion(&Writer, "a..b", 1, 1) ||
+            ERROR_INVALID_PARAMETER != DnsWriteRecord(&Writer, DNS_SECTION_QUESTION, ".", 1, 1, 0, nullptr, 0)) {
+            printf("escape round trip FAILED: %s\n", Text);
+            Errors++;
+        }
+    }
+
+    return Errors;
+}
+
+
+static void FuzzCheck(_In_reads_bytes_(Length) const BYTE * Message,
+                      _In_ ULONG Length,
+                      _Inout_ PULONG Accepted,
+                      _Inout_ PULONG Errors)
+/*
+功能：解析一个（变异的）报文，接受的要满足索引的约束，所有的名字的读取都不能越界。
+*/
+{
+    DNS_WIRE_MESSAGE Header;
+    DNS_WIRE_RECORD Records[64];
+    char Text[DNS_WIRE_MAX_NAME_TEXT];
+    ULONG Consumed;
+
+    ULONG ret = DnsWireParse(Message, Length, &Header, Records, _ARRAYSIZE(Records));
+    ULONG Count = min(Header.Records, (ULONG)_ARRAYSIZE(Records));
+
+    if (ERROR_SUCCESS == ret) {
+        (*Accepted)++;
+    }
+
+    for (ULONG i = 0; i < Count; i++) {
+        const DNS_WIRE_RECORD * Record = &Records[i];
+
+        if ((ULONG)Record->Name + Record->NameLength > Length ||
+            (ULONG)Record->Data + Record->DataLength > Length ||
+            ERROR_SUCCESS != DnsWireReadName(Message, Length, Record->Name, Text, sizeof(Text), &Consumed) ||
+            Consumed != Record->NameLength || strlen(Text) >= sizeof(Text)) {
+            (*Errors)++;
+        }
+
+        if (Record->DataLength) { // RDATA可能是任何东西，只要不越界。
+            DnsWireReadName(Message, Length, Record->Data, Text, sizeof(Text), nullptr);
+            DnsWireNameEqual(Message, Length, Record->Name, Record->Data);
+        }
+    }
+}
+
+
+static void DnsWireBenchmark()
+/*
+功能：DNS报文的编解码的验证，基准测试和模糊测试。
+
+1.畸形的名字（指针的环等）的拒绝；典型的应答的编码和解码的往返。
+2.解码（DnsWireParse，以及再读取所有的名字）和编码的速度（每秒的报文数）。
+3.随机变异（改字节，翻转位，插入指针，截断）后解析，检查索引的约束。
+  报文按实际的长度申请，配合ASan/Application Verifier能发现越界的读取。
+*/
+{
+    const ULONG Rounds = 20000;
+    const ULONG Mutations = 1000000;
+    PBYTE Corpus = (PBYTE)MALLOC((SIZE_T)DNS_WIRE_CORPUS * DNS_WIRE_SIZE);
+    ULONG Lengths[DNS_WIRE_CORPUS];
+    LARGE_INTEGER Frequency, Start, End;
+    UINT64 Seed = 0x5eed;
+    ULONG Errors = 0;
+    SIZE_T Bytes = 0;
+
+    if (nullptr == Corpus) {
+        printf("LastError:%d\n", GetLastError());
+        return;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+
+    {
+        ULONG Malformed = VerifyMalformed();
+        ULONG RoundTrip = 0;
+
+        for (ULONG i = 0; i < DNS_WIRE_CORPUS; i++) {
+            DNS_WRITER Writer;
+            RoundTrip += BuildMessage(&Seed, &Writer, Corpus + (SIZE_T)i * DNS_WIRE_SIZE);
+            Lengths[i] = Writer.Length;
+            Bytes += Writer.Length;
+        }
+
+        printf("verify: malformed %s, round trip %s (%lu errors), %lu messages, %.1f bytes/message\n",
+               Malformed ? "FAILED" : "ok",
+               RoundTrip ? "FAILED" : "ok",
+               Malformed + RoundTrip,
+               DNS_WIRE_CORPUS,
+               (double)Bytes / DNS_WIRE_CORPUS);
+        Errors += Malformed + RoundTrip;
+    }
+
+    {
+        DNS_WIRE_MESSAGE Header;
+        DNS_WIRE_RECORD Records[16];
+        ULONG Checksum = 0;
+
+        QueryPerformanceCounter(&Start);
+        for (ULONG r = 0; r < Rounds; r++) {
+            for (ULONG i = 0; i < DNS_WIRE_CORPUS; i++) {
+                const BYTE * Message = Corpus + (SIZE_T)i * DNS_WIRE_SIZE;
+
+                DnsWireParse(Message, Lengths[i], &Header, Records, _ARRAYSIZE(Records));
+                Checksum += Header.Records;
+            }
+        }
+        QueryPerformanceCounter(&End);
+
+        double Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+        printf("parse: %.2f M messages/s, %.0f MB/s (%lu)\n",
+               (double)Rounds * DNS_WIRE_CORPUS / Seconds / 1e6,
+               (double)Rounds * Bytes / Seconds / 1048576,
+               Checksum);
+    }
+
+    {
+        DNS_WIRE_MESSAGE Header;
+        DNS_WIRE_RECORD Records[16];
+        char Text[DNS_WIRE_MAX_NAME_TEXT];
+        ULONG Checksum = 0;
+
+        QueryPerformanceCounter(&Start);
+        for (ULONG r = 0; r < Rounds / 4; r++) {
+            for (ULONG i = 0; i < DNS_WIRE_CORPUS; i++) {
+                const BYTE * Message = Corpus + (SIZE_T)i * DNS_WIRE_SIZE;
+
+                DnsWireParse(Message, Lengths[i], &Header, Records, _ARRAYSIZE(Records));
+                for (ULONG k = 0; k < Header.Records; k++) {
+                    DnsWireReadName(Message, Lengths[i], Records[k].Name, Text, sizeof(Text), nullptr);
+                    Checksum += (BYTE)Text[0];
+                }
+            }
+        }
+        QueryPerformanceCounter(&End);
+
+        double Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+        printf("parse + names: %.2f M messages/s (%lu)\n",
+               (double)Rounds / 4 * DNS_WIRE_CORPUS / Seconds / 1e6,
+               Checksum);
+    }
+
+    {
+        PBYTE Buffer = (PBYTE)MALLOC(DNS_WIRE_SIZE);
+        UINT64 Seed2 = 0x5eed;
+        ULONG Bad = 0;
+
+        if (Buffer) {
+            QueryPerformanceCounter(&Start);
+            for (ULONG r = 0; r < Rounds / 20; r++) {
+                DNS_WRITER Writer;
+                Bad += BuildMessage(&Seed2, &Writer, Buffer); //包括了往返的检查。
+            }
+            QueryPerformanceCounter(&End);
+
+            double Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+            printf("encode + verify: %.2f M messages/s\n", (double)(Rounds / 20) / Seconds / 1e6);
+            Errors += Bad;
+            FREE(Buffer);
+        }
+    }
+
+    {
+        ULONG Accepted = 0;
+        ULONG Bad = 0;
+
+        QueryPerformanceCounter(&Start);
+        for (ULONG n = 0; n < Mutations; n++) {
+            UINT64 r = SplitMix64(&Seed);
+            ULONG Index = (ULONG)(r % DNS_WIRE_CORPUS);
+            ULONG Length = Lengths[Index];
+            BYTE Work[DNS_WIRE_SIZE];
+
+            RtlCopyMemory(Work, Corpus + (SIZE_T)Index * DNS_WIRE_SIZE, Length);
+
+            for (ULONG m = 0; m < 1 + ((r >> 8) % 4); m++) {
+                UINT64 x = SplitMix64(&Seed);
+                ULONG Position = (ULONG)((x >> 8) % Length);
+
+                switch (x % 5) {
+                case 0:
+                    Work[Position] = (BYTE)(x >> 40);
+                    break;
+                case 1:
+                    Work[Position] ^= (BYTE)(1 << ((x >> 40) % 8));
+                    break;
+                case 2: //插入一个随机的指针。
+                    if (Position + 1 < Length) {
+                        Work[Position] = (BYTE)(0xC0 | ((x >> 40) & 0x3F));
+                        Work[Position + 1] = (BYTE)(x >> 48);
+                    }
+                    break;
+                case 3: //指向头之后的指针，更容易成环。
+                    if (Position + 1 < Length) {
+                        Work[Position] = 0xC0;
+                        Work[Position + 1] = (BYTE)(DNS_WIRE_HEADER_SIZE + (x >> 40) % (Length - 1));
+                    }
+                    break;
+                default: //截断。
+                    Length = max(Position, (ULONG)1);
+                    break;
+                }
+            }
+
+            PBYTE Message = (PBYTE)MALLOC(Length); //按实际的长度，越界的读取能被发现。
+            if (nullptr == Message) {
+                break;
+            }
+
+            RtlCopyMemory(Message, Work, Length);
+            FuzzCheck(Message, Length, &Accepted, &Bad);
+            FREE(Message);
+        }
+        QueryPerformanceCounter(&End);
+
+        double Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+        printf("fuzz: %lu mutations, %lu accepted, %s (%lu errors), %.2f M/s\n",
+               Mutations,
+               Accepted,
+               Bad ? "FAILED" : "ok",
+               Bad,
+               Mutations / Seconds / 1e6);
+        Errors += Bad;
+    }
+
+    printf("%s\n", Errors ? "FAILED" : "ok");
+    FREE(Corpus);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+int _cdecl main()
+{
+    DnsWireBenchmark();
+
+    return 0;
+}
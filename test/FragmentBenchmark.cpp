@@ -0,0 +1,301 @@
+﻿/*
+IP分片和重组（Fragment.cpp）的验证和基准测试：分片后乱序，重复，丢失地重组，和原来的数据报比较，以及吞吐量。
+
+Windows上单独编译运行（不在test.vcxproj的生成里），VS的开发人员命令提示符下：
+cl /std:c++17 /O2 /EHsc /DUNICODE /D_UNICODE /wd4819 FragmentBenchmark.cpp ..\libnet\Dissector.cpp
+    ..\libnet\raw.cpp
+
+直接包含Fragment.cpp，组测试的数据报要用它里面的ReadUint16/WriteUint16，SetIpv4Checksum等（static的）。
+*/
+
+
+#include "..\libnet\Fragment.cpp"
+#include "..\libnet\udp.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static SIZE_T BuildTestDatagram(PBYTE Frame, UINT8 IpVersion, UINT16 Id, ULONG DataLength)
+/*
+功能：组装一个带UDP头的大数据报（IPv4的没有DF，IPv6的带一个Hop-by-Hop），用于验证和测试。
+*/
+{
+    PBYTE Ip = Frame + sizeof(ETHERNET_HEADER);
+    PBYTE Udp;
+    ULONG UdpLength = sizeof(UDP_HDR) + DataLength;
+
+    RtlZeroMemory(Frame, sizeof(ETHERNET_HEADER) + sizeof(IPV6_HEADER) + 8);
+    for (ULONG i = 0; i < 12; i++) {
+        Frame[i] = (BYTE)(i + 1);
+    }
+
+    if (4 == IpVersion) {
+        WriteUint16(Frame + 12, ETHERNET_TYPE_IPV4);
+        Ip[0] = 0x45;
+        WriteUint16(Ip + 2, (UINT16)(sizeof(IPV4_HEADER) + UdpLength));
+        WriteUint16(Ip + 4, Id);
+        Ip[8] = 64;
+        Ip[9] = IPPROTO_UDP;
+        WriteUint32(Ip + 12, 0xc0a80102);
+        WriteUint32(Ip + 16, 0x0a000001);
+        SetIpv4Checksum(Ip, sizeof(IPV4_HEADER));
+        Udp = Ip + sizeof(IPV4_HEADER);
+    } else {
+        WriteUint16(Frame + 12, ETHERNET_TYPE_IPV6);
+        Ip[0] = 6 << 4;
+        WriteUint16(Ip + 4, (UINT16)(8 + UdpLength));
+        Ip[6] = IPPROTO_HOPOPTS;
+        Ip[7] = 64;
+        Ip[8] = 0x20;
+        Ip[9] = 0x01;
+        Ip[23] = 1;
+        Ip[24] = 0x20;
+        Ip[25] = 0x01;
+        Ip[39] = 2;
+        Ip[40] = IPPROTO_UDP; // Hop-by-Hop：PadN。
+        Ip[42] = 1;
+        Ip[43] = 4;
+        Udp = Ip + sizeof(IPV6_HEADER) + 8;
+    }
+
+    WriteUint16(Udp, 12345);
+    WriteUint16(Udp + 2, 53);
+    WriteUint16(Udp + 4, (UINT16)UdpLength);
+    WriteUint16(Udp + 6, 0);
+
+    for (ULONG i = 0; i < DataLength; i++) {
+        Udp[sizeof(UDP_HDR) + i] = (BYTE)(i * 7 + Id);
+    }
+
+    return (Udp + UdpLength) - Frame;
+}
+
+
+static ULONG MaterializeFragments(const IP_FRAGMENT * Fragments, ULONG Count, PBYTE Frames, PULONG Lengths)
+/*
+功能：把分片（两段）拼成连续的帧，模拟线路上收到的，每个帧占IP_FRAGMENT_HEADER_SIZE + 2048字节。
+*/
+{
+    for (ULONG i = 0; i < Count; i++) {
+        PBYTE Frame = Frames + (SIZE_T)i * (IP_FRAGMENT_HEADER_SIZE + 2048);
+        RtlCopyMemory(Frame, Fragments[i].Header.Buffer, Fragments[i].Header.Length);
+        RtlCopyMemory(
+            Frame + Fragments[i].Header.Length, Fragments[i].Payload.Buffer, Fragments[i].Payload.Length);
+        Lengths[i] = Fragments[i].Header.Length + Fragments[i].Payload.Length;
+    }
+
+    return Count;
+}
+
+
+static void FragmentBenchmark()
+/*
+功能：分片和重组的验证和微基准测试（微测）。
+
+1.IPv4（MTU 1500）和IPv6（MTU 1280，带Hop-by-Hop）的大数据报，分片后倒序重组，结果应该和原来的一样。
+2.重复的，重叠的，超时的分片，看计数器。
+3.很多数据报的分片交错着到达时，单核每秒能重组的分片数。
+*/
+{
+    const ULONG DataLength = 8000;
+    const ULONG MaxFragments = 64;
+    const SIZE_T FrameStride = IP_FRAGMENT_HEADER_SIZE + 2048;
+    const SIZE_T HeaderSlabSize = (SIZE_T)MaxFragments * IP_FRAGMENT_HEADER_SIZE; //每个数据报的。
+    const ULONG Concurrent = 64;
+    PBYTE Datagrams = (PBYTE)MALLOC((SIZE_T)Concurrent * 9000);
+    PBYTE HeaderSlab = (PBYTE)MALLOC((SIZE_T)Concurrent * MaxFragments * IP_FRAGMENT_HEADER_SIZE);
+    PBYTE Frames = (PBYTE)MALLOC((SIZE_T)Concurrent * MaxFragments * FrameStride);
+    PIP_FRAGMENT Fragments = (PIP_FRAGMENT)MALLOC((SIZE_T)Concurrent * MaxFragments * sizeof(IP_FRAGMENT));
+    PULONG Lengths = (PULONG)MALLOC((SIZE_T)Concurrent * MaxFragments * sizeof(ULONG));
+    PIP_REASSEMBLER Reassembler = nullptr;
+    IP_REASSEMBLY_STATISTICS Statistics;
+    const BYTE * Datagram;
+    SIZE_T DatagramSize;
+    ULONG ret;
+
+    if (nullptr == Datagrams || nullptr == HeaderSlab || nullptr == Frames || nullptr == Fragments ||
+        nullptr == Lengths) {
+        printf("MALLOC: %u\n", GetLastError());
+        goto Cleanup;
+    }
+
+    ret = IpReassemblerCreate(Concurrent, 30000, IP_REASSEMBLY_OVERLAP_DROP, &Reassembler);
+    if (ERROR_SUCCESS != ret) {
+        printf("IpReassemblerCreate: %u\n", ret);
+        goto Cleanup;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //往返。
+
+    {
+        struct {
+            const char * Name;
+            UINT8 IpVersion;
+            ULONG Mtu;
+        } Cases[] = {{"ipv4", 4, 1500}, {"ipv6", 6, 1280}};
+
+        for (auto & Case : Cases) {
+            SIZE_T Size = BuildTestDatagram(Datagrams, Case.IpVersion, 0x1234, DataLength);
+            ULONG Count = MaxFragments;
+
+            ret = IpFragment(Datagrams, Size, Case.Mtu, 0x1234, HeaderSlab, HeaderSlabSize, Fragments, &Count);
+            if (ERROR_SUCCESS != ret) {
+                printf("%s: IpFragment: %u\n", Case.Name, ret);
+                continue;
+            }
+
+            MaterializeFragments(Fragments, Count, Frames, Lengths);
+
+            bool Passed = true;
+            for (ULONG i = 0; i < Count; i++) {
+                Passed = Passed && Lengths[i] - sizeof(ETHERNET_HEADER) <= Case.Mtu;
+            }
+
+            for (ULONG i = Count; i-- > 0;) { //倒序到达。
+                ret = IpReassemblerAdd(
+                    Reassembler, Frames + i * FrameStride, Lengths[i], 1000, &Datagram, &DatagramSize);
+                if (i) {
+                    Passed = Passed && ERROR_IO_PENDING == ret;
+                }
+            }
+
+            Passed = Passed && ERROR_SUCCESS == ret && Size == DatagramSize &&
+                     0 == memcmp(Datagram, Datagrams, Size);
+            printf("%s: %u fragments, %s\n", Case.Name, Count, Passed ? "ok" : "FAILED");
+        }
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //重复，重叠，超时。
+
+    {
+        SIZE_T Size = BuildTestDatagram(Datagrams, 4, 0x5678, DataLength);
+        ULONG Count = MaxFragments;
+        IpFragment(Datagrams, Size, 1500, 0, HeaderSlab, HeaderSlabSize, Fragments, &Count);
+        MaterializeFragments(Fragments, Count, Frames, Lengths);
+
+        IpReassemblerAdd(Reassembler, Frames, Lengths[0], 2000, &Datagram, &DatagramSize);
+        ULONG Duplicate = IpReassemblerAdd(Reassembler, Frames, Lengths[0], 2000, &Datagram, &DatagramSize);
+
+        //第二个分片的偏移往前移8字节，和第一个重叠。
+        PBYTE Overlapped = Frames + FrameStride;
+        PBYTE Ip = Overlapped + sizeof(ETHERNET_HEADER);
+        WriteUint16(Ip + 6, ReadUint16(Ip + 6) - 1);
+        SetIpv4Checksum(Ip, sizeof(IPV4_HEADER));
+        ULONG Overlap = IpReassemblerAdd(Reassembler, Overlapped, Lengths[1], 2000, &Datagram, &DatagramSize);
+
+        //只到了一个分片的，超时后被丢弃。
+        IpReassemblerAdd(Reassembler, Frames + 2 * FrameStride, Lengths[2], 3000, &Datagram, &DatagramSize);
+        IpReassemblerAdd(Reassembler, Frames, Lengths[0], 3000 + 30000, &Datagram, &DatagramSize);
+
+        IpReassemblerGetStatistics(Reassembler, &Statistics);
+        bool Passed = ERROR_IO_PENDING == Duplicate && ERROR_INVALID_DATA == Overlap &&
+                      1 == Statistics.Duplicates && 1 == Statistics.Overlaps && 1 == Statistics.Timeouts &&
+                      2 == Statistics.Datagrams && 1 == Statistics.InUse;
+        printf("duplicate/overlap/timeout: %s\n", Passed ? "ok" : "FAILED");
+    }
+
+    IpReassemblerDestroy(Reassembler);
+    Reassembler = nullptr;
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //吞吐量：Concurrent个数据报的分片交错着到达。
+
+    {
+        ret = IpReassemblerCreate(Concurrent, 30000, IP_REASSEMBLY_OVERLAP_DROP, &Reassembler);
+        if (ERROR_SUCCESS != ret) {
+            printf("IpReassemblerCreate: %u\n", ret);
+            goto Cleanup;
+        }
+
+        ULONG PerDatagram = 0;
+        SIZE_T FirstSize = 0;
+        for (ULONG d = 0; d < Concurrent; d++) {
+            PBYTE Original = Datagrams + (SIZE_T)d * 9000;
+            SIZE_T Size = BuildTestDatagram(Original, 4, (UINT16)d, DataLength);
+            ULONG Count = MaxFragments;
+            IpFragment(Original, Size, 1500, 0, HeaderSlab + d * HeaderSlabSize, HeaderSlabSize,
+                       Fragments + d * MaxFragments, &Count);
+            MaterializeFragments(Fragments + d * MaxFragments, Count, Frames + d * MaxFragments * FrameStride,
+                                 Lengths + d * MaxFragments);
+            PerDatagram = Count;
+            if (0 == d) {
+                FirstSize = Size;
+            }
+        }
+
+        LARGE_INTEGER Frequency, Start, End;
+        QueryPerformanceFrequency(&Frequency);
+
+        const ULONG Rounds = 5000;
+        UINT64 Bytes = 0, Completed = 0;
+
+        QueryPerformanceCounter(&Start);
+        for (ULONG r = 0; r < Rounds; r++) {
+            for (ULONG i = 0; i < PerDatagram; i++) {
+                for (ULONG d = 0; d < Concurrent; d++) {
+                    ULONG Slot = d * MaxFragments + i;
+                    ret = IpReassemblerAdd(
+                        Reassembler, Frames + Slot * FrameStride, Lengths[Slot], 1000, &Datagram, &DatagramSize);
+                    Bytes += Lengths[Slot];
+                    Completed += ERROR_SUCCESS == ret;
+                }
+            }
+        }
+        QueryPerformanceCounter(&End);
+
+        double Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+        UINT64 Total = (UINT64)Rounds * PerDatagram * Concurrent;
+        printf("reassemble: %8.2f Mpps%8.2f Gbps%8.2f ns/fragment, %s\n", Total / Seconds / 1e6,
+               Bytes * 8 / Seconds / 1e9, Seconds * 1e9 / Total,
+               (UINT64)Rounds * Concurrent == Completed ? "ok" : "FAILED");
+
+        ULONG Count = 0;
+        QueryPerformanceCounter(&Start);
+        for (ULONG r = 0; r < Rounds * Concurrent; r++) {
+            Count = MaxFragments;
+            IpFragment(Datagrams, FirstSize, 1500, r, HeaderSlab, HeaderSlabSize, Fragments, &Count);
+        }
+        QueryPerformanceCounter(&End);
+
+        Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+        Total = (UINT64)Rounds * Concurrent * Count;
+        printf("fragment:   %8.2f Mpps%8.2f ns/fragment\n", Total / Seconds / 1e6, Seconds * 1e9 / Total);
+    }
+
+Cleanup:
+    IpReassemblerDestroy(Reassembler);
+
+    if (Lengths) {
+        FREE(Lengths);
+    }
+
+    if (Fragments) {
+        FREE(Fragments);
+    }
+
+    if (Frames) {
+        FREE(Frames);
+    }
+
+    if (HeaderSlab) {
+        FREE(HeaderSlab);
+    }
+
+    if (Datagrams) {
+        FREE(Datagrams);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+int _cdecl main()
+{
+    FragmentBenchmark();
+
+    return 0;
+}
@@ -0,0 +1,598 @@
+﻿/*
+IpAddr.cpp的验证和基准测试，原来都是libnet.dll导出的。
+
+Windows上单独编译运行（不在test.vcxproj的生成里），VS的开发人员命令提示符下：
+cl /std:c++17 /O2 /EHsc /DUNICODE /D_UNICODE /wd4819 IpAddrBenchmark.cpp ..\libnet\IpAddr.cpp ..\libnet\IpClass.cpp
+
+CidrBenchmark：网段的枚举（CidrIteratorInit等），每个地址恰好出现一次，顺序的和乱序的吞吐量。
+IpTextBenchmark：地址的文本的转换（IpText.h），和InetPtonA/InetNtopA逐个比较，以及吞吐量。
+*/
+
+
+#include "..\libnet\pch.h"
+#include "..\libnet\IpAddr.h"
+#include "..\libnet\IpText.h"
+#include "..\libnet\SplitMix64.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static ULONG CidrCoverage(_Inout_ PCIDR_ITERATOR Iterator,
+                          _Inout_updates_bytes_(((SIZE_T)1 << Iterator->HostBits) / 8) PBYTE Bitmap,
+                          _Out_ double * Milliseconds)
+/*
+功能：枚举完整个网段，检查每个地址都在网段内且恰好出现一次。
+
+返回值：错误的个数。
+*/
+{
+    const ULONG Capacity = 65536;
+    const UINT64 Count = (UINT64)1 << Iterator->HostBits;
+    PUINT32 Addresses = (PUINT32)MALLOC(Capacity * sizeof(IN6_ADDR));
+    LARGE_INTEGER Frequency, Start, End;
+    UINT64 Total = 0;
+    ULONG Errors = 0;
+    ULONG n = 0;
+
+    *Milliseconds = 0;
+    if (nullptr == Addresses) {
+        return 1;
+    }
+
+    RtlZeroMemory(Bitmap, (SIZE_T)(Count + 7) / 8);
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    while (ERROR_SUCCESS == CidrIteratorNext(Iterator, Addresses, Capacity, &n)) {
+        for (ULONG i = 0; i < n; i++) {
+            UINT64 Host;
+            bool Inside;
+
+            if (AF_INET == Iterator->Family) {
+                UINT32 Address = Addresses[i];
+                if (0 == (Iterator->Flags & CIDR_FLAG_HOST_ORDER)) {
+                    Address = ntohl(Address);
+                }
+
+                Host = Address & Iterator->Mask;
+                Inside = (Address & ~Iterator->Mask) == Iterator->Base[1];
+            } else {
+                PUINT64 Address = (PUINT64)(Addresses + 4 * i);
+                Host = _byteswap_uint64(Address[1]) & Iterator->Mask;
+                Inside = _byteswap_uint64(Address[0]) == Iterator->Base[0] &&
+                         (_byteswap_uint64(Address[1]) & ~Iterator->Mask) == Iterator->Base[1];
+            }
+
+            if (!Inside || (Bitmap[Host / 8] & (1 << (Host % 8)))) {
+                Errors++;
+            }
+
+            Bitmap[Host / 8] |= (BYTE)(1 << (Host % 8));
+        }
+
+        Total += n;
+    }
+    QueryPerformanceCounter(&End);
+    *Milliseconds = (double)(End.QuadPart - Start.QuadPart) * 1e3 / Frequency.QuadPart;
+
+    if (Total != Count) {
+        Errors++;
+    }
+
+    FREE(Addresses);
+
+    return Errors;
+}
+
+
+static void CidrBenchmark()
+/*
+功能：CIDR枚举器的验证和基准测试。
+
+1.10.0.0.0/8的三种顺序：每个地址恰好一次，都在网段内，以及耗时（包括验证）。
+2.只枚举（不验证）一个/8的耗时（原来的EnumIPv4ByMasks要调用一千六百多万次InetNtop和printf）。
+3.断点续扫（CidrIteratorSeek）的结果和一次枚举完的一样。
+4.IPv6，字符串的解析和边界。
+*/
+{
+    const ULONG Capacity = 65536;
+    PBYTE Bitmap = (PBYTE)MALLOC(((SIZE_T)1 << 24) / 8);
+    PUINT32 Whole = (PUINT32)MALLOC(((SIZE_T)1 << 12) * sizeof(UINT32));
+    PUINT32 Chunk = (PUINT32)MALLOC(Capacity * sizeof(UINT32));
+    LARGE_INTEGER Frequency, Start, End;
+    CIDR_ITERATOR Iterator;
+    ULONG Errors = 0;
+    ULONG n = 0;
+
+    if (nullptr == Bitmap || nullptr == Whole || nullptr == Chunk) {
+        printf("LastError:%d\n", GetLastError());
+        goto Cleanup;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //覆盖。
+
+    {
+        const struct {
+            const char * Name;
+            ULONG Order;
+            UINT64 Parameter;
+            ULONG Flags;
+        } Cases[] = {
+            {"sequential", CIDR_ORDER_SEQUENTIAL, 0, 0},
+            {"strided", CIDR_ORDER_STRIDED, 0, CIDR_FLAG_HOST_ORDER},
+            {"shuffled", CIDR_ORDER_SHUFFLED, 12345, 0},
+        };
+
+        for (int i = 0; i < _ARRAYSIZE(Cases); i++) {
+            double Milliseconds = 0;
+            ULONG ret = CidrIteratorInitFromString(
+                &Iterator, "10.1.2.3/8", Cases[i].Order, Cases[i].Parameter, Cases[i].Flags);
+            ULONG Wrong = (ERROR_SUCCESS == ret) ? CidrCoverage(&Iterator, Bitmap, &Milliseconds) : 1;
+
+            printf("ipv4 /8 %-10s: %s, %8.1f ms (with verification)\n",
+                   Cases[i].Name,
+                   Wrong ? "FAILED" : "ok",
+                   Milliseconds);
+            Errors += Wrong;
+        }
+
+        double Milliseconds = 0;
+        ULONG Wrong = 1;
+        IN6_ADDR Prefix{};
+        Prefix.u.Byte[0] = 0x20;
+        Prefix.u.Byte[1] = 0x01;
+        Prefix.u.Byte[2] = 0x0d;
+        Prefix.u.Byte[3] = 0xb8;
+        if (ERROR_SUCCESS == CidrIteratorInit(&Iterator, AF_INET6, &Prefix, 104, CIDR_ORDER_SHUFFLED, 99, 0)) {
+            Wrong = CidrCoverage(&Iterator, Bitmap, &Milliseconds);
+        }
+
+        printf("ipv6 /104 shuffled  : %s, %8.1f ms (with verification)\n", Wrong ? "FAILED" : "ok", Milliseconds);
+        Errors += Wrong;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //只枚举的耗时。
+
+    {
+        const char * Names[] = {"sequential", "strided", "shuffled"}; //下标是CIDR_ORDER_*。
+        for (ULONG Order = CIDR_ORDER_SEQUENTIAL; Order <= CIDR_ORDER_SHUFFLED; Order++) {
+            UINT64 Total = 0;
+            volatile UINT32 Sink = 0;
+
+            CidrIteratorInitFromString(&Iterator, "10.0.0.0/8", Order, 1, 0);
+
+            QueryPerformanceCounter(&Start);
+            while (ERROR_SUCCESS == CidrIteratorNext(&Iterator, Chunk, Capacity, &n)) {
+                Sink = Sink + Chunk[n - 1];
+                Total += n;
+            }
+            QueryPerformanceCounter(&End);
+
+            double Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+            printf("ipv4 /8 %-10s: %I64u addresses in %6.1f ms, %7.1f M addresses/s\n",
+                   Names[Order],
+                   Total,
+                   Seconds * 1e3,
+                   Total / Seconds / 1e6);
+        }
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //断点续扫：一次取完，和分成不规则的几段（中间重新初始化并Seek）的结果一样。
+
+    {
+        const ULONG Total = 1 << 12;
+        UINT64 Offset = 0;
+        ULONG Wrong = 0;
+
+        CidrIteratorInitFromString(&Iterator, "172.16.0.0/20", CIDR_ORDER_SHUFFLED, 7, 0);
+        if (ERROR_SUCCESS != CidrIteratorNext(&Iterator, Whole, Total, &n) || n != Total ||
+            ERROR_NO_MORE_ITEMS != CidrIteratorNext(&Iterator, Chunk, Capacity, &n)) {
+            Wrong++;
+        }
+
+        while (Offset < Total) {
+            CidrIteratorInitFromString(&Iterator, "172.16.0.0/20", CIDR_ORDER_SHUFFLED, 7, 0);
+            CidrIteratorSeek(&Iterator, Offset);
+
+            if (ERROR_SUCCESS != CidrIteratorNext(&Iterator, Chunk, 1 + (ULONG)(Offset % 1000), &n) ||
+                0 != memcmp(Chunk, Whole + Offset, n * sizeof(UINT32))) {
+                Wrong++;
+                break;
+            }
+
+            Offset += n;
+            if (Offset != Iterator.Offset) {
+                Wrong++;
+            }
+        }
+
+        printf("resume: %s\n", Wrong ? "FAILED" : "ok");
+        Errors += Wrong;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //边界。
+
+    {
+        ULONG Wrong = 0;
+        IN6_ADDR IPv6[2];
+
+        // /32只有一个地址。
+        if (ERROR_SUCCESS != CidrIteratorInitFromString(&Iterator, "192.168.5.3", CIDR_ORDER_SHUFFLED, 1, 0) ||
+            ERROR_SUCCESS != CidrIteratorNext(&Iterator, Chunk, Capacity, &n) || 1 != n ||
+            Chunk[0] != htonl(0xc0a80503) || ERROR_NO_MORE_ITEMS != CidrIteratorNext(&Iterator, Chunk, 1, &n)) {
+            Wrong++;
+        }
+
+        // /64：跳到最后一个。
+        ULONG ret = CidrIteratorInitFromString(&Iterator, "2001:db8::1/64", CIDR_ORDER_SEQUENTIAL, 0, 0);
+        if (ERROR_SUCCESS != ret ||
+            ERROR_SUCCESS != CidrIteratorSeek(&Iterator, MAXUINT64) ||
+            ERROR_SUCCESS != CidrIteratorNext(&Iterator, IPv6, 2, &n) || 1 != n ||
+            0xffffffffffffffff != *(PUINT64)&IPv6[0].u.Byte[8] ||
+            ERROR_NO_MORE_ITEMS != CidrIteratorNext(&Iterator, IPv6, 2, &n)) {
+            Wrong++;
+        }
+
+        const char * Invalid[] = {
+            "", "10.0.0.0/", "10.0.0.0/33", "10.0.0.0/8x", "2001:db8::/63", "x/8", "10.0.0/8"};
+        for (int i = 0; i < _ARRAYSIZE(Invalid); i++) {
+            if (ERROR_INVALID_PARAMETER !=
+                CidrIteratorInitFromString(&Iterator, Invalid[i], CIDR_ORDER_SEQUENTIAL, 0, 0)) {
+                Wrong++;
+            }
+        }
+
+        printf("edge cases: %s\n", Wrong ? "FAILED" : "ok");
+        Errors += Wrong;
+    }
+
+    printf("cidr: %s (%lu errors)\n", Errors ? "FAILED" : "ok", Errors);
+
+Cleanup:
+    if (Chunk) {
+        FREE(Chunk);
+    }
+
+    if (Whole) {
+        FREE(Whole);
+    }
+
+    if (Bitmap) {
+        FREE(Bitmap);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static void MakeIpv6Sample(_Out_ PIN6_ADDR Address, _Inout_ PUINT64 Seed)
+/*
+功能：生成一个测试用的IPv6地址：各段随机地是0，小的值或者任意的值（以覆盖各种零段和前导零），
+以及一部分映射，兼容，转换和ISATAP的地址。
+*/
+{
+    const UINT64 Shape = SplitMix64(Seed);
+    const UINT64 Value[2] = {SplitMix64(Seed), SplitMix64(Seed)};
+
+    for (int i = 0; i < 8; i++) {
+        const ULONG Kind = (Shape >> (4 * i)) & 0xf;
+        UINT16 Word = (UINT16)(Value[i / 4] >> (16 * (i % 4)));
+
+        if (Kind < 6) {
+            Word = 0;
+        } else if (Kind < 8) {
+            Word &= 0xf;
+        } else if (Kind < 10) {
+            Word &= 0xff;
+        } else if (Kind < 12) {
+            Word &= 0xfff;
+        }
+
+        Address->u.Byte[2 * i] = (BYTE)(Word >> 8);
+        Address->u.Byte[2 * i + 1] = (BYTE)Word;
+    }
+
+    switch ((Shape >> 32) & 0xf) {
+    case 0: //::ffff:a.b.c.d
+        RtlZeroMemory(Address->u.Byte, 10);
+        Address->u.Byte[10] = Address->u.Byte[11] = 0xff;
+        break;
+    case 1: //::a.b.c.d，包括::0.0.0.x。
+        RtlZeroMemory(Address->u.Byte, (Shape >> 36) & 1 ? 12 : 14);
+        break;
+    case 2: //::ffff:0:a.b.c.d
+        RtlZeroMemory(Address->u.Byte, 12);
+        Address->u.Byte[8] = Address->u.Byte[9] = 0xff;
+        break;
+    case 3: // ISATAP
+        Address->u.Byte[8] = (Shape >> 36) & 1 ? 0x02 : 0;
+        Address->u.Byte[9] = 0;
+        Address->u.Byte[10] = 0x5e;
+        Address->u.Byte[11] = 0xfe;
+        break;
+    case 4: //::，::1
+        RtlZeroMemory(Address->u.Byte, 15);
+        Address->u.Byte[15] = (Shape >> 36) & 1;
+        break;
+    default:
+        break;
+    }
+}
+
+
+static void MutateText(_Inout_updates_z_(Size) char * Text, _In_ SIZE_T Size, _Inout_ PUINT64 Seed)
+/*
+功能：随机地修改（替换，删除，插入，截断）一个地址的文本，用来产生各种几乎合法的文本。
+*/
+{
+    static const char Alphabet[] = "0123456789abcdefABCDEF::..g%x ";
+    SIZE_T Length = strlen(Text);
+    const UINT64 r = SplitMix64(Seed);
+    const SIZE_T Position = Length ? (SIZE_T)((r >> 8) % Length) : 0;
+    const char c = Alphabet[(r >> 32) % (_ARRAYSIZE(Alphabet) - 1)];
+
+    switch (r & 3) {
+    case 0:
+        if (Length) {
+            Text[Position] = c;
+        }
+        break;
+    case 1:
+        if (Length) {
+            memmove(Text + Position, Text + Position + 1, Length - Position);
+        }
+        break;
+    case 2:
+        if (Length + 1 < Size) {
+            memmove(Text + Position + 1, Text + Position, Length - Position + 1);
+            Text[Position] = c;
+        }
+        break;
+    default:
+        Text[Position] = 0;
+        break;
+    }
+}
+
+
+static ULONG IpTextDifferential(_In_ ADDRESS_FAMILY Family,
+                                _In_ ULONG Count,
+                                _Inout_ PUINT64 Seed,
+                                _Out_writes_bytes_(IpText::Ipv6BufferSize * 2) char * Text)
+/*
+功能：和InetNtopA/InetPtonA对比（以及标量和SIMD的实现之间对比）。
+
+1.随机的地址：格式化的结果逐字节相同，解析回来的地址相同。
+2.随机修改过的文本：是否有效，以及有效的地址，和InetPtonA的相同。
+
+返回值：不同的个数，前几个会打印出来。
+*/
+{
+    char * Os = Text + IpText::Ipv6BufferSize;
+    ULONG Errors = 0;
+
+    for (ULONG i = 0; i < Count; i++) {
+        IN6_ADDR Address{}, Expected{}, Actual{};
+        bool Wrong = false;
+
+        if (AF_INET == Family) {
+            UINT32 Value = (UINT32)SplitMix64(Seed);
+            Value &= (i & 1) ? 0xffffffff : 0x3f3f3f3f; //一半的各段都比较小。
+            RtlCopyMemory(&Address, &Value, sizeof(Value));
+        } else {
+            MakeIpv6Sample(&Address, Seed);
+        }
+
+        if (AF_INET == Family) {
+            IpText::FormatIpv4((PIN_ADDR)&Address, Text);
+        } else {
+            IpText::FormatIpv6(&Address, Text);
+        }
+
+        InetNtopA(Family, &Address, Os, IpText::Ipv6BufferSize);
+        Wrong |= (0 != strcmp(Text, Os));
+
+#if defined(_M_IX86) || defined(_M_X64)
+        char Scalar[IpText::Ipv6BufferSize];
+        if (AF_INET6 == Family) {
+            char Chars[IpText::Ipv6HexSize];
+            ULONG ZeroMask = IpText::HexIpv6Scalar(&Address, Chars);
+            IpText::FormatIpv6Hexed(&Address, Chars, ZeroMask, Scalar);
+            Wrong |= (0 != strcmp(Text, Scalar));
+        }
+#endif
+
+        //解析：格式化的结果，或者随机修改过的。
+        if (i & 2) {
+            MutateText(Os, IpText::Ipv6BufferSize, Seed);
+            if (i & 4) {
+                MutateText(Os, IpText::Ipv6BufferSize, Seed);
+            }
+        }
+
+        const SIZE_T Length = strlen(Os);
+        const bool OsOk = (1 == InetPtonA(Family, Os, &Expected));
+        bool Ok;
+        if (AF_INET == Family) {
+            Ok = IpText::ParseIpv4(Os, Length, (PIN_ADDR)&Actual);
+        } else {
+            Ok = IpText::ParseIpv6(Os, Length, &Actual);
+        }
+
+        const SIZE_T Size = (AF_INET == Family) ? sizeof(IN_ADDR) : sizeof(IN6_ADDR);
+        Wrong |= (Ok != OsOk) || (Ok && 0 != memcmp(&Actual, &Expected, Size));
+
+#if defined(_M_IX86) || defined(_M_X64)
+        IN6_ADDR Other{};
+        bool OtherOk;
+        if (AF_INET == Family) {
+            OtherOk = IpText::ParseIpv4Scalar(Os, Length, (PIN_ADDR)&Other);
+        } else {
+            IpText::Ipv6Classes Classes;
+            IpText::ClassifyIpv6Scalar(Os, min(Length, IpText::Ipv6MaxLength), &Classes);
+            OtherOk = Length && Length <= IpText::Ipv6MaxLength &&
+                      IpText::ParseIpv6Classified(Os, Length, &Classes, &Other);
+        }
+
+        Wrong |= (OtherOk != Ok) || (Ok && 0 != memcmp(&Actual, &Other, Size));
+#endif
+
+        if (Wrong && Errors++ < 5) {
+            printf("  mismatch: %s (os %s) -> libnet %d, os %d\n", Text, Os, Ok, OsOk);
+        }
+    }
+
+    return Errors;
+}
+
+
+static void IpTextBenchmark()
+/*
+功能：地址的文本转换的验证和基准测试。
+
+1.和InetNtopA/InetPtonA的差分测试（随机的地址和随机修改过的文本）。
+2.InetNtopA/InetPtonA和批量接口的速度（地址/秒）。
+*/
+{
+    const ULONG Count = 1 << 18;
+    const ULONG Rounds = 8;
+    const SIZE_T Stride = IpText::Ipv6BufferSize;
+    PSTR Text = (PSTR)MALLOC(Count * Stride);
+    PCSTR * Strings = (PCSTR *)MALLOC(Count * sizeof(PCSTR));
+    PIN6_ADDR Addresses = (PIN6_ADDR)MALLOC(Count * sizeof(IN6_ADDR));
+    PIN6_ADDR Parsed = (PIN6_ADDR)MALLOC(Count * sizeof(IN6_ADDR));
+    LARGE_INTEGER Frequency, Start, End;
+    char Scratch[IpText::Ipv6BufferSize * 2];
+    UINT64 Seed = 0x5eed;
+    ULONG Errors = 0;
+
+    if (nullptr == Text || nullptr == Strings || nullptr == Addresses || nullptr == Parsed) {
+        printf("LastError:%d\n", GetLastError());
+        goto Cleanup;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+
+#if defined(_M_IX86) || defined(_M_X64)
+    printf("sse4.1: %s\n", IpText::UseSse41() ? "yes" : "no");
+#endif
+
+    for (int i = 0; i < 2; i++) {
+        const ADDRESS_FAMILY Family = i ? AF_INET6 : AF_INET;
+        ULONG Wrong = IpTextDifferential(Family, 1 << 20, &Seed, Scratch);
+
+        printf("ipv%d differential: %s (%lu mismatches)\n", i ? 6 : 4, Wrong ? "FAILED" : "ok", Wrong);
+        Errors += Wrong;
+    }
+
+    for (ULONG i = 0; i < Count; i++) {
+        Strings[i] = Text + i * Stride;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        const ADDRESS_FAMILY Family = i ? AF_INET6 : AF_INET;
+        const SIZE_T Size = i ? sizeof(IN6_ADDR) : sizeof(IN_ADDR);
+        double Os[2], Batch[2]; //格式化，解析。
+        volatile ULONG Sink = 0;
+
+        for (ULONG j = 0; j < Count; j++) {
+            if (i) {
+                MakeIpv6Sample(&Addresses[j], &Seed);
+            } else {
+                ((PIN_ADDR)Addresses)[j].S_un.S_addr = (ULONG)SplitMix64(&Seed);
+            }
+        }
+
+        QueryPerformanceCounter(&Start);
+        for (ULONG Round = 0; Round < Rounds; Round++) {
+            for (ULONG j = 0; j < Count; j++) {
+                InetNtopA(Family, (PBYTE)Addresses + j * Size, Text + j * Stride, Stride);
+            }
+        }
+        QueryPerformanceCounter(&End);
+        Os[0] = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+
+        QueryPerformanceCounter(&Start);
+        for (ULONG Round = 0; Round < Rounds; Round++) {
+            if (i) {
+                FormatIPv6Batch(Addresses, Count, Text, Stride, nullptr);
+            } else {
+                FormatIPv4Batch((PIN_ADDR)Addresses, Count, Text, Stride, nullptr);
+            }
+        }
+        QueryPerformanceCounter(&End);
+        Batch[0] = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+
+        QueryPerformanceCounter(&Start);
+        for (ULONG Round = 0; Round < Rounds; Round++) {
+            for (ULONG j = 0; j < Count; j++) {
+                Sink = Sink + InetPtonA(Family, Strings[j], (PBYTE)Parsed + j * Size);
+            }
+        }
+        QueryPerformanceCounter(&End);
+        Os[1] = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+
+        ULONG Valid = 0;
+        QueryPerformanceCounter(&Start);
+        for (ULONG Round = 0; Round < Rounds; Round++) {
+            if (i) {
+                Valid = ParseIPv6Batch(Strings, Count, Parsed, nullptr);
+            } else {
+                Valid = ParseIPv4Batch(Strings, Count, (PIN_ADDR)Parsed, nullptr);
+            }
+        }
+        QueryPerformanceCounter(&End);
+        Batch[1] = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+
+        if (Valid != Count || 0 != memcmp(Addresses, Parsed, Count * Size)) {
+            printf("ipv%d round trip: FAILED\n", i ? 6 : 4);
+            Errors++;
+        }
+
+        printf("ipv%d format: os %6.1f M/s, batch %6.1f M/s; parse: os %6.1f M/s, batch %6.1f M/s\n",
+               i ? 6 : 4,
+               (double)Count * Rounds / Os[0] / 1e6,
+               (double)Count * Rounds / Batch[0] / 1e6,
+               (double)Count * Rounds / Os[1] / 1e6,
+               (double)Count * Rounds / Batch[1] / 1e6);
+    }
+
+    printf("iptext: %s (%lu errors)\n", Errors ? "FAILED" : "ok", Errors);
+
+Cleanup:
+    if (Parsed) {
+        FREE(Parsed);
+    }
+
+    if (Addresses) {
+        FREE(Addresses);
+    }
+
+    if (Strings) {
+        FREE(Strings);
+    }
+
+    if (Text) {
+        FREE(Text);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+int _cdecl main()
+{
+    CidrBenchmark();
+    IpTextBenchmark();
+
+    return 0;
+}
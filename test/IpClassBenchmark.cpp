@@ -0,0 +1,191 @@
+﻿/*
+地址分类（IpClass.cpp）的验证和基准测试：和朴素的实现（逐个前缀比较，取最长的）对比，以及单个和批量的速度。
+
+Windows上单独编译运行（不在test.vcxproj的生成里），VS的开发人员命令提示符下：
+cl /std:c++17 /O2 /EHsc /DUNICODE /D_UNICODE /wd4819 IpClassBenchmark.cpp
+
+直接包含IpClass.cpp，朴素的实现要用它里面的前缀表（Ipv4Prefixes，Ipv6Prefixes等，都是static的）。
+*/
+
+
+#include "..\libnet\IpClass.cpp"
+#include "..\libnet\SplitMix64.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+template <SIZE_T Count>
+static UINT8 IpClassReference(const IpClassPrefix (&Prefixes)[Count], const BYTE * Address, ULONG Bytes)
+/*
+功能：朴素的实现（逐个前缀比较，取最长的），用于验证和对比。
+*/
+{
+    UINT8 Class = IP_CLASS_GLOBAL;
+
+    for (SIZE_T i = 0; i < Count; i++) { //已按长度排序，后面匹配的更长。
+        ULONG Length = Prefixes[i].PrefixLength;
+        ULONG Whole = Length / 8;
+        bool Match = 0 == memcmp(Address, Prefixes[i].Address, Whole);
+
+        if (Match && Length % 8) {
+            BYTE Mask = (BYTE)(0xff00 >> (Length % 8));
+            Match = (Address[Whole] & Mask) == Prefixes[i].Address[Whole];
+        }
+
+        if (Match) {
+            Class = Prefixes[i].Class;
+        }
+    }
+
+    if (16 == Bytes && 0xff == Address[0]) {
+        Class = Ipv6MulticastScope[Address[1] & 0xf];
+    }
+
+    return Class;
+}
+
+
+template <SIZE_T Count>
+static void IpClassSamples(const IpClassPrefix (&Prefixes)[Count],
+                           ULONG Bytes,
+                           _Out_writes_bytes_(Samples * 16) PBYTE Addresses,
+                           ULONG Samples,
+                           _Inout_ PUINT64 Seed)
+/*
+功能：生成测试的地址：一半随机，一半在前缀的边界附近（第一个，最后一个，前一个，后一个）。
+*/
+{
+    for (ULONG i = 0; i < Samples; i++) {
+        PBYTE Address = Addresses + (SIZE_T)i * 16;
+        UINT64 Random[2] = {SplitMix64(Seed), SplitMix64(Seed)};
+
+        RtlCopyMemory(Address, Random, 16);
+        if (i % 2) {
+            continue;
+        }
+
+        const IpClassPrefix * Prefix = &Prefixes[Random[0] % Count];
+        ULONG Length = Prefix->PrefixLength;
+        bool Last = Random[1] & 1;
+
+        for (ULONG k = 0; k < Bytes; k++) { //前缀部分不变，主机部分全0或者全1。
+            BYTE Mask = k * 8 + 8 <= Length ? 0xff : (k * 8 >= Length ? 0 : (BYTE)(0xff00 >> (Length % 8)));
+            Address[k] = (Prefix->Address[k] & Mask) | (Last ? (BYTE)~Mask : 0);
+        }
+
+        if (Random[1] & 2) { //越过边界。
+            for (LONG k = Bytes - 1; k >= 0; k--) {
+                if (Last ? 0 != ++Address[k] : 0 != Address[k]--) {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+
+static void IpClassBenchmark()
+/*
+功能：地址分类的验证和基准测试。
+
+1.和朴素的实现（逐个前缀比较）对比随机的地址和前缀的边界附近的地址。
+2.单个，批量，和朴素的实现的速度。
+*/
+{
+    const ULONG Samples = 1 << 20;
+    PBYTE Addresses = (PBYTE)MALLOC((SIZE_T)Samples * 16);
+    PIN_ADDR Addresses4 = (PIN_ADDR)MALLOC((SIZE_T)Samples * sizeof(IN_ADDR));
+    PUINT8 Classes = (PUINT8)MALLOC(Samples);
+    LARGE_INTEGER Frequency, Start, End;
+    UINT64 Seed = 0x1234;
+    ULONG Errors = 0;
+
+    if (nullptr == Addresses || nullptr == Addresses4 || nullptr == Classes) {
+        printf("LastError:%d\n", GetLastError());
+        goto Cleanup;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+
+    printf("tables: ipv4 %lu x 256 bytes, ipv6 %lu x 256 bytes\n", Ipv4Tables, Ipv6Tables);
+
+    for (int Family = 0; Family < 2; Family++) {
+        const ULONG Bytes = Family ? 16 : 4;
+        ULONG Wrong = 0;
+        UINT64 Sink = 0;
+        double Single, Batch, Naive;
+
+        if (Family) {
+            IpClassSamples(Ipv6Prefixes, Bytes, Addresses, Samples, &Seed);
+        } else {
+            IpClassSamples(Ipv4Prefixes, Bytes, Addresses, Samples, &Seed);
+            for (ULONG i = 0; i < Samples; i++) {
+                RtlCopyMemory(&Addresses4[i], Addresses + (SIZE_T)i * 16, sizeof(IN_ADDR));
+            }
+        }
+
+        QueryPerformanceCounter(&Start);
+        for (ULONG i = 0; i < Samples; i++) {
+            const BYTE * Address = Addresses + (SIZE_T)i * 16;
+            Sink += Family ? IpClassify6((const IN6_ADDR *)Address) : IpClassify4(&Addresses4[i]);
+        }
+        QueryPerformanceCounter(&End);
+        Single = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+
+        QueryPerformanceCounter(&Start);
+        if (Family) {
+            IpClassify6Batch((const IN6_ADDR *)Addresses, Samples, Classes);
+        } else {
+            IpClassify4Batch(Addresses4, Samples, Classes);
+        }
+        QueryPerformanceCounter(&End);
+        Batch = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+
+        QueryPerformanceCounter(&Start);
+        for (ULONG i = 0; i < Samples; i++) {
+            const BYTE * Address = Addresses + (SIZE_T)i * 16;
+            UINT8 Expected = Family ? IpClassReference(Ipv6Prefixes, Address, Bytes)
+                                    : IpClassReference(Ipv4Prefixes, Address, Bytes);
+            Wrong += Expected != Classes[i];
+        }
+        QueryPerformanceCounter(&End);
+        Naive = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+
+        printf("ipv%d: single %6.1f M/s, batch %6.1f M/s, naive %6.1f M/s, verify %s (%lu errors, sink %llu)\n",
+               Family ? 6 : 4,
+               Samples / Single / 1e6,
+               Samples / Batch / 1e6,
+               Samples / Naive / 1e6,
+               Wrong ? "FAILED" : "ok",
+               Wrong,
+               Sink);
+        Errors += Wrong;
+    }
+
+    printf("ipclass: %s (%lu errors)\n", Errors ? "FAILED" : "ok", Errors);
+
+Cleanup:
+    if (Classes) {
+        FREE(Classes);
+    }
+
+    if (Addresses4) {
+        FREE(Addresses4);
+    }
+
+    if (Addresses) {
+        FREE(Addresses);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+int _cdecl main()
+{
+    IpClassBenchmark();
+
+    return 0;
+}
@@ -0,0 +1,526 @@
+﻿/*
+地址集合（IpSet.cpp）的验证和基准测试：在一个地址窗口里和位图对比（增加，集合运算，包含），以及加载和查询的速度。
+
+Windows上单独编译运行（不在test.vcxproj的生成里），VS的开发人员命令提示符下：
+cl /std:c++17 /O2 /EHsc /DUNICODE /D_UNICODE /wd4819 IpSetBenchmark.cpp
+
+直接包含IpSet.cpp，参照的位图要用它里面的KeyFromAddress/KeyToAddress和IP_KEY6（static的）。
+*/
+
+
+#include "..\libnet\IpSet.cpp"
+#include "..\libnet\SplitMix64.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#define IP_SET_WINDOW_BITS 20 //验证用的地址窗口（2^20个地址，用位图做参照）。
+
+
+static void WindowAddress(_In_ ADDRESS_FAMILY Family, _In_ UINT32 Offset, _Out_ PIN6_ADDR Address)
+/*
+功能：验证用的窗口里的第Offset个地址。
+IPv4的是10.0.0.0/12；IPv6的跨过64位的边界（2001:db8::ffff:ffff:fff8:0开始），以检查进位。
+*/
+{
+    RtlZeroMemory(Address, sizeof(IN6_ADDR));
+
+    if (AF_INET == Family) {
+        KeyToAddress(0x0a000000 + Offset, (PIN_ADDR)Address);
+    } else {
+        IP_KEY6 Key{0x20010db800000000, 0xfffffffffff80000};
+        Key.Low += Offset;
+        if (Key.Low < Offset) {
+            Key.High++;
+        }
+
+        KeyToAddress(Key, Address);
+    }
+}
+
+
+static SIZE_T MakeWindowText(_In_ ADDRESS_FAMILY Family,
+                             _In_ ULONG Lines,
+                             _Inout_ PUINT64 Seed,
+                             _Inout_updates_(1 << IP_SET_WINDOW_BITS) PBYTE Bitmap,
+                             _Out_writes_bytes_(Size) char * Text,
+                             _In_ SIZE_T Size)
+/*
+功能：在窗口里随机生成Lines行（单个地址，前缀，区间），同时在位图（每个地址一个字节）里标记。
+*/
+{
+    SIZE_T Used = 0;
+    const ULONG Window = 1 << IP_SET_WINDOW_BITS;
+
+    for (ULONG i = 0; i < Lines && Used + 128 < Size; i++) {
+        UINT64 r = SplitMix64(Seed);
+        UINT32 First = (UINT32)(r % Window);
+        UINT32 Last = First;
+        IN6_ADDR Address;
+        char * Out = Text + Used;
+
+        WindowAddress(Family, First, &Address);
+        Out += (AF_INET == Family) ? IpText::FormatIpv4((PIN_ADDR)&Address, Out)
+                                   : IpText::FormatIpv6(&Address, Out);
+
+        switch ((r >> 32) % 3) {
+        case 1: {
+            ULONG Bits = (ULONG)((r >> 40) % 13);
+            First &= ~((1u << Bits) - 1);
+            Last = First + (1u << Bits) - 1;
+            Out += sprintf_s(Out, 8, "/%lu", (AF_INET == Family ? 32 : 128) - Bits);
+            break;
+        }
+        case 2:
+            Last = min(First + (UINT32)((r >> 40) % 5000), Window - 1);
+            WindowAddress(Family, Last, &Address);
+            *Out++ = '-';
+            Out += (AF_INET == Family) ? IpText::FormatIpv4((PIN_ADDR)&Address, Out)
+                                       : IpText::FormatIpv6(&Address, Out);
+            break;
+        default:
+            break;
+        }
+
+        *Out++ = '\n';
+        Used = Out - Text;
+
+        for (UINT32 k = First; k <= Last; k++) {
+            Bitmap[k] = 1;
+        }
+    }
+
+    return Used;
+}
+
+
+static ULONG VerifyWindow(_In_ ADDRESS_FAMILY Family, _Inout_ PUINT64 Seed, _Inout_ PBYTE Bitmaps)
+/*
+功能：在窗口里用位图验证导入，并，交，差，包含，CIDR和防火墙的文本（再解析回来比较）。
+
+参数：
+Bitmaps：4个窗口大小的位图（A，B，和两个临时的）。
+*/
+{
+    const ULONG Window = 1 << IP_SET_WINDOW_BITS;
+    const SIZE_T TextSize = 8 * 1024 * 1024;
+    PBYTE BitmapA = Bitmaps, BitmapB = Bitmaps + Window, Check = Bitmaps + 2 * Window;
+    char * Text = (char *)MALLOC(TextSize);
+    PLPM_PREFIX Prefixes = nullptr;
+    PWSTR Firewall = nullptr;
+    PIP_SET A = nullptr, B = nullptr, Union = nullptr, Intersect = nullptr, Difference = nullptr, Back = nullptr;
+    ULONG Errors = 0;
+
+    if (nullptr == Text) {
+        return 1;
+    }
+
+    RtlZeroMemory(Bitmaps, (SIZE_T)Window * 4);
+
+    if (ERROR_SUCCESS != IpSetCreate(&A) || ERROR_SUCCESS != IpSetCreate(&B) ||
+        ERROR_SUCCESS != IpSetCreate(&Back)) {
+        Errors++;
+        goto Cleanup;
+    }
+
+    {
+        SIZE_T Size = MakeWindowText(Family, 20000, Seed, BitmapA, Text, TextSize);
+        if (ERROR_SUCCESS != IpSetLoadText(A, Text, Size, nullptr)) {
+            Errors++;
+        }
+
+        Size = MakeWindowText(Family, 20000, Seed, BitmapB, Text, TextSize);
+        if (ERROR_SUCCESS != IpSetLoadText(B, Text, Size, nullptr)) {
+            Errors++;
+        }
+
+        if (ERROR_SUCCESS != IpSetUnion(A, B, &Union) || ERROR_SUCCESS != IpSetIntersect(A, B, &Intersect) ||
+            ERROR_SUCCESS != IpSetDifference(A, B, &Difference)) {
+            Errors++;
+            goto Cleanup;
+        }
+    }
+
+    for (ULONG k = 0; k < Window; k++) {
+        IN6_ADDR Address;
+        BOOLEAN a = BitmapA[k], b = BitmapB[k];
+
+        WindowAddress(Family, k, &Address);
+        Errors += IpSetContains(A, Family, &Address) != a;
+        Errors += IpSetContains(Union, Family, &Address) != (a || b);
+        Errors += IpSetContains(Intersect, Family, &Address) != (a && b);
+        Errors += IpSetContains(Difference, Family, &Address) != (a && !b);
+    }
+
+    {
+        //CIDR：覆盖恰好是A，互不相交，前缀的个数等于逐个区间贪心的结果（已是最少的）。
+        ULONG Count = 0;
+        if (ERROR_INSUFFICIENT_BUFFER != IpSetGetPrefixes(A, Family, nullptr, 0, &Count)) {
+            Errors++;
+        }
+
+        Prefixes = (PLPM_PREFIX)MALLOC((SIZE_T)Count * sizeof(LPM_PREFIX) + 1);
+        if (nullptr == Prefixes || ERROR_SUCCESS != IpSetGetPrefixes(A, Family, Prefixes, Count, &Count)) {
+            Errors++;
+            goto Cleanup;
+        }
+
+        for (ULONG i = 0; i < Count; i++) {
+            ULONG Width = AF_INET == Family ? 32 : 128;
+            ULONG Bits = Width - Prefixes[i].PrefixLength;
+            IN6_ADDR Base;
+            UINT32 Offset;
+
+            WindowAddress(Family, 0, &Base);
+            if (AF_INET == Family) {
+                Offset = KeyFromAddress((PIN_ADDR)Prefixes[i].Address) - KeyFromAddress((PIN_ADDR)&Base);
+            } else {
+                Offset = (UINT32)(KeyFromAddress((PIN6_ADDR)Prefixes[i].Address).Low - KeyFromAddress(&Base).Low);
+            }
+
+            if (Bits > IP_SET_WINDOW_BITS || Offset + (1ULL << Bits) > Window) {
+                Errors++;
+                continue;
+            }
+
+            for (UINT32 k = Offset; k < Offset + (1u << Bits); k++) {
+                Check[k]++;
+            }
+        }
+
+        for (ULONG k = 0; k < Window; k++) {
+            Errors += Check[k] != BitmapA[k];
+        }
+    }
+
+    {
+        //防火墙的文本，每次最多100个条目，再解析回来应该和A一样。
+        const SIZE_T Characters = 100 * 2 * IpText::Ipv6BufferSize;
+        ULONG Start = 0, Next = 0;
+        IP_SET_INFORMATION Information;
+
+        IpSetQuery(A, &Information);
+        const ULONG Total = Information.Ranges[0] + Information.Ranges[1];
+
+        Firewall = (PWSTR)MALLOC(Characters * sizeof(WCHAR));
+        if (nullptr == Firewall) {
+            Errors++;
+            goto Cleanup;
+        }
+
+        while (ERROR_SUCCESS == IpSetFormatFirewallAddresses(A, Start, 100, Firewall, Characters, &Next)) {
+            SIZE_T Length = 0;
+            for (PWSTR p = Firewall; *p; p++) {
+                Text[Length++] = (L',' == *p) ? '\n' : (char)*p;
+            }
+
+            Errors += ERROR_SUCCESS != IpSetLoadText(Back, Text, Length, nullptr);
+            Errors += Next - Start != 100 && Next != Total;
+            Start = Next;
+        }
+
+        Errors += Start != Total;
+
+        for (ULONG k = 0; k < Window; k++) {
+            IN6_ADDR Address;
+            WindowAddress(Family, k, &Address);
+            Errors += IpSetContains(Back, Family, &Address) != BitmapA[k];
+        }
+    }
+
+Cleanup:
+    IpSetDestroy(A);
+    IpSetDestroy(B);
+    IpSetDestroy(Union);
+    IpSetDestroy(Intersect);
+    IpSetDestroy(Difference);
+    IpSetDestroy(Back);
+
+    if (Firewall) {
+        FREE(Firewall);
+    }
+
+    if (Prefixes) {
+        FREE(Prefixes);
+    }
+
+    FREE(Text);
+    return Errors;
+}
+
+
+static ULONG VerifyEdges()
+/*
+功能：边界：整个地址空间，最大的地址，相邻的合并，无法解析的行和注释。
+*/
+{
+    const char Text[] = "0.0.0.0/0\n"
+                        "::/0\n"
+                        "# comment\n"
+                        "; comment\n"
+                        "\n"
+                        "1.2.3.4 ; SBL123\n"
+                        "01.2.3.4\n"
+                        "1.2.3.4/33\n"
+                        "1.2.3.9-1.2.3.4\n"
+                        "1.2.3.4-::1\n"
+                        "1.2.3.4/8";
+    PIP_SET All = nullptr, Top = nullptr, Rest = nullptr;
+    IP_SET_LOAD_STATISTICS Statistics;
+    IP_SET_INFORMATION Information;
+    LPM_PREFIX Prefixes[64];
+    ULONG Count = 0;
+    ULONG Errors = 0;
+    IN_ADDR Address;
+    IN6_ADDR Address6;
+
+    if (ERROR_SUCCESS != IpSetCreate(&All) || ERROR_SUCCESS != IpSetCreate(&Top)) {
+        Errors++;
+        goto Cleanup;
+    }
+
+    Errors += ERROR_SUCCESS != IpSetLoadText(All, Text, sizeof(Text) - 1, &Statistics);
+    Errors += Statistics.Lines != 11 || Statistics.Entries != 4 || Statistics.BadLines != 4;
+    Errors += Statistics.FirstBadLine != 7;
+
+    IpSetQuery(All, &Information);
+    Errors += Information.Ranges[0] != 1 || Information.Ranges[1] != 1 || Information.Addresses4 != 0x100000000;
+
+    Errors += ERROR_SUCCESS != IpSetGetPrefixes(All, AF_UNSPEC, Prefixes, _ARRAYSIZE(Prefixes), &Count);
+    Errors += Count != 2 || Prefixes[0].PrefixLength != 0 || Prefixes[1].PrefixLength != 0;
+
+    //最后的地址和相邻的合并：255.255.255.254/31，ffff:ffff:ffff:fffe:ffff:ffff:ffff:ffff/128和ffff:ffff:ffff:ffff::/64。
+    Errors += ERROR_SUCCESS != IpSetAddString(Top, "255.255.255.255");
+    Errors += ERROR_SUCCESS != IpSetAddString(Top, "255.255.255.254");
+    Errors += ERROR_SUCCESS != IpSetAddString(Top, "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff");
+    Errors += ERROR_SUCCESS != IpSetAddString(Top, "ffff:ffff:ffff:ffff::/64");
+    Errors += ERROR_SUCCESS != IpSetAddString(Top, "ffff:ffff:ffff:fffe:ffff:ffff:ffff:ffff");
+    Errors += ERROR_SUCCESS != IpSetGetPrefixes(Top, AF_UNSPEC, Prefixes, _ARRAYSIZE(Prefixes), &Count);
+    Errors += Count != 3 || Prefixes[0].PrefixLength != 31 || Prefixes[1].PrefixLength != 128 ||
+              Prefixes[2].PrefixLength != 64;
+
+    Errors += ERROR_SUCCESS != IpSetDifference(All, Top, &Rest);
+    if (Rest) {
+        IpSetQuery(Rest, &Information);
+        Errors += Information.Ranges[0] != 1 || Information.Addresses4 != 0xfffffffe || Information.Ranges[1] != 1;
+
+        Address.S_un.S_addr = 0xffffffff;
+        Errors += IpSetContains(Rest, AF_INET, &Address) || !IpSetContains(Top, AF_INET, &Address);
+        Address.S_un.S_addr = 0;
+        Errors += !IpSetContains(Rest, AF_INET, &Address);
+        RtlFillMemory(&Address6, sizeof(Address6), 0xff);
+        Errors += IpSetContains(Rest, AF_INET6, &Address6) || !IpSetContains(Top, AF_INET6, &Address6);
+
+        // 0.0.0.0-255.255.255.253是一个区间，但要31个前缀（/1到/31）。
+        Count = 0;
+        Errors += ERROR_SUCCESS != IpSetGetPrefixes(Rest, AF_INET, Prefixes, _ARRAYSIZE(Prefixes), &Count);
+        Errors += Count != 31;
+    }
+
+Cleanup:
+    IpSetDestroy(All);
+    IpSetDestroy(Top);
+    IpSetDestroy(Rest);
+    return Errors;
+}
+
+
+static void IpSetBenchmark()
+/*
+功能：地址集合的验证和基准测试。
+
+1.边界和窗口里的验证（和位图对比）。
+2.导入几百万行的地址列表（单个地址，前缀，区间，各占三分之一），速度和内存。
+3.并，交，差，包含，CIDR的速度。
+*/
+{
+    const ULONG Lines = 3000000;
+    const SIZE_T TextSize = (SIZE_T)Lines * 40;
+    const ULONG Lookups = 1 << 22;
+    char * Text = (char *)MALLOC(TextSize);
+    PBYTE Bitmaps = (PBYTE)MALLOC(((SIZE_T)4) << IP_SET_WINDOW_BITS);
+    PIN_ADDR Addresses = (PIN_ADDR)MALLOC((SIZE_T)Lookups * sizeof(IN_ADDR));
+    PIP_SET A = nullptr, B = nullptr, Result = nullptr;
+    LARGE_INTEGER Frequency, Start, End;
+    UINT64 Seed = 0x1234;
+    ULONG Errors = 0;
+    SIZE_T Size = 0;
+
+    if (nullptr == Text || nullptr == Bitmaps || nullptr == Addresses) {
+        printf("LastError:%d\n", GetLastError());
+        goto Cleanup;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+
+    {
+        ULONG Edges = VerifyEdges();
+        ULONG Window4 = VerifyWindow(AF_INET, &Seed, Bitmaps);
+        ULONG Window6 = VerifyWindow(AF_INET6, &Seed, Bitmaps);
+        printf("verify: edges %s, ipv4 %s, ipv6 %s (%lu errors)\n",
+               Edges ? "FAILED" : "ok",
+               Window4 ? "FAILED" : "ok",
+               Window6 ? "FAILED" : "ok",
+               Edges + Window4 + Window6);
+        Errors += Edges + Window4 + Window6;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //导入。
+
+    for (ULONG i = 0; i < Lines; i++) {
+        UINT64 r = SplitMix64(&Seed);
+        IN_ADDR Address;
+        char * Out = Text + Size;
+
+        Address.S_un.S_addr = (UINT32)r;
+        Out += IpText::FormatIpv4(&Address, Out);
+        if (1 == (r >> 32) % 3) {
+            Out += sprintf_s(Out, 8, "/%u", 16 + (UINT32)((r >> 40) % 17));
+        } else if (2 == (r >> 32) % 3) {
+            Address.S_un.S_addr = htonl(min(ntohl((UINT32)r) + (UINT32)((r >> 40) % 256), MAXUINT32 - 1));
+            *Out++ = '-';
+            Out += IpText::FormatIpv4(&Address, Out);
+        }
+
+        *Out++ = '\n';
+        Size = Out - Text;
+    }
+
+    if (ERROR_SUCCESS != IpSetCreate(&A) || ERROR_SUCCESS != IpSetCreate(&B)) {
+        goto Cleanup;
+    }
+
+    {
+        IP_SET_LOAD_STATISTICS Statistics;
+        IP_SET_INFORMATION Information;
+
+        QueryPerformanceCounter(&Start);
+        ULONG ret = IpSetLoadText(A, Text, Size, &Statistics);
+        IpSetQuery(A, &Information);
+        QueryPerformanceCounter(&End);
+
+        double Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+        printf("load: %llu lines (%.1f MB) in %.1f ms, %.1f M lines/s, ret %lu\n",
+               Statistics.Lines,
+               Size / 1048576.0,
+               Seconds * 1e3,
+               Statistics.Lines / Seconds / 1e6,
+               ret);
+        printf("load: %lu ranges, %llu addresses, %.1f MB (%.1f bytes per line, text %.1f bytes per line)\n",
+               Information.Ranges[0],
+               Information.Addresses4,
+               Information.Bytes / 1048576.0,
+               (double)Information.Bytes / Lines,
+               (double)Size / Lines);
+
+        //B：A里的每隔一个区间，再加上随机的/24。
+        for (ULONG i = 0; i < Information.Ranges[0]; i += 2) {
+            IN_ADDR First, Last;
+            KeyToAddress(A->List4.Ranges[i].First, &First);
+            KeyToAddress(A->List4.Ranges[i].Last, &Last);
+            IpSetAddRange(B, AF_INET, &First, &Last);
+        }
+
+        for (ULONG i = 0; i < Lines / 4; i++) {
+            IN_ADDR Address;
+            Address.S_un.S_addr = (UINT32)SplitMix64(&Seed);
+            IpSetAddPrefix(B, AF_INET, &Address, 24);
+        }
+
+        QueryPerformanceCounter(&Start);
+        IpSetQuery(B, &Information);
+        QueryPerformanceCounter(&End);
+        printf("normalize: %lu ranges in %.1f ms\n",
+               Information.Ranges[0],
+               (double)(End.QuadPart - Start.QuadPart) * 1e3 / Frequency.QuadPart);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //运算。
+
+    for (int Operation = 0; Operation < 3; Operation++) {
+        const char * Names[] = {"union", "intersect", "difference"};
+        IP_SET_INFORMATION Information;
+
+        QueryPerformanceCounter(&Start);
+        ULONG ret;
+        if (0 == Operation) {
+            ret = IpSetUnion(A, B, &Result);
+        } else if (1 == Operation) {
+            ret = IpSetIntersect(A, B, &Result);
+        } else {
+            ret = IpSetDifference(A, B, &Result);
+        }
+        QueryPerformanceCounter(&End);
+        if (ERROR_SUCCESS != ret) {
+            printf("%s failed: %lu\n", Names[Operation], ret);
+            Errors++;
+            continue;
+        }
+
+        IpSetQuery(Result, &Information);
+        printf("%-10s: %lu ranges in %.1f ms\n",
+               Names[Operation],
+               Information.Ranges[0],
+               (double)(End.QuadPart - Start.QuadPart) * 1e3 / Frequency.QuadPart);
+        IpSetDestroy(Result);
+        Result = nullptr;
+    }
+
+    {
+        ULONG Count = 0;
+        UINT64 Hits = 0;
+
+        QueryPerformanceCounter(&Start);
+        IpSetGetPrefixes(A, AF_INET, nullptr, 0, &Count);
+        QueryPerformanceCounter(&End);
+        printf("cidr: %lu prefixes in %.1f ms\n",
+               Count,
+               (double)(End.QuadPart - Start.QuadPart) * 1e3 / Frequency.QuadPart);
+
+        for (ULONG i = 0; i < Lookups; i++) {
+            Addresses[i].S_un.S_addr = (UINT32)SplitMix64(&Seed);
+        }
+
+        QueryPerformanceCounter(&Start);
+        for (ULONG i = 0; i < Lookups; i++) {
+            Hits += IpSetContains(A, AF_INET, &Addresses[i]);
+        }
+        QueryPerformanceCounter(&End);
+
+        double Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+        printf("contains: %.1f M/s, %.1f%% hits\n", Lookups / Seconds / 1e6, Hits * 100.0 / Lookups);
+    }
+
+    printf("ipset: %s (%lu errors)\n", Errors ? "FAILED" : "ok", Errors);
+
+Cleanup:
+    IpSetDestroy(A);
+    IpSetDestroy(B);
+    IpSetDestroy(Result);
+
+    if (Addresses) {
+        FREE(Addresses);
+    }
+
+    if (Bitmaps) {
+        FREE(Bitmaps);
+    }
+
+    if (Text) {
+        FREE(Text);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+int _cdecl main()
+{
+    IpSetBenchmark();
+
+    return 0;
+}
@@ -0,0 +1,469 @@
+﻿/*
+最长前缀匹配（Lpm.cpp）的验证和基准测试：和朴素的实现（排序后逐个比较）对比，以及单个和批量查找的速度。
+
+Windows上单独编译运行（不在test.vcxproj的生成里），VS的开发人员命令提示符下：
+cl /std:c++17 /O2 /EHsc /DUNICODE /D_UNICODE /wd4819 LpmBenchmark.cpp
+
+直接包含Lpm.cpp，朴素的实现要用它里面的LpmKey4/LpmKey6（static的）。
+*/
+
+
+#include "..\libnet\Lpm.cpp"
+#include "..\libnet\SplitMix64.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+typedef struct _LPM_REFERENCE {
+    UINT64 High;
+    UINT64 Low;
+    UINT32 Index; //前缀在列表里的下标，同样的前缀取最大的（后面的覆盖前面的）。
+    UINT8 PrefixLength;
+} LPM_REFERENCE, * PLPM_REFERENCE;
+
+
+static int __cdecl CompareReference(const void * a, const void * b)
+{
+    const LPM_REFERENCE * x = (const LPM_REFERENCE *)a;
+    const LPM_REFERENCE * y = (const LPM_REFERENCE *)b;
+
+    if (x->PrefixLength != y->PrefixLength) {
+        return x->PrefixLength < y->PrefixLength ? -1 : 1;
+    }
+
+    if (x->High != y->High) {
+        return x->High < y->High ? -1 : 1;
+    }
+
+    if (x->Low != y->Low) {
+        return x->Low < y->Low ? -1 : 1;
+    }
+
+    return (x->Index > y->Index) - (x->Index < y->Index);
+}
+
+
+static FORCEINLINE void LpmMask(_Inout_ PUINT64 High, _Inout_ PUINT64 Low, _In_ UINT8 PrefixLength)
+{
+    if (PrefixLength <= 64) {
+        *High = PrefixLength ? (*High & (MAXUINT64 << (64 - PrefixLength))) : 0;
+        *Low = 0;
+    } else {
+        *Low &= MAXUINT64 << (128 - PrefixLength);
+    }
+}
+
+
+static UINT32 ReferenceLookup(_In_reads_(Count) const LPM_REFERENCE * Sorted,
+                              _In_ ULONG Count,
+                              _In_ const ULONG * LengthStart, // 130项，长度为L的前缀在[LengthStart[L], LengthStart[L + 1])。
+                              _In_ UINT8 MaxLength,
+                              _In_ UINT64 High,
+                              _In_ UINT64 Low)
+/*
+功能：最朴素的最长前缀匹配：从最长的长度开始，在每个长度里二分查找。用于验证。
+*/
+{
+    UNREFERENCED_PARAMETER(Count);
+
+    for (int Length = MaxLength; Length >= 0; Length--) {
+        UINT64 h = High, l = Low;
+        LpmMask(&h, &l, (UINT8)Length);
+
+        //找最后一个(h, l)相同的，即最后加入的。
+        ULONG First = LengthStart[Length], Last = LengthStart[Length + 1];
+        while (First < Last) {
+            ULONG Middle = First + (Last - First) / 2;
+            const LPM_REFERENCE * r = &Sorted[Middle];
+            if (r->High < h || (r->High == h && r->Low <= l)) {
+                First = Middle + 1;
+            } else {
+                Last = Middle;
+            }
+        }
+
+        if (First > LengthStart[Length] && Sorted[First - 1].High == h && Sorted[First - 1].Low == l) {
+            return Sorted[First - 1].Index;
+        }
+    }
+
+    return LPM_NO_MATCH;
+}
+
+
+static ULONG LpmVerify(_In_ const LPM_TABLE * Table,
+                       _In_reads_(Count) const LPM_PREFIX * Prefixes,
+                       _In_ ULONG Count,
+                       _In_ ADDRESS_FAMILY Family,
+                       _In_ ULONG Samples,
+                       _Inout_ PUINT64 Seed)
+/*
+功能：用随机的地址（一半落在随机的前缀里）比较LpmLookup*，LpmLookup*Batch和朴素的实现。
+
+返回值：错误的个数。
+*/
+{
+    const UINT8 MaxLength = (AF_INET == Family) ? 32 : 128;
+    const ULONG BatchSize = 256;
+    PLPM_REFERENCE Sorted = (PLPM_REFERENCE)MALLOC(max(Count, 1) * sizeof(LPM_REFERENCE));
+    PBYTE Addresses = (PBYTE)MALLOC(BatchSize * sizeof(IN6_ADDR));
+    PUINT32 Values = (PUINT32)MALLOC(BatchSize * sizeof(UINT32));
+    ULONG LengthStart[130] = {0};
+    ULONG Errors = 0;
+    ULONG n = 0;
+
+    if (nullptr == Sorted || nullptr == Addresses || nullptr == Values) {
+        Errors++;
+        goto Cleanup;
+    }
+
+    for (ULONG i = 0; i < Count; i++) {
+        if (Prefixes[i].Family != Family) {
+            continue;
+        }
+
+        PLPM_REFERENCE r = &Sorted[n++];
+        if (AF_INET == Family) {
+            LpmKey4((const IN_ADDR *)Prefixes[i].Address, &r->High, &r->Low);
+        } else {
+            LpmKey6(Prefixes[i].Address, &r->High, &r->Low);
+        }
+
+        r->PrefixLength = Prefixes[i].PrefixLength;
+        r->Index = Prefixes[i].Value;
+        LpmMask(&r->High, &r->Low, r->PrefixLength);
+    }
+
+    qsort(Sorted, n, sizeof(LPM_REFERENCE), CompareReference);
+
+    for (ULONG i = 0, Length = 0; Length <= 129; Length++) {
+        while (i < n && Sorted[i].PrefixLength < Length) {
+            i++;
+        }
+
+        LengthStart[Length] = i;
+    }
+
+    for (ULONG Done = 0; Done < Samples; Done += BatchSize) {
+        for (ULONG i = 0; i < BatchSize; i++) {
+            UINT64 High = SplitMix64(Seed), Low = SplitMix64(Seed);
+
+            if ((i & 1) && n) {
+                const LPM_REFERENCE * r = &Sorted[SplitMix64(Seed) % n];
+                UINT64 h = MAXUINT64, l = MAXUINT64;
+                LpmMask(&h, &l, r->PrefixLength);
+                High = r->High | (High & ~h);
+                Low = r->Low | (Low & ~l);
+            }
+
+            if (AF_INET == Family) {
+                High &= 0xffffffff00000000;
+                Low = 0;
+                ((PIN_ADDR)Addresses)[i].S_un.S_addr = htonl((UINT32)(High >> 32));
+            } else {
+                UINT64 Word[2] = {_byteswap_uint64(High), _byteswap_uint64(Low)};
+                RtlCopyMemory(Addresses + i * sizeof(IN6_ADDR), Word, sizeof(Word));
+            }
+        }
+
+        if (AF_INET == Family) {
+            LpmLookup4Batch(Table, (const IN_ADDR *)Addresses, BatchSize, Values);
+        } else {
+            LpmLookup6Batch(Table, (const IN6_ADDR *)Addresses, BatchSize, Values);
+        }
+
+        for (ULONG i = 0; i < BatchSize; i++) {
+            UINT64 High, Low;
+            UINT32 Single;
+
+            if (AF_INET == Family) {
+                LpmKey4(&((const IN_ADDR *)Addresses)[i], &High, &Low);
+                Single = LpmLookup4(Table, &((const IN_ADDR *)Addresses)[i]);
+            } else {
+                LpmKey6(Addresses + i * sizeof(IN6_ADDR), &High, &Low);
+                Single = LpmLookup6(Table, &((const IN6_ADDR *)Addresses)[i]);
+            }
+
+            UINT32 Expected = ReferenceLookup(Sorted, n, LengthStart, MaxLength, High, Low);
+            if (Single != Expected || Values[i] != Expected) {
+                Errors++;
+            }
+        }
+    }
+
+Cleanup:
+    if (Values) {
+        FREE(Values);
+    }
+
+    if (Addresses) {
+        FREE(Addresses);
+    }
+
+    if (Sorted) {
+        FREE(Sorted);
+    }
+
+    return Errors;
+}
+
+
+static void LpmMakePrefixes(_Out_writes_(Count) PLPM_PREFIX Prefixes,
+                            _In_ ULONG Count,
+                            _In_ ADDRESS_FAMILY Family,
+                            _Inout_ PUINT64 Seed)
+/*
+功能：生成随机的前缀，长度的分布大致像公网的路由表（IPv4以/24为主，IPv6以/48和/32为主）。
+*/
+{
+    static const UINT8 Lengths4[] = {8, 12, 16, 16, 19, 20, 21, 22, 22, 23, 23, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+                                     24, 24, 24, 24, 24, 25, 27, 28, 30, 32};
+    static const UINT8 Lengths6[] = {16, 28, 29, 32, 32, 32, 36, 40, 44, 44, 46, 47, 48, 48, 48, 48, 48, 48,
+                                     48, 48, 56, 60, 64, 64, 96, 112, 127, 128};
+
+    for (ULONG i = 0; i < Count; i++) {
+        UINT64 High = SplitMix64(Seed), Low = SplitMix64(Seed);
+
+        Prefixes[i].Family = Family;
+        Prefixes[i].Value = i;
+
+        if (AF_INET == Family) {
+            Prefixes[i].PrefixLength = Lengths4[SplitMix64(Seed) % _ARRAYSIZE(Lengths4)];
+            UINT32 Address = htonl((UINT32)High);
+            RtlCopyMemory(Prefixes[i].Address, &Address, sizeof(Address));
+        } else {
+            Prefixes[i].PrefixLength = Lengths6[SplitMix64(Seed) % _ARRAYSIZE(Lengths6)];
+            High = (High & 0x1fffffffffffffff) | 0x2000000000000000; // 2000::/3，和真实的一样聚集在一起。
+            UINT64 Word[2] = {_byteswap_uint64(High), _byteswap_uint64(Low)};
+            RtlCopyMemory(Prefixes[i].Address, Word, sizeof(Word));
+        }
+    }
+}
+
+
+static void LpmBenchmark()
+/*
+功能：最长前缀匹配的验证和基准测试。
+
+1.随机生成类似公网的IPv4（50万）和IPv6（10万）的前缀，建表，和朴素的实现对比随机的地址。
+2.单个和批量查找的速度（随机地址，超出缓存）。
+3.LPM_INDEX：在线程池里用系统的路由表重建，并查找一个地址。
+*/
+{
+    const ULONG Count4 = 500000;
+    const ULONG Count6 = 100000;
+    const ULONG Lookups = 1 << 22;
+    PLPM_PREFIX Prefixes = (PLPM_PREFIX)MALLOC((SIZE_T)(Count4 + Count6) * sizeof(LPM_PREFIX));
+    PIN6_ADDR Addresses = (PIN6_ADDR)MALLOC((SIZE_T)Lookups * sizeof(IN6_ADDR));
+    PUINT32 Values = (PUINT32)MALLOC((SIZE_T)Lookups * sizeof(UINT32));
+    PLPM_TABLE Table = nullptr;
+    PLPM_INDEX Index = nullptr;
+    LARGE_INTEGER Frequency, Start, End;
+    UINT64 Seed = 0x1234;
+    ULONG Errors = 0;
+    ULONG ret = ERROR_SUCCESS;
+
+    if (nullptr == Prefixes || nullptr == Addresses || nullptr == Values) {
+        printf("LastError:%d\n", GetLastError());
+        goto Cleanup;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+
+    LpmMakePrefixes(Prefixes, Count4, AF_INET, &Seed);
+    LpmMakePrefixes(Prefixes + Count4, Count6, AF_INET6, &Seed);
+    for (ULONG i = 0; i < Count6; i++) {
+        Prefixes[Count4 + i].Value = Count4 + i;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //建表和验证。
+
+    {
+        QueryPerformanceCounter(&Start);
+        ret = LpmBuild(Prefixes, Count4 + Count6, &Table);
+        QueryPerformanceCounter(&End);
+        if (ERROR_SUCCESS != ret) {
+            printf("LpmBuild failed: %lu\n", ret);
+            goto Cleanup;
+        }
+
+        LPM_TABLE_INFORMATION Information;
+        LpmQueryTable(Table, &Information);
+        printf("build: %lu + %lu prefixes in %.1f ms, nodes %lu + %lu, leaves %lu + %lu, %.1f MB\n",
+               Information.Prefixes[0],
+               Information.Prefixes[1],
+               (double)(End.QuadPart - Start.QuadPart) * 1e3 / Frequency.QuadPart,
+               Information.Nodes[0],
+               Information.Nodes[1],
+               Information.Leaves[0],
+               Information.Leaves[1],
+               Information.Bytes / 1048576.0);
+
+        ULONG Wrong4 = LpmVerify(Table, Prefixes, Count4 + Count6, AF_INET, 1 << 18, &Seed);
+        ULONG Wrong6 = LpmVerify(Table, Prefixes, Count4 + Count6, AF_INET6, 1 << 16, &Seed);
+        printf("verify: ipv4 %s (%lu errors), ipv6 %s (%lu errors)\n",
+               Wrong4 ? "FAILED" : "ok",
+               Wrong4,
+               Wrong6 ? "FAILED" : "ok",
+               Wrong6);
+        Errors += Wrong4 + Wrong6;
+
+        //边界：空表，/0，/32，/128，重复的前缀。
+        LPM_PREFIX Edge[4]{};
+        PLPM_TABLE Small = nullptr;
+        IN_ADDR Probe4;
+        IN6_ADDR Probe6{};
+        Edge[0].Family = AF_INET; //0.0.0.0/0 -> 7
+        Edge[0].Value = 7;
+        Edge[1].Family = AF_INET; //10.0.0.1/32 -> 8，后面的覆盖。
+        Edge[1].PrefixLength = 32;
+        Edge[1].Value = 9;
+        Edge[1].Address[0] = 10;
+        Edge[1].Address[3] = 1;
+        Edge[2] = Edge[1];
+        Edge[2].Value = 8;
+        Edge[3].Family = AF_INET6; //::1/128 -> 6
+        Edge[3].PrefixLength = 128;
+        Edge[3].Value = 6;
+        Edge[3].Address[15] = 1;
+
+        ULONG Wrong = 0;
+        if (ERROR_SUCCESS != LpmBuild(Edge, _ARRAYSIZE(Edge), &Small)) {
+            Wrong++;
+        } else {
+            Probe4.S_un.S_addr = htonl(0x0a000001);
+            Wrong += (8 != LpmLookup4(Small, &Probe4));
+            Probe4.S_un.S_addr = htonl(0x0a000002);
+            Wrong += (7 != LpmLookup4(Small, &Probe4));
+            Probe6.u.Byte[15] = 1;
+            Wrong += (6 != LpmLookup6(Small, &Probe6));
+            Probe6.u.Byte[15] = 0;
+            Wrong += (LPM_NO_MATCH != LpmLookup6(Small, &Probe6));
+            LpmRelease(Small);
+        }
+
+        if (ERROR_SUCCESS != LpmBuild(nullptr, 0, &Small)) {
+            Wrong++;
+        } else {
+            Wrong += (LPM_NO_MATCH != LpmLookup4(Small, &Probe4));
+            LpmRelease(Small);
+        }
+
+        Edge[0].PrefixLength = 33;
+        if (ERROR_INVALID_PARAMETER != LpmBuild(Edge, 1, &Small)) {
+            Wrong++;
+        }
+
+        printf("edge cases: %s\n", Wrong ? "FAILED" : "ok");
+        Errors += Wrong;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //查找的速度。
+
+    for (int Family = 0; Family < 2; Family++) {
+        volatile UINT32 Sink = 0;
+        double Single, Batch;
+
+        for (ULONG i = 0; i < Lookups; i++) {
+            UINT64 Word[2] = {SplitMix64(&Seed), SplitMix64(&Seed)};
+            if (Family) {
+                Word[0] = _byteswap_uint64((_byteswap_uint64(Word[0]) & 0x1fffffffffffffff) | 0x2000000000000000);
+                RtlCopyMemory(&Addresses[i], Word, sizeof(IN6_ADDR));
+            } else {
+                ((PIN_ADDR)Addresses)[i].S_un.S_addr = (UINT32)Word[0];
+            }
+        }
+
+        QueryPerformanceCounter(&Start);
+        for (ULONG i = 0; i < Lookups; i++) {
+            if (Family) {
+                Sink = Sink + LpmLookup6(Table, &Addresses[i]);
+            } else {
+                Sink = Sink + LpmLookup4(Table, &((PIN_ADDR)Addresses)[i]);
+            }
+        }
+        QueryPerformanceCounter(&End);
+        Single = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+
+        QueryPerformanceCounter(&Start);
+        if (Family) {
+            LpmLookup6Batch(Table, Addresses, Lookups, Values);
+        } else {
+            LpmLookup4Batch(Table, (PIN_ADDR)Addresses, Lookups, Values);
+        }
+        QueryPerformanceCounter(&End);
+        Batch = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+
+        printf("ipv%d lookup: single %6.1f M/s, batch %6.1f M/s\n",
+               Family ? 6 : 4,
+               Lookups / Single / 1e6,
+               Lookups / Batch / 1e6);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //系统的路由表。
+
+    {
+        ret = LpmIndexCreate(&Index);
+        if (ERROR_SUCCESS != ret) {
+            goto Cleanup;
+        }
+
+        ret = LpmIndexRebuildFromRouteTable(Index, AF_UNSPEC, FALSE);
+        if (ERROR_SUCCESS == ret) {
+            ret = LpmIndexWait(Index);
+        }
+
+        PLPM_TABLE Current = LpmIndexAcquire(Index);
+        if (ERROR_SUCCESS != ret || nullptr == Current) {
+            printf("route table: rebuild failed: %lu\n", ret);
+        } else {
+            IN_ADDR Destination;
+            MIB_IPFORWARD_ROW2 Route;
+            CHAR NextHop[INET6_ADDRSTRLEN] = {0};
+
+            Destination.S_un.S_addr = htonl(0x08080808); // 8.8.8.8
+            if (ERROR_SUCCESS == LpmGetRoute(Current, LpmLookup4(Current, &Destination), &Route)) {
+                InetNtopA(AF_INET, &Route.NextHop.Ipv4.sin_addr, NextHop, _ARRAYSIZE(NextHop));
+            }
+
+            printf("route table: %lu routes, 8.8.8.8 via %s\n", Current->RouteCount, NextHop);
+            LpmRelease(Current);
+        }
+    }
+
+    printf("lpm: %s (%lu errors)\n", Errors ? "FAILED" : "ok", Errors);
+
+Cleanup:
+    if (Index) {
+        LpmIndexDestroy(Index);
+    }
+
+    LpmRelease(Table);
+
+    if (Values) {
+        FREE(Values);
+    }
+
+    if (Addresses) {
+        FREE(Addresses);
+    }
+
+    if (Prefixes) {
+        FREE(Prefixes);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+int _cdecl main()
+{
+    LpmBenchmark();
+
+    return 0;
+}
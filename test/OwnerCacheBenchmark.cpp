@@ -0,0 +1,389 @@
+﻿/*
+连接的所属进程的缓存（OwnerCache.cpp）的验证和基准测试。
+
+Linux上：
+g++ -std=c++17 -O2 -I../libnet OwnerCacheBenchmark.cpp ../libnet/TableBackendLinux.cpp
+
+Windows上（VS的开发人员命令提示符下）：
+cl /std:c++17 /O2 /EHsc /DUNICODE /D_UNICODE /wd4819 /I..\libnet OwnerCacheBenchmark.cpp ..\libnet\TableSnapshot.cpp
+
+都不在test.vcxproj的生成里。直接包含OwnerCache.cpp，要用它里面的QueryOwner等（static的）。
+*/
+
+
+#include "OwnerCache.cpp"
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/wait.h>
+#endif
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#define OWNER_BENCH_ROWS   4096 //模拟的表的行数。
+#define OWNER_BENCH_ROUNDS 20
+
+
+static BOOL SameString(_In_ const OWNER_CHAR * Left, _In_ const OWNER_CHAR * Right)
+{
+    while (*Left && *Left == *Right) {
+        Left++;
+        Right++;
+    }
+
+    return *Left == *Right;
+}
+
+
+static UINT64 BenchNanoseconds()
+{
+#ifdef _WIN32
+    LARGE_INTEGER Frequency, Counter;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Counter);
+    return (UINT64)((double)Counter.QuadPart * 1e9 / (double)Frequency.QuadPart);
+#else
+    struct timespec Now;
+
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (UINT64)Now.tv_sec * 1000000000 + (UINT64)Now.tv_nsec;
+#endif
+}
+
+
+static BOOL MeasureCache(_In_ PCSTR Name, _In_reads_(Count) const OWNER_CACHE_REQUEST * Requests, _In_ ULONG Count)
+/*
+功能：每一行都查系统（原来的做法）和走缓存的比较，结果要一样。
+*/
+{
+    POWNER_CACHE Uncached = nullptr;
+    POWNER_CACHE Cache = nullptr;
+    OWNER_CACHE_INFORMATION Information;
+    BOOL Ok = FALSE;
+    ULONG Mismatches = 0;
+    UINT64 Start = 0;
+    UINT64 UncachedTime = 0;
+    UINT64 CachedTime = 0;
+    auto Modules = reinterpret_cast<const OWNER_MODULE **>(MALLOC(Count * sizeof(const OWNER_MODULE *)));
+
+    if (nullptr == Modules || ERROR_SUCCESS != OwnerCacheCreate(0, &Uncached) ||
+        ERROR_SUCCESS != OwnerCacheCreate(0, &Cache)) {
+        printf("%s: create failed\n", Name);
+        goto Cleanup;
+    }
+
+    Start = BenchNanoseconds();
+    for (ULONG i = 0; i < Count; i++) { //只借用QueryOwner，不加入缓存。
+        POWNER_CACHE_ENTRY Entry = nullptr;
+
+        if (ERROR_SUCCESS == QueryOwner(Uncached, Requests[i].Pid, Requests[i].ModuleInfo, &Entry)) {
+            CloseEntry(Uncached, Entry);
+            FREE(Entry);
+        }
+    }
+    UncachedTime = BenchNanoseconds() - Start;
+
+    Start = BenchNanoseconds();
+    for (ULONG Round = 0; Round < OWNER_BENCH_ROUNDS; Round++) {
+        if (ERROR_SUCCESS != OwnerCacheResolve(Cache, Requests, Count, Modules)) {
+            printf("%s: resolve failed\n", Name);
+            goto Cleanup;
+        }
+    }
+    CachedTime = (BenchNanoseconds() - Start) / OWNER_BENCH_ROUNDS;
+
+    for (ULONG i = 0; i < Count; i++) { //和单独查的比较。
+        const OWNER_MODULE * Module = nullptr;
+        POWNER_CACHE_ENTRY Entry = nullptr;
+
+        if (ERROR_SUCCESS != QueryOwner(Uncached, Requests[i].Pid, Requests[i].ModuleInfo, &Entry)) {
+            continue;
+        }
+
+        OwnerCacheResolve(Cache, &Requests[i], 1, &Module);
+        if ((ERROR_SUCCESS == Entry->Status) != (nullptr != Module) ||
+            (Module && (!SameString(Module->Name, Entry->Module.Name) ||
+                        !SameString(Module->Path, Entry->Module.Path)))) {
+            Mismatches++; //查的过程中进程退出的也会不一样，不多的不算错。
+        }
+
+        CloseEntry(Uncached, Entry);
+        FREE(Entry);
+    }
+
+    OwnerCacheQuery(Cache, &Information);
+    printf("%s: %u rows, %u entries, uncached %.1f us/row, cached %.1f ns/row (%.0fx), "
+           "hit rate %.2f%% (%llu misses, %llu negative hits), mismatches %u\n",
+           Name,
+           Count,
+           Information.Entries,
+           Count ? (double)UncachedTime / 1e3 / Count : 0.0,
+           Count ? (double)CachedTime / Count : 0.0,
+           CachedTime ? (double)UncachedTime / (double)CachedTime : 0.0,
+           Information.Lookups ? 100.0 * (double)Information.Hits / (double)Information.Lookups : 0.0,
+           (unsigned long long)Information.Misses,
+           (unsigned long long)Information.NegativeHits,
+           Mismatches);
+
+    Ok = Mismatches <= Count / 100;
+
+Cleanup:
+    OwnerCacheDestroy(Cache);
+    OwnerCacheDestroy(Uncached);
+    if (Modules) {
+        FREE(Modules);
+    }
+
+    return Ok;
+}
+
+
+#ifdef _WIN32
+
+
+static ULONG CollectRequests(_Out_writes_(Capacity) POWNER_CACHE_REQUEST Requests,
+                             _In_ ULONG Capacity,
+                             _Inout_ PTABLE_SNAPSHOT Snapshot)
+/*
+功能：本机的TCP的OWNER_MODULE的表的行，不够Capacity的重复。
+*/
+{
+    ULONG Count = 0;
+
+    if (ERROR_SUCCESS != TableSnapshotRefresh(Snapshot)) {
+        return 0;
+    }
+
+    auto Rows = TableSnapshotRows<MIB_TCPROW_OWNER_MODULE>(Snapshot);
+    if (0 == Rows.Count) {
+        return 0;
+    }
+
+    for (; Count < Capacity; Count++) {
+        const MIB_TCPROW_OWNER_MODULE & Row = Rows[Count % Rows.Count];
+
+        Requests[Count].Pid = Row.dwOwningPid;
+        Requests[Count].ModuleInfo = Row.OwningModuleInfo;
+    }
+
+    return Count;
+}
+
+
+static BOOL VerifyExit()
+/*
+功能：进程退出后缓存的条目要作废。
+*/
+{
+    POWNER_CACHE Cache = nullptr;
+    OWNER_CACHE_INFORMATION Information;
+    const OWNER_MODULE * Module = nullptr;
+    WCHAR CommandLine[MAX_PATH + 16] = {};
+    STARTUPINFOW StartupInfo = {sizeof(STARTUPINFOW)};
+    PROCESS_INFORMATION ProcessInformation = {};
+    BOOL Ok = FALSE;
+    ULONG Status = ERROR_SUCCESS;
+
+    UINT Length = GetSystemDirectoryW(CommandLine, MAX_PATH);
+    if (0 == Length || Length >= MAX_PATH || ERROR_SUCCESS != OwnerCacheCreate(0, &Cache)) {
+        goto Cleanup;
+    }
+
+    wcscat_s(CommandLine, _countof(CommandLine), L"\\cmd.exe");
+    if (!CreateProcessW(nullptr,
+                        CommandLine,
+                        nullptr,
+                        nullptr,
+                        FALSE,
+                        CREATE_SUSPENDED | CREATE_NO_WINDOW,
+                        nullptr,
+                        nullptr,
+                        &StartupInfo,
+                        &ProcessInformation)) {
+        goto Cleanup;
+    }
+
+    OwnerCacheLookup(Cache, ProcessInformation.dwProcessId, nullptr, &Module);
+    OwnerCacheLookup(Cache, ProcessInformation.dwProcessId, nullptr, &Module);
+
+    TerminateProcess(ProcessInformation.hProcess, 0);
+    WaitForSingleObject(ProcessInformation.hProcess, INFINITE);
+
+    Status = OwnerCacheLookup(Cache, ProcessInformation.dwProcessId, nullptr, &Module);
+    OwnerCacheQuery(Cache, &Information);
+    Ok = 1 == Information.Hits && 1 == Information.Invalidations && nullptr == Module;
+    printf("exit: hits %llu, invalidations %llu, status after exit %u\n",
+           (unsigned long long)Information.Hits,
+           (unsigned long long)Information.Invalidations,
+           Status);
+
+Cleanup:
+    if (ProcessInformation.hProcess) {
+        CloseHandle(ProcessInformation.hThread);
+        CloseHandle(ProcessInformation.hProcess);
+    }
+
+    OwnerCacheDestroy(Cache);
+    return Ok;
+}
+
+
+#else
+
+
+static ULONG CollectRequests(_Out_writes_(Capacity) POWNER_CACHE_REQUEST Requests, _In_ ULONG Capacity)
+/*
+功能：模拟一个表：本进程，父进程，init和几个子进程的行按块交错，不够Capacity的重复。
+*/
+{
+    ULONG Owners[] = {(ULONG)getpid(), 1, (ULONG)getppid(), 0x7FFFFFF0}; //最后一个是不存在的（否定的）。
+    ULONG Count = 0;
+
+    for (; Count < Capacity; Count++) {
+        Requests[Count].Pid = Owners[(Count / 8) % _countof(Owners)];
+        Requests[Count].ModuleInfo = nullptr;
+    }
+
+    return Count;
+}
+
+
+static BOOL VerifySelf()
+/*
+功能：本进程的Name和Path要和/proc/self的一样。
+*/
+{
+    POWNER_CACHE Cache = nullptr;
+    const OWNER_MODULE * Module = nullptr;
+    char Name[64] = {};
+    char Path[PATH_MAX + 1] = {};
+    BOOL Ok = FALSE;
+
+    if (ERROR_SUCCESS != OwnerCacheCreate(0, &Cache)) {
+        return FALSE;
+    }
+
+    ULONG Length = 0;
+    ReadProcFile((ULONG)getpid(), "comm", Name, sizeof(Name), &Length);
+    if (Length && '\n' == Name[Length - 1]) {
+        Name[Length - 1] = 0;
+    }
+
+    ssize_t Bytes = readlink("/proc/self/exe", Path, PATH_MAX);
+    Path[Bytes > 0 ? Bytes : 0] = 0;
+
+    if (ERROR_SUCCESS == OwnerCacheLookup(Cache, (ULONG)getpid(), nullptr, &Module)) {
+        Ok = 0 == strcmp(Module->Name, Name) && 0 == strcmp(Module->Path, Path) && 0 != Module->CreateTime;
+        printf("self: pid %u, name %s, path %s, starttime %llu\n",
+               Module->Pid,
+               Module->Name,
+               Module->Path,
+               (unsigned long long)Module->CreateTime);
+    }
+
+    OwnerCacheDestroy(Cache);
+    return Ok;
+}
+
+
+static BOOL VerifyExit()
+/*
+功能：进程退出后缓存的条目要作废。
+*/
+{
+    POWNER_CACHE Cache = nullptr;
+    OWNER_CACHE_INFORMATION Information;
+    const OWNER_MODULE * Module = nullptr;
+
+    if (ERROR_SUCCESS != OwnerCacheCreate(0, &Cache)) {
+        return FALSE;
+    }
+
+    pid_t Child = fork();
+    if (0 == Child) {
+        pause();
+        _exit(0);
+    }
+
+    if (Child < 0) {
+        OwnerCacheDestroy(Cache);
+        return FALSE;
+    }
+
+    OwnerCacheLookup(Cache, (ULONG)Child, nullptr, &Module);
+    OwnerCacheLookup(Cache, (ULONG)Child, nullptr, &Module);
+
+    kill(Child, SIGKILL);
+    waitpid(Child, nullptr, 0);
+
+    ULONG Status = OwnerCacheLookup(Cache, (ULONG)Child, nullptr, &Module);
+    OwnerCacheQuery(Cache, &Information);
+    printf("exit: hits %llu, invalidations %llu, status after exit %u\n",
+           (unsigned long long)Information.Hits,
+           (unsigned long long)Information.Invalidations,
+           Status);
+
+    OwnerCacheDestroy(Cache);
+    return 1 == Information.Hits && 1 == Information.Invalidations && nullptr == Module;
+}
+
+
+#endif
+
+
+static void OwnerCacheBenchmark()
+/*
+功能：正确性和性能。
+
+1.每一行都查系统（原来的GetOwnerModuleFromTcp4EntryEx等的做法）和批量走缓存的耗时，结果要一样。
+  Windows的用本机的TCP的OWNER_MODULE的表，Linux的模拟几个进程的表。
+2.进程退出后的条目要作废（Windows的是挂起的cmd.exe，Linux的是fork的子进程）。
+*/
+{
+    BOOL Ok = TRUE;
+    ULONG Count = 0;
+    auto Requests = reinterpret_cast<POWNER_CACHE_REQUEST>(MALLOC(OWNER_BENCH_ROWS * sizeof(OWNER_CACHE_REQUEST)));
+    if (nullptr == Requests) {
+        printf("FAILED\n");
+        return;
+    }
+
+#ifdef _WIN32
+    TABLE_SNAPSHOT Snapshot =
+        TABLE_SNAPSHOT_INITIALIZER(TABLE_SNAPSHOT_TCP_EXTENDED, AF_INET, TCP_TABLE_OWNER_MODULE_ALL, FALSE);
+
+    Count = CollectRequests(Requests, OWNER_BENCH_ROWS, &Snapshot);
+#else
+    Ok = VerifySelf() && Ok;
+    Count = CollectRequests(Requests, OWNER_BENCH_ROWS);
+#endif
+
+    if (Count) {
+        Ok = MeasureCache("owners", Requests, Count) && Ok;
+    } else {
+        printf("no rows\n");
+        Ok = FALSE;
+    }
+
+    Ok = VerifyExit() && Ok;
+
+#ifdef _WIN32
+    TableSnapshotFree(&Snapshot);
+#endif
+    FREE(Requests);
+    printf("%s\n", Ok ? "ok" : "FAILED");
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+int main()
+{
+    OwnerCacheBenchmark();
+
+    return 0;
+}
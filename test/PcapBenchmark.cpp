@@ -0,0 +1,427 @@
+﻿/*
+pcap/pcapng的读写（Pcap.cpp）的验证和基准测试，Windows上的（CreateFileW，MapViewOfFile）。
+
+Windows上单独编译运行（不在test.vcxproj的生成里），VS的开发人员命令提示符下：
+cl /std:c++17 /O2 /EHsc /DUNICODE /D_UNICODE /wd4819 PcapBenchmark.cpp ..\libnet\Pcap.cpp
+
+Linux上的（mmap）见PcapTest.cpp。
+*/
+
+
+#include "..\libnet\pch.h"
+#include "..\libnet\Pcap.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//手工构造PcapOpenWriter不会写的文件（微秒的pcap，多个接口的pcapng，SPB，字节序相反的）。
+
+
+typedef struct _PCAP_IMAGE {
+    BYTE Data[4096];
+    ULONG Size;
+    bool Swapped; //按大端写。
+} PCAP_IMAGE, * PPCAP_IMAGE;
+
+
+static void PcapImagePut(_Inout_ PPCAP_IMAGE Image, _In_reads_bytes_(Size) const void * Data, _In_ ULONG Size)
+{
+    if (Size <= sizeof(Image->Data) - Image->Size) {
+        RtlCopyMemory(Image->Data + Image->Size, Data, Size);
+        Image->Size += Size;
+    }
+}
+
+
+static void PcapImagePut16(_Inout_ PPCAP_IMAGE Image, _In_ UINT16 Value)
+{
+    Value = Image->Swapped ? _byteswap_ushort(Value) : Value;
+    PcapImagePut(Image, &Value, sizeof(Value));
+}
+
+
+static void PcapImagePut32(_Inout_ PPCAP_IMAGE Image, _In_ UINT32 Value)
+{
+    Value = Image->Swapped ? _byteswap_ulong(Value) : Value;
+    PcapImagePut(Image, &Value, sizeof(Value));
+}
+
+
+static void PcapImagePad(_Inout_ PPCAP_IMAGE Image)
+{
+    const BYTE Padding[4]{};
+    PcapImagePut(Image, Padding, (4 - (Image->Size & 3)) & 3);
+}
+
+
+static ULONG PcapImageBeginBlock(_Inout_ PPCAP_IMAGE Image, _In_ UINT32 BlockType)
+{
+    ULONG Start = Image->Size;
+
+    PcapImagePut32(Image, BlockType);
+    PcapImagePut32(Image, 0); //长度在PcapImageEndBlock里补上。
+
+    return Start;
+}
+
+
+static void PcapImageEndBlock(_Inout_ PPCAP_IMAGE Image, _In_ ULONG Start)
+{
+    PcapImagePad(Image);
+
+    UINT32 BlockLength = Image->Size + sizeof(UINT32) - Start;
+    PcapImagePut32(Image, BlockLength);
+
+    BlockLength = Image->Swapped ? _byteswap_ulong(BlockLength) : BlockLength;
+    RtlCopyMemory(Image->Data + Start + 4, &BlockLength, sizeof(BlockLength));
+}
+
+
+static void PcapImageSection(_Inout_ PPCAP_IMAGE Image, _In_ bool Swapped)
+{
+    Image->Swapped = Swapped;
+
+    ULONG Start = PcapImageBeginBlock(Image, PCAPNG_BLOCK_SECTION_HEADER);
+    PcapImagePut32(Image, PCAPNG_BYTE_ORDER_MAGIC);
+    PcapImagePut16(Image, 1);
+    PcapImagePut16(Image, 0);
+    PcapImagePut32(Image, MAXUINT32); // SectionLength是-1（未知）。
+    PcapImagePut32(Image, MAXUINT32);
+    PcapImageEndBlock(Image, Start);
+}
+
+
+static void PcapImageInterface(_Inout_ PPCAP_IMAGE Image, _In_ UINT16 LinkType, _In_ int TsResol) //-1是没有这个选项。
+{
+    ULONG Start = PcapImageBeginBlock(Image, PCAPNG_BLOCK_INTERFACE);
+    PcapImagePut16(Image, LinkType);
+    PcapImagePut16(Image, 0);
+    PcapImagePut32(Image, MAXUINT16);
+
+    if (TsResol >= 0) {
+        BYTE Value = (BYTE)TsResol;
+        PcapImagePut16(Image, PCAPNG_OPTION_IF_TSRESOL);
+        PcapImagePut16(Image, 1);
+        PcapImagePut(Image, &Value, 1);
+        PcapImagePad(Image);
+    }
+
+    PcapImagePut16(Image, PCAPNG_OPTION_END);
+    PcapImagePut16(Image, 0);
+    PcapImageEndBlock(Image, Start);
+}
+
+
+static void PcapImageEnhancedPacket(_Inout_ PPCAP_IMAGE Image,
+                                    _In_ UINT32 InterfaceId,
+                                    _In_ UINT64 Timestamp, //接口的if_tsresol的单位。
+                                    _In_reads_bytes_(Length) const BYTE * Frame,
+                                    _In_ UINT32 Length)
+{
+    ULONG Start = PcapImageBeginBlock(Image, PCAPNG_BLOCK_ENHANCED_PACKET);
+    PcapImagePut32(Image, InterfaceId);
+    PcapImagePut32(Image, (UINT32)(Timestamp >> 32));
+    PcapImagePut32(Image, (UINT32)Timestamp);
+    PcapImagePut32(Image, Length);
+    PcapImagePut32(Image, Length);
+    PcapImagePut(Image, Frame, Length);
+    PcapImageEndBlock(Image, Start);
+}
+
+
+static void PcapImageSimplePacket(_Inout_ PPCAP_IMAGE Image,
+                                  _In_reads_bytes_(Length) const BYTE * Frame,
+                                  _In_ UINT32 Length)
+{
+    ULONG Start = PcapImageBeginBlock(Image, PCAPNG_BLOCK_SIMPLE_PACKET);
+    PcapImagePut32(Image, Length);
+    PcapImagePut(Image, Frame, Length);
+    PcapImageEndBlock(Image, Start);
+}
+
+
+static ULONG PcapImageSave(_In_ PPCAP_IMAGE Image, _In_z_ LPCWSTR FileName)
+{
+    HANDLE File = CreateFileW(FileName, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (INVALID_HANDLE_VALUE == File) {
+        return GetLastError();
+    }
+
+    DWORD Written = 0;
+    ULONG ret = ERROR_SUCCESS;
+    if (!WriteFile(File, Image->Data, Image->Size, &Written, nullptr)) {
+        ret = GetLastError();
+    } else if (Written != Image->Size) {
+        ret = ERROR_WRITE_FAULT;
+    }
+
+    CloseHandle(File);
+    return ret;
+}
+
+
+static bool PcapSamePacket(_In_ const PCAP_PACKET * Packet, _In_ const PCAP_PACKET * Expected)
+{
+    return Packet->Length == Expected->Length && Packet->OriginalLength == Expected->OriginalLength &&
+           Packet->Timestamp == Expected->Timestamp && Packet->LinkType == Expected->LinkType &&
+           RtlCompareMemory(Packet->Data, Expected->Data, Expected->Length) == Expected->Length;
+}
+
+
+static bool PcapVerifyFile(_In_z_ LPCWSTR FileName,
+                           _In_reads_(Count) const PCAP_PACKET * Expected,
+                           _In_ ULONG Count)
+/*
+功能：逐个比较读出来的包（数据，长度，时间戳，链路类型），包的个数也要一样。
+*/
+{
+    PPCAP_READER Reader = nullptr;
+    PCAP_PACKET Packet;
+    ULONG i = 0;
+
+    ULONG ret = PcapOpenReader(FileName, &Reader);
+    if (ERROR_SUCCESS != ret) {
+        printf("PcapOpenReader:%d\n", ret);
+        return false;
+    }
+
+    while (ERROR_SUCCESS == (ret = PcapNextPacket(Reader, &Packet))) {
+        if (i == Count || !PcapSamePacket(&Packet, &Expected[i])) {
+            printf("packet %d: length %d, timestamp %llu\n", i, Packet.Length, Packet.Timestamp);
+            ret = ERROR_INVALID_DATA;
+            break;
+        }
+
+        i++;
+    }
+
+    PcapCloseReader(Reader);
+
+    if (ERROR_NO_MORE_ITEMS != ret || i != Count) {
+        printf("%d of %d packets, ret:%d\n", i, Count, ret);
+        return false;
+    }
+
+    return true;
+}
+
+
+static bool PcapVerifyHandmade(_In_z_ LPCWSTR FileName, _In_reads_bytes_(128) const BYTE * Frames)
+/*
+功能：手工构造的文件：微秒的pcap（两种字节序），多个接口（各种if_tsresol）的pcapng，SPB，字节序相反的节。
+*/
+{
+    const UINT64 Seconds = 1700000000;
+    PCAP_PACKET Expected[16]{};
+    UINT32 Count;
+    bool Ok = true;
+    PCAP_IMAGE Image;
+
+    // pcap，微秒。
+    for (int Swapped = 0; Swapped < 2; Swapped++) {
+        RtlZeroMemory(&Image, sizeof(Image));
+        Image.Swapped = Swapped != 0;
+        PcapImagePut32(&Image, PCAP_MAGIC_MICROSECONDS);
+        PcapImagePut16(&Image, 2);
+        PcapImagePut16(&Image, 4);
+        PcapImagePut32(&Image, 0);
+        PcapImagePut32(&Image, 0);
+        PcapImagePut32(&Image, MAXUINT16);
+        PcapImagePut32(&Image, PCAP_LINKTYPE_ETHERNET);
+
+        for (Count = 0; Count < 3; Count++) {
+            UINT32 Microseconds = 999998 + Count; //第3个是进位的（不合法，但是要按原样换算）。
+            UINT32 Length = 60 + Count * 17;
+
+            PcapImagePut32(&Image, (UINT32)Seconds);
+            PcapImagePut32(&Image, Microseconds);
+            PcapImagePut32(&Image, Length);
+            PcapImagePut32(&Image, Length + Count); //截断的。
+            PcapImagePut(&Image, Frames + Count, Length);
+
+            Expected[Count] = {Frames + Count,
+                               Length,
+                               Length + Count,
+                               Seconds * 1000000000 + Microseconds * 1000ULL,
+                               PCAP_LINKTYPE_ETHERNET};
+        }
+
+        if (ERROR_SUCCESS != PcapImageSave(&Image, FileName) || !PcapVerifyFile(FileName, Expected, Count)) {
+            printf("pcap-us%s: MISMATCH\n", Swapped ? "-swapped" : "");
+            Ok = false;
+        }
+    }
+
+    // pcapng：6个接口，第一个没有if_tsresol（微秒），之后是纳秒，2^-20，2^-40，2^-63，毫秒。
+    const struct {
+        UINT16 LinkType;
+        int TsResol;
+        UINT64 Timestamp;
+        UINT64 Nanoseconds;
+    } Interfaces[] = {
+        {PCAP_LINKTYPE_ETHERNET, -1, Seconds * 1000000 + 123456, Seconds * 1000000000 + 123456000},
+        {101, 9, Seconds * 1000000000 + 123456789, Seconds * 1000000000 + 123456789},
+        {PCAP_LINKTYPE_ETHERNET, 0x80 | 20, (Seconds << 20) | (1 << 19), Seconds * 1000000000 + 500000000},
+        {PCAP_LINKTYPE_ETHERNET, 0x80 | 40, (1000ULL << 40) | ((1ULL << 40) - 1), 1000999999999ULL},
+        {PCAP_LINKTYPE_ETHERNET, 0x80 | 63, MAXUINT64, 1999999999ULL},
+        {PCAP_LINKTYPE_ETHERNET, 3, Seconds * 1000 + 123, Seconds * 1000000000 + 123000000},
+    };
+
+    RtlZeroMemory(&Image, sizeof(Image));
+    PcapImageSection(&Image, false);
+    Count = 0;
+
+    for (UINT32 i = 0; i < _ARRAYSIZE(Interfaces); i++) {
+        PcapImageInterface(&Image, Interfaces[i].LinkType, Interfaces[i].TsResol);
+    }
+
+    for (UINT32 i = 0; i < _ARRAYSIZE(Interfaces); i++) { //反过来，和接口的顺序无关。
+        UINT32 Id = _ARRAYSIZE(Interfaces) - 1 - i;
+        UINT32 Length = 61 + i;
+
+        PcapImageEnhancedPacket(&Image, Id, Interfaces[Id].Timestamp, Frames + i, Length);
+        Expected[Count++] = {Frames + i, Length, Length, Interfaces[Id].Nanoseconds, Interfaces[Id].LinkType};
+    }
+
+    ULONG Statistics = PcapImageBeginBlock(&Image, 5); //不认识的块（Interface Statistics），跳过。
+    PcapImagePut32(&Image, 0);
+    PcapImagePut32(&Image, 0);
+    PcapImagePut32(&Image, 0);
+    PcapImageEndBlock(&Image, Statistics);
+
+    PcapImageSimplePacket(&Image, Frames + 7, 63); // SPB没有时间戳，链路类型是第一个接口的。
+    Expected[Count++] = {Frames + 7, 63, 63, 0, PCAP_LINKTYPE_ETHERNET};
+
+    PcapImageSection(&Image, true); //新的节（大端），接口要重新编号。
+    PcapImageInterface(&Image, 101, 9);
+    PcapImageEnhancedPacket(&Image, 0, 42, Frames + 9, 65);
+    Expected[Count++] = {Frames + 9, 65, 65, 42, 101};
+    PcapImageSimplePacket(&Image, Frames + 11, 66);
+    Expected[Count++] = {Frames + 11, 66, 66, 0, 101};
+
+    if (ERROR_SUCCESS != PcapImageSave(&Image, FileName) || !PcapVerifyFile(FileName, Expected, Count)) {
+        printf("pcapng-interfaces: MISMATCH\n");
+        Ok = false;
+    }
+
+    return Ok;
+}
+
+
+static void PcapBenchmark()
+/*
+功能：pcap/pcapng的读写的验证和基准测试。
+
+1.PcapWritePacket写（pcap和pcapng，纳秒），读回来逐个比较数据，长度和时间戳，包括超过SnapLen的帧。
+2.手工构造的文件（微秒的pcap，多个接口的pcapng，SPB，字节序相反的）读回来比较，见PcapVerifyHandmade。
+3.写和读的吞吐量。
+*/
+{
+    const ULONG Count = 100000;
+    const ULONG Size = PCAP_MAX_SNAPLEN + 1024;
+    const UINT64 Base = 1700000000ULL * 1000000000 + 999000000; //每个包加1.000123毫秒，会跨过秒的边界。
+    WCHAR Directory[MAX_PATH];
+    WCHAR FileName[MAX_PATH];
+    PBYTE Frames = nullptr;
+    PPCAP_PACKET Expected = nullptr;
+    LARGE_INTEGER Frequency;
+
+    QueryPerformanceFrequency(&Frequency);
+
+    Frames = (PBYTE)MALLOC(Size);
+    Expected = (PPCAP_PACKET)MALLOC(Count * sizeof(PCAP_PACKET));
+    if (nullptr == Frames || nullptr == Expected) {
+        printf("LastError:%d\n", GetLastError());
+        goto Cleanup;
+    }
+
+    if (0 == GetTempPathW(_ARRAYSIZE(Directory), Directory) ||
+        0 == GetTempFileNameW(Directory, L"pcp", 0, FileName)) {
+        printf("LastError:%d\n", GetLastError());
+        goto Cleanup;
+    }
+
+    for (ULONG i = 0; i < Size; i++) {
+        Frames[i] = (BYTE)(i * 7 + 3);
+    }
+
+    for (ULONG i = 0; i < Count; i++) {
+        UINT32 Length = 60 + (i * 37) % 200;
+        UINT32 OriginalLength = (i % 3) ? Length : Length + 1000; // 0表示和Length一样。
+
+        if (Count - 1 == i) {
+            Length = OriginalLength = Size - 1; //超过SnapLen的要截掉。
+        }
+
+        Expected[i].Data = (Count - 1 == i) ? Frames : Frames + i % 251;
+        Expected[i].Length = Length;
+        Expected[i].OriginalLength = OriginalLength;
+        Expected[i].Timestamp = Base + i * 1000123ULL;
+        Expected[i].LinkType = PCAP_LINKTYPE_ETHERNET;
+    }
+
+    for (ULONG Format = PCAP_FORMAT_PCAP; Format <= PCAP_FORMAT_PCAPNG; Format++) {
+        const char * Name = PCAP_FORMAT_PCAP == Format ? "pcap" : "pcapng";
+        PPCAP_WRITER Writer = nullptr;
+        LARGE_INTEGER Start, Middle, End;
+        UINT64 Bytes = 0;
+
+        QueryPerformanceCounter(&Start);
+
+        ULONG ret = PcapOpenWriter(FileName, Format, PCAP_LINKTYPE_ETHERNET, &Writer);
+        for (ULONG i = 0; ERROR_SUCCESS == ret && i < Count; i++) {
+            const PCAP_PACKET & Packet = Expected[i];
+            ULONG OriginalLength = Packet.OriginalLength == Packet.Length ? 0 : Packet.OriginalLength;
+
+            ret = PcapWritePacket(Writer, Packet.Timestamp, Packet.Data, Packet.Length, OriginalLength);
+            Bytes += Packet.Length;
+        }
+
+        if (Writer) {
+            ULONG Close = PcapCloseWriter(Writer);
+            ret = ERROR_SUCCESS == ret ? Close : ret;
+        }
+
+        QueryPerformanceCounter(&Middle);
+
+        Expected[Count - 1].Length = PCAP_MAX_SNAPLEN;
+        bool Ok = ERROR_SUCCESS == ret && PcapVerifyFile(FileName, Expected, Count);
+        Expected[Count - 1].Length = Expected[Count - 1].OriginalLength;
+
+        QueryPerformanceCounter(&End);
+
+        double Write = (double)(Middle.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+        double Read = (double)(End.QuadPart - Middle.QuadPart) / Frequency.QuadPart;
+
+        printf("%s: %s\n", Name, Ok ? "ok" : "MISMATCH");
+        printf("%s: write %8.2f Mpps %8.1f MB/s, read+compare %8.2f Mpps %8.1f MB/s\n",
+               Name,
+               Count / Write / 1e6,
+               Bytes / Write / 1e6,
+               Count / Read / 1e6,
+               Bytes / Read / 1e6);
+    }
+
+    printf("handmade: %s\n", PcapVerifyHandmade(FileName, Frames) ? "ok" : "MISMATCH");
+
+    DeleteFileW(FileName);
+
+Cleanup:
+    if (Expected) {
+        FREE(Expected);
+    }
+
+    if (Frames) {
+        FREE(Frames);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+int _cdecl main()
+{
+    PcapBenchmark();
+
+    return 0;
+}
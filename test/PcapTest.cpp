@@ -0,0 +1,288 @@
+﻿/*
+pcap/pcapng的读写（Pcap.cpp）的单元测试，主要是读的时候跨窗口的重新映射。
+
+不依赖Windows，Linux上单独编译运行（不在test.vcxproj的生成里）：
+g++ -std=c++17 -O2 -Wall -Wextra -fsanitize=address,undefined -DPCAP_READER_WINDOW_SIZE=65536 -I../libnet
+    PcapTest.cpp ../libnet/Pcap.cpp
+
+窗口改成了64KB（默认是64MB），几MB的文件就要重新映射很多次：记录跨过窗口的边界，比窗口还大的记录，
+以及被截断的文件。Windows上的（MapViewOfFile的）验证见PcapBenchmark.cpp。
+*/
+
+
+#include "Pcap.h"
+
+#include <unistd.h>
+
+#include <vector>
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static int Failures;
+
+
+#define CHECK(Condition)                                                                                   \
+    do {                                                                                                   \
+        if (!(Condition)) {                                                                                \
+            printf("%s:%d: %s\n", __FUNCTION__, __LINE__, #Condition);                                    \
+            Failures++;                                                                                    \
+        }                                                                                                  \
+    } while (0)
+
+
+typedef struct _EXPECTED_PACKET {
+    SIZE_T Offset; //在Frames里的偏移。
+    UINT32 Length;
+    UINT32 OriginalLength;
+    UINT64 Timestamp;
+} EXPECTED_PACKET;
+
+
+static std::vector<BYTE> Frames;
+
+
+static void MakeFrames()
+{
+    Frames.resize(300000); //比PCAP_MAX_SNAPLEN（262144）大。
+
+    for (SIZE_T i = 0; i < Frames.size(); i++) {
+        Frames[i] = (BYTE)(i * 7 + 3);
+    }
+}
+
+
+static std::vector<EXPECTED_PACKET> MakePackets(ULONG Count)
+/*
+功能：长度是60到1559的（各种对齐），中间插几个比窗口大的，最后一个超过SnapLen（读出来是被截掉的）。
+*/
+{
+    std::vector<EXPECTED_PACKET> Packets;
+    const UINT64 Base = 1700000000ULL * 1000000000 + 999000000;
+
+    for (ULONG i = 0; i < Count; i++) {
+        EXPECTED_PACKET Packet;
+        Packet.Offset = i % 251;
+        Packet.Length = 60 + (i * 37) % 1500;
+        Packet.OriginalLength = (i % 3) ? Packet.Length : Packet.Length + 1000;
+        Packet.Timestamp = Base + i * 1000123ULL;
+
+        if (0 == i % 997) {
+            Packet.Length = Packet.OriginalLength = 100000 + i; //比窗口（64KB）大。
+        }
+
+        Packets.push_back(Packet);
+    }
+
+    Packets.back().Offset = 0;
+    Packets.back().Length = Packets.back().OriginalLength = (UINT32)Frames.size();
+    return Packets;
+}
+
+
+static void TempName(char * FileName)
+{
+    strcpy(FileName, "/tmp/PcapTestXXXXXX");
+
+    int File = mkstemp(FileName);
+    CHECK(File >= 0);
+    if (File >= 0) {
+        close(File);
+    }
+}
+
+
+static ULONG WritePackets(const char * FileName, ULONG Format, const std::vector<EXPECTED_PACKET> & Packets)
+{
+    PPCAP_WRITER Writer = nullptr;
+
+    ULONG ret = PcapOpenWriter(FileName, Format, PCAP_LINKTYPE_ETHERNET, &Writer);
+    for (SIZE_T i = 0; ERROR_SUCCESS == ret && i < Packets.size(); i++) {
+        const EXPECTED_PACKET & Packet = Packets[i];
+        ULONG OriginalLength = Packet.OriginalLength == Packet.Length ? 0 : Packet.OriginalLength;
+
+        ret = PcapWritePacket(Writer, Packet.Timestamp, &Frames[Packet.Offset], Packet.Length, OriginalLength);
+    }
+
+    if (Writer) {
+        ULONG Close = PcapCloseWriter(Writer);
+        ret = ERROR_SUCCESS == ret ? Close : ret;
+    }
+
+    return ret;
+}
+
+
+static ULONG ReadPackets(const char * FileName, const std::vector<EXPECTED_PACKET> & Packets, SIZE_T * Read)
+/*
+功能：逐个比较读出来的包，Read是比较通过的个数。
+
+返回值：最后一次PcapNextPacket的返回值（读完了是ERROR_NO_MORE_ITEMS）。
+*/
+{
+    PPCAP_READER Reader = nullptr;
+    PCAP_PACKET Packet;
+
+    *Read = 0;
+
+    ULONG ret = PcapOpenReader(FileName, &Reader);
+    if (ERROR_SUCCESS != ret) {
+        return ret;
+    }
+
+    while (ERROR_SUCCESS == (ret = PcapNextPacket(Reader, &Packet))) {
+        if (*Read == Packets.size()) {
+            ret = ERROR_INVALID_DATA;
+            break;
+        }
+
+        const EXPECTED_PACKET & Expected = Packets[*Read];
+        UINT32 Length = Expected.Length < 262144 ? Expected.Length : 262144;
+
+        if (Packet.Length != Length || Packet.OriginalLength != Expected.OriginalLength ||
+            Packet.Timestamp != Expected.Timestamp || Packet.LinkType != PCAP_LINKTYPE_ETHERNET ||
+            memcmp(Packet.Data, &Frames[Expected.Offset], Length)) {
+            printf("packet %zu: length %u, timestamp %llu\n", *Read, Packet.Length,
+                   (unsigned long long)Packet.Timestamp);
+            ret = ERROR_INVALID_DATA;
+            break;
+        }
+
+        (*Read)++;
+    }
+
+    PcapCloseReader(Reader);
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static void TestRoundTrip()
+/*
+功能：pcap和pcapng写了再读回来，几MB的文件，要换几十个窗口。
+*/
+{
+    std::vector<EXPECTED_PACKET> Packets = MakePackets(5000);
+    char FileName[64];
+    SIZE_T Read;
+
+    TempName(FileName);
+
+    for (ULONG Format = PCAP_FORMAT_PCAP; Format <= PCAP_FORMAT_PCAPNG; Format++) {
+        CHECK(ERROR_SUCCESS == WritePackets(FileName, Format, Packets));
+        CHECK(ERROR_NO_MORE_ITEMS == ReadPackets(FileName, Packets, &Read));
+        CHECK(Packets.size() == Read);
+    }
+
+    unlink(FileName);
+}
+
+
+static void TestBatch()
+/*
+功能：PcapWriteBatch写的，每个帧的时间戳都一样。
+*/
+{
+    std::vector<EXPECTED_PACKET> Packets;
+    std::vector<PACKET_SPAN> Spans;
+    char FileName[64];
+    PPCAP_WRITER Writer = nullptr;
+    SIZE_T Read;
+
+    for (ULONG i = 0; i < 1000; i++) {
+        PACKET_SPAN Span = {i * 128, 60 + i % 69};
+        Spans.push_back(Span);
+        Packets.push_back({Span.Offset, Span.Length, Span.Length, 42});
+    }
+
+    TempName(FileName);
+
+    ULONG ret = PcapOpenWriter(FileName, PCAP_FORMAT_PCAPNG, PCAP_LINKTYPE_ETHERNET, &Writer);
+    CHECK(ERROR_SUCCESS == ret);
+    if (ERROR_SUCCESS == ret) {
+        CHECK(ERROR_SUCCESS == PcapWriteBatch(Writer, 42, Frames.data(), Spans.data(), (ULONG)Spans.size()));
+        CHECK(ERROR_SUCCESS == PcapCloseWriter(Writer));
+        CHECK(ERROR_NO_MORE_ITEMS == ReadPackets(FileName, Packets, &Read));
+        CHECK(Packets.size() == Read);
+    }
+
+    unlink(FileName);
+}
+
+
+static void TestTruncated()
+/*
+功能：截断在最后一个记录（比窗口大）的中间，前面的都要读出来，然后是ERROR_INVALID_DATA。
+*/
+{
+    std::vector<EXPECTED_PACKET> Packets = MakePackets(2000);
+    char FileName[64];
+    SIZE_T Read;
+
+    TempName(FileName);
+
+    for (ULONG Format = PCAP_FORMAT_PCAP; Format <= PCAP_FORMAT_PCAPNG; Format++) {
+        CHECK(ERROR_SUCCESS == WritePackets(FileName, Format, Packets));
+
+        FILE * File = fopen(FileName, "rb");
+        CHECK(nullptr != File);
+        if (nullptr == File) {
+            continue;
+        }
+
+        fseek(File, 0, SEEK_END);
+        long Size = ftell(File);
+        fclose(File);
+
+        CHECK(0 == truncate(FileName, Size - 1000));
+        CHECK(ERROR_INVALID_DATA == ReadPackets(FileName, Packets, &Read));
+        CHECK(Packets.size() - 1 == Read);
+    }
+
+    unlink(FileName);
+}
+
+
+static void TestOpen()
+/*
+功能：打不开的，空的，不认识的文件。
+*/
+{
+    static const BYTE Garbage[32] = {0x12, 0x34, 0x56, 0x78};
+    PPCAP_READER Reader = nullptr;
+    char FileName[64];
+
+    CHECK(ERROR_FILE_NOT_FOUND == PcapOpenReader("/tmp/PcapTest-does-not-exist", &Reader));
+    CHECK(nullptr == Reader);
+
+    TempName(FileName);
+    CHECK(ERROR_INVALID_DATA == PcapOpenReader(FileName, &Reader)); //空的。
+
+    FILE * File = fopen(FileName, "wb");
+    CHECK(nullptr != File);
+    if (File) {
+        fwrite(Garbage, 1, sizeof(Garbage), File);
+        fclose(File);
+        CHECK(ERROR_INVALID_DATA == PcapOpenReader(FileName, &Reader));
+        CHECK(nullptr == Reader);
+    }
+
+    unlink(FileName);
+}
+
+
+int main()
+{
+    MakeFrames();
+
+    TestRoundTrip();
+    TestBatch();
+    TestTruncated();
+    TestOpen();
+
+    printf("%s\n", Failures ? "FAILED" : "ok");
+    return Failures ? 1 : 0;
+}
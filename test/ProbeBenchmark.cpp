@@ -0,0 +1,182 @@
+﻿/*
+端口探测（Probe.cpp）的验证和基准测试：模拟目标的回应（SYN+ACK，RST+ACK），验证匹配的结果，以及组包和匹配的速度。
+
+Windows上单独编译运行（不在test.vcxproj的生成里），VS的开发人员命令提示符下：
+cl /std:c++17 /O2 /EHsc /DUNICODE /D_UNICODE /wd4819 ProbeBenchmark.cpp ..\libnet\Probe.cpp
+    ..\libnet\Dissector.cpp ..\libnet\raw.cpp
+*/
+
+
+#include "..\libnet\pch.h"
+#include "..\libnet\Probe.h"
+#include "..\libnet\PacketTemplate.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+//模拟目标的回应：交换地址和端口，确认号是探测的序号加一。
+using SynAck4 = PacketTemplate::EthernetFrame<PacketTemplate::Ipv4,
+                                              PacketTemplate::Tcp<TH_SYN | TH_ACK,
+                                                                  PacketTemplate::Options<PacketTemplate::Mss>>>;
+using RstAck4 = PacketTemplate::EthernetFrame<PacketTemplate::Ipv4, PacketTemplate::Tcp<TH_RST | TH_ACK>>;
+using SynAck6 = PacketTemplate::EthernetFrame<PacketTemplate::Ipv6, PacketTemplate::Tcp<TH_SYN | TH_ACK>>;
+
+
+template <typename Reply, typename Probe, typename Address>
+static void BuildReply(_In_reads_bytes_(Probe::Size) const BYTE * Syn,
+                       _Out_writes_bytes_(Reply::Size) PBYTE Buffer,
+                       _In_ SEQ_NUM Delta) //加到确认号上的值（主机序），1是正确的回应。
+{
+    const ETHERNET_HEADER * eth_hdr = reinterpret_cast<const ETHERNET_HEADER *>(Syn);
+    const Address * Addresses = reinterpret_cast<const Address *>(Syn + Probe::AddressOffset);
+    const TCP_HDR * tcp_hdr = reinterpret_cast<const TCP_HDR *>(Syn + Probe::L4Offset);
+
+    Reply::Build(Buffer,
+                 (const BYTE *)&eth_hdr->Destination,
+                 (const BYTE *)&eth_hdr->Source,
+                 &Addresses[1],
+                 &Addresses[0],
+                 tcp_hdr->th_dport,
+                 tcp_hdr->th_sport,
+                 htonl(0x12345678),
+                 htonl(ntohl(tcp_hdr->th_seq) + Delta));
+}
+
+
+static void ProbeBenchmark()
+/*
+功能：无状态探测的验证和微基准测试（微测）。
+
+1.给一批目标组装探测，模拟它们的回应（SYN+ACK，RST+ACK，确认号不对的，过期的），验证匹配的结果。
+2.再测试单核每秒能组装的探测和能匹配的回应的个数。
+*/
+{
+    PROBE_CONTEXT Context;
+    const BYTE Key[16] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                          0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+    ULONG ret = ProbeInitialize(&Context, Key, 40000, 20000);
+    if (ERROR_SUCCESS != ret) {
+        printf("ProbeInitialize: %u\n", ret);
+        return;
+    }
+
+    const ULONG Targets = 1024;
+    BYTE Mac[6] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
+    IN_ADDR Source4{};
+    Source4.S_un.S_addr = htonl(0xc0a80102);
+    IN6_ADDR Source6 = in6addr_loopback;
+    PBYTE Replies = (PBYTE)MALLOC((SIZE_T)Targets * SynAck4::Size);
+    if (nullptr == Replies) {
+        printf("MALLOC: %u\n", GetLastError());
+        return;
+    }
+
+    ULONG Matched = 0, Closed = 0, Rejected = 0, Stale = 0, Wrong = 0;
+    BYTE Syn4[PacketTemplate::Syn4::Size];
+    BYTE Syn6[PacketTemplate::Syn6::Size];
+    BYTE Reply4[SynAck4::Size];
+    BYTE Reply6[SynAck6::Size];
+    PROBE_REPLY Reply;
+
+    for (ULONG i = 0; i < Targets; i++) {
+        IN_ADDR Destination4{};
+        Destination4.S_un.S_addr = htonl(0x0a000000 + i * 7919);
+        UINT16 Port = (UINT16)(1 + i % 1024);
+
+        PacketizeProbe4(&Context, Mac, Mac, &Source4, &Destination4, htons(Port), Syn4);
+
+        BuildReply<SynAck4, PacketTemplate::Syn4, IN_ADDR>(Syn4, Replies + (SIZE_T)i * SynAck4::Size, 1);
+        ret = ProbeMatchReply(&Context, Replies + (SIZE_T)i * SynAck4::Size, SynAck4::Size, &Reply);
+        if (ERROR_SUCCESS == ret && 4 == Reply.IpVersion && Port == Reply.Port &&
+            (TH_SYN | TH_ACK) == Reply.TcpFlags &&
+            0 == memcmp(Reply.Address, &Destination4, sizeof(Destination4))) {
+            Matched++;
+        } else {
+            Wrong++;
+        }
+
+        BuildReply<RstAck4, PacketTemplate::Syn4, IN_ADDR>(Syn4, Reply4, 1);
+        ret = ProbeMatchReply(&Context, Reply4, RstAck4::Size, &Reply);
+        if (ERROR_SUCCESS == ret && (TH_RST | TH_ACK) == Reply.TcpFlags && Port == Reply.Port) {
+            Closed++;
+        } else {
+            Wrong++;
+        }
+
+        BuildReply<SynAck4, PacketTemplate::Syn4, IN_ADDR>(Syn4, Reply4, 2); //确认号不对。
+        ret = ProbeMatchReply(&Context, Reply4, SynAck4::Size, &Reply);
+        ERROR_NOT_FOUND == ret ? Rejected++ : Wrong++;
+
+        IN6_ADDR Destination6{};
+        Destination6.u.Byte[0] = 0x20;
+        Destination6.u.Byte[1] = 0x01;
+        *(UINT32 *)&Destination6.u.Byte[12] = i;
+
+        PacketizeProbe6(&Context, Mac, Mac, &Source6, &Destination6, htons(Port), Syn6);
+        BuildReply<SynAck6, PacketTemplate::Syn6, IN6_ADDR>(Syn6, Reply6, 1);
+        ret = ProbeMatchReply(&Context, Reply6, SynAck6::Size, &Reply);
+        if (ERROR_SUCCESS == ret && 6 == Reply.IpVersion && Port == Reply.Port &&
+            0 == memcmp(Reply.Address, &Destination6, sizeof(Destination6))) {
+            Matched++;
+        } else {
+            Wrong++;
+        }
+    }
+
+    //纪元前进一次，上一个纪元的回应还能匹配；再前进一次就不能了。
+    Context.Epoch++;
+    ret = ProbeMatchReply(&Context, Replies, SynAck4::Size, &Reply);
+    (ERROR_SUCCESS == ret && 0 == Reply.Epoch) ? Stale++ : Wrong++;
+    Context.Epoch++;
+    ret = ProbeMatchReply(&Context, Replies, SynAck4::Size, &Reply);
+    ERROR_NOT_FOUND == ret ? Stale++ : Wrong++;
+    Context.Epoch = 0;
+
+    printf("matched:%u, closed:%u, rejected:%u, epoch:%u, wrong:%u (%s)\n",
+           Matched, Closed, Rejected, Stale, Wrong, 0 == Wrong ? "ok" : "FAILED");
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //吞吐量。
+
+    LARGE_INTEGER Frequency, Start, End;
+    QueryPerformanceFrequency(&Frequency);
+
+    const UINT64 Loops = 10000000;
+    volatile UINT32 Sink = 0;
+
+    QueryPerformanceCounter(&Start);
+    for (UINT64 i = 0; i < Loops; i++) {
+        IN_ADDR Destination4{};
+        Destination4.S_un.S_addr = (ULONG)i;
+        PacketizeProbe4(&Context, Mac, Mac, &Source4, &Destination4, htons(80), Syn4);
+        Sink = Sink + Syn4[sizeof(Syn4) - 1];
+    }
+    QueryPerformanceCounter(&End);
+
+    double Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+    printf("%-16s%8.2f Mpps%8.2f ns/packet\n", "probe4", Loops / Seconds / 1e6, Seconds * 1e9 / Loops);
+
+    QueryPerformanceCounter(&Start);
+    for (UINT64 i = 0; i < Loops; i++) {
+        ProbeMatchReply(&Context, Replies + (i % Targets) * SynAck4::Size, SynAck4::Size, &Reply);
+        Sink = Sink + Reply.Port;
+    }
+    QueryPerformanceCounter(&End);
+
+    Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+    printf("%-16s%8.2f Mpps%8.2f ns/packet\n", "match4", Loops / Seconds / 1e6, Seconds * 1e9 / Loops);
+
+    FREE(Replies);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+int _cdecl main()
+{
+    ProbeBenchmark();
+
+    return 0;
+}
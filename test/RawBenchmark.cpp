@@ -0,0 +1,1262 @@
+﻿/*
+raw.cpp的校验和与组包的基准测试：先验证（和原来的实现逐字节比较），再计时。
+
+Windows上单独编译运行（不在test.vcxproj的生成里），VS的开发人员命令提示符下：
+cl /std:c++17 /O2 /EHsc /DUNICODE /D_UNICODE /wd4819 RawBenchmark.cpp ..\libnet\raw.cpp
+
+ChecksumBenchmark：各个校验和的实现（标量，SSE2，AVX2）。
+PseudoHeaderChecksumBenchmark：伪首部的校验和，原来的（申请内存+复制）和现在的（流式）。
+ChecksumAdjustBenchmark：增量更新（RFC 1624）和重新计算。
+PacketTemplateBenchmark：模板组包和原来的逐个字段填写。
+GatherBenchmark：分散/聚集组包和复制到一个缓冲区。
+*/
+
+
+#include "..\libnet\pch.h"
+#include "..\libnet\raw.h"
+#include "..\libnet\udp.h"
+#include "..\libnet\PacketTemplate.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static USHORT WINAPI ChecksumLegacy(USHORT * buffer, int size)
+//摘自Windows-classic-samples\Samples\Win7Samples\netds\winsock\iphdrinc\rawudp.c
+// Description:
+//    This function calculates the 16-bit one's complement sum for the supplied buffer.
+//这是原来的checksum的实现，做对比用。
+{
+    unsigned long cksum = 0;
+
+    while (size > 1) {
+        cksum += *buffer++;
+        size -= sizeof(USHORT);
+    }
+
+    // If the buffer was not a multiple of 16-bits, add the last byte
+    if (size) {
+        cksum += *(UCHAR *)buffer;
+    }
+
+    // Add the low order 16-bits to the high order 16-bits
+    cksum = (cksum >> 16) + (cksum & 0xffff);
+    cksum += (cksum >> 16);
+
+    // Take the 1's complement
+    return (USHORT)(~cksum);
+}
+
+
+static void ChecksumBenchmark()
+/*
+功能：校验和的微基准测试（微测）。
+
+1.先验证各个实现和原来的算法的结果一致（不同的长度和地址的偏移）。
+2.再测试64B，576B，1500B，9000B的吞吐量（GB/s）。
+*/
+{
+    struct {
+        const char * Name;
+        CHECKSUM_KERNEL Kernel;
+    } Kernels[] = {
+        {"scalar", ChecksumScalar},
+#if defined(_M_IX86) || defined(_M_X64)
+        {"sse2", ChecksumSse2},
+        {"avx2", IsAvx2Supported() ? ChecksumAvx2 : nullptr},
+#endif
+    };
+
+    const SIZE_T MaxSize = 9000;
+    PBYTE Buffer = reinterpret_cast<PBYTE>(MALLOC(MaxSize + 64));
+    if (nullptr == Buffer) {
+        printf("LastError:%d\n", GetLastError());
+        return;
+    }
+
+    ULONG Seed = GetTickCount();
+    for (SIZE_T i = 0; i < MaxSize + 64; i++) {
+        Seed = Seed * 1103515245 + 12345;
+        Buffer[i] = (BYTE)(Seed >> 16);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //正确性。
+
+    for (auto & Kernel : Kernels) {
+        if (nullptr == Kernel.Kernel) {
+            continue;
+        }
+
+        ULONG Errors = 0;
+        for (int Size = 0; Size <= 1600; Size++) {
+            for (int Offset = 0; Offset < 8; Offset++) {
+                USHORT Expected = ChecksumLegacy(reinterpret_cast<USHORT *>(Buffer + Offset), Size);
+                USHORT Actual = (USHORT)~ChecksumFold(Kernel.Kernel(Buffer + Offset, Size));
+                if (Expected != Actual) {
+                    Errors++;
+                }
+            }
+        }
+
+        printf("%s: %s\n", Kernel.Name, Errors ? "MISMATCH" : "ok");
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //吞吐量。
+
+    LARGE_INTEGER Frequency;
+    QueryPerformanceFrequency(&Frequency);
+
+    const SIZE_T Sizes[] = {64, 576, 1500, 9000};
+    const UINT64 TotalBytes = 1ULL << 30; //每项测试大约处理1GB的数据。
+
+    printf("%-8s", "size");
+    printf("%12s", "legacy");
+    for (auto & Kernel : Kernels) {
+        printf("%12s", Kernel.Name);
+    }
+    printf("  (GB/s)\n");
+
+    for (auto Size : Sizes) {
+        UINT64 Loops = TotalBytes / Size;
+        volatile USHORT Sink = 0;
+        LARGE_INTEGER Start, End;
+
+        printf("%-8zu", Size);
+
+        QueryPerformanceCounter(&Start);
+        for (UINT64 i = 0; i < Loops; i++) {
+            Sink = Sink + ChecksumLegacy(reinterpret_cast<USHORT *>(Buffer), (int)Size);
+        }
+        QueryPerformanceCounter(&End);
+        double Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+        printf("%12.2f", (double)(Loops * Size) / Seconds / 1e9);
+
+        for (auto & Kernel : Kernels) {
+            if (nullptr == Kernel.Kernel) {
+                printf("%12s", "-");
+                continue;
+            }
+
+            QueryPerformanceCounter(&Start);
+            for (UINT64 i = 0; i < Loops; i++) {
+                Sink = Sink + ChecksumFold(Kernel.Kernel(Buffer, Size));
+            }
+            QueryPerformanceCounter(&End);
+            Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+            printf("%12.2f", (double)(Loops * Size) / Seconds / 1e9);
+        }
+
+        printf("\n");
+    }
+
+    FREE(Buffer);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//伪首部校验和的基准测试：原来的（申请内存+复制）和现在的（流式，就地）的对比。
+
+
+static void CalculationTcp4SumLegacy(OUT PBYTE buffer, WORD OptLen)
+/*
+原来的CalculationTcp4Sum的实现，仅供对比。
+*/
+{
+    PRAW_TCP tcp4 = reinterpret_cast<PRAW_TCP>(buffer);
+
+    PBYTE temp = reinterpret_cast<PBYTE>(MALLOC(sizeof(PSD_HEADER) + sizeof(TCP_HDR) + OptLen));
+    if (nullptr == temp) {
+        return;
+    }
+
+    PSD_HEADER * PseudoHeader = reinterpret_cast<PSD_HEADER *>(temp);
+
+    PseudoHeader->saddr = tcp4->ip_hdr.SourceAddress.S_un.S_addr;
+    PseudoHeader->daddr = tcp4->ip_hdr.DestinationAddress.S_un.S_addr;
+    PseudoHeader->mbz = 0;
+    PseudoHeader->ptcl = IPPROTO_TCP;
+    PseudoHeader->tcpl = ntohs(sizeof(TCP_HDR) + OptLen);
+
+    PBYTE test = &temp[0] + sizeof(PSD_HEADER);
+    RtlCopyMemory(test, &tcp4->tcp_hdr, sizeof(TCP_HDR));
+
+    test = test + sizeof(TCP_HDR);
+    RtlCopyMemory(test, (PBYTE)&tcp4->tcp_hdr + sizeof(TCP_HDR), OptLen);
+
+    tcp4->tcp_hdr.th_sum =
+        checksum(reinterpret_cast<USHORT *>(temp), sizeof(PSD_HEADER) + sizeof(TCP_HDR) + OptLen);
+
+    FREE(temp);
+}
+
+
+static USHORT calc_udp4_sum_legacy(USHORT * buffer, int size)
+/*
+原来的calc_udp4_sum的实现，仅供对比。
+*/
+{
+    USHORT sum = 0;
+    PIPV4_HEADER IPv4 = (PIPV4_HEADER)((PBYTE)buffer + ETH_LENGTH_OF_HEADER);
+    PUDP_HDR udp = (PUDP_HDR)((PBYTE)IPv4 + Ip4HeaderLengthInBytes(IPv4));
+
+    int len = size - ETH_LENGTH_OF_HEADER;
+    len -= Ip4HeaderLengthInBytes(IPv4);
+    len -= sizeof(UDP_HDR);
+
+    PSD_HEADER * buf = (PSD_HEADER *)MALLOC(sizeof(PSD_HEADER) + sizeof(UDP_HDR) + len);
+    if (!buf) {
+
+        return sum;
+    }
+
+    buf->saddr = IPv4->SourceAddress.S_un.S_addr;
+    buf->daddr = IPv4->DestinationAddress.S_un.S_addr;
+    buf->mbz = 0;
+    buf->ptcl = IPPROTO_UDP;
+    buf->tcpl = udp->udp_length;
+
+    PUDP_HDR tmp = (PUDP_HDR)((PBYTE)buf + sizeof(PSD_HEADER));
+    RtlCopyMemory(tmp, udp, sizeof(UDP_HDR));
+    tmp->udp_checksum = 0;
+
+    RtlCopyMemory((PBYTE)buf + sizeof(PSD_HEADER) + sizeof(UDP_HDR), (PBYTE)udp + sizeof(UDP_HDR), len);
+
+    sum = checksum((USHORT *)buf, sizeof(PSD_HEADER) + sizeof(UDP_HDR) + len);
+
+    FREE(buf);
+
+    return sum;
+}
+
+
+static void PseudoHeaderChecksumBenchmark()
+/*
+功能：对比伪首部校验和的每个包的耗时（纳秒）。
+
+1.TCP：PacketizeSyn4构造的SYN（带MSS选项）。
+2.UDP：带1472字节数据（以太网的MTU下最大）的UDP包。
+*/
+{
+    BYTE SrcMac[6] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
+    BYTE DesMac[6] = {0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb};
+    IN_ADDR Src;
+    IN_ADDR Dst;
+    Src.S_un.S_addr = htonl(0xc0a80102); // 192.168.1.2
+    Dst.S_un.S_addr = htonl(0x08080808); // 8.8.8.8
+
+    BYTE Syn[sizeof(RAW_TCP) + sizeof(TCP_OPT_MSS)] = {0};
+    PacketizeSyn4(SrcMac, DesMac, &Src, &Dst, htons(50000), htons(443), Syn);
+
+    const int PayloadLength = 1472;
+    const int UdpSize = ETH_LENGTH_OF_HEADER + sizeof(IPV4_HEADER) + sizeof(UDP_HDR) + PayloadLength;
+    PBYTE Udp = reinterpret_cast<PBYTE>(MALLOC(UdpSize));
+    if (nullptr == Udp) {
+        printf("LastError:%d\n", GetLastError());
+        return;
+    }
+
+    PIPV4_HEADER IPv4 = (PIPV4_HEADER)(Udp + ETH_LENGTH_OF_HEADER);
+    InitIpv4Header(&Src, &Dst, IPPROTO_UDP, (UINT16)(UdpSize - ETH_LENGTH_OF_HEADER), IPv4);
+    PUDP_HDR udp = (PUDP_HDR)((PBYTE)IPv4 + sizeof(IPV4_HEADER));
+    udp->src_portno = htons(50000);
+    udp->dst_portno = htons(53);
+    udp->udp_length = htons(sizeof(UDP_HDR) + PayloadLength);
+    for (int i = 0; i < PayloadLength; i++) {
+        ((PBYTE)udp + sizeof(UDP_HDR))[i] = (BYTE)(i * 7 + 3);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //正确性。
+
+    BYTE Legacy[sizeof(Syn)];
+    reinterpret_cast<PRAW_TCP>(Syn)->tcp_hdr.th_sum = 0; //原来的实现要求校验和字段事先为0。
+    RtlCopyMemory(Legacy, Syn, sizeof(Syn));
+    CalculationTcp4SumLegacy(Legacy, sizeof(TCP_OPT_MSS));
+    CalculationTcp4Sum(Syn, sizeof(TCP_OPT_MSS));
+    printf("tcp4: %s\n", RtlCompareMemory(Legacy, Syn, sizeof(Syn)) == sizeof(Syn) ? "ok" : "MISMATCH");
+
+    USHORT Expected = calc_udp4_sum_legacy((USHORT *)Udp, UdpSize);
+    printf("udp4: %s\n", Expected == calc_udp4_sum((USHORT *)Udp, UdpSize) ? "ok" : "MISMATCH");
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //耗时。
+
+    LARGE_INTEGER Frequency, Start, End;
+    QueryPerformanceFrequency(&Frequency);
+    const ULONG Loops = 1000000;
+    volatile USHORT Sink = 0;
+
+    QueryPerformanceCounter(&Start);
+    for (ULONG i = 0; i < Loops; i++) {
+        CalculationTcp4SumLegacy(Syn, sizeof(TCP_OPT_MSS));
+    }
+    QueryPerformanceCounter(&End);
+    double Before = (double)(End.QuadPart - Start.QuadPart) * 1e9 / Frequency.QuadPart / Loops;
+
+    QueryPerformanceCounter(&Start);
+    for (ULONG i = 0; i < Loops; i++) {
+        CalculationTcp4Sum(Syn, sizeof(TCP_OPT_MSS));
+    }
+    QueryPerformanceCounter(&End);
+    double After = (double)(End.QuadPart - Start.QuadPart) * 1e9 / Frequency.QuadPart / Loops;
+
+    printf("tcp4 syn:       before %8.1f ns/packet, after %8.1f ns/packet\n", Before, After);
+
+    QueryPerformanceCounter(&Start);
+    for (ULONG i = 0; i < Loops; i++) {
+        Sink = Sink + calc_udp4_sum_legacy((USHORT *)Udp, UdpSize);
+    }
+    QueryPerformanceCounter(&End);
+    Before = (double)(End.QuadPart - Start.QuadPart) * 1e9 / Frequency.QuadPart / Loops;
+
+    QueryPerformanceCounter(&Start);
+    for (ULONG i = 0; i < Loops; i++) {
+        Sink = Sink + calc_udp4_sum((USHORT *)Udp, UdpSize);
+    }
+    QueryPerformanceCounter(&End);
+    After = (double)(End.QuadPart - Start.QuadPart) * 1e9 / Frequency.QuadPart / Loops;
+
+    printf("udp4 1472 byte: before %8.1f ns/packet, after %8.1f ns/packet\n", Before, After);
+
+    FREE(Udp);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//增量校验和（ChecksumAdjust*）的测试：改写字段后增量更新的，和重新计算的比较。
+
+
+static USHORT ChecksumOnesAdd(_In_ USHORT a, _In_ USHORT b)
+/*
+功能：16位的二进制反码加法。
+
+用途：构造重新计算的校验和恰好为0的报文，即把校验和加到某个字段上（反码和变成0xFFFF）。
+*/
+{
+    UINT32 Sum = (UINT32)a + b;
+
+    return (USHORT)((Sum & 0xffff) + (Sum >> 16));
+}
+
+
+static void ChecksumAdjustBenchmark()
+/*
+功能：增量校验和的正确性和耗时。
+
+1.随机的IPv4头：改写TTL，标识和地址，用ChecksumAdjust16/ChecksumAdjust32更新，和checksum重新计算的比较。
+2.随机的TCP（IPv4和IPv6，带选项）：改写端口，序号，确认号和地址（伪首部），
+  和CalculationTcp4Sum/CalculationTcp6Sum重新计算的比较。
+3.随机的UDP：改写端口和地址，用UdpChecksumAdjust更新，和calc_udp4_sum的比较（算出0的要发送0xFFFF）。
+  没有校验和（0）的改写后还是0.
+4.边界：字段在0x0000和0xFFFF之间改写；改写后重新计算的校验和恰好是0（UDP的是0xFFFF）；
+  原来的校验和是0x0000（UDP的是0xFFFF）。
+5.导出的批量组包（PacketizeSyn4Batch，PacketizeSyn6Batch，packetize_icmpv4_echo_request_batch，
+  packetize_icmpv6_echo_request_batch）：每个帧里增量更新的校验和，和重新计算的比较。
+6.最后对比改写端口和地址时，重新计算和增量更新的每个包的耗时。
+*/
+{
+    BYTE Tcp4[sizeof(RAW_TCP) + sizeof(TCP_OPT)];
+    BYTE Tcp6[sizeof(RAW6_TCP) + sizeof(TCP_OPT)];
+    BYTE Udp4[ETH_LENGTH_OF_HEADER + sizeof(IPV4_HEADER) + sizeof(UDP_HDR) + 64];
+    PRAW_TCP t4 = reinterpret_cast<PRAW_TCP>(Tcp4);
+    PRAW6_TCP t6 = reinterpret_cast<PRAW6_TCP>(Tcp6);
+    PIPV4_HEADER u4 = (PIPV4_HEADER)(Udp4 + ETH_LENGTH_OF_HEADER);
+    PUDP_HDR udp = (PUDP_HDR)((PBYTE)u4 + sizeof(IPV4_HEADER));
+    ULONG ErrorsIp = 0, ErrorsTcp4 = 0, ErrorsTcp6 = 0, ErrorsUdp = 0, ErrorsEdge = 0;
+
+    ULONG Seed = GetTickCount();
+    auto Random = [&Seed](PVOID Buffer, SIZE_T Size) {
+        for (SIZE_T i = 0; i < Size; i++) {
+            Seed = Seed * 1103515245 + 12345;
+            reinterpret_cast<PBYTE>(Buffer)[i] = (BYTE)(Seed >> 16);
+        }
+    };
+
+    auto UdpSum = [&]() { //发送的UDP的校验和（RFC 768）。
+        USHORT Sum = calc_udp4_sum((USHORT *)Udp4, sizeof(Udp4));
+        return Sum ? Sum : (USHORT)0xFFFF;
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //正确性。
+
+    for (int i = 0; i < 100000; i++) {
+        UINT16 Ports[2];
+        SEQ_NUM Numbers[2];
+        IN_ADDR Addresses[2];
+        IN6_ADDR Addresses6[2];
+        UINT16 Old, New;
+        USHORT Sum;
+
+        Random(Ports, sizeof(Ports));
+        Random(Numbers, sizeof(Numbers));
+        Random(Addresses, sizeof(Addresses));
+        Random(Addresses6, sizeof(Addresses6));
+
+        //IPv4头。TTL是8位的，和后面的Protocol组成16位的字。
+        IPV4_HEADER Ip;
+        Random(&Ip, sizeof(Ip));
+        Ip.HeaderChecksum = 0;
+        Ip.HeaderChecksum = checksum(reinterpret_cast<USHORT *>(&Ip), sizeof(Ip));
+
+        RtlCopyMemory(&Old, &Ip.TimeToLive, sizeof(UINT16));
+        Ip.TimeToLive--;
+        RtlCopyMemory(&New, &Ip.TimeToLive, sizeof(UINT16));
+        Sum = ChecksumAdjust16(Ip.HeaderChecksum, Old, New);
+        Sum = ChecksumAdjust16(Sum, Ip.Identification, Ports[0]);
+        Ip.Identification = Ports[0];
+        Sum = ChecksumAdjust32(Sum, Ip.SourceAddress.S_un.S_addr, Addresses[0].S_un.S_addr);
+        Ip.SourceAddress = Addresses[0];
+        Sum = ChecksumAdjust32(Sum, Ip.DestinationAddress.S_un.S_addr, Addresses[1].S_un.S_addr);
+        Ip.DestinationAddress = Addresses[1];
+
+        Ip.HeaderChecksum = 0;
+        if (Sum != checksum(reinterpret_cast<USHORT *>(&Ip), sizeof(Ip))) {
+            ErrorsIp++;
+        }
+
+        //IPv4的TCP。
+        Random(Tcp4, sizeof(Tcp4));
+        CalculationTcp4Sum(Tcp4, sizeof(TCP_OPT));
+
+        Sum = ChecksumAdjust16(t4->tcp_hdr.th_sum, t4->tcp_hdr.th_sport, Ports[0]);
+        t4->tcp_hdr.th_sport = Ports[0];
+        Sum = ChecksumAdjust16(Sum, t4->tcp_hdr.th_dport, Ports[1]);
+        t4->tcp_hdr.th_dport = Ports[1];
+        Sum = ChecksumAdjust32(Sum, t4->tcp_hdr.th_seq, Numbers[0]);
+        t4->tcp_hdr.th_seq = Numbers[0];
+        Sum = ChecksumAdjust32(Sum, t4->tcp_hdr.th_ack, Numbers[1]);
+        t4->tcp_hdr.th_ack = Numbers[1];
+        Sum = ChecksumAdjust32(Sum, t4->ip_hdr.SourceAddress.S_un.S_addr, Addresses[0].S_un.S_addr);
+        t4->ip_hdr.SourceAddress = Addresses[0];
+        Sum = ChecksumAdjust32(Sum, t4->ip_hdr.DestinationAddress.S_un.S_addr, Addresses[1].S_un.S_addr);
+        t4->ip_hdr.DestinationAddress = Addresses[1];
+
+        CalculationTcp4Sum(Tcp4, sizeof(TCP_OPT));
+        if (Sum != t4->tcp_hdr.th_sum) {
+            ErrorsTcp4++;
+        }
+
+        //IPv6的TCP。序号用ChecksumAdjust（任意长度的）。
+        Random(Tcp6, sizeof(Tcp6));
+        CalculationTcp6Sum(Tcp6, sizeof(TCP_OPT));
+
+        Sum = ChecksumAdjust16(t6->tcp_hdr.th_sum, t6->tcp_hdr.th_sport, Ports[0]);
+        t6->tcp_hdr.th_sport = Ports[0];
+        Sum = ChecksumAdjust16(Sum, t6->tcp_hdr.th_dport, Ports[1]);
+        t6->tcp_hdr.th_dport = Ports[1];
+        Sum = ChecksumAdjust(Sum, &t6->tcp_hdr.th_seq, &Numbers[0], sizeof(SEQ_NUM));
+        t6->tcp_hdr.th_seq = Numbers[0];
+        Sum = ChecksumAdjust32(Sum, t6->tcp_hdr.th_ack, Numbers[1]);
+        t6->tcp_hdr.th_ack = Numbers[1];
+        Sum = ChecksumAdjust(Sum, &t6->ip_hdr.SourceAddress, &Addresses6[0], sizeof(IN6_ADDR));
+        t6->ip_hdr.SourceAddress = Addresses6[0];
+        Sum = ChecksumAdjust(Sum, &t6->ip_hdr.DestinationAddress, &Addresses6[1], sizeof(IN6_ADDR));
+        t6->ip_hdr.DestinationAddress = Addresses6[1];
+
+        CalculationTcp6Sum(Tcp6, sizeof(TCP_OPT));
+        if (Sum != t6->tcp_hdr.th_sum) {
+            ErrorsTcp6++;
+        }
+
+        //UDP。
+        Random(Udp4, sizeof(Udp4));
+        u4->VersionAndHeaderLength = (4 << 4) | (sizeof(IPV4_HEADER) / 4);
+        udp->udp_length = htons((UINT16)(sizeof(Udp4) - ETH_LENGTH_OF_HEADER - sizeof(IPV4_HEADER)));
+        udp->udp_checksum = UdpSum();
+
+        if (0 != UdpChecksumAdjust(0, &udp->src_portno, &Ports[0], sizeof(UINT16))) {
+            ErrorsUdp++;
+        }
+
+        Sum = UdpChecksumAdjust(udp->udp_checksum, &udp->src_portno, &Ports[0], sizeof(UINT16));
+        udp->src_portno = Ports[0];
+        Sum = UdpChecksumAdjust(Sum, &udp->dst_portno, &Ports[1], sizeof(UINT16));
+        udp->dst_portno = Ports[1];
+        Sum = UdpChecksumAdjust(Sum, &u4->SourceAddress, &Addresses[0], sizeof(IN_ADDR));
+        u4->SourceAddress = Addresses[0];
+        Sum = UdpChecksumAdjust(Sum, &u4->DestinationAddress, &Addresses[1], sizeof(IN_ADDR));
+        u4->DestinationAddress = Addresses[1];
+
+        if (Sum != UdpSum()) {
+            ErrorsUdp++;
+        }
+
+        udp->udp_checksum = Sum;
+
+        //////////////////////////////////////////////////////////////////////////////////////////
+        //边界。
+
+        //字段从0xFFFF改为0x0000，以及相反。
+        t4->tcp_hdr.th_sport = 0xFFFF;
+        t4->tcp_hdr.th_dport = 0;
+        CalculationTcp4Sum(Tcp4, sizeof(TCP_OPT));
+        Sum = ChecksumAdjust16(t4->tcp_hdr.th_sum, 0xFFFF, 0);
+        Sum = ChecksumAdjust16(Sum, 0, 0xFFFF);
+        t4->tcp_hdr.th_sport = 0;
+        t4->tcp_hdr.th_dport = 0xFFFF;
+        CalculationTcp4Sum(Tcp4, sizeof(TCP_OPT));
+        if (Sum != t4->tcp_hdr.th_sum) {
+            ErrorsEdge++;
+        }
+
+        //改写后的校验和恰好是0x0000，再从0x0000改写。
+        New = ChecksumOnesAdd(t4->tcp_hdr.th_dport, t4->tcp_hdr.th_sum);
+        Sum = ChecksumAdjust16(t4->tcp_hdr.th_sum, t4->tcp_hdr.th_dport, New);
+        t4->tcp_hdr.th_dport = New;
+        CalculationTcp4Sum(Tcp4, sizeof(TCP_OPT));
+        if (0 != Sum || 0 != t4->tcp_hdr.th_sum) {
+            ErrorsEdge++;
+        }
+
+        Sum = ChecksumAdjust16(Sum, t4->tcp_hdr.th_sport, Ports[0]);
+        t4->tcp_hdr.th_sport = Ports[0];
+        CalculationTcp4Sum(Tcp4, sizeof(TCP_OPT));
+        if (Sum != t4->tcp_hdr.th_sum) {
+            ErrorsEdge++;
+        }
+
+        //UDP的：改写后算出0，要发送0xFFFF；再从0xFFFF改写。
+        New = ChecksumOnesAdd(udp->dst_portno, calc_udp4_sum((USHORT *)Udp4, sizeof(Udp4)));
+        Sum = UdpChecksumAdjust(udp->udp_checksum, &udp->dst_portno, &New, sizeof(UINT16));
+        udp->dst_portno = New;
+        if (0xFFFF != Sum || 0xFFFF != UdpSum()) {
+            ErrorsEdge++;
+        }
+
+        Sum = UdpChecksumAdjust(Sum, &udp->src_portno, &Ports[1], sizeof(UINT16));
+        udp->src_portno = Ports[1];
+        if (Sum != UdpSum()) {
+            ErrorsEdge++;
+        }
+    }
+
+    printf("ipv4: %s\n", ErrorsIp ? "MISMATCH" : "ok");
+    printf("tcp4: %s\n", ErrorsTcp4 ? "MISMATCH" : "ok");
+    printf("tcp6: %s\n", ErrorsTcp6 ? "MISMATCH" : "ok");
+    printf("udp4: %s\n", ErrorsUdp ? "MISMATCH" : "ok");
+    printf("edge: %s\n", ErrorsEdge ? "MISMATCH" : "ok");
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //批量组包：随机的目的地址，端口和序号，每个帧复制一份再重新计算校验和，应该不变。
+
+    const ULONG Count = 1024;
+    const ULONG Stride = 128; //比最长的帧（ICMPv6的）长，也测试了非紧密排列。
+    const SIZE_T SlabSize = (SIZE_T)Count * Stride;
+    static_assert(sizeof(RAW6_TCP) + sizeof(TCP_OPT) <= Stride, "帧放不下。");
+    BYTE SrcMac[6] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
+    BYTE DesMac[6] = {0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb};
+    IN_ADDR Source4;
+    IN6_ADDR Source6;
+    UINT16 SourcePort, Sequence;
+    BYTE Frame[Stride];
+    ULONG ErrorsBatch = 0;
+    LARGE_INTEGER Frequency, Start, End;
+    const ULONG Loops = 10000000;
+    double Before, After;
+
+    PBYTE Slab = reinterpret_cast<PBYTE>(MALLOC(SlabSize));
+    PIN_ADDR Destinations4 = reinterpret_cast<PIN_ADDR>(MALLOC(Count * sizeof(IN_ADDR)));
+    PIN6_ADDR Destinations6 = reinterpret_cast<PIN6_ADDR>(MALLOC(Count * sizeof(IN6_ADDR)));
+    PUINT16 DestinationPorts = reinterpret_cast<PUINT16>(MALLOC(Count * sizeof(UINT16)));
+    if (nullptr == Slab || nullptr == Destinations4 || nullptr == Destinations6 || nullptr == DestinationPorts) {
+        printf("LastError:%d\n", GetLastError());
+        goto Cleanup;
+    }
+
+    for (int Round = 0; Round < 16; Round++) {
+        Random(&Source4, sizeof(Source4));
+        Random(&Source6, sizeof(Source6));
+        Random(&SourcePort, sizeof(SourcePort));
+        Random(&Sequence, sizeof(Sequence));
+        Random(Destinations4, Count * sizeof(IN_ADDR));
+        Random(Destinations6, Count * sizeof(IN6_ADDR));
+        Random(DestinationPorts, Count * sizeof(UINT16));
+        DestinationPorts[0] = 0; //和模板的一样。
+        DestinationPorts[1] = 0xFFFF;
+
+        PacketizeSyn4Batch(SrcMac,
+                           DesMac,
+                           &Source4,
+                           SourcePort,
+                           Count,
+                           Destinations4,
+                           DestinationPorts,
+                           Slab,
+                           SlabSize,
+                           Stride,
+                           nullptr);
+        for (ULONG i = 0; i < Count; i++) {
+            const SIZE_T Length = sizeof(RAW_TCP) + sizeof(TCP_OPT_MSS);
+            PRAW_TCP tcp4 = reinterpret_cast<PRAW_TCP>(Frame);
+            RtlCopyMemory(Frame, Slab + (SIZE_T)i * Stride, Length);
+            tcp4->ip_hdr.HeaderChecksum = 0;
+            tcp4->ip_hdr.HeaderChecksum = checksum(reinterpret_cast<USHORT *>(&tcp4->ip_hdr), sizeof(IPV4_HEADER));
+            CalculationTcp4Sum(Frame, sizeof(TCP_OPT_MSS));
+            if (RtlCompareMemory(Frame, Slab + (SIZE_T)i * Stride, Length) != Length) {
+                ErrorsBatch++;
+            }
+        }
+
+        PacketizeSyn6Batch(SrcMac,
+                           DesMac,
+                           &Source6,
+                           SourcePort,
+                           Count,
+                           Destinations6,
+                           DestinationPorts,
+                           Slab,
+                           SlabSize,
+                           Stride,
+                           nullptr);
+        for (ULONG i = 0; i < Count; i++) {
+            const SIZE_T Length = sizeof(RAW6_TCP);
+            RtlCopyMemory(Frame, Slab + (SIZE_T)i * Stride, Length);
+            CalculationTcp6Sum(Frame, 0);
+            if (RtlCompareMemory(Frame, Slab + (SIZE_T)i * Stride, Length) != Length) {
+                ErrorsBatch++;
+            }
+        }
+
+        packetize_icmpv4_echo_request_batch(
+            SrcMac, DesMac, &Source4, Sequence, Count, Destinations4, Slab, SlabSize, Stride, nullptr);
+        for (ULONG i = 0; i < Count; i++) {
+            const SIZE_T Length = sizeof(ETHERNET_HEADER) + sizeof(IPV4_HEADER) + sizeof(ICMP_MESSAGE);
+            PIPV4_HEADER ip_hdr = (PIPV4_HEADER)(Frame + sizeof(ETHERNET_HEADER));
+            PICMP_MESSAGE icmp = (PICMP_MESSAGE)(Frame + sizeof(ETHERNET_HEADER) + sizeof(IPV4_HEADER));
+            RtlCopyMemory(Frame, Slab + (SIZE_T)i * Stride, Length);
+            ip_hdr->HeaderChecksum = 0;
+            ip_hdr->HeaderChecksum = checksum(reinterpret_cast<USHORT *>(ip_hdr), sizeof(IPV4_HEADER));
+            icmp->Header.Checksum = 0;
+            icmp->Header.Checksum = checksum(reinterpret_cast<USHORT *>(icmp), sizeof(ICMP_MESSAGE));
+            if (RtlCompareMemory(Frame, Slab + (SIZE_T)i * Stride, Length) != Length ||
+                ntohs(icmp->icmp6_seq) != (UINT16)(Sequence + i)) {
+                ErrorsBatch++;
+            }
+        }
+
+        packetize_icmpv6_echo_request_batch(
+            SrcMac, DesMac, &Source6, Sequence, Count, Destinations6, Slab, SlabSize, Stride, nullptr);
+        for (ULONG i = 0; i < Count; i++) {
+            const SIZE_T Length = sizeof(ETHERNET_HEADER) + sizeof(IPV6_HEADER) + sizeof(ICMP_MESSAGE) + 0x20;
+            PICMP_MESSAGE icmp = (PICMP_MESSAGE)(Frame + sizeof(ETHERNET_HEADER) + sizeof(IPV6_HEADER));
+            RtlCopyMemory(Frame, Slab + (SIZE_T)i * Stride, Length);
+            calculation_icmpv6_echo_request_checksum(Frame, 0);
+            if (RtlCompareMemory(Frame, Slab + (SIZE_T)i * Stride, Length) != Length ||
+                ntohs(icmp->icmp6_seq) != (UINT16)(Sequence + i)) {
+                ErrorsBatch++;
+            }
+        }
+    }
+
+    printf("batch: %s\n", ErrorsBatch ? "MISMATCH" : "ok");
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //耗时：改写目的端口和目的地址。
+
+    QueryPerformanceFrequency(&Frequency);
+
+    QueryPerformanceCounter(&Start);
+    for (ULONG i = 0; i < Loops; i++) {
+        t4->tcp_hdr.th_dport = (UINT16)i;
+        t4->ip_hdr.DestinationAddress.S_un.S_addr = i;
+        CalculationTcp4Sum(Tcp4, sizeof(TCP_OPT));
+    }
+    QueryPerformanceCounter(&End);
+    Before = (double)(End.QuadPart - Start.QuadPart) * 1e9 / Frequency.QuadPart / Loops;
+
+    QueryPerformanceCounter(&Start);
+    for (ULONG i = 0; i < Loops; i++) {
+        USHORT Sum = ChecksumAdjust16(t4->tcp_hdr.th_sum, t4->tcp_hdr.th_dport, (UINT16)i);
+        t4->tcp_hdr.th_dport = (UINT16)i;
+        Sum = ChecksumAdjust32(Sum, t4->ip_hdr.DestinationAddress.S_un.S_addr, i);
+        t4->ip_hdr.DestinationAddress.S_un.S_addr = i;
+        t4->tcp_hdr.th_sum = Sum;
+    }
+    QueryPerformanceCounter(&End);
+    After = (double)(End.QuadPart - Start.QuadPart) * 1e9 / Frequency.QuadPart / Loops;
+
+    printf("tcp4 rewrite: recompute %8.1f ns/packet, adjust %8.1f ns/packet\n", Before, After);
+
+Cleanup:
+    if (DestinationPorts) {
+        FREE(DestinationPorts);
+    }
+
+    if (Destinations6) {
+        FREE(Destinations6);
+    }
+
+    if (Destinations4) {
+        FREE(Destinations4);
+    }
+
+    if (Slab) {
+        FREE(Slab);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static void PacketizeSyn4Legacy(IN PBYTE SrcMac, IN PBYTE DesMac, IN PIN_ADDR SourceAddress,
+                                IN PIN_ADDR DestinationAddress, IN UINT16 th_sport, IN UINT16 th_dport,
+                                OUT PBYTE buffer)
+/*
+功能：原来的（运行时逐个字段填写的）PacketizeSyn4，用于对比。
+*/
+{
+    PRAW_TCP tcp4 = (PRAW_TCP)buffer;
+
+    InitEthernetHeader(SrcMac, DesMac, ETHERNET_TYPE_IPV4, &tcp4->eth_hdr);
+
+    InitIpv4Header(SourceAddress,
+                   DestinationAddress,
+                   IPPROTO_TCP,
+                   sizeof(IPV4_HEADER) + sizeof(TCP_HDR) + sizeof(TCP_OPT_MSS),
+                   &tcp4->ip_hdr);
+
+    InitTcpHeaderBySyn(th_sport, th_dport, sizeof(TCP_OPT_MSS), &tcp4->tcp_hdr);
+
+    TCP_OPT_MSS * mss = (TCP_OPT_MSS *)(buffer + sizeof(RAW_TCP));
+    InitTcpMss(mss);
+
+    CalculationTcp4Sum(buffer, sizeof(TCP_OPT_MSS));
+}
+
+
+static void PacketizeSyn6Legacy(IN PBYTE SrcMac, IN PBYTE DesMac, IN PIN6_ADDR SourceAddress,
+                                IN PIN6_ADDR DestinationAddress, IN UINT16 th_sport, IN UINT16 th_dport,
+                                OUT PBYTE buffer)
+/*
+功能：原来的（运行时逐个字段填写的）PacketizeSyn6，用于对比。
+*/
+{
+    PRAW6_TCP tcp6 = (PRAW6_TCP)buffer;
+
+    InitEthernetHeader(SrcMac, DesMac, ETHERNET_TYPE_IPV6, &tcp6->eth_hdr);
+
+    InitIpv6HeaderForTcp(SourceAddress, DestinationAddress, IPPROTO_TCP, 0, &tcp6->ip_hdr);
+
+    InitTcpHeaderBySyn(th_sport, th_dport, 0, &tcp6->tcp_hdr);
+
+    CalculationTcp6Sum(buffer, 0);
+}
+
+
+static void PacketizeAck4Legacy(IN PIPV4_HEADER IPv4Header, IN PBYTE SrcMac, IN PBYTE DesMac, OUT PRAW_TCP buffer)
+/*
+功能：原来的（运行时逐个字段填写，再重新计算TCP的校验和的）PacketizeAck4，用于对比。
+*/
+{
+    PTCP_HDR tcp = (PTCP_HDR)((PBYTE)IPv4Header + Ip4HeaderLengthInBytes(IPv4Header));
+
+    InitEthernetHeader(SrcMac, DesMac, ETHERNET_TYPE_IPV4, &buffer->eth_hdr);
+    InitIpv4Header(IPv4Header, sizeof(IPV4_HEADER) + sizeof(TCP_HDR) + sizeof(TCP_OPT), false, &buffer->ip_hdr);
+    InitTcpHeaderWithAck(tcp, false, &buffer->tcp_hdr);
+
+    PTCP_OPT tcp_opt = (PTCP_OPT)((PBYTE)buffer + sizeof(RAW_TCP));
+    InitTcpMss(tcp_opt);
+    InitTcpWs(&tcp_opt->ws);
+    InitTcpSp(&tcp_opt->sp);
+
+    CalculationTcp4Sum((PBYTE)buffer, sizeof(TCP_OPT));
+}
+
+
+static void PacketizeAck6Legacy(IN PIPV6_HEADER IPv6Header, IN PBYTE SrcMac, IN PBYTE DesMac, OUT PRAW6_TCP buffer)
+/*
+功能：原来的（运行时逐个字段填写的）PacketizeAck6，用于对比。
+*/
+{
+    PTCP_HDR tcp = (PTCP_HDR)((PBYTE)IPv6Header + sizeof(IPV6_HEADER));
+
+    InitEthernetHeader(SrcMac, DesMac, ETHERNET_TYPE_IPV6, &buffer->eth_hdr);
+    InitIpv6Header(IPv6Header, false, sizeof(TCP_OPT), &buffer->ip_hdr);
+    InitTcpHeaderWithAck(tcp, false, &buffer->tcp_hdr);
+
+    PTCP_OPT tcp_opt = (PTCP_OPT)((PBYTE)buffer + sizeof(RAW6_TCP));
+    InitTcpMss(tcp_opt);
+    InitTcpWs(&tcp_opt->ws);
+    InitTcpSp(&tcp_opt->sp);
+
+    CalculationTcp6Sum((PBYTE)buffer, sizeof(TCP_OPT));
+}
+
+
+static void PacketTemplateBenchmark()
+/*
+功能：编译期的模板和原来的组包的对比。
+
+1.先验证随机的地址，端口和序号下，两者组的包（SYN和对SYN的应答）完全一样。
+2.再按字段解析应答，和手算的值（确认号，端口，地址，标志）比较，不依赖原来的组包。
+3.再对比每个包的耗时。
+*/
+{
+    static_assert(sizeof(RAW6_TCP) > sizeof(RAW_TCP) + sizeof(TCP_OPT_MSS), "缓冲区要能容纳两种包。");
+    BYTE Legacy[sizeof(RAW6_TCP) + sizeof(TCP_OPT)];
+    BYTE Templated[sizeof(RAW6_TCP) + sizeof(TCP_OPT)];
+    BYTE Syn4[PacketTemplate::Syn4::Size];
+    BYTE Syn6[PacketTemplate::Syn6::Size];
+    PRAW_TCP syn4 = reinterpret_cast<PRAW_TCP>(Syn4);
+    PRAW6_TCP syn6 = reinterpret_cast<PRAW6_TCP>(Syn6);
+    BYTE SrcMac[6] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
+    BYTE DesMac[6] = {0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb};
+    IN_ADDR Source4, Destination4;
+    IN6_ADDR Source6, Destination6;
+    ULONG Errors4 = 0, Errors6 = 0, ErrorsAck4 = 0, ErrorsAck6 = 0;
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //正确性。
+
+    ULONG Seed = GetTickCount();
+    auto Random = [&Seed](PVOID Buffer, SIZE_T Size) {
+        for (SIZE_T i = 0; i < Size; i++) {
+            Seed = Seed * 1103515245 + 12345;
+            reinterpret_cast<PBYTE>(Buffer)[i] = (BYTE)(Seed >> 16);
+        }
+    };
+
+    for (int i = 0; i < 100000; i++) {
+        UINT16 Ports[2];
+        SEQ_NUM Seq;
+        Random(&Source4, sizeof(Source4));
+        Random(&Destination4, sizeof(Destination4));
+        Random(&Source6, sizeof(Source6));
+        Random(&Destination6, sizeof(Destination6));
+        Random(Ports, sizeof(Ports));
+        Random(&Seq, sizeof(Seq));
+
+        RtlZeroMemory(Legacy, sizeof(Legacy));
+        PacketizeSyn4Legacy(SrcMac, DesMac, &Source4, &Destination4, Ports[0], Ports[1], Legacy);
+        PacketizeSyn4(SrcMac, DesMac, &Source4, &Destination4, Ports[0], Ports[1], Templated);
+        if (RtlCompareMemory(Legacy, Templated, PacketTemplate::Syn4::Size) != PacketTemplate::Syn4::Size) {
+            Errors4++;
+        }
+
+        RtlZeroMemory(Legacy, sizeof(Legacy));
+        PacketizeSyn6Legacy(SrcMac, DesMac, &Source6, &Destination6, Ports[0], Ports[1], Legacy);
+        PacketizeSyn6(SrcMac, DesMac, &Source6, &Destination6, Ports[0], Ports[1], Templated);
+        if (RtlCompareMemory(Legacy, Templated, PacketTemplate::Syn6::Size) != PacketTemplate::Syn6::Size) {
+            Errors6++;
+        }
+
+        //对收到的SYN的应答。
+        PacketizeSyn4(SrcMac, DesMac, &Source4, &Destination4, Ports[0], Ports[1], Syn4);
+        syn4->tcp_hdr.th_seq = Seq;
+        RtlZeroMemory(Legacy, sizeof(Legacy));
+        PacketizeAck4Legacy(&syn4->ip_hdr, SrcMac, DesMac, reinterpret_cast<PRAW_TCP>(Legacy));
+        PacketizeAck4(&syn4->ip_hdr, SrcMac, DesMac, reinterpret_cast<PRAW_TCP>(Templated));
+        if (RtlCompareMemory(Legacy, Templated, PacketTemplate::Ack4::Size) != PacketTemplate::Ack4::Size) {
+            ErrorsAck4++;
+        }
+
+        PacketizeSyn6(SrcMac, DesMac, &Source6, &Destination6, Ports[0], Ports[1], Syn6);
+        syn6->tcp_hdr.th_seq = Seq;
+        RtlZeroMemory(Legacy, sizeof(Legacy));
+        PacketizeAck6Legacy(&syn6->ip_hdr, SrcMac, DesMac, reinterpret_cast<PRAW6_TCP>(Legacy));
+        PacketizeAck6(&syn6->ip_hdr, SrcMac, DesMac, reinterpret_cast<PRAW6_TCP>(Templated));
+        if (RtlCompareMemory(Legacy, Templated, PacketTemplate::Ack6::Size) != PacketTemplate::Ack6::Size) {
+            ErrorsAck6++;
+        }
+    }
+
+    printf("syn4: %s\n", Errors4 ? "MISMATCH" : "ok");
+    printf("syn6: %s\n", Errors6 ? "MISMATCH" : "ok");
+    printf("ack4: %s\n", ErrorsAck4 ? "MISMATCH" : "ok");
+    printf("ack6: %s\n", ErrorsAck6 ? "MISMATCH" : "ok");
+
+    //应答的各个字段（主机序）。确认号是手算的，包括进位和回绕。
+    const struct {
+        UINT32 Seq;
+        UINT32 Ack;
+    } Numbers[] = {
+        {0, 1}, {1, 2}, {0xff, 0x100}, {0xffffff, 0x1000000}, {0x12345678, 0x12345679}, {0xffffffff, 0}};
+    ULONG ErrorsFields = 0;
+
+    Source4.S_un.S_addr = htonl(0xc0a80102);      // 192.168.1.2
+    Destination4.S_un.S_addr = htonl(0x08080808); // 8.8.8.8
+    RtlZeroMemory(&Source6, sizeof(Source6));
+    RtlZeroMemory(&Destination6, sizeof(Destination6));
+    Source6.u.Byte[0] = 0xfe;
+    Source6.u.Byte[1] = 0x80;
+    Source6.u.Byte[15] = 1;
+    Destination6.u.Byte[0] = 0x20;
+    Destination6.u.Byte[1] = 0x01;
+    Destination6.u.Byte[15] = 2;
+
+    for (auto & Number : Numbers) {
+        PRAW_TCP ack4 = reinterpret_cast<PRAW_TCP>(Templated);
+        PacketizeSyn4(SrcMac, DesMac, &Source4, &Destination4, htons(50000), htons(443), Syn4);
+        syn4->tcp_hdr.th_seq = htonl(Number.Seq);
+        PacketizeAck4(&syn4->ip_hdr, SrcMac, DesMac, ack4);
+        if (ntohl(ack4->tcp_hdr.th_ack) != Number.Ack || 0 != ack4->tcp_hdr.th_seq ||
+            ntohs(ack4->tcp_hdr.th_sport) != 443 || ntohs(ack4->tcp_hdr.th_dport) != 50000 ||
+            ack4->tcp_hdr.th_flags != (TH_SYN | TH_ACK) ||
+            ntohl(ack4->ip_hdr.SourceAddress.S_un.S_addr) != 0x08080808 ||
+            ntohl(ack4->ip_hdr.DestinationAddress.S_un.S_addr) != 0xc0a80102) {
+            ErrorsFields++;
+        }
+
+        PRAW6_TCP ack6 = reinterpret_cast<PRAW6_TCP>(Templated);
+        PacketizeSyn6(SrcMac, DesMac, &Source6, &Destination6, htons(50000), htons(443), Syn6);
+        syn6->tcp_hdr.th_seq = htonl(Number.Seq);
+        PacketizeAck6(&syn6->ip_hdr, SrcMac, DesMac, ack6);
+        if (ntohl(ack6->tcp_hdr.th_ack) != Number.Ack || 0 != ack6->tcp_hdr.th_seq ||
+            ntohs(ack6->tcp_hdr.th_sport) != 443 || ntohs(ack6->tcp_hdr.th_dport) != 50000 ||
+            ack6->tcp_hdr.th_flags != (TH_SYN | TH_ACK) ||
+            0 == IN6_ADDR_EQUAL(&ack6->ip_hdr.SourceAddress, &Destination6) ||
+            0 == IN6_ADDR_EQUAL(&ack6->ip_hdr.DestinationAddress, &Source6)) {
+            ErrorsFields++;
+        }
+    }
+
+    printf("ack fields: %s\n", ErrorsFields ? "MISMATCH" : "ok");
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //耗时。
+
+    LARGE_INTEGER Frequency, Start, End;
+    QueryPerformanceFrequency(&Frequency);
+    const ULONG Loops = 10000000;
+    double Before, After;
+
+    QueryPerformanceCounter(&Start);
+    for (ULONG i = 0; i < Loops; i++) {
+        PacketizeSyn4Legacy(SrcMac, DesMac, &Source4, &Destination4, (UINT16)i, 80, Legacy);
+    }
+    QueryPerformanceCounter(&End);
+    Before = (double)(End.QuadPart - Start.QuadPart) * 1e9 / Frequency.QuadPart / Loops;
+
+    QueryPerformanceCounter(&Start);
+    for (ULONG i = 0; i < Loops; i++) {
+        PacketizeSyn4(SrcMac, DesMac, &Source4, &Destination4, (UINT16)i, 80, Templated);
+    }
+    QueryPerformanceCounter(&End);
+    After = (double)(End.QuadPart - Start.QuadPart) * 1e9 / Frequency.QuadPart / Loops;
+
+    printf("syn4: before %8.1f ns/packet, after %8.1f ns/packet\n", Before, After);
+
+    QueryPerformanceCounter(&Start);
+    for (ULONG i = 0; i < Loops; i++) {
+        PacketizeSyn6Legacy(SrcMac, DesMac, &Source6, &Destination6, (UINT16)i, 80, Legacy);
+    }
+    QueryPerformanceCounter(&End);
+    Before = (double)(End.QuadPart - Start.QuadPart) * 1e9 / Frequency.QuadPart / Loops;
+
+    QueryPerformanceCounter(&Start);
+    for (ULONG i = 0; i < Loops; i++) {
+        PacketizeSyn6(SrcMac, DesMac, &Source6, &Destination6, (UINT16)i, 80, Templated);
+    }
+    QueryPerformanceCounter(&End);
+    After = (double)(End.QuadPart - Start.QuadPart) * 1e9 / Frequency.QuadPart / Loops;
+
+    printf("syn6: before %8.1f ns/packet, after %8.1f ns/packet\n", Before, After);
+
+    QueryPerformanceCounter(&Start);
+    for (ULONG i = 0; i < Loops; i++) {
+        PacketizeAck4Legacy(&syn4->ip_hdr, SrcMac, DesMac, reinterpret_cast<PRAW_TCP>(Legacy));
+    }
+    QueryPerformanceCounter(&End);
+    Before = (double)(End.QuadPart - Start.QuadPart) * 1e9 / Frequency.QuadPart / Loops;
+
+    QueryPerformanceCounter(&Start);
+    for (ULONG i = 0; i < Loops; i++) {
+        PacketizeAck4(&syn4->ip_hdr, SrcMac, DesMac, reinterpret_cast<PRAW_TCP>(Templated));
+    }
+    QueryPerformanceCounter(&End);
+    After = (double)(End.QuadPart - Start.QuadPart) * 1e9 / Frequency.QuadPart / Loops;
+
+    printf("ack4: before %8.1f ns/packet, after %8.1f ns/packet\n", Before, After);
+
+    QueryPerformanceCounter(&Start);
+    for (ULONG i = 0; i < Loops; i++) {
+        PacketizeAck6Legacy(&syn6->ip_hdr, SrcMac, DesMac, reinterpret_cast<PRAW6_TCP>(Legacy));
+    }
+    QueryPerformanceCounter(&End);
+    Before = (double)(End.QuadPart - Start.QuadPart) * 1e9 / Frequency.QuadPart / Loops;
+
+    QueryPerformanceCounter(&Start);
+    for (ULONG i = 0; i < Loops; i++) {
+        PacketizeAck6(&syn6->ip_hdr, SrcMac, DesMac, reinterpret_cast<PRAW6_TCP>(Templated));
+    }
+    QueryPerformanceCounter(&End);
+    After = (double)(End.QuadPart - Start.QuadPart) * 1e9 / Frequency.QuadPart / Loops;
+
+    printf("ack6: before %8.1f ns/packet, after %8.1f ns/packet\n", Before, After);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static bool VerifyGatherFrame(_In_reads_bytes_(Length) const BYTE * Frame, _In_ SIZE_T Length)
+/*
+功能：验证合并后的帧：IP里的长度，IP头的校验和，L4的校验和（包括伪首部）。
+*/
+{
+    const ETHERNET_HEADER * eth_hdr = (const ETHERNET_HEADER *)Frame;
+    const BYTE * L4 = nullptr;
+    SIZE_T L4Length = 0;
+    CHECKSUM_CONTEXT Context;
+    ChecksumInit(&Context);
+
+    if (ETHERNET_TYPE_IPV4 == ntohs(eth_hdr->Type)) {
+        const IPV4_HEADER * ip_hdr = (const IPV4_HEADER *)(Frame + sizeof(ETHERNET_HEADER));
+        if (ntohs(ip_hdr->TotalLength) != Length - sizeof(ETHERNET_HEADER) ||
+            ChecksumFold(ChecksumPartial(ip_hdr, sizeof(IPV4_HEADER))) != 0xffff) {
+            return false;
+        }
+
+        L4 = (const BYTE *)ip_hdr + sizeof(IPV4_HEADER);
+        L4Length = Length - sizeof(ETHERNET_HEADER) - sizeof(IPV4_HEADER);
+        if (IPPROTO_UDP == ip_hdr->Protocol) {
+            ChecksumUpdatePseudoHeader4(
+                &Context, &ip_hdr->SourceAddress, &ip_hdr->DestinationAddress, IPPROTO_UDP, (UINT16)L4Length);
+        }
+    } else {
+        const IPV6_HEADER * ip_hdr = (const IPV6_HEADER *)(Frame + sizeof(ETHERNET_HEADER));
+        L4 = (const BYTE *)ip_hdr + sizeof(IPV6_HEADER);
+        L4Length = Length - sizeof(ETHERNET_HEADER) - sizeof(IPV6_HEADER);
+        if (ntohs(ip_hdr->PayloadLength) != L4Length) {
+            return false;
+        }
+
+        ChecksumUpdatePseudoHeader6(
+            &Context, &ip_hdr->SourceAddress, &ip_hdr->DestinationAddress, ip_hdr->NextHeader, (UINT32)L4Length);
+    }
+
+    ChecksumUpdate(&Context, L4, L4Length);
+
+    return 0 == ChecksumFinal(&Context); //包括校验和字段在内的和是0xffff，取反是0。
+}
+
+
+static void GatherBenchmark()
+/*
+功能：分散/聚集组包的验证和基准测试。
+
+1.负载分成长度为奇数的多段，四种包合并后逐一验证长度和校验和。
+2.对比：分散/聚集（只写头，负载不复制）和复制到连续的帧里再计算校验和（原来的做法）。
+*/
+{
+    const SIZE_T PayloadSize = 8000; //巨型帧的路径MTU探测。
+    const ULONG Loops = 200000;
+    BYTE SrcMac[6] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
+    BYTE DesMac[6] = {0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb};
+    IN_ADDR Source4, Destination4;
+    IN6_ADDR Source6, Destination6;
+    BYTE Header[PACKET_GATHER_HEADER_SIZE];
+    PACKET_SEGMENT Segments[8];
+    PBYTE Payload = nullptr;
+    PBYTE Frame = nullptr;
+    LARGE_INTEGER Frequency, Start, End;
+    volatile UINT64 Sink = 0;
+
+    Payload = (PBYTE)MALLOC(PayloadSize);
+    Frame = (PBYTE)MALLOC(PACKET_GATHER_HEADER_SIZE + PayloadSize);
+    if (nullptr == Payload || nullptr == Frame) {
+        printf("LastError:%d\n", GetLastError());
+        goto Cleanup;
+    }
+
+    for (SIZE_T i = 0; i < PayloadSize; i++) {
+        Payload[i] = (BYTE)(i * 7 + 3);
+    }
+
+    Source4.S_un.S_addr = htonl(0xc0a80102);      // 192.168.1.2
+    Destination4.S_un.S_addr = htonl(0xcb007109); // 203.0.113.9
+    RtlZeroMemory(&Source6, sizeof(Source6));       // fe80::1
+    Source6.u.Byte[0] = 0xfe;
+    Source6.u.Byte[1] = 0x80;
+    Source6.u.Byte[15] = 1;
+    RtlZeroMemory(&Destination6, sizeof(Destination6)); // 2001:db8::9
+    Destination6.u.Byte[0] = 0x20;
+    Destination6.u.Byte[1] = 0x01;
+    Destination6.u.Byte[2] = 0x0d;
+    Destination6.u.Byte[3] = 0xb8;
+    Destination6.u.Byte[15] = 9;
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //正确性。
+
+    {
+        const ULONG Splits[] = {1, 999, 2, 3001, 1997, 1, 2000 - 1};
+        static_assert(_ARRAYSIZE(Splits) < _ARRAYSIZE(Segments), "段的数组太小。");
+        PACKET_SEGMENT Parts[_ARRAYSIZE(Splits)];
+        ULONG Offset = 0;
+        ULONG Errors = 0;
+
+        for (ULONG i = 0; i < _ARRAYSIZE(Splits); i++) {
+            Parts[i].Buffer = Payload + Offset;
+            Parts[i].Length = Splits[i];
+            Offset += Splits[i];
+        }
+
+        for (int Kind = 0; Kind < 4; Kind++) {
+            for (ULONG Count = 0; Count <= _ARRAYSIZE(Parts); Count++) {
+                ULONG SegmentCount = _ARRAYSIZE(Segments);
+                ULONG ret = ERROR_SUCCESS;
+                SIZE_T Length = 0;
+
+                switch (Kind) {
+                case 0:
+                    ret = packetize_icmpv4_echo_request_gather(
+                        SrcMac, DesMac, &Source4, &Destination4, 1, Parts, Count, Header, Segments, &SegmentCount);
+                    break;
+                case 1:
+                    ret = packetize_icmpv6_echo_request_gather(
+                        SrcMac, DesMac, &Source6, &Destination6, 2, Parts, Count, Header, Segments, &SegmentCount);
+                    break;
+                case 2:
+                    ret = PacketizeUdp4Gather(SrcMac,
+                                              DesMac,
+                                              &Source4,
+                                              &Destination4,
+                                              htons(33434),
+                                              htons(53),
+                                              Parts,
+                                              Count,
+                                              Header,
+                                              Segments,
+                                              &SegmentCount);
+                    break;
+                default:
+                    ret = PacketizeUdp6Gather(SrcMac,
+                                              DesMac,
+                                              &Source6,
+                                              &Destination6,
+                                              htons(33434),
+                                              htons(53),
+                                              Parts,
+                                              Count,
+                                              Header,
+                                              Segments,
+                                              &SegmentCount);
+                    break;
+                }
+
+                if (ERROR_SUCCESS != ret || SegmentCount != Count + 1 ||
+                    ERROR_SUCCESS != PacketGatherCopy(Segments,
+                                                      SegmentCount,
+                                                      Frame,
+                                                      PACKET_GATHER_HEADER_SIZE + PayloadSize,
+                                                      &Length) ||
+                    !VerifyGatherFrame(Frame, Length)) {
+                    Errors++;
+                }
+            }
+        }
+
+        //段的数组太小时返回需要的个数。
+        ULONG SegmentCount = 2;
+        ULONG ret = packetize_icmpv4_echo_request_gather(
+            SrcMac, DesMac, &Source4, &Destination4, 1, Parts, _ARRAYSIZE(Parts), Header, Segments, &SegmentCount);
+        if (ERROR_INSUFFICIENT_BUFFER != ret || SegmentCount != _ARRAYSIZE(Parts) + 1) {
+            Errors++;
+        }
+
+        //超过64KB的IP包。
+        PACKET_SEGMENT Huge = {MAXUINT16, Payload};
+        SegmentCount = _ARRAYSIZE(Segments);
+        ret = PacketizeUdp4Gather(
+            SrcMac, DesMac, &Source4, &Destination4, 0, 0, &Huge, 1, Header, Segments, &SegmentCount);
+        if (ERROR_INVALID_PARAMETER != ret) {
+            Errors++;
+        }
+
+        printf("gather: %s (%lu errors)\n", Errors ? "FAILED" : "ok", Errors);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    //性能。
+
+    {
+        PACKET_SEGMENT Whole = {(ULONG)PayloadSize, Payload};
+        const SIZE_T FrameLength = sizeof(ETHERNET_HEADER) + sizeof(IPV6_HEADER) + 8 + PayloadSize;
+        double Copy, Gather;
+
+        QueryPerformanceFrequency(&Frequency);
+
+        //原来的做法：头和负载组装到一个连续的帧里，再对整个L4计算校验和。
+        QueryPerformanceCounter(&Start);
+        for (ULONG i = 0; i < Loops; i++) {
+            PUDP_HDR udp = (PUDP_HDR)(Frame + sizeof(ETHERNET_HEADER) + sizeof(IPV6_HEADER));
+            CHECKSUM_CONTEXT Context;
+
+            InitEthernetHeader(SrcMac, DesMac, ETHERNET_TYPE_IPV6, (PETHERNET_HEADER)Frame);
+            InitIpv6Header(&Source6,
+                           &Destination6,
+                           IPPROTO_UDP,
+                           (UINT16)(sizeof(UDP_HDR) + PayloadSize),
+                           (PIPV6_HEADER)(Frame + sizeof(ETHERNET_HEADER)));
+            udp->src_portno = htons((UINT16)i);
+            udp->dst_portno = htons(53);
+            udp->udp_length = htons((UINT16)(sizeof(UDP_HDR) + PayloadSize));
+            udp->udp_checksum = 0;
+            RtlCopyMemory((PBYTE)udp + sizeof(UDP_HDR), Payload, PayloadSize);
+
+            ChecksumInit(&Context);
+            ChecksumUpdatePseudoHeader6(
+                &Context, &Source6, &Destination6, IPPROTO_UDP, (UINT32)(sizeof(UDP_HDR) + PayloadSize));
+            ChecksumUpdate(&Context, udp, sizeof(UDP_HDR) + PayloadSize);
+            udp->udp_checksum = ChecksumFinal(&Context);
+            Sink = Sink + udp->udp_checksum;
+        }
+        QueryPerformanceCounter(&End);
+        Copy = (double)(End.QuadPart - Start.QuadPart) * 1e9 / Frequency.QuadPart / Loops;
+
+        QueryPerformanceCounter(&Start);
+        for (ULONG i = 0; i < Loops; i++) {
+            ULONG SegmentCount = _ARRAYSIZE(Segments);
+            PacketizeUdp6Gather(SrcMac,
+                                DesMac,
+                                &Source6,
+                                &Destination6,
+                                htons((UINT16)i),
+                                htons(53),
+                                &Whole,
+                                1,
+                                Header,
+                                Segments,
+                                &SegmentCount);
+            Sink = Sink + Header[sizeof(ETHERNET_HEADER) + sizeof(IPV6_HEADER) + 6];
+        }
+        QueryPerformanceCounter(&End);
+        Gather = (double)(End.QuadPart - Start.QuadPart) * 1e9 / Frequency.QuadPart / Loops;
+
+        printf("udp6 %zu bytes: copy %8.1f ns/packet (%6.2f Gbps), gather %8.1f ns/packet (%6.2f Gbps)\n",
+               FrameLength,
+               Copy,
+               FrameLength * 8 / Copy,
+               Gather,
+               FrameLength * 8 / Gather);
+    }
+
+Cleanup:
+    if (Frame) {
+        FREE(Frame);
+    }
+
+    if (Payload) {
+        FREE(Payload);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+int _cdecl main()
+{
+    ChecksumBenchmark();
+    PseudoHeaderChecksumBenchmark();
+    ChecksumAdjustBenchmark();
+    PacketTemplateBenchmark();
+    GatherBenchmark();
+
+    return 0;
+}
@@ -0,0 +1,137 @@
+﻿/*
+取连接表的后端（TableBackend.cpp）的性能测试。Linux的后端的见TableBackendLinuxBenchmark.cpp。
+
+Windows上单独编译运行（不在test.vcxproj的生成里），VS的开发人员命令提示符下：
+cl /std:c++17 /O2 /EHsc /DUNICODE /D_UNICODE /wd4819 TableBackendBenchmark.cpp ..\libnet\TableBackend.cpp
+    ..\libnet\TableDiff.cpp ..\libnet\TableSnapshot.cpp ..\libnet\pch.cpp
+*/
+
+
+#include "..\libnet\pch.h"
+#include "..\libnet\TableBackend.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#define BACKEND_BENCH_ROUNDS 100
+
+
+static ULONG WINAPI CountRows(_In_opt_ PVOID Context,
+                              _In_reads_(Count) const TABLE_BACKEND_ROW * Rows,
+                              _In_ ULONG Count)
+{
+    UNREFERENCED_PARAMETER(Rows);
+
+    *reinterpret_cast<PUINT64>(Context) += Count;
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG WINAPI CheckRows(_In_opt_ PVOID Context,
+                              _In_reads_(Count) const TABLE_BACKEND_ROW * Rows,
+                              _In_ ULONG Count)
+/*
+功能：数一下本进程的行，行的格式要对。
+*/
+{
+    PULONG Own = reinterpret_cast<PULONG>(Context);
+
+    for (ULONG i = 0; i < Count; i++) {
+        if (AF_INET != Rows[i].Family && AF_INET6 != Rows[i].Family) {
+            return ERROR_INVALID_DATA;
+        }
+
+        if (IPPROTO_TCP == Rows[i].Protocol && nullptr == GetTcpConnectionStateName(Rows[i].State)) {
+            return ERROR_INVALID_DATA;
+        }
+
+        *Own += Rows[i].OwningPid == GetCurrentProcessId();
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+static void TableBackendBenchmark()
+/*
+功能：IP Helper的后端的正确性和性能。
+
+本进程绑定一个TCP的侦听和一个UDP，要找到它们（PID对）；然后取整个表若干次。
+Linux的后端的比较见TableBackendLinuxBenchmark.cpp。
+*/
+{
+    PTABLE_BACKEND Backend = nullptr;
+    TABLE_BACKEND_INFORMATION Information{};
+    SOCKADDR_IN Address{};
+    LARGE_INTEGER Frequency{}, Start{}, End{};
+    ULONG Own = 0;
+    UINT64 Rows = 0;
+    ULONG Status = ERROR_SUCCESS;
+    double Seconds = 0;
+    BOOL Ok = FALSE;
+
+    WSADATA WsaData{};
+    (void)WSAStartup(MAKEWORD(2, 2), &WsaData);
+
+    SOCKET Listen = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    SOCKET Udp = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    Address.sin_family = AF_INET;
+    Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (INVALID_SOCKET == Listen || INVALID_SOCKET == Udp ||
+        SOCKET_ERROR == bind(Listen, reinterpret_cast<PSOCKADDR>(&Address), sizeof(Address)) ||
+        SOCKET_ERROR == listen(Listen, SOMAXCONN) ||
+        SOCKET_ERROR == bind(Udp, reinterpret_cast<PSOCKADDR>(&Address), sizeof(Address))) {
+        printf("open sockets failed, %d\n", WSAGetLastError());
+        goto Cleanup;
+    }
+
+    Status = TableBackendCreate(TABLE_BACKEND_DEFAULT, 0, &Backend);
+    if (ERROR_SUCCESS != Status) {
+        printf("create failed, %u\n", Status);
+        goto Cleanup;
+    }
+
+    Status = TableBackendEnumerate(Backend, TABLE_BACKEND_ALL, CheckRows, &Own);
+    Ok = ERROR_SUCCESS == Status && Own >= 2;
+    printf("verify: iphelper %s (%u rows of this process)\n", Ok ? "ok" : "FAILED", Own);
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (ULONG i = 0; i < BACKEND_BENCH_ROUNDS; i++) {
+        TableBackendEnumerate(Backend, TABLE_BACKEND_ALL, CountRows, &Rows);
+    }
+    QueryPerformanceCounter(&End);
+
+    Seconds = (double)(End.QuadPart - Start.QuadPart) / (double)Frequency.QuadPart / BACKEND_BENCH_ROUNDS;
+    TableBackendGetInformation(Backend, &Information);
+    printf("iphelper %llu rows: %.3f ms/enumeration (%.1f ns/row), %Iu bytes\n",
+           Rows / BACKEND_BENCH_ROUNDS,
+           Seconds * 1e3,
+           Rows ? Seconds * 1e9 * BACKEND_BENCH_ROUNDS / (double)Rows : 0.0,
+           Information.Bytes);
+
+Cleanup:
+    TableBackendDestroy(Backend);
+    if (INVALID_SOCKET != Udp) {
+        closesocket(Udp);
+    }
+
+    if (INVALID_SOCKET != Listen) {
+        closesocket(Listen);
+    }
+
+    WSACleanup();
+    printf("%s\n", Ok ? "ok" : "FAILED");
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+int _cdecl main()
+{
+    TableBackendBenchmark();
+
+    return 0;
+}
@@ -0,0 +1,338 @@
+﻿/*
+Linux的取连接表的后端（TableBackendLinux.cpp）的验证和性能测试：NETLINK_SOCK_DIAG和/proc/net的比较。
+
+Linux上单独编译运行（Windows的见TableBackendBenchmark.cpp）：
+g++ -std=c++17 -O2 -I../libnet TableBackendLinuxBenchmark.cpp ../libnet/OwnerCache.cpp
+
+直接包含TableBackendLinux.cpp，要用它里面的BuildIndex（static的）。
+*/
+
+
+#include "TableBackendLinux.cpp"
+
+#include <sys/resource.h>
+#include <time.h>
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#define BACKEND_BENCH_CONNECTIONS 2000 //本机的TCP连接（各两行）。
+#define BACKEND_BENCH_UDP         16
+#define BACKEND_BENCH_ROUNDS      20
+
+
+//测试建的socket。
+typedef struct _BACKEND_BENCH_SOCKETS {
+    int Listen;
+    USHORT ListenPort;
+    USHORT UdpPort;     //第一个UDP的。
+    ULONG Connections;
+    ULONG Udp;
+    int Fds[2 * BACKEND_BENCH_CONNECTIONS + BACKEND_BENCH_UDP];
+    ULONG Count;
+} BACKEND_BENCH_SOCKETS, * PBACKEND_BENCH_SOCKETS;
+
+
+//回调里核对测试建的socket。
+typedef struct _BACKEND_BENCH_CHECK {
+    const BACKEND_BENCH_SOCKETS * Sockets;
+    ULONG Pid;
+    UINT64 Rows;
+    ULONG Listen;      // ListenPort的，LISTEN的，PID对的。
+    ULONG Established; //本地或远程是ListenPort的，ESTAB的，PID对的。
+    ULONG Udp;         //测试的UDP的端口范围里的，PID对的。
+} BACKEND_BENCH_CHECK, * PBACKEND_BENCH_CHECK;
+
+
+static USHORT GetLocalPort(_In_ int Fd)
+{
+    struct sockaddr_in Address;
+    socklen_t Length = sizeof(Address);
+
+    if (0 != getsockname(Fd, (struct sockaddr *)&Address, &Length)) {
+        return 0;
+    }
+
+    return ntohs(Address.sin_port);
+}
+
+
+static void CloseSockets(_Inout_ PBACKEND_BENCH_SOCKETS Sockets)
+{
+    for (ULONG i = 0; i < Sockets->Count; i++) {
+        close(Sockets->Fds[i]);
+    }
+
+    if (Sockets->Listen >= 0) {
+        close(Sockets->Listen);
+    }
+
+    Sockets->Count = 0;
+    Sockets->Listen = -1;
+}
+
+
+static BOOL OpenSockets(_Out_ PBACKEND_BENCH_SOCKETS Sockets)
+/*
+功能：在127.0.0.1上建一个侦听，BACKEND_BENCH_CONNECTIONS个连接和BACKEND_BENCH_UDP个绑定的UDP（端口连续的）。
+
+文件描述符不够的少建一些连接。
+*/
+{
+    struct sockaddr_in Address;
+    struct rlimit Limit;
+
+    memset(Sockets, 0, sizeof(BACKEND_BENCH_SOCKETS));
+    memset(&Address, 0, sizeof(Address));
+    Address.sin_family = AF_INET;
+    Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (0 == getrlimit(RLIMIT_NOFILE, &Limit) && Limit.rlim_cur < Limit.rlim_max) {
+        Limit.rlim_cur = Limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &Limit);
+    }
+
+    Sockets->Listen = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (Sockets->Listen < 0 || 0 != bind(Sockets->Listen, (struct sockaddr *)&Address, sizeof(Address)) ||
+        0 != listen(Sockets->Listen, SOMAXCONN)) {
+        CloseSockets(Sockets);
+        return FALSE;
+    }
+
+    Sockets->ListenPort = GetLocalPort(Sockets->Listen);
+    Address.sin_port = htons(Sockets->ListenPort);
+
+    for (ULONG i = 0; i < BACKEND_BENCH_CONNECTIONS; i++) {
+        int Client = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (Client < 0) {
+            break;
+        }
+
+        if (0 != connect(Client, (struct sockaddr *)&Address, sizeof(Address))) {
+            close(Client);
+            break;
+        }
+
+        int Server = accept4(Sockets->Listen, nullptr, nullptr, SOCK_CLOEXEC);
+        if (Server < 0) {
+            close(Client);
+            break;
+        }
+
+        Sockets->Fds[Sockets->Count++] = Client;
+        Sockets->Fds[Sockets->Count++] = Server;
+        Sockets->Connections++;
+    }
+
+    //端口连续的UDP，从一个随机的开始，冲突的跳过。
+    Address.sin_port = 0;
+    int First = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (First < 0 || 0 != bind(First, (struct sockaddr *)&Address, sizeof(Address))) {
+        if (First >= 0) {
+            close(First);
+        }
+
+        CloseSockets(Sockets);
+        return FALSE;
+    }
+
+    Sockets->Fds[Sockets->Count++] = First;
+    Sockets->UdpPort = GetLocalPort(First);
+    Sockets->Udp = 1;
+    for (ULONG i = 1; i < BACKEND_BENCH_UDP && Sockets->UdpPort + i <= 0xFFFF; i++) {
+        int Udp = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (Udp < 0) {
+            break;
+        }
+
+        Address.sin_port = htons((USHORT)(Sockets->UdpPort + i));
+        if (0 != bind(Udp, (struct sockaddr *)&Address, sizeof(Address))) {
+            close(Udp);
+            continue;
+        }
+
+        Sockets->Fds[Sockets->Count++] = Udp;
+        Sockets->Udp++;
+    }
+
+    return Sockets->Connections > 0;
+}
+
+
+static ULONG WINAPI CheckRows(_In_opt_ PVOID Context,
+                              _In_reads_(Count) const TABLE_BACKEND_ROW * Rows,
+                              _In_ ULONG Count)
+{
+    PBACKEND_BENCH_CHECK Check = reinterpret_cast<PBACKEND_BENCH_CHECK>(Context);
+    const BACKEND_BENCH_SOCKETS * Sockets = Check->Sockets;
+    const UINT8 Loopback[4] = {127, 0, 0, 1};
+
+    for (ULONG i = 0; i < Count; i++) {
+        const TABLE_BACKEND_ROW * Row = &Rows[i];
+        if (AF_INET != Row->Family || Row->OwningPid != Check->Pid ||
+            0 != memcmp(Row->LocalAddress, Loopback, sizeof(Loopback))) {
+            continue;
+        }
+
+        if (IPPROTO_UDP == Row->Protocol) {
+            Check->Udp += Row->LocalPort >= Sockets->UdpPort &&
+                          Row->LocalPort < Sockets->UdpPort + BACKEND_BENCH_UDP;
+        } else if (MIB_TCP_STATE_LISTEN == Row->State) {
+            Check->Listen += Row->LocalPort == Sockets->ListenPort;
+        } else if (MIB_TCP_STATE_ESTAB == Row->State) {
+            Check->Established += Row->LocalPort == Sockets->ListenPort || Row->RemotePort == Sockets->ListenPort;
+        }
+    }
+
+    Check->Rows += Count;
+    return ERROR_SUCCESS;
+}
+
+
+static ULONG WINAPI CountRows(_In_opt_ PVOID Context,
+                              _In_reads_(Count) const TABLE_BACKEND_ROW * Rows,
+                              _In_ ULONG Count)
+{
+    UNREFERENCED_PARAMETER(Rows);
+
+    *reinterpret_cast<PUINT64>(Context) += Count;
+    return ERROR_SUCCESS;
+}
+
+
+static BOOL VerifyBackend(_In_ ULONG Type, _In_ const BACKEND_BENCH_SOCKETS * Sockets)
+/*
+功能：测试建的socket都找到了，状态和PID都对。
+*/
+{
+    PTABLE_BACKEND Backend = nullptr;
+    BACKEND_BENCH_CHECK Check;
+
+    memset(&Check, 0, sizeof(Check));
+    Check.Sockets = Sockets;
+    Check.Pid = (ULONG)getpid();
+
+    if (ERROR_SUCCESS != TableBackendCreate(Type, 0, &Backend)) {
+        return FALSE;
+    }
+
+    ULONG Status = TableBackendEnumerate(Backend, TABLE_BACKEND_ALL, CheckRows, &Check);
+    TableBackendDestroy(Backend);
+
+    return ERROR_SUCCESS == Status && 1 == Check.Listen && 2 * Sockets->Connections == Check.Established &&
+           Sockets->Udp == Check.Udp;
+}
+
+
+static double ElapsedSeconds(_In_ const struct timespec * Start)
+{
+    struct timespec End;
+
+    clock_gettime(CLOCK_MONOTONIC, &End);
+    return (double)(End.tv_sec - Start->tv_sec) + (double)(End.tv_nsec - Start->tv_nsec) / 1e9;
+}
+
+
+static void MeasureBackend(_In_ PCSTR Name, _In_ ULONG Type, _In_ ULONG Flags)
+{
+    PTABLE_BACKEND Backend = nullptr;
+    TABLE_BACKEND_INFORMATION Information;
+    UINT64 Rows = 0;
+    struct timespec Start;
+
+    if (ERROR_SUCCESS != TableBackendCreate(Type, Flags, &Backend)) {
+        printf("%s: not supported\n", Name);
+        return;
+    }
+
+    TableBackendEnumerate(Backend, TABLE_BACKEND_ALL, CountRows, &Rows); //预热，建好索引。
+
+    Rows = 0;
+    clock_gettime(CLOCK_MONOTONIC, &Start);
+    for (ULONG i = 0; i < BACKEND_BENCH_ROUNDS; i++) {
+        TableBackendEnumerate(Backend, TABLE_BACKEND_ALL, CountRows, &Rows);
+    }
+
+    double Seconds = ElapsedSeconds(&Start) / BACKEND_BENCH_ROUNDS;
+    TableBackendGetInformation(Backend, &Information);
+    printf("%-16s %llu rows: %.3f ms/enumeration (%.1f ns/row), index builds %u, fallbacks %u\n",
+           Name,
+           (unsigned long long)(Rows / BACKEND_BENCH_ROUNDS),
+           Seconds * 1e3,
+           Rows ? Seconds * 1e9 * BACKEND_BENCH_ROUNDS / (double)Rows : 0.0,
+           Information.IndexBuilds,
+           Information.Fallbacks);
+
+    TableBackendDestroy(Backend);
+}
+
+
+static void MeasureIndex()
+/*
+功能：一次完整的inode到PID的索引的重建（遍历所有进程的/proc/[pid]/fd）的耗时。
+*/
+{
+    PTABLE_BACKEND Backend = nullptr;
+    struct timespec Start;
+
+    if (ERROR_SUCCESS != TableBackendCreate(TABLE_BACKEND_NETLINK, 0, &Backend)) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &Start);
+    for (ULONG i = 0; i < BACKEND_BENCH_ROUNDS; i++) {
+        BuildIndex(Backend);
+    }
+
+    printf("index build: %.3f ms (%u sockets)\n",
+           ElapsedSeconds(&Start) / BACKEND_BENCH_ROUNDS * 1e3,
+           Backend->IndexCount);
+
+    TableBackendDestroy(Backend);
+}
+
+
+static void TableBackendBenchmark()
+/*
+功能：NETLINK_SOCK_DIAG和/proc/net的正确性和性能的比较。
+
+先在本机建BACKEND_BENCH_CONNECTIONS个TCP连接和几个UDP，两个后端都要找到它们（状态，端口，PID），
+然后比较取整个表（找和不找进程）的耗时，以及重建inode索引的耗时。
+*/
+{
+    BACKEND_BENCH_SOCKETS Sockets;
+
+    if (!OpenSockets(&Sockets)) {
+        printf("open sockets failed, errno %d\nFAILED\n", errno);
+        return;
+    }
+
+    BOOL Netlink = VerifyBackend(TABLE_BACKEND_NETLINK, &Sockets);
+    BOOL Procfs = VerifyBackend(TABLE_BACKEND_PROCFS, &Sockets);
+    printf("verify (%u connections, %u udp): netlink %s, procfs %s\n",
+           Sockets.Connections,
+           Sockets.Udp,
+           Netlink ? "ok" : "FAILED",
+           Procfs ? "ok" : "FAILED");
+
+    MeasureBackend("netlink", TABLE_BACKEND_NETLINK, 0);
+    MeasureBackend("procfs", TABLE_BACKEND_PROCFS, 0);
+    MeasureBackend("netlink no pids", TABLE_BACKEND_NETLINK, TABLE_BACKEND_NO_PIDS);
+    MeasureBackend("procfs no pids", TABLE_BACKEND_PROCFS, TABLE_BACKEND_NO_PIDS);
+    MeasureIndex();
+
+    CloseSockets(&Sockets);
+    printf("%s\n", Netlink && Procfs ? "ok" : "FAILED");
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+int main()
+{
+    TableBackendBenchmark();
+
+    return 0;
+}
@@ -0,0 +1,607 @@
+﻿/*
+连接表的按列的过滤和统计（TableColumns.cpp）的验证和基准测试。
+
+Windows上单独编译运行（不在test.vcxproj的生成里），VS的开发人员命令提示符下：
+cl /std:c++17 /O2 /EHsc /DUNICODE /D_UNICODE /wd4819 TableColumnsBenchmark.cpp ..\libnet\TableSnapshot.cpp
+
+直接包含TableColumns.cpp，要逐个验证它里面的各个实现（ScalarKernels，Sse2Kernels，Avx2Kernels，static的）。
+*/
+
+
+#include "..\libnet\TableColumns.cpp"
+#include "..\libnet\SplitMix64.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#define COLUMNS_BENCH_ROWS4   700000
+#define COLUMNS_BENCH_ROWS6   300001 //不是64的倍数，最后一块是不满的。
+#define COLUMNS_BENCH_PIDS    300
+#define COLUMNS_BENCH_REMOTES 5000
+#define COLUMNS_BENCH_TOP     10
+#define COLUMNS_BENCH_ROUNDS  10
+
+
+typedef struct _COLUMNS_BENCH_TABLES {
+    PMIB_TCPTABLE_OWNER_PID Table4;
+    PMIB_TCP6TABLE_OWNER_MODULE Table6;
+} COLUMNS_BENCH_TABLES, * PCOLUMNS_BENCH_TABLES;
+
+
+static ULONG Skewed(_Inout_ PUINT64 Seed, _In_ ULONG Range)
+/*
+功能：[0, Range)里偏向小的数的随机数，模拟少数进程（地址）占大部分连接。
+*/
+{
+    UINT64 r = SplitMix64(Seed) % Range;
+    return (ULONG)(r * r / Range);
+}
+
+
+static DWORD RandomState(_Inout_ PUINT64 Seed)
+{
+    ULONG r = (ULONG)(SplitMix64(Seed) % 100);
+
+    if (r < 60) {
+        return MIB_TCP_STATE_ESTAB;
+    }
+
+    if (r < 75) {
+        return MIB_TCP_STATE_TIME_WAIT;
+    }
+
+    if (r < 85) {
+        return MIB_TCP_STATE_LISTEN;
+    }
+
+    return MIB_TCP_STATE_CLOSED + (DWORD)(SplitMix64(Seed) % MIB_TCP_STATE_DELETE_TCB);
+}
+
+
+static USHORT RandomPort(_Inout_ PUINT64 Seed)
+{
+    const USHORT Ports[] = {443, 80, 22, 3389, 53};
+    UINT64 r = SplitMix64(Seed);
+
+    return (r & 3) ? Ports[(r >> 2) % _countof(Ports)] : (USHORT)(1024 + (r >> 8) % 60000);
+}
+
+
+static void FreeTables(_Inout_ PCOLUMNS_BENCH_TABLES Tables)
+{
+    if (Tables->Table4) {
+        FREE(Tables->Table4);
+    }
+
+    if (Tables->Table6) {
+        FREE(Tables->Table6);
+    }
+
+    RtlZeroMemory(Tables, sizeof(COLUMNS_BENCH_TABLES));
+}
+
+
+static BOOL MakeTables(_Out_ PCOLUMNS_BENCH_TABLES Tables,
+                       _In_ ULONG Rows4,
+                       _In_ ULONG Rows6,
+                       _Inout_ PUINT64 Seed)
+/*
+功能：构造GetExtendedTcpTable的IPv4的（OWNER_PID）和IPv6的（OWNER_MODULE）的表。侦听的没有远程地址和端口。
+*/
+{
+    RtlZeroMemory(Tables, sizeof(COLUMNS_BENCH_TABLES));
+
+    SIZE_T Size4 = FIELD_OFFSET(MIB_TCPTABLE_OWNER_PID, table) +
+                   (SIZE_T)max(Rows4, 1UL) * sizeof(MIB_TCPROW_OWNER_PID);
+    SIZE_T Size6 = FIELD_OFFSET(MIB_TCP6TABLE_OWNER_MODULE, table) +
+                   (SIZE_T)max(Rows6, 1UL) * sizeof(MIB_TCP6ROW_OWNER_MODULE);
+
+    Tables->Table4 = reinterpret_cast<PMIB_TCPTABLE_OWNER_PID>(MALLOC(Size4));
+    Tables->Table6 = reinterpret_cast<PMIB_TCP6TABLE_OWNER_MODULE>(MALLOC(Size6));
+    if (nullptr == Tables->Table4 || nullptr == Tables->Table6) {
+        FreeTables(Tables);
+        return FALSE;
+    }
+
+    Tables->Table4->dwNumEntries = Rows4;
+    for (ULONG i = 0; i < Rows4; i++) {
+        PMIB_TCPROW_OWNER_PID Row = &Tables->Table4->table[i];
+
+        Row->dwState = RandomState(Seed);
+        Row->dwLocalAddr = htonl(0xC0A80001 + (ULONG)(SplitMix64(Seed) % 4));
+        Row->dwLocalPort = htons(RandomPort(Seed));
+        Row->dwOwningPid = 4 * (Skewed(Seed, COLUMNS_BENCH_PIDS) + 1);
+        if (MIB_TCP_STATE_LISTEN != Row->dwState) {
+            Row->dwRemoteAddr = htonl(0x0A000000 + Skewed(Seed, COLUMNS_BENCH_REMOTES));
+            Row->dwRemotePort = htons(RandomPort(Seed));
+        }
+    }
+
+    Tables->Table6->dwNumEntries = Rows6;
+    for (ULONG i = 0; i < Rows6; i++) {
+        PMIB_TCP6ROW_OWNER_MODULE Row = &Tables->Table6->table[i];
+        ULONG Remote = Skewed(Seed, COLUMNS_BENCH_REMOTES);
+
+        Row->dwState = RandomState(Seed);
+        Row->ucLocalAddr[0] = 0xfe;
+        Row->ucLocalAddr[1] = 0x80;
+        Row->ucLocalAddr[15] = (UCHAR)(1 + SplitMix64(Seed) % 4);
+        Row->dwLocalPort = htons(RandomPort(Seed));
+        Row->dwOwningPid = 4 * (Skewed(Seed, COLUMNS_BENCH_PIDS) + 1);
+        if (MIB_TCP_STATE_LISTEN != Row->dwState) {
+            Row->ucRemoteAddr[0] = 0x20;
+            Row->ucRemoteAddr[1] = 0x01;
+            Row->ucRemoteAddr[2] = 0x0d;
+            Row->ucRemoteAddr[3] = 0xb8;
+            Row->ucRemoteAddr[14] = (UCHAR)(Remote >> 8);
+            Row->ucRemoteAddr[15] = (UCHAR)Remote;
+            Row->dwRemotePort = htons(RandomPort(Seed));
+        }
+    }
+
+    return TRUE;
+}
+
+
+static BOOL RowMatches(_In_ const TABLE_COLUMNS_FILTER * Filter,
+                       _In_ UINT8 Family,
+                       _In_ DWORD State,
+                       _In_ DWORD LocalPort,
+                       _In_ DWORD RemotePort,
+                       _In_ DWORD Pid)
+/*
+功能：按行（原来的表）判断过滤的条件，作为参照。都是TCP的。
+*/
+{
+    UINT8 Column = GetState(State);
+
+    return (!(Filter->Flags & TABLE_COLUMNS_MATCH_FAMILY) || Filter->Family == Family) &&
+           (!(Filter->Flags & TABLE_COLUMNS_MATCH_PROTOCOL) || Filter->Protocol == IPPROTO_TCP) &&
+           (!(Filter->Flags & TABLE_COLUMNS_MATCH_STATES) || (Filter->States & (1UL << Column))) &&
+           (!(Filter->Flags & TABLE_COLUMNS_MATCH_LOCAL_PORT) || Filter->LocalPort == ntohs((USHORT)LocalPort)) &&
+           (!(Filter->Flags & TABLE_COLUMNS_MATCH_REMOTE_PORT) ||
+            Filter->RemotePort == ntohs((USHORT)RemotePort)) &&
+           (!(Filter->Flags & TABLE_COLUMNS_MATCH_PID) || Filter->Pid == Pid);
+}
+
+
+static ULONG RowsCountByState(_In_ const COLUMNS_BENCH_TABLES * Tables,
+                              _In_ const TABLE_COLUMNS_FILTER * Filter,
+                              _Out_writes_(TABLE_COLUMNS_STATES) PULONG Counts)
+/*
+功能：按行（原来的表，AoS）过滤并按状态计数，返回选中的行数。作为参照，也用来对比时间。
+*/
+{
+    ULONG Matched = 0;
+
+    RtlZeroMemory(Counts, TABLE_COLUMNS_STATES * sizeof(ULONG));
+
+    for (ULONG i = 0; i < Tables->Table4->dwNumEntries; i++) {
+        const MIB_TCPROW_OWNER_PID * Row = &Tables->Table4->table[i];
+        if (RowMatches(Filter, AF_INET, Row->dwState, Row->dwLocalPort, Row->dwRemotePort, Row->dwOwningPid)) {
+            Counts[GetState(Row->dwState)]++;
+            Matched++;
+        }
+    }
+
+    for (ULONG i = 0; i < Tables->Table6->dwNumEntries; i++) {
+        const MIB_TCP6ROW_OWNER_MODULE * Row = &Tables->Table6->table[i];
+        if (RowMatches(Filter, AF_INET6, Row->dwState, Row->dwLocalPort, Row->dwRemotePort, Row->dwOwningPid)) {
+            Counts[GetState(Row->dwState)]++;
+            Matched++;
+        }
+    }
+
+    return Matched;
+}
+
+
+static int __cdecl CompareKey(_In_ const void * A, _In_ const void * B)
+{
+    return memcmp(A, B, 2 * sizeof(UINT64));
+}
+
+
+static PGROUP_ENTRY RowsGroup(_In_ const COLUMNS_BENCH_TABLES * Tables,
+                              _In_ const TABLE_COLUMNS_FILTER * Filter,
+                              _In_ BOOL ByAddress,
+                              _Out_ PULONG Groups)
+/*
+功能：按行过滤，排序后数相同的键，得到全部的分组（按排名排序）。作为分组的参照，调用者用FREE释放。
+*/
+{
+    ULONG Total = Tables->Table4->dwNumEntries + Tables->Table6->dwNumEntries;
+    PGROUP_ENTRY Keys = reinterpret_cast<PGROUP_ENTRY>(MALLOC((SIZE_T)max(Total, 1UL) * sizeof(GROUP_ENTRY)));
+    ULONG n = 0;
+
+    *Groups = 0;
+    if (nullptr == Keys) {
+        return nullptr;
+    }
+
+    for (ULONG i = 0; i < Tables->Table4->dwNumEntries; i++) {
+        const MIB_TCPROW_OWNER_PID * Row = &Tables->Table4->table[i];
+        if (RowMatches(Filter, AF_INET, Row->dwState, Row->dwLocalPort, Row->dwRemotePort, Row->dwOwningPid)) {
+            if (ByAddress) {
+                MapAddress4(Row->dwRemoteAddr, reinterpret_cast<PIN6_ADDR>(Keys[n].Key));
+            } else {
+                Keys[n].Key[0] = Row->dwOwningPid;
+            }
+
+            n++;
+        }
+    }
+
+    for (ULONG i = 0; i < Tables->Table6->dwNumEntries; i++) {
+        const MIB_TCP6ROW_OWNER_MODULE * Row = &Tables->Table6->table[i];
+        if (RowMatches(Filter, AF_INET6, Row->dwState, Row->dwLocalPort, Row->dwRemotePort, Row->dwOwningPid)) {
+            if (ByAddress) {
+                RtlCopyMemory(Keys[n].Key, Row->ucRemoteAddr, sizeof(IN6_ADDR));
+            } else {
+                Keys[n].Key[0] = Row->dwOwningPid;
+            }
+
+            n++;
+        }
+    }
+
+    qsort(Keys, n, sizeof(GROUP_ENTRY), CompareKey);
+
+    ULONG Runs = 0;
+    for (ULONG i = 0; i < n;) {
+        ULONG End = i + 1;
+        while (End < n && 0 == CompareKey(&Keys[End], &Keys[i])) {
+            End++;
+        }
+
+        Keys[Runs] = Keys[i];
+        Keys[Runs++].Count = End - i;
+        i = End;
+    }
+
+    qsort(Keys, Runs, sizeof(GROUP_ENTRY), ByAddress ? CompareAddressGroup : ComparePidGroup);
+    *Groups = Runs;
+    return Keys;
+}
+
+
+static BOOL VerifyAppend()
+/*
+功能：快照（UDP，IPv4和IPv6混合）的追加，地址的映射，缓冲区增大时保留原有的行。
+*/
+{
+    TABLE_COLUMNS Columns;
+    TABLE_SNAPSHOT Udp6{};
+    UINT64 Seed = 23;
+    COLUMNS_BENCH_TABLES Tables{};
+    BOOL Ok = FALSE;
+
+    TableColumnsInit(&Columns);
+    TableSnapshotInit(&Udp6, TABLE_SNAPSHOT_UDP_EXTENDED, AF_INET6, UDP_TABLE_OWNER_PID, FALSE);
+    if (!MakeTables(&Tables, 1000, 3, &Seed) || ERROR_SUCCESS != TableSnapshotReserve(&Udp6, 2)) {
+        goto Cleanup;
+    }
+
+    //不调用API，直接填写快照。
+    RtlZeroMemory(Udp6.Buffer, Udp6.Capacity);
+    reinterpret_cast<PMIB_UDP6TABLE_OWNER_PID>(Udp6.Buffer)->dwNumEntries = 2;
+    Udp6.Rows = reinterpret_cast<PMIB_UDP6TABLE_OWNER_PID>(Udp6.Buffer)->table;
+    Udp6.RowSize = sizeof(MIB_UDP6ROW_OWNER_PID);
+    Udp6.Count = 2;
+    for (ULONG i = 0; i < 2; i++) {
+        auto Row = &reinterpret_cast<PMIB_UDP6ROW_OWNER_PID>(Udp6.Rows)[i];
+        Row->ucLocalAddr[15] = 1;
+        Row->dwLocalPort = htons(5353);
+        Row->dwOwningPid = 100 + i;
+    }
+
+    if (ERROR_SUCCESS != TableColumnsAppend(&Columns, &Udp6) ||
+        ERROR_SUCCESS != TableColumnsAppendTcp4(&Columns, Tables.Table4) ||
+        ERROR_SUCCESS != TableColumnsAppendTcp6(&Columns, Tables.Table6) || Columns.Count != 1005 ||
+        Columns.Grows != 1) {
+        goto Cleanup;
+    }
+
+    //再追加，超过第一次申请的1024行。
+    if (ERROR_SUCCESS != TableColumnsAppendTcp4(&Columns, Tables.Table4) || Columns.Count != 2005 ||
+        Columns.Grows != 2 || Columns.Capacity % TABLE_COLUMNS_BLOCK) {
+        goto Cleanup;
+    }
+
+    {
+        const MIB_TCPROW_OWNER_PID * Tcp4 = &Tables.Table4->table[7];
+        const MIB_TCP6ROW_OWNER_MODULE * Tcp6 = &Tables.Table6->table[2];
+        IN6_ADDR Mapped;
+        MapAddress4(Tcp4->dwRemoteAddr, &Mapped);
+
+        Ok = Columns.Protocol[1] == IPPROTO_UDP && Columns.Family[1] == AF_INET6 && Columns.State[1] == 0 &&
+             Columns.LocalPort[1] == 5353 && Columns.Pid[1] == 101 && Columns.LocalAddress[1].u.Byte[15] == 1 &&
+             Columns.Family[2 + 7] == AF_INET && Columns.Pid[2 + 7] == Tcp4->dwOwningPid &&
+             Columns.State[2 + 7] == Tcp4->dwState &&
+             Columns.RemotePort[2 + 7] == ntohs((USHORT)Tcp4->dwRemotePort) &&
+             0 == memcmp(&Columns.RemoteAddress[2 + 7], &Mapped, sizeof(IN6_ADDR)) &&
+             0 == memcmp(&Columns.RemoteAddress[1005 + 7], &Mapped, sizeof(IN6_ADDR)) &&
+             Columns.Family[1002 + 2] == AF_INET6 && Columns.Pid[1002 + 2] == Tcp6->dwOwningPid &&
+             0 == memcmp(&Columns.RemoteAddress[1002 + 2], Tcp6->ucRemoteAddr, sizeof(IN6_ADDR));
+    }
+
+Cleanup:
+    TableColumnsFree(&Columns);
+    TableSnapshotFree(&Udp6);
+    FreeTables(&Tables);
+    return Ok;
+}
+
+
+static BOOL VerifyKernels(_In_ const COLUMN_KERNELS * Kernels,
+                          _In_ const TABLE_COLUMNS * Columns,
+                          _In_ const COLUMNS_BENCH_TABLES * Tables,
+                          _In_reads_(Filters) const TABLE_COLUMNS_FILTER * Filter,
+                          _In_ ULONG Filters,
+                          _Out_writes_(TABLE_COLUMNS_SELECTION_WORDS(Columns->Count)) PUINT64 Selection)
+/*
+功能：一组内核的过滤和按状态计数的结果和按行的参照一致。
+*/
+{
+    ULONG Counts[TABLE_COLUMNS_STATES];
+    ULONG Expected[TABLE_COLUMNS_STATES];
+
+    CountRowsByState(Kernels, Columns, nullptr, Counts);
+    RowsCountByState(Tables, &Filter[0], Expected);
+    if (0 != memcmp(Counts, Expected, sizeof(Counts))) {
+        return FALSE;
+    }
+
+    for (ULONG i = 0; i < Filters; i++) {
+        ULONG Matched = FilterRows(Kernels, Columns, &Filter[i], Selection);
+        if (Matched != RowsCountByState(Tables, &Filter[i], Expected)) {
+            return FALSE;
+        }
+
+        CountRowsByState(Kernels, Columns, Selection, Counts);
+        if (0 != memcmp(Counts, Expected, sizeof(Counts))) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+static BOOL VerifyTop(_Inout_ PTABLE_COLUMNS Columns,
+                      _In_ const COLUMNS_BENCH_TABLES * Tables,
+                      _In_ const TABLE_COLUMNS_FILTER * Filter,
+                      _In_ BOOL ByAddress,
+                      _Out_writes_(TABLE_COLUMNS_SELECTION_WORDS(Columns->Count)) PUINT64 Selection)
+/*
+功能：前COLUMNS_BENCH_TOP个（和全部的）分组和按行排序的参照一致。
+*/
+{
+    TABLE_COLUMNS_PID_COUNT Pids[COLUMNS_BENCH_TOP];
+    TABLE_COLUMNS_ADDRESS_COUNT Addresses[COLUMNS_BENCH_TOP];
+    ULONG Returned = 0;
+    ULONG Groups = 0;
+    ULONG ExpectedGroups = 0;
+    BOOL Ok = TRUE;
+
+    PGROUP_ENTRY Expected = RowsGroup(Tables, Filter, ByAddress, &ExpectedGroups);
+    if (nullptr == Expected) {
+        return FALSE;
+    }
+
+    TableColumnsFilter(Columns, Filter, Selection);
+    ULONG Status = ERROR_SUCCESS;
+    if (ByAddress) {
+        Status =
+            TableColumnsTopRemoteAddresses(Columns, Selection, COLUMNS_BENCH_TOP, Addresses, &Returned, &Groups);
+    } else {
+        Status = TableColumnsTopPids(Columns, Selection, COLUMNS_BENCH_TOP, Pids, &Returned, &Groups);
+    }
+
+    if (ERROR_SUCCESS != Status || Groups != ExpectedGroups ||
+        Returned != min(ExpectedGroups, COLUMNS_BENCH_TOP)) {
+        Ok = FALSE;
+    }
+
+    for (ULONG i = 0; Ok && i < Returned; i++) {
+        if (ByAddress) {
+            Ok = Addresses[i].Count == Expected[i].Count &&
+                 0 == memcmp(&Addresses[i].Address, Expected[i].Key, sizeof(IN6_ADDR));
+        } else {
+            Ok = Pids[i].Count == Expected[i].Count && Pids[i].Pid == Expected[i].Key[0];
+        }
+    }
+
+    FREE(Expected);
+    return Ok;
+}
+
+
+static double ElapsedSeconds(_In_ const LARGE_INTEGER * Start)
+{
+    LARGE_INTEGER Frequency{};
+    LARGE_INTEGER End{};
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&End);
+    return (double)(End.QuadPart - Start->QuadPart) / Frequency.QuadPart;
+}
+
+
+static void TableColumnsBenchmark()
+/*
+功能：列式的连接表的验证和基准测试。
+
+1.验证：追加（快照，IPv4和IPv6的表），各组内核（标量，SSE2，AVX2）的过滤和按状态计数，前N个PID和远程地址。
+2.约100万行（70%是IPv4的MIB_TCPROW_OWNER_PID，30%是IPv6的MIB_TCP6ROW_OWNER_MODULE）：
+  构建的时间；按行（AoS）和按列的过滤加按状态计数的时间；前N个的分组的时间。
+*/
+{
+    ULONG Errors = 0;
+    UINT64 Seed = 23;
+    TABLE_COLUMNS Columns;
+    COLUMNS_BENCH_TABLES Tables{};
+    PUINT64 Selection = nullptr;
+    LARGE_INTEGER Start{};
+    const COLUMN_KERNELS * KernelSets[] = {
+        &ScalarKernels,
+#if defined(_M_IX86) || defined(_M_X64)
+        &Sse2Kernels,
+        IsAvx2Supported() ? &Avx2Kernels : nullptr,
+#endif
+    };
+    TABLE_COLUMNS_FILTER Filters[6] = {};
+    const ULONG Rows = COLUMNS_BENCH_ROWS4 + COLUMNS_BENCH_ROWS6;
+
+    //0：全部；1：已建立的；2：443的侦听和TIME_WAIT；3：一个进程的IPv6的；4：连到443的已建立的TCP；5：没有的PID。
+    Filters[1].Flags = TABLE_COLUMNS_MATCH_STATES;
+    Filters[1].States = 1UL << MIB_TCP_STATE_ESTAB;
+    Filters[2].Flags = TABLE_COLUMNS_MATCH_STATES | TABLE_COLUMNS_MATCH_LOCAL_PORT;
+    Filters[2].States = (1UL << MIB_TCP_STATE_LISTEN) | (1UL << MIB_TCP_STATE_TIME_WAIT);
+    Filters[2].LocalPort = 443;
+    Filters[3].Flags = TABLE_COLUMNS_MATCH_PID | TABLE_COLUMNS_MATCH_FAMILY;
+    Filters[3].Pid = 8;
+    Filters[3].Family = AF_INET6;
+    Filters[4].Flags = TABLE_COLUMNS_MATCH_STATES | TABLE_COLUMNS_MATCH_REMOTE_PORT | TABLE_COLUMNS_MATCH_PROTOCOL;
+    Filters[4].States = 1UL << MIB_TCP_STATE_ESTAB;
+    Filters[4].RemotePort = 443;
+    Filters[4].Protocol = IPPROTO_TCP;
+    Filters[5].Flags = TABLE_COLUMNS_MATCH_PID;
+    Filters[5].Pid = 3;
+
+    TableColumnsInit(&Columns);
+
+    BOOL Append = VerifyAppend();
+    Errors += Append ? 0 : 1;
+    printf("verify: append %s", Append ? "ok" : "FAILED");
+
+    Selection = reinterpret_cast<PUINT64>(MALLOC(TABLE_COLUMNS_SELECTION_WORDS(Rows) * sizeof(UINT64)));
+    if (nullptr == Selection || !MakeTables(&Tables, COLUMNS_BENCH_ROWS4, COLUMNS_BENCH_ROWS6, &Seed) ||
+        ERROR_SUCCESS != TableColumnsAppendTcp4(&Columns, Tables.Table4) ||
+        ERROR_SUCCESS != TableColumnsAppendTcp6(&Columns, Tables.Table6)) {
+        printf("\nLastError:%d\n", GetLastError());
+        Errors++;
+        goto Cleanup;
+    }
+
+    for (ULONG i = 0; i < _countof(KernelSets); i++) {
+        if (KernelSets[i]) {
+            BOOL Ok = VerifyKernels(KernelSets[i], &Columns, &Tables, Filters, _countof(Filters), Selection);
+            Errors += Ok ? 0 : 1;
+            printf(", %s %s", KernelSets[i]->Name, Ok ? "ok" : "FAILED");
+        }
+    }
+
+    {
+        BOOL Pids = VerifyTop(&Columns, &Tables, &Filters[0], FALSE, Selection) &&
+                    VerifyTop(&Columns, &Tables, &Filters[2], FALSE, Selection);
+        BOOL Addresses = VerifyTop(&Columns, &Tables, &Filters[1], TRUE, Selection) &&
+                         VerifyTop(&Columns, &Tables, &Filters[5], TRUE, Selection);
+        Errors += (Pids ? 0 : 1) + (Addresses ? 0 : 1);
+        printf(", top pids %s, top remote addresses %s\n", Pids ? "ok" : "FAILED", Addresses ? "ok" : "FAILED");
+    }
+
+    //构建。
+    QueryPerformanceCounter(&Start);
+    for (int r = 0; r < COLUMNS_BENCH_ROUNDS; r++) {
+        TableColumnsReset(&Columns);
+        TableColumnsAppendTcp4(&Columns, Tables.Table4);
+        TableColumnsAppendTcp6(&Columns, Tables.Table6);
+    }
+    printf("%u rows: build %.2f ns/row, %.1f MB\n",
+           Rows,
+           ElapsedSeconds(&Start) * 1e9 / COLUMNS_BENCH_ROUNDS / Rows,
+           (double)Columns.Capacity * TABLE_COLUMNS_ROW_BYTES / 1048576.0);
+
+    //过滤加按状态计数：按行的，和各组内核。
+    for (ULONG f = 0; f < _countof(Filters); f += 4) {
+        ULONG Counts[TABLE_COLUMNS_STATES];
+        ULONG Expected[TABLE_COLUMNS_STATES];
+        ULONG Matched = 0;
+
+        QueryPerformanceCounter(&Start);
+        for (int r = 0; r < COLUMNS_BENCH_ROUNDS; r++) {
+            Matched = RowsCountByState(&Tables, &Filters[f], Expected);
+        }
+        printf("filter %u + count by state (%u rows): aos %.2f ns/row",
+               f,
+               Matched,
+               ElapsedSeconds(&Start) * 1e9 / COLUMNS_BENCH_ROUNDS / Rows);
+
+        for (ULONG i = 0; i < _countof(KernelSets); i++) {
+            if (nullptr == KernelSets[i]) {
+                continue;
+            }
+
+            QueryPerformanceCounter(&Start);
+            for (int r = 0; r < COLUMNS_BENCH_ROUNDS; r++) {
+                if (Filters[f].Flags) {
+                    FilterRows(KernelSets[i], &Columns, &Filters[f], Selection);
+                }
+
+                CountRowsByState(KernelSets[i], &Columns, Filters[f].Flags ? Selection : nullptr, Counts);
+            }
+            printf(", %s %.2f", KernelSets[i]->Name, ElapsedSeconds(&Start) * 1e9 / COLUMNS_BENCH_ROUNDS / Rows);
+
+            if (0 != memcmp(Counts, Expected, sizeof(Counts))) {
+                Errors++;
+            }
+        }
+
+        printf("\n");
+    }
+
+    //分组。
+    {
+        TABLE_COLUMNS_PID_COUNT Pids[COLUMNS_BENCH_TOP];
+        TABLE_COLUMNS_ADDRESS_COUNT Addresses[COLUMNS_BENCH_TOP];
+        ULONG Returned = 0;
+        ULONG PidGroups = 0;
+        ULONG AddressGroups = 0;
+
+        QueryPerformanceCounter(&Start);
+        for (int r = 0; r < COLUMNS_BENCH_ROUNDS; r++) {
+            TableColumnsTopPids(&Columns, nullptr, COLUMNS_BENCH_TOP, Pids, &Returned, &PidGroups);
+        }
+        double PidSeconds = ElapsedSeconds(&Start) / COLUMNS_BENCH_ROUNDS;
+
+        ULONG Matched = TableColumnsFilter(&Columns, &Filters[1], Selection);
+        QueryPerformanceCounter(&Start);
+        for (int r = 0; r < COLUMNS_BENCH_ROUNDS; r++) {
+            TableColumnsTopRemoteAddresses(
+                &Columns, Selection, COLUMNS_BENCH_TOP, Addresses, &Returned, &AddressGroups);
+        }
+        double AddressSeconds = ElapsedSeconds(&Start) / COLUMNS_BENCH_ROUNDS;
+
+        printf("top %u pids: %.2f ms (%u groups), "
+               "top %u remote addresses of %u established: %.2f ms (%u groups)\n",
+               COLUMNS_BENCH_TOP,
+               PidSeconds * 1e3,
+               PidGroups,
+               COLUMNS_BENCH_TOP,
+               Matched,
+               AddressSeconds * 1e3,
+               AddressGroups);
+    }
+
+Cleanup:
+    if (Selection) {
+        FREE(Selection);
+    }
+
+    TableColumnsFree(&Columns);
+    FreeTables(&Tables);
+    printf("%s\n", Errors ? "FAILED" : "ok");
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+int _cdecl main()
+{
+    TableColumnsBenchmark();
+
+    return 0;
+}
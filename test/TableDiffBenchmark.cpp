@@ -0,0 +1,406 @@
+﻿/*
+连接表的增量（TableDiff.cpp）的验证和基准测试。
+
+Windows上单独编译运行（不在test.vcxproj的生成里），VS的开发人员命令提示符下：
+cl /std:c++17 /O2 /EHsc /DUNICODE /D_UNICODE /wd4819 TableDiffBenchmark.cpp ..\libnet\TableDiff.cpp
+    ..\libnet\TableSnapshot.cpp ..\libnet\pch.cpp
+*/
+
+
+#include "..\libnet\pch.h"
+#include "..\libnet\TableDiff.h"
+#include "..\libnet\SplitMix64.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#define DIFF_BENCH_ROWS 500000
+
+
+static BOOL MakeSnapshot(_Out_ PTABLE_SNAPSHOT Snapshot,
+                         _In_ ULONG Kind,
+                         _In_ ULONG Family,
+                         _In_ ULONG Class,
+                         _In_ ULONG Count)
+/*
+功能：不调用API，直接构造一个能放下Count行的快照（行的内容由调用者填写）。
+*/
+{
+    TableSnapshotInit(Snapshot, Kind, Family, Class, FALSE);
+    if (ERROR_SUCCESS != TableSnapshotReserve(Snapshot, max(Count, 1UL))) {
+        return FALSE;
+    }
+
+    Snapshot->RowSize = 0;
+    switch (Kind) {
+    case TABLE_SNAPSHOT_TCP_EXTENDED:
+        Snapshot->RowSize = AF_INET6 == Family ? sizeof(MIB_TCP6ROW_OWNER_PID) : sizeof(MIB_TCPROW_OWNER_PID);
+        break;
+    case TABLE_SNAPSHOT_UDP_EXTENDED:
+        Snapshot->RowSize = AF_INET6 == Family ? sizeof(MIB_UDP6ROW_OWNER_PID) : sizeof(MIB_UDPROW_OWNER_PID);
+        break;
+    default:
+        _ASSERTE(FALSE);
+        break;
+    }
+
+    RtlZeroMemory(Snapshot->Buffer, Snapshot->Capacity);
+    *reinterpret_cast<PDWORD>(Snapshot->Buffer) = Count;
+
+    ULONG Offset = FIELD_OFFSET(MIB_TCPTABLE_OWNER_PID, table); //这几种表的都一样。
+    Snapshot->Rows = reinterpret_cast<PUCHAR>(Snapshot->Buffer) + Offset;
+    Snapshot->Count = Count;
+    return TRUE;
+}
+
+
+typedef struct _DIFF_COUNTS {
+    ULONG Opened;
+    ULONG Closed;
+    ULONG StateChanged;
+    ULONG PidChanged;
+    ULONG Events;
+} DIFF_COUNTS, * PDIFF_COUNTS;
+
+
+static ULONG WINAPI CountEvents(_In_opt_ PVOID Context,
+                                _In_reads_(Count) const TABLE_DIFF_EVENT * Events,
+                                _In_ ULONG Count)
+{
+    auto Counts = reinterpret_cast<PDIFF_COUNTS>(Context);
+
+    for (ULONG i = 0; i < Count; i++) {
+        Counts->Events++;
+        switch (Events[i].Type) {
+        case TABLE_DIFF_OPENED:
+            Counts->Opened++;
+            break;
+        case TABLE_DIFF_CLOSED:
+            Counts->Closed++;
+            break;
+        default:
+            Counts->StateChanged += (Events[i].Changes & TABLE_DIFF_STATE_CHANGED) ? 1 : 0;
+            Counts->PidChanged += (Events[i].Changes & TABLE_DIFF_PID_CHANGED) ? 1 : 0;
+            break;
+        }
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+static void FillTcp4(_Inout_ PTABLE_SNAPSHOT Snapshot, _Inout_ PUINT64 Seed)
+{
+    auto Rows = reinterpret_cast<PMIB_TCPROW_OWNER_PID>(Snapshot->Rows);
+
+    for (ULONG i = 0; i < Snapshot->Count; i++) {
+        UINT64 r = SplitMix64(Seed);
+        Rows[i].dwState = MIB_TCP_STATE_ESTAB;
+        Rows[i].dwLocalAddr = 0x0100000a;                        // 10.0.0.1
+        Rows[i].dwLocalPort = htons((USHORT)(1024 + i % 60000));
+        Rows[i].dwRemoteAddr = (DWORD)r;
+        Rows[i].dwRemotePort = htons((USHORT)(r >> 32));
+        Rows[i].dwOwningPid = 100 + (ULONG)((r >> 48) % 64);
+    }
+}
+
+
+static void Shuffle(_Inout_ PTABLE_SNAPSHOT Snapshot, _Inout_ PUINT64 Seed)
+{
+    auto Rows = reinterpret_cast<PMIB_TCPROW_OWNER_PID>(Snapshot->Rows);
+
+    for (ULONG i = Snapshot->Count; i > 1; i--) {
+        ULONG j = (ULONG)(SplitMix64(Seed) % i);
+        MIB_TCPROW_OWNER_PID Temp = Rows[i - 1];
+        Rows[i - 1] = Rows[j];
+        Rows[j] = Temp;
+    }
+}
+
+
+static BOOL MakeChurn(_In_ const TABLE_SNAPSHOT * Old,
+                      _Out_ PTABLE_SNAPSHOT New,
+                      _Inout_ PUINT64 Seed,
+                      _Out_ PDIFF_COUNTS Expected)
+/*
+功能：由Old构造New：关闭1%，状态变化1%，PID变化0.1%，打开1%，再打乱顺序。
+*/
+{
+    ULONG Closed = Old->Count / 100;
+    ULONG Opened = Old->Count / 100;
+    ULONG Count = Old->Count - Closed + Opened;
+
+    RtlZeroMemory(Expected, sizeof(DIFF_COUNTS));
+    if (!MakeSnapshot(New, Old->Kind, Old->Family, Old->Class, Count)) {
+        return FALSE;
+    }
+
+    auto From = reinterpret_cast<const MIB_TCPROW_OWNER_PID *>(Old->Rows);
+    auto To = reinterpret_cast<PMIB_TCPROW_OWNER_PID>(New->Rows);
+    ULONG n = 0;
+
+    for (ULONG i = Closed; i < Old->Count; i++) { //前面的Closed个关闭了（Old本身是乱序的）。
+        To[n] = From[i];
+        if (i % 100 == 1) {
+            To[n].dwState = MIB_TCP_STATE_CLOSE_WAIT;
+            Expected->StateChanged++;
+        }
+
+        if (i % 1000 == 2) {
+            To[n].dwOwningPid += 1000;
+            Expected->PidChanged++;
+        }
+
+        n++;
+    }
+
+    TABLE_SNAPSHOT Fresh{};
+    if (!MakeSnapshot(&Fresh, Old->Kind, Old->Family, Old->Class, Opened)) {
+        TableSnapshotFree(New);
+        return FALSE;
+    }
+
+    FillTcp4(&Fresh, Seed);
+    RtlCopyMemory(&To[n], Fresh.Rows, (SIZE_T)Opened * sizeof(MIB_TCPROW_OWNER_PID));
+    TableSnapshotFree(&Fresh);
+
+    Shuffle(New, Seed);
+    Expected->Opened = Opened;
+    Expected->Closed = Closed;
+    return TRUE;
+}
+
+
+static BOOL SameCounts(_In_ const DIFF_COUNTS * A, _In_ const DIFF_COUNTS * B)
+{
+    return A->Opened == B->Opened && A->Closed == B->Closed && A->StateChanged == B->StateChanged &&
+           A->PidChanged == B->PidChanged;
+}
+
+
+static BOOL VerifyDuplicates()
+/*
+功能：同一个四元组的多行（UDP的重复绑定）：PID相同的配对，剩下的是PID的变化，再剩下的打开或关闭。
+*/
+{
+    TABLE_SNAPSHOT Old{};
+    TABLE_SNAPSHOT New{};
+    BOOL Ok = MakeSnapshot(&Old, TABLE_SNAPSHOT_UDP_EXTENDED, AF_INET6, UDP_TABLE_OWNER_PID, 4) &&
+              MakeSnapshot(&New, TABLE_SNAPSHOT_UDP_EXTENDED, AF_INET6, UDP_TABLE_OWNER_PID, 5);
+    if (!Ok) {
+        TableSnapshotFree(&Old);
+        return FALSE;
+    }
+
+    //上一次：5353端口的PID 10，20，30，和53端口的PID 40。这次：5353端口的PID 30，10，50，60，和123端口的PID 70。
+    const ULONG OldPids[] = {10, 20, 30, 40};
+    const ULONG NewPids[] = {30, 10, 50, 60, 70};
+    auto OldRows = reinterpret_cast<PMIB_UDP6ROW_OWNER_PID>(Old.Rows);
+    auto NewRows = reinterpret_cast<PMIB_UDP6ROW_OWNER_PID>(New.Rows);
+
+    for (ULONG i = 0; i < 4; i++) {
+        OldRows[i].ucLocalAddr[15] = 1;
+        OldRows[i].dwLocalPort = htons(i < 3 ? 5353 : 53);
+        OldRows[i].dwOwningPid = OldPids[i];
+    }
+
+    for (ULONG i = 0; i < 5; i++) {
+        NewRows[i].ucLocalAddr[15] = 1;
+        NewRows[i].dwLocalPort = htons(i < 4 ? 5353 : 123);
+        NewRows[i].dwOwningPid = NewPids[i];
+    }
+
+    //期望：10和30不变，20->50是PID的变化，60是打开的，53关闭，123打开。
+    DIFF_COUNTS Counts{};
+    DIFF_COUNTS Expected{2, 1, 0, 1, 0};
+    ULONG Status = TableDiffCompare(&Old, &New, CountEvents, &Counts);
+    Ok = ERROR_SUCCESS == Status && SameCounts(&Counts, &Expected) && 4 == Counts.Events;
+
+    TableSnapshotFree(&Old);
+    TableSnapshotFree(&New);
+    return Ok;
+}
+
+
+static BOOL VerifyChurn(_In_ ULONG Flags, _In_ ULONG Count)
+/*
+功能：随机的表和它的变化（见MakeChurn），事件的个数要和构造的一样；再比较一次没有变化的，要没有事件。
+*/
+{
+    UINT64 Seed = 21;
+    TABLE_SNAPSHOT Old{};
+    TABLE_SNAPSHOT New{};
+    DIFF_COUNTS Expected{};
+    DIFF_COUNTS Counts{};
+    DIFF_COUNTS Again{};
+    PTABLE_DIFF Diff = nullptr;
+    BOOL Ok = FALSE;
+
+    if (!MakeSnapshot(&Old, TABLE_SNAPSHOT_TCP_EXTENDED, AF_INET, TCP_TABLE_OWNER_PID_ALL, Count)) {
+        return FALSE;
+    }
+
+    FillTcp4(&Old, &Seed);
+    if (!MakeChurn(&Old, &New, &Seed, &Expected)) {
+        goto Cleanup;
+    }
+
+    if (ERROR_SUCCESS != TableDiffCreate(Flags, &Diff) ||
+        ERROR_SUCCESS != TableDiffUpdate(Diff, &Old, nullptr, nullptr)) {
+        goto Cleanup;
+    }
+
+    if (ERROR_SUCCESS != TableDiffUpdate(Diff, &New, CountEvents, &Counts) || !SameCounts(&Counts, &Expected)) {
+        printf("churn: opened %u/%u, closed %u/%u, state %u/%u, pid %u/%u\n",
+               Counts.Opened,
+               Expected.Opened,
+               Counts.Closed,
+               Expected.Closed,
+               Counts.StateChanged,
+               Expected.StateChanged,
+               Counts.PidChanged,
+               Expected.PidChanged);
+        goto Cleanup;
+    }
+
+    Shuffle(&New, &Seed);
+    Ok = ERROR_SUCCESS == TableDiffUpdate(Diff, &New, CountEvents, &Again) && 0 == Again.Events;
+
+Cleanup:
+    TableDiffDestroy(Diff);
+    TableSnapshotFree(&Old);
+    TableSnapshotFree(&New);
+    return Ok;
+}
+
+
+static double TimeUpdates(_In_ ULONG Flags,
+                          _In_ const TABLE_SNAPSHOT * A,
+                          _In_ const TABLE_SNAPSHOT * B,
+                          _In_ int Rounds,
+                          _Out_ PSIZE_T Bytes,
+                          _Out_ PUINT64 Events)
+/*
+功能：交替地更新A和B（每次都有约3%的变化），返回每次更新的秒数。
+*/
+{
+    LARGE_INTEGER Frequency{};
+    LARGE_INTEGER Start{};
+    LARGE_INTEGER End{};
+    PTABLE_DIFF Diff = nullptr;
+    DIFF_COUNTS Counts{};
+    TABLE_DIFF_INFORMATION Information{};
+
+    *Bytes = 0;
+    *Events = 0;
+    if (ERROR_SUCCESS != TableDiffCreate(Flags, &Diff)) {
+        return 0;
+    }
+
+    TableDiffUpdate(Diff, A, nullptr, nullptr);
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (int i = 0; i < Rounds; i++) {
+        TableDiffUpdate(Diff, (i & 1) ? A : B, CountEvents, &Counts);
+    }
+    QueryPerformanceCounter(&End);
+
+    TableDiffGetInformation(Diff, &Information);
+    *Bytes = Information.Bytes;
+    *Events = Counts.Events;
+    TableDiffDestroy(Diff);
+    return (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart / Rounds;
+}
+
+
+static void TableDiffBenchmark()
+/*
+功能：连接表的增量的验证和基准测试。
+
+1.验证：同一个四元组的多行；随机的表的打开，关闭，状态和PID的变化（完整的和TABLE_DIFF_COMPACT）。
+2.DIFF_BENCH_ROWS个连接，每次约3%的变化，每次更新的时间和占用的内存。
+3.本机的TCP表：两次刷新之间的变化。
+*/
+{
+    ULONG Errors = 0;
+
+    BOOL Duplicates = VerifyDuplicates();
+    BOOL Full = VerifyChurn(0, 20000) && VerifyChurn(0, 30);
+    BOOL Compact = VerifyChurn(TABLE_DIFF_COMPACT, 20000);
+    Errors += (Duplicates ? 0 : 1) + (Full ? 0 : 1) + (Compact ? 0 : 1);
+    printf("verify: duplicates %s, full %s, compact %s\n",
+           Duplicates ? "ok" : "FAILED",
+           Full ? "ok" : "FAILED",
+           Compact ? "ok" : "FAILED");
+
+    UINT64 Seed = 22;
+    TABLE_SNAPSHOT A{};
+    TABLE_SNAPSHOT B{};
+    DIFF_COUNTS Expected{};
+    if (MakeSnapshot(&A, TABLE_SNAPSHOT_TCP_EXTENDED, AF_INET, TCP_TABLE_OWNER_PID_ALL, DIFF_BENCH_ROWS)) {
+        FillTcp4(&A, &Seed);
+        if (MakeChurn(&A, &B, &Seed, &Expected)) {
+            const ULONG Modes[] = {0, TABLE_DIFF_COMPACT};
+            for (ULONG i = 0; i < _countof(Modes); i++) {
+                SIZE_T Bytes = 0;
+                UINT64 Events = 0;
+                double Seconds = TimeUpdates(Modes[i], &A, &B, 10, &Bytes, &Events);
+                printf("%u rows, %-7s: %7.2f ms/update, %6.1f M rows/s, %llu events/update, %.1f MB\n",
+                       DIFF_BENCH_ROWS,
+                       Modes[i] ? "compact" : "full",
+                       Seconds * 1e3,
+                       Seconds > 0 ? DIFF_BENCH_ROWS / Seconds / 1e6 : 0.0,
+                       Events / 10,
+                       Bytes / 1048576.0);
+            }
+
+            TableSnapshotFree(&B);
+        } else {
+            Errors++;
+        }
+
+        TableSnapshotFree(&A);
+    } else {
+        Errors++;
+    }
+
+    TABLE_SNAPSHOT Live{};
+    PTABLE_DIFF Diff = nullptr;
+    DIFF_COUNTS Counts{};
+    TableSnapshotInit(&Live, TABLE_SNAPSHOT_TCP_EXTENDED, AF_INET, TCP_TABLE_OWNER_PID_ALL, FALSE);
+    if (ERROR_SUCCESS == TableDiffCreate(0, &Diff) && ERROR_SUCCESS == TableSnapshotRefresh(&Live) &&
+        ERROR_SUCCESS == TableDiffUpdate(Diff, &Live, nullptr, nullptr)) {
+        Sleep(100);
+        if (ERROR_SUCCESS == TableSnapshotRefresh(&Live) &&
+            ERROR_SUCCESS == TableDiffUpdate(Diff, &Live, CountEvents, &Counts)) {
+            printf("live TCP4: %u rows, 100 ms: opened %u, closed %u, state changed %u, pid changed %u\n",
+                   Live.Count,
+                   Counts.Opened,
+                   Counts.Closed,
+                   Counts.StateChanged,
+                   Counts.PidChanged);
+        } else {
+            Errors++;
+        }
+    } else {
+        Errors++;
+    }
+
+    TableDiffDestroy(Diff);
+    TableSnapshotFree(&Live);
+
+    printf("%s\n", Errors ? "FAILED" : "ok");
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+int _cdecl main()
+{
+    TableDiffBenchmark();
+
+    return 0;
+}
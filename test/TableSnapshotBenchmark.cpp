@@ -0,0 +1,255 @@
+﻿/*
+连接表的快照（TableSnapshot.cpp）的验证和基准测试，结果和本机的连接数有关。
+
+Windows上单独编译运行（不在test.vcxproj的生成里），VS的开发人员命令提示符下：
+cl /std:c++17 /O2 /EHsc /DUNICODE /D_UNICODE /wd4819 TableSnapshotBenchmark.cpp
+
+直接包含TableSnapshot.cpp，验证要用它里面的QueryTable（static的）。
+*/
+
+
+#include "..\libnet\TableSnapshot.cpp"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#define TABLE_BENCH_ROUNDS 200
+
+
+typedef struct _TABLE_BENCH_CASE {
+    PCSTR Name;
+    ULONG Kind;
+    ULONG Family;
+    ULONG Class;
+} TABLE_BENCH_CASE, * PTABLE_BENCH_CASE;
+
+
+static const TABLE_BENCH_CASE BenchCases[] = {
+    {"GetTcpTable", TABLE_SNAPSHOT_TCP, AF_INET, 0},
+    {"GetTcpTable2", TABLE_SNAPSHOT_TCP2, AF_INET, 0},
+    {"GetTcp6Table", TABLE_SNAPSHOT_TCP6, AF_INET6, 0},
+    {"GetTcp6Table2", TABLE_SNAPSHOT_TCP6_2, AF_INET6, 0},
+    {"TCP4 OWNER_PID_ALL", TABLE_SNAPSHOT_TCP_EXTENDED, AF_INET, TCP_TABLE_OWNER_PID_ALL},
+    {"TCP4 OWNER_MODULE_ALL", TABLE_SNAPSHOT_TCP_EXTENDED, AF_INET, TCP_TABLE_OWNER_MODULE_ALL},
+    {"TCP6 OWNER_PID_ALL", TABLE_SNAPSHOT_TCP_EXTENDED, AF_INET6, TCP_TABLE_OWNER_PID_ALL},
+    {"GetUdpTable", TABLE_SNAPSHOT_UDP, AF_INET, 0},
+    {"GetUdp6Table", TABLE_SNAPSHOT_UDP6, AF_INET6, 0},
+    {"UDP4 OWNER_MODULE", TABLE_SNAPSHOT_UDP_EXTENDED, AF_INET, UDP_TABLE_OWNER_MODULE},
+    {"UDP6 OWNER_PID", TABLE_SNAPSHOT_UDP_EXTENDED, AF_INET6, UDP_TABLE_OWNER_PID},
+};
+
+
+static BOOL VerifyLayout()
+/*
+功能：参数的检查。
+*/
+{
+    TABLE_SNAPSHOT Snapshot{};
+    const ULONG Tcp = TABLE_SNAPSHOT_TCP_EXTENDED;
+    const ULONG Udp = TABLE_SNAPSHOT_UDP_EXTENDED;
+
+    if (ERROR_NOT_SUPPORTED != TableSnapshotInit(&Snapshot, Tcp, AF_INET6, TCP_TABLE_BASIC_ALL, FALSE)) {
+        return FALSE;
+    }
+
+    if (ERROR_INVALID_PARAMETER != TableSnapshotInit(&Snapshot, 0, AF_INET, 0, FALSE) ||
+        ERROR_INVALID_PARAMETER != TableSnapshotInit(&Snapshot, Udp, AF_INET, 3, FALSE) ||
+        ERROR_INVALID_PARAMETER != TableSnapshotInit(&Snapshot, Udp, AF_UNSPEC, 0, FALSE)) {
+        return FALSE;
+    }
+
+    if (ERROR_SUCCESS != TableSnapshotInit(&Snapshot, Tcp, AF_INET, TCP_TABLE_OWNER_PID_ALL, FALSE) ||
+        ERROR_SUCCESS != TableSnapshotReserve(&Snapshot, 1000) ||
+        Snapshot.Capacity < FIELD_OFFSET(MIB_TCPTABLE_OWNER_PID, table) + 1000 * sizeof(MIB_TCPROW_OWNER_PID) ||
+        1 != Snapshot.Grows) {
+        TableSnapshotFree(&Snapshot);
+        return FALSE;
+    }
+
+    ULONG Capacity = Snapshot.Capacity;
+    BOOL Ok = ERROR_SUCCESS == TableSnapshotReserve(&Snapshot, 10) && Capacity == Snapshot.Capacity; //只增不减。
+    TableSnapshotFree(&Snapshot);
+    return Ok && nullptr == Snapshot.Buffer;
+}
+
+
+static BOOL VerifyRefresh()
+/*
+功能：每一种表都刷新几次：行的大小和个数要在缓冲区里，稳定时不再申请内存。
+*/
+{
+    for (ULONG i = 0; i < _countof(BenchCases); i++) {
+        const TABLE_BENCH_CASE * Case = &BenchCases[i];
+        TABLE_SNAPSHOT Snapshot{};
+        BOOL Ok = TRUE;
+
+        TableSnapshotInit(&Snapshot, Case->Kind, Case->Family, Case->Class, FALSE);
+        for (int Round = 0; Round < 3 && Ok; Round++) {
+            ULONG Status = TableSnapshotRefresh(&Snapshot);
+            if (ERROR_SUCCESS != Status) {
+                printf("%s: %d\n", Case->Name, Status);
+                Ok = FALSE;
+                break;
+            }
+
+            ULONGLONG Offset = (PUCHAR)Snapshot.Rows - (PUCHAR)Snapshot.Buffer;
+            Ok = Snapshot.Rows && Offset + (ULONGLONG)Snapshot.Count * Snapshot.RowSize <= Snapshot.Capacity;
+        }
+
+        //连接的增减一般在预留的范围内，3次刷新最多再增大一次。
+        Ok = Ok && 3 == Snapshot.Refreshes && Snapshot.Grows <= 2;
+        TableSnapshotFree(&Snapshot);
+        if (!Ok) {
+            printf("%s: verify failed\n", Case->Name);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+static BOOL VerifyRows()
+/*
+功能：按类型访问的行的个数和位置。
+*/
+{
+    TABLE_SNAPSHOT Snapshot{};
+    TableSnapshotInit(&Snapshot, TABLE_SNAPSHOT_UDP_EXTENDED, AF_INET, UDP_TABLE_OWNER_PID, TRUE);
+    if (ERROR_SUCCESS != TableSnapshotRefresh(&Snapshot)) {
+        TableSnapshotFree(&Snapshot);
+        return FALSE;
+    }
+
+    auto Rows = TableSnapshotRows<MIB_UDPROW_OWNER_PID>(&Snapshot);
+    ULONG Count = 0;
+    for (auto & Row : Rows) {
+        UNREFERENCED_PARAMETER(Row);
+        Count++;
+    }
+
+    BOOL Ok = Count == Snapshot.Count && (0 == Count || &Rows[0] == Snapshot.Rows);
+    TableSnapshotFree(&Snapshot);
+    return Ok;
+}
+
+
+static double TimeOld(_In_ const TABLE_BENCH_CASE * Case, _Out_ PULONG Failures)
+/*
+功能：原来的EnumExtendedTcpTable等的做法：申请表头，调用，释放，申请，再调用，释放。
+*/
+{
+    LARGE_INTEGER Frequency{};
+    LARGE_INTEGER Start{};
+    LARGE_INTEGER End{};
+    TABLE_SNAPSHOT Probe{};
+
+    *Failures = 0;
+    TableSnapshotInit(&Probe, Case->Kind, Case->Family, Case->Class, FALSE);
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (int i = 0; i < TABLE_BENCH_ROUNDS; i++) {
+        Probe.Buffer = MALLOC(sizeof(MIB_TCPTABLE_OWNER_PID));
+        ULONG Size = sizeof(MIB_TCPTABLE_OWNER_PID);
+        ULONG Status = QueryTable(&Probe, &Size);
+        if (ERROR_INSUFFICIENT_BUFFER == Status) {
+            FREE(Probe.Buffer);
+            Probe.Buffer = MALLOC(Size);
+            Status = Probe.Buffer ? QueryTable(&Probe, &Size) : ERROR_NOT_ENOUGH_MEMORY;
+        }
+
+        *Failures += ERROR_SUCCESS == Status ? 0 : 1;
+        if (Probe.Buffer) {
+            FREE(Probe.Buffer);
+        }
+    }
+    QueryPerformanceCounter(&End);
+
+    Probe.Buffer = nullptr;
+    return (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+}
+
+
+static double TimeSnapshot(_In_ const TABLE_BENCH_CASE * Case, _Out_ PULONG Failures, _Out_ PULONG Grows)
+{
+    LARGE_INTEGER Frequency{};
+    LARGE_INTEGER Start{};
+    LARGE_INTEGER End{};
+    TABLE_SNAPSHOT Snapshot{};
+
+    *Failures = 0;
+    TableSnapshotInit(&Snapshot, Case->Kind, Case->Family, Case->Class, FALSE);
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (int i = 0; i < TABLE_BENCH_ROUNDS; i++) {
+        *Failures += ERROR_SUCCESS == TableSnapshotRefresh(&Snapshot) ? 0 : 1;
+    }
+    QueryPerformanceCounter(&End);
+
+    *Grows = Snapshot.Grows;
+    TableSnapshotFree(&Snapshot);
+    return (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+}
+
+
+static void TableSnapshotBenchmark()
+/*
+功能：快照的验证和基准测试。
+
+1.验证：参数，每种表的刷新，按类型访问。
+2.每种表刷新TABLE_BENCH_ROUNDS次，原来的做法（两次调用，两次申请）和快照的比较。
+  结果和本机的连接数有关，连接越多差距越大。
+*/
+{
+    ULONG Errors = 0;
+
+    BOOL Layout = VerifyLayout();
+    BOOL Refresh = VerifyRefresh();
+    BOOL Rows = VerifyRows();
+    Errors += (Layout ? 0 : 1) + (Refresh ? 0 : 1) + (Rows ? 0 : 1);
+    printf("verify: layout %s, refresh %s, rows %s\n",
+           Layout ? "ok" : "FAILED",
+           Refresh ? "ok" : "FAILED",
+           Rows ? "ok" : "FAILED");
+
+    for (ULONG i = 0; i < _countof(BenchCases); i++) {
+        const TABLE_BENCH_CASE * Case = &BenchCases[i];
+        TABLE_SNAPSHOT Snapshot{};
+        ULONG OldFailures = 0;
+        ULONG NewFailures = 0;
+        ULONG Grows = 0;
+
+        TableSnapshotInit(&Snapshot, Case->Kind, Case->Family, Case->Class, FALSE);
+        TableSnapshotRefresh(&Snapshot);
+
+        double Old = TimeOld(Case, &OldFailures);
+        double New = TimeSnapshot(Case, &NewFailures, &Grows);
+        Errors += OldFailures || NewFailures ? 1 : 0;
+
+        printf("%-22s rows:%-7u old:%8.1f us/refresh  snapshot:%8.1f us/refresh  (%.2fx, grows:%u)\n",
+               Case->Name,
+               Snapshot.Count,
+               Old * 1e6 / TABLE_BENCH_ROUNDS,
+               New * 1e6 / TABLE_BENCH_ROUNDS,
+               New > 0 ? Old / New : 0.0,
+               Grows);
+
+        TableSnapshotFree(&Snapshot);
+    }
+
+    printf("%s\n", Errors ? "FAILED" : "ok");
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+int _cdecl main()
+{
+    TableSnapshotBenchmark();
+
+    return 0;
+}